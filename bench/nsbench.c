@@ -0,0 +1,567 @@
+/* nsbench.c -- Measure the read throughput of Kongsberg files.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+
+   Each file is read to the end once in each of the read modes below, and the
+   time, the throughput in MB/s of the file size, and the datagrams per second
+   are printed for each mode, followed by the number and size of the datagrams
+   of each type returned.  The datagrams of all unknown types are counted
+   together.  The best of the repeated reads of a mode is reported, so the
+   first read also warms the page cache.  The format of each
+   file is found from its contents, and files made by nsgen may be used.
+
+   plain      kma_open() or emx_open() with the default settings.
+   ignore-wc  The water column datagrams are skipped.
+   filter     Only the bathymetry datagrams (MRZ, or XYZ 88 and depth) are read.
+   mmap       kma_open_mmap() or emx_open_mmap().
+   block      A 4 MiB file block.
+   async-io   Eight queued 1 MiB reads.
+   prefetch   An I/O thread reads eight datagrams ahead.
+   chunks     kma_read_chunks() or emx_read_chunks() with one thread per processor.
+
+   Usage: nsbench [-s] [-r repeats] [-j threads] file ...
+
+   -s           Skip corrupt data with kma_set_resync() or emx_set_resync().
+   -r repeats   Number of reads of each mode (default 3).
+   -j threads   Number of threads of the chunks mode (default one per processor).
+
+   Compile from the top directory with:
+
+   cc -O2 -D_GNU_SOURCE -I. -o nsbench bench/nsbench.c *.c -lm -lpthread */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "kma_reader.h"
+#include "emx_reader.h"
+#include "cpl_alloc.h"
+#include "cpl_error.h"
+#include "cpl_thread.h"
+
+
+/* Read Modes */
+#define BENCH_PLAIN      0
+#define BENCH_IGNORE_WC  1
+#define BENCH_FILTER     2
+#define BENCH_MMAP       3
+#define BENCH_BLOCK      4
+#define BENCH_ASYNC_IO   5
+#define BENCH_PREFETCH   6
+#define BENCH_CHUNKS     7
+#define BENCH_NUM_MODES  8
+
+/* Maximum Number of Datagram Types */
+#define BENCH_MAX_TYPES  64
+
+
+/* Read Result */
+typedef struct {
+    uint64_t time;                        /* Time of the read in nanoseconds.                           */
+    uint64_t num_datagrams;               /* Number of datagrams returned.                              */
+    size_t num_types;                     /* Number of datagram types returned.                         */
+    uint32_t type[BENCH_MAX_TYPES];       /* Datagram types in the order first returned.                */
+    uint64_t count[BENCH_MAX_TYPES];      /* Number of datagrams returned of each type.                 */
+    uint64_t bytes[BENCH_MAX_TYPES];      /* Size of the datagrams returned of each type in bytes.      */
+} bench_result;
+
+
+/* Chunk Results */
+typedef struct {
+    bench_result *result;                 /* Array of num_chunks results.                               */
+    size_t num_chunks;                    /* Number of chunks.                                          */
+    int resync;                           /* Skip corrupt data if true.                                 */
+} bench_chunks;
+
+
+/* External Variable */
+int cpl_lib_debug = 0;
+
+
+/* Private Function Prototypes */
+static uint64_t bench_clock (void);
+static void bench_add (bench_result *, const uint32_t, const uint64_t, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void bench_print (const char *, const int, const bench_result *, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int bench_chunks_init (bench_chunks *, const size_t, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+static void bench_chunks_join (bench_chunks *, bench_result *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int bench_kma (const char *, const int, const int, const int, bench_result *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int bench_kma_chunk (kma_handle *, const kma_data *, const size_t, void *) CPL_ATTRIBUTE_NONNULL (1) CPL_ATTRIBUTE_NONNULL (4);
+static int bench_emx (const char *, const int, const int, const int, bench_result *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int bench_emx_chunk (emx_handle *, const emx_data *, const size_t, void *) CPL_ATTRIBUTE_NONNULL (1) CPL_ATTRIBUTE_NONNULL (4);
+
+
+/* Names of the Read Modes */
+static const char *bench_mode_name[BENCH_NUM_MODES] = {
+    "plain", "ignore-wc", "filter", "mmap", "block", "async-io", "prefetch", "chunks"
+};
+
+
+int main (
+    int argc,
+    char **argv) {
+
+    bench_result best, r;
+    struct stat st;
+    unsigned long repeats = 3;
+    unsigned long i;
+    int num_threads = 0;
+    int resync = 0;
+    int is_kma;
+    int mode;
+    int status;
+    int c;
+
+
+    while ((c = getopt (argc, argv, "sr:j:")) != -1) {
+        switch (c) {
+            case 's' : resync = 1; break;
+            case 'r' : repeats = strtoul (optarg, NULL, 10); break;
+            case 'j' : num_threads = atoi (optarg); break;
+            default :
+                fprintf (stderr, "Usage: %s [-s] [-r repeats] [-j threads] file ...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if ((optind >= argc) || (repeats == 0)) {
+        fprintf (stderr, "Usage: %s [-s] [-r repeats] [-j threads] file ...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (num_threads <= 0) {
+        num_threads = cpl_thread_num_cpus ();
+    }
+
+    for (; optind<argc; optind++) {
+        if (stat (argv[optind], &st) != 0) {
+            fprintf (stderr, "Unable to find %s\n", argv[optind]);
+            return EXIT_FAILURE;
+        }
+
+        if (kma_identify (argv[optind]) > 0) {
+            is_kma = 1;
+        } else if (emx_identify (argv[optind]) > 0) {
+            is_kma = 0;
+        } else {
+            fprintf (stderr, "Unknown file format: %s\n", argv[optind]);
+            return EXIT_FAILURE;
+        }
+
+        printf ("%s: %.2f MB, %s, %d threads\n", argv[optind], st.st_size / 1.0e6, (is_kma) ? "kmall" : "all", num_threads);
+        printf ("%-10s %10s %10s %12s\n", "mode", "time (s)", "MB/s", "datagrams/s");
+        printf ("  %-32s %10s %10s\n", "type", "count", "MB");
+
+        for (mode=0; mode<BENCH_NUM_MODES; mode++) {
+            status = 0;
+            for (i=0; (i<repeats) && (status == 0); i++) {
+                if (is_kma) {
+                    status = bench_kma (argv[optind], mode, num_threads, resync, &r);
+                } else {
+                    status = bench_emx (argv[optind], mode, num_threads, resync, &r);
+                }
+                if ((status == 0) && ((i == 0) || (r.time < best.time))) {
+                    best = r;
+                }
+            }
+
+            if (status == CS_EUNSUP) {
+                printf ("%-10s not supported\n", bench_mode_name[mode]);
+            } else if (status != 0) {
+                printf ("%-10s error %d\n", bench_mode_name[mode], status);
+            } else {
+                bench_print (bench_mode_name[mode], is_kma, &best, (uint64_t) st.st_size);
+            }
+        }
+
+        printf ("\n");
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/******************************************************************************
+*
+* bench_clock - Return the time of a monotonic clock in nanoseconds.
+*
+******************************************************************************/
+
+static uint64_t bench_clock (void) {
+
+    struct timespec ts;
+
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+
+/******************************************************************************
+*
+* bench_add - Count N datagrams of TYPE with a total size of BYTES in the
+*   result R.  Types after the first BENCH_MAX_TYPES are only counted in the
+*   total.
+*
+******************************************************************************/
+
+static void bench_add (
+    bench_result *r,
+    const uint32_t type,
+    const uint64_t n,
+    const uint64_t bytes) {
+
+    size_t i;
+
+
+    r->num_datagrams += n;
+
+    for (i=0; i<r->num_types; i++) {
+        if (r->type[i] == type) {
+            break;
+        }
+    }
+
+    if (i == r->num_types) {
+        if (r->num_types == BENCH_MAX_TYPES) {
+            return;
+        }
+        r->type[i] = type;
+        r->count[i] = 0;
+        r->bytes[i] = 0;
+        r->num_types++;
+    }
+
+    r->count[i] += n;
+    r->bytes[i] += bytes;
+}
+
+
+/******************************************************************************
+*
+* bench_print - Print the result R of the read mode NAME of a file of SIZE
+*   bytes, followed by the number and size of the datagrams of each type.  The
+*   types with the same name, which are the unknown types, share one row.
+*
+******************************************************************************/
+
+static void bench_print (
+    const char *name,
+    const int is_kma,
+    const bench_result *r,
+    const uint64_t size) {
+
+    const char *type_name[BENCH_MAX_TYPES];
+    uint64_t count, bytes;
+    double seconds;
+    size_t i, j;
+
+
+    seconds = (r->time > 0) ? r->time / 1.0e9 : 1.0e-9;
+
+    printf ("%-10s %10.4f %10.1f %12.0f\n", name, seconds, size / 1.0e6 / seconds, r->num_datagrams / seconds);
+
+    for (i=0; i<r->num_types; i++) {
+        type_name[i] = (is_kma) ? kma_get_datagram_name (r->type[i]) : emx_get_datagram_name ((uint8_t) r->type[i]);
+    }
+
+    for (i=0; i<r->num_types; i++) {
+        for (j=0; j<i; j++) {
+            if (strcmp (type_name[j], type_name[i]) == 0) {
+                break;
+            }
+        }
+        if (j < i) {
+            continue;
+        }
+
+        count = 0;
+        bytes = 0;
+        for (j=i; j<r->num_types; j++) {
+            if (strcmp (type_name[j], type_name[i]) == 0) {
+                count += r->count[j];
+                bytes += r->bytes[j];
+            }
+        }
+
+        printf ("  %-32s %10llu %10.1f\n", type_name[i], (unsigned long long) count, bytes / 1.0e6);
+    }
+}
+
+
+/******************************************************************************
+*
+* bench_chunks_init - Allocate NUM_CHUNKS empty results in C, which skip
+*   corrupt data if RESYNC is true.
+*
+* Return: 0 if the results were allocated, or
+*         CS_ENOMEM if memory could not be allocated.
+*
+******************************************************************************/
+
+static int bench_chunks_init (
+    bench_chunks *c,
+    const size_t num_chunks,
+    const int resync) {
+
+    c->result = cpl_calloc (num_chunks, sizeof (bench_result));
+    if (c->result == NULL) {
+        return CS_ENOMEM;
+    }
+    c->num_chunks = num_chunks;
+    c->resync = resync;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* bench_chunks_join - Add the results of the chunks in C to the result R and
+*   free the results of the chunks.
+*
+******************************************************************************/
+
+static void bench_chunks_join (
+    bench_chunks *c,
+    bench_result *r) {
+
+    size_t i, j;
+
+
+    for (i=0; i<c->num_chunks; i++) {
+        for (j=0; j<c->result[i].num_types; j++) {
+            bench_add (r, c->result[i].type[j], c->result[i].count[j], c->result[i].bytes[j]);
+        }
+    }
+
+    cpl_free (c->result);
+}
+
+
+/******************************************************************************
+*
+* bench_kma - Read the KMA file FILE_NAME to the end in the read mode MODE and
+*   store the time and the datagram counts in R.  The chunks mode uses
+*   NUM_THREADS threads, and corrupt data is skipped if RESYNC is true.
+*
+* Return: 0 if the file was read, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EUNSUP if the read mode is not supported
+*         Any error from the reader
+*
+******************************************************************************/
+
+static int bench_kma (
+    const char *file_name,
+    const int mode,
+    const int num_threads,
+    const int resync,
+    bench_result *r) {
+
+    static const uint32_t mrz = KMA_DATAGRAM_MRZ;
+    kma_handle *h;
+    kma_data *d;
+    bench_chunks c;
+    uint64_t start;
+    int status = 0;
+
+
+    memset (r, 0, sizeof (bench_result));
+
+    start = bench_clock ();
+
+    if (mode == BENCH_CHUNKS) {
+        status = bench_chunks_init (&c, (size_t) num_threads * 4, resync);
+        if (status == 0) {
+            status = kma_read_chunks (file_name, c.num_chunks, num_threads, 0, bench_kma_chunk, &c);
+            r->time = bench_clock () - start;
+            bench_chunks_join (&c, r);
+        }
+        return status;
+    }
+
+    h = (mode == BENCH_MMAP) ? kma_open_mmap (file_name) : kma_open (file_name);
+    if (h == NULL) {
+        return CS_EOPEN;
+    }
+
+    kma_set_resync (h, resync);
+
+    switch (mode) {
+        case BENCH_IGNORE_WC : kma_set_ignore_mwc (h, 1); break;
+        case BENCH_FILTER : status = kma_set_type_filter (h, &mrz, 1, 0); break;
+        case BENCH_BLOCK : kma_set_block_size (h, 4 << 20); break;
+        case BENCH_ASYNC_IO :
+            kma_set_block_size (h, 1 << 20);
+            status = kma_set_async_io (h, 8, 0);
+            break;
+        case BENCH_PREFETCH : status = kma_set_prefetch (h, 8, 1 << 20); break;
+        default : break;
+    }
+
+    if (status == 0) {
+        while ((d = kma_read (h)) != NULL) {
+            bench_add (r, d->header.dgmType, 1, d->header.numBytesDgm);
+        }
+        status = kma_get_errno (h);
+    }
+
+    r->time = bench_clock () - start;
+
+    kma_close (h);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* bench_kma_chunk - Count the datagram D of chunk CHUNK in the chunk results
+*   USER_DATA.  The handle H of the chunk is set to skip corrupt data when it
+*   is opened.
+*
+* Return: 0 to read the rest of the chunk.
+*
+******************************************************************************/
+
+static int bench_kma_chunk (
+    kma_handle *h,
+    const kma_data *d,
+    const size_t chunk,
+    void *user_data) {
+
+    bench_chunks *c = user_data;
+
+
+    if (d == NULL) {
+        kma_set_resync (h, c->resync);
+    } else if (chunk < c->num_chunks) {
+        bench_add (&(c->result[chunk]), d->header.dgmType, 1, d->header.numBytesDgm);
+    }
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* bench_emx - Read the EMX file FILE_NAME to the end in the read mode MODE and
+*   store the time and the datagram counts in R.  The chunks mode uses
+*   NUM_THREADS threads, and corrupt data is skipped if RESYNC is true.
+*
+* Return: 0 if the file was read, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EUNSUP if the read mode is not supported
+*         Any error from the reader
+*
+******************************************************************************/
+
+static int bench_emx (
+    const char *file_name,
+    const int mode,
+    const int num_threads,
+    const int resync,
+    bench_result *r) {
+
+    static const uint8_t bathymetry[2] = {EMX_DATAGRAM_XYZ, EMX_DATAGRAM_DEPTH};
+    emx_handle *h;
+    emx_data *d;
+    bench_chunks c;
+    uint64_t start;
+    int status = 0;
+
+
+    memset (r, 0, sizeof (bench_result));
+
+    start = bench_clock ();
+
+    if (mode == BENCH_CHUNKS) {
+        status = bench_chunks_init (&c, (size_t) num_threads * 4, resync);
+        if (status == 0) {
+            status = emx_read_chunks (file_name, c.num_chunks, num_threads, 0, bench_emx_chunk, &c);
+            r->time = bench_clock () - start;
+            bench_chunks_join (&c, r);
+        }
+        return status;
+    }
+
+    h = (mode == BENCH_MMAP) ? emx_open_mmap (file_name) : emx_open (file_name);
+    if (h == NULL) {
+        return CS_EOPEN;
+    }
+
+    emx_set_resync (h, resync);
+
+    switch (mode) {
+        case BENCH_IGNORE_WC : emx_set_ignore_wc (h, 1); break;
+        case BENCH_FILTER : status = emx_set_type_filter (h, bathymetry, 2, 0); break;
+        case BENCH_BLOCK : emx_set_block_size (h, 4 << 20); break;
+        case BENCH_ASYNC_IO :
+            emx_set_block_size (h, 1 << 20);
+            status = emx_set_async_io (h, 8, 0);
+            break;
+        case BENCH_PREFETCH : status = emx_set_prefetch (h, 8, 1 << 20); break;
+        default : break;
+    }
+
+    if (status == 0) {
+        while ((d = emx_read (h)) != NULL) {
+            bench_add (r, d->header.datagram_type, 1, d->header.bytes_in_datagram + sizeof (uint32_t));
+        }
+        status = emx_get_errno (h);
+    }
+
+    r->time = bench_clock () - start;
+
+    emx_close (h);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* bench_emx_chunk - Count the datagram D of chunk CHUNK in the chunk results
+*   USER_DATA.  The handle H of the chunk is set to skip corrupt data when it
+*   is opened.
+*
+* Return: 0 to read the rest of the chunk.
+*
+******************************************************************************/
+
+static int bench_emx_chunk (
+    emx_handle *h,
+    const emx_data *d,
+    const size_t chunk,
+    void *user_data) {
+
+    bench_chunks *c = user_data;
+
+
+    if (d == NULL) {
+        emx_set_resync (h, c->resync);
+    } else if (chunk < c->num_chunks) {
+        bench_add (&(c->result[chunk]), d->header.datagram_type, 1, d->header.bytes_in_datagram + sizeof (uint32_t));
+    }
+
+    return 0;
+}
@@ -0,0 +1,961 @@
+/* nsgen.c -- Generate a synthetic Kongsberg file for benchmarks and tests.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+
+   A .kmall file is written with MRZ, MWC, and SKM datagrams for each ping,
+   and a .all file is written with depth, XYZ 88, seabed image 89, water
+   column, and attitude datagrams for each ping.  The format is chosen by the
+   extension of the file name.  The fields are placed with the datagram
+   structs of the readers, so the layout follows the headers.  A .all file
+   may be written in either byte order, and the datagram headers may be
+   corrupted to test resynchronization.
+
+   Usage: nsgen [-B] [-W] [-n pings] [-b beams] [-s samples] [-c interval] [-r seed] file
+
+   -B           Write a .all file in big-endian byte order.
+   -W           Do not write water column datagrams.
+   -n pings     Number of pings (default 1000).
+   -b beams     Number of beams of each ping (default 256, at most 255 for .all depth).
+   -s samples   Number of water column samples of each beam (default 200).
+   -c interval  Corrupt the header of every INTERVAL-th datagram.
+   -r seed      Seed of the random numbers (default 1).
+
+   Compile from the top directory with:
+
+   cc -O2 -D_GNU_SOURCE -I. -o nsgen bench/nsgen.c *.c -lm -lpthread */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "kma_reader.h"
+#include "emx_reader.h"
+#include "cpl_alloc.h"
+#include "cpl_error.h"
+
+
+/* Datagram Buffer */
+typedef struct {
+    uint8_t *data;                        /* Datagram being written.                                    */
+    size_t size;                          /* Number of bytes written to data.                           */
+    size_t alloc;                         /* Number of bytes allocated for data.                        */
+    size_t header_size;                   /* Size of the datagram header in bytes.                      */
+    int big_endian;                       /* Write the fields in big-endian byte order if true.         */
+} gen_buffer;
+
+
+/* Generator Options */
+typedef struct {
+    unsigned long num_pings;              /* Number of pings.                                           */
+    unsigned int num_beams;               /* Number of beams of each ping.                              */
+    unsigned int num_samples;             /* Number of water column samples of each beam.               */
+    unsigned long corrupt_interval;       /* Corrupt every corrupt_interval-th datagram or zero.        */
+    int big_endian;                       /* Write a .all file in big-endian byte order if true.        */
+    int water_column;                     /* Write water column datagrams if true.                      */
+    uint64_t seed;                        /* State of the random numbers.                               */
+    unsigned long num_datagrams;          /* Number of datagrams written.                               */
+    unsigned long num_corrupted;          /* Number of datagrams corrupted.                             */
+} gen_options;
+
+
+/* External Variable */
+int cpl_lib_debug = 0;
+
+
+/* Private Function Prototypes */
+static size_t gen_reserve (gen_buffer *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_put8 (gen_buffer *, const size_t, const uint8_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_put16 (gen_buffer *, const size_t, const uint16_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_put32 (gen_buffer *, const size_t, const uint32_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_putf (gen_buffer *, const size_t, const float) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_putd (gen_buffer *, const size_t, const double) CPL_ATTRIBUTE_NONNULL_ALL;
+static uint32_t gen_random (gen_options *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int gen_write (FILE *, gen_buffer *, gen_options *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_kma_header (gen_buffer *, const uint32_t, const uint8_t, const unsigned long) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_kma_end (gen_buffer *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_kma_partition (gen_buffer *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_kma_mrz (gen_buffer *, const gen_options *, const unsigned long) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_kma_mwc (gen_buffer *, const gen_options *, const unsigned long) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_kma_skm (gen_buffer *, const unsigned long) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_emx_header (gen_buffer *, const uint8_t, const unsigned long) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_emx_end (gen_buffer *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_emx_depth (gen_buffer *, const gen_options *, const unsigned long) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_emx_xyz (gen_buffer *, const gen_options *, const unsigned long) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_emx_seabed (gen_buffer *, const gen_options *, const unsigned long) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_emx_wc (gen_buffer *, const gen_options *, const unsigned long) CPL_ATTRIBUTE_NONNULL_ALL;
+static void gen_emx_attitude (gen_buffer *, const unsigned long) CPL_ATTRIBUTE_NONNULL_ALL;
+static unsigned int gen_seabed_samples (const unsigned int) CPL_ATTRIBUTE_CONST;
+
+
+int main (
+    int argc,
+    char **argv) {
+
+    gen_buffer g;
+    gen_options o;
+    const char *file_name;
+    const char *extension;
+    unsigned long ping;
+    FILE *fp;
+    int is_kma;
+    int status = 0;
+    int c;
+
+
+    memset (&o, 0, sizeof (gen_options));
+    o.num_pings = 1000;
+    o.num_beams = 256;
+    o.num_samples = 200;
+    o.water_column = 1;
+    o.seed = 1;
+
+    while ((c = getopt (argc, argv, "BWn:b:s:c:r:")) != -1) {
+        switch (c) {
+            case 'B' : o.big_endian = 1; break;
+            case 'W' : o.water_column = 0; break;
+            case 'n' : o.num_pings = strtoul (optarg, NULL, 10); break;
+            case 'b' : o.num_beams = (unsigned int) strtoul (optarg, NULL, 10); break;
+            case 's' : o.num_samples = (unsigned int) strtoul (optarg, NULL, 10); break;
+            case 'c' : o.corrupt_interval = strtoul (optarg, NULL, 10); break;
+            case 'r' : o.seed = strtoull (optarg, NULL, 10); break;
+            default :
+                fprintf (stderr, "Usage: %s [-B] [-W] [-n pings] [-b beams] [-s samples] [-c interval] [-r seed] file\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        fprintf (stderr, "Usage: %s [-B] [-W] [-n pings] [-b beams] [-s samples] [-c interval] [-r seed] file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    file_name = argv[optind];
+    extension = strrchr (file_name, '.');
+    if ((extension != NULL) && (strcmp (extension, ".kmall") == 0)) {
+        is_kma = 1;
+    } else if ((extension != NULL) && (strcmp (extension, ".all") == 0)) {
+        is_kma = 0;
+    } else {
+        fprintf (stderr, "The file name must end with .kmall or .all: %s\n", file_name);
+        return EXIT_FAILURE;
+    }
+
+    /* The beam counts are limited by the sizes of the count fields. */
+    if ((o.num_beams == 0) || (o.num_beams > UINT16_MAX) || (o.num_samples > UINT16_MAX) || (o.seed == 0)) {
+        fprintf (stderr, "Invalid number of beams or samples, or a zero seed\n");
+        return EXIT_FAILURE;
+    }
+
+    fp = fopen (file_name, "wb");
+    if (fp == NULL) {
+        fprintf (stderr, "Unable to create %s\n", file_name);
+        return EXIT_FAILURE;
+    }
+
+    memset (&g, 0, sizeof (gen_buffer));
+    g.header_size = (is_kma) ? sizeof (kma_datagram_header) : sizeof (emx_datagram_header);
+    g.big_endian = (!is_kma && o.big_endian);
+
+    for (ping=0; (ping<o.num_pings) && (status == 0); ping++) {
+        if (is_kma) {
+            gen_kma_skm (&g, ping);
+            status = gen_write (fp, &g, &o);
+            if (status == 0) {
+                gen_kma_mrz (&g, &o, ping);
+                status = gen_write (fp, &g, &o);
+            }
+            if ((status == 0) && o.water_column) {
+                gen_kma_mwc (&g, &o, ping);
+                status = gen_write (fp, &g, &o);
+            }
+        } else {
+            gen_emx_attitude (&g, ping);
+            status = gen_write (fp, &g, &o);
+            if (status == 0) {
+                gen_emx_depth (&g, &o, ping);
+                status = gen_write (fp, &g, &o);
+            }
+            if (status == 0) {
+                gen_emx_xyz (&g, &o, ping);
+                status = gen_write (fp, &g, &o);
+            }
+            if (status == 0) {
+                gen_emx_seabed (&g, &o, ping);
+                status = gen_write (fp, &g, &o);
+            }
+            if ((status == 0) && o.water_column) {
+                gen_emx_wc (&g, &o, ping);
+                status = gen_write (fp, &g, &o);
+            }
+        }
+    }
+
+    if (g.data) {
+        cpl_free (g.data);
+    }
+
+    if ((fclose (fp) != 0) || (status != 0)) {
+        fprintf (stderr, "Unable to write %s\n", file_name);
+        return EXIT_FAILURE;
+    }
+
+    printf ("%s: %lu pings, %lu datagrams, %lu corrupted\n", file_name, o.num_pings, o.num_datagrams, o.num_corrupted);
+
+    return EXIT_SUCCESS;
+}
+
+
+/******************************************************************************
+*
+* gen_reserve - Append N zero bytes to the datagram buffer G.
+*
+* Return: The offset of the bytes from the start of the datagram.
+*
+******************************************************************************/
+
+static size_t gen_reserve (
+    gen_buffer *g,
+    const size_t n) {
+
+    size_t offset;
+    size_t alloc;
+    uint8_t *data;
+
+
+    if (g->size + n > g->alloc) {
+        alloc = g->alloc;
+        data = cpl_realloc2 (g->data, g->size + n, 1, &alloc);
+        if (data == NULL) {
+            fprintf (stderr, "Out of memory\n");
+            exit (EXIT_FAILURE);
+        }
+        g->data = data;
+        g->alloc = alloc;
+    }
+
+    offset = g->size;
+    memset (g->data + offset, 0, n);
+    g->size += n;
+
+    return offset;
+}
+
+
+/******************************************************************************
+*
+* gen_put8 - Set the byte at OFFSET of the datagram buffer G to VALUE.
+*
+******************************************************************************/
+
+static void gen_put8 (
+    gen_buffer *g,
+    const size_t offset,
+    const uint8_t value) {
+
+    g->data[offset] = value;
+}
+
+
+/******************************************************************************
+*
+* gen_put16 - Set the 16-bit field at OFFSET of the datagram buffer G to VALUE
+*   in the byte order of G.
+*
+******************************************************************************/
+
+static void gen_put16 (
+    gen_buffer *g,
+    const size_t offset,
+    const uint16_t value) {
+
+    if (g->big_endian) {
+        g->data[offset] = (uint8_t) (value >> 8);
+        g->data[offset+1] = (uint8_t) value;
+    } else {
+        g->data[offset] = (uint8_t) value;
+        g->data[offset+1] = (uint8_t) (value >> 8);
+    }
+}
+
+
+/******************************************************************************
+*
+* gen_put32 - Set the 32-bit field at OFFSET of the datagram buffer G to VALUE
+*   in the byte order of G.
+*
+******************************************************************************/
+
+static void gen_put32 (
+    gen_buffer *g,
+    const size_t offset,
+    const uint32_t value) {
+
+    if (g->big_endian) {
+        gen_put16 (g, offset, (uint16_t) (value >> 16));
+        gen_put16 (g, offset + 2, (uint16_t) value);
+    } else {
+        gen_put16 (g, offset, (uint16_t) value);
+        gen_put16 (g, offset + 2, (uint16_t) (value >> 16));
+    }
+}
+
+
+/******************************************************************************
+*
+* gen_putf - Set the float field at OFFSET of the datagram buffer G to VALUE
+*   in the byte order of G.
+*
+******************************************************************************/
+
+static void gen_putf (
+    gen_buffer *g,
+    const size_t offset,
+    const float value) {
+
+    uint32_t u;
+
+
+    memcpy (&u, &value, sizeof (uint32_t));
+    gen_put32 (g, offset, u);
+}
+
+
+/******************************************************************************
+*
+* gen_putd - Set the double field at OFFSET of the datagram buffer G to VALUE
+*   in the byte order of G.
+*
+******************************************************************************/
+
+static void gen_putd (
+    gen_buffer *g,
+    const size_t offset,
+    const double value) {
+
+    uint64_t u;
+
+
+    memcpy (&u, &value, sizeof (uint64_t));
+    if (g->big_endian) {
+        gen_put32 (g, offset, (uint32_t) (u >> 32));
+        gen_put32 (g, offset + 4, (uint32_t) u);
+    } else {
+        gen_put32 (g, offset, (uint32_t) u);
+        gen_put32 (g, offset + 4, (uint32_t) (u >> 32));
+    }
+}
+
+
+/******************************************************************************
+*
+* gen_random - Get the next random number of the xorshift generator of O.
+*
+* Return: A random 32-bit number.
+*
+******************************************************************************/
+
+static uint32_t gen_random (
+    gen_options *o) {
+
+    o->seed ^= o->seed << 13;
+    o->seed ^= o->seed >> 7;
+    o->seed ^= o->seed << 17;
+
+    return (uint32_t) (o->seed >> 32);
+}
+
+
+/******************************************************************************
+*
+* gen_write - Write the datagram in the buffer G to the file FP and empty the
+*   buffer.  If the datagram is the corrupt_interval-th datagram of O, then a
+*   random region of the datagram header is overwritten with random bytes
+*   before the datagram is written.  Only the headers are corrupted, since
+*   resync skips datagrams with an invalid header or size, while a corrupt
+*   body of a KMA datagram is an error.
+*
+* Return: 0 if the datagram was written, or
+*         -1 if the write failed.
+*
+******************************************************************************/
+
+static int gen_write (
+    FILE *fp,
+    gen_buffer *g,
+    gen_options *o) {
+
+    size_t offset;
+    size_t length;
+    size_t i;
+
+
+    o->num_datagrams++;
+
+    if ((o->corrupt_interval > 0) && ((o->num_datagrams % o->corrupt_interval) == 0)) {
+        offset = gen_random (o) % g->header_size;
+        length = 1 + gen_random (o) % (g->header_size - offset);
+        for (i=0; i<length; i++) {
+            g->data[offset+i] = (uint8_t) gen_random (o);
+        }
+        o->num_corrupted++;
+    }
+
+    if (fwrite (g->data, 1, g->size, fp) != g->size) {
+        return -1;
+    }
+
+    g->size = 0;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* gen_kma_header - Start a KMA datagram of TYPE and VERSION for PING in the
+*   datagram buffer G.  The pings are half a second apart.
+*
+******************************************************************************/
+
+static void gen_kma_header (
+    gen_buffer *g,
+    const uint32_t type,
+    const uint8_t version,
+    const unsigned long ping) {
+
+    size_t h;
+
+
+    h = gen_reserve (g, sizeof (kma_datagram_header));
+    gen_put32 (g, h + offsetof (kma_datagram_header, dgmType), type);
+    gen_put8 (g, h + offsetof (kma_datagram_header, dgmVersion), version);
+    gen_put16 (g, h + offsetof (kma_datagram_header, echoSounderID), 2040);
+    gen_put32 (g, h + offsetof (kma_datagram_header, time_sec), (uint32_t) (1600000000 + ping / 2));
+    gen_put32 (g, h + offsetof (kma_datagram_header, time_nanosec), (uint32_t) ((ping % 2) * 500000000));
+}
+
+
+/******************************************************************************
+*
+* gen_kma_end - Finish the KMA datagram in the datagram buffer G by setting
+*   the datagram size at the start and the end.
+*
+******************************************************************************/
+
+static void gen_kma_end (
+    gen_buffer *g) {
+
+    size_t e;
+
+
+    e = gen_reserve (g, sizeof (uint32_t));
+    gen_put32 (g, offsetof (kma_datagram_header, numBytesDgm), (uint32_t) g->size);
+    gen_put32 (g, e, (uint32_t) g->size);
+}
+
+
+/******************************************************************************
+*
+* gen_kma_partition - Add the partition of a datagram that is not split to
+*   the datagram buffer G.
+*
+******************************************************************************/
+
+static void gen_kma_partition (
+    gen_buffer *g) {
+
+    size_t p;
+
+
+    p = gen_reserve (g, sizeof (kma_datagram_m_partition));
+    gen_put16 (g, p + offsetof (kma_datagram_m_partition, numOfDgms), 1);
+    gen_put16 (g, p + offsetof (kma_datagram_m_partition, dgmNum), 1);
+}
+
+
+/******************************************************************************
+*
+* gen_kma_mrz - Write an MRZ datagram for PING to the datagram buffer G with
+*   one TX sector, num_beams soundings in a flat swath, and seabed image
+*   samples for each sounding.
+*
+******************************************************************************/
+
+static void gen_kma_mrz (
+    gen_buffer *g,
+    const gen_options *o,
+    const unsigned long ping) {
+
+    size_t p;
+    size_t sample;
+    unsigned int ns;
+    unsigned int i, j;
+    float angle;
+
+
+    gen_kma_header (g, KMA_DATAGRAM_MRZ, 1, ping);
+    gen_kma_partition (g);
+
+    p = gen_reserve (g, sizeof (kma_datagram_m_common));
+    gen_put16 (g, p + offsetof (kma_datagram_m_common, numBytesCmnPart), sizeof (kma_datagram_m_common));
+    gen_put16 (g, p + offsetof (kma_datagram_m_common, pingCnt), (uint16_t) ping);
+    gen_put8 (g, p + offsetof (kma_datagram_m_common, rxFansPerPing), 1);
+    gen_put8 (g, p + offsetof (kma_datagram_m_common, swathsPerPing), 1);
+    gen_put8 (g, p + offsetof (kma_datagram_m_common, numRxTransducers), 1);
+
+    p = gen_reserve (g, sizeof (kma_datagram_mrz_ping_info));
+    gen_put16 (g, p + offsetof (kma_datagram_mrz_ping_info, numBytesInfoData), sizeof (kma_datagram_mrz_ping_info));
+    gen_putf (g, p + offsetof (kma_datagram_mrz_ping_info, pingRate_Hz), 2.0f);
+    gen_putf (g, p + offsetof (kma_datagram_mrz_ping_info, frequencyMode_Hz), 300000.0f);
+    gen_put16 (g, p + offsetof (kma_datagram_mrz_ping_info, numTxSectors), 1);
+    gen_put16 (g, p + offsetof (kma_datagram_mrz_ping_info, numBytesPerTxSector), sizeof (kma_datagram_mrz_tx_sector_info_v1));
+    gen_putf (g, p + offsetof (kma_datagram_mrz_ping_info, headingVessel_deg), (float) (ping % 360));
+    gen_putf (g, p + offsetof (kma_datagram_mrz_ping_info, soundSpeedAtTxDepth_mPerSec), 1500.0f);
+    gen_putd (g, p + offsetof (kma_datagram_mrz_ping_info, latitude_deg), 45.0 + ping * 1.0e-6);
+    gen_putd (g, p + offsetof (kma_datagram_mrz_ping_info, longitude_deg), -70.0);
+
+    p = gen_reserve (g, sizeof (kma_datagram_mrz_tx_sector_info_v1));
+    gen_putf (g, p + offsetof (kma_datagram_mrz_tx_sector_info_v1, centreFreq_Hz), 300000.0f);
+
+    p = gen_reserve (g, sizeof (kma_datagram_mrz_rx_info));
+    gen_put16 (g, p + offsetof (kma_datagram_mrz_rx_info, numBytesRxInfo), sizeof (kma_datagram_mrz_rx_info));
+    gen_put16 (g, p + offsetof (kma_datagram_mrz_rx_info, numSoundingsMaxMain), (uint16_t) o->num_beams);
+    gen_put16 (g, p + offsetof (kma_datagram_mrz_rx_info, numSoundingsValidMain), (uint16_t) o->num_beams);
+    gen_put16 (g, p + offsetof (kma_datagram_mrz_rx_info, numBytesPerSounding), sizeof (kma_datagram_mrz_sounding));
+    gen_putf (g, p + offsetof (kma_datagram_mrz_rx_info, seabedImageSampleRate_Hz), 10000.0f);
+
+    for (i=0; i<o->num_beams; i++) {
+        angle = -60.0f + 120.0f * (float) i / (float) o->num_beams;
+        ns = gen_seabed_samples (i);
+        p = gen_reserve (g, sizeof (kma_datagram_mrz_sounding));
+        gen_put16 (g, p + offsetof (kma_datagram_mrz_sounding, soundingIndex), (uint16_t) i);
+        gen_putf (g, p + offsetof (kma_datagram_mrz_sounding, qualityFactor), 0.5f);
+        gen_putf (g, p + offsetof (kma_datagram_mrz_sounding, reflectivity1_dB), -30.0f + (float) (i % 10));
+        gen_putf (g, p + offsetof (kma_datagram_mrz_sounding, beamAngleReRx_deg), angle);
+        gen_putf (g, p + offsetof (kma_datagram_mrz_sounding, twoWayTravelTime_sec), 0.1f);
+        gen_putf (g, p + offsetof (kma_datagram_mrz_sounding, z_reRefPoint_m), 75.0f);
+        gen_putf (g, p + offsetof (kma_datagram_mrz_sounding, y_reRefPoint_m), 1.3f * angle);
+        gen_putf (g, p + offsetof (kma_datagram_mrz_sounding, x_reRefPoint_m), 0.0f);
+        gen_put16 (g, p + offsetof (kma_datagram_mrz_sounding, SIcentreSample), (uint16_t) (ns / 2));
+        gen_put16 (g, p + offsetof (kma_datagram_mrz_sounding, SInumSamples), (uint16_t) ns);
+    }
+
+    for (i=0; i<o->num_beams; i++) {
+        ns = gen_seabed_samples (i);
+        sample = gen_reserve (g, ns * sizeof (int16_t));
+        for (j=0; j<ns; j++) {
+            gen_put16 (g, sample + j * sizeof (int16_t), (uint16_t) (int16_t) (-300 - (int) ((i + j) % 50)));
+        }
+    }
+
+    gen_kma_end (g);
+}
+
+
+/******************************************************************************
+*
+* gen_kma_mwc - Write an MWC datagram for PING to the datagram buffer G with
+*   one TX sector and num_beams beams of num_samples amplitudes without phase.
+*
+******************************************************************************/
+
+static void gen_kma_mwc (
+    gen_buffer *g,
+    const gen_options *o,
+    const unsigned long ping) {
+
+    size_t p;
+    unsigned int i, j;
+
+
+    gen_kma_header (g, KMA_DATAGRAM_MWC, 1, ping);
+    gen_kma_partition (g);
+
+    p = gen_reserve (g, sizeof (kma_datagram_m_common));
+    gen_put16 (g, p + offsetof (kma_datagram_m_common, numBytesCmnPart), sizeof (kma_datagram_m_common));
+    gen_put16 (g, p + offsetof (kma_datagram_m_common, pingCnt), (uint16_t) ping);
+    gen_put8 (g, p + offsetof (kma_datagram_m_common, rxFansPerPing), 1);
+    gen_put8 (g, p + offsetof (kma_datagram_m_common, swathsPerPing), 1);
+    gen_put8 (g, p + offsetof (kma_datagram_m_common, numRxTransducers), 1);
+
+    p = gen_reserve (g, sizeof (kma_datagram_mwc_tx_info));
+    gen_put16 (g, p + offsetof (kma_datagram_mwc_tx_info, numBytesTxInfo), sizeof (kma_datagram_mwc_tx_info));
+    gen_put16 (g, p + offsetof (kma_datagram_mwc_tx_info, numTxSectors), 1);
+    gen_put16 (g, p + offsetof (kma_datagram_mwc_tx_info, numBytesPerTxSector), sizeof (kma_datagram_mwc_tx_sector_info));
+
+    p = gen_reserve (g, sizeof (kma_datagram_mwc_tx_sector_info));
+    gen_putf (g, p + offsetof (kma_datagram_mwc_tx_sector_info, centreFreq_Hz), 300000.0f);
+
+    p = gen_reserve (g, sizeof (kma_datagram_mwc_rx_info));
+    gen_put16 (g, p + offsetof (kma_datagram_mwc_rx_info, numBytesRxInfo), sizeof (kma_datagram_mwc_rx_info));
+    gen_put16 (g, p + offsetof (kma_datagram_mwc_rx_info, numBeams), (uint16_t) o->num_beams);
+    gen_put8 (g, p + offsetof (kma_datagram_mwc_rx_info, numBytesPerBeamEntry), sizeof (kma_datagram_mwc_rx_beam_data));
+    gen_put8 (g, p + offsetof (kma_datagram_mwc_rx_info, phaseFlag), KMA_MWC_RX_PHASE_OFF);
+    gen_putf (g, p + offsetof (kma_datagram_mwc_rx_info, sampleFreq_Hz), 10000.0f);
+    gen_putf (g, p + offsetof (kma_datagram_mwc_rx_info, soundVelocity_mPerSec), 1500.0f);
+
+    for (i=0; i<o->num_beams; i++) {
+        p = gen_reserve (g, sizeof (kma_datagram_mwc_rx_beam_data));
+        gen_putf (g, p + offsetof (kma_datagram_mwc_rx_beam_data, beamPointAngReVertical_deg), -60.0f + 120.0f * (float) i / (float) o->num_beams);
+        gen_put16 (g, p + offsetof (kma_datagram_mwc_rx_beam_data, detectedRangeInSamples), (uint16_t) (o->num_samples * 3 / 4));
+        gen_put16 (g, p + offsetof (kma_datagram_mwc_rx_beam_data, numSamples), (uint16_t) o->num_samples);
+        gen_putf (g, p + offsetof (kma_datagram_mwc_rx_beam_data, detectedRangeInSamplesHighResolution), (float) (o->num_samples * 3) / 4.0f);
+
+        p = gen_reserve (g, o->num_samples);
+        for (j=0; j<o->num_samples; j++) {
+            gen_put8 (g, p + j, (uint8_t) (int8_t) (-100 + (int) ((i * 7 + j) % 80)));
+        }
+    }
+
+    gen_kma_end (g);
+}
+
+
+/******************************************************************************
+*
+* gen_kma_skm - Write an SKM datagram for PING to the datagram buffer G with
+*   ten KM binary samples 50 ms apart.
+*
+******************************************************************************/
+
+static void gen_kma_skm (
+    gen_buffer *g,
+    const unsigned long ping) {
+
+    size_t p, s;
+    uint32_t time_sec, time_nanosec;
+    unsigned int i;
+
+
+    gen_kma_header (g, KMA_DATAGRAM_SKM, 1, ping);
+
+    p = gen_reserve (g, sizeof (kma_datagram_skm_info));
+    gen_put16 (g, p + offsetof (kma_datagram_skm_info, numBytesInfoPart), sizeof (kma_datagram_skm_info));
+    gen_put16 (g, p + offsetof (kma_datagram_skm_info, numSamples), 10);
+    gen_put16 (g, p + offsetof (kma_datagram_skm_info, numBytesPerSample), sizeof (kma_datagram_skm_sample));
+
+    for (i=0; i<10; i++) {
+        time_sec = (uint32_t) (1600000000 + ping / 2);
+        time_nanosec = (uint32_t) ((ping % 2) * 500000000 + i * 50000000);
+        s = gen_reserve (g, sizeof (kma_datagram_skm_sample));
+        p = s + offsetof (kma_datagram_skm_sample, KMdefault);
+        memcpy (g->data + p + offsetof (kma_datagram_skm_binary, dgmType), "#KMB", 4);
+        gen_put16 (g, p + offsetof (kma_datagram_skm_binary, numBytesDgm), sizeof (kma_datagram_skm_binary));
+        gen_put16 (g, p + offsetof (kma_datagram_skm_binary, dgmVersion), 1);
+        gen_put32 (g, p + offsetof (kma_datagram_skm_binary, time_sec), time_sec);
+        gen_put32 (g, p + offsetof (kma_datagram_skm_binary, time_nanosec), time_nanosec);
+        gen_putd (g, p + offsetof (kma_datagram_skm_binary, latitude_deg), 45.0 + ping * 1.0e-6);
+        gen_putd (g, p + offsetof (kma_datagram_skm_binary, longitude_deg), -70.0);
+        gen_putf (g, p + offsetof (kma_datagram_skm_binary, roll_deg), (float) i * 0.1f);
+        gen_putf (g, p + offsetof (kma_datagram_skm_binary, pitch_deg), (float) i * -0.05f);
+        gen_putf (g, p + offsetof (kma_datagram_skm_binary, heading_deg), (float) (ping % 360));
+        p = s + offsetof (kma_datagram_skm_sample, delayedHeave);
+        gen_put32 (g, p + offsetof (kma_datagram_skm_delayed_heave, time_sec), time_sec);
+        gen_put32 (g, p + offsetof (kma_datagram_skm_delayed_heave, time_nanosec), time_nanosec);
+    }
+
+    gen_kma_end (g);
+}
+
+
+/******************************************************************************
+*
+* gen_emx_header - Start an EMX datagram of TYPE for PING in the datagram
+*   buffer G.  The pings are half a second apart.
+*
+******************************************************************************/
+
+static void gen_emx_header (
+    gen_buffer *g,
+    const uint8_t type,
+    const unsigned long ping) {
+
+    size_t h;
+
+
+    h = gen_reserve (g, sizeof (emx_datagram_header));
+    gen_put8 (g, h + offsetof (emx_datagram_header, start_identifier), 0x02);
+    gen_put8 (g, h + offsetof (emx_datagram_header, datagram_type), type);
+    gen_put16 (g, h + offsetof (emx_datagram_header, em_model_number), 2040);
+    gen_put32 (g, h + offsetof (emx_datagram_header, date), 20200101 + (uint32_t) (ping / 172800));
+    gen_put32 (g, h + offsetof (emx_datagram_header, time_ms), (uint32_t) ((ping % 172800) * 500));
+    gen_put16 (g, h + offsetof (emx_datagram_header, counter), (uint16_t) ping);
+    gen_put16 (g, h + offsetof (emx_datagram_header, serial_number), 100);
+}
+
+
+/******************************************************************************
+*
+* gen_emx_end - Finish the EMX datagram in the datagram buffer G.  The body is
+*   padded to an even datagram size, and the end identifier, the checksum of
+*   the bytes between the start and end identifiers, and the datagram size
+*   are set.
+*
+******************************************************************************/
+
+static void gen_emx_end (
+    gen_buffer *g) {
+
+    size_t e;
+    size_t i;
+    uint16_t checksum = 0;
+
+
+    if ((g->size % 2) == 0) {
+        gen_reserve (g, 1);
+    }
+
+    for (i=offsetof (emx_datagram_header, datagram_type); i<g->size; i++) {
+        checksum = (uint16_t) (checksum + g->data[i]);
+    }
+
+    e = gen_reserve (g, 3);
+    gen_put8 (g, e, 0x03);
+    gen_put16 (g, e + 1, checksum);
+    gen_put32 (g, offsetof (emx_datagram_header, bytes_in_datagram), (uint32_t) (g->size - sizeof (uint32_t)));
+}
+
+
+/******************************************************************************
+*
+* gen_emx_depth - Write a depth datagram for PING to the datagram buffer G
+*   with up to 255 beams in a flat swath.
+*
+******************************************************************************/
+
+static void gen_emx_depth (
+    gen_buffer *g,
+    const gen_options *o,
+    const unsigned long ping) {
+
+    size_t p;
+    unsigned int num_beams;
+    unsigned int i;
+
+
+    num_beams = (o->num_beams > UINT8_MAX) ? UINT8_MAX : o->num_beams;
+
+    gen_emx_header (g, EMX_DATAGRAM_DEPTH, ping);
+
+    p = gen_reserve (g, sizeof (emx_datagram_depth_info));
+    gen_put16 (g, p + offsetof (emx_datagram_depth_info, vessel_heading), (uint16_t) ((ping % 360) * 100));
+    gen_put16 (g, p + offsetof (emx_datagram_depth_info, sound_speed), 15000);
+    gen_put16 (g, p + offsetof (emx_datagram_depth_info, transducer_depth), 250);
+    gen_put8 (g, p + offsetof (emx_datagram_depth_info, max_beams), (uint8_t) num_beams);
+    gen_put8 (g, p + offsetof (emx_datagram_depth_info, num_beams), (uint8_t) num_beams);
+    gen_put8 (g, p + offsetof (emx_datagram_depth_info, depth_resolution), 1);
+    gen_put8 (g, p + offsetof (emx_datagram_depth_info, horizontal_resolution), 1);
+    gen_put16 (g, p + offsetof (emx_datagram_depth_info, sample_rate), 10000);
+
+    for (i=0; i<num_beams; i++) {
+        p = gen_reserve (g, sizeof (emx_datagram_depth_beam));
+        gen_put16 (g, p + offsetof (emx_datagram_depth_beam, depth), 7500);
+        gen_put16 (g, p + offsetof (emx_datagram_depth_beam, across_track), (uint16_t) (int16_t) (-10000 + (int) (20000 * i / num_beams)));
+        gen_put16 (g, p + offsetof (emx_datagram_depth_beam, beam_depression_angle), (uint16_t) (3000 + 6000 * i / num_beams));
+        gen_put16 (g, p + offsetof (emx_datagram_depth_beam, range), 1000);
+        gen_put8 (g, p + offsetof (emx_datagram_depth_beam, quality_factor), 50);
+        gen_put8 (g, p + offsetof (emx_datagram_depth_beam, beam_number), (uint8_t) (i + 1));
+    }
+
+    /* The depth offset multiplier follows the beams. */
+    gen_reserve (g, sizeof (int8_t));
+
+    gen_emx_end (g);
+}
+
+
+/******************************************************************************
+*
+* gen_emx_xyz - Write an XYZ 88 datagram for PING to the datagram buffer G
+*   with num_beams beams in a flat swath.
+*
+******************************************************************************/
+
+static void gen_emx_xyz (
+    gen_buffer *g,
+    const gen_options *o,
+    const unsigned long ping) {
+
+    size_t p;
+    unsigned int i;
+
+
+    gen_emx_header (g, EMX_DATAGRAM_XYZ, ping);
+
+    p = gen_reserve (g, sizeof (emx_datagram_xyz_info));
+    gen_put16 (g, p + offsetof (emx_datagram_xyz_info, vessel_heading), (uint16_t) ((ping % 360) * 100));
+    gen_put16 (g, p + offsetof (emx_datagram_xyz_info, sound_speed), 15000);
+    gen_putf (g, p + offsetof (emx_datagram_xyz_info, transducer_depth), 2.5f);
+    gen_put16 (g, p + offsetof (emx_datagram_xyz_info, num_beams), (uint16_t) o->num_beams);
+    gen_put16 (g, p + offsetof (emx_datagram_xyz_info, valid_beams), (uint16_t) o->num_beams);
+    gen_putf (g, p + offsetof (emx_datagram_xyz_info, sample_rate), 10000.0f);
+
+    for (i=0; i<o->num_beams; i++) {
+        p = gen_reserve (g, sizeof (emx_datagram_xyz_beam));
+        gen_putf (g, p + offsetof (emx_datagram_xyz_beam, depth), 75.0f);
+        gen_putf (g, p + offsetof (emx_datagram_xyz_beam, across_track), -100.0f + 200.0f * (float) i / (float) o->num_beams);
+        gen_put16 (g, p + offsetof (emx_datagram_xyz_beam, detect_window_length), 20);
+        gen_put8 (g, p + offsetof (emx_datagram_xyz_beam, quality_factor), 50);
+        gen_put16 (g, p + offsetof (emx_datagram_xyz_beam, backscatter), (uint16_t) (int16_t) (-300 + (int) (i % 50)));
+    }
+
+    gen_emx_end (g);
+}
+
+
+/******************************************************************************
+*
+* gen_emx_seabed - Write a seabed image 89 datagram for PING to the datagram
+*   buffer G with num_beams beams.
+*
+******************************************************************************/
+
+static void gen_emx_seabed (
+    gen_buffer *g,
+    const gen_options *o,
+    const unsigned long ping) {
+
+    size_t p;
+    unsigned int ns;
+    unsigned int i, j;
+
+
+    gen_emx_header (g, EMX_DATAGRAM_SEABED_IMAGE_89, ping);
+
+    p = gen_reserve (g, sizeof (emx_datagram_seabed_89_info));
+    gen_putf (g, p + offsetof (emx_datagram_seabed_89_info, sample_rate), 10000.0f);
+    gen_put16 (g, p + offsetof (emx_datagram_seabed_89_info, range_norm), 100);
+    gen_put16 (g, p + offsetof (emx_datagram_seabed_89_info, tx_beamwidth), 10);
+    gen_put16 (g, p + offsetof (emx_datagram_seabed_89_info, tvg_cross_over), 100);
+    gen_put16 (g, p + offsetof (emx_datagram_seabed_89_info, num_beams), (uint16_t) o->num_beams);
+
+    for (i=0; i<o->num_beams; i++) {
+        ns = gen_seabed_samples (i);
+        p = gen_reserve (g, sizeof (emx_datagram_seabed_89_beam));
+        gen_put8 (g, p + offsetof (emx_datagram_seabed_89_beam, sorting_direction), (i < o->num_beams / 2) ? (uint8_t) (int8_t) -1 : 1);
+        gen_put16 (g, p + offsetof (emx_datagram_seabed_89_beam, num_samples), (uint16_t) ns);
+        gen_put16 (g, p + offsetof (emx_datagram_seabed_89_beam, detect_sample), (uint16_t) (ns / 2));
+    }
+
+    for (i=0; i<o->num_beams; i++) {
+        ns = gen_seabed_samples (i);
+        p = gen_reserve (g, ns * sizeof (int16_t));
+        for (j=0; j<ns; j++) {
+            gen_put16 (g, p + j * sizeof (int16_t), (uint16_t) (int16_t) (-300 - (int) ((i + j) % 50)));
+        }
+    }
+
+    gen_emx_end (g);
+}
+
+
+/******************************************************************************
+*
+* gen_emx_wc - Write a water column datagram for PING to the datagram buffer G
+*   with one TX sector and num_beams beams of num_samples amplitudes.
+*
+******************************************************************************/
+
+static void gen_emx_wc (
+    gen_buffer *g,
+    const gen_options *o,
+    const unsigned long ping) {
+
+    size_t p;
+    unsigned int i, j;
+
+
+    gen_emx_header (g, EMX_DATAGRAM_WATER_COLUMN, ping);
+
+    p = gen_reserve (g, sizeof (emx_datagram_wc_info));
+    gen_put16 (g, p + offsetof (emx_datagram_wc_info, num_datagrams), 1);
+    gen_put16 (g, p + offsetof (emx_datagram_wc_info, datagram_number), 1);
+    gen_put16 (g, p + offsetof (emx_datagram_wc_info, tx_sectors), 1);
+    gen_put16 (g, p + offsetof (emx_datagram_wc_info, num_beams), (uint16_t) o->num_beams);
+    gen_put16 (g, p + offsetof (emx_datagram_wc_info, datagram_beams), (uint16_t) o->num_beams);
+    gen_put16 (g, p + offsetof (emx_datagram_wc_info, sound_speed), 15000);
+    gen_put32 (g, p + offsetof (emx_datagram_wc_info, sample_rate), 1000000);
+    gen_put8 (g, p + offsetof (emx_datagram_wc_info, tvg_function), 30);
+
+    p = gen_reserve (g, sizeof (emx_datagram_wc_tx_beam));
+    gen_put16 (g, p + offsetof (emx_datagram_wc_tx_beam, center_freq), 30000);
+
+    for (i=0; i<o->num_beams; i++) {
+        p = gen_reserve (g, sizeof (emx_datagram_wc_rx_beam_info));
+        gen_put16 (g, p + offsetof (emx_datagram_wc_rx_beam_info, beam_angle), (uint16_t) (int16_t) (-6000 + (int) (12000 * i / o->num_beams)));
+        gen_put16 (g, p + offsetof (emx_datagram_wc_rx_beam_info, num_samples), (uint16_t) o->num_samples);
+        gen_put16 (g, p + offsetof (emx_datagram_wc_rx_beam_info, detected_range), (uint16_t) (o->num_samples * 3 / 4));
+        gen_put8 (g, p + offsetof (emx_datagram_wc_rx_beam_info, beam_index), (uint8_t) i);
+
+        p = gen_reserve (g, o->num_samples);
+        for (j=0; j<o->num_samples; j++) {
+            gen_put8 (g, p + j, (uint8_t) (int8_t) (-100 + (int) ((i * 7 + j) % 80)));
+        }
+    }
+
+    gen_emx_end (g);
+}
+
+
+/******************************************************************************
+*
+* gen_emx_attitude - Write an attitude datagram for PING to the datagram buffer
+*   G with ten entries 50 ms apart.
+*
+******************************************************************************/
+
+static void gen_emx_attitude (
+    gen_buffer *g,
+    const unsigned long ping) {
+
+    size_t p;
+    unsigned int i;
+
+
+    gen_emx_header (g, EMX_DATAGRAM_ATTITUDE, ping);
+
+    p = gen_reserve (g, sizeof (emx_datagram_attitude_info));
+    gen_put16 (g, p + offsetof (emx_datagram_attitude_info, num_entries), 10);
+
+    for (i=0; i<10; i++) {
+        p = gen_reserve (g, sizeof (emx_datagram_attitude_data));
+        gen_put16 (g, p + offsetof (emx_datagram_attitude_data, record_time), (uint16_t) (i * 50));
+        gen_put16 (g, p + offsetof (emx_datagram_attitude_data, roll), (uint16_t) (int16_t) (i * 10));
+        gen_put16 (g, p + offsetof (emx_datagram_attitude_data, pitch), (uint16_t) (int16_t) (i * -5));
+        gen_put16 (g, p + offsetof (emx_datagram_attitude_data, heading), (uint16_t) ((ping % 360) * 100));
+    }
+
+    /* The sensor system descriptor follows the entries. */
+    gen_reserve (g, sizeof (int8_t));
+
+    gen_emx_end (g);
+}
+
+
+/******************************************************************************
+*
+* gen_seabed_samples - Get the number of seabed image samples of BEAM.
+*
+* Return: The number of samples (8-23).
+*
+******************************************************************************/
+
+static unsigned int gen_seabed_samples (
+    const unsigned int beam) {
+
+    return 8 + beam % 16;
+}
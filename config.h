@@ -29,6 +29,21 @@
 /* Define if you have the 'realpath' function. */
 /* #undef HAVE_REALPATH */
 
+/* Define if you have the 'mmap' function. */
+#define HAVE_MMAP 1
+
+/* Define if you have the Linux io_uring interface (linux/io_uring.h). */
+#define HAVE_IO_URING 1
+
+/* Define if you have the POSIX threads library. */
+#define HAVE_PTHREAD 1
+
+/* Define if you have the zstd compression library (-lzstd). */
+/* #undef HAVE_ZSTD */
+
+/* Define if you have the zlib compression library (-lz). */
+/* #undef HAVE_ZLIB */
+
 /* Define if you have the 'clock_gettime' function. */
 #define HAVE_CLOCK_GETTIME 1
 
@@ -21,6 +21,18 @@
 #include "cpl_debug.h"
 
 
+/* Default Sizes of Arena Blocks and Pool Chunks in Bytes */
+#define CPL_ARENA_BLOCK_SIZE  65536
+#define CPL_POOL_CHUNK_SIZE   65536
+
+
+/* Memory Arena Block */
+struct cpl_arena_block_struct {
+    cpl_arena_block *next;      /* Next block in the list or NULL.             */
+    size_t size;                /* Number of data bytes after the block.       */
+};
+
+
 /* Private Variable Declarations */
 static cpl_malloc_fn g_malloc_fn = malloc;
 static cpl_calloc_fn g_calloc_fn = calloc;
@@ -353,3 +365,355 @@ void cpl_memlist_free (
         cpl_free (node);
     }
 }
+
+
+/******************************************************************************
+*
+* cpl_arena_init - Initialize the memory arena A, which allocates memory from
+*   blocks of at least BLOCK_SIZE bytes.  If BLOCK_SIZE is zero, then a default
+*   size is used.  No memory is allocated until the first allocation, and the
+*   caller must call cpl_arena_free() after use.
+*
+******************************************************************************/
+
+void cpl_arena_init (
+    cpl_arena *a,
+    const size_t block_size) {
+
+    assert (a);
+
+    a->first = NULL;
+    a->current = NULL;
+    a->used = 0;
+    a->block_size = block_size > 0 ? block_size : CPL_ARENA_BLOCK_SIZE;
+}
+
+
+/******************************************************************************
+*
+* cpl_arena_free - Free all blocks of the memory arena A, which invalidates all
+*   memory allocated from it.  The arena may be used again afterwards.
+*
+******************************************************************************/
+
+void cpl_arena_free (
+    cpl_arena *a) {
+
+    cpl_arena_block *b;
+
+
+    assert (a);
+
+    while (a->first) {
+        b = a->first;
+        a->first = b->next;
+        cpl_free (b);
+    }
+
+    a->current = NULL;
+    a->used = 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_arena_alloc - Allocate SIZE bytes aligned to a multiple of ALIGNMENT
+*   bytes from the memory arena A.  If ALIGNMENT is zero, then the memory is
+*   aligned to CPL_ARENA_ALIGNMENT bytes.  The memory is valid until the arena
+*   is reset to a position before it or freed, and is never freed by itself.
+*   Allocations are made from the current block, or otherwise from the next
+*   block kept by a reset or a new block, so that allocating the same sizes
+*   after a reset does not allocate any more memory.
+*
+* Return: A pointer to the allocated memory, or
+*         NULL if memory allocation failed.
+*
+******************************************************************************/
+
+void * cpl_arena_alloc (
+    cpl_arena *a,
+    const size_t size,
+    const size_t alignment) {
+
+    const size_t align = alignment > 0 ? alignment : CPL_ARENA_ALIGNMENT;
+    cpl_arena_block *b;
+    char *base, *p;
+    size_t used, offset, n;
+
+
+    assert (a);
+
+    /* Use the first block from the current one with enough space. */
+    used = a->used;
+
+    for (b=a->current; b; b=b->next) {
+        base = (char *) (b + 1);
+        p = (char *) cpl_ptr_align (base + used, align);
+        offset = (size_t) (p - base);
+
+        if ((offset <= b->size) && (size <= b->size - offset)) {
+            a->current = b;
+            a->used = offset + size;
+            return p;
+        }
+
+        used = 0;
+    }
+
+    if (size > (size_t) -1 - sizeof (cpl_arena_block) - align) {
+        cpl_debug (cpl_lib_debug, "Arena allocation of %lu bytes is too large\n", (unsigned long) size);
+        return NULL;
+    }
+
+    /* Insert a new block after the current one, so the blocks kept by a reset
+       that were too small remain available for later allocations. */
+    n = size + align - 1;
+    if (n < a->block_size) n = a->block_size;
+
+    b = (cpl_arena_block *) cpl_malloc (sizeof (cpl_arena_block) + n);
+    if (CPL_UNLIKELY (!b)) return NULL;
+
+    b->size = n;
+
+    if (a->current) {
+        b->next = a->current->next;
+        a->current->next = b;
+    } else {
+        b->next = a->first;
+        a->first = b;
+    }
+
+    base = (char *) (b + 1);
+    p = (char *) cpl_ptr_align (base, align);
+
+    a->current = b;
+    a->used = (size_t) (p - base) + size;
+
+    return p;
+}
+
+
+/******************************************************************************
+*
+* cpl_arena_calloc - Allocate memory for NELEM objects of size ELSIZE from the
+*   memory arena A, which is aligned to CPL_ARENA_ALIGNMENT bytes and set to zero.
+*
+* Return: A pointer to the allocated memory, or
+*         NULL if memory allocation failed.
+*
+******************************************************************************/
+
+void * cpl_arena_calloc (
+    cpl_arena *a,
+    const size_t nelem,
+    const size_t elsize) {
+
+    void *p;
+
+
+    assert (a);
+
+    if ((elsize > 0) && (nelem > (size_t) -1 / elsize)) {
+        cpl_debug (cpl_lib_debug, "Arena allocation of %lu objects is too large\n", (unsigned long) nelem);
+        return NULL;
+    }
+
+    p = cpl_arena_alloc (a, nelem * elsize, 0);
+    if (p) memset (p, 0, nelem * elsize);
+
+    return p;
+}
+
+
+/******************************************************************************
+*
+* cpl_arena_get_mark - Store the current position of the memory arena A in M,
+*   which may be passed to cpl_arena_reset_to() to release all allocations made
+*   after it.
+*
+******************************************************************************/
+
+void cpl_arena_get_mark (
+    const cpl_arena *a,
+    cpl_arena_mark *m) {
+
+    assert (a);
+    assert (m);
+
+    m->block = a->current;
+    m->used = a->used;
+}
+
+
+/******************************************************************************
+*
+* cpl_arena_reset_to - Release all allocations of the memory arena A made after
+*   the position M, which was stored by cpl_arena_get_mark().  The blocks are
+*   kept for later allocations.  The position must not be used after the arena
+*   is reset to an earlier position or freed.
+*
+******************************************************************************/
+
+void cpl_arena_reset_to (
+    cpl_arena *a,
+    const cpl_arena_mark *m) {
+
+    assert (a);
+    assert (m);
+
+    if (m->block) {
+        a->current = m->block;
+        a->used = m->used;
+    } else {
+        cpl_arena_reset (a);
+    }
+}
+
+
+/******************************************************************************
+*
+* cpl_arena_reset - Release all allocations of the memory arena A, while keeping
+*   its blocks for later allocations, e.g., at the end of each ping.
+*
+******************************************************************************/
+
+void cpl_arena_reset (
+    cpl_arena *a) {
+
+    assert (a);
+
+    a->current = a->first;
+    a->used = 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_pool_init - Initialize the block pool P, which allocates blocks of
+*   BLOCK_SIZE bytes aligned to CPL_ARENA_ALIGNMENT bytes in chunks of
+*   CHUNK_BLOCKS blocks.  If CHUNK_BLOCKS is zero, then a default chunk size is
+*   used.  No memory is allocated until the first allocation, and the caller
+*   must call cpl_pool_free() after use.
+*
+******************************************************************************/
+
+void cpl_pool_init (
+    cpl_pool *p,
+    const size_t block_size,
+    const size_t chunk_blocks) {
+
+    size_t size;
+
+
+    assert (p);
+
+    /* Free blocks store the link to the next free block. */
+    size = block_size > sizeof (void *) ? block_size : sizeof (void *);
+    size = (size + CPL_ARENA_ALIGNMENT - 1) / CPL_ARENA_ALIGNMENT * CPL_ARENA_ALIGNMENT;
+
+    p->free_list = NULL;
+    p->chunks = NULL;
+    p->block_size = size;
+
+    if (chunk_blocks > 0) {
+        p->chunk_blocks = chunk_blocks;
+    } else {
+        p->chunk_blocks = size < CPL_POOL_CHUNK_SIZE ? CPL_POOL_CHUNK_SIZE / size : 1;
+    }
+}
+
+
+/******************************************************************************
+*
+* cpl_pool_free - Free all chunks of the block pool P, which invalidates all
+*   blocks allocated from it.  The pool may be used again afterwards.
+*
+******************************************************************************/
+
+void cpl_pool_free (
+    cpl_pool *p) {
+
+    void *chunk;
+
+
+    assert (p);
+
+    while (p->chunks) {
+        chunk = p->chunks;
+        p->chunks = *((void **) chunk);
+        cpl_free (chunk);
+    }
+
+    p->free_list = NULL;
+}
+
+
+/******************************************************************************
+*
+* cpl_pool_alloc - Allocate a block from the block pool P, which is taken from
+*   the blocks released to the pool or otherwise from a new chunk of blocks.
+*
+* Return: A pointer to the allocated block, or
+*         NULL if memory allocation failed.
+*
+******************************************************************************/
+
+void * cpl_pool_alloc (
+    cpl_pool *p) {
+
+    char *chunk, *block;
+    size_t i;
+    void *b;
+
+
+    assert (p);
+
+    if (!p->free_list) {
+        if (p->chunk_blocks > ((size_t) -1 - sizeof (void *) - CPL_ARENA_ALIGNMENT) / p->block_size) {
+            cpl_debug (cpl_lib_debug, "Pool chunk of %lu blocks is too large\n", (unsigned long) p->chunk_blocks);
+            return NULL;
+        }
+
+        chunk = (char *) cpl_malloc (sizeof (void *) + CPL_ARENA_ALIGNMENT - 1 + p->chunk_blocks * p->block_size);
+        if (CPL_UNLIKELY (!chunk)) return NULL;
+
+        /* Link the chunk to the list of chunks, followed by the aligned blocks. */
+        *((void **) chunk) = p->chunks;
+        p->chunks = chunk;
+
+        block = (char *) cpl_ptr_align (chunk + sizeof (void *), CPL_ARENA_ALIGNMENT);
+
+        /* Add the blocks to the free list so the first block is used first. */
+        for (i=p->chunk_blocks; i>0; i--) {
+            b = block + (i - 1) * p->block_size;
+            *((void **) b) = p->free_list;
+            p->free_list = b;
+        }
+    }
+
+    b = p->free_list;
+    p->free_list = *((void **) b);
+
+    return b;
+}
+
+
+/******************************************************************************
+*
+* cpl_pool_release - Release the block PTR allocated by cpl_pool_alloc() back to
+*   the block pool P, which reuses it for a later allocation.  If PTR is NULL,
+*   then nothing is done.
+*
+******************************************************************************/
+
+void cpl_pool_release (
+    cpl_pool *p,
+    void *ptr) {
+
+    assert (p);
+
+    if (!ptr) return;
+
+    *((void **) ptr) = p->free_list;
+    p->free_list = ptr;
+}
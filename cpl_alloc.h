@@ -33,6 +33,39 @@ typedef void * (* cpl_realloc_fn) (void *, const size_t);
 typedef void (* cpl_free_fn) (void *);
 
 
+/* Default Alignment of Arena and Pool Allocations in Bytes */
+#define CPL_ARENA_ALIGNMENT  16
+
+
+/* Opaque Memory Arena Block Type */
+typedef struct cpl_arena_block_struct cpl_arena_block;
+
+
+/* Memory Arena */
+typedef struct {
+    cpl_arena_block *first;     /* List of allocated blocks or NULL.           */
+    cpl_arena_block *current;   /* Block that allocations are made from.       */
+    size_t used;                /* Number of bytes used in the current block.  */
+    size_t block_size;          /* Minimum size of new blocks in bytes.        */
+} cpl_arena;
+
+
+/* Memory Arena Position */
+typedef struct {
+    cpl_arena_block *block;     /* Block of the position or NULL.              */
+    size_t used;                /* Number of bytes used in the block.          */
+} cpl_arena_mark;
+
+
+/* Fixed-Size Block Pool */
+typedef struct {
+    void *free_list;            /* List of free blocks or NULL.                */
+    void *chunks;               /* List of allocated chunks of blocks or NULL. */
+    size_t block_size;          /* Size of each block in bytes.                */
+    size_t chunk_blocks;        /* Number of blocks allocated per chunk.       */
+} cpl_pool;
+
+
 /******************************* API Functions *******************************/
 
 CPL_CLINKAGE_START
@@ -51,6 +84,17 @@ void cpl_get_memory_functions (cpl_malloc_fn *, cpl_calloc_fn *, cpl_realloc_fn
 void * cpl_memlist_add (const void *, const void *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
 void cpl_memlist_replace (void *, const void *, void *);
 void cpl_memlist_free (void *);
+void cpl_arena_init (cpl_arena *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_arena_free (cpl_arena *) CPL_ATTRIBUTE_NONNULL_ALL;
+void * cpl_arena_alloc (cpl_arena *, const size_t, const size_t) CPL_ATTRIBUTE_MALLOC CPL_ATTRIBUTE_WARN_UNUSED_RESULT CPL_ATTRIBUTE_NONNULL_ALL;
+void * cpl_arena_calloc (cpl_arena *, const size_t, const size_t) CPL_ATTRIBUTE_MALLOC CPL_ATTRIBUTE_WARN_UNUSED_RESULT CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_arena_get_mark (const cpl_arena *, cpl_arena_mark *) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_arena_reset_to (cpl_arena *, const cpl_arena_mark *) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_arena_reset (cpl_arena *) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_pool_init (cpl_pool *, const size_t, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_pool_free (cpl_pool *) CPL_ATTRIBUTE_NONNULL_ALL;
+void * cpl_pool_alloc (cpl_pool *) CPL_ATTRIBUTE_MALLOC CPL_ATTRIBUTE_WARN_UNUSED_RESULT CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_pool_release (cpl_pool *, void *) CPL_ATTRIBUTE_NONNULL (1);
 
 
 CPL_CLINKAGE_END
@@ -14,7 +14,21 @@
    along with this program; if not, write to the Free Software
    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
 
+#include <string.h>
 #include "cpl_bswap.h"
+#include "cpl_simd.h"
+
+
+/* The arrays may not be aligned, so the remaining values are copied with memcpy, which
+   compilers convert to an unaligned load and store. */
+#define CPL_BSWAP_SCALAR(p, i, n, type, swap) do {                            \
+    type __x;                                                                 \
+    for (; (i)<(n); (i)++) {                                                  \
+        memcpy (&__x, (p) + (i) * sizeof (type), sizeof (type));              \
+        __x = swap (__x);                                                     \
+        memcpy ((p) + (i) * sizeof (type), &__x, sizeof (type));              \
+    }                                                                         \
+} while (0)
 
 
 /******************************************************************************
@@ -31,3 +45,141 @@ int cpl_is_big_endian (void) {
     u.x = 1;
     return u.c[0] == 0;
 }
+
+
+/******************************************************************************
+*
+* cpl_bswap_array16 - Byte swap the array of N 16-bit values given by P in
+*   place.  The array does not need to be aligned.  The values are swapped 16
+*   or 32 bytes at a time using SSE2, SSSE3, AVX2, or NEON instructions if
+*   available when compiled.
+*
+******************************************************************************/
+
+void cpl_bswap_array16 (
+    void *p,
+    const size_t n) {
+
+    uint8_t *q = (uint8_t *) p;
+    size_t i = 0;
+#if defined (CPL_SIMD_SSSE3)
+    const __m128i mask = _mm_setr_epi8 (1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+#endif
+
+
+#if defined (CPL_SIMD_AVX2)
+    for (; i+16<=n; i+=16) {
+        __m256i *v = (__m256i *) (q + i * 2);
+        _mm256_storeu_si256 (v, _mm256_shuffle_epi8 (_mm256_loadu_si256 (v), _mm256_broadcastsi128_si256 (mask)));
+    }
+#elif defined (CPL_SIMD_SSSE3)
+    for (; i+8<=n; i+=8) {
+        __m128i *v = (__m128i *) (q + i * 2);
+        _mm_storeu_si128 (v, _mm_shuffle_epi8 (_mm_loadu_si128 (v), mask));
+    }
+#elif defined (CPL_SIMD_SSE2)
+    for (; i+8<=n; i+=8) {
+        __m128i *v = (__m128i *) (q + i * 2);
+        __m128i x = _mm_loadu_si128 (v);
+        _mm_storeu_si128 (v, _mm_or_si128 (_mm_slli_epi16 (x, 8), _mm_srli_epi16 (x, 8)));
+    }
+#elif defined (CPL_SIMD_NEON)
+    for (; i+8<=n; i+=8) {
+        vst1q_u8 (q + i * 2, vrev16q_u8 (vld1q_u8 (q + i * 2)));
+    }
+#endif
+
+    CPL_BSWAP_SCALAR (q, i, n, uint16_t, cpl_bswap16);
+}
+
+
+/******************************************************************************
+*
+* cpl_bswap_array32 - Byte swap the array of N 32-bit values or floats given
+*   by P in place.  The array does not need to be aligned.
+*
+******************************************************************************/
+
+void cpl_bswap_array32 (
+    void *p,
+    const size_t n) {
+
+    uint8_t *q = (uint8_t *) p;
+    size_t i = 0;
+#if defined (CPL_SIMD_SSSE3)
+    const __m128i mask = _mm_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+#endif
+
+
+#if defined (CPL_SIMD_AVX2)
+    for (; i+8<=n; i+=8) {
+        __m256i *v = (__m256i *) (q + i * 4);
+        _mm256_storeu_si256 (v, _mm256_shuffle_epi8 (_mm256_loadu_si256 (v), _mm256_broadcastsi128_si256 (mask)));
+    }
+#elif defined (CPL_SIMD_SSSE3)
+    for (; i+4<=n; i+=4) {
+        __m128i *v = (__m128i *) (q + i * 4);
+        _mm_storeu_si128 (v, _mm_shuffle_epi8 (_mm_loadu_si128 (v), mask));
+    }
+#elif defined (CPL_SIMD_SSE2)
+    /* Swap the 16-bit halves of each value, and then the bytes of each half. */
+    for (; i+4<=n; i+=4) {
+        __m128i *v = (__m128i *) (q + i * 4);
+        __m128i x = _mm_loadu_si128 (v);
+        x = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (x, _MM_SHUFFLE (2, 3, 0, 1)), _MM_SHUFFLE (2, 3, 0, 1));
+        _mm_storeu_si128 (v, _mm_or_si128 (_mm_slli_epi16 (x, 8), _mm_srli_epi16 (x, 8)));
+    }
+#elif defined (CPL_SIMD_NEON)
+    for (; i+4<=n; i+=4) {
+        vst1q_u8 (q + i * 4, vrev32q_u8 (vld1q_u8 (q + i * 4)));
+    }
+#endif
+
+    CPL_BSWAP_SCALAR (q, i, n, uint32_t, cpl_bswap32);
+}
+
+
+/******************************************************************************
+*
+* cpl_bswap_array64 - Byte swap the array of N 64-bit values or doubles given
+*   by P in place.  The array does not need to be aligned.
+*
+******************************************************************************/
+
+void cpl_bswap_array64 (
+    void *p,
+    const size_t n) {
+
+    uint8_t *q = (uint8_t *) p;
+    size_t i = 0;
+#if defined (CPL_SIMD_SSSE3)
+    const __m128i mask = _mm_setr_epi8 (7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+#endif
+
+
+#if defined (CPL_SIMD_AVX2)
+    for (; i+4<=n; i+=4) {
+        __m256i *v = (__m256i *) (q + i * 8);
+        _mm256_storeu_si256 (v, _mm256_shuffle_epi8 (_mm256_loadu_si256 (v), _mm256_broadcastsi128_si256 (mask)));
+    }
+#elif defined (CPL_SIMD_SSSE3)
+    for (; i+2<=n; i+=2) {
+        __m128i *v = (__m128i *) (q + i * 8);
+        _mm_storeu_si128 (v, _mm_shuffle_epi8 (_mm_loadu_si128 (v), mask));
+    }
+#elif defined (CPL_SIMD_SSE2)
+    /* Reverse the 16-bit quarters of each value, and then swap the bytes of each quarter. */
+    for (; i+2<=n; i+=2) {
+        __m128i *v = (__m128i *) (q + i * 8);
+        __m128i x = _mm_loadu_si128 (v);
+        x = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (x, _MM_SHUFFLE (0, 1, 2, 3)), _MM_SHUFFLE (0, 1, 2, 3));
+        _mm_storeu_si128 (v, _mm_or_si128 (_mm_slli_epi16 (x, 8), _mm_srli_epi16 (x, 8)));
+    }
+#elif defined (CPL_SIMD_NEON)
+    for (; i+2<=n; i+=2) {
+        vst1q_u8 (q + i * 8, vrev64q_u8 (vld1q_u8 (q + i * 8)));
+    }
+#endif
+
+    CPL_BSWAP_SCALAR (q, i, n, uint64_t, cpl_bswap64);
+}
@@ -55,6 +55,10 @@
 
    cpl_is_big_endian () - Return non-zero if big endian
 
+   cpl_bswap_array16 (p, n) - Byte swap an array of n 16-bit values in place
+   cpl_bswap_array32 (p, n) - Byte swap an array of n 32-bit values or floats in place
+   cpl_bswap_array64 (p, n) - Byte swap an array of n 64-bit values or doubles in place
+
    Some of these routines are macros and may evaluate their input more than once. */
 
 #ifndef CPL_BSWAP_H
@@ -616,6 +620,9 @@ static inline double cpl_bytes_to_f64_swap (const uint8_t *x) {
 
 
 int cpl_is_big_endian (void) CPL_ATTRIBUTE_PURE;
+void cpl_bswap_array16 (void *, const size_t);
+void cpl_bswap_array32 (void *, const size_t);
+void cpl_bswap_array64 (void *, const size_t);
 
 
 CPL_CLINKAGE_END
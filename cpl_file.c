@@ -17,7 +17,9 @@
 
  Compiler Defines:
    HAVE_FSEEKO   - Defined if fseeko is available.
-   HAVE_REALPATH - Defined if realpath is available. */
+   HAVE_REALPATH - Defined if realpath is available.
+   HAVE_MMAP     - Defined if mmap is available.
+   HAVE_IO_URING - Defined if the Linux io_uring interface is available. */
 
 #include "config.h"
 #include <stdio.h>
@@ -30,6 +32,7 @@
 #include <fcntl.h>
 #include <assert.h>
 #include "cpl_file.h"
+#include "cpl_zfile.h"
 #include "cpl_debug.h"
 #include "cpl_alloc.h"
 #include "cpl_str.h"
@@ -39,10 +42,22 @@
 # define F_OK  0
 # include <windows.h>
 # include <direct.h>
+# include <io.h>
 #else
 # include <unistd.h>
 #endif
 
+#if defined (HAVE_MMAP) && !defined (CPL_WIN32_API)
+# include <sys/mman.h>
+#endif
+
+#if defined (HAVE_IO_URING)
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <sys/uio.h>
+# include <linux/io_uring.h>
+#endif
+
 
 /* Define to test if EINTR is available. */
 #ifdef EINTR
@@ -62,6 +77,51 @@
 #endif
 
 
+/* Asynchronous Read Block */
+typedef struct {
+    char *data;                 /* Aligned memory for the read.                */
+    off_t offset;               /* File offset of the first byte of data.      */
+    size_t size;                /* Number of bytes read.                       */
+    int pending;                /* Non-zero until the read is complete.        */
+    int error;                  /* Value of errno if the read failed.          */
+#if defined (HAVE_IO_URING)
+    struct iovec iov;           /* Target of the queued read.                  */
+#endif
+} cpl_bfile_aio_block;
+
+
+/* Buffered File Asynchronous Reads */
+struct cpl_bfile_aio_struct {
+    cpl_bfile_aio_block *blocks;  /* Ring of depth reads in file order.          */
+    char *memory;               /* Allocated memory for the block data.        */
+    size_t depth;               /* Number of reads kept in flight.             */
+    size_t block_size;          /* Size of each read (multiple of alignment).  */
+    size_t head;                /* Index of the block holding the position.    */
+    off_t position;             /* File offset of the next byte returned.      */
+    off_t next;                 /* File offset of the next read queued.        */
+    int active;                 /* Non-zero if every block has a read queued.  */
+    int direct;                 /* Non-zero if O_DIRECT was set on the file.   */
+    int fd;                     /* File descriptor.                            */
+#if defined (HAVE_IO_URING)
+    int ring;                   /* io_uring file descriptor, or -1 for pread.  */
+    unsigned to_submit;         /* Number of reads not given to the kernel.    */
+    unsigned *sq_tail;          /* Submission queue tail.                      */
+    unsigned *sq_mask;          /* Submission queue index mask.                */
+    unsigned *sq_array;         /* Submission queue entry indices.             */
+    unsigned *cq_head;          /* Completion queue head.                      */
+    unsigned *cq_tail;          /* Completion queue tail.                      */
+    unsigned *cq_mask;          /* Completion queue index mask.                */
+    struct io_uring_sqe *sqes;  /* Submission queue entries.                   */
+    struct io_uring_cqe *cqes;  /* Completion queue entries.                   */
+    void *sq_map;               /* Mapping of the submission queue.            */
+    void *cq_map;               /* Mapping of the completion queue.            */
+    size_t sq_map_size;         /* Size of the submission queue mapping.       */
+    size_t cq_map_size;         /* Size of the completion queue mapping.       */
+    size_t sqes_size;           /* Size of the submission entries mapping.     */
+#endif
+};
+
+
 /* External Variable */
 extern int cpl_lib_debug;
 
@@ -310,6 +370,66 @@ ssize_t cpl_read (
 }
 
 
+/******************************************************************************
+*
+* cpl_pread - Read up to SIZE bytes into BUFFER from the open file descriptor FD
+*   starting at the file offset OFFSET, retrying if interrupted.  The file
+*   position of FD is not used, so reads on different parts of the file may be
+*   made without seeking.  On Windows, the file position is moved past the data.
+*
+* Return: Return the number of bytes successfully read, which may be less than
+*           SIZE (e.g., at the end of the file), or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+ssize_t cpl_pread (
+    void *buffer,
+    const size_t size,
+    const int fd,
+    const off_t offset) {
+
+    ssize_t bytes_read;
+
+
+    assert (buffer);
+    assert (fd != -1);
+
+    errno = 0;
+
+#if defined (CPL_WIN32_API)
+    {
+        HANDLE fh = (HANDLE) _get_osfhandle (fd);
+        OVERLAPPED ov;
+        DWORD n = 0;
+
+        memset (&ov, 0, sizeof (ov));
+        ov.Offset = (DWORD) ((unsigned __int64) offset & 0xFFFFFFFF);
+        ov.OffsetHigh = (DWORD) ((unsigned __int64) offset >> 32);
+
+        if (ReadFile (fh, buffer, (DWORD) size, &n, &ov)) {
+            bytes_read = (ssize_t) n;
+        } else if (GetLastError () == ERROR_HANDLE_EOF) {
+            bytes_read = 0;
+        } else {
+            errno = EIO;
+            bytes_read = -1;
+        }
+    }
+#else
+    do {
+        bytes_read = pread (fd, buffer, size, offset);
+    } while ((bytes_read < 0) && (CPL_IS_EINTR (errno)));
+#endif
+
+    if (bytes_read < 0) {
+        cpl_debug (cpl_lib_debug, "Error reading data (%lu bytes at %.0f) from file (fd=%d): %s\n", (unsigned long) size, (double) offset, fd, strerror (errno));
+    }
+
+    return bytes_read;
+}
+
+
 /******************************************************************************
 *
 * cpl_write - Write up to SIZE bytes at BUFFER to the file descriptor FD, retrying
@@ -582,6 +702,1378 @@ int cpl_close (
 }
 
 
+/******************************************************************************
+*
+* cpl_mmap - Map the entire contents of the open file descriptor FD into memory
+*   for read-only access and store the size of the mapping in SIZE.  Pages are
+*   mapped private, so the caller must not write to the returned memory.  The
+*   mapping remains valid after FD is closed and must be released by calling
+*   cpl_munmap().
+*
+* Return: A pointer to the start of the mapped file, or
+*         NULL if the file is empty or could not be mapped.
+*
+******************************************************************************/
+
+void * cpl_mmap (
+    const int fd,
+    size_t *size) {
+
+    cpl_stat_t stbuf;
+    void *addr = NULL;
+
+
+    assert (size);
+    assert (fd != -1);
+
+    *size = 0;
+
+    if (cpl_fstat (fd, &stbuf) != 0) {
+        return NULL;
+    }
+
+    /* Only regular files can be mapped, and zero-length mappings are not allowed. */
+    if ((stbuf.s_isreg == 0) || (stbuf.file_size <= 0)) {
+        return NULL;
+    }
+
+    /* Make sure the file size fits into the address space. */
+    if ((off_t) ((size_t) stbuf.file_size) != stbuf.file_size) {
+        cpl_debug (cpl_lib_debug, "File is too large to map into memory\n");
+        return NULL;
+    }
+
+#if defined (CPL_WIN32_API)
+    {
+        HANDLE fh = (HANDLE) _get_osfhandle (fd);
+        HANDLE mh;
+
+        if (fh == INVALID_HANDLE_VALUE) {
+            return NULL;
+        }
+
+        mh = CreateFileMapping (fh, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mh == NULL) {
+            cpl_debug (cpl_lib_debug, "CreateFileMapping failed (%ld)\n", (long int) GetLastError ());
+            return NULL;
+        }
+
+        addr = MapViewOfFile (mh, FILE_MAP_READ, 0, 0, 0);
+
+        /* The view holds a reference to the mapping object, so the handle can be closed now. */
+        CloseHandle (mh);
+
+        if (addr == NULL) {
+            cpl_debug (cpl_lib_debug, "MapViewOfFile failed (%ld)\n", (long int) GetLastError ());
+            return NULL;
+        }
+    }
+#elif defined (HAVE_MMAP)
+    addr = mmap (NULL, (size_t) stbuf.file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (addr == MAP_FAILED) {
+        cpl_debug (cpl_lib_debug, "mmap failed: %s\n", strerror (errno));
+        return NULL;
+    }
+
+# if defined (POSIX_MADV_SEQUENTIAL)
+    /* The file is normally read from start to end, so tell the kernel to read ahead aggressively. */
+    if (posix_madvise (addr, (size_t) stbuf.file_size, POSIX_MADV_SEQUENTIAL) != 0) {
+        cpl_debug (cpl_lib_debug, "posix_madvise failed\n");
+    }
+# endif
+#else
+    cpl_debug (cpl_lib_debug, "Memory-mapped files are not supported\n");
+    return NULL;
+#endif
+
+    *size = (size_t) stbuf.file_size;
+
+    return addr;
+}
+
+
+/******************************************************************************
+*
+* cpl_munmap - Release the memory mapping at ADDR of length SIZE that was
+*   returned by cpl_mmap().
+*
+* Return: 0 if the mapping is successfully released, and
+*        -1 on failure.
+*
+******************************************************************************/
+
+int cpl_munmap (
+    void *addr,
+    const size_t size) {
+
+    int retval = 0;
+
+
+    if (addr) {
+#if defined (CPL_WIN32_API)
+        (void) size;
+        if (UnmapViewOfFile (addr) == 0) {
+            cpl_debug (cpl_lib_debug, "UnmapViewOfFile failed (%ld)\n", (long int) GetLastError ());
+            retval = -1;
+        }
+#elif defined (HAVE_MMAP)
+        retval = munmap (addr, size);
+
+        if (retval != 0) {
+            cpl_debug (cpl_lib_debug, "munmap failed: %s\n", strerror (errno));
+        }
+#else
+        (void) size;
+        retval = -1;
+#endif
+    }
+
+    return retval;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_aio_uring_init - Create an io_uring with room for ENTRIES reads for
+*   the asynchronous reads A and map its queues into memory.
+*
+* Return: 0 if the io_uring was created, or
+*        -1 if io_uring is not available.
+*
+******************************************************************************/
+
+#if defined (HAVE_IO_URING)
+static int cpl_bfile_aio_uring_init (
+    cpl_bfile_aio *a,
+    const unsigned entries) {
+
+    struct io_uring_params p;
+    char *sq, *cq;
+    int fd;
+
+
+    assert (a);
+
+    memset (&p, 0, sizeof (p));
+
+    fd = (int) syscall (__NR_io_uring_setup, entries, &p);
+    if (fd < 0) {
+        cpl_debug (cpl_lib_debug, "io_uring_setup failed: %s\n", strerror (errno));
+        return -1;
+    }
+
+    a->sq_map_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+    a->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+    a->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+
+    /* Newer kernels share one mapping for both queues. */
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (a->cq_map_size > a->sq_map_size) a->sq_map_size = a->cq_map_size;
+        a->cq_map_size = a->sq_map_size;
+    }
+
+    a->sq_map = mmap (NULL, a->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (a->sq_map == MAP_FAILED) {
+        cpl_debug (cpl_lib_debug, "mmap of io_uring failed: %s\n", strerror (errno));
+        close (fd);
+        return -1;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        a->cq_map = a->sq_map;
+    } else {
+        a->cq_map = mmap (NULL, a->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (a->cq_map == MAP_FAILED) {
+            cpl_debug (cpl_lib_debug, "mmap of io_uring failed: %s\n", strerror (errno));
+            munmap (a->sq_map, a->sq_map_size);
+            close (fd);
+            return -1;
+        }
+    }
+
+    a->sqes = (struct io_uring_sqe *) mmap (NULL, a->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (a->sqes == MAP_FAILED) {
+        cpl_debug (cpl_lib_debug, "mmap of io_uring failed: %s\n", strerror (errno));
+        if (a->cq_map != a->sq_map) munmap (a->cq_map, a->cq_map_size);
+        munmap (a->sq_map, a->sq_map_size);
+        close (fd);
+        return -1;
+    }
+
+    sq = (char *) a->sq_map;
+    cq = (char *) a->cq_map;
+
+    a->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    a->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    a->sq_array = (unsigned *) (sq + p.sq_off.array);
+    a->cq_head = (unsigned *) (cq + p.cq_off.head);
+    a->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    a->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    a->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    a->ring = fd;
+    a->to_submit = 0;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_aio_uring_enter - Give the queued reads of the asynchronous reads A
+*   to the kernel and wait until at least MIN_COMPLETE reads are complete.
+*
+* Return: 0 if successful, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+static int cpl_bfile_aio_uring_enter (
+    cpl_bfile_aio *a,
+    const unsigned min_complete) {
+
+    long result;
+
+
+    assert (a);
+
+    do {
+        result = syscall (__NR_io_uring_enter, a->ring, a->to_submit, min_complete, min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while ((result < 0) && (CPL_IS_EINTR (errno)));
+
+    if (result < 0) {
+        cpl_debug (cpl_lib_debug, "io_uring_enter failed: %s\n", strerror (errno));
+        return -1;
+    }
+
+    a->to_submit -= (unsigned) result;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_aio_uring_reap - Mark the blocks of the completed reads of the
+*   asynchronous reads A as complete.
+*
+******************************************************************************/
+
+static void cpl_bfile_aio_uring_reap (
+    cpl_bfile_aio *a) {
+
+    struct io_uring_cqe *cqe;
+    cpl_bfile_aio_block *l;
+    unsigned head, tail;
+
+
+    assert (a);
+
+    /* The kernel writes the tail and this thread owns the head. */
+    head = *(a->cq_head);
+    tail = __atomic_load_n (a->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        cqe = &(a->cqes[head & *(a->cq_mask)]);
+        l = &(a->blocks[cqe->user_data]);
+
+        if (cqe->res < 0) {
+            l->error = -cqe->res;
+        } else {
+            l->size = (size_t) cqe->res;
+        }
+
+        l->pending = 0;
+        head++;
+    }
+
+    __atomic_store_n (a->cq_head, head, __ATOMIC_RELEASE);
+}
+#endif
+
+
+/******************************************************************************
+*
+* cpl_bfile_aio_submit - Queue a read into the block L of the asynchronous reads
+*   A from the file offset OFFSET.  With io_uring, the read is added to the
+*   submission queue and given to the kernel by the next wait.  Otherwise, the
+*   read is made with pread when the block is needed.
+*
+******************************************************************************/
+
+static void cpl_bfile_aio_submit (
+    cpl_bfile_aio *a,
+    cpl_bfile_aio_block *l,
+    const off_t offset) {
+
+    assert (a);
+    assert (l);
+
+    l->offset = offset;
+    l->size = 0;
+    l->error = 0;
+    l->pending = 1;
+
+#if defined (HAVE_IO_URING)
+    if (a->ring != -1) {
+        struct io_uring_sqe *sqe;
+        unsigned tail, index;
+
+        tail = *(a->sq_tail);
+        index = tail & *(a->sq_mask);
+        sqe = &(a->sqes[index]);
+
+        l->iov.iov_base = l->data;
+        l->iov.iov_len = a->block_size;
+
+        memset (sqe, 0, sizeof (*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = a->fd;
+        sqe->addr = (__u64) (size_t) &(l->iov);
+        sqe->len = 1;
+        sqe->off = (__u64) offset;
+        sqe->user_data = (__u64) (l - a->blocks);
+
+        /* Publish the entry before the tail so the kernel sees a complete entry. */
+        a->sq_array[index] = index;
+        __atomic_store_n (a->sq_tail, tail + 1, __ATOMIC_RELEASE);
+        a->to_submit++;
+    }
+#endif
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_aio_wait - Wait until the read into the block L of the asynchronous
+*   reads A is complete.  A short read is continued with pread unless it is at
+*   the end of the file, so the block is full unless the file ends in it.
+*
+* Return: 0 if the read was successful, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+static int cpl_bfile_aio_wait (
+    cpl_bfile_aio *a,
+    cpl_bfile_aio_block *l) {
+
+    ssize_t result;
+    int retry;
+
+
+    assert (a);
+    assert (l);
+
+#if defined (HAVE_IO_URING)
+    if (a->ring != -1) {
+        if ((a->to_submit > 0) && (cpl_bfile_aio_uring_enter (a, 0) != 0)) return -1;
+
+        cpl_bfile_aio_uring_reap (a);
+        while (l->pending) {
+            if (cpl_bfile_aio_uring_enter (a, 1) != 0) return -1;
+            cpl_bfile_aio_uring_reap (a);
+        }
+    }
+#endif
+
+    /* Reads that are still pending have not been made. */
+    if (l->pending) {
+        l->pending = 0;
+        retry = 1;
+    } else {
+        retry = (l->error == 0) && (l->size > 0);
+    }
+
+    /* O_DIRECT reads must start on an aligned offset, and a short unaligned read is the end of the file. */
+    while (retry && (l->size < a->block_size) && (!a->direct || (l->size % CPL_BFILE_ALIGN == 0))) {
+        result = cpl_pread (l->data + l->size, a->block_size - l->size, a->fd, l->offset + (off_t) l->size);
+        if (result < 0) {
+            l->error = errno;
+            break;
+        }
+        if (result == 0) break;
+        l->size += (size_t) result;
+    }
+
+    if (l->error != 0) {
+        errno = l->error;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_aio_drain - Wait for every queued read of the asynchronous reads A,
+*   so the blocks can be reused.  No reads are queued afterwards.
+*
+* Return: 0 if successful, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+static int cpl_bfile_aio_drain (
+    cpl_bfile_aio *a) {
+
+    size_t i;
+
+
+    assert (a);
+
+#if defined (HAVE_IO_URING)
+    if (a->ring != -1) {
+        if ((a->to_submit > 0) && (cpl_bfile_aio_uring_enter (a, 0) != 0)) return -1;
+
+        cpl_bfile_aio_uring_reap (a);
+        for (i = 0; i < a->depth; i++) {
+            while (a->blocks[i].pending) {
+                if (cpl_bfile_aio_uring_enter (a, 1) != 0) return -1;
+                cpl_bfile_aio_uring_reap (a);
+            }
+        }
+    }
+#endif
+
+    for (i = 0; i < a->depth; i++) {
+        a->blocks[i].pending = 0;
+    }
+
+    a->active = 0;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_aio_direct - Set or clear O_DIRECT on the file of the asynchronous
+*   reads A if DIRECT is non-zero or zero, respectively.
+*
+* Return: 0 if successful, or
+*        -1 if O_DIRECT is not supported.
+*
+******************************************************************************/
+
+static int cpl_bfile_aio_direct (
+    cpl_bfile_aio *a,
+    const int direct) {
+
+#if defined (O_DIRECT) && !defined (CPL_WIN32_API)
+    int flags;
+
+
+    assert (a);
+
+    flags = fcntl (a->fd, F_GETFL);
+    if (flags == -1) return -1;
+
+    flags = direct ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    if (fcntl (a->fd, F_SETFL, flags) == -1) {
+        cpl_debug (cpl_lib_debug, "Failed to change O_DIRECT: %s\n", strerror (errno));
+        return -1;
+    }
+
+    a->direct = direct;
+
+    return 0;
+#else
+    assert (a);
+    return direct ? -1 : 0;
+#endif
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_aio_read - Read up to SIZE bytes into BUFFER from the asynchronous
+*   reads A at the current position.  When all data in the oldest block has been
+*   returned, it is reused for the read after the newest one, so DEPTH reads
+*   stay in flight while the file is read in order.
+*
+* Return: Return the number of bytes successfully read, which is zero only at
+*           EOF, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+static ssize_t cpl_bfile_aio_read (
+    cpl_bfile_aio *a,
+    char *buffer,
+    const size_t size) {
+
+    cpl_bfile_aio_block *l;
+    size_t i, n, skip;
+    int error;
+
+
+    assert (a);
+    assert (buffer);
+
+    for (;;) {
+        /* Queue reads into all blocks starting at the aligned offset of the position. */
+        if (!a->active) {
+            a->head = 0;
+            a->next = a->position - a->position % CPL_BFILE_ALIGN;
+            for (i = 0; i < a->depth; i++) {
+                cpl_bfile_aio_submit (a, &(a->blocks[i]), a->next);
+                a->next += (off_t) a->block_size;
+            }
+            a->active = 1;
+        }
+
+        l = &(a->blocks[a->head]);
+
+        if (cpl_bfile_aio_wait (a, l) != 0) {
+            error = errno;
+            if (cpl_bfile_aio_drain (a) != 0) return -1;
+
+            /* Some file systems only reject O_DIRECT on the first read, so use the page cache. */
+            if ((error == EINVAL) && a->direct && (cpl_bfile_aio_direct (a, 0) == 0)) continue;
+
+            errno = error;
+            return -1;
+        }
+
+        skip = (size_t) (a->position - l->offset);
+
+        if (skip < l->size) {
+            n = l->size - skip;
+            if (n > size) n = size;
+            memcpy (buffer, l->data + skip, n);
+            a->position += (off_t) n;
+            return (ssize_t) n;
+        }
+
+        /* The file ends in a short block.  Reads are queued again next time in case the file grows. */
+        if (l->size < a->block_size) {
+            if (cpl_bfile_aio_drain (a) != 0) return -1;
+            return 0;
+        }
+
+        cpl_bfile_aio_submit (a, l, a->next);
+        a->next += (off_t) a->block_size;
+        a->head = (a->head + 1) % a->depth;
+    }
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_aio_seek - Set the position of the asynchronous reads A to the file
+*   offset OFFSET.  The queued reads are kept if they include the offset.
+*
+* Return: 0 if the position was set, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+static int cpl_bfile_aio_seek (
+    cpl_bfile_aio *a,
+    const off_t offset) {
+
+    assert (a);
+
+    if (a->active && (offset >= a->blocks[a->head].offset) && (offset < a->next)) {
+        a->position = offset;
+        return 0;
+    }
+
+    if (cpl_bfile_aio_drain (a) != 0) return -1;
+
+    a->position = offset;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_aio_free - Wait for the queued reads, clear O_DIRECT, and free the
+*   asynchronous reads A.  If the queued reads can not be waited for, then the
+*   memory of the blocks is not freed, since the reads may still write to it.
+*
+******************************************************************************/
+
+static void cpl_bfile_aio_free (
+    cpl_bfile_aio *a) {
+
+    int leak = 0;
+
+
+    assert (a);
+
+    if (cpl_bfile_aio_drain (a) != 0) {
+        cpl_debug (cpl_lib_debug, "Unable to wait for the queued reads, so the read blocks are not freed\n");
+        leak = 1;
+    }
+
+    if (a->direct) cpl_bfile_aio_direct (a, 0);
+
+#if defined (HAVE_IO_URING)
+    if (a->ring != -1) {
+        munmap (a->sqes, a->sqes_size);
+        if (a->cq_map != a->sq_map) munmap (a->cq_map, a->cq_map_size);
+        munmap (a->sq_map, a->sq_map_size);
+        close (a->ring);
+    }
+#endif
+
+    if (!leak) cpl_free (a->memory);
+    cpl_free (a->blocks);
+    cpl_free (a);
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_input - Read up to SIZE bytes into BUFFER from the file of the
+*   buffered file B at the end of the valid data in the block.
+*
+* Return: Return the number of bytes successfully read, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+static ssize_t cpl_bfile_input (
+    cpl_bfile_t *b,
+    void *buffer,
+    const size_t size) {
+
+    ssize_t result;
+
+
+    assert (b);
+
+    if (b->zfile) {
+        result = cpl_zfile_read (b->zfile, buffer, size);
+    } else if (b->aio) {
+        result = cpl_bfile_aio_read (b->aio, (char *) buffer, size);
+    } else {
+        result = cpl_read (buffer, size, b->fd);
+    }
+
+    b->num_reads++;
+    if (result > 0) b->bytes_read += (uint64_t) result;
+
+    return result;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_init - Initialize the buffered file B to read from the open file
+*   descriptor FD in blocks of at least BLOCK_SIZE bytes.  If BLOCK_SIZE is zero,
+*   then CPL_BFILE_BLOCK_SIZE is used.  Reading starts at the current position
+*   of FD.  No memory is allocated until the first read.  The reads and seeks
+*   made on FD are counted in the bytes_read, num_reads, and num_seeks members.
+*   The caller must call cpl_bfile_free() to free the block after use, but the
+*   file descriptor is not closed by the buffered file.
+*
+******************************************************************************/
+
+void cpl_bfile_init (
+    cpl_bfile_t *b,
+    const int fd,
+    const size_t block_size) {
+
+    assert (b);
+
+    b->buffer = NULL;
+    b->buffer_size = 0;
+    b->block_size = block_size > 0 ? block_size : CPL_BFILE_BLOCK_SIZE;
+    b->start = 0;
+    b->end = 0;
+    b->fd = fd;
+    b->aio = NULL;
+    b->zfile = NULL;
+    b->bytes_read = 0;
+    b->num_reads = 0;
+    b->num_seeks = 0;
+
+    /* Pipes do not have a file position, so count from zero. */
+    b->offset = fd != -1 ? cpl_seek (fd, 0, SEEK_CUR) : 0;
+    if (b->offset == (off_t) -1) b->offset = 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_free - Free the read-ahead block of the buffered file B.
+*
+******************************************************************************/
+
+void cpl_bfile_free (
+    cpl_bfile_t *b) {
+
+    assert (b);
+
+    if (b->zfile) {
+        cpl_zfile_close (b->zfile);
+        b->zfile = NULL;
+    }
+
+    /* Leave the file position of the descriptor after the data read. */
+    if (b->aio) {
+        cpl_bfile_aio_free (b->aio);
+        b->aio = NULL;
+        cpl_seek (b->fd, b->offset, SEEK_SET);
+    }
+
+    if (b->buffer) {
+        cpl_free (b->buffer);
+        b->buffer = NULL;
+    }
+
+    b->buffer_size = 0;
+    b->start = 0;
+    b->end = 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_set_buffer - Give the block BUFFER of BUFFER_SIZE bytes to the
+*   buffered file B, which has not read anything yet.  The first N bytes of
+*   BUFFER are the data read from the file descriptor just before its current
+*   position, such as a prefix read to identify the file, and are returned by
+*   the first reads instead of being read again.  BUFFER must be allocated with
+*   cpl_malloc() and is owned by B, which frees it with cpl_bfile_free().
+*
+******************************************************************************/
+
+void cpl_bfile_set_buffer (
+    cpl_bfile_t *b,
+    char *buffer,
+    const size_t buffer_size,
+    const size_t n) {
+
+    assert (b);
+    assert (buffer);
+    assert (n <= buffer_size);
+    assert (!b->buffer && !b->aio);
+
+    b->buffer = buffer;
+    b->buffer_size = buffer_size;
+    b->start = 0;
+    b->end = n;
+
+    /* Pipes do not have a file position, so count from the start of the given data. */
+    b->offset = cpl_seek (b->fd, 0, SEEK_CUR);
+    if (b->offset == (off_t) -1) b->offset = (off_t) n;
+
+    /* The data was read from the file, so it is counted as one read. */
+    b->num_reads++;
+    b->bytes_read += n;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_set_block_size - Set the minimum number of bytes read from the file
+*   at a time by the buffered file B to BLOCK_SIZE.  If BLOCK_SIZE is zero, then
+*   CPL_BFILE_BLOCK_SIZE is used.  The block is resized on the next read.
+*
+******************************************************************************/
+
+void cpl_bfile_set_block_size (
+    cpl_bfile_t *b,
+    const size_t block_size) {
+
+    assert (b);
+    b->block_size = block_size > 0 ? block_size : CPL_BFILE_BLOCK_SIZE;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_reserve - Make sure the block of the buffered file B can hold at
+*   least SIZE contiguous unread bytes, which is needed before calling
+*   cpl_bfile_get().  Any unread data in the block is preserved.
+*
+* Return: 0 if the block is large enough, or
+*        -1 if memory allocation failed.
+*
+******************************************************************************/
+
+int cpl_bfile_reserve (
+    cpl_bfile_t *b,
+    const size_t size) {
+
+    size_t n;
+    char *p;
+
+
+    assert (b);
+
+    if (size <= b->buffer_size) return 0;
+
+    /* The block is never smaller than the block size.  Larger requests allocate
+       1.5 * size bytes to avoid reallocating for every slightly larger request. */
+    n = size <= b->block_size ? b->block_size : size + (size + 1) / 2;
+
+    /* Move any unread data to the start of the block before growing it. */
+    if (b->start > 0) {
+        memmove (b->buffer, b->buffer + b->start, b->end - b->start);
+        b->end -= b->start;
+        b->start = 0;
+    }
+
+    p = (char *) cpl_realloc (b->buffer, n);
+    if (!p) {
+        cpl_debug (cpl_lib_debug, "Failed to allocate %lu bytes for file block\n", (unsigned long) n);
+        return -1;
+    }
+
+    b->buffer = p;
+    b->buffer_size = n;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_fill - Read from the file into the block of the buffered file B until
+*   at least SIZE unread bytes are available or EOF is reached.  The block must
+*   already be large enough to hold SIZE bytes.
+*
+* Return: The number of unread bytes in the block, which is less than SIZE
+*           only at EOF, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+static ssize_t cpl_bfile_fill (
+    cpl_bfile_t *b,
+    const size_t size) {
+
+    ssize_t result;
+
+
+    assert (b);
+    assert (size <= b->buffer_size);
+
+    if (b->end - b->start >= size) return (ssize_t) (b->end - b->start);
+
+    /* Move the unread data to the start of the block if the rest will not fit. */
+    if (b->start + size > b->buffer_size) {
+        memmove (b->buffer, b->buffer + b->start, b->end - b->start);
+        b->end -= b->start;
+        b->start = 0;
+    }
+
+    /* Read as much as will fit in the block so later requests are served from memory.
+       Pipes and network files may return partial reads, so keep reading until done. */
+    while (b->end - b->start < size) {
+        result = cpl_bfile_input (b, b->buffer + b->end, b->buffer_size - b->end);
+        if (result < 0) return -1;
+        if (result == 0) break;
+        b->end += (size_t) result;
+        b->offset += (off_t) result;
+    }
+
+    return (ssize_t) (b->end - b->start);
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_read - Read up to SIZE bytes from the buffered file B into BUFFER.
+*   Reads that are larger than the block size bypass the block.
+*
+* Return: Return the number of bytes successfully read, which is less than
+*           SIZE only at EOF, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+ssize_t cpl_bfile_read (
+    cpl_bfile_t *b,
+    void *buffer,
+    const size_t size) {
+
+    size_t n;
+    ssize_t result;
+
+
+    assert (b);
+    assert (buffer);
+
+    if (size == 0) return 0;
+
+    /* Copy whatever is already in the block. */
+    n = b->end - b->start;
+    if (n > size) n = size;
+    if (n > 0) {
+        memcpy (buffer, b->buffer + b->start, n);
+        b->start += n;
+    }
+
+    if (n == size) return (ssize_t) n;
+
+    /* The block is now empty.  Large requests are read directly to the caller's buffer. */
+    b->start = b->end = 0;
+
+    if (size - n >= b->block_size) {
+        while (n < size) {
+            result = cpl_bfile_input (b, (char *) buffer + n, size - n);
+            if (result < 0) return -1;
+            if (result == 0) break;
+            n += (size_t) result;
+            b->offset += (off_t) result;
+        }
+        return (ssize_t) n;
+    }
+
+    if (cpl_bfile_reserve (b, b->block_size) != 0) return -1;
+
+    result = cpl_bfile_fill (b, size - n);
+    if (result < 0) return -1;
+
+    if ((size_t) result > size - n) result = (ssize_t) (size - n);
+    memcpy ((char *) buffer + n, b->buffer + b->start, (size_t) result);
+    b->start += (size_t) result;
+
+    return (ssize_t) n + result;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_get - Set PTR to SIZE contiguous bytes read from the buffered file B
+*   without copying them.  The data remains valid until the next call using B.
+*   The caller must first call cpl_bfile_reserve() with at least SIZE bytes.
+*
+* Return: Return the number of bytes available at PTR, which is less than
+*           SIZE only at EOF, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+ssize_t cpl_bfile_get (
+    cpl_bfile_t *b,
+    char **ptr,
+    const size_t size) {
+
+    ssize_t result;
+
+
+    assert (b);
+    assert (ptr);
+
+    if (size > b->buffer_size) {
+        cpl_debug (cpl_lib_debug, "File block is too small (%lu < %lu)\n", (unsigned long) b->buffer_size, (unsigned long) size);
+        return -1;
+    }
+
+    result = cpl_bfile_fill (b, size);
+    if (result < 0) return -1;
+
+    if ((size_t) result > size) result = (ssize_t) size;
+
+    *ptr = b->buffer + b->start;
+    b->start += (size_t) result;
+
+    return result;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_peek - Set PTR to the next SIZE contiguous bytes of the buffered file
+*   B without copying them or moving the read position.  The data remains valid
+*   until the next call using B.  The caller must first call cpl_bfile_reserve()
+*   with at least SIZE bytes.
+*
+* Return: Return the number of bytes available at PTR, which is less than
+*           SIZE only at EOF, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+ssize_t cpl_bfile_peek (
+    cpl_bfile_t *b,
+    char **ptr,
+    const size_t size) {
+
+    ssize_t result;
+
+
+    assert (b);
+    assert (ptr);
+
+    if (size > b->buffer_size) {
+        cpl_debug (cpl_lib_debug, "File block is too small (%lu < %lu)\n", (unsigned long) b->buffer_size, (unsigned long) size);
+        return -1;
+    }
+
+    result = cpl_bfile_fill (b, size);
+    if (result < 0) return -1;
+
+    if ((size_t) result > size) result = (ssize_t) size;
+
+    *ptr = b->buffer + b->start;
+
+    return result;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_skip - Skip SIZE bytes forward in the buffered file B.  If the data
+*   is already in the block, then only the read cursor is moved, otherwise the
+*   file position is moved past the remainder.  Files that do not support seeking
+*   (e.g., pipes) are read and the data discarded.
+*
+* Return: 0 if the data was skipped, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+int cpl_bfile_skip (
+    cpl_bfile_t *b,
+    const size_t size) {
+
+    size_t n;
+    ssize_t result;
+
+
+    assert (b);
+
+    /* Move the cursor if the data is already in the block. */
+    n = b->end - b->start;
+
+    if (size <= n) {
+        b->start += size;
+        return 0;
+    }
+
+    n = size - n;
+    b->start = b->end = 0;
+    b->num_seeks++;
+
+    if (b->zfile) {
+        if (cpl_zfile_seek (b->zfile, (uint64_t) (b->offset + (off_t) n)) != 0) return -1;
+        b->offset += (off_t) n;
+        return 0;
+    }
+
+    if (b->aio) {
+        if (cpl_bfile_aio_seek (b->aio, b->offset + (off_t) n) != 0) return -1;
+        b->offset += (off_t) n;
+        return 0;
+    }
+
+    if (cpl_seek (b->fd, (off_t) n, SEEK_CUR) != (off_t) -1) {
+        b->offset += (off_t) n;
+        return 0;
+    }
+
+    if (errno != ESPIPE) return -1;
+
+    /* Not seekable, so read the data through the block and discard it. */
+    if (cpl_bfile_reserve (b, b->block_size) != 0) return -1;
+
+    while (n > 0) {
+        result = cpl_read (b->buffer, n < b->buffer_size ? n : b->buffer_size, b->fd);
+        b->num_reads++;
+        if (result <= 0) return (int) result;
+        b->bytes_read += (uint64_t) result;
+        n -= (size_t) result;
+        b->offset += (off_t) result;
+    }
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_tell - Return the file offset of the next unread byte of the
+*   buffered file B.
+*
+******************************************************************************/
+
+off_t cpl_bfile_tell (
+    const cpl_bfile_t *b) {
+
+    assert (b);
+    return b->offset - (off_t) (b->end - b->start);
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_seek - Set the position of the next unread byte of the buffered
+*   file B to the file offset OFFSET.  If the offset is within the data already
+*   in the block, then only the read cursor is moved.
+*
+* Return: 0 if the position was set, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+int cpl_bfile_seek (
+    cpl_bfile_t *b,
+    const off_t offset) {
+
+    off_t block_offset;
+
+
+    assert (b);
+
+    if (offset < 0) return -1;
+
+    /* File offset of the start of the block. */
+    block_offset = b->offset - (off_t) b->end;
+
+    if ((offset >= block_offset) && (offset <= b->offset)) {
+        b->start = (size_t) (offset - block_offset);
+        return 0;
+    }
+
+    b->num_seeks++;
+
+    if (b->zfile) {
+        if (cpl_zfile_seek (b->zfile, (uint64_t) offset) != 0) return -1;
+    } else if (b->aio) {
+        if (cpl_bfile_aio_seek (b->aio, offset) != 0) return -1;
+    } else if (cpl_seek (b->fd, offset, SEEK_SET) == (off_t) -1) {
+        return -1;
+    }
+
+    b->start = b->end = 0;
+    b->offset = offset;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_discard - Discard the data in the block of the buffered file B, so
+*   the data at and after the file position are read from the file again.  This
+*   is needed before seeking back to data that the caller changed in the block.
+*
+* Return: 0 if the data was discarded, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+int cpl_bfile_discard (
+    cpl_bfile_t *b) {
+
+    off_t offset;
+
+
+    assert (b);
+
+    if (b->end == 0) return 0;
+
+    offset = cpl_bfile_tell (b);
+    b->num_seeks++;
+
+    if (b->zfile) {
+        if (cpl_zfile_seek (b->zfile, (uint64_t) offset) != 0) return -1;
+    } else if (b->aio) {
+        if (cpl_bfile_aio_seek (b->aio, offset) != 0) return -1;
+    } else if (cpl_seek (b->fd, offset, SEEK_SET) == (off_t) -1) {
+        return -1;
+    }
+
+    b->start = b->end = 0;
+    b->offset = offset;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_set_async - Read the file of the buffered file B with DEPTH reads of
+*   the block size kept in flight ahead of the data in the block.  On Linux, the
+*   reads are queued together with io_uring, so one thread keeps DEPTH requests
+*   outstanding on the device.  Elsewhere, or if io_uring is not available, the
+*   reads are made one at a time with pread.  The reads are aligned to
+*   CPL_BFILE_ALIGN bytes, and if FLAGS includes CPL_BFILE_DIRECT, then the file
+*   is opened with O_DIRECT to bypass the page cache where the file system
+*   supports it.  The read size is fixed by the block size at the time of the
+*   call.  The other buffered file functions are unchanged, but the file
+*   position of the descriptor is undefined until cpl_bfile_free() is called or
+*   DEPTH is zero, which returns to plain reads at the next unread byte.  This
+*   has no effect on a compressed file found by cpl_bfile_detect(), which is
+*   read with pread by its decoding threads.
+*
+* Return: 0 if successful, or
+*        -1 if an error occurred (errno is ENOMEM if memory allocation failed or
+*           ESPIPE if the file does not support seeking).
+*
+******************************************************************************/
+
+int cpl_bfile_set_async (
+    cpl_bfile_t *b,
+    const size_t depth,
+    const int flags) {
+
+    cpl_bfile_aio *a;
+    size_t i, block_size;
+    char *data;
+
+
+    assert (b);
+
+    if (b->zfile) return 0;
+
+    if (b->aio) {
+        cpl_bfile_aio_free (b->aio);
+        b->aio = NULL;
+        if (cpl_seek (b->fd, b->offset, SEEK_SET) == (off_t) -1) return -1;
+    }
+
+    if (depth == 0) return 0;
+
+    /* Pipes do not support reads at an offset. */
+    if (cpl_seek (b->fd, 0, SEEK_CUR) == (off_t) -1) return -1;
+
+    block_size = b->block_size + CPL_BFILE_ALIGN - 1;
+    block_size -= block_size % CPL_BFILE_ALIGN;
+
+    if (depth > ((size_t) -1 - CPL_BFILE_ALIGN) / block_size) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    a = (cpl_bfile_aio *) cpl_malloc (sizeof (cpl_bfile_aio));
+    if (!a) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    a->blocks = (cpl_bfile_aio_block *) cpl_calloc (depth, sizeof (cpl_bfile_aio_block));
+    a->memory = (char *) cpl_malloc (depth * block_size + CPL_BFILE_ALIGN);
+
+    if (!a->blocks || !a->memory) {
+        cpl_debug (cpl_lib_debug, "Failed to allocate %lu asynchronous reads of %lu bytes\n", (unsigned long) depth, (unsigned long) block_size);
+        if (a->blocks) cpl_free (a->blocks);
+        if (a->memory) cpl_free (a->memory);
+        cpl_free (a);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    data = (char *) cpl_ptr_align (a->memory, CPL_BFILE_ALIGN);
+    for (i = 0; i < depth; i++) {
+        a->blocks[i].data = data + i * block_size;
+    }
+
+    a->depth = depth;
+    a->block_size = block_size;
+    a->head = 0;
+    a->position = b->offset;
+    a->next = 0;
+    a->active = 0;
+    a->direct = 0;
+    a->fd = b->fd;
+
+#if defined (HAVE_IO_URING)
+    a->ring = -1;
+    if ((depth > UINT_MAX) || (cpl_bfile_aio_uring_init (a, (unsigned) depth) != 0)) {
+        cpl_debug (cpl_lib_debug, "io_uring is not available, so reads are made with pread\n");
+    }
+#endif
+
+    if ((flags & CPL_BFILE_DIRECT) && (cpl_bfile_aio_direct (a, 1) != 0)) {
+        cpl_debug (cpl_lib_debug, "O_DIRECT is not supported, so reads use the page cache\n");
+    }
+
+    b->aio = a;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_detect - Determine if the file of the buffered file B, which must
+*   be positioned at the start of the file, is a compressed file written by
+*   cpl_zfile_create().  If so, then the buffered file reads the decoded data
+*   from then on, with THREADS frames decoded ahead on as many threads, and the
+*   file offsets of the other buffered file functions are offsets of the decoded
+*   data.  The file is decoded in frames, so a seek only decodes the frame at
+*   the new offset.  A file that is not a valid compressed file, including one
+*   that does not support seeking, is read unchanged.  The start of the file is
+*   read into the block, so this is done before any other read.
+*
+* Return: 1 if the file is a compressed file,
+*         0 if the file is read unchanged, or
+*        -1 if an error occurred while reading the start of the file.
+*
+******************************************************************************/
+
+int cpl_bfile_detect (
+    cpl_bfile_t *b,
+    const size_t threads) {
+
+    cpl_zfile *z;
+    ssize_t result;
+    char *p;
+
+
+    assert (b);
+
+    if (b->zfile) return 1;
+
+    /* Only the start of the file can be checked for the header. */
+    if ((b->start != 0) || (b->offset != (off_t) b->end)) return 0;
+
+    if (cpl_bfile_reserve (b, b->block_size) != 0) return -1;
+
+    result = cpl_bfile_peek (b, &p, CPL_ZFILE_HEADER_SIZE);
+    if (result < 0) return -1;
+
+    if (!cpl_zfile_identify_data (p, (size_t) result)) return 0;
+
+    z = cpl_zfile_open_fd (b->fd, threads);
+    if (!z) {
+        cpl_debug (cpl_lib_debug, "Invalid compressed file, so it is read unchanged\n");
+        return 0;
+    }
+
+    if (b->aio) {
+        cpl_bfile_aio_free (b->aio);
+        b->aio = NULL;
+    }
+
+    b->zfile = z;
+    b->start = b->end = 0;
+    b->offset = 0;
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* cpl_bfile_set_threads - Decode THREADS frames ahead on as many threads if the
+*   buffered file B reads a compressed file, or decode each frame when it is
+*   needed if THREADS is zero.
+*
+******************************************************************************/
+
+void cpl_bfile_set_threads (
+    cpl_bfile_t *b,
+    const size_t threads) {
+
+    assert (b);
+
+    if (b->zfile) cpl_zfile_set_threads (b->zfile, threads);
+}
+
+
 /******************************************************************************
 *
 * cpl_realpath - Return the canonicalized name of the FILE_NAME which does not
@@ -29,6 +29,7 @@
 #include <time.h>
 #endif
 
+#define CPL_NEED_FIXED_WIDTH_T  /* Tell cpl_spec.h we need fixed-width types. */
 #include "cpl_spec.h"
 
 
@@ -74,6 +75,43 @@ typedef struct {
 } cpl_stat_t;
 
 
+/* Default Buffered File Block Size */
+#define CPL_BFILE_BLOCK_SIZE  (1 << 20)
+
+
+/* Alignment of the File Offset, Size, and Memory of Asynchronous Reads */
+#define CPL_BFILE_ALIGN       4096
+
+
+/* Buffered File Asynchronous Read Flags */
+#define CPL_BFILE_DIRECT      0x0001   /* Bypass the page cache (O_DIRECT) if supported. */
+
+
+/* Buffered File Asynchronous Reads */
+typedef struct cpl_bfile_aio_struct cpl_bfile_aio;
+
+
+/* Buffered File Compressed File (see cpl_zfile.h) */
+typedef struct cpl_zfile_struct cpl_bfile_zfile;
+
+
+/* Buffered File Type */
+typedef struct {
+    char *buffer;          /* Read-ahead block.                          */
+    size_t buffer_size;    /* Allocated size of the block.               */
+    size_t block_size;     /* Minimum size of each read from the file.   */
+    size_t start;          /* Offset of the next unread byte in block.   */
+    size_t end;            /* Offset past the last valid byte in block.  */
+    off_t offset;          /* File offset of the end of the valid data.  */
+    int fd;                /* File descriptor.                           */
+    cpl_bfile_aio *aio;    /* Reads queued ahead of the block, or NULL.  */
+    cpl_bfile_zfile *zfile; /* Compressed file decoded, or NULL.         */
+    uint64_t bytes_read;   /* Number of bytes read from the file.        */
+    uint64_t num_reads;    /* Number of reads from the file.             */
+    uint64_t num_seeks;    /* Number of seeks in the file.               */
+} cpl_bfile_t;
+
+
 /******************************* API Functions *******************************/
 
 CPL_CLINKAGE_START
@@ -84,6 +122,7 @@ int cpl_fseeko (FILE *, const off_t, const int) CPL_ATTRIBUTE_NONNULL_ALL;
 off_t cpl_seek (const int, const off_t, const int);
 size_t cpl_fread (void *, const size_t, FILE *) CPL_ATTRIBUTE_NONNULL_ALL;
 ssize_t cpl_read (void *, const size_t, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+ssize_t cpl_pread (void *, const size_t, const int, const off_t) CPL_ATTRIBUTE_NONNULL_ALL;
 ssize_t cpl_write (const int, const void *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
 int cpl_file_exists (const char *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
 FILE * cpl_fopen (const char *, const int) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
@@ -91,6 +130,23 @@ int cpl_open (const char *, const int) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_W
 int cpl_create (const char *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
 int cpl_fclose (FILE *);
 int cpl_close (const int);
+void * cpl_mmap (const int, size_t *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int cpl_munmap (void *, const size_t);
+void cpl_bfile_init (cpl_bfile_t *, const int, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_bfile_free (cpl_bfile_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_bfile_set_buffer (cpl_bfile_t *, char *, const size_t, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_bfile_set_block_size (cpl_bfile_t *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_bfile_reserve (cpl_bfile_t *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+ssize_t cpl_bfile_read (cpl_bfile_t *, void *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+ssize_t cpl_bfile_get (cpl_bfile_t *, char **, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+ssize_t cpl_bfile_peek (cpl_bfile_t *, char **, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_bfile_skip (cpl_bfile_t *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+off_t cpl_bfile_tell (const cpl_bfile_t *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+int cpl_bfile_seek (cpl_bfile_t *, const off_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_bfile_discard (cpl_bfile_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_bfile_set_async (cpl_bfile_t *, const size_t, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_bfile_detect (cpl_bfile_t *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_bfile_set_threads (cpl_bfile_t *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
 char * cpl_realpath (const char *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT CPL_ATTRIBUTE_NONNULL_ALL;
 int cpl_remove (const char *);
 int cpl_mkstemp (char *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
@@ -0,0 +1,698 @@
+/* cpl_nav.c -- Time ordered store of navigation and motion samples.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "cpl_nav.h"
+#include "cpl_alloc.h"
+#include "cpl_error.h"
+#include "cpl_table.h"
+
+
+/* Number of Intervals Stepped Forward Before a Binary Search */
+#define CPL_NAV_MAX_STEPS  8
+
+
+/* Number of Samples Copied to a Table at a Time */
+#define CPL_NAV_TABLE_ROWS  4096
+
+
+/* Private Function Prototypes */
+static void cpl_nav_init_series (cpl_nav_series *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void cpl_nav_free_series (cpl_nav_series *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_nav_add (cpl_nav_series *, const int64_t, const double *) CPL_ATTRIBUTE_NONNULL_ALL;
+static size_t cpl_nav_find (cpl_nav_series *, const int64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static size_t cpl_nav_interp (cpl_nav_series *, const int64_t *, const size_t, double **, const double *, const double *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_nav_write (const cpl_nav_series *, cpl_table *, const char **) CPL_ATTRIBUTE_NONNULL_ALL;
+
+
+/******************************************************************************
+*
+* cpl_nav_init - Initialize the navigation store N, which must be done before
+*   any samples are added.
+*
+******************************************************************************/
+
+void cpl_nav_init (
+    cpl_nav *n) {
+
+    assert (n);
+
+    cpl_nav_init_series (&(n->attitude), 3);
+    cpl_nav_init_series (&(n->heading), 1);
+    cpl_nav_init_series (&(n->position), 2);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_free - Free the memory used by the navigation store N.
+*
+******************************************************************************/
+
+void cpl_nav_free (
+    cpl_nav *n) {
+
+    assert (n);
+
+    cpl_nav_free_series (&(n->attitude));
+    cpl_nav_free_series (&(n->heading));
+    cpl_nav_free_series (&(n->position));
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_clear - Remove all samples from the navigation store N.  The memory
+*   is kept so it can be reused for the samples of the next file.
+*
+******************************************************************************/
+
+void cpl_nav_clear (
+    cpl_nav *n) {
+
+    assert (n);
+
+    n->attitude.num = n->attitude.cursor = 0;
+    n->heading.num = n->heading.cursor = 0;
+    n->position.num = n->position.cursor = 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_add_attitude - Add the ROLL and PITCH in degrees and the HEAVE in
+*   meters at TIME in nanoseconds since 1970-01-01 to the navigation store N.
+*
+* Return: 0 if the sample was added, or
+*         CS_ENOMEM if memory could not be allocated.
+*
+******************************************************************************/
+
+int cpl_nav_add_attitude (
+    cpl_nav *n,
+    const int64_t time,
+    const double roll,
+    const double pitch,
+    const double heave) {
+
+    double v[3];
+
+
+    assert (n);
+
+    v[CPL_NAV_ROLL] = roll;
+    v[CPL_NAV_PITCH] = pitch;
+    v[CPL_NAV_HEAVE] = heave;
+
+    return cpl_nav_add (&(n->attitude), time, v);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_add_heading - Add the HEADING in degrees at TIME in nanoseconds since
+*   1970-01-01 to the navigation store N.
+*
+* Return: 0 if the sample was added, or
+*         CS_ENOMEM if memory could not be allocated.
+*
+******************************************************************************/
+
+int cpl_nav_add_heading (
+    cpl_nav *n,
+    const int64_t time,
+    const double heading) {
+
+    assert (n);
+
+    return cpl_nav_add (&(n->heading), time, &heading);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_add_position - Add the LATITUDE and LONGITUDE in degrees at TIME in
+*   nanoseconds since 1970-01-01 to the navigation store N.
+*
+* Return: 0 if the sample was added, or
+*         CS_ENOMEM if memory could not be allocated.
+*
+******************************************************************************/
+
+int cpl_nav_add_position (
+    cpl_nav *n,
+    const int64_t time,
+    const double latitude,
+    const double longitude) {
+
+    double v[2];
+
+
+    assert (n);
+
+    v[CPL_NAV_LATITUDE] = latitude;
+    v[CPL_NAV_LONGITUDE] = longitude;
+
+    return cpl_nav_add (&(n->position), time, v);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_interp_attitude - Linearly interpolate the roll, pitch, and heave of
+*   the navigation store N at the NUM_TIMES times TIME in nanoseconds since
+*   1970-01-01, and store them in the arrays ROLL, PITCH, and HEAVE.  Any of
+*   the output arrays may be NULL if not needed.  Times outside of the samples
+*   in the store are set to NaN.  The interval found for each time is kept, so
+*   times in increasing order are found by stepping forward instead of with a
+*   binary search.
+*
+* Return: The number of times within the samples in the store.
+*
+******************************************************************************/
+
+size_t cpl_nav_interp_attitude (
+    cpl_nav *n,
+    const int64_t *time,
+    const size_t num_times,
+    double *roll,
+    double *pitch,
+    double *heave) {
+
+    static const double period[3] = { 0.0, 0.0, 0.0 };
+    static const double lower[3] = { 0.0, 0.0, 0.0 };
+    double *out[3];
+
+
+    assert (n);
+    assert (time);
+
+    out[CPL_NAV_ROLL] = roll;
+    out[CPL_NAV_PITCH] = pitch;
+    out[CPL_NAV_HEAVE] = heave;
+
+    return cpl_nav_interp (&(n->attitude), time, num_times, out, period, lower);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_interp_heading - Interpolate the heading of the navigation store N at
+*   the NUM_TIMES times TIME in nanoseconds since 1970-01-01, and store it in
+*   the array HEADING in the range [0,360).  The heading is interpolated the
+*   short way around the circle.  Times outside of the samples in the store are
+*   set to NaN.
+*
+* Return: The number of times within the samples in the store.
+*
+******************************************************************************/
+
+size_t cpl_nav_interp_heading (
+    cpl_nav *n,
+    const int64_t *time,
+    const size_t num_times,
+    double *heading) {
+
+    static const double period[1] = { 360.0 };
+    static const double lower[1] = { 0.0 };
+    double *out[1];
+
+
+    assert (n);
+    assert (time);
+    assert (heading);
+
+    out[CPL_NAV_HEADING] = heading;
+
+    return cpl_nav_interp (&(n->heading), time, num_times, out, period, lower);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_interp_position - Linearly interpolate the latitude and longitude of
+*   the navigation store N at the NUM_TIMES times TIME in nanoseconds since
+*   1970-01-01, and store them in the arrays LATITUDE and LONGITUDE.  Either of
+*   the output arrays may be NULL if not needed.  The longitude is interpolated
+*   across the antimeridian and is stored in the range [-180,180).  Times
+*   outside of the samples in the store are set to NaN.
+*
+* Return: The number of times within the samples in the store.
+*
+******************************************************************************/
+
+size_t cpl_nav_interp_position (
+    cpl_nav *n,
+    const int64_t *time,
+    const size_t num_times,
+    double *latitude,
+    double *longitude) {
+
+    static const double period[2] = { 0.0, 360.0 };
+    static const double lower[2] = { 0.0, -180.0 };
+    double *out[2];
+
+
+    assert (n);
+    assert (time);
+
+    out[CPL_NAV_LATITUDE] = latitude;
+    out[CPL_NAV_LONGITUDE] = longitude;
+
+    return cpl_nav_interp (&(n->position), time, num_times, out, period, lower);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_write_attitude - Add the attitude samples of the navigation store N
+*   as rows of the table T.  If T has no columns, then the columns "time" in
+*   nanoseconds since 1970-01-01 (int64), and "roll", "pitch", and "heave"
+*   (double) are added first.  Columns of the table with other names are left
+*   as zero.
+*
+* Return: 0 if the samples were added, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+int cpl_nav_write_attitude (
+    const cpl_nav *n,
+    cpl_table *t) {
+
+    static const char *name[3] = { "roll", "pitch", "heave" };
+
+
+    assert (n);
+    assert (t);
+
+    return cpl_nav_write (&(n->attitude), t, name);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_write_heading - Add the heading samples of the navigation store N as
+*   rows of the table T.  If T has no columns, then the columns "time" in
+*   nanoseconds since 1970-01-01 (int64) and "heading" (double) are added
+*   first.  Columns of the table with other names are left as zero.
+*
+* Return: 0 if the samples were added, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+int cpl_nav_write_heading (
+    const cpl_nav *n,
+    cpl_table *t) {
+
+    static const char *name[1] = { "heading" };
+
+
+    assert (n);
+    assert (t);
+
+    return cpl_nav_write (&(n->heading), t, name);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_write_position - Add the position samples of the navigation store N
+*   as rows of the table T.  If T has no columns, then the columns "time" in
+*   nanoseconds since 1970-01-01 (int64), and "latitude" and "longitude"
+*   (double) are added first.  Columns of the table with other names are left
+*   as zero.
+*
+* Return: 0 if the samples were added, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+int cpl_nav_write_position (
+    const cpl_nav *n,
+    cpl_table *t) {
+
+    static const char *name[2] = { "latitude", "longitude" };
+
+
+    assert (n);
+    assert (t);
+
+    return cpl_nav_write (&(n->position), t, name);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_init_series - Initialize the time series S with NUM_VALUES values per
+*   sample.
+*
+******************************************************************************/
+
+static void cpl_nav_init_series (
+    cpl_nav_series *s,
+    const size_t num_values) {
+
+    size_t i;
+
+
+    assert (s);
+    assert (num_values <= CPL_NAV_MAX_VALUES);
+
+    s->time = NULL;
+    for (i=0; i<CPL_NAV_MAX_VALUES; i++) {
+        s->value[i] = NULL;
+    }
+    s->num_values = num_values;
+    s->num = 0;
+    s->alloc = 0;
+    s->cursor = 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_free_series - Free the memory used by the time series S.
+*
+******************************************************************************/
+
+static void cpl_nav_free_series (
+    cpl_nav_series *s) {
+
+    size_t i;
+
+
+    assert (s);
+
+    if (s->time) cpl_free (s->time);
+    for (i=0; i<s->num_values; i++) {
+        if (s->value[i]) cpl_free (s->value[i]);
+    }
+
+    cpl_nav_init_series (s, s->num_values);
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_add - Add the sample V at TIME to the time series S.  The samples are
+*   kept in time order, and since samples are normally added in time order, a
+*   sample is only moved into place if it is earlier than the last sample.
+*   Samples with the same time are kept in the order added.
+*
+* Return: 0 if the sample was added, or
+*         CS_ENOMEM if memory could not be allocated.
+*
+******************************************************************************/
+
+static int cpl_nav_add (
+    cpl_nav_series *s,
+    const int64_t time,
+    const double *v) {
+
+    size_t lo, hi, mid;
+    size_t alloc;
+    size_t i;
+    void *p;
+
+
+    assert (s);
+    assert (v);
+
+    if (s->num >= s->alloc) {
+        alloc = s->alloc;
+        p = cpl_realloc2 (s->time, s->num, sizeof (int64_t), &alloc);
+        if (!p) return CS_ENOMEM;
+        s->time = (int64_t *) p;
+
+        for (i=0; i<s->num_values; i++) {
+            p = cpl_realloc (s->value[i], alloc * sizeof (double));
+            if (!p) return CS_ENOMEM;
+            s->value[i] = (double *) p;
+        }
+
+        s->alloc = alloc;
+    }
+
+    /* Find the first sample later than TIME. */
+    lo = s->num;
+    if ((s->num > 0) && (time < s->time[s->num-1])) {
+        lo = 0;
+        hi = s->num - 1;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (s->time[mid] <= time) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        memmove (s->time + lo + 1, s->time + lo, (s->num - lo) * sizeof (int64_t));
+        for (i=0; i<s->num_values; i++) {
+            memmove (s->value[i] + lo + 1, s->value[i] + lo, (s->num - lo) * sizeof (double));
+        }
+    }
+
+    s->time[lo] = time;
+    for (i=0; i<s->num_values; i++) {
+        s->value[i][lo] = v[i];
+    }
+    s->num++;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_find - Return the start of the interval of the time series S that
+*   contains TIME, which must be within the samples of S, and save it as the
+*   cursor of S.  The search starts from the cursor so that increasing times
+*   are found by stepping forward a few intervals, and a binary search is only
+*   needed for larger jumps or times that go backward.
+*
+******************************************************************************/
+
+static size_t cpl_nav_find (
+    cpl_nav_series *s,
+    const int64_t time) {
+
+    size_t lo, hi, mid;
+    size_t i;
+
+
+    assert (s);
+    assert (s->num >= 2);
+
+    lo = 0;
+    hi = s->num - 1;
+    i = s->cursor;
+
+    if ((i < s->num - 1) && (s->time[i] <= time)) {
+        for (mid=0; mid<CPL_NAV_MAX_STEPS; mid++) {
+            if ((i + 1 == s->num - 1) || (time < s->time[i+1])) {
+                s->cursor = i;
+                return i;
+            }
+            i++;
+        }
+        lo = i;
+    } else if (i < s->num - 1) {
+        hi = i;
+    }
+
+    /* Find the last sample at or before TIME in [lo,hi], leaving an interval to interpolate. */
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (s->time[mid] <= time) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    s->cursor = lo;
+
+    return lo;
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_interp - Interpolate the values of the time series S at the NUM_TIMES
+*   times TIME and store them in the arrays OUT, which may be NULL if a value
+*   is not needed.  Values with a non-zero PERIOD are angles that are
+*   interpolated the short way around the circle and wrapped into the range
+*   [LOWER,LOWER+PERIOD).
+*
+* Return: The number of times within the samples of S.
+*
+******************************************************************************/
+
+static size_t cpl_nav_interp (
+    cpl_nav_series *s,
+    const int64_t *time,
+    const size_t num_times,
+    double **out,
+    const double *period,
+    const double *lower) {
+
+    size_t count = 0;
+    size_t i, j, k;
+    double f, d, v;
+
+
+    assert (s);
+    assert (time);
+    assert (out);
+    assert (period);
+    assert (lower);
+
+    for (i=0; i<num_times; i++) {
+
+        if ((s->num == 0) || (time[i] < s->time[0]) || (time[i] > s->time[s->num-1])) {
+            for (j=0; j<s->num_values; j++) {
+                if (out[j]) out[j][i] = NAN;
+            }
+            continue;
+        }
+
+        count++;
+
+        if (s->num == 1) {
+            for (j=0; j<s->num_values; j++) {
+                if (out[j]) out[j][i] = s->value[j][0];
+            }
+            continue;
+        }
+
+        k = cpl_nav_find (s, time[i]);
+
+        if (s->time[k+1] > s->time[k]) {
+            f = (double) (time[i] - s->time[k]) / (double) (s->time[k+1] - s->time[k]);
+        } else {
+            f = 0.0;
+        }
+
+        for (j=0; j<s->num_values; j++) {
+            if (!out[j]) continue;
+
+            d = s->value[j][k+1] - s->value[j][k];
+
+            if (period[j] > 0.0) {
+                if (d > 0.5 * period[j]) {
+                    d -= period[j];
+                } else if (d < -0.5 * period[j]) {
+                    d += period[j];
+                }
+
+                v = fmod (s->value[j][k] + f * d - lower[j], period[j]);
+                if (v < 0.0) v += period[j];
+
+                out[j][i] = v + lower[j];
+            } else {
+                out[j][i] = s->value[j][k] + f * d;
+            }
+        }
+    }
+
+    return count;
+}
+
+
+/******************************************************************************
+*
+* cpl_nav_write - Add the samples of the time series S as rows of the table T,
+*   where NAME is the array of the column names of the values of S.  If T has
+*   no columns, then the columns are added first.  The samples are copied in
+*   blocks of CPL_NAV_TABLE_ROWS rows directly into the column arrays.
+*
+* Return: 0 if the samples were added, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+static int cpl_nav_write (
+    const cpl_nav_series *s,
+    cpl_table *t,
+    const char **name) {
+
+    int column[CPL_NAV_MAX_VALUES];
+    int time_column;
+    size_t i, j;
+    size_t rows;
+    int status;
+
+
+    assert (s);
+    assert (t);
+    assert (name);
+
+    if (cpl_table_get_num_columns (t) == 0) {
+        if ((status = cpl_table_add_column (t, "time", CPL_TABLE_INT64)) < 0) return status;
+        for (j=0; j<s->num_values; j++) {
+            if ((status = cpl_table_add_column (t, name[j], CPL_TABLE_FLOAT64)) < 0) return status;
+        }
+    }
+
+    time_column = cpl_table_find_column (t, "time");
+    for (j=0; j<s->num_values; j++) {
+        column[j] = cpl_table_find_column (t, name[j]);
+    }
+
+    for (i=0; i<s->num; i+=rows) {
+        rows = s->num - i;
+        if (rows > CPL_NAV_TABLE_ROWS) rows = CPL_NAV_TABLE_ROWS;
+
+        status = cpl_table_reserve (t, rows);
+        if (status != CS_ENONE) return status;
+
+        if (time_column >= 0) {
+            memcpy (cpl_table_get_column (t, time_column), s->time + i, rows * sizeof (int64_t));
+        }
+
+        for (j=0; j<s->num_values; j++) {
+            if (column[j] >= 0) {
+                memcpy (cpl_table_get_column (t, column[j]), s->value[j] + i, rows * sizeof (double));
+            }
+        }
+
+        cpl_table_commit (t, rows);
+    }
+
+    return CS_ENONE;
+}
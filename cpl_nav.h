@@ -0,0 +1,86 @@
+/* cpl_nav.h -- Header file for cpl_nav.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#ifndef CPL_NAV_H
+#define CPL_NAV_H
+
+#if defined (__cplusplus)
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#define CPL_NEED_FIXED_WIDTH_T  /* Tell cpl_spec.h we need fixed-width types. */
+#include "cpl_spec.h"
+#include "cpl_table.h"
+
+
+/* Maximum Number of Values per Navigation Sample */
+#define CPL_NAV_MAX_VALUES  3
+
+
+/* Navigation Attitude Values */
+#define CPL_NAV_ROLL        0  /* Roll in degrees.                 */
+#define CPL_NAV_PITCH       1  /* Pitch in degrees.                */
+#define CPL_NAV_HEAVE       2  /* Heave in meters.                 */
+
+/* Navigation Heading Values */
+#define CPL_NAV_HEADING     0  /* Heading in degrees (0-360).      */
+
+/* Navigation Position Values */
+#define CPL_NAV_LATITUDE    0  /* Latitude in degrees.             */
+#define CPL_NAV_LONGITUDE   1  /* Longitude in degrees (-180-180). */
+
+
+/* Navigation Time Series */
+typedef struct {
+    int64_t *time;                        /* Array of num times in ns since 1970-01-01.  */
+    double *value[CPL_NAV_MAX_VALUES];    /* Array of num samples for each value.        */
+    size_t num_values;                    /* Number of values per sample.                */
+    size_t num;                           /* Number of samples in time order.            */
+    size_t alloc;                         /* Number of samples allocated.                */
+    size_t cursor;                        /* Start of the last interval interpolated.    */
+} cpl_nav_series;
+
+
+/* Navigation and Motion Store */
+typedef struct {
+    cpl_nav_series attitude;              /* Roll, pitch, and heave samples.             */
+    cpl_nav_series heading;               /* Heading samples.                            */
+    cpl_nav_series position;              /* Latitude and longitude samples.             */
+} cpl_nav;
+
+
+/******************************* API Functions *******************************/
+
+CPL_CLINKAGE_START
+
+void cpl_nav_init (cpl_nav *) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_nav_free (cpl_nav *) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_nav_clear (cpl_nav *) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_nav_add_attitude (cpl_nav *, const int64_t, const double, const double, const double) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_nav_add_heading (cpl_nav *, const int64_t, const double) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_nav_add_position (cpl_nav *, const int64_t, const double, const double) CPL_ATTRIBUTE_NONNULL_ALL;
+size_t cpl_nav_interp_attitude (cpl_nav *, const int64_t *, const size_t, double *, double *, double *) CPL_ATTRIBUTE_NONNULL (1) CPL_ATTRIBUTE_NONNULL (2);
+size_t cpl_nav_interp_heading (cpl_nav *, const int64_t *, const size_t, double *) CPL_ATTRIBUTE_NONNULL_ALL;
+size_t cpl_nav_interp_position (cpl_nav *, const int64_t *, const size_t, double *, double *) CPL_ATTRIBUTE_NONNULL (1) CPL_ATTRIBUTE_NONNULL (2);
+int cpl_nav_write_attitude (const cpl_nav *, cpl_table *) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_nav_write_heading (const cpl_nav *, cpl_table *) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_nav_write_position (const cpl_nav *, cpl_table *) CPL_ATTRIBUTE_NONNULL_ALL;
+
+CPL_CLINKAGE_END
+
+#endif /* CPL_NAV_H */
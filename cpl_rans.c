@@ -0,0 +1,290 @@
+/* cpl_rans.c -- Order-0 rANS entropy coder.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   Encoded Format:
+   The byte frequencies are scaled to a total of CPL_RANS_TOTAL and stored
+   first.  A frequency below 128 is one byte, a larger frequency is two bytes
+   with the high bit of the first byte set, and a run of zero frequencies is
+   a zero byte followed by the run length minus one.  The 32-bit coder state
+   follows in little-endian order, and then the bytes emitted by the coder in
+   the order they are read by the decoder.  The number of decoded bytes is not
+   stored, so it must be known by the caller. */
+
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include "cpl_rans.h"
+#include "cpl_error.h"
+#include "cpl_debug.h"
+
+
+/* Number of Bits of the Scaled Frequencies */
+#define CPL_RANS_SCALE_BITS  12
+
+
+/* Total of the Scaled Frequencies */
+#define CPL_RANS_TOTAL       (1 << CPL_RANS_SCALE_BITS)
+
+
+/* Lower Bound of the Coder State */
+#define CPL_RANS_LOWER       (1UL << 23)
+
+
+/* External Variable */
+extern int cpl_lib_debug;
+
+
+/* Private Function Prototypes */
+static void cpl_rans_scale (const size_t *, const size_t, uint32_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+
+
+/******************************************************************************
+*
+* cpl_rans_encode - Encode the N bytes IN to the buffer OUT of OUT_SIZE bytes,
+*   and return the encoded size in SIZE.  The caller should store the data
+*   unencoded if the buffer is too small, since the data then does not
+*   compress.
+*
+* Return: 0 if the data was encoded, or
+*         CS_EOVERFLOW if the encoded data does not fit in OUT_SIZE bytes.
+*
+******************************************************************************/
+
+int cpl_rans_encode (
+    const uint8_t *in,
+    const size_t n,
+    uint8_t *out,
+    const size_t out_size,
+    size_t *size) {
+
+    size_t count[256];
+    uint32_t freq[256];
+    uint32_t cum[256];
+    uint32_t x, x_max;
+    uint8_t *start;
+    uint8_t *q;
+    size_t table_size = 0;
+    size_t i, j;
+
+
+    assert (in || (n == 0));
+    assert (out);
+    assert (size);
+
+    memset (count, 0, sizeof (count));
+    for (i=0; i<n; i++) {
+        count[in[i]]++;
+    }
+
+    cpl_rans_scale (count, n, freq);
+
+    /* Store the frequency table. */
+    for (i=0; i<256; ) {
+        if (table_size + 2 > out_size) return CS_EOVERFLOW;
+
+        if (freq[i] == 0) {
+            for (j=i+1; (j<256) && (freq[j] == 0); j++);
+            out[table_size++] = 0;
+            out[table_size++] = (uint8_t) (j - i - 1);
+            i = j;
+        } else {
+            if (freq[i] < 128) {
+                out[table_size++] = (uint8_t) freq[i];
+            } else {
+                out[table_size++] = (uint8_t) (0x80 | (freq[i] >> 8));
+                out[table_size++] = (uint8_t) (freq[i] & 0xFF);
+            }
+            i++;
+        }
+    }
+
+    cum[0] = 0;
+    for (i=1; i<256; i++) {
+        cum[i] = cum[i-1] + freq[i-1];
+    }
+
+    /* The coder runs from the last byte to the first, so the bytes are emitted
+       backwards from the end of the buffer and moved after the table. */
+    start = out + table_size + sizeof (uint32_t);
+    if (start > out + out_size) return CS_EOVERFLOW;
+
+    q = out + out_size;
+    x = CPL_RANS_LOWER;
+
+    for (i=n; i>0; i--) {
+        j = in[i-1];
+        x_max = ((CPL_RANS_LOWER >> CPL_RANS_SCALE_BITS) << 8) * freq[j];
+        while (x >= x_max) {
+            if (q == start) return CS_EOVERFLOW;
+            *--q = (uint8_t) x;
+            x >>= 8;
+        }
+        x = ((x / freq[j]) << CPL_RANS_SCALE_BITS) + (x % freq[j]) + cum[j];
+    }
+
+    for (i=0; i<sizeof (uint32_t); i++) {
+        out[table_size + i] = (uint8_t) (x >> (8 * i));
+    }
+
+    j = (size_t) (out + out_size - q);
+    memmove (start, q, j);
+
+    *size = table_size + sizeof (uint32_t) + j;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_rans_decode - Decode the SIZE bytes IN encoded by cpl_rans_encode() to
+*   the N bytes OUT.
+*
+* Return: 0 if the data was decoded, or
+*         CS_EBADDATA if the encoded data is corrupt.
+*
+******************************************************************************/
+
+int cpl_rans_decode (
+    const uint8_t *in,
+    const size_t size,
+    uint8_t *out,
+    const size_t n) {
+
+    uint8_t symbol[CPL_RANS_TOTAL];
+    uint32_t freq[256];
+    uint32_t cum[256];
+    uint32_t total = 0;
+    uint32_t x, slot;
+    const uint8_t *p = in;
+    const uint8_t *end = in + size;
+    size_t i, j;
+    uint8_t s;
+
+
+    assert (in);
+    assert (out || (n == 0));
+
+    /* Read the frequency table. */
+    for (i=0; i<256; ) {
+        if (p == end) goto L1;
+
+        if (*p == 0) {
+            if (end - p < 2) goto L1;
+            j = i + (size_t) p[1] + 1;
+            if (j > 256) goto L1;
+            for (; i<j; i++) freq[i] = 0;
+            p += 2;
+        } else if (*p & 0x80) {
+            if (end - p < 2) goto L1;
+            freq[i++] = ((uint32_t) (*p & 0x7F) << 8) | p[1];
+            p += 2;
+        } else {
+            freq[i++] = *p++;
+        }
+    }
+
+    for (i=0; i<256; i++) {
+        cum[i] = total;
+        total += freq[i];
+        if (total > CPL_RANS_TOTAL) goto L1;
+        memset (symbol + cum[i], (int) i, freq[i]);
+    }
+
+    if ((total != CPL_RANS_TOTAL) || ((size_t) (end - p) < sizeof (uint32_t))) goto L1;
+
+    x = (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+    p += sizeof (uint32_t);
+
+    if ((x < CPL_RANS_LOWER) || (x >= (CPL_RANS_LOWER << 8))) goto L1;
+
+    for (i=0; i<n; i++) {
+        slot = x & (CPL_RANS_TOTAL - 1);
+        s = symbol[slot];
+        out[i] = s;
+        x = freq[s] * (x >> CPL_RANS_SCALE_BITS) + slot - cum[s];
+        while (x < CPL_RANS_LOWER) {
+            if (p == end) goto L1;
+            x = (x << 8) | *p++;
+        }
+    }
+
+    /* The coder returns to its initial state after all bytes are decoded. */
+    if ((x != CPL_RANS_LOWER) || (p != end)) goto L1;
+
+    return CS_ENONE;
+
+L1: cpl_debug (cpl_lib_debug, "Corrupt rANS encoded data (%lu bytes)\n", (unsigned long) size);
+    return CS_EBADDATA;
+}
+
+
+/******************************************************************************
+*
+* cpl_rans_scale - Scale the COUNT of each byte value of N bytes to the FREQ
+*   that total CPL_RANS_TOTAL, keeping a frequency of at least one for every
+*   byte value that occurs.  If N is zero, then all frequencies are given to
+*   the zero byte so the table is still valid.
+*
+******************************************************************************/
+
+static void cpl_rans_scale (
+    const size_t *count,
+    const size_t n,
+    uint32_t *freq) {
+
+    uint32_t total = 0;
+    size_t i, max_i = 0;
+
+
+    assert (count);
+    assert (freq);
+
+    if (n == 0) {
+        memset (freq, 0, 256 * sizeof (uint32_t));
+        freq[0] = CPL_RANS_TOTAL;
+        return;
+    }
+
+    for (i=0; i<256; i++) {
+        if (count[i] == 0) {
+            freq[i] = 0;
+        } else {
+            freq[i] = (uint32_t) (((uint64_t) count[i] * CPL_RANS_TOTAL) / n);
+            if (freq[i] == 0) freq[i] = 1;
+        }
+
+        total += freq[i];
+        if (count[i] > count[max_i]) max_i = i;
+    }
+
+    /* Rounding down leaves a shortfall, which goes to the most frequent byte. */
+    if (total <= CPL_RANS_TOTAL) {
+        freq[max_i] += CPL_RANS_TOTAL - total;
+        return;
+    }
+
+    /* Rare bytes raised to one can exceed the total, so take the excess from
+       the largest frequencies. */
+    while (total > CPL_RANS_TOTAL) {
+        max_i = 0;
+        for (i=1; i<256; i++) {
+            if (freq[i] > freq[max_i]) max_i = i;
+        }
+        freq[max_i]--;
+        total--;
+    }
+}
@@ -0,0 +1,39 @@
+/* cpl_rans.h -- Header file for cpl_rans.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#ifndef CPL_RANS_H
+#define CPL_RANS_H
+
+#if defined (__cplusplus)
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#define CPL_NEED_FIXED_WIDTH_T  /* Tell cpl_spec.h we need fixed-width types. */
+#include "cpl_spec.h"
+
+
+/******************************* API Functions *******************************/
+
+CPL_CLINKAGE_START
+
+int cpl_rans_encode (const uint8_t *, const size_t, uint8_t *, const size_t, size_t *) CPL_ATTRIBUTE_NONNULL (3) CPL_ATTRIBUTE_NONNULL (5);
+int cpl_rans_decode (const uint8_t *, const size_t, uint8_t *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
+
+CPL_CLINKAGE_END
+
+#endif /* CPL_RANS_H */
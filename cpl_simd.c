@@ -0,0 +1,152 @@
+/* cpl_simd.c -- Vectorized sample conversion routines.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#include "config.h"
+#include <assert.h>
+#include "cpl_simd.h"
+
+
+/******************************************************************************
+*
+* cpl_convert_samples8 - Convert the N 8-bit samples IN to floats multiplied by
+*   SCALE and store them in OUT.  The samples are converted 8 or 16 at a time
+*   using AVX2, SSE2, or NEON instructions if available when compiled.
+*
+******************************************************************************/
+
+void cpl_convert_samples8 (
+    float *out,
+    const int8_t *in,
+    const size_t n,
+    const float scale) {
+
+#if defined (CPL_SIMD_AVX2)
+    __m256 s;
+    __m256i x;
+#elif defined (CPL_SIMD_SSE2)
+    __m128 s;
+    __m128i x, lo, hi;
+#elif defined (CPL_SIMD_NEON)
+    float32x4_t s;
+    int16x8_t lo, hi;
+    int8x16_t x;
+#endif
+    size_t i = 0;
+
+
+    assert (out);
+    assert (in);
+
+#if defined (CPL_SIMD_AVX2)
+    s = _mm256_set1_ps (scale);
+
+    for (; i+8<=n; i+=8) {
+        x = _mm256_cvtepi8_epi32 (_mm_loadl_epi64 ((const __m128i *) (in + i)));
+        _mm256_storeu_ps (out + i, _mm256_mul_ps (_mm256_cvtepi32_ps (x), s));
+    }
+#elif defined (CPL_SIMD_SSE2)
+    /* Each byte is sign extended by unpacking it into the high byte of a wider lane and then
+       shifting it back down arithmetically. */
+    s = _mm_set1_ps (scale);
+
+    for (; i+16<=n; i+=16) {
+        x = _mm_loadu_si128 ((const __m128i *) (in + i));
+        lo = _mm_srai_epi16 (_mm_unpacklo_epi8 (x, x), 8);
+        hi = _mm_srai_epi16 (_mm_unpackhi_epi8 (x, x), 8);
+        _mm_storeu_ps (out + i, _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (lo, lo), 16)), s));
+        _mm_storeu_ps (out + i + 4, _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (lo, lo), 16)), s));
+        _mm_storeu_ps (out + i + 8, _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (hi, hi), 16)), s));
+        _mm_storeu_ps (out + i + 12, _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (hi, hi), 16)), s));
+    }
+#elif defined (CPL_SIMD_NEON)
+    s = vdupq_n_f32 (scale);
+
+    for (; i+16<=n; i+=16) {
+        x = vld1q_s8 (in + i);
+        lo = vmovl_s8 (vget_low_s8 (x));
+        hi = vmovl_s8 (vget_high_s8 (x));
+        vst1q_f32 (out + i, vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (lo))), s));
+        vst1q_f32 (out + i + 4, vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (lo))), s));
+        vst1q_f32 (out + i + 8, vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (hi))), s));
+        vst1q_f32 (out + i + 12, vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (hi))), s));
+    }
+#endif
+
+    for (; i<n; i++) {
+        out[i] = in[i] * scale;
+    }
+}
+
+
+/******************************************************************************
+*
+* cpl_convert_samples16 - Convert the N 16-bit samples IN to floats multiplied
+*   by SCALE and store them in OUT.  The samples are converted 8 at a time using
+*   AVX2, SSE2, or NEON instructions if available when compiled.
+*
+******************************************************************************/
+
+void cpl_convert_samples16 (
+    float *out,
+    const int16_t *in,
+    const size_t n,
+    const float scale) {
+
+#if defined (CPL_SIMD_AVX2)
+    __m256 s;
+    __m256i x;
+#elif defined (CPL_SIMD_SSE2)
+    __m128 s;
+    __m128i x;
+#elif defined (CPL_SIMD_NEON)
+    float32x4_t s;
+    int16x8_t x;
+#endif
+    size_t i = 0;
+
+
+    assert (out);
+    assert (in);
+
+#if defined (CPL_SIMD_AVX2)
+    s = _mm256_set1_ps (scale);
+
+    for (; i+8<=n; i+=8) {
+        x = _mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i *) (in + i)));
+        _mm256_storeu_ps (out + i, _mm256_mul_ps (_mm256_cvtepi32_ps (x), s));
+    }
+#elif defined (CPL_SIMD_SSE2)
+    s = _mm_set1_ps (scale);
+
+    for (; i+8<=n; i+=8) {
+        x = _mm_loadu_si128 ((const __m128i *) (in + i));
+        _mm_storeu_ps (out + i, _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (x, x), 16)), s));
+        _mm_storeu_ps (out + i + 4, _mm_mul_ps (_mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (x, x), 16)), s));
+    }
+#elif defined (CPL_SIMD_NEON)
+    s = vdupq_n_f32 (scale);
+
+    for (; i+8<=n; i+=8) {
+        x = vld1q_s16 (in + i);
+        vst1q_f32 (out + i, vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (x))), s));
+        vst1q_f32 (out + i + 4, vmulq_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (x))), s));
+    }
+#endif
+
+    for (; i<n; i++) {
+        out[i] = in[i] * scale;
+    }
+}
@@ -0,0 +1,70 @@
+/* cpl_simd.h -- Header file for cpl_simd.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+
+   The instruction set available when compiled is given by the macros below,
+   which include the intrinsics header of the instruction set.  Each macro is
+   also defined for the newer instruction sets, so the code for the newest
+   instruction set is selected by testing the macros in the order listed.
+
+   CPL_SIMD_AVX2 - Defined if AVX2 instructions are available
+   CPL_SIMD_SSSE3 - Defined if SSSE3 instructions are available
+   CPL_SIMD_SSE2 - Defined if SSE2 instructions are available
+   CPL_SIMD_NEON - Defined if NEON instructions are available
+
+   cpl_convert_samples8 (out, in, n, scale) - Convert n 8-bit samples to scaled floats
+   cpl_convert_samples16 (out, in, n, scale) - Convert n 16-bit samples to scaled floats */
+
+#ifndef CPL_SIMD_H
+#define CPL_SIMD_H
+
+#if defined (__cplusplus)
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#define CPL_NEED_FIXED_WIDTH_T /* Tell cpl_spec.h we need fixed-width types. */
+#include "cpl_spec.h"
+
+#if defined (__AVX2__)
+# include <immintrin.h>
+# define CPL_SIMD_AVX2   1
+# define CPL_SIMD_SSSE3  1
+# define CPL_SIMD_SSE2   1
+#elif defined (__SSSE3__)
+# include <tmmintrin.h>
+# define CPL_SIMD_SSSE3  1
+# define CPL_SIMD_SSE2   1
+#elif defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && (_M_IX86_FP >= 2))
+# include <emmintrin.h>
+# define CPL_SIMD_SSE2   1
+#elif defined (__ARM_NEON)
+# include <arm_neon.h>
+# define CPL_SIMD_NEON   1
+#endif
+
+
+/******************************* API Functions *******************************/
+
+CPL_CLINKAGE_START
+
+void cpl_convert_samples8 (float *, const int8_t *, const size_t, const float) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_convert_samples16 (float *, const int16_t *, const size_t, const float) CPL_ATTRIBUTE_NONNULL_ALL;
+
+CPL_CLINKAGE_END
+
+#endif /* CPL_SIMD_H */
@@ -0,0 +1,60 @@
+/* cpl_snippets.c -- Seabed image snippet buffer shared by the readers.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#include <stddef.h>
+#include <assert.h>
+#include "cpl_snippets.h"
+#include "cpl_alloc.h"
+#include "cpl_error.h"
+
+
+/******************************************************************************
+*
+* cpl_snippets_alloc - Allocate the arrays of the snippet buffer S from the
+*   memory arena A, with room for MAX_SAMPLES samples and MAX_BEAMS beams, and
+*   set S to store a new batch.  The arrays are released with the arena and
+*   must not be freed otherwise.
+*
+* Return: 0 if the arrays were allocated, or
+*         CS_ENOMEM if memory allocation failed.
+*
+******************************************************************************/
+
+int cpl_snippets_alloc (
+    cpl_snippets *s,
+    const size_t max_samples,
+    const size_t max_beams,
+    cpl_arena *a) {
+
+    assert (s);
+    assert (a);
+
+    s->sample = (float *) cpl_arena_calloc (a, max_samples, sizeof (float));
+    s->offset = (size_t *) cpl_arena_calloc (a, max_beams, sizeof (size_t));
+    s->length = (uint16_t *) cpl_arena_calloc (a, max_beams, sizeof (uint16_t));
+    s->max_samples = max_samples;
+    s->max_beams = max_beams;
+    s->num_samples = 0;
+    s->num_beams = 0;
+
+    if (!s->sample || !s->offset || !s->length) {
+        s->max_samples = 0;
+        s->max_beams = 0;
+        return CS_ENOMEM;
+    }
+
+    return CS_ENONE;
+}
@@ -0,0 +1,51 @@
+/* cpl_snippets.h -- Header file for cpl_snippets.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#ifndef CPL_SNIPPETS_H
+#define CPL_SNIPPETS_H
+
+#if defined (__cplusplus)
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#define CPL_NEED_FIXED_WIDTH_T  /* Tell cpl_spec.h we need fixed-width types. */
+#include "cpl_spec.h"
+#include "cpl_alloc.h"
+
+
+/* Seabed Image Snippets */
+typedef struct {
+    float *sample;                        /* Array of max_samples seabed image samples in dB.           */
+    size_t *offset;                       /* Array of max_beams offsets of the first sample of beams.   */
+    uint16_t *length;                     /* Array of max_beams numbers of samples of each beam.        */
+    size_t max_samples;                   /* Number of elements of the sample array.                    */
+    size_t max_beams;                     /* Number of elements of the offset and length arrays.        */
+    size_t num_samples;                   /* Number of samples stored.  Set to zero for a new batch.    */
+    size_t num_beams;                     /* Number of beams stored.  Set to zero for a new batch.      */
+} cpl_snippets;
+
+
+/******************************* API Functions *******************************/
+
+CPL_CLINKAGE_START
+
+int cpl_snippets_alloc (cpl_snippets *, const size_t, const size_t, cpl_arena *) CPL_ATTRIBUTE_NONNULL_ALL;
+
+CPL_CLINKAGE_END
+
+#endif /* CPL_SNIPPETS_H */
@@ -0,0 +1,605 @@
+/* cpl_table.c -- Columnar table file writer.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   File Format:
+   The file is written in the byte order of the host, which is given in the
+   file header, and every block starts at a multiple of 8 bytes, so the file
+   can be memory-mapped and each column used as an array.
+
+     File header (32 bytes)
+     Column descriptors (40 bytes each)
+     Row groups, each with:
+       Row group header (16 bytes)
+       Column data, num_rows elements of each column in the order of the
+         column descriptors, each padded with zeros to a multiple of 8 bytes
+     Row group offsets (8 bytes each)
+     File trailer (24 bytes)
+
+   A reader finds the row groups from the trailer at the end of the file. */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "cpl_table.h"
+#include "cpl_alloc.h"
+#include "cpl_error.h"
+#include "cpl_debug.h"
+#include "cpl_file.h"
+
+
+/* Table File Magic Strings and Version */
+#define CPL_TABLE_MAGIC          "CPLTABLE"
+#define CPL_TABLE_TRAILER_MAGIC  "CPLTABND"
+#define CPL_TABLE_VERSION        1
+#define CPL_TABLE_BYTE_ORDER     0x01020304
+
+
+/* Table File Header (32 Bytes) */
+typedef struct {
+    char magic[8];                    /* Magic string "CPLTABLE".           */
+    uint32_t version;                 /* Table file version.                */
+    uint32_t byte_order;              /* 0x01020304 in the file byte order. */
+    uint32_t num_columns;             /* Number of column descriptors.      */
+    uint32_t descriptor_size;         /* Size of each descriptor in bytes.  */
+    uint64_t reserved;                /* Reserved for future use.           */
+} cpl_table_file_header;
+
+
+/* Table Column Descriptor (40 Bytes) */
+typedef struct {
+    char name[CPL_TABLE_NAME_SIZE];   /* Null-terminated column name.       */
+    uint32_t type;                    /* Column type CPL_TABLE_*.           */
+    uint32_t element_size;            /* Size of each element in bytes.     */
+} cpl_table_descriptor;
+
+
+/* Table Row Group Header (16 Bytes) */
+typedef struct {
+    uint64_t num_rows;                /* Number of rows in the group.       */
+    uint64_t data_size;               /* Size of the column data in bytes.  */
+} cpl_table_group_header;
+
+
+/* Table File Trailer (24 Bytes) */
+typedef struct {
+    uint64_t num_groups;              /* Number of row groups.              */
+    uint64_t num_rows;                /* Total number of rows.              */
+    char magic[8];                    /* Magic string "CPLTABND".           */
+} cpl_table_file_trailer;
+
+
+/* Table Column */
+typedef struct {
+    cpl_table_descriptor d;           /* Column descriptor.                 */
+    char *data;                       /* Rows of the current row group.     */
+} cpl_table_column;
+
+
+/* Table File */
+struct cpl_table_struct {
+    FILE *fp;                         /* File stream.                       */
+    cpl_table_column *column;         /* Array of num_columns columns.      */
+    size_t num_columns;               /* Number of columns.                 */
+    size_t column_alloc;              /* Allocated number of columns.       */
+    size_t group_size;                /* Rows allocated for each column.    */
+    size_t num_rows;                  /* Rows in the current row group.     */
+    uint64_t total_rows;              /* Rows in all row groups.            */
+    uint64_t *group_offset;           /* File offset of each row group.     */
+    size_t num_groups;                /* Number of row groups written.      */
+    size_t group_alloc;               /* Allocated number of offsets.       */
+    uint64_t offset;                  /* File offset of the next write.     */
+    int started;                      /* Boolean if the header is written.  */
+    int table_errno;                  /* Error condition of the last write. */
+};
+
+
+/* External Variable */
+extern int cpl_lib_debug;
+
+
+/* Private Function Prototypes */
+static size_t cpl_table_element_size (const int) CPL_ATTRIBUTE_CONST;
+static int cpl_table_write (cpl_table *, const void *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_table_start (cpl_table *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_table_flush (cpl_table *) CPL_ATTRIBUTE_NONNULL_ALL;
+
+
+/******************************************************************************
+*
+* cpl_table_create - Create the table file given by FILE_NAME, which is written
+*   in row groups of GROUP_SIZE rows.  If GROUP_SIZE is zero, then
+*   CPL_TABLE_GROUP_SIZE is used.  The columns are added with
+*   cpl_table_add_column() before the first row is reserved.  The caller must
+*   call cpl_table_close() to finish the file and free the table.
+*
+* Return: A pointer to the new table, or
+*         NULL if the file could not be created or memory allocation failed.
+*
+******************************************************************************/
+
+cpl_table * cpl_table_create (
+    const char *file_name,
+    const size_t group_size) {
+
+    cpl_table *t;
+
+
+    assert (file_name);
+
+    t = (cpl_table *) cpl_malloc (sizeof (cpl_table));
+    if (!t) return NULL;
+
+    t->fp = cpl_fopen (file_name, CPL_FOPEN_WRITE | CPL_FOPEN_BINARY);
+    if (!t->fp) {
+        cpl_free (t);
+        return NULL;
+    }
+
+    t->column = NULL;
+    t->num_columns = 0;
+    t->column_alloc = 0;
+    t->group_size = group_size > 0 ? group_size : CPL_TABLE_GROUP_SIZE;
+    t->num_rows = 0;
+    t->total_rows = 0;
+    t->group_offset = NULL;
+    t->num_groups = 0;
+    t->group_alloc = 0;
+    t->offset = 0;
+    t->started = 0;
+    t->table_errno = CS_ENONE;
+
+    return t;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_close - Write the last row group and the row group offsets of the
+*   table T, close the file, and free the table.
+*
+* Return: 0 if the file was written successfully, or
+*         error condition if an error occurred, including any earlier write.
+*
+* Errors: CS_ENOMEM
+*         CS_EWRITE
+*         CS_ECLOSE
+*
+******************************************************************************/
+
+int cpl_table_close (
+    cpl_table *t) {
+
+    cpl_table_file_trailer trailer;
+    size_t i;
+    int status;
+
+
+    if (!t) return CS_ENONE;
+
+    /* An empty table still has a header, so it can be read. */
+    if (!t->started) cpl_table_start (t, t->group_size);
+
+    cpl_table_flush (t);
+
+    if (t->num_groups > 0) {
+        cpl_table_write (t, t->group_offset, t->num_groups * sizeof (uint64_t));
+    }
+
+    trailer.num_groups = t->num_groups;
+    trailer.num_rows = t->total_rows;
+    memcpy (trailer.magic, CPL_TABLE_TRAILER_MAGIC, sizeof (trailer.magic));
+    cpl_table_write (t, &trailer, sizeof (trailer));
+
+    status = t->table_errno;
+
+    if ((cpl_fclose (t->fp) != 0) && (status == CS_ENONE)) status = CS_ECLOSE;
+
+    for (i=0; i<t->num_columns; i++) {
+        if (t->column[i].data) cpl_free (t->column[i].data);
+    }
+
+    if (t->column) cpl_free (t->column);
+    if (t->group_offset) cpl_free (t->group_offset);
+    cpl_free (t);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_add_column - Add a column with the name NAME and one of the
+*   CPL_TABLE type definitions TYPE to the table T.  Columns can only be added
+*   before the first row is reserved.
+*
+* Return: The column number, which starts from zero, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*
+******************************************************************************/
+
+int cpl_table_add_column (
+    cpl_table *t,
+    const char *name,
+    const int type) {
+
+    cpl_table_column *column;
+    size_t column_alloc;
+    size_t element_size;
+
+
+    assert (t);
+    assert (name);
+
+    element_size = cpl_table_element_size (type);
+
+    if (t->started || (element_size == 0) || (strlen (name) >= CPL_TABLE_NAME_SIZE)) return CS_EINVAL;
+
+    if (t->num_columns == t->column_alloc) {
+        column_alloc = t->column_alloc;
+        column = (cpl_table_column *) cpl_realloc2 (t->column, t->num_columns + 1, sizeof (cpl_table_column), &column_alloc);
+        if (!column) return CS_ENOMEM;
+        t->column = column;
+        t->column_alloc = column_alloc;
+    }
+
+    column = &(t->column[t->num_columns]);
+
+    memset (&(column->d), 0, sizeof (cpl_table_descriptor));
+    strcpy (column->d.name, name);
+    column->d.type = (uint32_t) type;
+    column->d.element_size = (uint32_t) element_size;
+    column->data = NULL;
+
+    return (int) t->num_columns++;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_find_column - Return the number of the column with the name NAME
+*   of the table T, or -1 if there is no such column.
+*
+******************************************************************************/
+
+int cpl_table_find_column (
+    const cpl_table *t,
+    const char *name) {
+
+    size_t i;
+
+
+    assert (t);
+    assert (name);
+
+    for (i=0; i<t->num_columns; i++) {
+        if (strcmp (t->column[i].d.name, name) == 0) return (int) i;
+    }
+
+    return -1;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_get_num_columns - Return the number of columns of the table T.
+*
+******************************************************************************/
+
+size_t cpl_table_get_num_columns (
+    const cpl_table *t) {
+
+    assert (t);
+    return t->num_columns;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_reserve - Make room for N more rows in the current row group of the
+*   table T.  If the row group does not have room, then it is written to the
+*   file first, and the row group is enlarged if N is more than the group size.
+*   The rows are stored by the caller in the arrays given by
+*   cpl_table_get_column() and added to the table by cpl_table_commit().
+*
+* Return: 0 if the rows were reserved, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+int cpl_table_reserve (
+    cpl_table *t,
+    const size_t n) {
+
+    size_t group_size;
+    size_t i;
+    char *data;
+
+
+    assert (t);
+
+    if (!t->started) return cpl_table_start (t, n);
+
+    if (n <= t->group_size - t->num_rows) return CS_ENONE;
+
+    if (cpl_table_flush (t) != CS_ENONE) return t->table_errno;
+
+    if (n > t->group_size) {
+        for (i=0; i<t->num_columns; i++) {
+            group_size = t->group_size;
+            data = (char *) cpl_realloc2 (t->column[i].data, n, t->column[i].d.element_size, &group_size);
+            if (!data) {
+                t->table_errno = CS_ENOMEM;
+                return CS_ENOMEM;
+            }
+            memset (data, 0, n * t->column[i].d.element_size);
+            t->column[i].data = data;
+        }
+
+        t->group_size = n;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_get_column - Return a pointer to the array of the column number
+*   COLUMN of the table T at the first row not committed yet.  The pointer is
+*   valid until the next call to cpl_table_reserve() or cpl_table_close().
+*
+******************************************************************************/
+
+void * cpl_table_get_column (
+    const cpl_table *t,
+    const int column) {
+
+    assert (t);
+    assert ((column >= 0) && ((size_t) column < t->num_columns));
+    assert (t->started);
+
+    return t->column[column].data + t->num_rows * t->column[column].d.element_size;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_commit - Add the next N rows stored in the column arrays to the
+*   table T.  The rows must have been reserved by cpl_table_reserve(), and
+*   columns not stored by the caller are left as zero.
+*
+******************************************************************************/
+
+void cpl_table_commit (
+    cpl_table *t,
+    const size_t n) {
+
+    assert (t);
+    assert (n <= t->group_size - t->num_rows);
+
+    t->num_rows += n;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_get_num_rows - Return the number of rows committed to the table T.
+*
+******************************************************************************/
+
+uint64_t cpl_table_get_num_rows (
+    const cpl_table *t) {
+
+    assert (t);
+    return t->total_rows + t->num_rows;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_element_size - Return the size in bytes of the CPL_TABLE column
+*   type TYPE, or zero if the type is invalid.
+*
+******************************************************************************/
+
+static size_t cpl_table_element_size (
+    const int type) {
+
+    switch (type) {
+        case CPL_TABLE_INT8    :
+        case CPL_TABLE_UINT8   : return 1;
+        case CPL_TABLE_INT16   :
+        case CPL_TABLE_UINT16  : return 2;
+        case CPL_TABLE_INT32   :
+        case CPL_TABLE_UINT32  :
+        case CPL_TABLE_FLOAT32 : return 4;
+        case CPL_TABLE_INT64   :
+        case CPL_TABLE_UINT64  :
+        case CPL_TABLE_FLOAT64 : return 8;
+        default                : return 0;
+    }
+}
+
+
+/******************************************************************************
+*
+* cpl_table_write - Write SIZE bytes of DATA to the file of the table T.  The
+*   first error is kept, and nothing more is written after it.
+*
+* Return: 0 if the data was written, or
+*         CS_EWRITE if an error occurred.
+*
+******************************************************************************/
+
+static int cpl_table_write (
+    cpl_table *t,
+    const void *data,
+    const size_t size) {
+
+    assert (t);
+    assert (data);
+
+    if (t->table_errno != CS_ENONE) return t->table_errno;
+
+    if ((size > 0) && (fwrite (data, 1, size, t->fp) != size)) {
+        cpl_debug (cpl_lib_debug, "Failed to write table data (%lu bytes)\n", (unsigned long) size);
+        t->table_errno = CS_EWRITE;
+        return CS_EWRITE;
+    }
+
+    t->offset += size;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_start - Write the header and the column descriptors of the table T,
+*   and allocate the row group for at least N rows.  If the row group can not
+*   be allocated, then the columns already allocated are freed.
+*
+* Return: 0 if successful, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+static int cpl_table_start (
+    cpl_table *t,
+    const size_t n) {
+
+    cpl_table_file_header header;
+    size_t group_size;
+    size_t i, j;
+
+
+    assert (t);
+    assert (!t->started);
+
+    if (t->table_errno != CS_ENONE) return t->table_errno;
+
+    group_size = (n > t->group_size) ? n : t->group_size;
+
+    for (i=0; i<t->num_columns; i++) {
+        t->column[i].data = (char *) cpl_calloc (group_size, t->column[i].d.element_size);
+        if (!t->column[i].data) {
+            for (j=0; j<i; j++) {
+                cpl_free (t->column[j].data);
+                t->column[j].data = NULL;
+            }
+            t->table_errno = CS_ENOMEM;
+            return CS_ENOMEM;
+        }
+    }
+
+    t->group_size = group_size;
+
+    memcpy (header.magic, CPL_TABLE_MAGIC, sizeof (header.magic));
+    header.version = CPL_TABLE_VERSION;
+    header.byte_order = CPL_TABLE_BYTE_ORDER;
+    header.num_columns = (uint32_t) t->num_columns;
+    header.descriptor_size = sizeof (cpl_table_descriptor);
+    header.reserved = 0;
+
+    t->started = 1;
+
+    if (cpl_table_write (t, &header, sizeof (header)) != CS_ENONE) return CS_EWRITE;
+
+    for (i=0; i<t->num_columns; i++) {
+        if (cpl_table_write (t, &(t->column[i].d), sizeof (cpl_table_descriptor)) != CS_ENONE) return CS_EWRITE;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_table_flush - Write the rows of the current row group of the table T to
+*   the file, and start a new row group.  Nothing is written if the row group
+*   is empty.
+*
+* Return: 0 if successful, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+static int cpl_table_flush (
+    cpl_table *t) {
+
+    static const char padding[8] = { 0 };
+    cpl_table_group_header header;
+    uint64_t *group_offset;
+    size_t group_alloc;
+    size_t size;
+    size_t i;
+
+
+    assert (t);
+
+    if (t->num_rows == 0) return t->table_errno;
+
+    if (t->num_groups == t->group_alloc) {
+        group_alloc = t->group_alloc;
+        group_offset = (uint64_t *) cpl_realloc2 (t->group_offset, t->num_groups + 1, sizeof (uint64_t), &group_alloc);
+        if (!group_offset) {
+            t->table_errno = CS_ENOMEM;
+            return CS_ENOMEM;
+        }
+        t->group_offset = group_offset;
+        t->group_alloc = group_alloc;
+    }
+
+    header.num_rows = t->num_rows;
+    header.data_size = 0;
+
+    for (i=0; i<t->num_columns; i++) {
+        header.data_size += (t->num_rows * t->column[i].d.element_size + 7) & ~(uint64_t) 7;
+    }
+
+    t->group_offset[t->num_groups++] = t->offset;
+
+    cpl_table_write (t, &header, sizeof (header));
+
+    /* Each column is written with one large write, and padded so the next one is aligned.
+       The rows are cleared so the columns the caller does not store are zero. */
+    for (i=0; i<t->num_columns; i++) {
+        size = t->num_rows * t->column[i].d.element_size;
+        cpl_table_write (t, t->column[i].data, size);
+        cpl_table_write (t, padding, ((size + 7) & ~(size_t) 7) - size);
+        memset (t->column[i].data, 0, t->group_size * t->column[i].d.element_size);
+    }
+
+    t->total_rows += t->num_rows;
+    t->num_rows = 0;
+
+    return t->table_errno;
+}
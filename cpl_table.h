@@ -0,0 +1,71 @@
+/* cpl_table.h -- Header file for cpl_table.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#ifndef CPL_TABLE_H
+#define CPL_TABLE_H
+
+#if defined (__cplusplus)
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#define CPL_NEED_FIXED_WIDTH_T  /* Tell cpl_spec.h we need fixed-width types. */
+#include "cpl_spec.h"
+
+
+/* Table Column Types */
+#define CPL_TABLE_INT8      1  /* int8_t.   */
+#define CPL_TABLE_UINT8     2  /* uint8_t.  */
+#define CPL_TABLE_INT16     3  /* int16_t.  */
+#define CPL_TABLE_UINT16    4  /* uint16_t. */
+#define CPL_TABLE_INT32     5  /* int32_t.  */
+#define CPL_TABLE_UINT32    6  /* uint32_t. */
+#define CPL_TABLE_INT64     7  /* int64_t.  */
+#define CPL_TABLE_UINT64    8  /* uint64_t. */
+#define CPL_TABLE_FLOAT32   9  /* float.    */
+#define CPL_TABLE_FLOAT64  10  /* double.   */
+
+
+/* Maximum Length of a Column Name Including the Terminating Null */
+#define CPL_TABLE_NAME_SIZE   32
+
+
+/* Default Number of Rows in a Row Group */
+#define CPL_TABLE_GROUP_SIZE  65536
+
+
+/* Opaque Table File Type */
+typedef struct cpl_table_struct cpl_table;
+
+
+/******************************* API Functions *******************************/
+
+CPL_CLINKAGE_START
+
+cpl_table * cpl_table_create (const char *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int cpl_table_close (cpl_table *);
+int cpl_table_add_column (cpl_table *, const char *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_table_find_column (const cpl_table *, const char *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+size_t cpl_table_get_num_columns (const cpl_table *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+int cpl_table_reserve (cpl_table *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+void * cpl_table_get_column (const cpl_table *, const int) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+void cpl_table_commit (cpl_table *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+uint64_t cpl_table_get_num_rows (const cpl_table *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+
+CPL_CLINKAGE_END
+
+#endif /* CPL_TABLE_H */
@@ -0,0 +1,992 @@
+/* cpl_thread.c -- Portable thread pool functions.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+
+ Compiler Defines:
+   HAVE_PTHREAD  - Defined if the POSIX threads library is available. */
+
+#include "config.h"
+#include <stddef.h>
+#include <assert.h>
+#include "cpl_thread.h"
+#include "cpl_debug.h"
+#include "cpl_alloc.h"
+
+#if defined (CPL_WIN32_API)
+# define WIN32_LEAN_AND_MEAN  /* Exclude Cryptography, DDE, RPC, Shell, and Windows Sockets API. */
+# include <windows.h>
+# include <process.h>
+# define CPL_HAVE_THREADS  1
+#elif defined (HAVE_PTHREAD)
+# include <pthread.h>
+# include <unistd.h>
+# define CPL_HAVE_THREADS  1
+#else
+# include <unistd.h>
+#endif
+
+/* The ring indices are lock-free if atomic loads and stores are available. */
+#if defined (CPL_WIN32_API) || (defined (__GNUC__) && defined (__ATOMIC_SEQ_CST))
+# define CPL_RING_LOCK_FREE  1
+#endif
+
+/* Padding to Keep Ring Indices Written by Different Threads Apart */
+#define CPL_RING_PAD  64
+
+
+/* Thread Pool */
+typedef struct {
+    cpl_task_fn fn;              /* Task function.                */
+    void *arg;                   /* Task function argument.       */
+    size_t num_tasks;            /* Number of tasks to run.       */
+    size_t next_task;            /* Next task to run.             */
+#if defined (CPL_WIN32_API)
+    CRITICAL_SECTION lock;       /* Lock for the next task.       */
+#elif defined (HAVE_PTHREAD)
+    pthread_mutex_t lock;        /* Lock for the next task.       */
+#endif
+} cpl_thread_pool;
+
+
+/* Worker Thread */
+struct cpl_worker_struct {
+    cpl_task_fn fn;              /* Task function.                */
+    void *arg;                   /* Task function argument.       */
+    size_t task;                 /* Task number.                  */
+    int busy;                    /* Boolean if a task is running. */
+    int quit;                    /* Boolean to stop the thread.   */
+#if defined (CPL_WIN32_API)
+    HANDLE thread;               /* Worker thread.                */
+    CRITICAL_SECTION lock;       /* Lock for the worker state.    */
+    CONDITION_VARIABLE cond;     /* Signal of a change of state.  */
+#elif defined (HAVE_PTHREAD)
+    pthread_t thread;            /* Worker thread.                */
+    pthread_mutex_t lock;        /* Lock for the worker state.    */
+    pthread_cond_t cond;         /* Signal of a change of state.  */
+#endif
+};
+
+
+/* Single-Producer Single-Consumer Ring */
+struct cpl_ring_struct {
+    void **items;                /* Array of capacity items.      */
+    size_t mask;                 /* Capacity minus one.           */
+    char pad0[CPL_RING_PAD];     /* Padding before the head.      */
+    volatile size_t head;        /* Number of items popped.       */
+    char pad1[CPL_RING_PAD];     /* Padding before the tail.      */
+    volatile size_t tail;        /* Number of items pushed.       */
+    char pad2[CPL_RING_PAD];     /* Padding before the state.     */
+    volatile size_t waiting;     /* Boolean if consumer waits.    */
+    int closed;                  /* Boolean if ring is closed.    */
+#if defined (CPL_WIN32_API)
+    CRITICAL_SECTION lock;       /* Lock for a waiting consumer.  */
+    CONDITION_VARIABLE cond;     /* Signal of a pushed item.      */
+#elif defined (HAVE_PTHREAD)
+    pthread_mutex_t lock;        /* Lock for a waiting consumer.  */
+    pthread_cond_t cond;         /* Signal of a pushed item.      */
+#if !defined (CPL_RING_LOCK_FREE)
+    pthread_mutex_t index_lock;  /* Lock for the indices.         */
+#endif
+#endif
+};
+
+
+/* Private Function Prototypes */
+#if defined (CPL_HAVE_THREADS)
+static int cpl_thread_next (cpl_thread_pool *, size_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void cpl_thread_work (cpl_thread_pool *) CPL_ATTRIBUTE_NONNULL_ALL;
+#if defined (CPL_WIN32_API)
+static unsigned __stdcall cpl_thread_main (void *);
+#else
+static void * cpl_thread_main (void *);
+#endif
+static void cpl_worker_lock (cpl_worker *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void cpl_worker_unlock (cpl_worker *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void cpl_worker_sleep (cpl_worker *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void cpl_worker_signal (cpl_worker *) CPL_ATTRIBUTE_NONNULL_ALL;
+#if defined (CPL_WIN32_API)
+static unsigned __stdcall cpl_worker_main (void *);
+#else
+static void * cpl_worker_main (void *);
+#endif
+#endif
+static size_t cpl_ring_load (cpl_ring *, const volatile size_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void cpl_ring_store (cpl_ring *, volatile size_t *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+
+
+/* External Variable */
+extern int cpl_lib_debug;
+
+
+/******************************************************************************
+*
+* cpl_thread_num_cpus - Return the number of online processors, or 1 if the
+*   number is unknown.
+*
+******************************************************************************/
+
+int cpl_thread_num_cpus (void) {
+
+#if defined (CPL_WIN32_API)
+    SYSTEM_INFO info;
+
+
+    GetSystemInfo (&info);
+    if (info.dwNumberOfProcessors > 0) return (int) info.dwNumberOfProcessors;
+#elif defined (_SC_NPROCESSORS_ONLN)
+    long n;
+
+
+    n = sysconf (_SC_NPROCESSORS_ONLN);
+    if (n > 0) return n > CPL_THREAD_MAX ? CPL_THREAD_MAX : (int) n;
+#endif
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* cpl_thread_run - Run the function FN (ARG, I) for each task I from 0 to
+*   NUM_TASKS - 1 using a pool of up to NUM_THREADS threads, including the
+*   calling thread.  The tasks are handed out in order to the next available
+*   thread, so tasks of different cost are balanced across the threads.  If
+*   NUM_THREADS is zero or negative, then one thread per processor is used.
+*   This function returns after all tasks are finished.  If threads are not
+*   available or can not be created, then the remaining tasks are run by the
+*   calling thread.
+*
+* Return: The number of threads used to run the tasks.
+*
+******************************************************************************/
+
+int cpl_thread_run (
+    const size_t num_tasks,
+    const int num_threads,
+    cpl_task_fn fn,
+    void *arg) {
+
+#if defined (CPL_HAVE_THREADS)
+    cpl_thread_pool pool;
+#if defined (CPL_WIN32_API)
+    HANDLE *threads;
+    uintptr_t thread;
+#else
+    pthread_t *threads;
+#endif
+    size_t n, num_created;
+#endif
+    size_t i;
+
+
+    assert (fn);
+
+#if defined (CPL_HAVE_THREADS)
+    n = num_threads > 0 ? (size_t) num_threads : (size_t) cpl_thread_num_cpus ();
+    if (n > CPL_THREAD_MAX) n = CPL_THREAD_MAX;
+    if (n > num_tasks) n = num_tasks;
+
+    if (n > 1) {
+        pool.fn = fn;
+        pool.arg = arg;
+        pool.num_tasks = num_tasks;
+        pool.next_task = 0;
+
+#if defined (CPL_WIN32_API)
+        threads = (HANDLE *) cpl_malloc ((n - 1) * sizeof (HANDLE));
+#else
+        threads = (pthread_t *) cpl_malloc ((n - 1) * sizeof (pthread_t));
+#endif
+
+#if defined (CPL_WIN32_API)
+        if (threads) InitializeCriticalSection (&(pool.lock));
+#else
+        if (threads && (pthread_mutex_init (&(pool.lock), NULL) != 0)) {
+            cpl_free (threads);
+            threads = NULL;
+        }
+#endif
+
+        if (threads) {
+            /* The calling thread is also a worker, so create one less thread. */
+            for (num_created=0; num_created<n-1; num_created++) {
+#if defined (CPL_WIN32_API)
+                thread = _beginthreadex (NULL, 0, cpl_thread_main, &pool, 0, NULL);
+                if (thread == 0) break;
+                threads[num_created] = (HANDLE) thread;
+#else
+                if (pthread_create (&(threads[num_created]), NULL, cpl_thread_main, &pool) != 0) break;
+#endif
+            }
+
+            if (num_created < n - 1) {
+                cpl_debug (cpl_lib_debug, "Created %lu of %lu threads\n", (unsigned long) num_created, (unsigned long) (n - 1));
+            }
+
+            cpl_thread_work (&pool);
+
+            for (i=0; i<num_created; i++) {
+#if defined (CPL_WIN32_API)
+                WaitForSingleObject (threads[i], INFINITE);
+                CloseHandle (threads[i]);
+#else
+                pthread_join (threads[i], NULL);
+#endif
+            }
+
+#if defined (CPL_WIN32_API)
+            DeleteCriticalSection (&(pool.lock));
+#else
+            pthread_mutex_destroy (&(pool.lock));
+#endif
+            cpl_free (threads);
+
+            return (int) num_created + 1;
+        }
+
+        cpl_debug (cpl_lib_debug, "Unable to create thread pool\n");
+    }
+#else
+    (void) num_threads;
+#endif
+
+    for (i=0; i<num_tasks; i++) {
+        fn (arg, i);
+    }
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* cpl_worker_create - Create a worker thread, which runs one task at a time in
+*   the background that is given by cpl_worker_start().
+*
+* Return: The worker thread, or
+*         NULL if threads are not available or an error occurred.
+*
+******************************************************************************/
+
+cpl_worker * cpl_worker_create (void) {
+
+#if defined (CPL_HAVE_THREADS)
+    cpl_worker *w;
+#if defined (CPL_WIN32_API)
+    uintptr_t thread;
+#endif
+
+
+    w = (cpl_worker *) cpl_malloc (sizeof (cpl_worker));
+    if (!w) return NULL;
+
+    w->fn = NULL;
+    w->arg = NULL;
+    w->task = 0;
+    w->busy = 0;
+    w->quit = 0;
+
+#if defined (CPL_WIN32_API)
+    InitializeCriticalSection (&(w->lock));
+    InitializeConditionVariable (&(w->cond));
+
+    thread = _beginthreadex (NULL, 0, cpl_worker_main, w, 0, NULL);
+    if (thread == 0) {
+        DeleteCriticalSection (&(w->lock));
+        cpl_free (w);
+        return NULL;
+    }
+
+    w->thread = (HANDLE) thread;
+#else
+    if (pthread_mutex_init (&(w->lock), NULL) != 0) {
+        cpl_free (w);
+        return NULL;
+    }
+
+    if (pthread_cond_init (&(w->cond), NULL) != 0) {
+        pthread_mutex_destroy (&(w->lock));
+        cpl_free (w);
+        return NULL;
+    }
+
+    if (pthread_create (&(w->thread), NULL, cpl_worker_main, w) != 0) {
+        pthread_cond_destroy (&(w->cond));
+        pthread_mutex_destroy (&(w->lock));
+        cpl_free (w);
+        return NULL;
+    }
+#endif
+
+    return w;
+#else
+    cpl_debug (cpl_lib_debug, "Threads are not available\n");
+    return NULL;
+#endif
+}
+
+
+/******************************************************************************
+*
+* cpl_worker_start - Run the function FN (ARG, TASK) on the worker thread W.
+*   This function waits for any previous task to finish, and then returns
+*   without waiting for the new task.
+*
+******************************************************************************/
+
+void cpl_worker_start (
+    cpl_worker *w,
+    cpl_task_fn fn,
+    void *arg,
+    const size_t task) {
+
+    assert (w);
+    assert (fn);
+
+#if defined (CPL_HAVE_THREADS)
+    cpl_worker_lock (w);
+
+    while (w->busy) {
+        cpl_worker_sleep (w);
+    }
+
+    w->fn = fn;
+    w->arg = arg;
+    w->task = task;
+    w->busy = 1;
+
+    cpl_worker_signal (w);
+    cpl_worker_unlock (w);
+#else
+    fn (arg, task);
+#endif
+}
+
+
+/******************************************************************************
+*
+* cpl_worker_wait - Wait for the task running on the worker thread W to finish.
+*   The results of the task are available to the calling thread on return.
+*
+******************************************************************************/
+
+void cpl_worker_wait (
+    cpl_worker *w) {
+
+    assert (w);
+
+#if defined (CPL_HAVE_THREADS)
+    cpl_worker_lock (w);
+
+    while (w->busy) {
+        cpl_worker_sleep (w);
+    }
+
+    cpl_worker_unlock (w);
+#endif
+}
+
+
+/******************************************************************************
+*
+* cpl_worker_destroy - Wait for the task running on the worker thread W to
+*   finish, stop the thread, and free its resources.
+*
+******************************************************************************/
+
+void cpl_worker_destroy (
+    cpl_worker *w) {
+
+    if (!w) return;
+
+#if defined (CPL_HAVE_THREADS)
+    cpl_worker_lock (w);
+
+    while (w->busy) {
+        cpl_worker_sleep (w);
+    }
+
+    w->quit = 1;
+
+    cpl_worker_signal (w);
+    cpl_worker_unlock (w);
+
+#if defined (CPL_WIN32_API)
+    WaitForSingleObject (w->thread, INFINITE);
+    CloseHandle (w->thread);
+    DeleteCriticalSection (&(w->lock));
+#else
+    pthread_join (w->thread, NULL);
+    pthread_cond_destroy (&(w->cond));
+    pthread_mutex_destroy (&(w->lock));
+#endif
+#endif
+
+    cpl_free (w);
+}
+
+
+/******************************************************************************
+*
+* cpl_ring_create - Create a single-producer single-consumer ring, which passes
+*   up to CAPACITY non-NULL items in order from one thread to another.  The
+*   capacity is rounded up to a power of two.  Pushing and popping items does
+*   not take a lock, and only a consumer that waits for an empty ring sleeps.
+*
+* Return: The ring, or
+*         NULL if CAPACITY is zero or an error occurred.
+*
+******************************************************************************/
+
+cpl_ring * cpl_ring_create (
+    const size_t capacity) {
+
+    cpl_ring *r;
+    size_t n = 1;
+
+
+    if (capacity == 0) return NULL;
+
+    while (n < capacity) {
+        if (n > ((size_t) -1) / 2 / sizeof (void *)) return NULL;
+        n *= 2;
+    }
+
+    r = (cpl_ring *) cpl_malloc (sizeof (cpl_ring));
+    if (!r) return NULL;
+
+    r->items = (void **) cpl_malloc (n * sizeof (void *));
+    if (!r->items) {
+        cpl_free (r);
+        return NULL;
+    }
+
+    r->mask = n - 1;
+    r->head = 0;
+    r->tail = 0;
+    r->waiting = 0;
+    r->closed = 0;
+
+#if defined (CPL_WIN32_API)
+    InitializeCriticalSection (&(r->lock));
+    InitializeConditionVariable (&(r->cond));
+#elif defined (HAVE_PTHREAD)
+    if (pthread_mutex_init (&(r->lock), NULL) != 0) {
+        cpl_free (r->items);
+        cpl_free (r);
+        return NULL;
+    }
+
+    if (pthread_cond_init (&(r->cond), NULL) != 0) {
+        pthread_mutex_destroy (&(r->lock));
+        cpl_free (r->items);
+        cpl_free (r);
+        return NULL;
+    }
+
+#if !defined (CPL_RING_LOCK_FREE)
+    if (pthread_mutex_init (&(r->index_lock), NULL) != 0) {
+        pthread_cond_destroy (&(r->cond));
+        pthread_mutex_destroy (&(r->lock));
+        cpl_free (r->items);
+        cpl_free (r);
+        return NULL;
+    }
+#endif
+#endif
+
+    return r;
+}
+
+
+/******************************************************************************
+*
+* cpl_ring_destroy - Free the ring R.  No thread may be using the ring.
+*
+******************************************************************************/
+
+void cpl_ring_destroy (
+    cpl_ring *r) {
+
+    if (!r) return;
+
+#if defined (CPL_WIN32_API)
+    DeleteCriticalSection (&(r->lock));
+#elif defined (HAVE_PTHREAD)
+    pthread_cond_destroy (&(r->cond));
+    pthread_mutex_destroy (&(r->lock));
+#if !defined (CPL_RING_LOCK_FREE)
+    pthread_mutex_destroy (&(r->index_lock));
+#endif
+#endif
+
+    cpl_free (r->items);
+    cpl_free (r);
+}
+
+
+/******************************************************************************
+*
+* cpl_ring_push - Add the non-NULL ITEM to the end of the ring R.  Only one
+*   thread may push items to a ring, and a consumer waiting in cpl_ring_wait()
+*   is woken.
+*
+* Return: 0 if the item was added, or
+*        -1 if the ring is full.
+*
+******************************************************************************/
+
+int cpl_ring_push (
+    cpl_ring *r,
+    void *item) {
+
+    size_t head;
+    size_t tail;
+
+
+    assert (r);
+    assert (item);
+
+    /* Only this thread changes the tail, so it can be read without a barrier. */
+    tail = r->tail;
+    head = cpl_ring_load (r, &(r->head));
+
+    if (tail - head > r->mask) return -1;
+
+    r->items[tail & r->mask] = item;
+
+    /* The item must be stored before the consumer can see the new tail. */
+    cpl_ring_store (r, &(r->tail), tail + 1);
+
+    /* The tail is stored before the consumer state is read, so a consumer that
+       found the ring empty is either seen here or sees the new item itself. */
+    if (cpl_ring_load (r, &(r->waiting))) {
+#if defined (CPL_WIN32_API)
+        EnterCriticalSection (&(r->lock));
+        WakeConditionVariable (&(r->cond));
+        LeaveCriticalSection (&(r->lock));
+#elif defined (HAVE_PTHREAD)
+        pthread_mutex_lock (&(r->lock));
+        pthread_cond_signal (&(r->cond));
+        pthread_mutex_unlock (&(r->lock));
+#endif
+    }
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_ring_pop - Remove the first item from the ring R without waiting.  Only
+*   one thread may pop items from a ring.
+*
+* Return: The first item, or
+*         NULL if the ring is empty.
+*
+******************************************************************************/
+
+void * cpl_ring_pop (
+    cpl_ring *r) {
+
+    size_t head;
+    size_t tail;
+    void *item;
+
+
+    assert (r);
+
+    /* Only this thread changes the head, so it can be read without a barrier. */
+    head = r->head;
+    tail = cpl_ring_load (r, &(r->tail));
+
+    if (head == tail) return NULL;
+
+    item = r->items[head & r->mask];
+
+    /* The item must be read before the producer can reuse its place. */
+    cpl_ring_store (r, &(r->head), head + 1);
+
+    return item;
+}
+
+
+/******************************************************************************
+*
+* cpl_ring_wait - Remove the first item from the ring R, and wait for an item
+*   to be pushed if the ring is empty.  Only one thread may pop items from a
+*   ring.  If threads are not available, then this does not wait.
+*
+* Return: The first item, or
+*         NULL if the ring is closed or empty without threads.
+*
+******************************************************************************/
+
+void * cpl_ring_wait (
+    cpl_ring *r) {
+
+    void *item;
+
+
+    assert (r);
+
+    item = cpl_ring_pop (r);
+    if (item) return item;
+
+#if defined (CPL_HAVE_THREADS)
+#if defined (CPL_WIN32_API)
+    EnterCriticalSection (&(r->lock));
+#else
+    pthread_mutex_lock (&(r->lock));
+#endif
+
+    /* Announce the wait before checking the tail again, which pairs with the
+       order of the tail and the consumer state in cpl_ring_push(). */
+    cpl_ring_store (r, &(r->waiting), 1);
+
+    while (!r->closed && (cpl_ring_load (r, &(r->tail)) == r->head)) {
+#if defined (CPL_WIN32_API)
+        SleepConditionVariableCS (&(r->cond), &(r->lock), INFINITE);
+#else
+        pthread_cond_wait (&(r->cond), &(r->lock));
+#endif
+    }
+
+    cpl_ring_store (r, &(r->waiting), 0);
+
+    if (r->closed) item = NULL;
+    else item = cpl_ring_pop (r);
+
+#if defined (CPL_WIN32_API)
+    LeaveCriticalSection (&(r->lock));
+#else
+    pthread_mutex_unlock (&(r->lock));
+#endif
+#endif
+
+    return item;
+}
+
+
+/******************************************************************************
+*
+* cpl_ring_close - Close the ring R, so the consumer no longer waits for items.
+*   A consumer waiting in cpl_ring_wait() is woken, and this and later calls to
+*   cpl_ring_wait() return NULL.  Items still in the ring may be removed with
+*   cpl_ring_pop().
+*
+******************************************************************************/
+
+void cpl_ring_close (
+    cpl_ring *r) {
+
+    assert (r);
+
+#if defined (CPL_WIN32_API)
+    EnterCriticalSection (&(r->lock));
+    r->closed = 1;
+    WakeConditionVariable (&(r->cond));
+    LeaveCriticalSection (&(r->lock));
+#elif defined (HAVE_PTHREAD)
+    pthread_mutex_lock (&(r->lock));
+    r->closed = 1;
+    pthread_cond_signal (&(r->cond));
+    pthread_mutex_unlock (&(r->lock));
+#else
+    r->closed = 1;
+#endif
+}
+
+#if defined (CPL_HAVE_THREADS)
+
+/******************************************************************************
+*
+* cpl_thread_next - Store the next task to run from the thread pool P in TASK.
+*
+* Return: 1 if a task was stored, or
+*         0 if all tasks have been started.
+*
+******************************************************************************/
+
+static int cpl_thread_next (
+    cpl_thread_pool *p,
+    size_t *task) {
+
+    int status = 0;
+
+
+    assert (p);
+    assert (task);
+
+#if defined (CPL_WIN32_API)
+    EnterCriticalSection (&(p->lock));
+#else
+    pthread_mutex_lock (&(p->lock));
+#endif
+
+    if (p->next_task < p->num_tasks) {
+        *task = p->next_task++;
+        status = 1;
+    }
+
+#if defined (CPL_WIN32_API)
+    LeaveCriticalSection (&(p->lock));
+#else
+    pthread_mutex_unlock (&(p->lock));
+#endif
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* cpl_thread_work - Run tasks from the thread pool P until all tasks have been
+*   started.
+*
+******************************************************************************/
+
+static void cpl_thread_work (
+    cpl_thread_pool *p) {
+
+    size_t task;
+
+
+    assert (p);
+
+    while (cpl_thread_next (p, &task)) {
+        p->fn (p->arg, task);
+    }
+}
+
+
+/******************************************************************************
+*
+* cpl_thread_main - Start routine of the threads created by cpl_thread_run.
+*
+******************************************************************************/
+
+#if defined (CPL_WIN32_API)
+static unsigned __stdcall cpl_thread_main (
+    void *arg) {
+
+    cpl_thread_work ((cpl_thread_pool *) arg);
+    return 0;
+}
+#else
+static void * cpl_thread_main (
+    void *arg) {
+
+    cpl_thread_work ((cpl_thread_pool *) arg);
+    return NULL;
+}
+#endif
+
+
+
+/******************************************************************************
+*
+* cpl_worker_lock - Lock the state of the worker thread W.
+*
+******************************************************************************/
+
+static void cpl_worker_lock (
+    cpl_worker *w) {
+
+    assert (w);
+
+#if defined (CPL_WIN32_API)
+    EnterCriticalSection (&(w->lock));
+#else
+    pthread_mutex_lock (&(w->lock));
+#endif
+}
+
+
+/******************************************************************************
+*
+* cpl_worker_unlock - Unlock the state of the worker thread W.
+*
+******************************************************************************/
+
+static void cpl_worker_unlock (
+    cpl_worker *w) {
+
+    assert (w);
+
+#if defined (CPL_WIN32_API)
+    LeaveCriticalSection (&(w->lock));
+#else
+    pthread_mutex_unlock (&(w->lock));
+#endif
+}
+
+
+/******************************************************************************
+*
+* cpl_worker_sleep - Wait for a change of state of the worker thread W, which
+*   must be locked.
+*
+******************************************************************************/
+
+static void cpl_worker_sleep (
+    cpl_worker *w) {
+
+    assert (w);
+
+#if defined (CPL_WIN32_API)
+    SleepConditionVariableCS (&(w->cond), &(w->lock), INFINITE);
+#else
+    pthread_cond_wait (&(w->cond), &(w->lock));
+#endif
+}
+
+
+/******************************************************************************
+*
+* cpl_worker_signal - Wake all threads waiting for a change of state of the
+*   worker thread W, which must be locked.
+*
+******************************************************************************/
+
+static void cpl_worker_signal (
+    cpl_worker *w) {
+
+    assert (w);
+
+#if defined (CPL_WIN32_API)
+    WakeAllConditionVariable (&(w->cond));
+#else
+    pthread_cond_broadcast (&(w->cond));
+#endif
+}
+
+
+/******************************************************************************
+*
+* cpl_worker_main - Start routine of the worker threads created by
+*   cpl_worker_create, which runs each task given to the worker until it is
+*   stopped.
+*
+******************************************************************************/
+
+#if defined (CPL_WIN32_API)
+static unsigned __stdcall cpl_worker_main (
+#else
+static void * cpl_worker_main (
+#endif
+    void *arg) {
+
+    cpl_worker *w = (cpl_worker *) arg;
+
+
+    assert (w);
+
+    cpl_worker_lock (w);
+
+    for (;;) {
+        while (!w->busy && !w->quit) {
+            cpl_worker_sleep (w);
+        }
+
+        if (!w->busy) break;
+
+        /* Run the task without holding the lock, so the state can be checked. */
+        cpl_worker_unlock (w);
+        w->fn (w->arg, w->task);
+        cpl_worker_lock (w);
+
+        w->busy = 0;
+        cpl_worker_signal (w);
+    }
+
+    cpl_worker_unlock (w);
+
+#if defined (CPL_WIN32_API)
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+#endif /* CPL_HAVE_THREADS */
+
+
+/******************************************************************************
+*
+* cpl_ring_load - Return the ring index or state at P of the ring R, which is
+*   read after all memory operations that come before it in this thread.
+*
+******************************************************************************/
+
+static size_t cpl_ring_load (
+    cpl_ring *r,
+    const volatile size_t *p) {
+
+    size_t value;
+
+
+    (void) r;
+    assert (p);
+
+#if defined (CPL_WIN32_API)
+    MemoryBarrier ();
+    value = *p;
+    MemoryBarrier ();
+#elif defined (CPL_RING_LOCK_FREE)
+    value = __atomic_load_n (p, __ATOMIC_SEQ_CST);
+#elif defined (HAVE_PTHREAD)
+    pthread_mutex_lock (&(r->index_lock));
+    value = *p;
+    pthread_mutex_unlock (&(r->index_lock));
+#else
+    value = *p;
+#endif
+
+    return value;
+}
+
+
+/******************************************************************************
+*
+* cpl_ring_store - Store VALUE in the ring index or state at P of the ring R,
+*   which is written after all memory operations that come before it in this
+*   thread.
+*
+******************************************************************************/
+
+static void cpl_ring_store (
+    cpl_ring *r,
+    volatile size_t *p,
+    const size_t value) {
+
+    (void) r;
+    assert (p);
+
+#if defined (CPL_WIN32_API)
+    MemoryBarrier ();
+    *p = value;
+    MemoryBarrier ();
+#elif defined (CPL_RING_LOCK_FREE)
+    __atomic_store_n (p, value, __ATOMIC_SEQ_CST);
+#elif defined (HAVE_PTHREAD)
+    pthread_mutex_lock (&(r->index_lock));
+    *p = value;
+    pthread_mutex_unlock (&(r->index_lock));
+#else
+    *p = value;
+#endif
+}
@@ -0,0 +1,64 @@
+/* cpl_thread.h -- Header file for cpl_thread.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#ifndef CPL_THREAD_H
+#define CPL_THREAD_H
+
+#if defined (__cplusplus)
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#include "cpl_spec.h"
+
+
+/* Maximum Number of Threads Used by cpl_thread_run */
+#define CPL_THREAD_MAX  256
+
+
+/* Task Function Type for cpl_thread_run */
+typedef void (*cpl_task_fn) (void *, const size_t);
+
+
+/* Opaque Worker Thread Type */
+typedef struct cpl_worker_struct cpl_worker;
+
+
+/* Opaque Single-Producer Single-Consumer Ring Type */
+typedef struct cpl_ring_struct cpl_ring;
+
+
+/******************************* API Functions *******************************/
+
+CPL_CLINKAGE_START
+
+int cpl_thread_num_cpus (void);
+int cpl_thread_run (const size_t, const int, cpl_task_fn, void *) CPL_ATTRIBUTE_NONNULL (3);
+cpl_worker * cpl_worker_create (void) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+void cpl_worker_start (cpl_worker *, cpl_task_fn, void *, const size_t) CPL_ATTRIBUTE_NONNULL (1) CPL_ATTRIBUTE_NONNULL (2);
+void cpl_worker_wait (cpl_worker *) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_worker_destroy (cpl_worker *);
+cpl_ring * cpl_ring_create (const size_t) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+void cpl_ring_destroy (cpl_ring *);
+int cpl_ring_push (cpl_ring *, void *) CPL_ATTRIBUTE_NONNULL_ALL;
+void * cpl_ring_pop (cpl_ring *) CPL_ATTRIBUTE_NONNULL_ALL;
+void * cpl_ring_wait (cpl_ring *) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_ring_close (cpl_ring *) CPL_ATTRIBUTE_NONNULL_ALL;
+
+CPL_CLINKAGE_END
+
+#endif /* CPL_THREAD_H */
@@ -22,6 +22,11 @@
 #include "cpl_timedate.h"
 #include "cpl_str.h"
 
+#if defined (CPL_WIN32_API)
+# define WIN32_LEAN_AND_MEAN  /* Exclude Cryptography, DDE, RPC, Shell, and Windows Sockets API. */
+# include <windows.h>
+#endif
+
 
 /* Nanoseconds Per Second */
 #define NSEC_PER_SEC 1000000000
@@ -679,3 +684,36 @@ void cpl_timespec_normalize (
         }
     }
 }
+
+
+/******************************************************************************
+*
+* cpl_clock_ns - Return the time of a monotonic clock in nanoseconds, which is
+*   only useful to measure elapsed time as the difference of two calls.  The
+*   clock is not affected by changes to the system time.  If no monotonic clock
+*   is available, then the system time is used with a resolution of seconds.
+*
+******************************************************************************/
+
+uint64_t cpl_clock_ns (void) {
+
+#if defined (CPL_WIN32_API)
+    LARGE_INTEGER count, frequency;
+
+
+    QueryPerformanceCounter (&count);
+    QueryPerformanceFrequency (&frequency);
+
+    return (uint64_t) (count.QuadPart / frequency.QuadPart) * NSEC_PER_SEC +
+        (uint64_t) (count.QuadPart % frequency.QuadPart) * NSEC_PER_SEC / (uint64_t) frequency.QuadPart;
+#elif defined (HAVE_CLOCK_GETTIME) && defined (CLOCK_MONOTONIC)
+    struct timespec ts;
+
+
+    if (clock_gettime (CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+    return (uint64_t) ts.tv_sec * NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+#else
+    return (uint64_t) time (NULL) * NSEC_PER_SEC;
+#endif
+}
@@ -23,6 +23,7 @@
 #include <time.h>
 #endif
 
+#define CPL_NEED_FIXED_WIDTH_T  /* Tell cpl_spec.h we need fixed-width types. */
 #include "cpl_spec.h"
 
 
@@ -57,6 +58,7 @@ void cpl_timespec_add (struct timespec *, struct timespec *) CPL_ATTRIBUTE_NONNU
 void cpl_timespec_sub (struct timespec *, struct timespec *) CPL_ATTRIBUTE_NONNULL_ALL;
 int cpl_timespec_cmp (struct timespec *, struct timespec *) CPL_ATTRIBUTE_NONNULL_ALL;
 void cpl_timespec_normalize (struct timespec *) CPL_ATTRIBUTE_NONNULL_ALL;
+uint64_t cpl_clock_ns (void);
 
 
 CPL_CLINKAGE_END
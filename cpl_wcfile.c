@@ -0,0 +1,610 @@
+/* cpl_wcfile.c -- Compressed water column file.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   File Format:
+   The file is written in the byte order of the host, which is given in the
+   file header.  Each water column datagram is one block, which is rANS
+   encoded by cpl_rans_encode() or stored unencoded if it does not compress.
+   The reader prepares the datagram, such as delta coding the samples, before
+   it is written and undoes this after it is read.
+
+     File header (24 bytes)
+     Blocks
+     Index entries (32 bytes each, cpl_wcfile_entry)
+     File trailer (24 bytes)
+
+   A reader finds the index from the trailer at the end of the file, so any
+   datagram can be read with a single read of its block. */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "cpl_wcfile.h"
+#include "cpl_rans.h"
+#include "cpl_alloc.h"
+#include "cpl_error.h"
+#include "cpl_debug.h"
+#include "cpl_file.h"
+
+
+/* Water Column File Magic Strings and Version */
+#define CPL_WCFILE_MAGIC          "CPLWATER"
+#define CPL_WCFILE_TRAILER_MAGIC  "CPLWCEND"
+#define CPL_WCFILE_VERSION        1
+#define CPL_WCFILE_BYTE_ORDER     0x01020304
+
+
+/* Water Column File Header (24 Bytes) */
+typedef struct {
+    char magic[8];                    /* Magic string "CPLWATER".           */
+    uint32_t version;                 /* Water column file version.         */
+    uint32_t byte_order;              /* 0x01020304 in the file byte order. */
+    uint32_t format;                  /* Datagram format CPL_WCFILE_*.      */
+    uint32_t entry_size;              /* Size of each index entry in bytes. */
+} cpl_wcfile_header;
+
+
+/* Water Column File Trailer (24 Bytes) */
+typedef struct {
+    uint64_t num_entries;             /* Number of index entries.           */
+    uint64_t index_offset;            /* File offset of the index.          */
+    char magic[8];                    /* Magic string "CPLWCEND".           */
+} cpl_wcfile_trailer;
+
+
+/* Water Column File */
+struct cpl_wcfile_struct {
+    FILE *fp;                         /* File stream if writing, or NULL.   */
+    int fd;                           /* File descriptor if reading.        */
+    cpl_wcfile_entry *entry;          /* Array of num_entries entries.      */
+    size_t num_entries;               /* Number of index entries.           */
+    size_t entry_alloc;               /* Allocated number of entries.       */
+    uint8_t *block;                   /* Encoded block.                     */
+    size_t block_alloc;               /* Allocated size of the block.       */
+    uint8_t *data;                    /* Decoded datagram.                  */
+    size_t data_alloc;                /* Allocated size of the datagram.    */
+    uint64_t offset;                  /* File offset of the next write.     */
+    int sorted;                       /* Boolean if entries are time order. */
+    int wc_errno;                     /* Error condition of the last write. */
+};
+
+
+/* External Variable */
+extern int cpl_lib_debug;
+
+
+/* Private Function Prototypes */
+static cpl_wcfile * cpl_wcfile_new (void) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+static int cpl_wcfile_put (cpl_wcfile *, const void *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_wcfile_get (cpl_wcfile *, void *, const size_t, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+
+
+/******************************************************************************
+*
+* cpl_wcfile_create - Create the water column file given by FILE_NAME for the
+*   datagrams of the CPL_WCFILE format FORMAT.  The datagrams are added with
+*   cpl_wcfile_write().  The caller must call cpl_wcfile_close() to finish the
+*   file and free the water column file.
+*
+* Return: A pointer to the new water column file, or
+*         NULL if the file could not be created or memory allocation failed.
+*
+******************************************************************************/
+
+cpl_wcfile * cpl_wcfile_create (
+    const char *file_name,
+    const uint32_t format) {
+
+    cpl_wcfile_header header;
+    cpl_wcfile *w;
+
+
+    assert (file_name);
+
+    w = cpl_wcfile_new ();
+    if (!w) return NULL;
+
+    w->fp = cpl_fopen (file_name, CPL_FOPEN_WRITE | CPL_FOPEN_BINARY);
+    if (!w->fp) {
+        cpl_free (w);
+        return NULL;
+    }
+
+    memcpy (header.magic, CPL_WCFILE_MAGIC, sizeof (header.magic));
+    header.version = CPL_WCFILE_VERSION;
+    header.byte_order = CPL_WCFILE_BYTE_ORDER;
+    header.format = format;
+    header.entry_size = sizeof (cpl_wcfile_entry);
+
+    cpl_wcfile_put (w, &header, sizeof (header));
+
+    return w;
+}
+
+
+/******************************************************************************
+*
+* cpl_wcfile_open - Open the water column file given by FILE_NAME for reading,
+*   which must hold datagrams of the CPL_WCFILE format FORMAT.  The index is
+*   read and checked, and the datagrams are read with cpl_wcfile_read().  The
+*   caller must call cpl_wcfile_close() to free the water column file.
+*
+* Return: A pointer to the water column file, or
+*         NULL if the file could not be opened, is not a valid water column
+*           file of the format, or memory allocation failed.
+*
+******************************************************************************/
+
+cpl_wcfile * cpl_wcfile_open (
+    const char *file_name,
+    const uint32_t format) {
+
+    cpl_wcfile_header header;
+    cpl_wcfile_trailer trailer;
+    cpl_wcfile_entry *e;
+    cpl_stat_t stbuf;
+    cpl_wcfile *w;
+    uint64_t file_size;
+    uint64_t offset;
+    size_t i;
+
+
+    assert (file_name);
+
+    w = cpl_wcfile_new ();
+    if (!w) return NULL;
+
+    w->fd = cpl_open (file_name, CPL_OPEN_RDONLY | CPL_OPEN_BINARY | CPL_OPEN_RANDOM);
+    if (w->fd < 0) {
+        cpl_free (w);
+        return NULL;
+    }
+
+    if ((cpl_fstat (w->fd, &stbuf) != 0) || (stbuf.file_size < (off_t) (sizeof (header) + sizeof (trailer)))) goto L1;
+
+    file_size = (uint64_t) stbuf.file_size;
+
+    if ((cpl_wcfile_get (w, &header, sizeof (header), 0) != CS_ENONE) ||
+        (cpl_wcfile_get (w, &trailer, sizeof (trailer), file_size - sizeof (trailer)) != CS_ENONE)) goto L1;
+
+    if ((memcmp (header.magic, CPL_WCFILE_MAGIC, sizeof (header.magic)) != 0) ||
+        (memcmp (trailer.magic, CPL_WCFILE_TRAILER_MAGIC, sizeof (trailer.magic)) != 0)) {
+        cpl_debug (cpl_lib_debug, "Invalid water column file\n");
+        goto L1;
+    }
+
+    if ((header.version != CPL_WCFILE_VERSION) || (header.byte_order != CPL_WCFILE_BYTE_ORDER) ||
+        (header.format != format) || (header.entry_size != sizeof (cpl_wcfile_entry))) {
+        cpl_debug (cpl_lib_debug, "Unsupported water column file (version=%u, format=%u)\n", header.version, header.format);
+        goto L1;
+    }
+
+    /* The index must fill the file between the blocks and the trailer. */
+    if ((trailer.index_offset < sizeof (header)) || (trailer.index_offset > file_size - sizeof (trailer)) ||
+        (trailer.num_entries != (file_size - sizeof (trailer) - trailer.index_offset) / sizeof (cpl_wcfile_entry)) ||
+        ((file_size - sizeof (trailer) - trailer.index_offset) % sizeof (cpl_wcfile_entry) != 0) ||
+        (trailer.num_entries > SIZE_MAX / sizeof (cpl_wcfile_entry))) {
+        cpl_debug (cpl_lib_debug, "Invalid water column file index\n");
+        goto L1;
+    }
+
+    w->num_entries = (size_t) trailer.num_entries;
+    if (w->num_entries > 0) {
+        w->entry = (cpl_wcfile_entry *) cpl_malloc (w->num_entries * sizeof (cpl_wcfile_entry));
+        if (!w->entry) goto L1;
+        w->entry_alloc = w->num_entries;
+
+        if (cpl_wcfile_get (w, w->entry, w->num_entries * sizeof (cpl_wcfile_entry), trailer.index_offset) != CS_ENONE) goto L1;
+    }
+
+    /* Make sure every block is within the file, so a block read never goes past the index. */
+    offset = sizeof (header);
+    for (i=0; i<w->num_entries; i++) {
+        e = &(w->entry[i]);
+        if ((e->offset < offset) || (e->offset > trailer.index_offset) || (e->block_size > trailer.index_offset - e->offset) ||
+            ((e->method != CPL_WCFILE_STORED) && (e->method != CPL_WCFILE_RANS)) ||
+            ((e->method == CPL_WCFILE_STORED) && (e->block_size != e->size))) {
+            cpl_debug (cpl_lib_debug, "Invalid water column file entry (%lu)\n", (unsigned long) i);
+            goto L1;
+        }
+        offset = e->offset + e->block_size;
+        if ((i > 0) && (e->time < w->entry[i-1].time)) w->sorted = 0;
+    }
+
+    return w;
+
+L1: cpl_wcfile_close (w);
+    return NULL;
+}
+
+
+/******************************************************************************
+*
+* cpl_wcfile_close - Close the water column file W and free it.  If the file
+*   was created, then the index and trailer are written first.
+*
+* Return: 0 if the file was closed successfully, or
+*         error condition if an error occurred, including any earlier write.
+*
+* Errors: CS_EWRITE
+*         CS_ECLOSE
+*
+******************************************************************************/
+
+int cpl_wcfile_close (
+    cpl_wcfile *w) {
+
+    cpl_wcfile_trailer trailer;
+    int status = CS_ENONE;
+
+
+    if (!w) return CS_ENONE;
+
+    if (w->fp) {
+        trailer.num_entries = w->num_entries;
+        trailer.index_offset = w->offset;
+        memcpy (trailer.magic, CPL_WCFILE_TRAILER_MAGIC, sizeof (trailer.magic));
+
+        if (w->num_entries > 0) {
+            cpl_wcfile_put (w, w->entry, w->num_entries * sizeof (cpl_wcfile_entry));
+        }
+
+        cpl_wcfile_put (w, &trailer, sizeof (trailer));
+
+        status = w->wc_errno;
+
+        if ((cpl_fclose (w->fp) != 0) && (status == CS_ENONE)) status = CS_ECLOSE;
+    } else if (w->fd >= 0) {
+        if (cpl_close (w->fd) != 0) status = CS_ECLOSE;
+    }
+
+    if (w->entry) cpl_free (w->entry);
+    if (w->block) cpl_free (w->block);
+    if (w->data) cpl_free (w->data);
+    cpl_free (w);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* cpl_wcfile_write - Add the datagram DATA of SIZE bytes with the TIME in ns
+*   since 1970-01-01 and the ping counter PING to the water column file W.  The
+*   datagram is rANS encoded unless it does not compress.
+*
+* Return: 0 if the datagram was written, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+int cpl_wcfile_write (
+    cpl_wcfile *w,
+    const void *data,
+    const size_t size,
+    const int64_t time,
+    const uint32_t ping) {
+
+    cpl_wcfile_entry *entry;
+    cpl_wcfile_entry *e;
+    const void *block;
+    size_t block_size;
+    size_t entry_alloc;
+    size_t alloc;
+    uint8_t *buffer;
+
+
+    assert (w);
+    assert (data);
+
+    if (!w->fp || (size > UINT32_MAX)) return CS_EINVAL;
+    if (w->wc_errno != CS_ENONE) return w->wc_errno;
+
+    if (w->num_entries == w->entry_alloc) {
+        entry_alloc = w->entry_alloc;
+        entry = (cpl_wcfile_entry *) cpl_realloc2 (w->entry, w->num_entries + 1, sizeof (cpl_wcfile_entry), &entry_alloc);
+        if (!entry) return CS_ENOMEM;
+        w->entry = entry;
+        w->entry_alloc = entry_alloc;
+    }
+
+    if (size > w->block_alloc) {
+        alloc = w->block_alloc;
+        buffer = (uint8_t *) cpl_realloc2 (w->block, size, sizeof (uint8_t), &alloc);
+        if (!buffer) return CS_ENOMEM;
+        w->block = buffer;
+        w->block_alloc = alloc;
+    }
+
+    e = &(w->entry[w->num_entries]);
+
+    memset (e, 0, sizeof (cpl_wcfile_entry));
+    e->offset = w->offset;
+    e->size = (uint32_t) size;
+    e->time = time;
+    e->ping = ping;
+
+    /* Encoding into fewer bytes than the datagram fails if it does not compress. */
+    if ((size > 0) && (cpl_rans_encode ((const uint8_t *) data, size, w->block, size - 1, &block_size) == CS_ENONE)) {
+        e->method = CPL_WCFILE_RANS;
+        block = w->block;
+    } else {
+        e->method = CPL_WCFILE_STORED;
+        block = data;
+        block_size = size;
+    }
+
+    e->block_size = (uint32_t) block_size;
+
+    if (cpl_wcfile_put (w, block, block_size) != CS_ENONE) return w->wc_errno;
+
+    if ((w->num_entries > 0) && (time < w->entry[w->num_entries-1].time)) w->sorted = 0;
+    w->num_entries++;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_wcfile_read - Read and decode the datagram of the entry number N of the
+*   water column file W, and set DATA to the decoded datagram, which has the
+*   size given by its entry.  The datagram is valid until the next call using
+*   W, and may be changed by the caller, such as to undo the delta coding.
+*
+* Return: 0 if the datagram was read, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EREAD
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+int cpl_wcfile_read (
+    cpl_wcfile *w,
+    const size_t n,
+    uint8_t **data) {
+
+    const cpl_wcfile_entry *e;
+    uint8_t *buffer;
+    size_t alloc;
+    int status;
+
+
+    assert (w);
+    assert (data);
+
+    if (w->fp || (n >= w->num_entries)) return CS_EINVAL;
+
+    e = &(w->entry[n]);
+
+    /* Allocate at least one byte, so an empty datagram still has a pointer. */
+    if (e->size >= w->data_alloc) {
+        alloc = w->data_alloc;
+        buffer = (uint8_t *) cpl_realloc2 (w->data, e->size, sizeof (uint8_t), &alloc);
+        if (!buffer) return CS_ENOMEM;
+        w->data = buffer;
+        w->data_alloc = alloc;
+    }
+
+    if (e->method == CPL_WCFILE_STORED) {
+        status = cpl_wcfile_get (w, w->data, e->size, e->offset);
+        if (status != CS_ENONE) return status;
+    } else {
+        if (e->block_size >= w->block_alloc) {
+            alloc = w->block_alloc;
+            buffer = (uint8_t *) cpl_realloc2 (w->block, e->block_size, sizeof (uint8_t), &alloc);
+            if (!buffer) return CS_ENOMEM;
+            w->block = buffer;
+            w->block_alloc = alloc;
+        }
+
+        status = cpl_wcfile_get (w, w->block, e->block_size, e->offset);
+        if (status != CS_ENONE) return status;
+
+        status = cpl_rans_decode (w->block, e->block_size, w->data, e->size);
+        if (status != CS_ENONE) return status;
+    }
+
+    *data = w->data;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_wcfile_get_num_entries - Return the number of datagrams of the water
+*   column file W.
+*
+******************************************************************************/
+
+size_t cpl_wcfile_get_num_entries (
+    const cpl_wcfile *w) {
+
+    assert (w);
+    return w->num_entries;
+}
+
+
+/******************************************************************************
+*
+* cpl_wcfile_get_entry - Return the index entry number N of the water column
+*   file W, or NULL if N is not a valid entry number.
+*
+******************************************************************************/
+
+const cpl_wcfile_entry * cpl_wcfile_get_entry (
+    const cpl_wcfile *w,
+    const size_t n) {
+
+    assert (w);
+
+    if (n >= w->num_entries) return NULL;
+    return &(w->entry[n]);
+}
+
+
+/******************************************************************************
+*
+* cpl_wcfile_find_time - Return the number of the first entry of the water
+*   column file W with a time at or after TIME in ns since 1970-01-01, or the
+*   number of entries if there is none.  The entries are in the order they were
+*   written, which is normally the time order of the pings, so the entries are
+*   searched with a binary search unless they are out of time order.
+*
+******************************************************************************/
+
+size_t cpl_wcfile_find_time (
+    const cpl_wcfile *w,
+    const int64_t time) {
+
+    size_t low, high, mid;
+    size_t i;
+
+
+    assert (w);
+
+    if (!w->sorted) {
+        for (i=0; i<w->num_entries; i++) {
+            if (w->entry[i].time >= time) break;
+        }
+
+        return i;
+    }
+
+    low = 0;
+    high = w->num_entries;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (w->entry[mid].time < time) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+
+/******************************************************************************
+*
+* cpl_wcfile_new - Allocate a water column file with no file open.
+*
+* Return: A pointer to the new water column file, or
+*         NULL if memory allocation failed.
+*
+******************************************************************************/
+
+static cpl_wcfile * cpl_wcfile_new (void) {
+
+    cpl_wcfile *w;
+
+
+    w = (cpl_wcfile *) cpl_malloc (sizeof (cpl_wcfile));
+    if (!w) return NULL;
+
+    w->fp = NULL;
+    w->fd = -1;
+    w->entry = NULL;
+    w->num_entries = 0;
+    w->entry_alloc = 0;
+    w->block = NULL;
+    w->block_alloc = 0;
+    w->data = NULL;
+    w->data_alloc = 0;
+    w->offset = 0;
+    w->sorted = 1;
+    w->wc_errno = CS_ENONE;
+
+    return w;
+}
+
+
+/******************************************************************************
+*
+* cpl_wcfile_put - Write SIZE bytes of DATA to the file of the water column
+*   file W.  The first error is kept, and nothing more is written after it.
+*
+* Return: 0 if the data was written, or
+*         CS_EWRITE if an error occurred.
+*
+******************************************************************************/
+
+static int cpl_wcfile_put (
+    cpl_wcfile *w,
+    const void *data,
+    const size_t size) {
+
+    assert (w);
+    assert (data);
+
+    if (w->wc_errno != CS_ENONE) return w->wc_errno;
+
+    if ((size > 0) && (fwrite (data, 1, size, w->fp) != size)) {
+        cpl_debug (cpl_lib_debug, "Failed to write water column data (%lu bytes)\n", (unsigned long) size);
+        w->wc_errno = CS_EWRITE;
+        return CS_EWRITE;
+    }
+
+    w->offset += size;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_wcfile_get - Read SIZE bytes of the water column file W at the file
+*   offset OFFSET into DATA, retrying any partial read.
+*
+* Return: 0 if the data was read, or
+*         CS_EREAD if an error occurred or the end of file was reached.
+*
+******************************************************************************/
+
+static int cpl_wcfile_get (
+    cpl_wcfile *w,
+    void *data,
+    const size_t size,
+    const uint64_t offset) {
+
+    ssize_t result;
+    size_t n = 0;
+
+
+    assert (w);
+    assert (data);
+
+    while (n < size) {
+        result = cpl_pread ((char *) data + n, size - n, w->fd, (off_t) (offset + n));
+        if (result <= 0) {
+            cpl_debug (cpl_lib_debug, "Failed to read water column data (%lu bytes)\n", (unsigned long) size);
+            return CS_EREAD;
+        }
+        n += (size_t) result;
+    }
+
+    return CS_ENONE;
+}
@@ -0,0 +1,71 @@
+/* cpl_wcfile.h -- Header file for cpl_wcfile.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#ifndef CPL_WCFILE_H
+#define CPL_WCFILE_H
+
+#if defined (__cplusplus)
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#define CPL_NEED_FIXED_WIDTH_T  /* Tell cpl_spec.h we need fixed-width types. */
+#include "cpl_spec.h"
+
+
+/* Water Column File Datagram Formats */
+#define CPL_WCFILE_KMA     1  /* KMA MWC datagrams.             */
+#define CPL_WCFILE_EMX     2  /* EMX water column datagrams.    */
+
+
+/* Water Column File Block Methods */
+#define CPL_WCFILE_STORED  0  /* Datagram is stored unencoded.  */
+#define CPL_WCFILE_RANS    1  /* Datagram is rANS encoded.      */
+
+
+/* Water Column File Index Entry (32 Bytes) */
+typedef struct {
+    uint64_t offset;                  /* File offset of the block.                 */
+    uint32_t block_size;              /* Size of the block in the file.            */
+    uint32_t size;                    /* Size of the decoded datagram.             */
+    int64_t time;                     /* Datagram time in ns since 1970-01-01.     */
+    uint32_t ping;                    /* Ping counter of the datagram.             */
+    uint8_t method;                   /* Block method CPL_WCFILE_STORED or _RANS.  */
+    uint8_t spare[3];                 /* Spare.                                    */
+} cpl_wcfile_entry;
+
+
+/* Opaque Water Column File Type */
+typedef struct cpl_wcfile_struct cpl_wcfile;
+
+
+/******************************* API Functions *******************************/
+
+CPL_CLINKAGE_START
+
+cpl_wcfile * cpl_wcfile_create (const char *, const uint32_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+cpl_wcfile * cpl_wcfile_open (const char *, const uint32_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int cpl_wcfile_close (cpl_wcfile *);
+int cpl_wcfile_write (cpl_wcfile *, const void *, const size_t, const int64_t, const uint32_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_wcfile_read (cpl_wcfile *, const size_t, uint8_t **) CPL_ATTRIBUTE_NONNULL_ALL;
+size_t cpl_wcfile_get_num_entries (const cpl_wcfile *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+const cpl_wcfile_entry * cpl_wcfile_get_entry (const cpl_wcfile *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+size_t cpl_wcfile_find_time (const cpl_wcfile *, const int64_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+
+CPL_CLINKAGE_END
+
+#endif /* CPL_WCFILE_H */
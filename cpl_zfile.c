@@ -0,0 +1,1247 @@
+/* cpl_zfile.c -- Seekable compressed file.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   File Format:
+   The CPLZFILE format is specific to this library and is not a zstd or gzip
+   file, even though its frames may hold zstd frames or zlib streams, so it
+   is only read by cpl_zfile_open_fd().  Standard .zst or .gz files can not be
+   opened and must be decompressed first.
+
+   The file is written in the byte order of the host, which is given in the
+   file header.  The data is split into frames of frame_size bytes, except for
+   a shorter last frame, and each frame is compressed with zstd or zlib if the
+   library is available, or else rANS encoded by cpl_rans_encode(), or is
+   stored unencoded if it does not compress.  The method is given by the index
+   entry of each frame.  Every frame is compressed on its own, so the frames
+   can be decoded in any order and in parallel.
+
+     File header (24 bytes)
+     Frames
+     Index entries (16 bytes each)
+     File trailer (32 bytes)
+
+   A reader finds the index from the trailer at the end of the file, so the
+   frame holding any offset of the decoded data is read with a single read.
+
+
+ Compiler Defines:
+   HAVE_ZSTD - Defined if the zstd library is available (link with -lzstd).
+   HAVE_ZLIB - Defined if the zlib library is available (link with -lz). */
+
+#include "config.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include "cpl_zfile.h"
+#include "cpl_rans.h"
+#include "cpl_alloc.h"
+#include "cpl_error.h"
+#include "cpl_debug.h"
+#include "cpl_file.h"
+#include "cpl_thread.h"
+
+#if defined (HAVE_ZSTD)
+# include <zstd.h>
+#endif
+
+#if defined (HAVE_ZLIB)
+# include <zlib.h>
+#endif
+
+
+/* Compressed File Magic Strings and Version */
+#define CPL_ZFILE_MAGIC          "CPLZFILE"
+#define CPL_ZFILE_TRAILER_MAGIC  "CPLZFEND"
+#define CPL_ZFILE_VERSION        1
+#define CPL_ZFILE_BYTE_ORDER     0x01020304
+
+
+/* Compressed File Frame Methods */
+#define CPL_ZFILE_STORED         0  /* Frame is stored unencoded.  */
+#define CPL_ZFILE_RANS           1  /* Frame is rANS encoded.      */
+#define CPL_ZFILE_ZLIB           2  /* Frame is a zlib stream.     */
+#define CPL_ZFILE_ZSTD           3  /* Frame is a zstd frame.      */
+
+
+/* Method Used for the Frames Written */
+#if defined (HAVE_ZSTD)
+# define CPL_ZFILE_METHOD        CPL_ZFILE_ZSTD
+#elif defined (HAVE_ZLIB)
+# define CPL_ZFILE_METHOD        CPL_ZFILE_ZLIB
+#else
+# define CPL_ZFILE_METHOD        CPL_ZFILE_RANS
+#endif
+
+
+/* Frame Number of a Slot Without a Frame */
+#define CPL_ZFILE_NO_FRAME       ((size_t) -1)
+
+
+/* Compressed File Header (24 Bytes) */
+typedef struct {
+    char magic[8];                    /* Magic string "CPLZFILE".           */
+    uint32_t version;                 /* Compressed file version.           */
+    uint32_t byte_order;              /* 0x01020304 in the file byte order. */
+    uint32_t frame_size;              /* Size of the decoded frames.        */
+    uint32_t entry_size;              /* Size of each index entry in bytes. */
+} cpl_zfile_header;
+
+
+/* Compressed File Index Entry (16 Bytes) */
+typedef struct {
+    uint64_t offset;                  /* File offset of the frame.          */
+    uint32_t block_size;              /* Size of the frame in the file.     */
+    uint32_t method;                  /* Frame method CPL_ZFILE_*.          */
+} cpl_zfile_entry;
+
+
+/* Compressed File Trailer (32 Bytes) */
+typedef struct {
+    uint64_t num_frames;              /* Number of index entries.           */
+    uint64_t index_offset;            /* File offset of the index.          */
+    uint64_t size;                    /* Size of the decoded data.          */
+    char magic[8];                    /* Magic string "CPLZFEND".           */
+} cpl_zfile_trailer;
+
+
+/* Frame Decoded Ahead of the Reader */
+typedef struct {
+    cpl_worker *worker;               /* Thread decoding the frame, or NULL.  */
+    size_t frame;                     /* Frame number, or CPL_ZFILE_NO_FRAME. */
+    uint8_t *data;                    /* Decoded frame.                       */
+    uint8_t *block;                   /* Encoded frame.                       */
+    int pending;                      /* Non-zero until the frame is waited.  */
+    int status;                       /* Error condition of the decoding.     */
+} cpl_zfile_slot;
+
+
+/* Compressed File */
+struct cpl_zfile_struct {
+    FILE *fp;                         /* File stream if writing, or NULL.     */
+    int fd;                           /* File descriptor if reading.          */
+    cpl_zfile_entry *entry;           /* Array of num_frames entries.         */
+    size_t num_frames;                /* Number of frames.                    */
+    size_t entry_alloc;               /* Allocated number of entries.         */
+    size_t frame_size;                /* Size of the decoded frames.          */
+    size_t max_block_size;            /* Largest frame in the file.           */
+    uint64_t size;                    /* Size of the decoded data.            */
+    uint8_t *frame;                   /* Frame being written.                 */
+    size_t frame_used;                /* Number of bytes in the frame.        */
+    uint8_t *block;                   /* Encoded frame being written.         */
+    uint64_t offset;                  /* File offset of the next write.       */
+    cpl_zfile_slot *slot;             /* Frames decoded ahead, or NULL.       */
+    size_t num_slots;                 /* Number of slots.                     */
+    size_t threads;                   /* Number of decoding threads.          */
+    size_t head;                      /* Slot of the frame being read.        */
+    size_t next;                      /* Next frame to decode.                */
+    uint64_t position;                /* Offset of the next byte to read.     */
+    int z_errno;                      /* Error condition of the last write.   */
+};
+
+
+/* External Variable */
+extern int cpl_lib_debug;
+
+
+/* Private Function Prototypes */
+static cpl_zfile * cpl_zfile_new (void) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+static int cpl_zfile_flush (cpl_zfile *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_zfile_put (cpl_zfile *, const void *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_zfile_get (const cpl_zfile *, void *, const size_t, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static size_t cpl_zfile_frame_length (const cpl_zfile *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static int cpl_zfile_start (cpl_zfile *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void cpl_zfile_stop (cpl_zfile *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void cpl_zfile_submit (cpl_zfile *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_zfile_wait (cpl_zfile *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void cpl_zfile_restart (cpl_zfile *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void cpl_zfile_advance (cpl_zfile *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_zfile_encode (const uint8_t *, const size_t, uint8_t *, const size_t, size_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_zfile_decode (const uint32_t, const uint8_t *, const size_t, uint8_t *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int cpl_zfile_have_method (const uint32_t) CPL_ATTRIBUTE_CONST;
+static void cpl_zfile_decode_task (void *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
+
+
+/******************************************************************************
+*
+* cpl_zfile_create - Create the compressed file given by FILE_NAME with decoded
+*   frames of FRAME_SIZE bytes.  If FRAME_SIZE is zero, then CPL_ZFILE_FRAME_SIZE
+*   is used.  Smaller frames make a seek faster, and larger frames compress
+*   slightly better.  The frames are compressed with zstd if HAVE_ZSTD is
+*   defined, or with zlib if HAVE_ZLIB is defined, or else rANS encoded, and a
+*   reader must be built with the same library.  The data is added with
+*   cpl_zfile_write().  The caller must call cpl_zfile_close() to finish the
+*   file and free the compressed file.
+*
+* Return: A pointer to the new compressed file, or
+*         NULL if the file could not be created or memory allocation failed.
+*
+******************************************************************************/
+
+cpl_zfile * cpl_zfile_create (
+    const char *file_name,
+    const size_t frame_size) {
+
+    cpl_zfile_header header;
+    cpl_zfile *z;
+
+
+    assert (file_name);
+
+    assert (sizeof (cpl_zfile_header) == CPL_ZFILE_HEADER_SIZE);
+    assert (sizeof (cpl_zfile_entry) == 16);
+    assert (sizeof (cpl_zfile_trailer) == 32);
+
+    if (frame_size > UINT32_MAX) return NULL;
+
+    z = cpl_zfile_new ();
+    if (!z) return NULL;
+
+    z->frame_size = frame_size > 0 ? frame_size : CPL_ZFILE_FRAME_SIZE;
+
+    z->frame = (uint8_t *) cpl_malloc (z->frame_size);
+    z->block = (uint8_t *) cpl_malloc (z->frame_size);
+    if (!z->frame || !z->block) goto L1;
+
+    z->fp = cpl_fopen (file_name, CPL_FOPEN_WRITE | CPL_FOPEN_BINARY);
+    if (!z->fp) goto L1;
+
+    memcpy (header.magic, CPL_ZFILE_MAGIC, sizeof (header.magic));
+    header.version = CPL_ZFILE_VERSION;
+    header.byte_order = CPL_ZFILE_BYTE_ORDER;
+    header.frame_size = (uint32_t) z->frame_size;
+    header.entry_size = sizeof (cpl_zfile_entry);
+
+    cpl_zfile_put (z, &header, sizeof (header));
+
+    return z;
+
+L1: cpl_zfile_close (z);
+    return NULL;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_write - Add the SIZE bytes DATA to the compressed file Z.  Each
+*   frame is encoded and written when it is full.
+*
+* Return: 0 if the data was added, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+int cpl_zfile_write (
+    cpl_zfile *z,
+    const void *data,
+    const size_t size) {
+
+    const uint8_t *p = (const uint8_t *) data;
+    size_t remaining = size;
+    size_t n;
+
+
+    assert (z);
+    assert (data);
+
+    if (!z->fp) return CS_EINVAL;
+    if (z->z_errno != CS_ENONE) return z->z_errno;
+
+    while (remaining > 0) {
+        n = z->frame_size - z->frame_used;
+        if (n > remaining) n = remaining;
+
+        memcpy (z->frame + z->frame_used, p, n);
+        z->frame_used += n;
+        p += n;
+        remaining -= n;
+
+        if ((z->frame_used == z->frame_size) && (cpl_zfile_flush (z) != CS_ENONE)) return z->z_errno;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_compress - Compress the file given by IN_NAME to the compressed file
+*   given by OUT_NAME with decoded frames of FRAME_SIZE bytes, or of
+*   CPL_ZFILE_FRAME_SIZE bytes if FRAME_SIZE is zero.
+*
+* Return: 0 if the file was compressed, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EOPEN
+*         CS_ENOMEM
+*         CS_EREAD
+*         CS_EWRITE
+*         CS_ECLOSE
+*
+******************************************************************************/
+
+int cpl_zfile_compress (
+    const char *in_name,
+    const char *out_name,
+    const size_t frame_size) {
+
+    cpl_zfile *z;
+    ssize_t result;
+    char *buffer;
+    int status = CS_ENONE;
+    int fd;
+
+
+    assert (in_name);
+    assert (out_name);
+
+    fd = cpl_open (in_name, CPL_OPEN_RDONLY | CPL_OPEN_BINARY | CPL_OPEN_SEQUENTIAL);
+    if (fd < 0) {
+        cpl_debug (cpl_lib_debug, "Failed to open file '%s'\n", in_name);
+        return CS_EOPEN;
+    }
+
+    buffer = (char *) cpl_malloc (CPL_BFILE_BLOCK_SIZE);
+    if (!buffer) {
+        cpl_close (fd);
+        return CS_ENOMEM;
+    }
+
+    z = cpl_zfile_create (out_name, frame_size);
+    if (!z) {
+        cpl_debug (cpl_lib_debug, "Failed to create file '%s'\n", out_name);
+        cpl_free (buffer);
+        cpl_close (fd);
+        return CS_EOPEN;
+    }
+
+    while (status == CS_ENONE) {
+        result = cpl_read (buffer, CPL_BFILE_BLOCK_SIZE, fd);
+        if (result < 0) {
+            cpl_debug (cpl_lib_debug, "Read error occurred for file '%s'\n", in_name);
+            status = CS_EREAD;
+            break;
+        }
+        if (result == 0) break;
+
+        status = cpl_zfile_write (z, buffer, (size_t) result);
+    }
+
+    if ((cpl_zfile_close (z) != CS_ENONE) && (status == CS_ENONE)) status = CS_EWRITE;
+
+    cpl_free (buffer);
+    cpl_close (fd);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_open_fd - Open the compressed file of the open file descriptor FD
+*   for reading, with THREADS frames decoded ahead of the reader on as many
+*   threads.  If THREADS is zero, then each frame is decoded by the reading
+*   thread when it is needed.  The index is read and checked, and the decoded
+*   data is read with cpl_zfile_read() starting at offset zero.  The file is
+*   only read with pread(), so the file position of FD is not changed.  The
+*   caller must call cpl_zfile_close() to free the compressed file, which does
+*   not close FD.
+*
+* Return: A pointer to the compressed file, or
+*         NULL if FD is not a valid compressed file or memory allocation failed.
+*
+******************************************************************************/
+
+cpl_zfile * cpl_zfile_open_fd (
+    const int fd,
+    const size_t threads) {
+
+    cpl_zfile_header header;
+    cpl_zfile_trailer trailer;
+    cpl_zfile_entry *e;
+    cpl_stat_t stbuf;
+    cpl_zfile *z;
+    uint64_t file_size;
+    uint64_t offset;
+    size_t i, n;
+
+
+    if (fd < 0) return NULL;
+
+    z = cpl_zfile_new ();
+    if (!z) return NULL;
+
+    z->fd = fd;
+    z->threads = threads > CPL_THREAD_MAX ? CPL_THREAD_MAX : threads;
+
+    if ((cpl_fstat (fd, &stbuf) != 0) || (stbuf.file_size < (off_t) (sizeof (header) + sizeof (trailer)))) goto L1;
+
+    file_size = (uint64_t) stbuf.file_size;
+
+    if ((cpl_zfile_get (z, &header, sizeof (header), 0) != CS_ENONE) ||
+        (cpl_zfile_get (z, &trailer, sizeof (trailer), file_size - sizeof (trailer)) != CS_ENONE)) goto L1;
+
+    if ((memcmp (header.magic, CPL_ZFILE_MAGIC, sizeof (header.magic)) != 0) ||
+        (memcmp (trailer.magic, CPL_ZFILE_TRAILER_MAGIC, sizeof (trailer.magic)) != 0)) {
+        cpl_debug (cpl_lib_debug, "Invalid compressed file\n");
+        goto L1;
+    }
+
+    if ((header.version != CPL_ZFILE_VERSION) || (header.byte_order != CPL_ZFILE_BYTE_ORDER) ||
+        (header.entry_size != sizeof (cpl_zfile_entry)) || (header.frame_size == 0)) {
+        cpl_debug (cpl_lib_debug, "Unsupported compressed file (version=%u)\n", header.version);
+        goto L1;
+    }
+
+    /* The index must fill the file between the frames and the trailer, and
+       there must be exactly one frame for each frame_size bytes of data. */
+    if ((trailer.index_offset < sizeof (header)) || (trailer.index_offset > file_size - sizeof (trailer)) ||
+        (trailer.num_frames != (file_size - sizeof (trailer) - trailer.index_offset) / sizeof (cpl_zfile_entry)) ||
+        ((file_size - sizeof (trailer) - trailer.index_offset) % sizeof (cpl_zfile_entry) != 0) ||
+        (trailer.num_frames > SIZE_MAX / sizeof (cpl_zfile_entry)) ||
+        (trailer.num_frames != trailer.size / header.frame_size + (trailer.size % header.frame_size != 0))) {
+        cpl_debug (cpl_lib_debug, "Invalid compressed file index\n");
+        goto L1;
+    }
+
+    z->frame_size = header.frame_size;
+    z->size = trailer.size;
+    z->num_frames = (size_t) trailer.num_frames;
+
+    if (z->num_frames > 0) {
+        z->entry = (cpl_zfile_entry *) cpl_malloc (z->num_frames * sizeof (cpl_zfile_entry));
+        if (!z->entry) goto L1;
+        z->entry_alloc = z->num_frames;
+
+        if (cpl_zfile_get (z, z->entry, z->num_frames * sizeof (cpl_zfile_entry), trailer.index_offset) != CS_ENONE) goto L1;
+    }
+
+    /* Make sure every frame is within the file, so a frame read never goes past the index. */
+    offset = sizeof (header);
+    for (i=0; i<z->num_frames; i++) {
+        e = &(z->entry[i]);
+        n = cpl_zfile_frame_length (z, i);
+        if ((e->offset < offset) || (e->offset > trailer.index_offset) || (e->block_size > trailer.index_offset - e->offset) ||
+            ((e->method == CPL_ZFILE_STORED) && (e->block_size != n))) {
+            cpl_debug (cpl_lib_debug, "Invalid compressed file entry (%lu)\n", (unsigned long) i);
+            goto L1;
+        }
+        if (!cpl_zfile_have_method (e->method)) {
+            cpl_debug (cpl_lib_debug, "Unsupported compressed frame method (%u)\n", e->method);
+            goto L1;
+        }
+        if (e->block_size > z->max_block_size) z->max_block_size = e->block_size;
+        offset = e->offset + e->block_size;
+    }
+
+    return z;
+
+L1: z->fd = -1;
+    cpl_zfile_close (z);
+    return NULL;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_close - Close the compressed file Z and free it.  If the file was
+*   created, then the last frame, the index, and the trailer are written first.
+*   The file descriptor of a file opened by cpl_zfile_open_fd() is not closed.
+*
+* Return: 0 if the file was closed successfully, or
+*         error condition if an error occurred, including any earlier write.
+*
+* Errors: CS_EWRITE
+*         CS_ECLOSE
+*
+******************************************************************************/
+
+int cpl_zfile_close (
+    cpl_zfile *z) {
+
+    cpl_zfile_trailer trailer;
+    int status = CS_ENONE;
+
+
+    if (!z) return CS_ENONE;
+
+    if (z->fp) {
+        if (z->frame_used > 0) cpl_zfile_flush (z);
+
+        trailer.num_frames = z->num_frames;
+        trailer.index_offset = z->offset;
+        trailer.size = z->size;
+        memcpy (trailer.magic, CPL_ZFILE_TRAILER_MAGIC, sizeof (trailer.magic));
+
+        if (z->num_frames > 0) {
+            cpl_zfile_put (z, z->entry, z->num_frames * sizeof (cpl_zfile_entry));
+        }
+
+        cpl_zfile_put (z, &trailer, sizeof (trailer));
+
+        status = z->z_errno;
+
+        if ((cpl_fclose (z->fp) != 0) && (status == CS_ENONE)) status = CS_ECLOSE;
+    }
+
+    cpl_zfile_stop (z);
+
+    if (z->entry) cpl_free (z->entry);
+    if (z->frame) cpl_free (z->frame);
+    if (z->block) cpl_free (z->block);
+    cpl_free (z);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_read - Read up to SIZE bytes of the decoded data of the compressed
+*   file Z at the current position into BUFFER.  At most the rest of the frame
+*   at the position is returned.  When a frame has been read, its slot decodes
+*   the frame after the last one queued, so the threads stay busy while the
+*   file is read in order.
+*
+* Return: The number of bytes read, which is zero only at the end of the data,
+*           or
+*        -1 if an error occurred (errno is ENOMEM if memory allocation failed,
+*           or EIO if a frame could not be read or is corrupt).
+*
+******************************************************************************/
+
+ssize_t cpl_zfile_read (
+    cpl_zfile *z,
+    void *buffer,
+    const size_t size) {
+
+    cpl_zfile_slot *s;
+    size_t frame;
+    size_t skip;
+    size_t n;
+
+
+    assert (z);
+    assert (buffer);
+
+    if (z->fp) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((size == 0) || (z->position >= z->size)) return 0;
+
+    if (!z->slot && (cpl_zfile_start (z) != 0)) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    frame = (size_t) (z->position / z->frame_size);
+
+    /* Pass the frames before the position that are already queued after a seek forward. */
+    while ((z->slot[z->head].frame < frame) && (frame < z->next)) {
+        cpl_zfile_wait (z, z->head);
+        cpl_zfile_advance (z);
+    }
+
+    if (z->slot[z->head].frame != frame) cpl_zfile_restart (z, frame);
+
+    if (cpl_zfile_wait (z, z->head) != CS_ENONE) {
+        errno = EIO;
+        return -1;
+    }
+
+    s = &(z->slot[z->head]);
+
+    skip = (size_t) (z->position - (uint64_t) frame * z->frame_size);
+    n = cpl_zfile_frame_length (z, frame) - skip;
+    if (n > size) n = size;
+
+    memcpy (buffer, s->data + skip, n);
+    z->position += n;
+
+    if (skip + n == cpl_zfile_frame_length (z, frame)) cpl_zfile_advance (z);
+
+    return (ssize_t) n;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_seek - Set the position of the next byte read from the compressed
+*   file Z to the offset OFFSET of the decoded data.  The queued frames are kept
+*   if they include the offset.
+*
+* Return: 0 if the position was set, or
+*        -1 if the offset is past the end of the data.
+*
+******************************************************************************/
+
+int cpl_zfile_seek (
+    cpl_zfile *z,
+    const uint64_t offset) {
+
+    assert (z);
+
+    if (offset > z->size) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    z->position = offset;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_set_threads - Decode THREADS frames ahead of the reader of the
+*   compressed file Z on as many threads, or decode each frame when it is
+*   needed if THREADS is zero.  The change takes effect on the next read.
+*
+******************************************************************************/
+
+void cpl_zfile_set_threads (
+    cpl_zfile *z,
+    const size_t threads) {
+
+    assert (z);
+
+    cpl_zfile_stop (z);
+    z->threads = threads > CPL_THREAD_MAX ? CPL_THREAD_MAX : threads;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_get_size - Return the size of the decoded data of the compressed
+*   file Z.
+*
+******************************************************************************/
+
+uint64_t cpl_zfile_get_size (
+    const cpl_zfile *z) {
+
+    assert (z);
+    return z->size;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_get_num_frames - Return the number of frames of the compressed file
+*   Z.
+*
+******************************************************************************/
+
+size_t cpl_zfile_get_num_frames (
+    const cpl_zfile *z) {
+
+    assert (z);
+    return z->num_frames;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_identify_data - Determine if the SIZE bytes DATA at the start of a
+*   file are the start of a compressed file.
+*
+* Return: 1 if the data starts with the compressed file header, or
+*         0 if it does not.
+*
+******************************************************************************/
+
+int cpl_zfile_identify_data (
+    const void *data,
+    const size_t size) {
+
+    assert (data || (size == 0));
+
+    if (size < CPL_ZFILE_HEADER_SIZE) return 0;
+
+    return memcmp (data, CPL_ZFILE_MAGIC, strlen (CPL_ZFILE_MAGIC)) == 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_new - Allocate a compressed file with no file open.
+*
+* Return: A pointer to the new compressed file, or
+*         NULL if memory allocation failed.
+*
+******************************************************************************/
+
+static cpl_zfile * cpl_zfile_new (void) {
+
+    cpl_zfile *z;
+
+
+    z = (cpl_zfile *) cpl_malloc (sizeof (cpl_zfile));
+    if (!z) return NULL;
+
+    z->fp = NULL;
+    z->fd = -1;
+    z->entry = NULL;
+    z->num_frames = 0;
+    z->entry_alloc = 0;
+    z->frame_size = 0;
+    z->max_block_size = 0;
+    z->size = 0;
+    z->frame = NULL;
+    z->frame_used = 0;
+    z->block = NULL;
+    z->offset = 0;
+    z->slot = NULL;
+    z->num_slots = 0;
+    z->threads = 0;
+    z->head = 0;
+    z->next = 0;
+    z->position = 0;
+    z->z_errno = CS_ENONE;
+
+    return z;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_flush - Encode the frame being written to the compressed file Z,
+*   write it, and add its index entry.  The frame is stored unencoded if it
+*   does not compress into fewer bytes.
+*
+* Return: 0 if the frame was written, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+static int cpl_zfile_flush (
+    cpl_zfile *z) {
+
+    cpl_zfile_entry *entry;
+    cpl_zfile_entry *e;
+    const void *block;
+    size_t block_size;
+    size_t entry_alloc;
+
+
+    assert (z);
+
+    if (z->z_errno != CS_ENONE) return z->z_errno;
+
+    if (z->num_frames == z->entry_alloc) {
+        entry_alloc = z->entry_alloc;
+        entry = (cpl_zfile_entry *) cpl_realloc2 (z->entry, z->num_frames + 1, sizeof (cpl_zfile_entry), &entry_alloc);
+        if (!entry) {
+            z->z_errno = CS_ENOMEM;
+            return CS_ENOMEM;
+        }
+        z->entry = entry;
+        z->entry_alloc = entry_alloc;
+    }
+
+    e = &(z->entry[z->num_frames]);
+    e->offset = z->offset;
+
+    /* Encoding into fewer bytes than the frame fails if it does not compress. */
+    if (cpl_zfile_encode (z->frame, z->frame_used, z->block, z->frame_used - 1, &block_size) == CS_ENONE) {
+        e->method = CPL_ZFILE_METHOD;
+        block = z->block;
+    } else {
+        e->method = CPL_ZFILE_STORED;
+        block = z->frame;
+        block_size = z->frame_used;
+    }
+
+    e->block_size = (uint32_t) block_size;
+
+    if (cpl_zfile_put (z, block, block_size) != CS_ENONE) return z->z_errno;
+
+    z->num_frames++;
+    z->size += z->frame_used;
+    z->frame_used = 0;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_put - Write SIZE bytes of DATA to the file of the compressed file Z.
+*   The first error is kept, and nothing more is written after it.
+*
+* Return: 0 if the data was written, or
+*         CS_EWRITE if an error occurred.
+*
+******************************************************************************/
+
+static int cpl_zfile_put (
+    cpl_zfile *z,
+    const void *data,
+    const size_t size) {
+
+    assert (z);
+    assert (data);
+
+    if (z->z_errno != CS_ENONE) return z->z_errno;
+
+    if ((size > 0) && (fwrite (data, 1, size, z->fp) != size)) {
+        cpl_debug (cpl_lib_debug, "Failed to write compressed data (%lu bytes)\n", (unsigned long) size);
+        z->z_errno = CS_EWRITE;
+        return CS_EWRITE;
+    }
+
+    z->offset += size;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_get - Read SIZE bytes of the compressed file Z at the file offset
+*   OFFSET into DATA, retrying any partial read.  This is called by the
+*   decoding threads, so it only reads the file with pread().
+*
+* Return: 0 if the data was read, or
+*         CS_EREAD if an error occurred or the end of file was reached.
+*
+******************************************************************************/
+
+static int cpl_zfile_get (
+    const cpl_zfile *z,
+    void *data,
+    const size_t size,
+    const uint64_t offset) {
+
+    ssize_t result;
+    size_t n = 0;
+
+
+    assert (z);
+    assert (data);
+
+    while (n < size) {
+        result = cpl_pread ((char *) data + n, size - n, z->fd, (off_t) (offset + n));
+        if (result <= 0) {
+            cpl_debug (cpl_lib_debug, "Failed to read compressed data (%lu bytes)\n", (unsigned long) size);
+            return CS_EREAD;
+        }
+        n += (size_t) result;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_frame_length - Return the decoded size of the frame number N of the
+*   compressed file Z, which is the frame size except for the last frame.
+*
+******************************************************************************/
+
+static size_t cpl_zfile_frame_length (
+    const cpl_zfile *z,
+    const size_t n) {
+
+    uint64_t start;
+
+
+    assert (z);
+
+    start = (uint64_t) n * z->frame_size;
+
+    return z->size - start < z->frame_size ? (size_t) (z->size - start) : z->frame_size;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_start - Allocate the slots of the frames decoded ahead of the reader
+*   of the compressed file Z and start their threads.  If a thread can not be
+*   created, then its slot is decoded by the reading thread.
+*
+* Return: 0 if the slots were allocated, or
+*        -1 if memory allocation failed.
+*
+******************************************************************************/
+
+static int cpl_zfile_start (
+    cpl_zfile *z) {
+
+    cpl_zfile_slot *s;
+    size_t i;
+
+
+    assert (z);
+    assert (!z->slot);
+
+    z->num_slots = z->threads > 0 ? z->threads : 1;
+
+    z->slot = (cpl_zfile_slot *) cpl_calloc (z->num_slots, sizeof (cpl_zfile_slot));
+    if (!z->slot) {
+        z->num_slots = 0;
+        return -1;
+    }
+
+    for (i=0; i<z->num_slots; i++) {
+        s = &(z->slot[i]);
+        s->frame = CPL_ZFILE_NO_FRAME;
+
+        /* Allocate at least one byte, so an empty data block still has a pointer. */
+        s->data = (uint8_t *) cpl_malloc (z->frame_size);
+        s->block = (uint8_t *) cpl_malloc (z->max_block_size > 0 ? z->max_block_size : 1);
+        if (!s->data || !s->block) {
+            cpl_debug (cpl_lib_debug, "Failed to allocate %lu decoded frames\n", (unsigned long) z->num_slots);
+            cpl_zfile_stop (z);
+            return -1;
+        }
+
+        if (z->threads > 0) s->worker = cpl_worker_create ();
+    }
+
+    z->head = 0;
+    z->next = 0;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_stop - Wait for the frames being decoded for the compressed file Z,
+*   stop the threads, and free the slots.
+*
+******************************************************************************/
+
+static void cpl_zfile_stop (
+    cpl_zfile *z) {
+
+    cpl_zfile_slot *s;
+    size_t i;
+
+
+    assert (z);
+
+    if (!z->slot) return;
+
+    for (i=0; i<z->num_slots; i++) {
+        s = &(z->slot[i]);
+        if (s->worker) cpl_worker_destroy (s->worker);
+        if (s->data) cpl_free (s->data);
+        if (s->block) cpl_free (s->block);
+    }
+
+    cpl_free (z->slot);
+
+    z->slot = NULL;
+    z->num_slots = 0;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_submit - Start decoding the next frame of the compressed file Z in
+*   the slot number N, or leave the slot empty after the last frame.
+*
+******************************************************************************/
+
+static void cpl_zfile_submit (
+    cpl_zfile *z,
+    const size_t n) {
+
+    cpl_zfile_slot *s;
+
+
+    assert (z);
+    assert (n < z->num_slots);
+
+    s = &(z->slot[n]);
+
+    if (z->next >= z->num_frames) {
+        s->frame = CPL_ZFILE_NO_FRAME;
+        return;
+    }
+
+    s->frame = z->next++;
+    s->pending = 1;
+    s->status = CS_ENONE;
+
+    if (s->worker) cpl_worker_start (s->worker, cpl_zfile_decode_task, z, n);
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_wait - Wait until the frame in the slot number N of the compressed
+*   file Z is decoded.  A slot without a thread is decoded now.
+*
+* Return: 0 if the frame was decoded, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EREAD
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+static int cpl_zfile_wait (
+    cpl_zfile *z,
+    const size_t n) {
+
+    cpl_zfile_slot *s;
+
+
+    assert (z);
+    assert (n < z->num_slots);
+
+    s = &(z->slot[n]);
+
+    if (s->pending) {
+        if (s->worker) {
+            cpl_worker_wait (s->worker);
+        } else {
+            cpl_zfile_decode_task (z, n);
+        }
+        s->pending = 0;
+    }
+
+    return s->status;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_restart - Wait for the frames being decoded for the compressed file
+*   Z, and queue the frames starting with the frame number FRAME in all slots.
+*
+******************************************************************************/
+
+static void cpl_zfile_restart (
+    cpl_zfile *z,
+    const size_t frame) {
+
+    size_t i;
+
+
+    assert (z);
+
+    for (i=0; i<z->num_slots; i++) {
+        cpl_zfile_wait (z, i);
+    }
+
+    z->head = 0;
+    z->next = frame;
+
+    for (i=0; i<z->num_slots; i++) {
+        cpl_zfile_submit (z, i);
+    }
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_advance - Reuse the slot of the frame that has been read from the
+*   compressed file Z for the next frame, and move to the following slot.  The
+*   frame in the slot must already be waited for.
+*
+******************************************************************************/
+
+static void cpl_zfile_advance (
+    cpl_zfile *z) {
+
+    assert (z);
+    assert (!z->slot[z->head].pending);
+
+    cpl_zfile_submit (z, z->head);
+    z->head = (z->head + 1) % z->num_slots;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_decode_task - Read and decode the frame in the slot number N of the
+*   compressed file ARG, and store the result in the status of the slot.  This
+*   is the task of the decoding threads, so it only uses memory of the slot.
+*
+******************************************************************************/
+
+static void cpl_zfile_decode_task (
+    void *arg,
+    const size_t n) {
+
+    cpl_zfile *z = (cpl_zfile *) arg;
+    const cpl_zfile_entry *e;
+    cpl_zfile_slot *s;
+    size_t length;
+
+
+    assert (z);
+
+    s = &(z->slot[n]);
+    e = &(z->entry[s->frame]);
+    length = cpl_zfile_frame_length (z, s->frame);
+
+    if (e->method == CPL_ZFILE_STORED) {
+        s->status = cpl_zfile_get (z, s->data, length, e->offset);
+        return;
+    }
+
+    s->status = cpl_zfile_get (z, s->block, e->block_size, e->offset);
+    if (s->status != CS_ENONE) return;
+
+    s->status = cpl_zfile_decode (e->method, s->block, e->block_size, s->data, length);
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_encode - Compress the SIZE bytes DATA with CPL_ZFILE_METHOD to the
+*   buffer BLOCK of MAX_SIZE bytes, and return the size of the compressed data
+*   in BLOCK_SIZE.
+*
+* Return: 0 if the data was compressed, or
+*         CS_EOVERFLOW if the compressed data is larger than MAX_SIZE bytes.
+*
+******************************************************************************/
+
+static int cpl_zfile_encode (
+    const uint8_t *data,
+    const size_t size,
+    uint8_t *block,
+    const size_t max_size,
+    size_t *block_size) {
+
+#if defined (HAVE_ZSTD)
+    size_t result;
+#elif defined (HAVE_ZLIB)
+    uLongf n;
+#endif
+
+
+    assert (data);
+    assert (block);
+    assert (block_size);
+
+#if defined (HAVE_ZSTD)
+    result = ZSTD_compress (block, max_size, data, size, ZSTD_CLEVEL_DEFAULT);
+    if (ZSTD_isError (result)) return CS_EOVERFLOW;
+
+    *block_size = result;
+    return CS_ENONE;
+#elif defined (HAVE_ZLIB)
+    n = (uLongf) max_size;
+    if (compress2 ((Bytef *) block, &n, (const Bytef *) data, (uLong) size, Z_DEFAULT_COMPRESSION) != Z_OK) return CS_EOVERFLOW;
+
+    *block_size = (size_t) n;
+    return CS_ENONE;
+#else
+    return cpl_rans_encode (data, size, block, max_size, block_size);
+#endif
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_decode - Decode the BLOCK_SIZE bytes BLOCK of a frame compressed
+*   with the method METHOD to the SIZE bytes DATA.  The decoded data must be
+*   exactly SIZE bytes.
+*
+* Return: 0 if the frame was decoded, or
+*         CS_EBADDATA if the frame is corrupt or the method is not supported.
+*
+******************************************************************************/
+
+static int cpl_zfile_decode (
+    const uint32_t method,
+    const uint8_t *block,
+    const size_t block_size,
+    uint8_t *data,
+    const size_t size) {
+
+#if defined (HAVE_ZSTD)
+    size_t result;
+#endif
+#if defined (HAVE_ZLIB)
+    uLongf n;
+#endif
+
+
+    assert (block);
+    assert (data);
+
+    if (method == CPL_ZFILE_RANS) return cpl_rans_decode (block, block_size, data, size);
+
+#if defined (HAVE_ZSTD)
+    if (method == CPL_ZFILE_ZSTD) {
+        result = ZSTD_decompress (data, size, block, block_size);
+        if (ZSTD_isError (result) || (result != size)) {
+            cpl_debug (cpl_lib_debug, "Corrupt zstd frame\n");
+            return CS_EBADDATA;
+        }
+        return CS_ENONE;
+    }
+#endif
+
+#if defined (HAVE_ZLIB)
+    if (method == CPL_ZFILE_ZLIB) {
+        n = (uLongf) size;
+        if ((uncompress ((Bytef *) data, &n, (const Bytef *) block, (uLong) block_size) != Z_OK) || (n != size)) {
+            cpl_debug (cpl_lib_debug, "Corrupt zlib frame\n");
+            return CS_EBADDATA;
+        }
+        return CS_ENONE;
+    }
+#endif
+
+    return CS_EBADDATA;
+}
+
+
+/******************************************************************************
+*
+* cpl_zfile_have_method - Determine if frames of the method METHOD can be read.
+*
+* Return: 1 if the method is supported, or
+*         0 if it is not.
+*
+******************************************************************************/
+
+static int cpl_zfile_have_method (
+    const uint32_t method) {
+
+    if ((method == CPL_ZFILE_STORED) || (method == CPL_ZFILE_RANS)) return 1;
+
+#if defined (HAVE_ZSTD)
+    if (method == CPL_ZFILE_ZSTD) return 1;
+#endif
+
+#if defined (HAVE_ZLIB)
+    if (method == CPL_ZFILE_ZLIB) return 1;
+#endif
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+/* cpl_zfile.h -- Header file for cpl_zfile.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#ifndef CPL_ZFILE_H
+#define CPL_ZFILE_H
+
+#if defined (__cplusplus)
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#define CPL_NEED_FIXED_WIDTH_T  /* Tell cpl_spec.h we need fixed-width types. */
+#include "cpl_spec.h"
+#include "cpl_file.h"
+
+
+/* Size of the Compressed File Header */
+#define CPL_ZFILE_HEADER_SIZE  24
+
+
+/* Default Size of the Decoded Frames */
+#define CPL_ZFILE_FRAME_SIZE   (1<<20)
+
+
+/* Default Number of Threads Decoding Frames Ahead of the Reader */
+#define CPL_ZFILE_THREADS      4
+
+
+/* Opaque Compressed File Type */
+typedef struct cpl_zfile_struct cpl_zfile;
+
+
+/******************************* API Functions *******************************/
+
+CPL_CLINKAGE_START
+
+cpl_zfile * cpl_zfile_create (const char *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int cpl_zfile_write (cpl_zfile *, const void *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_zfile_compress (const char *, const char *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+cpl_zfile * cpl_zfile_open_fd (const int, const size_t) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int cpl_zfile_close (cpl_zfile *);
+ssize_t cpl_zfile_read (cpl_zfile *, void *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int cpl_zfile_seek (cpl_zfile *, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+void cpl_zfile_set_threads (cpl_zfile *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+uint64_t cpl_zfile_get_size (const cpl_zfile *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+size_t cpl_zfile_get_num_frames (const cpl_zfile *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+int cpl_zfile_identify_data (const void *, const size_t) CPL_ATTRIBUTE_PURE;
+
+CPL_CLINKAGE_END
+
+#endif /* CPL_ZFILE_H */
@@ -16,6 +16,10 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
 #include <assert.h>
 #include "emx_reader.h"
 #include "cpl_timedate.h"
@@ -24,7 +28,12 @@
 #include "cpl_error.h"
 #include "cpl_bswap.h"
 #include "cpl_file.h"
+#include "cpl_zfile.h"
+#include "cpl_thread.h"
 #include "cpl_str.h"
+#include "cpl_table.h"
+#include "cpl_wcfile.h"
+#include "cpl_simd.h"
 
 
 /* EMX Datagram Identifier */
@@ -34,40 +43,251 @@
 /* EMX Max TX Sectors */
 #define EMX_MAX_TX_SECTORS  20
 
+/* Relocate a datagram pointer X from SRC to DST in emx_relocate(). */
+#define EMX_RELOCATE(x)     ((x) = emx_relocate_ptr ((x), src, size, dst))
+
+
+/* EMX Datagram Checksum */
+typedef struct {
+    const uint8_t *data;               /* Datagram data after the header.   */
+    size_t size;                       /* Number of bytes to sum.           */
+    uint16_t header_sum;               /* Sum of the header bytes.          */
+    uint16_t file_sum;                 /* Checksum stored in the datagram.  */
+    uint16_t counter;                  /* Datagram counter.                 */
+    uint8_t datagram_type;             /* Datagram type.                    */
+    int valid;                         /* Boolean if the checksum is valid. */
+} emx_checksum;
+
+
+/* EMX Retained Datagram */
+typedef struct emx_retained_struct emx_retained;
+
+struct emx_retained_struct {
+    emx_data d;                        /* Datagram pointing into buffer.    */
+    char *buffer;                      /* Copy of the datagram or NULL.     */
+    size_t buffer_size;                /* Allocated size of the buffer.     */
+    emx_retained *next;                /* Next retained datagram or NULL.   */
+    emx_retained *next_free;           /* Next released datagram or NULL.   */
+};
+
+
+/* EMX Read-Ahead Buffer */
+typedef struct {
+    emx_data d;                        /* Datagram pointing into the body.  */
+    char *body;                        /* Datagram body or NULL at the end. */
+    size_t body_size;                  /* Size of the datagram body.        */
+    char *buffer;                      /* Copy of the datagram or NULL.     */
+    size_t buffer_size;                /* Allocated size of the buffer.     */
+    uint64_t end;                      /* File offset after the datagram.   */
+    uint64_t resync_bytes;             /* Bytes skipped by resync so far.   */
+    uint64_t resync_count;             /* Bad datagrams skipped so far.     */
+    uint64_t bytes_read;               /* Bytes read from the file so far.  */
+    uint64_t num_reads;                /* Reads from the file so far.       */
+    uint64_t num_seeks;                /* Seeks in the file so far.         */
+    uint64_t checksum_failures;        /* Invalid checksums so far.         */
+    int checksum_valid;                /* Boolean if the checksum is valid. */
+    int swap_pending;                  /* Boolean if arrays are unswapped.  */
+    int status;                        /* Error condition at the end.       */
+} emx_prefetch_slot;
+
+
+/* EMX Read-Ahead State */
+typedef struct emx_prefetch_struct emx_prefetch;
+
 
 /* EMX File Handle */
 struct emx_handle_struct {
-    char *buffer;                      /* File I/O buffer.            */
-    size_t buffer_size;                /* Allocated buffer size.      */
-    emx_data d;                        /* Static emx_data struct.     */
-    int fd;                            /* File descriptor.            */
-    int emx_errno;                     /* Error condition code.       */
-    int ignore_wc;                     /* Boolean to ignore WC data.  */
-    int ignore_checksum;               /* Boolean to ignore checksum. */
-    int swap;                          /* Boolean to byte-swap data.  */
-    size_t hisas_bytes_per_sample[6];  /* HISAS data bytes per sample. */
+    char *buffer;                      /* File I/O buffer.                  */
+    size_t buffer_size;                /* Allocated buffer size.            */
+    cpl_bfile_t io;                    /* Buffered file reader.             */
+    const char *map;                   /* Memory-mapped file or NULL.       */
+    size_t map_size;                   /* Size of the memory-mapped file.   */
+    size_t map_offset;                 /* Current read offset into the map. */
+    emx_data d;                        /* Static emx_data struct.           */
+    int fd;                            /* File descriptor.                  */
+    int emx_errno;                     /* Error condition code.             */
+    int ignore_wc;                     /* Boolean to ignore WC data.        */
+    int ignore_checksum;               /* Boolean to ignore checksum.       */
+    int checksum_mode;                 /* Checksum verification mode.       */
+    int checksum_pending;              /* Mode of a pending verification.   */
+    emx_checksum checksum;             /* Checksum of the last datagram.    */
+    cpl_worker *worker;                /* Checksum worker thread or NULL.   */
+    uint8_t skip_type[256];            /* Booleans to skip datagram types.  */
+    int resync;                        /* Boolean to resync after bad data. */
+    uint64_t resync_bytes;             /* Bytes skipped by resync.          */
+    uint64_t resync_count;             /* Bad datagrams skipped by resync.  */
+    int read_one;                      /* Boolean to read one datagram.     */
+    int swap;                          /* Boolean to byte-swap data.        */
+    int lazy_swap;                     /* Boolean to swap arrays if needed. */
+    int swap_pending;                  /* Boolean if arrays are unswapped.  */
+    size_t hisas_bytes_per_sample[6];  /* HISAS data bytes per sample.      */
+    emx_index_entry *index;            /* Datagram index or NULL.           */
+    size_t index_size;                 /* Number of datagrams in the index. */
+    size_t index_alloc;                /* Allocated index entries.          */
+    uint32_t *index_by_type;           /* Index sorted by type and time.    */
+    uint32_t *index_by_time;           /* Index sorted by time.             */
+    cpl_nav *nav;                      /* Navigation store or NULL.         */
+    uint32_t nav_date;                 /* Date of the navigation day start. */
+    int64_t nav_day;                   /* Start of nav_date in nanoseconds. */
+    char *body;                        /* Last datagram body or NULL.       */
+    size_t body_size;                  /* Size of the last datagram body.   */
+    emx_retained *retained;            /* List of all retained datagrams.   */
+    emx_retained *released;            /* List of released datagrams.       */
+    emx_prefetch *prefetch;            /* Read-ahead state or NULL.         */
+    emx_stats stats;                   /* Datagram counts and times.        */
+    int timing;                        /* Boolean to measure read times.    */
+    emx_trace_fn trace;                /* Datagram trace function or NULL.  */
+    void *trace_data;                  /* Trace function user data.         */
+};
+
+
+/* EMX Read-Ahead State */
+struct emx_prefetch_struct {
+    emx_handle h;                      /* File handle of the I/O thread.    */
+    emx_prefetch_slot *slots;          /* Array of depth buffers.           */
+    size_t depth;                      /* Number of buffers.                */
+    cpl_ring *ready;                   /* Buffers read by the I/O thread.   */
+    cpl_ring *free;                    /* Buffers returned by the consumer. */
+    cpl_worker *worker;                /* I/O thread.                       */
+    emx_prefetch_slot *last;           /* Buffer of the last datagram.      */
+    uint64_t position;                 /* File offset after the last one.   */
+    uint64_t count;                    /* Number of datagrams read ahead.   */
+    uint64_t stalls;                   /* Waits for the I/O thread.         */
+    int running;                       /* Boolean if the I/O thread is run. */
+};
+
+
+/* EMX Water Column File */
+struct emx_wc_file_struct {
+    cpl_wcfile *w;                     /* Compressed water column file.     */
+    emx_data d;                        /* Decoded datagram.                 */
+    int emx_errno;                     /* Error condition code.             */
 };
 
 
+/* EMX Index File Header (32 Bytes) */
+typedef struct CPL_ATTRIBUTE_PACKED CPL_ATTRIBUTE_GCC_STRUCT {
+    char magic[8];                     /* Magic string "EMXINDEX".          */
+    uint32_t version;                  /* Index file version.               */
+    uint32_t byte_order;               /* 0x01020304 in file byte order.    */
+    uint32_t entry_size;               /* Size of each index entry.         */
+    uint32_t num_entries;              /* Number of index entries.          */
+    uint64_t file_size;                /* Size of the indexed file.         */
+} emx_index_file_header;
+
+
+/* EMX Index Sort Key */
+typedef struct {
+    uint64_t time;                     /* Sort time from emx_index_time.    */
+    uint32_t type;                     /* Datagram type.                    */
+    uint32_t entry;                    /* Index entry number.               */
+} emx_index_key;
+
+
+/* EMX Batch Read State */
+typedef struct {
+    const char **file_names;           /* File names to read.               */
+    int *file_status;                  /* Status of each file.              */
+    int options;                       /* Batch read options.               */
+    emx_batch_fn fn;                   /* Datagram callback function.       */
+    void *user_data;                   /* Callback function user data.      */
+} emx_batch;
+
+
+/* EMX Chunked Read State */
+typedef struct {
+    const char *file_name;             /* File name to read.                */
+    uint64_t *offsets;                 /* Start offset of each chunk.       */
+    int *chunk_status;                 /* Status of each chunk.             */
+    int options;                       /* Batch read options.               */
+    emx_batch_fn fn;                   /* Datagram callback function.       */
+    void *user_data;                   /* Callback function user data.      */
+} emx_chunks;
+
+
+/* EMX Index File Definitions */
+#define EMX_INDEX_MAGIC       "EMXINDEX"
+#define EMX_INDEX_VERSION     2
+#define EMX_INDEX_BYTE_ORDER  0x01020304
+
+
+/* Size of the Output Buffer Used by emx_copy() */
+#define EMX_COPY_BUFFER_SIZE  (1<<20)
+
+
+/* Size of the File Prefix Read by emx_identify() */
+#define EMX_IDENTIFY_SIZE     (1<<16)
+
+
+/* Number of Consecutive Datagram Headers Validated to Identify a File */
+#define EMX_IDENTIFY_HEADERS  4
+
+
 /* Private Function Prototypes */
-static int emx_get_header (emx_datagram_header *, int *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_read_header (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static emx_handle * emx_new_handle (const int) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+static int emx_check_header (emx_datagram_header *, int *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_skip (emx_handle *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_copy_write (const int, const char *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void emx_delta_wc (uint8_t *, const uint8_t *, const size_t, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_resync (emx_handle *, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static ssize_t emx_peek (emx_handle *, const uint64_t, const size_t, char **) CPL_ATTRIBUTE_NONNULL_ALL;
+static uint64_t emx_tell (const emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static int emx_seek (emx_handle *, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_file_size (const emx_handle *, uint64_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_sort_index (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void emx_free_index (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_compare_type (const void *, const void *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static int emx_compare_time (const void *, const void *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static uint64_t emx_index_time (const uint32_t, const uint32_t) CPL_ATTRIBUTE_CONST;
+static void emx_batch_task (void *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
+static int emx_batch_file (emx_batch *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_split_chunks (emx_handle *, uint64_t *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void emx_chunk_task (void *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
+static int emx_chunk_file (emx_chunks *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
 static int emx_valid_header (const emx_datagram_header *) CPL_ATTRIBUTE_NONNULL_ALL;
 static int emx_valid_date (const uint32_t) CPL_ATTRIBUTE_PURE;
 static int emx_byte_order (const uint32_t, const uint16_t) CPL_ATTRIBUTE_PURE;
 static void emx_swap_header (emx_datagram_header *) CPL_ATTRIBUTE_NONNULL_ALL;
 static void emx_swap_datagram (emx_datagram *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+static void emx_swap_arrays (emx_datagram *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
 static int emx_valid_checksum (const emx_datagram_header *, const char *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_prepare_checksum (const emx_datagram_header *, const char *, const int, emx_checksum *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_finish_checksum (const emx_checksum *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static uint16_t emx_sum_bytes (const uint8_t *, const size_t) CPL_ATTRIBUTE_PURE;
+static void emx_checksum_task (void *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
+static void emx_wait_checksum (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_add_nav (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_nav_time (emx_handle *, const uint32_t, const uint32_t, int64_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void emx_relocate (emx_data *, const char *, const size_t, char *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void * emx_relocate_ptr (const void *, const char *, const size_t, char *) CPL_ATTRIBUTE_NONNULL (2) CPL_ATTRIBUTE_NONNULL (4) CPL_ATTRIBUTE_PURE;
 static int set_buffer_size (emx_handle *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void emx_count_datagram (emx_handle *, const uint64_t, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static emx_data * emx_prefetch_read (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_prefetch_start (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int emx_prefetch_stop (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void emx_prefetch_free (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void emx_prefetch_task (void *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
 
 
 /* Private Variables */
 static int emx_debug = 0;
 
+/* Names of the XYZ beam columns in the order of the column flags. */
+static const char *emx_xyz_column_name[EMX_XYZ_NUM_COLUMNS] = {
+    "depth", "across_track", "along_track", "detect_window_length", "quality_factor",
+    "beam_adjustment", "detection_info", "system_cleaning", "backscatter"
+};
+
 
 /******************************************************************************
 *
 * emx_open - Open the file given by FILE_NAME and return a handle to it.  The
 *   caller must call emx_close() to close the file and free the memory after use.
+*   A file written by cpl_zfile_compress() is decoded as it is read, with
+*   CPL_ZFILE_THREADS frames decoded ahead (see emx_set_decode_threads()), and
+*   all file offsets and sizes, such as those of the index, are of the decoded
+*   data.
 *
 * Return: A file handle pointer to the open file, or
 *         NULL if the file can not be opened for reading.
@@ -157,35 +377,97 @@ emx_handle * emx_open (
     }
 
     /* Allocate memory storage for the handle.  This must be free'd later. */
-    h = (emx_handle *) cpl_malloc (sizeof (emx_handle));
+    h = emx_new_handle (fd);
     if (!h) {
         cpl_close (fd);
         return NULL;
     }
 
-    /* Initialize the file buffer. */
-    h->buffer_size = 0;
-    h->buffer = NULL;
+    /* A compressed file is decoded as it is read.  Any read error is returned by the first read. */
+    cpl_bfile_detect (&(h->io), CPL_ZFILE_THREADS);
 
-    /* Initialize the file handle. */
-    h->emx_errno = CS_ENONE;
-    h->fd = fd;
+    return h;
+}
 
-    /* Set boolean to ignore watercolumn data to false by default. */
-    h->ignore_wc = 0;
 
-    /* Set boolean to ignore the datagram checksum to false by default. */
-    h->ignore_checksum = 0;
+/******************************************************************************
+*
+* emx_open_fd - Return a handle that reads from the open file descriptor FD,
+*   such as a file opened and identified by ns_open().  If BUFFER is not NULL,
+*   then its first N bytes are the data read from FD just before its current
+*   position, which are returned by the first reads instead of being read
+*   again.  BUFFER of BUFFER_SIZE bytes must be allocated with cpl_malloc().
+*   If successful, the handle owns FD and BUFFER, and emx_close() closes FD.
+*   Otherwise, both are still owned by the caller.  A compressed file is
+*   decoded as by emx_open().
+*
+* Return: A file handle pointer to the open file, or
+*         NULL if memory allocation failed.
+*
+******************************************************************************/
 
-    /* Set boolean to byte swap to be undefined. */
-    h->swap = -1;
+emx_handle * emx_open_fd (
+    const int fd,
+    char *buffer,
+    const size_t buffer_size,
+    const size_t n) {
+
+    emx_handle *h;
 
-    h->hisas_bytes_per_sample[0] = 0;
-    h->hisas_bytes_per_sample[1] = 0;
-    h->hisas_bytes_per_sample[2] = 0;
-    h->hisas_bytes_per_sample[3] = 0;
-    h->hisas_bytes_per_sample[4] = 0;
-    h->hisas_bytes_per_sample[5] = 0;
+
+    if (fd < 0) return NULL;
+
+    h = emx_new_handle (fd);
+    if (!h) return NULL;
+
+    if (buffer) cpl_bfile_set_buffer (&(h->io), buffer, buffer_size, n);
+
+    /* A compressed file is decoded as it is read.  Any read error is returned by the first read. */
+    cpl_bfile_detect (&(h->io), CPL_ZFILE_THREADS);
+
+    return h;
+}
+
+
+/******************************************************************************
+*
+* emx_open_mmap - Open the file given by FILE_NAME and map its contents into
+*   memory for reading.  The datagram pointers returned by emx_read() point
+*   directly into the mapped file instead of an internal copy, so no per-datagram
+*   read or copy is done.  The mapped data is read-only and must not be modified
+*   by the caller.  Datagrams that must be modified after reading, which are all
+*   datagrams in a byte-swapped file and the sidescan status datagram, are still
+*   copied to the internal buffer.  If the file can not be mapped (e.g., not a
+*   regular file), then the handle falls back to the reads used by emx_open().
+*
+* Return: A file handle pointer to the open file, or
+*         NULL if the file can not be opened for reading.
+*
+******************************************************************************/
+
+emx_handle * emx_open_mmap (
+    const char *file_name) {
+
+    emx_handle *h;
+
+
+    h = emx_open (file_name);
+    if (!h) return NULL;
+
+    /* The decoded data of a compressed file is not in the file. */
+    if (h->io.zfile) {
+        cpl_debug (emx_debug, "File is compressed, using buffered reads\n");
+        return h;
+    }
+
+    h->map = (const char *) cpl_mmap (h->fd, &(h->map_size));
+
+    if (h->map) {
+        cpl_debug (emx_debug, "Mapped %lu bytes into memory\n", (unsigned long) h->map_size);
+    } else {
+        cpl_debug (emx_debug, "Failed to map file, using buffered reads\n");
+        h->map_size = 0;
+    }
 
     return h;
 }
@@ -202,12 +484,21 @@ emx_handle * emx_open (
 int emx_close (
     emx_handle *h) {
 
+    emx_retained *r;
     int status = CS_ENONE;
 
 
     if (h) {
         cpl_debug (emx_debug, "Closing file\n");
 
+        /* Stop the I/O thread, which returns the file state to the handle. */
+        emx_prefetch_free (h);
+
+        /* Stop the checksum worker thread after the last datagram is verified. */
+        emx_wait_checksum (h);
+        cpl_worker_destroy (h->worker);
+        h->worker = NULL;
+
         /* Close the file if it wasn't already closed. */
         if (h->fd != -1) {
             if (cpl_close (h->fd) != 0) {
@@ -216,12 +507,33 @@ int emx_close (
             h->fd = -1;
         }
 
-        /* Free the internal storage buffer. */
+        /* Release the memory-mapped file. */
+        if (h->map) {
+            if (cpl_munmap ((void *) h->map, h->map_size) != 0) {
+                status = CS_ECLOSE;
+            }
+            h->map = NULL;
+        }
+
+        /* Free the internal storage buffers. */
         if (h->buffer) {
             cpl_free (h->buffer);
             h->buffer = NULL;
         }
 
+        cpl_bfile_free (&(h->io));
+
+        /* Free the datagram index. */
+        emx_free_index (h);
+
+        /* Free the retained datagrams, whether released or not. */
+        while (h->retained) {
+            r = h->retained;
+            h->retained = r->next;
+            if (r->buffer) cpl_free (r->buffer);
+            cpl_free (r);
+        }
+
         /* Free the file handle. */
         cpl_free (h);
     }
@@ -238,6 +550,8 @@ int emx_close (
 *   storage for the datagram and channel data will be overwritten in
 *   subsequent calls to this function or if the file is closed.  If they are to
 *   be preserved, then they should be copied to a user-defined buffer location.
+*   If resync mode is set, then corrupt datagrams are skipped by searching for
+*   the next valid datagram.
 *
 * Return: A pointer to the data struct if the data was read successfully,
 *         NULL if no valid data was found or EOF was reached.
@@ -253,24 +567,51 @@ int emx_close (
 emx_data * emx_read (
     emx_handle *h) {
 
+    uint64_t offset;
+    uint64_t start = 0;
+    uint64_t parse_start = 0;
     size_t actual_read_size;
     size_t read_size;
     size_t n;
     ssize_t result;
+    int count = 0;
     int i, status;
+    emx_data *d;
     char *p;
 
 
     assert (h);
 
-    /* Read the datagram header from the file descriptor.  The header will be validated and byte swapped as needed. */
-L1: status = emx_get_header (&h->d.header, &h->swap, h->fd);
+    if (h->timing) start = cpl_clock_ns ();
+
+    /* Datagrams read ahead by the I/O thread are returned in file order, but a
+       read of only one datagram follows a seek, so it is read directly. */
+    if (h->prefetch) {
+        if (!h->read_one) {
+            d = emx_prefetch_read (h);
+            if (d) emx_count_datagram (h, start, 0);
+            return d;
+        }
+        if (emx_prefetch_stop (h) != 0) return NULL;
+    }
+
+    h->body = NULL;
+
+    /* When reading in index order, a skipped datagram must not be followed by the next one in the file. */
+L1: if (h->read_one && (count++ > 0)) return NULL;
+
+    /* Save the datagram offset, which is needed to resynchronize after corrupt data. */
+    offset = emx_tell (h);
+
+    /* Read the datagram header from the file.  The header will be validated and byte swapped as needed. */
+    status = emx_read_header (h);
 
     /* Check for EOF. */
     if (status == 0) return NULL;
 
     /* Check for error condition. */
     if (status < 0) {
+        if (h->resync && (status == CS_EBADDATA)) goto L2;
         h->emx_errno = status;
         return NULL;
     }
@@ -287,9 +628,7 @@ L1: status = emx_get_header (&h->d.header, &h->swap, h->fd);
        the read time is greater than the seek time on the storage device, then seeking
        past this data is advantageous if this data is not desired. */
     if (h->ignore_wc && (h->d.header.datagram_type == EMX_DATAGRAM_WATER_COLUMN)) {
-        if (cpl_seek (h->fd, read_size, SEEK_CUR) < 0) {
-            cpl_debug (emx_debug, "Seek failed\n");
-            h->emx_errno = CS_ESEEK;
+        if (emx_skip (h, read_size) != 0) {
             return NULL;
         }
 
@@ -297,50 +636,122 @@ L1: status = emx_get_header (&h->d.header, &h->swap, h->fd);
         goto L1;
     }
 
-    /* Resize the buffer as needed to fit the datagram size. */
-    if (set_buffer_size (h, read_size) != 0) {
-        h->emx_errno = CS_ENOMEM;
-        return NULL;
-    }
+    /* Skip any datagrams rejected by the datagram type filter. */
+    if (h->skip_type[h->d.header.datagram_type]) {
+        if (emx_skip (h, read_size) != 0) {
+            return NULL;
+        }
 
-    /* Read the rest of the datagram from the file descriptor to the buffer. */
-    result = cpl_read (h->buffer, read_size, h->fd);
-    if (result < 0) {
-        cpl_debug (emx_debug, "Read error occurred\n");
-        h->emx_errno = CS_EREAD;
-        return NULL;
+        /* Now go back and read another datagram. */
+        goto L1;
     }
 
-    actual_read_size = (size_t) result;
+    if (h->map) {
+        if (h->map_size - h->map_offset < read_size) {
+            cpl_debug (emx_debug, "Unexpected end of file\n");
+            if (h->resync) goto L2;
+            h->emx_errno = CS_EBADDATA;
+            return NULL;
+        }
+
+        /* Byte swapping and the sidescan status datagram modify the data after reading, so
+           those must be copied to the buffer.  Otherwise point directly into the memory map. */
+        if (h->swap || (h->d.header.datagram_type == EMX_DATAGRAM_SIDESCAN_STATUS)) {
+            if (set_buffer_size (h, read_size) != 0) {
+                h->emx_errno = CS_ENOMEM;
+                return NULL;
+            }
 
-    /* Make sure we read at least the minimum size. */
-    if (actual_read_size != read_size) {
-        /* If the expected amount was not read, then the file is corrupt. */
-        cpl_debug (emx_debug, "Unexpected end of file\n");
-        h->emx_errno = CS_EBADDATA;
-        return NULL;
+            memcpy (h->buffer, h->map + h->map_offset, read_size);
+            p = h->buffer;
+        } else {
+            p = (char *) (h->map + h->map_offset);
+        }
+
+        h->map_offset += read_size;
+        h->io.bytes_read += read_size;
+    } else {
+        /* Resize the file block as needed to fit the datagram size. */
+        if (cpl_bfile_reserve (&(h->io), read_size) != 0) {
+            h->emx_errno = CS_ENOMEM;
+            return NULL;
+        }
+
+        /* Get the rest of the datagram from the file block.  The pointer p is set to the start
+           of the datagram (after the header) so no copy of the data is made.  The block is
+           writable, so the data may be byte swapped in place. */
+        result = cpl_bfile_get (&(h->io), &p, read_size);
+        if (result < 0) {
+            cpl_debug (emx_debug, "Read error occurred\n");
+            h->emx_errno = CS_EREAD;
+            return NULL;
+        }
+
+        actual_read_size = (size_t) result;
+
+        /* Make sure we read at least the minimum size. */
+        if (actual_read_size != read_size) {
+            /* If the expected amount was not read, then the file is corrupt. */
+            cpl_debug (emx_debug, "Unexpected end of file\n");
+            if (h->resync) goto L2;
+            h->emx_errno = CS_EBADDATA;
+            return NULL;
+        }
     }
 
+    if (h->timing) parse_start = cpl_clock_ns ();
+
     /* Have found data with an undocumented datagram of type 0x74 ('t') that does
        not appear to have a valid checksum or date/timestamp.  The datagram appears
        to contain some directory information.  Need to skip this datagram here. */
     if (h->d.header.datagram_type != EMX_DATAGRAM_UNKNOWN2) {
 
-        /* Verify the checksum and end identifier are valid. */
-        if (emx_valid_checksum (&(h->d.header), h->buffer, h->swap) == 0) {
-            /* Checksum errors appear to be common in older data.  If we have an error then discard this datagram and
-               read another unless requested to continue processing it. */
-            if (h->ignore_checksum == 0) {
-                cpl_debug (emx_debug, "Discarding bad datagram\n");
-                goto L1;
+        /* In resync mode, a missing end identifier means the datagram size is corrupt and the
+           next datagram can not be found, so search for it instead of discarding the datagram.
+           An end identifier of zero is accepted as in emx_prepare_checksum(). */
+        if (h->resync && (p[read_size - 3] != EMX_END_BYTE) && (p[read_size - 3] != 0)) {
+            cpl_debug (emx_debug, "Invalid end identifier (%u)\n", (uint8_t) p[read_size - 3]);
+            goto L2;
+        }
+
+        /* Data that are byte-swapped or changed while setting the pointers below can not be verified
+           later, so these are verified now as in the eager mode. */
+        if ((h->checksum_mode == EMX_CHECKSUM_EAGER) || (h->d.header.datagram_type == EMX_DATAGRAM_SIDESCAN_STATUS) ||
+            ((h->checksum_mode == EMX_CHECKSUM_THREAD) && (h->swap || !h->worker))) {
+
+            /* Verify the checksum and end identifier are valid. */
+            h->checksum.valid = emx_valid_checksum (&(h->d.header), p, h->swap);
+            if (h->checksum.valid == 0) {
+                h->stats.checksum_failures++;
+
+                /* Checksum errors appear to be common in older data.  If we have an error then discard this datagram and
+                   read another unless requested to continue processing it.  Datagrams verified here in the other modes
+                   are not discarded, and the result is returned by emx_verify_checksum(). */
+                if ((h->ignore_checksum == 0) && (h->checksum_mode == EMX_CHECKSUM_EAGER)) {
+                    cpl_debug (emx_debug, "Discarding bad datagram\n");
+                    goto L1;
+                }
             }
+        } else if (emx_prepare_checksum (&(h->d.header), p, h->swap, &(h->checksum)) == 0) {
+            h->checksum.valid = 0;
+            h->stats.checksum_failures++;
+        } else if (h->checksum_mode == EMX_CHECKSUM_THREAD) {
+            /* Sum the datagram bytes while the caller processes the datagram. */
+            h->checksum_pending = EMX_CHECKSUM_THREAD;
+            cpl_worker_start (h->worker, emx_checksum_task, h, 0);
+        } else {
+            h->checksum_pending = EMX_CHECKSUM_DEFERRED;
         }
+    } else {
+        h->checksum.valid = 1;
     }
 
-    /* Set the pointer p to the buffer, which is the start of the datagram (after the header). */
-    p = h->buffer;
+    /* Save the datagram body, which emx_retain() copies. */
+    h->body = p;
+    h->body_size = read_size;
 
-    /* Set the pointers of the datagram array (channel) data into the correct places in the buffer. */
+    /* The pointer p is now at the start of the datagram (after the header).  Set the pointers
+       of the datagram array (channel) data into the correct places in the buffer. */
     switch (h->d.header.datagram_type) {
 
         /* Byte-swapping is done after setting the pointers here, so if any parameters are needed to set the
@@ -878,2614 +1289,7101 @@ L1: status = emx_get_header (&h->d.header, &h->swap, h->fd);
             break;
     }
 
-    /* Byte swap the datagram if necessary. */
+    /* Byte swap the datagram if necessary.  In the lazy mode, the beam and sample arrays are
+       only swapped if the caller calls emx_get_array_data(). */
     if (h->swap) {
         emx_swap_datagram (&h->d.datagram, h->d.header.datagram_type);
+
+        if (h->lazy_swap) {
+            h->swap_pending = 1;
+        } else {
+            emx_swap_arrays (&h->d.datagram, h->d.header.datagram_type);
+        }
+    }
+
+    /* Store the navigation samples if requested. */
+    if (h->nav) {
+        status = emx_add_nav (h);
+        if (status != CS_ENONE) {
+            h->emx_errno = status;
+            return NULL;
+        }
     }
 
+    emx_count_datagram (h, start, h->timing ? cpl_clock_ns () - parse_start : 0);
+
     return &(h->d);
+
+    /* The datagram at the saved offset is corrupt, so search for the next valid datagram. */
+L2: status = emx_resync (h, offset);
+
+    /* Now go back and read the datagram that was found. */
+    if (status > 0) goto L1;
+
+    if (status < 0) h->emx_errno = status;
+
+    return NULL;
 }
 
 
 /******************************************************************************
 *
-* emx_get_wc_rxbeam - The water column data RX beam data stored in the EMX format
-*   consists of the emx_datagram_wc_rx_beam_info struct followed by num_samples
-*   of amplitude data.  This function will set the pointers in the Rx beam data
-*   object D for the data stream starting at P.  The start of the next Rx beam
-*   data stream will be returned.
+* emx_get_xyz_columns - Copy the beam fields selected by the EMX_XYZ_COLUMN flags
+*   in MASK of the XYZ 88 datagram D to the arrays of the column set C, which
+*   stores each field in a separate contiguous array of floats.  The beams are
+*   stored starting at element N of each array, and no more than MAX_SIZE
+*   elements in total are used, so the beams of several pings can be stored one
+*   after the other by passing the number of beams stored so far as N.  The
+*   arrays of columns not selected by MASK are not used and may be NULL, and
+*   selected columns with a NULL array are skipped.  The beam adjustment and
+*   backscatter are converted to degrees and dB.
+*
+* Return: The number of beams stored, which is less than the number in the
+*           datagram only if MAX_SIZE is reached.
 *
 ******************************************************************************/
 
-const uint8_t * emx_get_wc_rxbeam (
-    emx_datagram_wc_rx_beam *d,
-    const uint8_t *p) {
+size_t emx_get_xyz_columns (
+    const emx_datagram_xyz *d,
+    const unsigned int mask,
+    const emx_xyz_columns *c,
+    const size_t n,
+    const size_t max_size) {
+
+    const emx_datagram_xyz_beam *beam;
+    size_t num_beams;
+    size_t i;
+    float *out;
+
 
     assert (d);
-    assert (p);
+    assert (c);
 
-    d->info = (emx_datagram_wc_rx_beam_info *) p;
-    p = p + sizeof (emx_datagram_wc_rx_beam_info);
-    d->amplitude = (int8_t *) p;
-    p = p + d->info->num_samples * sizeof (int8_t);
+    if (!d->info || !d->beam || (n >= max_size)) return 0;
 
-    return p;
+    num_beams = d->info->num_beams;
+    if (num_beams > max_size - n) num_beams = max_size - n;
+
+    beam = d->beam;
+
+    /* Fill one column at a time, so each output array is written sequentially. */
+    if ((mask & EMX_XYZ_COLUMN_DEPTH) && c->depth) {
+        out = c->depth + n;
+        for (i=0; i<num_beams; i++) {
+            out[i] = beam[i].depth;
+        }
+    }
+
+    if ((mask & EMX_XYZ_COLUMN_ACROSS_TRACK) && c->across_track) {
+        out = c->across_track + n;
+        for (i=0; i<num_beams; i++) {
+            out[i] = beam[i].across_track;
+        }
+    }
+
+    if ((mask & EMX_XYZ_COLUMN_ALONG_TRACK) && c->along_track) {
+        out = c->along_track + n;
+        for (i=0; i<num_beams; i++) {
+            out[i] = beam[i].along_track;
+        }
+    }
+
+    if ((mask & EMX_XYZ_COLUMN_DETECT_WINDOW_LENGTH) && c->detect_window_length) {
+        out = c->detect_window_length + n;
+        for (i=0; i<num_beams; i++) {
+            out[i] = (float) beam[i].detect_window_length;
+        }
+    }
+
+    if ((mask & EMX_XYZ_COLUMN_QUALITY_FACTOR) && c->quality_factor) {
+        out = c->quality_factor + n;
+        for (i=0; i<num_beams; i++) {
+            out[i] = (float) beam[i].quality_factor;
+        }
+    }
+
+    if ((mask & EMX_XYZ_COLUMN_BEAM_ADJUSTMENT) && c->beam_adjustment) {
+        out = c->beam_adjustment + n;
+        for (i=0; i<num_beams; i++) {
+            out[i] = beam[i].beam_adjustment * 0.1f;
+        }
+    }
+
+    if ((mask & EMX_XYZ_COLUMN_DETECTION_INFO) && c->detection_info) {
+        out = c->detection_info + n;
+        for (i=0; i<num_beams; i++) {
+            out[i] = (float) beam[i].detection_info;
+        }
+    }
+
+    if ((mask & EMX_XYZ_COLUMN_SYSTEM_CLEANING) && c->system_cleaning) {
+        out = c->system_cleaning + n;
+        for (i=0; i<num_beams; i++) {
+            out[i] = (float) beam[i].system_cleaning;
+        }
+    }
+
+    if ((mask & EMX_XYZ_COLUMN_BACKSCATTER) && c->backscatter) {
+        out = c->backscatter + n;
+        for (i=0; i<num_beams; i++) {
+            out[i] = beam[i].backscatter * 0.1f;
+        }
+    }
+
+    return num_beams;
 }
 
 
 /******************************************************************************
 *
-* emx_get_attitude_network_data - The attitude network data stored in the EMX
-*   format consists of the emx_datagram_attitude_network_data_info struct
-*   followed by num_bytes_input of the attitude message.  This function will
-*   set the pointers in the attitude network data object D for the data stream
-*   starting at P.  The start of the next attitude network data stream will be
-*   returned.
+* emx_alloc_xyz_columns - Allocate the arrays of the column set C selected by
+*   the EMX_XYZ_COLUMN flags in MASK from the memory arena A, with room for N
+*   beams each.  The arrays of columns not selected are set to NULL.  The arrays
+*   are released with the arena, e.g., by cpl_arena_reset() after each ping,
+*   and must not be freed otherwise.
+*
+* Return: 0 if the arrays were allocated, or
+*         CS_ENOMEM if memory allocation failed.
 *
 ******************************************************************************/
 
-const uint8_t * emx_get_attitude_network_data (
-    emx_datagram_attitude_network_data *d,
-    const uint8_t *p) {
+int emx_alloc_xyz_columns (
+    emx_xyz_columns *c,
+    const unsigned int mask,
+    const size_t n,
+    cpl_arena *a) {
 
-    assert (d);
-    assert (p);
+    float **column[EMX_XYZ_NUM_COLUMNS];
+    size_t j;
 
-    d->info = (emx_datagram_attitude_network_data_info *) p;
-    p = p + sizeof (emx_datagram_attitude_network_data_info);
-    d->message = (uint8_t *) p;
-    p = p + d->info->num_bytes_input;
 
-    return p;
+    assert (c);
+    assert (a);
+
+    column[0] = &(c->depth);
+    column[1] = &(c->across_track);
+    column[2] = &(c->along_track);
+    column[3] = &(c->detect_window_length);
+    column[4] = &(c->quality_factor);
+    column[5] = &(c->beam_adjustment);
+    column[6] = &(c->detection_info);
+    column[7] = &(c->system_cleaning);
+    column[8] = &(c->backscatter);
+
+    for (j=0; j<EMX_XYZ_NUM_COLUMNS; j++) {
+        *column[j] = NULL;
+    }
+
+    for (j=0; j<EMX_XYZ_NUM_COLUMNS; j++) {
+        if (!(mask & (1U << j))) continue;
+
+        *column[j] = (float *) cpl_arena_calloc (a, n, sizeof (float));
+        if (!*column[j]) return CS_ENOMEM;
+    }
+
+    return CS_ENONE;
 }
 
 
 /******************************************************************************
 *
-* emx_print - Print the data in D to the file stream FP in a human-readable
-*   format.  The OUTPUT_LEVEL can be set to 0, 1, or 2 for increasingly more
-*   information.
+* emx_add_xyz_table_columns - Add the columns of the XYZ 88 beams selected by
+*   the EMX_XYZ_COLUMN flags in MASK to the table T, which is then written by
+*   emx_write_xyz_table().  Each row is one beam, with the columns "time" in
+*   nanoseconds since 1970-01-01 (int64), "counter" (uint16), and "beam" number
+*   (uint16), followed by the selected fields named as in emx_xyz_columns
+*   (float).
+*
+* Return: 0 if the columns were added, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
 *
 ******************************************************************************/
 
-void emx_print (
-    FILE *fp,
-    const emx_data *d,
-    const int output_level) {
+int emx_add_xyz_table_columns (
+    cpl_table *t,
+    const unsigned int mask) {
 
-    int i;
+    int status;
+    size_t j;
 
 
-    assert (fp);
+    assert (t);
 
-    if (!d) return;
+    if ((status = cpl_table_add_column (t, "time", CPL_TABLE_INT64)) < 0) return status;
+    if ((status = cpl_table_add_column (t, "counter", CPL_TABLE_UINT16)) < 0) return status;
+    if ((status = cpl_table_add_column (t, "beam", CPL_TABLE_UINT16)) < 0) return status;
 
-    fprintf (fp, "\
-====== DATAGRAM =======\n\
-bytes_in_datagram     : %u Bytes\n\
-start_identifier      : %u\n\
-datagram_type         : %s\n\
-em_model_number       : EM %u\n\
-date                  : %u\n\
-time_ms               : %u ms\n\
-counter               : %u\n\
-serial_number         : %u\n\
------------------------\n", d->header.bytes_in_datagram, d->header.start_identifier,
-        emx_get_datagram_name (d->header.datagram_type), d->header.em_model_number, d->header.date,
-        d->header.time_ms, d->header.counter, d->header.serial_number);
+    for (j=0; j<EMX_XYZ_NUM_COLUMNS; j++) {
+        if (!(mask & (1U << j))) continue;
+        if ((status = cpl_table_add_column (t, emx_xyz_column_name[j], CPL_TABLE_FLOAT32)) < 0) return status;
+    }
 
-    switch (d->header.datagram_type) {
-
-        case EMX_DATAGRAM_DEPTH :
+    return CS_ENONE;
+}
 
-            fprintf (fp, "\
-vessel_heading        : %0.1f deg\n\
-sound_speed           : %0.1f m/s\n\
-transducer_depth      : %0.2f m\n\
-max_beams             : %u\n\
-num_beams             : %u\n\
-depth_resolution      : %u cm\n\
-horizontal_resolution : %u cm\n\
-sample_rate           : %u Hz (%0.2f m)\n\
-depth_offset_mult     : %d\n", d->datagram.depth.info->vessel_heading * 0.01, d->datagram.depth.info->sound_speed * 0.1,
-                d->datagram.depth.info->transducer_depth * 0.01, d->datagram.depth.info->max_beams, d->datagram.depth.info->num_beams,
-                d->datagram.depth.info->depth_resolution, d->datagram.depth.info->horizontal_resolution, d->datagram.depth.info->sample_rate,
-                750.0 / d->datagram.depth.info->sample_rate, d->datagram.depth.depth_offset_multiplier);
 
-            if (output_level > 0) {
+/******************************************************************************
+*
+* emx_write_xyz_table - Add the beams of the XYZ 88 datagram in D as rows of the
+*   table T, which has the columns added by emx_add_xyz_table_columns().  The
+*   fields are copied by emx_get_xyz_columns() directly into the column arrays
+*   of the table, and columns of the table not known here are left as zero.
+*   Nothing is done if D is not an XYZ 88 datagram or has no beams.
+*
+* Return: The number of beams added, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EBADDATA
+*         CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
 
-                for (i=0; i<d->datagram.depth.info->num_beams; i++) {
+int emx_write_xyz_table (
+    cpl_table *t,
+    const emx_data *d) {
+
+    const emx_datagram_xyz *xyz;
+    float **column[EMX_XYZ_NUM_COLUMNS];
+    emx_xyz_columns c;
+    unsigned int mask;
+    size_t num_beams;
+    size_t i, j;
+    int64_t *time;
+    int64_t time_ns;
+    uint16_t *counter, *beam;
+    double day;
+    int status;
+    int k;
 
-                    fprintf (fp, "\
---- Sounding [ %d ] ----\n\
-depth                 : ", i);
 
-                    if ((emx_get_model (d->header.em_model_number) == EM_MODEL_120) || (emx_get_model (d->header.em_model_number) == EM_MODEL_121A) ||
-                        (emx_get_model (d->header.em_model_number) == EM_MODEL_300)) {
-                        fprintf (fp, "%u\n", (uint16_t) d->datagram.depth.beam[i].depth);
-                    } else {
-                        fprintf (fp, "%d\n", d->datagram.depth.beam[i].depth);
-                    }
+    assert (t);
+    assert (d);
 
-                    fprintf (fp, "\
-across_track          : %d\n\
-along_track           : %d\n\
-beam_depression_angle : %0.1f deg\n\
-beam_azimuth_angle    : %0.1f deg\n\
-range                 : %u\n\
-quality_factor        : %u\n\
-detect_window_length  : %u\n\
-backscatter           : %0.1f dB\n\
-beam_number           : %u\n", d->datagram.depth.beam[i].across_track, d->datagram.depth.beam[i].along_track,
-                        d->datagram.depth.beam[i].beam_depression_angle / 100.0, d->datagram.depth.beam[i].beam_azimuth_angle / 100.0, d->datagram.depth.beam[i].range,
-                        d->datagram.depth.beam[i].quality_factor, d->datagram.depth.beam[i].detect_window_length, d->datagram.depth.beam[i].backscatter * 0.5,
-                        d->datagram.depth.beam[i].beam_number);
-                }
-            }
+    xyz = &(d->datagram.xyz);
 
-            break;
+    if ((d->header.datagram_type != EMX_DATAGRAM_XYZ) || !xyz->info || !xyz->beam) return 0;
 
-        case EMX_DATAGRAM_DEPTH_NOMINAL :
+    num_beams = xyz->info->num_beams;
+    if (num_beams == 0) return 0;
 
-            fprintf (fp, "\
-transducer_depth      : %0.2f m\n\
-max_beams             : %u\n\
-valid_beams           : %u\n", d->datagram.depth_nominal.info->transducer_depth, d->datagram.depth_nominal.info->max_beams,
-                d->datagram.depth_nominal.info->num_beams);
+    day = cpl_mktime ((int) (d->header.date / 10000), (int) ((d->header.date / 100) % 100), (int) (d->header.date % 100), 0, 0, 0.0);
+    if (day < 0) return CS_EBADDATA;
 
-            if (output_level > 0) {
+    time_ns = (int64_t) day * 1000000000 + (int64_t) d->header.time_ms * 1000000;
 
-                for (i=0; i<d->datagram.depth_nominal.info->num_beams; i++) {
+    status = cpl_table_reserve (t, num_beams);
+    if (status != CS_ENONE) return status;
 
-                    fprintf (fp, "\
---- Sounding [ %d ] ----\n\
-depth                 : %0.2f m\n\
-across_track          : %0.2f m\n\
-along_track           : %0.2f m\n\
-detection_info        : %u\n\
-system_cleaning       : %d\n", i, d->datagram.depth_nominal.beam[i].depth, d->datagram.depth_nominal.beam[i].across_track,
-                        d->datagram.depth_nominal.beam[i].along_track, d->datagram.depth_nominal.beam[i].detection_info,
-                        d->datagram.depth_nominal.beam[i].system_cleaning);
-                }
-            }
+    column[0] = &(c.depth);
+    column[1] = &(c.across_track);
+    column[2] = &(c.along_track);
+    column[3] = &(c.detect_window_length);
+    column[4] = &(c.quality_factor);
+    column[5] = &(c.beam_adjustment);
+    column[6] = &(c.detection_info);
+    column[7] = &(c.system_cleaning);
+    column[8] = &(c.backscatter);
 
-            break;
+    mask = 0;
+    for (j=0; j<EMX_XYZ_NUM_COLUMNS; j++) {
+        k = cpl_table_find_column (t, emx_xyz_column_name[j]);
+        if (k >= 0) {
+            *column[j] = (float *) cpl_table_get_column (t, k);
+            mask |= 1U << j;
+        } else {
+            *column[j] = NULL;
+        }
+    }
 
-        case EMX_DATAGRAM_XYZ :
+    emx_get_xyz_columns (xyz, mask, &c, 0, num_beams);
 
-            fprintf (fp, "\
-vessel_heading        : %0.1f deg\n\
-sound_speed           : %0.1f m/s\n\
-transducer_depth      : %0.2f m\n\
-num_beams             : %u beams\n\
-valid_beams           : %u beams\n\
-sample_rate           : %0.2f Hz (%0.2f m)\n\
-scanning_info         : %u\n", d->datagram.xyz.info->vessel_heading * 0.01, d->datagram.xyz.info->sound_speed * 0.1, d->datagram.xyz.info->transducer_depth,
-                d->datagram.xyz.info->num_beams, d->datagram.xyz.info->valid_beams, d->datagram.xyz.info->sample_rate,
-                750.0 / d->datagram.xyz.info->sample_rate, d->datagram.xyz.info->scanning_info);
+    if ((k = cpl_table_find_column (t, "time")) >= 0) {
+        time = (int64_t *) cpl_table_get_column (t, k);
+        for (i=0; i<num_beams; i++) {
+            time[i] = time_ns;
+        }
+    }
 
-            if (output_level > 0) {
+    if ((k = cpl_table_find_column (t, "counter")) >= 0) {
+        counter = (uint16_t *) cpl_table_get_column (t, k);
+        for (i=0; i<num_beams; i++) {
+            counter[i] = d->header.counter;
+        }
+    }
 
-                for (i=0; i<d->datagram.xyz.info->num_beams; i++) {
+    if ((k = cpl_table_find_column (t, "beam")) >= 0) {
+        beam = (uint16_t *) cpl_table_get_column (t, k);
+        for (i=0; i<num_beams; i++) {
+            beam[i] = (uint16_t) i;
+        }
+    }
 
-                    fprintf (fp, "\
---- Sounding [ %d ] ----\n\
-depth                 : %0.2f m\n\
-across_track          : %0.2f m\n\
-along_track           : %0.2f m\n\
-detect_window_length  : %u\n\
-quality_factor        : %u\n\
-beam_adjustment       : %0.1f deg\n\
-detection_info        : %u\n\
-system_cleaning       : %d\n\
-backscatter           : %0.1f dB\n", i, d->datagram.xyz.beam[i].depth, d->datagram.xyz.beam[i].across_track, d->datagram.xyz.beam[i].along_track,
-                        d->datagram.xyz.beam[i].detect_window_length, d->datagram.xyz.beam[i].quality_factor, d->datagram.xyz.beam[i].beam_adjustment * 0.1,
-                        d->datagram.xyz.beam[i].detection_info, d->datagram.xyz.beam[i].system_cleaning, d->datagram.xyz.beam[i].backscatter * 0.1);
-                }
-            }
+    cpl_table_commit (t, num_beams);
 
-            break;
+    return (int) num_beams;
+}
 
-        case EMX_DATAGRAM_EXTRA_DETECTIONS :
 
-            fprintf (fp, "\
-datagram_counter      : %u\n\
-datagram_version      : %u\n\
-swath_counter         : %u\n\
-swath_index           : %u\n\
-vessel_heading        : %0.2f deg\n\
-sound_speed           : %0.1f m\n\
-reference_depth       : %0.2f m\n\
-wc_sample_rate        : %0.2f Hz\n\
-raw_amp_sample_rate   : %0.2f Hz\n\
-rx_transducer_index   : %u\n\
-num_detects           : %u\n\
-num_classes           : %u\n\
-nbytes_class          : %u Bytes\n\
-nalarm_flags          : %u\n\
-nbytes_detect         : %u Bytes\n", d->datagram.extra_detect.info->datagram_counter, d->datagram.extra_detect.info->datagram_version,
-                d->datagram.extra_detect.info->swath_counter, d->datagram.extra_detect.info->swath_index, d->datagram.extra_detect.info->vessel_heading * 0.01,
-                d->datagram.extra_detect.info->sound_speed * 0.1, d->datagram.extra_detect.info->reference_depth, d->datagram.extra_detect.info->wc_sample_rate,
-                d->datagram.extra_detect.info->raw_amplitude_sample_rate, d->datagram.extra_detect.info->rx_transducer_index,
-                d->datagram.extra_detect.info->num_detects, d->datagram.extra_detect.info->num_classes, d->datagram.extra_detect.info->nbytes_class,
-                d->datagram.extra_detect.info->nalarm_flags, d->datagram.extra_detect.info->nbytes_detect);
+/******************************************************************************
+*
+* emx_get_seabed_89_snippets - Append the sample amplitudes of each beam of the
+*   seabed image 89 datagram D to the snippet buffer S, which stores the samples
+*   of all beams in one flat array of floats converted from 0.1 dB to dB.  The
+*   offset of the first sample of each beam in the sample array and its number
+*   of samples are stored in the offset and length arrays, with one entry per
+*   beam.  The samples of beams with a sorting direction of -1 are reversed, so
+*   the first sample of each beam always has the lowest range.  The snippets of
+*   several pings can be stored one after the other, since the samples and
+*   beams are stored after the num_samples and num_beams already in S.  This is
+*   the same layout used by kma_get_mrz_snippets() for the KMA format.  If the
+*   lazy swap mode is set, then D must be returned by emx_get_array_data().
+*
+* Return: 0 if the snippets of the ping were stored,
+*         CS_EBADDATA if the samples are larger than the datagram, or
+*         CS_EOVERFLOW if the ping does not fit in the arrays of S, in which
+*           case S is unchanged.
+*
+******************************************************************************/
 
-            if (output_level > 0) {
+int emx_get_seabed_89_snippets (
+    const emx_datagram_seabed_89 *d,
+    cpl_snippets *s) {
 
-                for (i=0; i<d->datagram.extra_detect.info->num_classes; i++) {
+    size_t num_beams;
+    size_t num_samples;
+    size_t i, j, k;
+    uint16_t n;
+    float *out;
+    float t;
 
-                    fprintf (fp, "\
------ Class [ %d ] -----\n\
-start_depth           : %u %%\n\
-stop_depth            : %u %%\n\
-qf_threshold          : %u\n\
-bs_threshold          : %d dB\n\
-snr_threshold         : %u dB\n\
-alarm_threshold       : %u\n\
-num_detects           : %u\n\
-show_class            : %u\n\
-alarm_flag            : %u\n", i, d->datagram.extra_detect.classes[i].start_depth, d->datagram.extra_detect.classes[i].stop_depth,
-                        d->datagram.extra_detect.classes[i].qf_threshold, d->datagram.extra_detect.classes[i].bs_threshold, d->datagram.extra_detect.classes[i].snr_threshold,
-                        d->datagram.extra_detect.classes[i].alarm_threshold, d->datagram.extra_detect.classes[i].num_detects, d->datagram.extra_detect.classes[i].show_class,
-                        d->datagram.extra_detect.classes[i].alarm_flag);
-                }
-            }
 
-            if (output_level > 1) {
+    assert (d);
+    assert (s);
 
-                for (i=0; i<d->datagram.extra_detect.info->num_detects; i++) {
+    if (!d->info) return CS_ENONE;
 
-                    fprintf (fp, "\
-depth                 : %0.2f m\n\
-across_track          : %0.2f m\n\
-along_track           : %0.2f m\n\
-latitude_delta        : %0.8f\n\
-longitud_delta        : %0.8f\n\
-beam_angle            : %0.2f deg\n\
-angle_correction      : %0.2f\n\
-travel_time           : %0.5f s\n\
-travel_time_correction: %0.5f s\n\
-backscatter           : %0.1f dB\n\
-beam_adjustment       : %0.1f deg\n\
-detection_info        : %d\n\
-tx_sector             : %u\n\
-detect_window_length  : %u\n\
-quality_factor        : %u\n\
-system_cleaning       : %u\n\
-range_factor          : %u %%\n\
-class_number          : %u\n\
-confidence            : %u\n\
-qf_ifremer            : %u\n\
-wc_beam_number        : %u\n\
-beam_angle_across     : %0.2f deg\n\
-detected_range        : %u\n\
-raw_amplitude         : %u\n", d->datagram.extra_detect.data[i].depth, d->datagram.extra_detect.data[i].across_track, d->datagram.extra_detect.data[i].along_track,
-                        d->datagram.extra_detect.data[i].latitude_delta, d->datagram.extra_detect.data[i].longitud_delta, d->datagram.extra_detect.data[i].beam_angle,
-                        d->datagram.extra_detect.data[i].angle_correction, d->datagram.extra_detect.data[i].travel_time, d->datagram.extra_detect.data[i].travel_time_correction,
-                        d->datagram.extra_detect.data[i].backscatter / 10.0, d->datagram.extra_detect.data[i].beam_adjustment / 10.0, d->datagram.extra_detect.data[i].detection_info,
-                        d->datagram.extra_detect.data[i].tx_sector, d->datagram.extra_detect.data[i].detection_window_length, d->datagram.extra_detect.data[i].quality_factor,
-                        d->datagram.extra_detect.data[i].system_cleaning, d->datagram.extra_detect.data[i].range_factor, d->datagram.extra_detect.data[i].class_number,
-                        d->datagram.extra_detect.data[i].confidence, d->datagram.extra_detect.data[i].qf_ifremer, d->datagram.extra_detect.data[i].wc_beam_number,
-                        d->datagram.extra_detect.data[i].beam_angle_across, d->datagram.extra_detect.data[i].detected_range, d->datagram.extra_detect.data[i].raw_amplitude);
-                }
-            }
+    num_beams = d->info->num_beams;
 
-            /* TODO: Output raw amplitudes. */
+    /* Find the total number of samples first, so nothing is stored if the ping does not fit. */
+    num_samples = 0;
+    for (i=0; i<num_beams; i++) {
+        num_samples += d->beam[i].num_samples;
+    }
 
-            break;
+    if (num_samples * sizeof (int16_t) > (size_t) d->bytes_end) {
+        cpl_debug (emx_debug, "Invalid number of seabed image samples (%lu)\n", (unsigned long) num_samples);
+        return CS_EBADDATA;
+    }
 
-        case EMX_DATAGRAM_CENTRAL_BEAMS :
+    if ((num_beams > s->max_beams - s->num_beams) || (num_samples > s->max_samples - s->num_samples)) {
+        return CS_EOVERFLOW;
+    }
 
-            fprintf (fp, "\
-mean_abs_coeff        : %0.2f dB/km\n\
-pulse_length          : %u us\n\
-range_norm            : %u\n\
-start_range           : %u\n\
-stop_range            : %u\n\
-normal_incidence_bs   : %d dB\n\
-oblique_bs            : %d dB\n\
-tx_beamwidth          : %0.1f deg\n\
-tvg_cross_over        : %0.1f deg\n\
-num_beams             : %u\n", d->datagram.central_beams.info->mean_abs_coef *.01, d->datagram.central_beams.info->pulse_length,
-                d->datagram.central_beams.info->range_norm, d->datagram.central_beams.info->start_range, d->datagram.central_beams.info->stop_range,
-                d->datagram.central_beams.info->normal_incidence_bs, d->datagram.central_beams.info->oblique_bs, d->datagram.central_beams.info->tx_beamwidth * 0.1,
-                d->datagram.central_beams.info->tvg_cross_over * 0.1, d->datagram.central_beams.info->num_beams);
+    num_samples = 0;
+    for (i=0; i<num_beams; i++) {
+        n = d->beam[i].num_samples;
 
-            if (output_level > 0) {
+        s->offset[s->num_beams] = s->num_samples;
+        s->length[s->num_beams] = n;
+        s->num_beams++;
 
-                for (i=0; i<d->datagram.central_beams.info->num_beams; i++) {
+        if (n > 0) {
+            out = s->sample + s->num_samples;
+            cpl_convert_samples16 (out, d->amplitude + num_samples, n, 0.1f);
 
-                    fprintf (fp, "\
------ Beam [ %d ] ------\n\
-beam_index            : %u\n\
-num_samples           : %u\n\
-start_range           : %u\n", i, d->datagram.central_beams.beam[i].beam_index, d->datagram.central_beams.beam[i].num_samples, d->datagram.central_beams.beam[i].start_range);
+            if (d->beam[i].sorting_direction < 0) {
+                for (j=0, k=n-1; j<k; j++, k--) {
+                    t = out[j];
+                    out[j] = out[k];
+                    out[k] = t;
                 }
             }
 
-            break;
-
-        case EMX_DATAGRAM_RRA_101 :
+            s->num_samples += n;
+            num_samples += n;
+        }
+    }
 
-            fprintf (fp, "\
-vessel_heading        : %0.2f deg\n\
-sound_speed           : %0.1f m/s\n\
-transducer_depth      : %0.2f m\n\
-max_beams             : %u\n\
-num_beams             : %u\n\
-depth_resolution      : %0.2f m\n\
-horizontal_resolution : %0.2f m\n\
-sample_rate           : %u Hz\n\
-status                : %d\n\
-range_norm            : %u\n\
-normal_incidence_bs   : %0.1f dB\n\
-oblique_bs            : %0.1f dB\n\
-fixed_gain            : %u\n\
-tx_power              : %d\n\
-mode                  : %u\n\
-coverage              : %u\n\
-yawstab_heading       : %u\n\
-tx_sectors            : %u\n", d->datagram.rra_101.info->vessel_heading / 100.0, d->datagram.rra_101.info->sound_speed / 10.0, d->datagram.rra_101.info->transducer_depth / 100.0,
-                d->datagram.rra_101.info->max_beams, d->datagram.rra_101.info->num_beams, d->datagram.rra_101.info->depth_resolution / 100.0, d->datagram.rra_101.info->horizontal_resolution / 100.0,
-                d->datagram.rra_101.info->sample_rate, d->datagram.rra_101.info->status, d->datagram.rra_101.info->range_norm, d->datagram.rra_101.info->normal_incidence_bs / 10.0,
-                d->datagram.rra_101.info->oblique_bs / 10.0, d->datagram.rra_101.info->fixed_gain, d->datagram.rra_101.info->tx_power, d->datagram.rra_101.info->mode,
-                d->datagram.rra_101.info->coverage, d->datagram.rra_101.info->yawstab_heading, d->datagram.rra_101.info->tx_sectors);
+    return CS_ENONE;
+}
 
-            for (i=0; i<d->datagram.rra_101.info->tx_sectors; i++) {
 
-                fprintf (fp, "\
----- Sector [ %d ] -----\n\
-last_beam             : %u\n\
-tx_tilt_angle         : %0.2f deg\n\
-heading               : %0.1f deg\n\
-roll                  : %0.1f deg\n\
-pitch                 : %0.1f deg\n\
-heave                 : %0.2f m\n", i, d->datagram.rra_101.tx_beam[i].last_beam, d->datagram.rra_101.tx_beam[i].tx_tilt_angle * 0.01,
-                    d->datagram.rra_101.tx_beam[i].heading * 0.01, d->datagram.rra_101.tx_beam[i].roll * 0.01, d->datagram.rra_101.tx_beam[i].pitch * 0.01,
-                    d->datagram.rra_101.tx_beam[i].heave * 0.01);
-            }
+/******************************************************************************
+*
+* emx_get_wc_rxbeam - The water column data RX beam data stored in the EMX format
+*   consists of the emx_datagram_wc_rx_beam_info struct followed by num_samples
+*   of amplitude data.  This function will set the pointers in the Rx beam data
+*   object D for the data stream starting at P.  The start of the next Rx beam
+*   data stream will be returned.
+*
+******************************************************************************/
 
-            if (output_level > 0) {
+const uint8_t * emx_get_wc_rxbeam (
+    emx_datagram_wc_rx_beam *d,
+    const uint8_t *p) {
 
-                for (i=0; i<d->datagram.rra_101.info->num_beams; i++) {
+    assert (d);
+    assert (p);
 
-                    fprintf (fp, "\
----- RX_Beam [ %d ] -----\n\
-range                 : %u\n\
-quality_factor        : %u\n\
-detect_window_length  : %u\n\
-backscatter           : %0.1f dB\n\
-beam_number           : %u\n\
-rx_beam_angle         : %0.2f deg\n\
-rx_heading            : %0.2f deg\n\
-roll                  : %0.2f deg\n\
-pitch                 : %0.2f deg\n\
-heave                 : %0.2f m\n", i, d->datagram.rra_101.rx_beam[i].range, d->datagram.rra_101.rx_beam[i].quality_factor,
-                        d->datagram.rra_101.rx_beam[i].detect_window_length, d->datagram.rra_101.rx_beam[i].backscatter * 0.5,
-                        d->datagram.rra_101.rx_beam[i].beam_number, d->datagram.rra_101.rx_beam[i].rx_beam_angle * 0.01,
-                        d->datagram.rra_101.rx_beam[i].rx_heading * 0.01, d->datagram.rra_101.rx_beam[i].roll * 0.01,
-                        d->datagram.rra_101.rx_beam[i].pitch * 0.01, d->datagram.rra_101.rx_beam[i].heave * 0.01);
-                }
-            }
+    d->info = (emx_datagram_wc_rx_beam_info *) p;
+    p = p + sizeof (emx_datagram_wc_rx_beam_info);
+    d->amplitude = (int8_t *) p;
+    p = p + d->info->num_samples * sizeof (int8_t);
 
-            break;
+    return p;
+}
 
-        case EMX_DATAGRAM_RRA_70 :
 
-            fprintf (fp, "\
-max_beams             : %u\n\
-num_beams             : %u\n\
-sound_speed           : %0.1f m/s\n", d->datagram.rra_70.info->max_beams, d->datagram.rra_70.info->num_beams, d->datagram.rra_70.info->sound_speed / 10.0);
+/******************************************************************************
+*
+* emx_init_wc_ping - Initialize the water column ping P, which must be done
+*   before it is used by emx_add_wc_ping().
+*
+******************************************************************************/
 
-            if (output_level > 0) {
+void emx_init_wc_ping (
+    emx_wc_ping *p) {
 
-                for (i=0; i<d->datagram.rra_70.info->num_beams; i++) {
+    assert (p);
 
-                    fprintf (fp, "\
------ Beam [ %d ] ------\n\
-beam_angle            : %0.2f deg\n\
-tx_tilt_angle         : %0.2f deg\n\
-range                 : %u\n\
-backscatter           : %0.1f dB\n\
-beam_number           : %u\n", i, d->datagram.rra_70.beam[i].beam_angle * 0.01, d->datagram.rra_70.beam[i].tx_tilt_angle * 0.01,
-                        d->datagram.rra_70.beam[i].range, d->datagram.rra_70.beam[i].backscatter * 0.1, d->datagram.rra_70.beam[i].beam_number);
-                }
-            }
+    memset (&(p->header), 0, sizeof (emx_datagram_header));
+    memset (&(p->info), 0, sizeof (emx_datagram_wc_info));
+    p->beamData = NULL;
+    p->offset = NULL;
+    p->num_beams = 0;
+    p->max_samples = 0;
+    p->data_size = 0;
+    p->data_alloc = 0;
+    p->offset_alloc = 0;
+    p->next_datagram = 0;
+    p->complete = 0;
+}
 
-            break;
 
-        case EMX_DATAGRAM_RRA_102 :
+/******************************************************************************
+*
+* emx_free_wc_ping - Free the memory used by the water column ping P.
+*
+******************************************************************************/
 
-            fprintf (fp, "\
-tx_sectors            : %u\n\
-num_beams             : %u\n\
-sample_rate           : %0.2f Hz\n\
-rov_depth             : %0.2f m\n\
-sound_speed           : %0.1f m/s\n\
-max_beams             : %u\n", d->datagram.rra_102.info->tx_sectors, d->datagram.rra_102.info->num_beams,
-                d->datagram.rra_102.info->sample_rate * 0.01, d->datagram.rra_102.info->rov_depth * 0.01,
-                d->datagram.rra_102.info->sound_speed * 0.1, d->datagram.rra_102.info->max_beams);
+void emx_free_wc_ping (
+    emx_wc_ping *p) {
 
-            for (i=0; i<d->datagram.rra_102.info->tx_sectors; i++) {
+    assert (p);
 
-                fprintf (fp, "\
----- Sector [ %d ] -----\n\
-tx_tilt_angle         : %0.2f deg\n\
-focus_range           : %0.1f m\n\
-signal_length         : %u ms\n\
-tx_offset             : %u ms\n\
-center_freq           : %u Hz\n\
-signal_bandwidth      : %0.0f Hz\n\
-signal_waveform_id    : %u\n\
-tx_sector             : %u\n", i, d->datagram.rra_102.tx_beam[i].tx_tilt_angle * 0.01, d->datagram.rra_102.tx_beam[i].focus_range * 0.1,
-                    d->datagram.rra_102.tx_beam[i].signal_length, d->datagram.rra_102.tx_beam[i].tx_offset, d->datagram.rra_102.tx_beam[i].center_freq,
-                    d->datagram.rra_102.tx_beam[i].signal_bandwidth * 10.0, d->datagram.rra_102.tx_beam[i].signal_waveform_id, d->datagram.rra_102.tx_beam[i].tx_sector);
-            }
+    if (p->beamData) cpl_free (p->beamData);
+    if (p->offset) cpl_free (p->offset);
 
-            if (output_level > 0) {
+    emx_init_wc_ping (p);
+}
 
-                for (i=0; i<d->datagram.rra_102.info->num_beams; i++) {
 
-                    fprintf (fp, "\
----- RX_Beam [ %d ] -----\n\
-rx_beam_angle         : %0.2f deg\n\
-range                 : %0.2f\n\
-tx_sector_number      : %u\n\
-backscatter           : %0.1f dB\n\
-quality_factor        : %u\n\
-detect_window_length  : %u\n\
-beam_number           : %d\n", i, d->datagram.rra_102.rx_beam[i].rx_beam_angle * 0.01, d->datagram.rra_102.rx_beam[i].range * 0.25,
-                        d->datagram.rra_102.rx_beam[i].tx_sector_number, d->datagram.rra_102.rx_beam[i].backscatter * 0.5,
-                        d->datagram.rra_102.rx_beam[i].quality_factor, d->datagram.rra_102.rx_beam[i].detect_window_length,
-                        d->datagram.rra_102.rx_beam[i].beam_number);
-                }
-            }
+/******************************************************************************
+*
+* emx_add_wc_ping - Add the water column datagram D to the ping P.  The RX
+*   beams of a ping are split over info->num_datagrams datagrams, which are
+*   matched by the ping counter and datagram_number, and the beams are copied
+*   one after the other so the ping is still available after the datagram
+*   buffer is reused by emx_read().  A datagram with datagram_number 1 starts a
+*   new ping, and a datagram that is out of sequence discards the ping being
+*   assembled.  The memory of the ping is reused for the next ping, so no memory
+*   is allocated once the largest ping has been seen.  The beams of a complete
+*   ping are found with emx_get_wc_ping_beam() and emx_get_wc_matrix().  If the
+*   lazy swap mode is set, then D must be returned by emx_get_array_data().
+*
+* Return: 1 if the ping is complete,
+*         0 if more datagrams of the ping are needed,
+*         CS_EINVAL if D is not a water column datagram,
+*         CS_EBADDATA if the RX beams do not fit in the datagram, or
+*         CS_ENOMEM if memory could not be allocated.
+*
+******************************************************************************/
 
-            break;
+int emx_add_wc_ping (
+    emx_wc_ping *p,
+    const emx_data *d) {
 
-        case EMX_DATAGRAM_RRA_78 :
+    const emx_datagram_wc_rx_beam_info *beam_info;
+    const emx_datagram_wc_info *info;
+    emx_datagram_wc_rx_beam rx_beam;
+    const uint8_t *end;
+    const uint8_t *q;
+    uint8_t *data;
+    size_t *offset;
+    size_t size;
+    size_t alloc;
+    size_t n, i;
 
-            fprintf (fp, "\
-sound_speed           : %0.1f m/s\n\
-tx_sectors            : %u\n\
-num_beams             : %u\n\
-valid_beams           : %u\n\
-sample_rate           : %0.2f Hz\n\
-dscale                : %u\n", d->datagram.rra_78.info->sound_speed * 0.1, d->datagram.rra_78.info->tx_sectors,
-                d->datagram.rra_78.info->num_beams, d->datagram.rra_78.info->valid_beams,
-                d->datagram.rra_78.info->sample_rate, d->datagram.rra_78.info->dscale);
 
-            for (i=0; i<d->datagram.rra_78.info->tx_sectors; i++) {
+    assert (p);
+    assert (d);
 
-                fprintf (fp, "\
----- Sector [ %d ] -----\n\
-tx_tilt_angle         : %0.2f deg\n\
-focus_range           : %0.1f m\n\
-signal_length         : %0.6f s\n\
-sector_tx_delay       : %0.6f s\n\
-center_freq           : %0.1f Hz\n\
-mean_absorption       : %0.2f dB/km\n\
-signal_waveform_id    : %u\n\
-transmit_sector       : %u\n\
-signal_bandwidth      : %0.0f Hz\n", i, d->datagram.rra_78.tx_beam[i].tx_tilt_angle * 0.01, d->datagram.rra_78.tx_beam[i].focus_range * 0.1,
-                    d->datagram.rra_78.tx_beam[i].signal_length, d->datagram.rra_78.tx_beam[i].sector_tx_delay, d->datagram.rra_78.tx_beam[i].center_freq,
-                    d->datagram.rra_78.tx_beam[i].mean_absorption * 0.01, d->datagram.rra_78.tx_beam[i].signal_waveform_id, d->datagram.rra_78.tx_beam[i].tx_sector,
-                    d->datagram.rra_78.tx_beam[i].signal_bandwidth);
-            }
+    if ((d->header.datagram_type != EMX_DATAGRAM_WATER_COLUMN) || !d->datagram.wc.info) return CS_EINVAL;
 
-            if (output_level > 0) {
+    info = d->datagram.wc.info;
 
-                for (i=0; i<d->datagram.rra_78.info->num_beams; i++) {
+    /* The RX beams end before the end identifier and the checksum, and the sample
+       counts are checked before anything is copied from the datagram. */
+    n = d->header.bytes_in_datagram + sizeof (uint32_t) - sizeof (emx_datagram_header);
+    end = (const uint8_t *) info + ((n > 3) ? n - 3 : 0);
 
-                    fprintf (fp, "\
------ Beam [ %d ] -----\n\
-rx_beam_angle         : %0.2f deg\n\
-tx_sector_number      : %u\n\
-detection_info        : %u\n\
-detect_window_length  : %u\n\
-quality_factor        : %u\n\
-dcorr                 : %d\n\
-two_way_travel_time   : %0.5f s\n\
-backscatter           : %0.1f dB\n\
-system_cleaning       : %d\n", i, d->datagram.rra_78.rx_beam[i].rx_beam_angle / 100.0, d->datagram.rra_78.rx_beam[i].tx_sector_number, d->datagram.rra_78.rx_beam[i].detection_info,
-                        d->datagram.rra_78.rx_beam[i].detect_window_length, d->datagram.rra_78.rx_beam[i].quality_factor, d->datagram.rra_78.rx_beam[i].doppler_correction,
-                        d->datagram.rra_78.rx_beam[i].two_way_travel_time, d->datagram.rra_78.rx_beam[i].backscatter / 10.0, d->datagram.rra_78.rx_beam[i].system_cleaning);
-                }
-            }
+    q = d->datagram.wc.beamData;
+    if (q > end) {
+        cpl_debug (emx_debug, "Invalid number of water column TX sectors (%u)\n", info->tx_sectors);
+        p->next_datagram = 0;
+        p->complete = 0;
+        return CS_EBADDATA;
+    }
 
-            break;
+    /* Find the size of the RX beams of this datagram. */
+    for (i=0; i<info->datagram_beams; i++) {
+        beam_info = (const emx_datagram_wc_rx_beam_info *) q;
+        if (((size_t) (end - q) < sizeof (emx_datagram_wc_rx_beam_info)) ||
+            (beam_info->num_samples > (size_t) (end - q) - sizeof (emx_datagram_wc_rx_beam_info))) {
+            cpl_debug (emx_debug, "Water column beam %lu of ping %u does not fit in the datagram\n", (unsigned long) i, d->header.counter);
+            p->next_datagram = 0;
+            p->complete = 0;
+            return CS_EBADDATA;
+        }
+        q = emx_get_wc_rxbeam (&rx_beam, q);
+    }
+    size = (size_t) (q - d->datagram.wc.beamData);
 
-        case EMX_DATAGRAM_SEABED_IMAGE_83 :
+    if ((info->datagram_number == 0) || (info->datagram_number > info->num_datagrams)) {
+        cpl_debug (emx_debug, "Invalid water column datagram number (%u of %u)\n", info->datagram_number, info->num_datagrams);
+        p->next_datagram = 0;
+        return 0;
+    }
 
-            fprintf (fp, "\
-mean_abs_coeff        : %0.2f dB/km\n\
-pulse_length          : %u us\n\
-range_norm            : %u\n\
-start_range           : %u\n\
-stop_range            : %u\n\
-normal_incidence_bs   : %0.1f dB\n\
-oblique_bs            : %0.1f dB\n\
-tx_beamwidth          : %0.1f deg\n\
-tvg_cross_over        : %0.1f deg\n\
-num_beams             : %u beams\n", d->datagram.seabed_83.info->mean_abs_coef * 0.01, d->datagram.seabed_83.info->pulse_length,
-                d->datagram.seabed_83.info->range_norm, d->datagram.seabed_83.info->start_range, d->datagram.seabed_83.info->stop_range,
-                d->datagram.seabed_83.info->normal_incidence_bs * 0.1, d->datagram.seabed_83.info->oblique_bs * 0.1,
-                d->datagram.seabed_83.info->tx_beamwidth * 0.1, d->datagram.seabed_83.info->tvg_cross_over * 0.1, d->datagram.seabed_83.info->num_beams);
+    if (info->datagram_number == 1) {
 
-            if (output_level > 0) {
+        /* Start a new ping. */
+        memcpy (&(p->header), &(d->header), sizeof (emx_datagram_header));
+        memcpy (&(p->info), info, sizeof (emx_datagram_wc_info));
+        n = info->tx_sectors;
+        if (n > EMX_WC_MAX_TX_SECTORS) n = EMX_WC_MAX_TX_SECTORS;
+        memcpy (p->txbeam, d->datagram.wc.txbeam, n * sizeof (emx_datagram_wc_tx_beam));
 
-                int num_samples = 0;
+        p->num_beams = 0;
+        p->max_samples = 0;
+        p->data_size = 0;
+        p->complete = 0;
 
-                for (i=0; i<d->datagram.seabed_83.info->num_beams; i++) {
+    } else if ((info->datagram_number != p->next_datagram) || (d->header.counter != p->header.counter) ||
+        (info->num_datagrams != p->info.num_datagrams)) {
 
-                    fprintf (fp, "\
------ Beam [ %d ] -----\n\
-beam_index            : %u\n\
-sorting_direction     : %d\n\
-num_samples           : %u\n\
-detect_sample         : %u\n", i, d->datagram.seabed_83.beam[i].beam_index, d->datagram.seabed_83.beam[i].sorting_direction,
-                        d->datagram.seabed_83.beam[i].num_samples, d->datagram.seabed_83.beam[i].detect_sample);
+        cpl_debug (emx_debug, "Water column datagram %u of %u of ping %u is out of sequence\n",
+            info->datagram_number, info->num_datagrams, d->header.counter);
+        p->next_datagram = 0;
+        p->complete = 0;
+        return 0;
+    }
 
-                    num_samples += d->datagram.seabed_83.beam[i].num_samples;
-                }
+    /* The allocated sizes are only updated once the memory is allocated. */
+    alloc = p->data_alloc;
+    data = (uint8_t *) cpl_realloc2 (p->beamData, p->data_size + size, sizeof (uint8_t), &alloc);
+    if (!data) {
+        p->next_datagram = 0;
+        return CS_ENOMEM;
+    }
+    p->beamData = data;
+    p->data_alloc = alloc;
+
+    alloc = p->offset_alloc;
+    offset = (size_t *) cpl_realloc2 (p->offset, p->num_beams + info->datagram_beams, sizeof (size_t), &alloc);
+    if (!offset) {
+        p->next_datagram = 0;
+        return CS_ENOMEM;
+    }
+    p->offset = offset;
+    p->offset_alloc = alloc;
 
-                fprintf (fp, "\
------------------------\n\
-bytes_end             : %d\n", d->datagram.seabed_83.bytes_end);
+    memcpy (p->beamData + p->data_size, d->datagram.wc.beamData, size);
 
-                if (output_level > 1) {
-                    fputs ("\
-amplitude             : ", fp);
+    q = p->beamData + p->data_size;
+    for (i=0; i<info->datagram_beams; i++) {
+        p->offset[p->num_beams++] = (size_t) (q - p->beamData);
+        q = emx_get_wc_rxbeam (&rx_beam, q);
 
-                    for (i=0; i<num_samples; i++) {
+        if (rx_beam.info->num_samples > p->max_samples) {
+            p->max_samples = rx_beam.info->num_samples;
+        }
+    }
+    p->data_size += size;
 
-                        fprintf (fp, "%0.1f ", d->datagram.seabed_83.amplitude[i] * 0.5);
-                    }
+    if (info->datagram_number < info->num_datagrams) {
+        p->next_datagram = info->datagram_number + 1;
+        return 0;
+    }
 
-                    fputc ('\n', fp);
-                }
-            }
+    if (p->num_beams != p->info.num_beams) {
+        cpl_debug (emx_debug, "Water column ping %u has %lu of %u beams\n", p->header.counter,
+            (unsigned long) p->num_beams, p->info.num_beams);
+    }
 
-            break;
+    p->next_datagram = 0;
+    p->complete = 1;
 
-        case EMX_DATAGRAM_SEABED_IMAGE_89 :
+    return 1;
+}
 
-            fprintf (fp, "\
-sample_rate           : %0.2f Hz (%0.2f m)\n\
-range_norm            : %u samples\n\
-normal_incidence_bs   : %0.1f dB\n\
-oblique_bs            : %0.1f dB\n\
-tx_beamwidth          : %0.1f deg\n\
-tvg_cross_over        : %0.1f deg\n\
-num_beams             : %u beams\n", d->datagram.seabed_89.info->sample_rate, 750.0 / d->datagram.seabed_89.info->sample_rate,
-                d->datagram.seabed_89.info->range_norm, 0.1 * d->datagram.seabed_89.info->normal_incidence_bs, 0.1 * d->datagram.seabed_89.info->oblique_bs,
-                0.1 * d->datagram.seabed_89.info->tx_beamwidth, 0.1 * d->datagram.seabed_89.info->tvg_cross_over, d->datagram.seabed_89.info->num_beams);
 
-            if (output_level > 0) {
+/******************************************************************************
+*
+* emx_get_wc_ping_beam - Set the pointers in the Rx beam data object D for the
+*   BEAM_NUM beam of the water column ping P.
+*
+* Return: 0 if the beam was found, or
+*         CS_EINVAL if the ping is not complete or BEAM_NUM is not in the ping.
+*
+******************************************************************************/
 
-                int num_samples = 0;
+int emx_get_wc_ping_beam (
+    const emx_wc_ping *p,
+    const size_t beam_num,
+    emx_datagram_wc_rx_beam *d) {
 
-                for (i=0; i<d->datagram.seabed_89.info->num_beams; i++) {
+    assert (p);
+    assert (d);
 
-                    fprintf (fp, "\
------ Beam [ %d ] -----\n\
-sorting_direction     : %d\n\
-detection_info        : %u\n\
-num_samples           : %u\n\
-detect_sample         : %u\n", i, d->datagram.seabed_89.beam[i].sorting_direction, d->datagram.seabed_89.beam[i].detection_info,
-                        d->datagram.seabed_89.beam[i].num_samples, d->datagram.seabed_89.beam[i].detect_sample);
+    if (!p->complete || (beam_num >= p->num_beams)) return CS_EINVAL;
 
-                    num_samples += d->datagram.seabed_89.beam[i].num_samples;
-                }
+    emx_get_wc_rxbeam (d, p->beamData + p->offset[beam_num]);
 
-                fprintf (fp, "\
------------------------\n\
-bytes_end             : %d\n", d->datagram.seabed_89.bytes_end);
+    return CS_ENONE;
+}
 
-                if (output_level > 1) {
-                    fputs ("\
-amplitude             : ", fp);
 
-                    for (i=0; i<num_samples; i++) {
+/******************************************************************************
+*
+* emx_write_wc_file - Write the water column datagrams read from the file
+*   handle H to the compressed water column file given by FILE_NAME.  The
+*   datagrams are read from the current position to the end of the file with
+*   emx_read(), so the read options of H apply, and are stored in the native
+*   byte order.  The amplitude samples of each beam are delta coded before the
+*   datagram is rANS encoded, and the datagrams are read back by
+*   emx_wc_file_read().  Setting a type filter of only water column datagrams
+*   on H avoids parsing the other datagrams.
+*
+* Return: 0 if the file was written successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EOPEN
+*         CS_ENOMEM
+*         CS_EWRITE
+*         Any error of emx_read()
+*
+******************************************************************************/
 
-                        fprintf (fp, "%0.1f ", d->datagram.seabed_89.amplitude[i] * 0.1);
-                    }
+int emx_write_wc_file (
+    emx_handle *h,
+    const char *file_name) {
 
-                    fputc ('\n', fp);
-                }
-            }
+    cpl_wcfile *w;
+    emx_data *d;
+    uint8_t *buffer = NULL;
+    uint8_t *p;
+    size_t buffer_size = 0;
+    size_t alloc;
+    size_t size;
+    int64_t time;
+    int status = CS_ENONE;
 
-            break;
 
-        case EMX_DATAGRAM_WATER_COLUMN :
+    assert (h);
+    assert (file_name);
 
-            fprintf (fp, "\
-num_datagrams         : %u\n\
-datagram_number       : %u\n\
-tx_sectors            : %u\n\
-num_beams             : %u\n\
-datagram_beams        : %u\n\
-sound_speed           : %0.1f m/s\n\
-sample_rate           : %0.2f Hz (%0.2f m)\n\
-tx_heave              : %d cm\n\
-tvg_function          : %u\n\
-tvg_offset            : %d dB\n\
-scanning_info         : %u\n", d->datagram.wc.info->num_datagrams, d->datagram.wc.info->datagram_number, d->datagram.wc.info->tx_sectors,
-                d->datagram.wc.info->num_beams, d->datagram.wc.info->datagram_beams, d->datagram.wc.info->sound_speed * 0.1, d->datagram.wc.info->sample_rate * 0.01,
-                750.0 / (0.01 * d->datagram.wc.info->sample_rate), d->datagram.wc.info->tx_heave, d->datagram.wc.info->tvg_function,
-                d->datagram.wc.info->tvg_offset, d->datagram.wc.info->scanning_info);
+    w = cpl_wcfile_create (file_name, CPL_WCFILE_EMX);
+    if (!w) {
+        cpl_debug (emx_debug, "Failed to create water column file\n");
+        return CS_EOPEN;
+    }
 
-            for (i=0; i<d->datagram.wc.info->tx_sectors; i++) {
-                fprintf (fp, "\
----- Sector [ %d ] -----\n\
-tx_tilt_angle         : %0.2f deg\n\
-center_freq           : %0.0f Hz\n\
-tx_sector             : %u\n", i, d->datagram.wc.txbeam[i].tx_tilt_angle / 100.0, d->datagram.wc.txbeam[i].center_freq * 10.0, d->datagram.wc.txbeam[i].tx_sector);
-            }
+    while ((d = emx_read (h)) != NULL) {
+        if ((d->header.datagram_type != EMX_DATAGRAM_WATER_COLUMN) || !d->datagram.wc.info) continue;
 
-            if (output_level > 0) {
+        /* The samples are delta coded in native byte order, so swap any arrays left by the lazy mode. */
+        if (h->swap_pending) {
+            emx_swap_arrays (&h->d.datagram, h->d.header.datagram_type);
+            h->swap_pending = 0;
+        }
 
-                emx_datagram_wc_rx_beam wc_rx_beam;
-                const uint8_t *p = d->datagram.wc.beamData;
+        /* The header and the body are copied, so the samples can be delta coded. */
+        size = sizeof (emx_datagram_header) + h->body_size;
 
-                for (i=0; i<d->datagram.wc.info->datagram_beams; i++) {
+        if (size > buffer_size) {
+            alloc = buffer_size;
+            p = (uint8_t *) cpl_realloc2 (buffer, size, sizeof (uint8_t), &alloc);
+            if (!p) {
+                status = CS_ENOMEM;
+                break;
+            }
+            buffer = p;
+            buffer_size = alloc;
+        }
 
-                    p = emx_get_wc_rxbeam (&wc_rx_beam, p);
+        memcpy (buffer, &(d->header), sizeof (emx_datagram_header));
+        memcpy (buffer + sizeof (emx_datagram_header), h->body, h->body_size);
 
-                    fprintf (fp, "\
------ Beam [ %d ] ------\n\
-beam_angle            : %0.2f deg\n\
-start_range           : %u\n\
-num_samples           : %u\n\
-detected_range        : %u\n\
-tx_sector             : %u\n\
-beam_index            : %u\n", i, wc_rx_beam.info->beam_angle / 100.0, wc_rx_beam.info->start_range, wc_rx_beam.info->num_samples,
-                        wc_rx_beam.info->detected_range, wc_rx_beam.info->tx_sector, wc_rx_beam.info->beam_index);
+        p = buffer + sizeof (emx_datagram_header) + ((const char *) d->datagram.wc.beamData - h->body);
+        if (p <= buffer + size) {
+            emx_delta_wc (p, buffer + size, d->datagram.wc.info->datagram_beams, 0);
+        }
 
-                    if (output_level > 1) {
-                        int j;
+        /* Datagrams with an invalid date are kept at time zero. */
+        if (emx_nav_time (h, d->header.date, d->header.time_ms, &time) != CS_ENONE) time = 0;
 
-                        fputs ("\
-amplitude             : ", fp);
+        status = cpl_wcfile_write (w, buffer, size, time, d->header.counter);
+        if (status != CS_ENONE) break;
+    }
 
-                        for (j=0; j<wc_rx_beam.info->num_samples; j++) {
-                            fprintf (fp, "%0.1f ", wc_rx_beam.amplitude[j] * 0.5);
-                        }
+    if (status == CS_ENONE) status = h->emx_errno;
 
-                        fputc ('\n', fp);
-                    }
-                }
-            }
+    if (buffer) cpl_free (buffer);
 
-            break;
+    if ((cpl_wcfile_close (w) != CS_ENONE) && (status == CS_ENONE)) status = CS_EWRITE;
 
-        case EMX_DATAGRAM_QUALITY_FACTOR :
+    return status;
+}
 
-            fprintf (fp, "\
-num_beams             : %u\n\
-npar                  : %u\n", d->datagram.qf.info->num_beams, d->datagram.qf.info->npar);
 
-            if (output_level > 0) {
+/******************************************************************************
+*
+* emx_wc_file_open - Open the compressed water column file given by FILE_NAME,
+*   which was written by emx_write_wc_file().  The caller must call
+*   emx_wc_file_close() to close the file after use.
+*
+* Return: A pointer to the water column file, or
+*         NULL if the file could not be opened, is not a valid EMX water
+*           column file, or memory allocation failed.
+*
+******************************************************************************/
 
-                fputs ("\
-quality_factor        : ", fp);
+emx_wc_file * emx_wc_file_open (
+    const char *file_name) {
 
-                for (i=0; i<d->datagram.qf.info->num_beams; i++) {
-                    fprintf (fp, "%0.1f ", d->datagram.qf.data[i]);
-                }
-                fputc ('\n', fp);
-            }
+    emx_wc_file *f;
 
-            break;
 
-        case EMX_DATAGRAM_ATTITUDE :
+    assert (file_name);
 
-            fprintf (fp, "\
-num_entries           : %u\n\
-sensor_sys_descriptor : %d\n", d->datagram.attitude.info->num_entries, d->datagram.attitude.sensor_system_descriptor);
+    f = (emx_wc_file *) cpl_malloc (sizeof (emx_wc_file));
+    if (!f) return NULL;
 
-            if (output_level > 0) {
+    f->w = cpl_wcfile_open (file_name, CPL_WCFILE_EMX);
+    if (!f->w) {
+        cpl_free (f);
+        return NULL;
+    }
 
-                for (i=0; i<d->datagram.attitude.info->num_entries; i++) {
+    memset (&(f->d), 0, sizeof (emx_data));
+    f->emx_errno = CS_ENONE;
 
-                    fprintf (fp, "\
------ Entry [ %d ] -----\n\
-record_time           : %0.3f s\n\
-status                : %u\n\
-roll                  : %0.2f deg\n\
-pitch                 : %0.2f deg\n\
-heave                 : %d cm\n\
-heading               : %0.2f deg\n", i, d->datagram.attitude.data[i].record_time / 1000.0, d->datagram.attitude.data[i].status, d->datagram.attitude.data[i].roll * 0.01,
-                        d->datagram.attitude.data[i].pitch * 0.01, d->datagram.attitude.data[i].heave, d->datagram.attitude.data[i].heading * 0.01);
-                }
-            }
+    return f;
+}
 
-            break;
 
-        case EMX_DATAGRAM_ATTITUDE_NETWORK :
+/******************************************************************************
+*
+* emx_wc_file_close - Close the water column file F and free it.
+*
+* Return: 0 if the file is successfully closed, or
+*         error condition if an error occurred.
+*
+******************************************************************************/
 
-            fprintf (fp, "\
-num_entries           : %u\n\
-sensor_sys_descriptor : %d\n", d->datagram.attitude_network.info->num_entries, d->datagram.attitude_network.info->sensor_system_descriptor);
+int emx_wc_file_close (
+    emx_wc_file *f) {
 
-            if (output_level > 0) {
+    int status = CS_ENONE;
 
-                emx_datagram_attitude_network_data attitude_data;
-                const uint8_t *p = d->datagram.attitude_network.data;
 
-                for (i=0; i<d->datagram.attitude_network.info->num_entries; i++) {
+    if (f) {
+        status = cpl_wcfile_close (f->w);
+        cpl_free (f);
+    }
 
-                    p = emx_get_attitude_network_data (&attitude_data, p);
+    return status;
+}
 
-                    fprintf (fp, "\
------ Entry [ %d ] -----\n\
-record_time           : %0.3f s\n\
-roll                  : %0.2f deg\n\
-pitch                 : %0.2f deg\n\
-heave                 : %0.2f m\n\
-heading               : %0.2f deg\n\
-num_bytes_input       : %u Bytes\n", i, attitude_data.info->record_time / 1000.0, attitude_data.info->roll * 0.01, attitude_data.info->pitch * 0.01, attitude_data.info->heave * 0.01,
-                        attitude_data.info->heading * 0.01, attitude_data.info->num_bytes_input);
 
-                    if (output_level > 1) {
-                        int j;
+/******************************************************************************
+*
+* emx_wc_file_read - Read and decode the water column datagram number N of the
+*   water column file F.  The datagram has the same pointer setup as emx_read(),
+*   so the datagrams of a ping can be joined by emx_add_wc_ping() and the beams
+*   parsed by emx_get_wc_rxbeam().  Only this datagram is read from the file.
+*   The datagram is valid until the next call using F.
+*
+* Return: A pointer to the data struct, or
+*         NULL if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EREAD
+*         CS_EBADDATA
+*
+******************************************************************************/
 
-                        fputs ("\
-message               : ", fp);
+emx_data * emx_wc_file_read (
+    emx_wc_file *f,
+    const size_t n) {
 
-                        for (j=0; j<attitude_data.info->num_bytes_input; j++) {
-                            fprintf (fp, "%d ", attitude_data.message[j]);
-                        }
+    const cpl_wcfile_entry *e;
+    emx_datagram_wc_info *info;
+    uint8_t *data;
+    uint8_t *p;
+    size_t size;
+    int status;
 
-                        fputc ('\n', fp);
-                    }
-                }
-            }
 
-            break;
+    assert (f);
 
-        case EMX_DATAGRAM_CLOCK :
+    status = cpl_wcfile_read (f->w, n, &data);
+    if (status != CS_ENONE) {
+        f->emx_errno = status;
+        return NULL;
+    }
 
-            fprintf (fp, "\
-date                  : %u\n\
-time_ms               : %u ms\n\
-PPS                   : %u\n", d->datagram.clock.info->date, d->datagram.clock.info->time_ms, d->datagram.clock.info->PPS);
+    e = cpl_wcfile_get_entry (f->w, n);
 
-            break;
+    if (e->size < sizeof (emx_datagram_header) + sizeof (emx_datagram_wc_info)) goto L1;
 
-        case EMX_DATAGRAM_HEIGHT :
+    memcpy (&(f->d.header), data, sizeof (emx_datagram_header));
+    if (f->d.header.datagram_type != EMX_DATAGRAM_WATER_COLUMN) goto L1;
 
-            fprintf (fp, "\
-height                : %d cm\n\
-height_type           : %u\n", d->datagram.height.info->height, d->datagram.height.info->height_type);
+    p = data + sizeof (emx_datagram_header);
+    info = (emx_datagram_wc_info *) p;
 
-            break;
+    if (info->tx_sectors > EMX_MAX_TX_SECTORS) goto L1;
 
-        case EMX_DATAGRAM_HEADING :
+    size = sizeof (emx_datagram_wc_info) + info->tx_sectors * sizeof (emx_datagram_wc_tx_beam);
+    if (size > e->size - sizeof (emx_datagram_header)) goto L1;
 
-            fprintf (fp, "\
-num_entries           : %u\n\
-heading_indicator     : %u\n", d->datagram.heading.info->num_entries, d->datagram.heading.heading_indicator);
+    f->d.datagram.wc.info = info;
+    f->d.datagram.wc.txbeam = (emx_datagram_wc_tx_beam *) (p + sizeof (emx_datagram_wc_info));
+    f->d.datagram.wc.beamData = p + size;
 
-            if (output_level > 0) {
-                for (i=0; i<d->datagram.heading.info->num_entries; i++) {
+    emx_delta_wc (f->d.datagram.wc.beamData, data + e->size, info->datagram_beams, 1);
 
-                    fprintf (fp, "\
------ Entry [ %d ] -----\n\
-record_time           : %u ms\n\
-heading               : %0.2f deg\n", i, d->datagram.heading.data[i].record_time, d->datagram.heading.data[i].heading * 0.01);
-                }
-            }
+    f->emx_errno = CS_ENONE;
 
-            break;
+    return &(f->d);
 
-        case EMX_DATAGRAM_POSITION :
+L1: cpl_debug (emx_debug, "Invalid water column file datagram (%lu)\n", (unsigned long) n);
+    f->emx_errno = CS_EBADDATA;
+    return NULL;
+}
 
-            if (d->datagram.position.info->latitude == EMX_NULL_INT32) {
-                fputs ("latitude              : INVALID\n", fp);
-            } else {
-                fprintf (fp, "latitude              : %0.5f deg\n", d->datagram.position.info->latitude / 20000000.0);
-            }
 
-            if (d->datagram.position.info->longitude == EMX_NULL_INT32) {
-                fputs ("longitude             : INVALID\n", fp);
-            } else {
-                fprintf (fp, "longitude             : %0.5f deg\n", d->datagram.position.info->longitude / 10000000.0);
-            }
+/******************************************************************************
+*
+* emx_wc_file_get_num_datagrams - Return the number of water column datagrams
+*   of the water column file F.
+*
+******************************************************************************/
 
-            if (d->datagram.position.info->position_fix_quality == EMX_NULL_UINT16) {
-                fputs ("position_fix_quality  : INVALID\n", fp);
-            } else {
-                fprintf (fp, "position_fix_quality  : %0.2f m\n", d->datagram.position.info->position_fix_quality / 100.0);
-            }
+size_t emx_wc_file_get_num_datagrams (
+    const emx_wc_file *f) {
 
-            if (d->datagram.position.info->vessel_speed == EMX_NULL_UINT16) {
-                fputs ("vessel_speed          : INVALID\n", fp);
-            } else {
-                fprintf (fp, "vessel_speed          : %0.2f m/s\n", d->datagram.position.info->vessel_speed / 100.0);
-            }
+    assert (f);
+    return cpl_wcfile_get_num_entries (f->w);
+}
 
-            if (d->datagram.position.info->vessel_course == EMX_NULL_UINT16) {
-                fputs ("vessel_course         : INVALID\n", fp);
-            } else {
-                fprintf (fp, "vessel_course         : %0.2f deg\n", 0.01 * d->datagram.position.info->vessel_course);
-            }
 
-            if (d->datagram.position.info->vessel_heading == EMX_NULL_UINT16) {
-                fputs ("vessel_heading        : INVALID\n", fp);
-            } else {
-                fprintf (fp, "vessel_heading        : %0.2f deg\n", 0.01 * d->datagram.position.info->vessel_heading);
-            }
+/******************************************************************************
+*
+* emx_wc_file_get_entry - Return the index entry of the water column datagram
+*   number N of the water column file F, which gives the time and ping counter
+*   of the datagram without reading it, or NULL if N is not a valid datagram
+*   number.
+*
+******************************************************************************/
 
-            fprintf (fp, "position_system       : %u\n", d->datagram.position.info->position_system);
+const cpl_wcfile_entry * emx_wc_file_get_entry (
+    const emx_wc_file *f,
+    const size_t n) {
 
-            if ((d->datagram.position.info->position_system & 3) == 1) {
-                fprintf (fp, "position_system       : Positioning System 1\n");
-            }
+    assert (f);
+    return cpl_wcfile_get_entry (f->w, n);
+}
 
-            if ((d->datagram.position.info->position_system & 3) == 2) {
-                fprintf (fp, "position_system       : Positioning System 2\n");
-            }
 
-            if ((d->datagram.position.info->position_system & 3) == 3) {
-                fprintf (fp, "position_system       : Positioning System 3\n");
-            }
+/******************************************************************************
+*
+* emx_wc_file_find_time - Return the number of the first water column datagram
+*   of the water column file F at or after the DATE (year*10000 + month*100 +
+*   day) and TIME_MS since midnight, or the number of datagrams if there is
+*   none or the date is invalid.
+*
+******************************************************************************/
 
-            if ((d->datagram.position.info->position_system & 192) == 128) {
-                fprintf (fp, "position_system       : Positioning System Active, System Time Used\n");
-            }
+size_t emx_wc_file_find_time (
+    const emx_wc_file *f,
+    const uint32_t date,
+    const uint32_t time_ms) {
 
-            if ((d->datagram.position.info->position_system & 192) == 192) {
-                fprintf (fp, "position_system       : Positioning System Active, Input Datagram Used\n");
-            }
+    double day;
 
-            fprintf (fp, "bytes_in_input        : %u Bytes\n", d->datagram.position.info->bytes_in_input);
 
-            fputs ("\
-message               : ", fp);
+    assert (f);
 
-            /* TODO: Check if message is binary and print in hex. */
-            for (i=0; i<d->datagram.position.info->bytes_in_input; i++) {
-                if (d->datagram.position.message[i] == '\0') break;
-                if ((d->datagram.position.message[i] != '\n') && (d->datagram.position.message[i] != '\r')) {
-                    if (CPL_ISALNUM (d->datagram.position.message[i])) {
-                        fprintf (fp, "%c", d->datagram.position.message[i]);
-                    }
-                }
-            }
-            fputc ('\n', fp);
+    day = cpl_mktime ((int) (date / 10000), (int) ((date / 100) % 100), (int) (date % 100), 0, 0, 0.0);
+    if (day < 0) return cpl_wcfile_get_num_entries (f->w);
 
-            break;
+    return cpl_wcfile_find_time (f->w, (int64_t) day * 1000000000 + (int64_t) time_ms * 1000000);
+}
 
-        case EMX_DATAGRAM_SINGLE_BEAM_DEPTH :
 
-            fprintf (fp, "\
-date                  : %u\n\
-time_ms               : %u ms\n\
-depth                 : %0.2f m\n\
-source                : %c\n", d->datagram.sb_depth.info->date, d->datagram.sb_depth.info->time_ms, d->datagram.sb_depth.info->depth * 0.01,
-                d->datagram.sb_depth.info->source);
+/******************************************************************************
+*
+* emx_wc_file_get_errno - Return the error condition code of the water column
+*   file F.
+*
+******************************************************************************/
 
-            break;
+int emx_wc_file_get_errno (
+    const emx_wc_file *f) {
 
-        case EMX_DATAGRAM_TIDE :
+    assert (f);
+    return f->emx_errno;
+}
 
-            fprintf (fp, "\
-date                  : %u\n\
-time_ms               : %u ms\n\
-tide_offset           : %0.2f m\n", d->datagram.tide.info->date, d->datagram.tide.info->time_ms, d->datagram.tide.info->tide_offset * 0.01);
 
-            break;
+/******************************************************************************
+*
+* emx_get_wc_matrix - Fill the dense matrix AMPLITUDE with the samples of the
+*   RX beams of the water column ping P.  The matrix stores one beam per row of
+*   ROW_SIZE floats, which must be at least the max_samples of the ping, so the
+*   caller must provide num_beams * ROW_SIZE floats.  The amplitudes are
+*   converted from 0.5 dB to dB, and samples past the num_samples of a beam are
+*   set to NaN.
+*
+* Return: 0 if the matrix was filled, or
+*         CS_EINVAL if the ping is not complete or ROW_SIZE is less than
+*           max_samples.
+*
+******************************************************************************/
 
-        case EMX_DATAGRAM_SSSV :
+int emx_get_wc_matrix (
+    const emx_wc_ping *p,
+    float *amplitude,
+    const size_t row_size) {
 
-            fprintf (fp, "\
-num_samples           : %u\n", d->datagram.sssv.info->num_samples);
+    emx_datagram_wc_rx_beam rx_beam;
+    size_t num_samples;
+    size_t i, j;
+    float *out;
 
-            if (output_level > 0) {
 
-                for (i=0; i<d->datagram.sssv.info->num_samples; i++) {
+    assert (p);
+    assert (amplitude);
 
-                    fprintf (fp, "\
------ Sample [ %d ] ----\n\
-record_time           : %u s\n\
-sound_speed           : %0.1f m/s\n", i, d->datagram.sssv.data[i].record_time, d->datagram.sssv.data[i].sound_speed / 10.0);
-                }
-            }
+    if (!p->complete || (row_size < p->max_samples)) return CS_EINVAL;
 
-            break;
+    for (i=0; i<p->num_beams; i++) {
 
-        case EMX_DATAGRAM_SVP :
+        emx_get_wc_rxbeam (&rx_beam, p->beamData + p->offset[i]);
+        num_samples = rx_beam.info->num_samples;
+        out = amplitude + i * row_size;
 
-            fprintf (fp, "\
-date                  : %u\n\
-time_ms               : %u ms\n\
-num_samples           : %u\n\
-depth_resolution      : %u cm\n", d->datagram.svp.info->date, d->datagram.svp.info->time_ms, d->datagram.svp.info->num_samples,
-                d->datagram.svp.info->depth_resolution);
+        if (num_samples > 0) {
+            cpl_convert_samples8 (out, rx_beam.amplitude, num_samples, 0.5f);
+        }
 
-            if (output_level > 0) {
+        for (j=num_samples; j<row_size; j++) {
+            out[j] = NAN;
+        }
+    }
 
-                for (i=0; i<d->datagram.svp.info->num_samples; i++) {
+    return CS_ENONE;
+}
 
-                    fprintf (fp, "\
------ Sample [ %d ] ----\n\
-depth                 : %0.2f m\n\
-sound_speed           : %0.1f m/s\n", i, d->datagram.svp.data[i].depth * 0.01, d->datagram.svp.data[i].sound_speed * 0.1);
-                }
-            }
 
-            break;
+/******************************************************************************
+*
+* emx_get_attitude_network_data - The attitude network data stored in the EMX
+*   format consists of the emx_datagram_attitude_network_data_info struct
+*   followed by num_bytes_input of the attitude message.  This function will
+*   set the pointers in the attitude network data object D for the data stream
+*   starting at P.  The start of the next attitude network data stream will be
+*   returned.
+*
+******************************************************************************/
 
-        case EMX_DATAGRAM_SVP_EM3000 :
+const uint8_t * emx_get_attitude_network_data (
+    emx_datagram_attitude_network_data *d,
+    const uint8_t *p) {
 
-            fprintf (fp, "\
-date                  : %u\n\
-time_ms               : %u ms\n\
-num_samples           : %u\n\
-depth_resolution      : %u cm\n", d->datagram.svp_em3000.info->date, d->datagram.svp_em3000.info->time_ms, d->datagram.svp_em3000.info->num_samples,
-                d->datagram.svp_em3000.info->depth_resolution);
+    assert (d);
+    assert (p);
 
-            if (output_level > 0) {
+    d->info = (emx_datagram_attitude_network_data_info *) p;
+    p = p + sizeof (emx_datagram_attitude_network_data_info);
+    d->message = (uint8_t *) p;
+    p = p + d->info->num_bytes_input;
 
-                for (i=0; i<d->datagram.svp_em3000.info->num_samples; i++) {
+    return p;
+}
 
-                    fprintf (fp, "\
------ Sample [ %d ] ----\n\
-depth                 : %0.2f m\n\
-sound_speed           : %0.1f m/s\n", i, d->datagram.svp_em3000.data[i].depth * 0.01, d->datagram.svp_em3000.data[i].sound_speed * 0.1);
-                }
-            }
 
-            break;
+/******************************************************************************
+*
+* emx_retain - Retain the datagram returned by the last call to emx_read() for
+*   the file handle H, so it stays valid after further datagrams are read.  The
+*   datagram of a memory-mapped file points into the map and is not copied,
+*   which includes all datagrams read using emx_open_mmap() that are not byte
+*   swapped.  Otherwise, the datagram body is copied to a buffer owned by the
+*   retained datagram, and its pointers are set to the copy.  The beam and
+*   sample arrays are swapped first if they were not swapped in the lazy mode
+*   set by emx_set_lazy_swap().  The buffers of released datagrams are reused,
+*   so holding a window of N pings costs N buffers that are allocated only once.
+*   The caller must call emx_release() when finished, and all retained
+*   datagrams are freed by emx_close().
+*
+* Return: A pointer to the retained emx_data struct, or
+*         NULL if no datagram was read or memory allocation failed.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*
+******************************************************************************/
 
-        case EMX_DATAGRAM_KM_SSP_OUTPUT :
+emx_data * emx_retain (
+    emx_handle *h) {
 
-            fprintf (fp, "\
-num_bytes             : %d\n", d->datagram.ssp_output.num_bytes);
+    emx_retained *r;
+    char *buffer;
 
-            fputs ("\
-data                  : ", fp);
 
-            for (i=0; i<d->datagram.ssp_output.num_bytes; i++) {
-                if (d->datagram.ssp_output.data[i] == '\0') break;
-                fputc (d->datagram.ssp_output.data[i], fp);
-            }
-            fputc ('\n', fp);
+    assert (h);
 
-            break;
+    if (!h->body) {
+        h->emx_errno = CS_EINVAL;
+        return NULL;
+    }
 
-        case EMX_DATAGRAM_INSTALL_PARAMS :
+    /* The retained copy is never swapped later, so swap any arrays left by the lazy mode. */
+    if (h->swap_pending) {
+        emx_swap_arrays (&h->d.datagram, h->d.header.datagram_type);
+        h->swap_pending = 0;
+    }
 
-            fprintf (fp, "\
-serial_number2        : %u\n\
-text_length           : %d\n", d->datagram.install_params.info->serial_number2, d->datagram.install_params.text_length);
+    /* Reuse a released datagram, which keeps its buffer, before allocating a new one. */
+    if (h->released) {
+        r = h->released;
+        h->released = r->next_free;
+    } else {
+        r = (emx_retained *) cpl_malloc (sizeof (emx_retained));
+        if (!r) {
+            h->emx_errno = CS_ENOMEM;
+            return NULL;
+        }
 
-            fputs ("\
-text                  : ", fp);
+        r->buffer = NULL;
+        r->buffer_size = 0;
+        r->next = h->retained;
+        h->retained = r;
+    }
 
-            for (i=0; i<d->datagram.install_params.text_length; i++) {
-                if (d->datagram.install_params.text[i] == '\0') break;
-                fputc (d->datagram.install_params.text[i], fp);
-            }
-            fputc ('\n', fp);
+    r->next_free = NULL;
+    r->d = h->d;
 
-            break;
+    /* Datagrams pointing into the map are never changed, so these do not need a copy. */
+    if (h->map && (h->body >= h->map) && (h->body + h->body_size <= h->map + h->map_size)) {
+        return &(r->d);
+    }
 
-        case EMX_DATAGRAM_INSTALL_PARAMS_STOP :
+    buffer = (char *) cpl_resize (r->buffer, h->body_size, sizeof (char), &(r->buffer_size));
+    if (!buffer) {
+        r->buffer = NULL;
+        r->buffer_size = 0;
+        r->next_free = h->released;
+        h->released = r;
+        h->emx_errno = CS_ENOMEM;
+        return NULL;
+    }
 
-            fprintf (fp, "\
-serial_number2        : %u\n\
-text_length           : %d\n", d->datagram.install_params_stop.info->serial_number2, d->datagram.install_params_stop.text_length);
+    r->buffer = buffer;
+    memcpy (r->buffer, h->body, h->body_size);
+    emx_relocate (&(r->d), h->body, h->body_size, r->buffer);
 
-            fputs ("\
-text                  : ", fp);
+    return &(r->d);
+}
 
-            for (i=0; i<d->datagram.install_params_stop.text_length; i++) {
-                if (d->datagram.install_params_stop.text[i] == '\0') break;
-                fputc (d->datagram.install_params_stop.text[i], fp);
-            }
-            fputc ('\n', fp);
 
-            break;
+/******************************************************************************
+*
+* emx_release - Release the datagram D retained by emx_retain() for the file
+*   handle H, so its buffer may be reused by a later call to emx_retain().  If D
+*   is NULL, then nothing is done.
+*
+******************************************************************************/
 
-        case EMX_DATAGRAM_INSTALL_PARAMS_REMOTE :
+void emx_release (
+    emx_handle *h,
+    emx_data *d) {
 
-            fprintf (fp, "\
-serial_number2        : %u\n\
-text_length           : %d\n", d->datagram.install_params_remote.info->serial_number2, d->datagram.install_params_remote.text_length);
+    emx_retained *r;
 
-            fputs ("\
-text                  : ", fp);
 
-            for (i=0; i<d->datagram.install_params_remote.text_length; i++) {
-                if (d->datagram.install_params_remote.text[i] == '\0') break;
-                fputc (d->datagram.install_params_remote.text[i], fp);
-            }
-            fputc ('\n', fp);
+    assert (h);
 
-            break;
+    if (!d) return;
 
-        case EMX_DATAGRAM_REMOTE_PARAMS_INFO :
+    /* The emx_data struct is the first member of the retained datagram. */
+    r = (emx_retained *) d;
+    r->next_free = h->released;
+    h->released = r;
+}
 
-            /* TODO: */
 
-            break;
+/******************************************************************************
+*
+* emx_print - Print the data in D to the file stream FP in a human-readable
+*   format.  The OUTPUT_LEVEL can be set to 0, 1, or 2 for increasingly more
+*   information.
+*
+******************************************************************************/
 
-        case EMX_DATAGRAM_RUNTIME_PARAMS :
+void emx_print (
+    FILE *fp,
+    const emx_data *d,
+    const int output_level) {
 
-            fprintf (fp, "\
-operator_station_stat : %u\n\
-pu_status             : %u\n\
-bsp_status            : %u\n\
-head_or_tx_status     : %u\n\
-mode                  : %u\n\
-filter_id             : %u\n\
-min_depth             : %u m\n\
-max_depth             : %u m\n\
-absorption            : %0.2f dB/km\n\
-tx_pulse_length       : %u us\n", d->datagram.runtime_params.info->operator_station_status, d->datagram.runtime_params.info->pu_status,
-                d->datagram.runtime_params.info->bsp_status, d->datagram.runtime_params.info->head_or_tx_status, d->datagram.runtime_params.info->mode,
-                d->datagram.runtime_params.info->filter_id, d->datagram.runtime_params.info->min_depth, d->datagram.runtime_params.info->max_depth,
-                d->datagram.runtime_params.info->absorption / 100.0, d->datagram.runtime_params.info->tx_pulse_length);
+    int i;
 
-            fputs ("\
-tx_beamwidth          : ", fp);
 
-            if (d->datagram.runtime_params.info->tx_beamwidth == EMX_NULL_UINT16) {
-                fputs ("INVALID\n", fp);
-            }
+    assert (fp);
 
-            fprintf (fp, "%0.1f deg\n", d->datagram.runtime_params.info->tx_beamwidth / 10.0);
+    if (!d) return;
 
-            fprintf (fp, "\
-tx_power              : %d dB\n\
-rx_beamwidth          : %0.1f deg\n\
-rx_bandwidth          : %0.0f Hz\n\
-rx_fixed_gain         : %u dB\n\
-tvg_crossover         : %u deg\n\
-sound_speed_source    : %u\n\
-max_port_swath        : %u m\n", d->datagram.runtime_params.info->tx_power, d->datagram.runtime_params.info->rx_beamwidth / 10.0,
-                d->datagram.runtime_params.info->rx_bandwidth * 50.0, d->datagram.runtime_params.info->rx_fixed_gain,
-                d->datagram.runtime_params.info->tvg_crossover, d->datagram.runtime_params.info->sound_speed_source,
-                d->datagram.runtime_params.info->max_port_swath);
+    fprintf (fp, "\
+====== DATAGRAM =======\n\
+bytes_in_datagram     : %u Bytes\n\
+start_identifier      : %u\n\
+datagram_type         : %s\n\
+em_model_number       : EM %u\n\
+date                  : %u\n\
+time_ms               : %u ms\n\
+counter               : %u\n\
+serial_number         : %u\n\
+-----------------------\n", d->header.bytes_in_datagram, d->header.start_identifier,
+        emx_get_datagram_name (d->header.datagram_type), d->header.em_model_number, d->header.date,
+        d->header.time_ms, d->header.counter, d->header.serial_number);
 
-            fputs ("\
-beam_spacing          : ", fp);
+    switch (d->header.datagram_type) {
 
-            if ((d->datagram.runtime_params.info->beam_spacing & 128) == 0) {
-                switch (d->datagram.runtime_params.info->beam_spacing) {
-                    case 0 : fputs ("Determined by beamwidth\n", fp); break;
-                    case 1 : fputs ("Equidistant\n", fp); break;
-                    case 2 : fputs ("Equiangle\n", fp); break;
-                    case 3 : fputs ("High density equidistant\n", fp); break;
-                    default : fprintf (fp, "%u\n", d->datagram.runtime_params.info->beam_spacing); break;
-                }
-            } else {
-                /* TODO: dual head. */
-            }
+        case EMX_DATAGRAM_DEPTH :
 
             fprintf (fp, "\
-max_port_coverage     : %u deg\n\
-yaw_pitch_mode        : %u\n\
-max_stbd_coverage     : %u deg\n\
-max_stbd_swath        : %u m\n\
-tx_along_tilt         : %d\n\
-filter_id2            : %u\n", d->datagram.runtime_params.info->max_port_coverage, d->datagram.runtime_params.info->yaw_pitch_mode,
-                d->datagram.runtime_params.info->max_stbd_coverage, d->datagram.runtime_params.info->max_stbd_swath,
-                d->datagram.runtime_params.info->tx_along_tilt, d->datagram.runtime_params.info->filter_id2);
-
-            break;
-
-        case EMX_DATAGRAM_EXTRA_PARAMS :
+vessel_heading        : %0.1f deg\n\
+sound_speed           : %0.1f m/s\n\
+transducer_depth      : %0.2f m\n\
+max_beams             : %u\n\
+num_beams             : %u\n\
+depth_resolution      : %u cm\n\
+horizontal_resolution : %u cm\n\
+sample_rate           : %u Hz (%0.2f m)\n\
+depth_offset_mult     : %d\n", d->datagram.depth.info->vessel_heading * 0.01, d->datagram.depth.info->sound_speed * 0.1,
+                d->datagram.depth.info->transducer_depth * 0.01, d->datagram.depth.info->max_beams, d->datagram.depth.info->num_beams,
+                d->datagram.depth.info->depth_resolution, d->datagram.depth.info->horizontal_resolution, d->datagram.depth.info->sample_rate,
+                750.0 / d->datagram.depth.info->sample_rate, d->datagram.depth.depth_offset_multiplier);
 
-            fputs ("\
-content               : ", fp);
+            if (output_level > 0) {
 
-            switch (d->datagram.extra_params.info->content) {
-                case 1 : fputs ("calib.txt\n", fp); break;
-                case 2 : fputs ("Log all heights\n", fp); break;
-                case 3 : fputs ("Sound velocity at transducer\n", fp); break;
-                case 4 : fputs ("Sound velocity profile\n", fp); break;
-                case 5 : fputs ("Multicast RX status\n", fp); break;
-                case 6 : fputs ("bscorr.txt\n", fp); break;
-                default : fprintf (fp, "%u\n", d->datagram.extra_params.info->content); break;
-            }
+                for (i=0; i<d->datagram.depth.info->num_beams; i++) {
 
-            switch (d->datagram.extra_params.info->content) {
+                    fprintf (fp, "\
+--- Sounding [ %d ] ----\n\
+depth                 : ", i);
 
-                /* TODO: */
+                    if ((emx_get_model (d->header.em_model_number) == EM_MODEL_120) || (emx_get_model (d->header.em_model_number) == EM_MODEL_121A) ||
+                        (emx_get_model (d->header.em_model_number) == EM_MODEL_300)) {
+                        fprintf (fp, "%u\n", (uint16_t) d->datagram.depth.beam[i].depth);
+                    } else {
+                        fprintf (fp, "%d\n", d->datagram.depth.beam[i].depth);
+                    }
 
-                case 6 :
                     fprintf (fp, "\
-num_chars             : %u\n\
-text                  : \n\
-%s\n", d->datagram.extra_params.data.bs_corr.num_chars, d->datagram.extra_params.data.bs_corr.text);
-                    break;
-
-                default : break;
+across_track          : %d\n\
+along_track           : %d\n\
+beam_depression_angle : %0.1f deg\n\
+beam_azimuth_angle    : %0.1f deg\n\
+range                 : %u\n\
+quality_factor        : %u\n\
+detect_window_length  : %u\n\
+backscatter           : %0.1f dB\n\
+beam_number           : %u\n", d->datagram.depth.beam[i].across_track, d->datagram.depth.beam[i].along_track,
+                        d->datagram.depth.beam[i].beam_depression_angle / 100.0, d->datagram.depth.beam[i].beam_azimuth_angle / 100.0, d->datagram.depth.beam[i].range,
+                        d->datagram.depth.beam[i].quality_factor, d->datagram.depth.beam[i].detect_window_length, d->datagram.depth.beam[i].backscatter * 0.5,
+                        d->datagram.depth.beam[i].beam_number);
+                }
             }
 
             break;
 
-        case EMX_DATAGRAM_PU_OUTPUT :
+        case EMX_DATAGRAM_DEPTH_NOMINAL :
 
             fprintf (fp, "\
-udp_port1             : %u\n\
-udp_port2             : %u\n\
-udp_port3             : %u\n\
-udp_port4             : %u\n\
-system_descriptor     : %u\n\
-pu_software_version   : %s\n\
-bsp_software_version  : %s\n\
-transceiver1_version  : %s\n\
-transceiver2_version  : %s\n\
-host_ip_address       : %u\n\
-tx_opening_angle      : %u\n\
-rx_opening_angle      : %u\n", d->datagram.pu_output.info->udp_port1, d->datagram.pu_output.info->udp_port2,
-                d->datagram.pu_output.info->udp_port3, d->datagram.pu_output.info->udp_port4, d->datagram.pu_output.info->system_descriptor,
-                d->datagram.pu_output.info->pu_software_version, d->datagram.pu_output.info->bsp_software_version,
-                d->datagram.pu_output.info->transceiver1_version, d->datagram.pu_output.info->transceiver2_version,
-                d->datagram.pu_output.info->host_ip_address, d->datagram.pu_output.info->tx_opening_angle,
-                d->datagram.pu_output.info->rx_opening_angle);
+transducer_depth      : %0.2f m\n\
+max_beams             : %u\n\
+valid_beams           : %u\n", d->datagram.depth_nominal.info->transducer_depth, d->datagram.depth_nominal.info->max_beams,
+                d->datagram.depth_nominal.info->num_beams);
 
-            break;
+            if (output_level > 0) {
 
-        case EMX_DATAGRAM_PU_STATUS :
+                for (i=0; i<d->datagram.depth_nominal.info->num_beams; i++) {
 
-            fprintf (fp, "\
-ping_rate             : %0.2f Hz\n\
-ping_counter          : %u\n\
-swath_distance        : %u\n\
-status_udp_port_2     : %u\n\
-status_serial_port_1  : %u\n\
-status_serial_port_2  : %u\n\
-status_serial_port_3  : %u\n\
-status_serial_port_4  : %u\n\
-pps_status            : %d\n\
-position_status       : %d\n\
-attitude_status       : %d\n\
-clock_status          : %d\n\
-heading_status        : %d\n\
-pu_status             : %u\n\
-heading               : %0.2f deg\n\
-roll                  : %0.2f deg\n\
-pitch                 : %0.2f deg\n\
-heave                 : %0.2f m\n\
-sound_speed           : %0.1f m/s\n\
+                    fprintf (fp, "\
+--- Sounding [ %d ] ----\n\
 depth                 : %0.2f m\n\
-velocity              : %0.2f m/s\n\
-velocity_status       : %u\n\
-ramp                  : %u\n\
-bs_oblique            : %d dB\n\
-bs_normal             : %d dB\n\
-gain                  : %d dB\n\
-depth_normal          : %u m\n\
-range_normal          : %u m\n\
-port_coverage         : %u deg\n\
-stbd_coverage         : %u deg\n\
-sound_speed_svp       : %0.1f m/s\n\
-yaw_stabilization     : %d\n\
-port_coverage2        : %d\n\
-stbd_coverage2        : %d\n\
-cpu_temp              : %d deg C\n", d->datagram.pu_status.info->ping_rate * 0.01, d->datagram.pu_status.info->ping_counter, d->datagram.pu_status.info->swath_distance,
-                d->datagram.pu_status.info->status_udp_port_2, d->datagram.pu_status.info->status_serial_port_1, d->datagram.pu_status.info->status_serial_port_2,
-                d->datagram.pu_status.info->status_serial_port_3, d->datagram.pu_status.info->status_serial_port_4, d->datagram.pu_status.info->pps_status,
-                d->datagram.pu_status.info->position_status, d->datagram.pu_status.info->attitude_status, d->datagram.pu_status.info->clock_status,
-                d->datagram.pu_status.info->heading_status, d->datagram.pu_status.info->pu_status, d->datagram.pu_status.info->heading * 0.01,
-                d->datagram.pu_status.info->roll * 0.01, d->datagram.pu_status.info->pitch * 0.01, d->datagram.pu_status.info->heave * 0.01,
-                d->datagram.pu_status.info->sound_speed * 0.1, d->datagram.pu_status.info->depth * 0.01, d->datagram.pu_status.info->velocity * 0.01,
-                d->datagram.pu_status.info->velocity_status, d->datagram.pu_status.info->ramp, d->datagram.pu_status.info->bs_oblique, d->datagram.pu_status.info->bs_normal,
-                d->datagram.pu_status.info->gain, d->datagram.pu_status.info->depth_normal, d->datagram.pu_status.info->range_normal, d->datagram.pu_status.info->port_coverage,
-                d->datagram.pu_status.info->stbd_coverage, d->datagram.pu_status.info->sound_speed_svp * 0.1, d->datagram.pu_status.info->yaw_stabilization,
-                d->datagram.pu_status.info->port_coverage2, d->datagram.pu_status.info->stbd_coverage2, d->datagram.pu_status.info->cpu_temp);
+across_track          : %0.2f m\n\
+along_track           : %0.2f m\n\
+detection_info        : %u\n\
+system_cleaning       : %d\n", i, d->datagram.depth_nominal.beam[i].depth, d->datagram.depth_nominal.beam[i].across_track,
+                        d->datagram.depth_nominal.beam[i].along_track, d->datagram.depth_nominal.beam[i].detection_info,
+                        d->datagram.depth_nominal.beam[i].system_cleaning);
+                }
+            }
 
             break;
 
-        case EMX_DATAGRAM_PU_BIST_RESULT :
+        case EMX_DATAGRAM_XYZ :
 
             fprintf (fp, "\
-test_number           : %u\n\
-test_result_status    : %d\n\
-text_length           : %d\n", d->datagram.pu_bist_result.info->test_number, d->datagram.pu_bist_result.info->test_result_status,
-                d->datagram.pu_bist_result.text_length);
+vessel_heading        : %0.1f deg\n\
+sound_speed           : %0.1f m/s\n\
+transducer_depth      : %0.2f m\n\
+num_beams             : %u beams\n\
+valid_beams           : %u beams\n\
+sample_rate           : %0.2f Hz (%0.2f m)\n\
+scanning_info         : %u\n", d->datagram.xyz.info->vessel_heading * 0.01, d->datagram.xyz.info->sound_speed * 0.1, d->datagram.xyz.info->transducer_depth,
+                d->datagram.xyz.info->num_beams, d->datagram.xyz.info->valid_beams, d->datagram.xyz.info->sample_rate,
+                750.0 / d->datagram.xyz.info->sample_rate, d->datagram.xyz.info->scanning_info);
 
-            fputs ("\
-text                  : ", fp);
+            if (output_level > 0) {
 
-            for (i=0; i<d->datagram.pu_bist_result.text_length; i++) {
-                if (d->datagram.pu_bist_result.text[i] == '\0') break;
-                fputc (d->datagram.pu_bist_result.text[i], fp);
+                for (i=0; i<d->datagram.xyz.info->num_beams; i++) {
+
+                    fprintf (fp, "\
+--- Sounding [ %d ] ----\n\
+depth                 : %0.2f m\n\
+across_track          : %0.2f m\n\
+along_track           : %0.2f m\n\
+detect_window_length  : %u\n\
+quality_factor        : %u\n\
+beam_adjustment       : %0.1f deg\n\
+detection_info        : %u\n\
+system_cleaning       : %d\n\
+backscatter           : %0.1f dB\n", i, d->datagram.xyz.beam[i].depth, d->datagram.xyz.beam[i].across_track, d->datagram.xyz.beam[i].along_track,
+                        d->datagram.xyz.beam[i].detect_window_length, d->datagram.xyz.beam[i].quality_factor, d->datagram.xyz.beam[i].beam_adjustment * 0.1,
+                        d->datagram.xyz.beam[i].detection_info, d->datagram.xyz.beam[i].system_cleaning, d->datagram.xyz.beam[i].backscatter * 0.1);
+                }
             }
-            fputc ('\n', fp);
 
             break;
 
-        case EMX_DATAGRAM_TRANSDUCER_TILT :
+        case EMX_DATAGRAM_EXTRA_DETECTIONS :
 
             fprintf (fp, "\
-num_entries           : %u\n", d->datagram.tilt.info->num_entries);
+datagram_counter      : %u\n\
+datagram_version      : %u\n\
+swath_counter         : %u\n\
+swath_index           : %u\n\
+vessel_heading        : %0.2f deg\n\
+sound_speed           : %0.1f m\n\
+reference_depth       : %0.2f m\n\
+wc_sample_rate        : %0.2f Hz\n\
+raw_amp_sample_rate   : %0.2f Hz\n\
+rx_transducer_index   : %u\n\
+num_detects           : %u\n\
+num_classes           : %u\n\
+nbytes_class          : %u Bytes\n\
+nalarm_flags          : %u\n\
+nbytes_detect         : %u Bytes\n", d->datagram.extra_detect.info->datagram_counter, d->datagram.extra_detect.info->datagram_version,
+                d->datagram.extra_detect.info->swath_counter, d->datagram.extra_detect.info->swath_index, d->datagram.extra_detect.info->vessel_heading * 0.01,
+                d->datagram.extra_detect.info->sound_speed * 0.1, d->datagram.extra_detect.info->reference_depth, d->datagram.extra_detect.info->wc_sample_rate,
+                d->datagram.extra_detect.info->raw_amplitude_sample_rate, d->datagram.extra_detect.info->rx_transducer_index,
+                d->datagram.extra_detect.info->num_detects, d->datagram.extra_detect.info->num_classes, d->datagram.extra_detect.info->nbytes_class,
+                d->datagram.extra_detect.info->nalarm_flags, d->datagram.extra_detect.info->nbytes_detect);
 
             if (output_level > 0) {
 
-                for (i=0; i<d->datagram.tilt.info->num_entries; i++) {
+                for (i=0; i<d->datagram.extra_detect.info->num_classes; i++) {
 
                     fprintf (fp, "\
------ Sample [ %d ] ----\n\
-record_time           : %u\n\
-tilt                  : %0.2f deg\n", i, d->datagram.tilt.data[i].record_time, d->datagram.tilt.data[i].tilt * 0.01);
+----- Class [ %d ] -----\n\
+start_depth           : %u %%\n\
+stop_depth            : %u %%\n\
+qf_threshold          : %u\n\
+bs_threshold          : %d dB\n\
+snr_threshold         : %u dB\n\
+alarm_threshold       : %u\n\
+num_detects           : %u\n\
+show_class            : %u\n\
+alarm_flag            : %u\n", i, d->datagram.extra_detect.classes[i].start_depth, d->datagram.extra_detect.classes[i].stop_depth,
+                        d->datagram.extra_detect.classes[i].qf_threshold, d->datagram.extra_detect.classes[i].bs_threshold, d->datagram.extra_detect.classes[i].snr_threshold,
+                        d->datagram.extra_detect.classes[i].alarm_threshold, d->datagram.extra_detect.classes[i].num_detects, d->datagram.extra_detect.classes[i].show_class,
+                        d->datagram.extra_detect.classes[i].alarm_flag);
                 }
             }
 
-            break;
+            if (output_level > 1) {
 
-        case EMX_DATAGRAM_HISAS_STATUS :
+                for (i=0; i<d->datagram.extra_detect.info->num_detects; i++) {
 
-            fprintf (fp, "\
-version_id            : %u\n\
-ping_rate             : %0.2f Hz\n\
-ping_counter          : %u\n\
-pu_idle_count         : %u\n\
-sensor_input_status   : %u\n\
-pps_status            : %d\n\
-clock_status          : %d\n\
-attitude_status       : %d\n\
-trigger_status        : %u\n\
-pu_modes              : %u\n\
-logger_status         : %u\n\
-yaw                   : %0.2f deg\n\
+                    fprintf (fp, "\
+depth                 : %0.2f m\n\
+across_track          : %0.2f m\n\
+along_track           : %0.2f m\n\
+latitude_delta        : %0.8f\n\
+longitud_delta        : %0.8f\n\
+beam_angle            : %0.2f deg\n\
+angle_correction      : %0.2f\n\
+travel_time           : %0.5f s\n\
+travel_time_correction: %0.5f s\n\
+backscatter           : %0.1f dB\n\
+beam_adjustment       : %0.1f deg\n\
+detection_info        : %d\n\
+tx_sector             : %u\n\
+detect_window_length  : %u\n\
+quality_factor        : %u\n\
+system_cleaning       : %u\n\
+range_factor          : %u %%\n\
+class_number          : %u\n\
+confidence            : %u\n\
+qf_ifremer            : %u\n\
+wc_beam_number        : %u\n\
+beam_angle_across     : %0.2f deg\n\
+detected_range        : %u\n\
+raw_amplitude         : %u\n", d->datagram.extra_detect.data[i].depth, d->datagram.extra_detect.data[i].across_track, d->datagram.extra_detect.data[i].along_track,
+                        d->datagram.extra_detect.data[i].latitude_delta, d->datagram.extra_detect.data[i].longitud_delta, d->datagram.extra_detect.data[i].beam_angle,
+                        d->datagram.extra_detect.data[i].angle_correction, d->datagram.extra_detect.data[i].travel_time, d->datagram.extra_detect.data[i].travel_time_correction,
+                        d->datagram.extra_detect.data[i].backscatter / 10.0, d->datagram.extra_detect.data[i].beam_adjustment / 10.0, d->datagram.extra_detect.data[i].detection_info,
+                        d->datagram.extra_detect.data[i].tx_sector, d->datagram.extra_detect.data[i].detection_window_length, d->datagram.extra_detect.data[i].quality_factor,
+                        d->datagram.extra_detect.data[i].system_cleaning, d->datagram.extra_detect.data[i].range_factor, d->datagram.extra_detect.data[i].class_number,
+                        d->datagram.extra_detect.data[i].confidence, d->datagram.extra_detect.data[i].qf_ifremer, d->datagram.extra_detect.data[i].wc_beam_number,
+                        d->datagram.extra_detect.data[i].beam_angle_across, d->datagram.extra_detect.data[i].detected_range, d->datagram.extra_detect.data[i].raw_amplitude);
+                }
+            }
+
+            /* TODO: Output raw amplitudes. */
+
+            break;
+
+        case EMX_DATAGRAM_CENTRAL_BEAMS :
+
+            fprintf (fp, "\
+mean_abs_coeff        : %0.2f dB/km\n\
+pulse_length          : %u us\n\
+range_norm            : %u\n\
+start_range           : %u\n\
+stop_range            : %u\n\
+normal_incidence_bs   : %d dB\n\
+oblique_bs            : %d dB\n\
+tx_beamwidth          : %0.1f deg\n\
+tvg_cross_over        : %0.1f deg\n\
+num_beams             : %u\n", d->datagram.central_beams.info->mean_abs_coef *.01, d->datagram.central_beams.info->pulse_length,
+                d->datagram.central_beams.info->range_norm, d->datagram.central_beams.info->start_range, d->datagram.central_beams.info->stop_range,
+                d->datagram.central_beams.info->normal_incidence_bs, d->datagram.central_beams.info->oblique_bs, d->datagram.central_beams.info->tx_beamwidth * 0.1,
+                d->datagram.central_beams.info->tvg_cross_over * 0.1, d->datagram.central_beams.info->num_beams);
+
+            if (output_level > 0) {
+
+                for (i=0; i<d->datagram.central_beams.info->num_beams; i++) {
+
+                    fprintf (fp, "\
+----- Beam [ %d ] ------\n\
+beam_index            : %u\n\
+num_samples           : %u\n\
+start_range           : %u\n", i, d->datagram.central_beams.beam[i].beam_index, d->datagram.central_beams.beam[i].num_samples, d->datagram.central_beams.beam[i].start_range);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_RRA_101 :
+
+            fprintf (fp, "\
+vessel_heading        : %0.2f deg\n\
+sound_speed           : %0.1f m/s\n\
+transducer_depth      : %0.2f m\n\
+max_beams             : %u\n\
+num_beams             : %u\n\
+depth_resolution      : %0.2f m\n\
+horizontal_resolution : %0.2f m\n\
+sample_rate           : %u Hz\n\
+status                : %d\n\
+range_norm            : %u\n\
+normal_incidence_bs   : %0.1f dB\n\
+oblique_bs            : %0.1f dB\n\
+fixed_gain            : %u\n\
+tx_power              : %d\n\
+mode                  : %u\n\
+coverage              : %u\n\
+yawstab_heading       : %u\n\
+tx_sectors            : %u\n", d->datagram.rra_101.info->vessel_heading / 100.0, d->datagram.rra_101.info->sound_speed / 10.0, d->datagram.rra_101.info->transducer_depth / 100.0,
+                d->datagram.rra_101.info->max_beams, d->datagram.rra_101.info->num_beams, d->datagram.rra_101.info->depth_resolution / 100.0, d->datagram.rra_101.info->horizontal_resolution / 100.0,
+                d->datagram.rra_101.info->sample_rate, d->datagram.rra_101.info->status, d->datagram.rra_101.info->range_norm, d->datagram.rra_101.info->normal_incidence_bs / 10.0,
+                d->datagram.rra_101.info->oblique_bs / 10.0, d->datagram.rra_101.info->fixed_gain, d->datagram.rra_101.info->tx_power, d->datagram.rra_101.info->mode,
+                d->datagram.rra_101.info->coverage, d->datagram.rra_101.info->yawstab_heading, d->datagram.rra_101.info->tx_sectors);
+
+            for (i=0; i<d->datagram.rra_101.info->tx_sectors; i++) {
+
+                fprintf (fp, "\
+---- Sector [ %d ] -----\n\
+last_beam             : %u\n\
+tx_tilt_angle         : %0.2f deg\n\
+heading               : %0.1f deg\n\
+roll                  : %0.1f deg\n\
+pitch                 : %0.1f deg\n\
+heave                 : %0.2f m\n", i, d->datagram.rra_101.tx_beam[i].last_beam, d->datagram.rra_101.tx_beam[i].tx_tilt_angle * 0.01,
+                    d->datagram.rra_101.tx_beam[i].heading * 0.01, d->datagram.rra_101.tx_beam[i].roll * 0.01, d->datagram.rra_101.tx_beam[i].pitch * 0.01,
+                    d->datagram.rra_101.tx_beam[i].heave * 0.01);
+            }
+
+            if (output_level > 0) {
+
+                for (i=0; i<d->datagram.rra_101.info->num_beams; i++) {
+
+                    fprintf (fp, "\
+---- RX_Beam [ %d ] -----\n\
+range                 : %u\n\
+quality_factor        : %u\n\
+detect_window_length  : %u\n\
+backscatter           : %0.1f dB\n\
+beam_number           : %u\n\
+rx_beam_angle         : %0.2f deg\n\
+rx_heading            : %0.2f deg\n\
 roll                  : %0.2f deg\n\
 pitch                 : %0.2f deg\n\
-heave                 : %0.3f m\n\
-sound_speed           : %0.2f m/s\n\
-log_file_size_port    : %u Bytes\n\
-log_file_size_stbd    : %u Bytes\n\
-free_space_port       : %u MBytes\n\
-free_space_stbd       : %u MBytes\n\
-cbmf_1_status         : %u\n\
-cbmf_2_status         : %u\n\
-tru_board_status      : %u\n\
-pu_status             : %u\n\
-cpu_temp              : %d deg C\n\
-lptx_temp             : %d deg C\n\
-lprx_temp             : %d deg C\n\
-hdd_temp              : %d deg C\n\
-last_nav_depth_input  : %d\n\
-last_nav_alt_input    : %d\n\
-transmitters_passive  : %u\n\
-ext_trigger_enabled   : %u\n\
-sidescan_bathy_enabled: %u\n\
-insas_enabled         : %u\n", d->datagram.hisas_status.info->version_id, d->datagram.hisas_status.info->ping_rate * 0.01,
-                d->datagram.hisas_status.info->ping_counter, d->datagram.hisas_status.info->pu_idle_count,
-                d->datagram.hisas_status.info->sensor_input_status, d->datagram.hisas_status.info->pps_status,
-                d->datagram.hisas_status.info->clock_status, d->datagram.hisas_status.info->attitude_status,
-                d->datagram.hisas_status.info->trigger_status, d->datagram.hisas_status.info->pu_modes,
-                d->datagram.hisas_status.info->logger_status, d->datagram.hisas_status.info->yaw * 0.01,
-                d->datagram.hisas_status.info->roll * 0.01, d->datagram.hisas_status.info->pitch * 0.01, d->datagram.hisas_status.info->heave * 0.01,
-                d->datagram.hisas_status.info->sound_speed * 0.1, d->datagram.hisas_status.info->log_file_size_port,
-                d->datagram.hisas_status.info->log_file_size_stbd, d->datagram.hisas_status.info->free_space_port,
-                d->datagram.hisas_status.info->free_space_stbd, d->datagram.hisas_status.info->cbmf_1_status,
-                d->datagram.hisas_status.info->cbmf_2_status, d->datagram.hisas_status.info->tru_board_status,
-                d->datagram.hisas_status.info->pu_status, d->datagram.hisas_status.info->cpu_temp,
-                d->datagram.hisas_status.info->lptx_temp, d->datagram.hisas_status.info->lprx_temp,
-                d->datagram.hisas_status.info->hdd_temp, d->datagram.hisas_status.info->last_nav_depth_input,
-                d->datagram.hisas_status.info->last_nav_altitude_input, d->datagram.hisas_status.info->transmitters_passive,
-                d->datagram.hisas_status.info->external_trigger_enabled, d->datagram.hisas_status.info->sidescan_bathy_enabled,
-                d->datagram.hisas_status.info->in_mission_sas_enabled);
+heave                 : %0.2f m\n", i, d->datagram.rra_101.rx_beam[i].range, d->datagram.rra_101.rx_beam[i].quality_factor,
+                        d->datagram.rra_101.rx_beam[i].detect_window_length, d->datagram.rra_101.rx_beam[i].backscatter * 0.5,
+                        d->datagram.rra_101.rx_beam[i].beam_number, d->datagram.rra_101.rx_beam[i].rx_beam_angle * 0.01,
+                        d->datagram.rra_101.rx_beam[i].rx_heading * 0.01, d->datagram.rra_101.rx_beam[i].roll * 0.01,
+                        d->datagram.rra_101.rx_beam[i].pitch * 0.01, d->datagram.rra_101.rx_beam[i].heave * 0.01);
+                }
+            }
 
             break;
 
-        case EMX_DATAGRAM_SIDESCAN_STATUS :
+        case EMX_DATAGRAM_RRA_70 :
 
             fprintf (fp, "\
-file_format           : %u\n\
-system_type           : %u\n\
-sonar_type            : %u\n\
-nav_units             : %u\n\
-num_channels          : %u\n", d->datagram.sidescan_status.info->file_format, d->datagram.sidescan_status.info->system_type,
-                d->datagram.sidescan_status.info->sonar_type, d->datagram.sidescan_status.info->nav_units,
-                d->datagram.sidescan_status.info->num_channels);
+max_beams             : %u\n\
+num_beams             : %u\n\
+sound_speed           : %0.1f m/s\n", d->datagram.rra_70.info->max_beams, d->datagram.rra_70.info->num_beams, d->datagram.rra_70.info->sound_speed / 10.0);
 
-            for (i=0; i<d->datagram.sidescan_status.info->num_channels; i++) {
+            if (output_level > 0) {
 
-                fprintf (fp, "\
------ Channel %d -------\n\
-type_of_channel       : %u\n\
-sub_channel_number    : %u\n\
-correction_flags      : %u\n\
-uni_polar             : %u\n\
-bytes_per_sample      : %u\n\
-channel_name          : %s\n\
-frequency             : %0.1f Hz\n\
-horiz_beam_angle      : %0.1f deg\n\
-tilt_angle            : %0.1f deg\n\
-beam_width            : %0.1f deg\n\
-offset_x              : %0.3f m\n\
-offset_y              : %0.3f m\n\
-offset_z              : %0.3f m\n\
-offset_yaw            : %0.1f deg\n\
-offset_pitch          : %0.1f deg\n\
-offset_roll           : %0.1f deg\n", i, d->datagram.sidescan_status.info->channel[i].type_of_channel,
-                    d->datagram.sidescan_status.info->channel[i].sub_channel_number, d->datagram.sidescan_status.info->channel[i].correction_flags,
-                    d->datagram.sidescan_status.info->channel[i].uni_polar, d->datagram.sidescan_status.info->channel[i].bytes_per_sample,
-                    d->datagram.sidescan_status.info->channel[i].channel_name, d->datagram.sidescan_status.info->channel[i].frequency,
-                    d->datagram.sidescan_status.info->channel[i].horiz_beam_angle, d->datagram.sidescan_status.info->channel[i].tilt_angle,
-                    d->datagram.sidescan_status.info->channel[i].beam_width, d->datagram.sidescan_status.info->channel[i].offset_x,
-                    d->datagram.sidescan_status.info->channel[i].offset_y, d->datagram.sidescan_status.info->channel[i].offset_z,
-                    d->datagram.sidescan_status.info->channel[i].offset_yaw, d->datagram.sidescan_status.info->channel[i].offset_pitch,
-                    d->datagram.sidescan_status.info->channel[i].offset_roll);
+                for (i=0; i<d->datagram.rra_70.info->num_beams; i++) {
+
+                    fprintf (fp, "\
+----- Beam [ %d ] ------\n\
+beam_angle            : %0.2f deg\n\
+tx_tilt_angle         : %0.2f deg\n\
+range                 : %u\n\
+backscatter           : %0.1f dB\n\
+beam_number           : %u\n", i, d->datagram.rra_70.beam[i].beam_angle * 0.01, d->datagram.rra_70.beam[i].tx_tilt_angle * 0.01,
+                        d->datagram.rra_70.beam[i].range, d->datagram.rra_70.beam[i].backscatter * 0.1, d->datagram.rra_70.beam[i].beam_number);
+                }
             }
 
             break;
 
-        case EMX_DATAGRAM_HISAS_1032_SIDESCAN :
+        case EMX_DATAGRAM_RRA_102 :
 
             fprintf (fp, "\
-magic_number          : 0x%x\n\
-header_type           : %u\n\
-beam_number           : %u\n\
-num_channels          : %u\n\
-num_bytes_record      : %u\n\
-year                  : %u\n\
-month                 : %u\n\
-day                   : %u\n\
-hour                  : %u\n\
-minute                : %u\n\
-second                : %u\n\
-hseconds              : %u\n\
-ping_number           : %u\n\
-sound_velocity_two_way: %0.1f m/s\n\
-sound_velocity        : %0.1f m/s\n\
-fix_time_hour         : %u\n\
-fix_time_minute       : %u\n\
-fix_time_second       : %u\n\
-fix_time_hsecond      : %u\n\
-sensor_speed          : %0.1f kts\n\
-sensor_lat            : %0.8f deg\n\
-sensor_lon            : %0.8f deg\n\
-sensor_depth          : %0.2f m\n\
-sensor_altitude       : %0.2f m\n\
-sensor_aux_altitude   : %0.2f m\n\
-sensor_pitch          : %0.1f deg\n\
-sensor_roll           : %0.1f deg\n\
-sensor_heading        : %0.1f deg\n", d->datagram.sidescan_data.info->magic_number, d->datagram.sidescan_data.info->header_type,
-                d->datagram.sidescan_data.info->beam_number, d->datagram.sidescan_data.info->num_channels,
-                d->datagram.sidescan_data.info->num_bytes_record, d->datagram.sidescan_data.info->year,
-                d->datagram.sidescan_data.info->month, d->datagram.sidescan_data.info->day, d->datagram.sidescan_data.info->hour,
-                d->datagram.sidescan_data.info->minute, d->datagram.sidescan_data.info->second, d->datagram.sidescan_data.info->hseconds,
-                d->datagram.sidescan_data.info->ping_number, d->datagram.sidescan_data.info->sound_velocity_two_way,
-                d->datagram.sidescan_data.info->sound_velocity, d->datagram.sidescan_data.info->fix_time_hour,
-                d->datagram.sidescan_data.info->fix_time_minute, d->datagram.sidescan_data.info->fix_time_second,
+tx_sectors            : %u\n\
+num_beams             : %u\n\
+sample_rate           : %0.2f Hz\n\
+rov_depth             : %0.2f m\n\
+sound_speed           : %0.1f m/s\n\
+max_beams             : %u\n", d->datagram.rra_102.info->tx_sectors, d->datagram.rra_102.info->num_beams,
+                d->datagram.rra_102.info->sample_rate * 0.01, d->datagram.rra_102.info->rov_depth * 0.01,
+                d->datagram.rra_102.info->sound_speed * 0.1, d->datagram.rra_102.info->max_beams);
+
+            for (i=0; i<d->datagram.rra_102.info->tx_sectors; i++) {
+
+                fprintf (fp, "\
+---- Sector [ %d ] -----\n\
+tx_tilt_angle         : %0.2f deg\n\
+focus_range           : %0.1f m\n\
+signal_length         : %u ms\n\
+tx_offset             : %u ms\n\
+center_freq           : %u Hz\n\
+signal_bandwidth      : %0.0f Hz\n\
+signal_waveform_id    : %u\n\
+tx_sector             : %u\n", i, d->datagram.rra_102.tx_beam[i].tx_tilt_angle * 0.01, d->datagram.rra_102.tx_beam[i].focus_range * 0.1,
+                    d->datagram.rra_102.tx_beam[i].signal_length, d->datagram.rra_102.tx_beam[i].tx_offset, d->datagram.rra_102.tx_beam[i].center_freq,
+                    d->datagram.rra_102.tx_beam[i].signal_bandwidth * 10.0, d->datagram.rra_102.tx_beam[i].signal_waveform_id, d->datagram.rra_102.tx_beam[i].tx_sector);
+            }
+
+            if (output_level > 0) {
+
+                for (i=0; i<d->datagram.rra_102.info->num_beams; i++) {
+
+                    fprintf (fp, "\
+---- RX_Beam [ %d ] -----\n\
+rx_beam_angle         : %0.2f deg\n\
+range                 : %0.2f\n\
+tx_sector_number      : %u\n\
+backscatter           : %0.1f dB\n\
+quality_factor        : %u\n\
+detect_window_length  : %u\n\
+beam_number           : %d\n", i, d->datagram.rra_102.rx_beam[i].rx_beam_angle * 0.01, d->datagram.rra_102.rx_beam[i].range * 0.25,
+                        d->datagram.rra_102.rx_beam[i].tx_sector_number, d->datagram.rra_102.rx_beam[i].backscatter * 0.5,
+                        d->datagram.rra_102.rx_beam[i].quality_factor, d->datagram.rra_102.rx_beam[i].detect_window_length,
+                        d->datagram.rra_102.rx_beam[i].beam_number);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_RRA_78 :
+
+            fprintf (fp, "\
+sound_speed           : %0.1f m/s\n\
+tx_sectors            : %u\n\
+num_beams             : %u\n\
+valid_beams           : %u\n\
+sample_rate           : %0.2f Hz\n\
+dscale                : %u\n", d->datagram.rra_78.info->sound_speed * 0.1, d->datagram.rra_78.info->tx_sectors,
+                d->datagram.rra_78.info->num_beams, d->datagram.rra_78.info->valid_beams,
+                d->datagram.rra_78.info->sample_rate, d->datagram.rra_78.info->dscale);
+
+            for (i=0; i<d->datagram.rra_78.info->tx_sectors; i++) {
+
+                fprintf (fp, "\
+---- Sector [ %d ] -----\n\
+tx_tilt_angle         : %0.2f deg\n\
+focus_range           : %0.1f m\n\
+signal_length         : %0.6f s\n\
+sector_tx_delay       : %0.6f s\n\
+center_freq           : %0.1f Hz\n\
+mean_absorption       : %0.2f dB/km\n\
+signal_waveform_id    : %u\n\
+transmit_sector       : %u\n\
+signal_bandwidth      : %0.0f Hz\n", i, d->datagram.rra_78.tx_beam[i].tx_tilt_angle * 0.01, d->datagram.rra_78.tx_beam[i].focus_range * 0.1,
+                    d->datagram.rra_78.tx_beam[i].signal_length, d->datagram.rra_78.tx_beam[i].sector_tx_delay, d->datagram.rra_78.tx_beam[i].center_freq,
+                    d->datagram.rra_78.tx_beam[i].mean_absorption * 0.01, d->datagram.rra_78.tx_beam[i].signal_waveform_id, d->datagram.rra_78.tx_beam[i].tx_sector,
+                    d->datagram.rra_78.tx_beam[i].signal_bandwidth);
+            }
+
+            if (output_level > 0) {
+
+                for (i=0; i<d->datagram.rra_78.info->num_beams; i++) {
+
+                    fprintf (fp, "\
+----- Beam [ %d ] -----\n\
+rx_beam_angle         : %0.2f deg\n\
+tx_sector_number      : %u\n\
+detection_info        : %u\n\
+detect_window_length  : %u\n\
+quality_factor        : %u\n\
+dcorr                 : %d\n\
+two_way_travel_time   : %0.5f s\n\
+backscatter           : %0.1f dB\n\
+system_cleaning       : %d\n", i, d->datagram.rra_78.rx_beam[i].rx_beam_angle / 100.0, d->datagram.rra_78.rx_beam[i].tx_sector_number, d->datagram.rra_78.rx_beam[i].detection_info,
+                        d->datagram.rra_78.rx_beam[i].detect_window_length, d->datagram.rra_78.rx_beam[i].quality_factor, d->datagram.rra_78.rx_beam[i].doppler_correction,
+                        d->datagram.rra_78.rx_beam[i].two_way_travel_time, d->datagram.rra_78.rx_beam[i].backscatter / 10.0, d->datagram.rra_78.rx_beam[i].system_cleaning);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_SEABED_IMAGE_83 :
+
+            fprintf (fp, "\
+mean_abs_coeff        : %0.2f dB/km\n\
+pulse_length          : %u us\n\
+range_norm            : %u\n\
+start_range           : %u\n\
+stop_range            : %u\n\
+normal_incidence_bs   : %0.1f dB\n\
+oblique_bs            : %0.1f dB\n\
+tx_beamwidth          : %0.1f deg\n\
+tvg_cross_over        : %0.1f deg\n\
+num_beams             : %u beams\n", d->datagram.seabed_83.info->mean_abs_coef * 0.01, d->datagram.seabed_83.info->pulse_length,
+                d->datagram.seabed_83.info->range_norm, d->datagram.seabed_83.info->start_range, d->datagram.seabed_83.info->stop_range,
+                d->datagram.seabed_83.info->normal_incidence_bs * 0.1, d->datagram.seabed_83.info->oblique_bs * 0.1,
+                d->datagram.seabed_83.info->tx_beamwidth * 0.1, d->datagram.seabed_83.info->tvg_cross_over * 0.1, d->datagram.seabed_83.info->num_beams);
+
+            if (output_level > 0) {
+
+                int num_samples = 0;
+
+                for (i=0; i<d->datagram.seabed_83.info->num_beams; i++) {
+
+                    fprintf (fp, "\
+----- Beam [ %d ] -----\n\
+beam_index            : %u\n\
+sorting_direction     : %d\n\
+num_samples           : %u\n\
+detect_sample         : %u\n", i, d->datagram.seabed_83.beam[i].beam_index, d->datagram.seabed_83.beam[i].sorting_direction,
+                        d->datagram.seabed_83.beam[i].num_samples, d->datagram.seabed_83.beam[i].detect_sample);
+
+                    num_samples += d->datagram.seabed_83.beam[i].num_samples;
+                }
+
+                fprintf (fp, "\
+-----------------------\n\
+bytes_end             : %d\n", d->datagram.seabed_83.bytes_end);
+
+                if (output_level > 1) {
+                    fputs ("\
+amplitude             : ", fp);
+
+                    for (i=0; i<num_samples; i++) {
+
+                        fprintf (fp, "%0.1f ", d->datagram.seabed_83.amplitude[i] * 0.5);
+                    }
+
+                    fputc ('\n', fp);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_SEABED_IMAGE_89 :
+
+            fprintf (fp, "\
+sample_rate           : %0.2f Hz (%0.2f m)\n\
+range_norm            : %u samples\n\
+normal_incidence_bs   : %0.1f dB\n\
+oblique_bs            : %0.1f dB\n\
+tx_beamwidth          : %0.1f deg\n\
+tvg_cross_over        : %0.1f deg\n\
+num_beams             : %u beams\n", d->datagram.seabed_89.info->sample_rate, 750.0 / d->datagram.seabed_89.info->sample_rate,
+                d->datagram.seabed_89.info->range_norm, 0.1 * d->datagram.seabed_89.info->normal_incidence_bs, 0.1 * d->datagram.seabed_89.info->oblique_bs,
+                0.1 * d->datagram.seabed_89.info->tx_beamwidth, 0.1 * d->datagram.seabed_89.info->tvg_cross_over, d->datagram.seabed_89.info->num_beams);
+
+            if (output_level > 0) {
+
+                int num_samples = 0;
+
+                for (i=0; i<d->datagram.seabed_89.info->num_beams; i++) {
+
+                    fprintf (fp, "\
+----- Beam [ %d ] -----\n\
+sorting_direction     : %d\n\
+detection_info        : %u\n\
+num_samples           : %u\n\
+detect_sample         : %u\n", i, d->datagram.seabed_89.beam[i].sorting_direction, d->datagram.seabed_89.beam[i].detection_info,
+                        d->datagram.seabed_89.beam[i].num_samples, d->datagram.seabed_89.beam[i].detect_sample);
+
+                    num_samples += d->datagram.seabed_89.beam[i].num_samples;
+                }
+
+                fprintf (fp, "\
+-----------------------\n\
+bytes_end             : %d\n", d->datagram.seabed_89.bytes_end);
+
+                if (output_level > 1) {
+                    fputs ("\
+amplitude             : ", fp);
+
+                    for (i=0; i<num_samples; i++) {
+
+                        fprintf (fp, "%0.1f ", d->datagram.seabed_89.amplitude[i] * 0.1);
+                    }
+
+                    fputc ('\n', fp);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_WATER_COLUMN :
+
+            fprintf (fp, "\
+num_datagrams         : %u\n\
+datagram_number       : %u\n\
+tx_sectors            : %u\n\
+num_beams             : %u\n\
+datagram_beams        : %u\n\
+sound_speed           : %0.1f m/s\n\
+sample_rate           : %0.2f Hz (%0.2f m)\n\
+tx_heave              : %d cm\n\
+tvg_function          : %u\n\
+tvg_offset            : %d dB\n\
+scanning_info         : %u\n", d->datagram.wc.info->num_datagrams, d->datagram.wc.info->datagram_number, d->datagram.wc.info->tx_sectors,
+                d->datagram.wc.info->num_beams, d->datagram.wc.info->datagram_beams, d->datagram.wc.info->sound_speed * 0.1, d->datagram.wc.info->sample_rate * 0.01,
+                750.0 / (0.01 * d->datagram.wc.info->sample_rate), d->datagram.wc.info->tx_heave, d->datagram.wc.info->tvg_function,
+                d->datagram.wc.info->tvg_offset, d->datagram.wc.info->scanning_info);
+
+            for (i=0; i<d->datagram.wc.info->tx_sectors; i++) {
+                fprintf (fp, "\
+---- Sector [ %d ] -----\n\
+tx_tilt_angle         : %0.2f deg\n\
+center_freq           : %0.0f Hz\n\
+tx_sector             : %u\n", i, d->datagram.wc.txbeam[i].tx_tilt_angle / 100.0, d->datagram.wc.txbeam[i].center_freq * 10.0, d->datagram.wc.txbeam[i].tx_sector);
+            }
+
+            if (output_level > 0) {
+
+                emx_datagram_wc_rx_beam wc_rx_beam;
+                const uint8_t *p = d->datagram.wc.beamData;
+
+                for (i=0; i<d->datagram.wc.info->datagram_beams; i++) {
+
+                    p = emx_get_wc_rxbeam (&wc_rx_beam, p);
+
+                    fprintf (fp, "\
+----- Beam [ %d ] ------\n\
+beam_angle            : %0.2f deg\n\
+start_range           : %u\n\
+num_samples           : %u\n\
+detected_range        : %u\n\
+tx_sector             : %u\n\
+beam_index            : %u\n", i, wc_rx_beam.info->beam_angle / 100.0, wc_rx_beam.info->start_range, wc_rx_beam.info->num_samples,
+                        wc_rx_beam.info->detected_range, wc_rx_beam.info->tx_sector, wc_rx_beam.info->beam_index);
+
+                    if (output_level > 1) {
+                        int j;
+
+                        fputs ("\
+amplitude             : ", fp);
+
+                        for (j=0; j<wc_rx_beam.info->num_samples; j++) {
+                            fprintf (fp, "%0.1f ", wc_rx_beam.amplitude[j] * 0.5);
+                        }
+
+                        fputc ('\n', fp);
+                    }
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_QUALITY_FACTOR :
+
+            fprintf (fp, "\
+num_beams             : %u\n\
+npar                  : %u\n", d->datagram.qf.info->num_beams, d->datagram.qf.info->npar);
+
+            if (output_level > 0) {
+
+                fputs ("\
+quality_factor        : ", fp);
+
+                for (i=0; i<d->datagram.qf.info->num_beams; i++) {
+                    fprintf (fp, "%0.1f ", d->datagram.qf.data[i]);
+                }
+                fputc ('\n', fp);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_ATTITUDE :
+
+            fprintf (fp, "\
+num_entries           : %u\n\
+sensor_sys_descriptor : %d\n", d->datagram.attitude.info->num_entries, d->datagram.attitude.sensor_system_descriptor);
+
+            if (output_level > 0) {
+
+                for (i=0; i<d->datagram.attitude.info->num_entries; i++) {
+
+                    fprintf (fp, "\
+----- Entry [ %d ] -----\n\
+record_time           : %0.3f s\n\
+status                : %u\n\
+roll                  : %0.2f deg\n\
+pitch                 : %0.2f deg\n\
+heave                 : %d cm\n\
+heading               : %0.2f deg\n", i, d->datagram.attitude.data[i].record_time / 1000.0, d->datagram.attitude.data[i].status, d->datagram.attitude.data[i].roll * 0.01,
+                        d->datagram.attitude.data[i].pitch * 0.01, d->datagram.attitude.data[i].heave, d->datagram.attitude.data[i].heading * 0.01);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_ATTITUDE_NETWORK :
+
+            fprintf (fp, "\
+num_entries           : %u\n\
+sensor_sys_descriptor : %d\n", d->datagram.attitude_network.info->num_entries, d->datagram.attitude_network.info->sensor_system_descriptor);
+
+            if (output_level > 0) {
+
+                emx_datagram_attitude_network_data attitude_data;
+                const uint8_t *p = d->datagram.attitude_network.data;
+
+                for (i=0; i<d->datagram.attitude_network.info->num_entries; i++) {
+
+                    p = emx_get_attitude_network_data (&attitude_data, p);
+
+                    fprintf (fp, "\
+----- Entry [ %d ] -----\n\
+record_time           : %0.3f s\n\
+roll                  : %0.2f deg\n\
+pitch                 : %0.2f deg\n\
+heave                 : %0.2f m\n\
+heading               : %0.2f deg\n\
+num_bytes_input       : %u Bytes\n", i, attitude_data.info->record_time / 1000.0, attitude_data.info->roll * 0.01, attitude_data.info->pitch * 0.01, attitude_data.info->heave * 0.01,
+                        attitude_data.info->heading * 0.01, attitude_data.info->num_bytes_input);
+
+                    if (output_level > 1) {
+                        int j;
+
+                        fputs ("\
+message               : ", fp);
+
+                        for (j=0; j<attitude_data.info->num_bytes_input; j++) {
+                            fprintf (fp, "%d ", attitude_data.message[j]);
+                        }
+
+                        fputc ('\n', fp);
+                    }
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_CLOCK :
+
+            fprintf (fp, "\
+date                  : %u\n\
+time_ms               : %u ms\n\
+PPS                   : %u\n", d->datagram.clock.info->date, d->datagram.clock.info->time_ms, d->datagram.clock.info->PPS);
+
+            break;
+
+        case EMX_DATAGRAM_HEIGHT :
+
+            fprintf (fp, "\
+height                : %d cm\n\
+height_type           : %u\n", d->datagram.height.info->height, d->datagram.height.info->height_type);
+
+            break;
+
+        case EMX_DATAGRAM_HEADING :
+
+            fprintf (fp, "\
+num_entries           : %u\n\
+heading_indicator     : %u\n", d->datagram.heading.info->num_entries, d->datagram.heading.heading_indicator);
+
+            if (output_level > 0) {
+                for (i=0; i<d->datagram.heading.info->num_entries; i++) {
+
+                    fprintf (fp, "\
+----- Entry [ %d ] -----\n\
+record_time           : %u ms\n\
+heading               : %0.2f deg\n", i, d->datagram.heading.data[i].record_time, d->datagram.heading.data[i].heading * 0.01);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_POSITION :
+
+            if (d->datagram.position.info->latitude == EMX_NULL_INT32) {
+                fputs ("latitude              : INVALID\n", fp);
+            } else {
+                fprintf (fp, "latitude              : %0.5f deg\n", d->datagram.position.info->latitude / 20000000.0);
+            }
+
+            if (d->datagram.position.info->longitude == EMX_NULL_INT32) {
+                fputs ("longitude             : INVALID\n", fp);
+            } else {
+                fprintf (fp, "longitude             : %0.5f deg\n", d->datagram.position.info->longitude / 10000000.0);
+            }
+
+            if (d->datagram.position.info->position_fix_quality == EMX_NULL_UINT16) {
+                fputs ("position_fix_quality  : INVALID\n", fp);
+            } else {
+                fprintf (fp, "position_fix_quality  : %0.2f m\n", d->datagram.position.info->position_fix_quality / 100.0);
+            }
+
+            if (d->datagram.position.info->vessel_speed == EMX_NULL_UINT16) {
+                fputs ("vessel_speed          : INVALID\n", fp);
+            } else {
+                fprintf (fp, "vessel_speed          : %0.2f m/s\n", d->datagram.position.info->vessel_speed / 100.0);
+            }
+
+            if (d->datagram.position.info->vessel_course == EMX_NULL_UINT16) {
+                fputs ("vessel_course         : INVALID\n", fp);
+            } else {
+                fprintf (fp, "vessel_course         : %0.2f deg\n", 0.01 * d->datagram.position.info->vessel_course);
+            }
+
+            if (d->datagram.position.info->vessel_heading == EMX_NULL_UINT16) {
+                fputs ("vessel_heading        : INVALID\n", fp);
+            } else {
+                fprintf (fp, "vessel_heading        : %0.2f deg\n", 0.01 * d->datagram.position.info->vessel_heading);
+            }
+
+            fprintf (fp, "position_system       : %u\n", d->datagram.position.info->position_system);
+
+            if ((d->datagram.position.info->position_system & 3) == 1) {
+                fprintf (fp, "position_system       : Positioning System 1\n");
+            }
+
+            if ((d->datagram.position.info->position_system & 3) == 2) {
+                fprintf (fp, "position_system       : Positioning System 2\n");
+            }
+
+            if ((d->datagram.position.info->position_system & 3) == 3) {
+                fprintf (fp, "position_system       : Positioning System 3\n");
+            }
+
+            if ((d->datagram.position.info->position_system & 192) == 128) {
+                fprintf (fp, "position_system       : Positioning System Active, System Time Used\n");
+            }
+
+            if ((d->datagram.position.info->position_system & 192) == 192) {
+                fprintf (fp, "position_system       : Positioning System Active, Input Datagram Used\n");
+            }
+
+            fprintf (fp, "bytes_in_input        : %u Bytes\n", d->datagram.position.info->bytes_in_input);
+
+            fputs ("\
+message               : ", fp);
+
+            /* TODO: Check if message is binary and print in hex. */
+            for (i=0; i<d->datagram.position.info->bytes_in_input; i++) {
+                if (d->datagram.position.message[i] == '\0') break;
+                if ((d->datagram.position.message[i] != '\n') && (d->datagram.position.message[i] != '\r')) {
+                    if (CPL_ISALNUM (d->datagram.position.message[i])) {
+                        fprintf (fp, "%c", d->datagram.position.message[i]);
+                    }
+                }
+            }
+            fputc ('\n', fp);
+
+            break;
+
+        case EMX_DATAGRAM_SINGLE_BEAM_DEPTH :
+
+            fprintf (fp, "\
+date                  : %u\n\
+time_ms               : %u ms\n\
+depth                 : %0.2f m\n\
+source                : %c\n", d->datagram.sb_depth.info->date, d->datagram.sb_depth.info->time_ms, d->datagram.sb_depth.info->depth * 0.01,
+                d->datagram.sb_depth.info->source);
+
+            break;
+
+        case EMX_DATAGRAM_TIDE :
+
+            fprintf (fp, "\
+date                  : %u\n\
+time_ms               : %u ms\n\
+tide_offset           : %0.2f m\n", d->datagram.tide.info->date, d->datagram.tide.info->time_ms, d->datagram.tide.info->tide_offset * 0.01);
+
+            break;
+
+        case EMX_DATAGRAM_SSSV :
+
+            fprintf (fp, "\
+num_samples           : %u\n", d->datagram.sssv.info->num_samples);
+
+            if (output_level > 0) {
+
+                for (i=0; i<d->datagram.sssv.info->num_samples; i++) {
+
+                    fprintf (fp, "\
+----- Sample [ %d ] ----\n\
+record_time           : %u s\n\
+sound_speed           : %0.1f m/s\n", i, d->datagram.sssv.data[i].record_time, d->datagram.sssv.data[i].sound_speed / 10.0);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_SVP :
+
+            fprintf (fp, "\
+date                  : %u\n\
+time_ms               : %u ms\n\
+num_samples           : %u\n\
+depth_resolution      : %u cm\n", d->datagram.svp.info->date, d->datagram.svp.info->time_ms, d->datagram.svp.info->num_samples,
+                d->datagram.svp.info->depth_resolution);
+
+            if (output_level > 0) {
+
+                for (i=0; i<d->datagram.svp.info->num_samples; i++) {
+
+                    fprintf (fp, "\
+----- Sample [ %d ] ----\n\
+depth                 : %0.2f m\n\
+sound_speed           : %0.1f m/s\n", i, d->datagram.svp.data[i].depth * 0.01, d->datagram.svp.data[i].sound_speed * 0.1);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_SVP_EM3000 :
+
+            fprintf (fp, "\
+date                  : %u\n\
+time_ms               : %u ms\n\
+num_samples           : %u\n\
+depth_resolution      : %u cm\n", d->datagram.svp_em3000.info->date, d->datagram.svp_em3000.info->time_ms, d->datagram.svp_em3000.info->num_samples,
+                d->datagram.svp_em3000.info->depth_resolution);
+
+            if (output_level > 0) {
+
+                for (i=0; i<d->datagram.svp_em3000.info->num_samples; i++) {
+
+                    fprintf (fp, "\
+----- Sample [ %d ] ----\n\
+depth                 : %0.2f m\n\
+sound_speed           : %0.1f m/s\n", i, d->datagram.svp_em3000.data[i].depth * 0.01, d->datagram.svp_em3000.data[i].sound_speed * 0.1);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_KM_SSP_OUTPUT :
+
+            fprintf (fp, "\
+num_bytes             : %d\n", d->datagram.ssp_output.num_bytes);
+
+            fputs ("\
+data                  : ", fp);
+
+            for (i=0; i<d->datagram.ssp_output.num_bytes; i++) {
+                if (d->datagram.ssp_output.data[i] == '\0') break;
+                fputc (d->datagram.ssp_output.data[i], fp);
+            }
+            fputc ('\n', fp);
+
+            break;
+
+        case EMX_DATAGRAM_INSTALL_PARAMS :
+
+            fprintf (fp, "\
+serial_number2        : %u\n\
+text_length           : %d\n", d->datagram.install_params.info->serial_number2, d->datagram.install_params.text_length);
+
+            fputs ("\
+text                  : ", fp);
+
+            for (i=0; i<d->datagram.install_params.text_length; i++) {
+                if (d->datagram.install_params.text[i] == '\0') break;
+                fputc (d->datagram.install_params.text[i], fp);
+            }
+            fputc ('\n', fp);
+
+            break;
+
+        case EMX_DATAGRAM_INSTALL_PARAMS_STOP :
+
+            fprintf (fp, "\
+serial_number2        : %u\n\
+text_length           : %d\n", d->datagram.install_params_stop.info->serial_number2, d->datagram.install_params_stop.text_length);
+
+            fputs ("\
+text                  : ", fp);
+
+            for (i=0; i<d->datagram.install_params_stop.text_length; i++) {
+                if (d->datagram.install_params_stop.text[i] == '\0') break;
+                fputc (d->datagram.install_params_stop.text[i], fp);
+            }
+            fputc ('\n', fp);
+
+            break;
+
+        case EMX_DATAGRAM_INSTALL_PARAMS_REMOTE :
+
+            fprintf (fp, "\
+serial_number2        : %u\n\
+text_length           : %d\n", d->datagram.install_params_remote.info->serial_number2, d->datagram.install_params_remote.text_length);
+
+            fputs ("\
+text                  : ", fp);
+
+            for (i=0; i<d->datagram.install_params_remote.text_length; i++) {
+                if (d->datagram.install_params_remote.text[i] == '\0') break;
+                fputc (d->datagram.install_params_remote.text[i], fp);
+            }
+            fputc ('\n', fp);
+
+            break;
+
+        case EMX_DATAGRAM_REMOTE_PARAMS_INFO :
+
+            /* TODO: */
+
+            break;
+
+        case EMX_DATAGRAM_RUNTIME_PARAMS :
+
+            fprintf (fp, "\
+operator_station_stat : %u\n\
+pu_status             : %u\n\
+bsp_status            : %u\n\
+head_or_tx_status     : %u\n\
+mode                  : %u\n\
+filter_id             : %u\n\
+min_depth             : %u m\n\
+max_depth             : %u m\n\
+absorption            : %0.2f dB/km\n\
+tx_pulse_length       : %u us\n", d->datagram.runtime_params.info->operator_station_status, d->datagram.runtime_params.info->pu_status,
+                d->datagram.runtime_params.info->bsp_status, d->datagram.runtime_params.info->head_or_tx_status, d->datagram.runtime_params.info->mode,
+                d->datagram.runtime_params.info->filter_id, d->datagram.runtime_params.info->min_depth, d->datagram.runtime_params.info->max_depth,
+                d->datagram.runtime_params.info->absorption / 100.0, d->datagram.runtime_params.info->tx_pulse_length);
+
+            fputs ("\
+tx_beamwidth          : ", fp);
+
+            if (d->datagram.runtime_params.info->tx_beamwidth == EMX_NULL_UINT16) {
+                fputs ("INVALID\n", fp);
+            }
+
+            fprintf (fp, "%0.1f deg\n", d->datagram.runtime_params.info->tx_beamwidth / 10.0);
+
+            fprintf (fp, "\
+tx_power              : %d dB\n\
+rx_beamwidth          : %0.1f deg\n\
+rx_bandwidth          : %0.0f Hz\n\
+rx_fixed_gain         : %u dB\n\
+tvg_crossover         : %u deg\n\
+sound_speed_source    : %u\n\
+max_port_swath        : %u m\n", d->datagram.runtime_params.info->tx_power, d->datagram.runtime_params.info->rx_beamwidth / 10.0,
+                d->datagram.runtime_params.info->rx_bandwidth * 50.0, d->datagram.runtime_params.info->rx_fixed_gain,
+                d->datagram.runtime_params.info->tvg_crossover, d->datagram.runtime_params.info->sound_speed_source,
+                d->datagram.runtime_params.info->max_port_swath);
+
+            fputs ("\
+beam_spacing          : ", fp);
+
+            if ((d->datagram.runtime_params.info->beam_spacing & 128) == 0) {
+                switch (d->datagram.runtime_params.info->beam_spacing) {
+                    case 0 : fputs ("Determined by beamwidth\n", fp); break;
+                    case 1 : fputs ("Equidistant\n", fp); break;
+                    case 2 : fputs ("Equiangle\n", fp); break;
+                    case 3 : fputs ("High density equidistant\n", fp); break;
+                    default : fprintf (fp, "%u\n", d->datagram.runtime_params.info->beam_spacing); break;
+                }
+            } else {
+                /* TODO: dual head. */
+            }
+
+            fprintf (fp, "\
+max_port_coverage     : %u deg\n\
+yaw_pitch_mode        : %u\n\
+max_stbd_coverage     : %u deg\n\
+max_stbd_swath        : %u m\n\
+tx_along_tilt         : %d\n\
+filter_id2            : %u\n", d->datagram.runtime_params.info->max_port_coverage, d->datagram.runtime_params.info->yaw_pitch_mode,
+                d->datagram.runtime_params.info->max_stbd_coverage, d->datagram.runtime_params.info->max_stbd_swath,
+                d->datagram.runtime_params.info->tx_along_tilt, d->datagram.runtime_params.info->filter_id2);
+
+            break;
+
+        case EMX_DATAGRAM_EXTRA_PARAMS :
+
+            fputs ("\
+content               : ", fp);
+
+            switch (d->datagram.extra_params.info->content) {
+                case 1 : fputs ("calib.txt\n", fp); break;
+                case 2 : fputs ("Log all heights\n", fp); break;
+                case 3 : fputs ("Sound velocity at transducer\n", fp); break;
+                case 4 : fputs ("Sound velocity profile\n", fp); break;
+                case 5 : fputs ("Multicast RX status\n", fp); break;
+                case 6 : fputs ("bscorr.txt\n", fp); break;
+                default : fprintf (fp, "%u\n", d->datagram.extra_params.info->content); break;
+            }
+
+            switch (d->datagram.extra_params.info->content) {
+
+                /* TODO: */
+
+                case 6 :
+                    fprintf (fp, "\
+num_chars             : %u\n\
+text                  : \n\
+%s\n", d->datagram.extra_params.data.bs_corr.num_chars, d->datagram.extra_params.data.bs_corr.text);
+                    break;
+
+                default : break;
+            }
+
+            break;
+
+        case EMX_DATAGRAM_PU_OUTPUT :
+
+            fprintf (fp, "\
+udp_port1             : %u\n\
+udp_port2             : %u\n\
+udp_port3             : %u\n\
+udp_port4             : %u\n\
+system_descriptor     : %u\n\
+pu_software_version   : %s\n\
+bsp_software_version  : %s\n\
+transceiver1_version  : %s\n\
+transceiver2_version  : %s\n\
+host_ip_address       : %u\n\
+tx_opening_angle      : %u\n\
+rx_opening_angle      : %u\n", d->datagram.pu_output.info->udp_port1, d->datagram.pu_output.info->udp_port2,
+                d->datagram.pu_output.info->udp_port3, d->datagram.pu_output.info->udp_port4, d->datagram.pu_output.info->system_descriptor,
+                d->datagram.pu_output.info->pu_software_version, d->datagram.pu_output.info->bsp_software_version,
+                d->datagram.pu_output.info->transceiver1_version, d->datagram.pu_output.info->transceiver2_version,
+                d->datagram.pu_output.info->host_ip_address, d->datagram.pu_output.info->tx_opening_angle,
+                d->datagram.pu_output.info->rx_opening_angle);
+
+            break;
+
+        case EMX_DATAGRAM_PU_STATUS :
+
+            fprintf (fp, "\
+ping_rate             : %0.2f Hz\n\
+ping_counter          : %u\n\
+swath_distance        : %u\n\
+status_udp_port_2     : %u\n\
+status_serial_port_1  : %u\n\
+status_serial_port_2  : %u\n\
+status_serial_port_3  : %u\n\
+status_serial_port_4  : %u\n\
+pps_status            : %d\n\
+position_status       : %d\n\
+attitude_status       : %d\n\
+clock_status          : %d\n\
+heading_status        : %d\n\
+pu_status             : %u\n\
+heading               : %0.2f deg\n\
+roll                  : %0.2f deg\n\
+pitch                 : %0.2f deg\n\
+heave                 : %0.2f m\n\
+sound_speed           : %0.1f m/s\n\
+depth                 : %0.2f m\n\
+velocity              : %0.2f m/s\n\
+velocity_status       : %u\n\
+ramp                  : %u\n\
+bs_oblique            : %d dB\n\
+bs_normal             : %d dB\n\
+gain                  : %d dB\n\
+depth_normal          : %u m\n\
+range_normal          : %u m\n\
+port_coverage         : %u deg\n\
+stbd_coverage         : %u deg\n\
+sound_speed_svp       : %0.1f m/s\n\
+yaw_stabilization     : %d\n\
+port_coverage2        : %d\n\
+stbd_coverage2        : %d\n\
+cpu_temp              : %d deg C\n", d->datagram.pu_status.info->ping_rate * 0.01, d->datagram.pu_status.info->ping_counter, d->datagram.pu_status.info->swath_distance,
+                d->datagram.pu_status.info->status_udp_port_2, d->datagram.pu_status.info->status_serial_port_1, d->datagram.pu_status.info->status_serial_port_2,
+                d->datagram.pu_status.info->status_serial_port_3, d->datagram.pu_status.info->status_serial_port_4, d->datagram.pu_status.info->pps_status,
+                d->datagram.pu_status.info->position_status, d->datagram.pu_status.info->attitude_status, d->datagram.pu_status.info->clock_status,
+                d->datagram.pu_status.info->heading_status, d->datagram.pu_status.info->pu_status, d->datagram.pu_status.info->heading * 0.01,
+                d->datagram.pu_status.info->roll * 0.01, d->datagram.pu_status.info->pitch * 0.01, d->datagram.pu_status.info->heave * 0.01,
+                d->datagram.pu_status.info->sound_speed * 0.1, d->datagram.pu_status.info->depth * 0.01, d->datagram.pu_status.info->velocity * 0.01,
+                d->datagram.pu_status.info->velocity_status, d->datagram.pu_status.info->ramp, d->datagram.pu_status.info->bs_oblique, d->datagram.pu_status.info->bs_normal,
+                d->datagram.pu_status.info->gain, d->datagram.pu_status.info->depth_normal, d->datagram.pu_status.info->range_normal, d->datagram.pu_status.info->port_coverage,
+                d->datagram.pu_status.info->stbd_coverage, d->datagram.pu_status.info->sound_speed_svp * 0.1, d->datagram.pu_status.info->yaw_stabilization,
+                d->datagram.pu_status.info->port_coverage2, d->datagram.pu_status.info->stbd_coverage2, d->datagram.pu_status.info->cpu_temp);
+
+            break;
+
+        case EMX_DATAGRAM_PU_BIST_RESULT :
+
+            fprintf (fp, "\
+test_number           : %u\n\
+test_result_status    : %d\n\
+text_length           : %d\n", d->datagram.pu_bist_result.info->test_number, d->datagram.pu_bist_result.info->test_result_status,
+                d->datagram.pu_bist_result.text_length);
+
+            fputs ("\
+text                  : ", fp);
+
+            for (i=0; i<d->datagram.pu_bist_result.text_length; i++) {
+                if (d->datagram.pu_bist_result.text[i] == '\0') break;
+                fputc (d->datagram.pu_bist_result.text[i], fp);
+            }
+            fputc ('\n', fp);
+
+            break;
+
+        case EMX_DATAGRAM_TRANSDUCER_TILT :
+
+            fprintf (fp, "\
+num_entries           : %u\n", d->datagram.tilt.info->num_entries);
+
+            if (output_level > 0) {
+
+                for (i=0; i<d->datagram.tilt.info->num_entries; i++) {
+
+                    fprintf (fp, "\
+----- Sample [ %d ] ----\n\
+record_time           : %u\n\
+tilt                  : %0.2f deg\n", i, d->datagram.tilt.data[i].record_time, d->datagram.tilt.data[i].tilt * 0.01);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_HISAS_STATUS :
+
+            fprintf (fp, "\
+version_id            : %u\n\
+ping_rate             : %0.2f Hz\n\
+ping_counter          : %u\n\
+pu_idle_count         : %u\n\
+sensor_input_status   : %u\n\
+pps_status            : %d\n\
+clock_status          : %d\n\
+attitude_status       : %d\n\
+trigger_status        : %u\n\
+pu_modes              : %u\n\
+logger_status         : %u\n\
+yaw                   : %0.2f deg\n\
+roll                  : %0.2f deg\n\
+pitch                 : %0.2f deg\n\
+heave                 : %0.3f m\n\
+sound_speed           : %0.2f m/s\n\
+log_file_size_port    : %u Bytes\n\
+log_file_size_stbd    : %u Bytes\n\
+free_space_port       : %u MBytes\n\
+free_space_stbd       : %u MBytes\n\
+cbmf_1_status         : %u\n\
+cbmf_2_status         : %u\n\
+tru_board_status      : %u\n\
+pu_status             : %u\n\
+cpu_temp              : %d deg C\n\
+lptx_temp             : %d deg C\n\
+lprx_temp             : %d deg C\n\
+hdd_temp              : %d deg C\n\
+last_nav_depth_input  : %d\n\
+last_nav_alt_input    : %d\n\
+transmitters_passive  : %u\n\
+ext_trigger_enabled   : %u\n\
+sidescan_bathy_enabled: %u\n\
+insas_enabled         : %u\n", d->datagram.hisas_status.info->version_id, d->datagram.hisas_status.info->ping_rate * 0.01,
+                d->datagram.hisas_status.info->ping_counter, d->datagram.hisas_status.info->pu_idle_count,
+                d->datagram.hisas_status.info->sensor_input_status, d->datagram.hisas_status.info->pps_status,
+                d->datagram.hisas_status.info->clock_status, d->datagram.hisas_status.info->attitude_status,
+                d->datagram.hisas_status.info->trigger_status, d->datagram.hisas_status.info->pu_modes,
+                d->datagram.hisas_status.info->logger_status, d->datagram.hisas_status.info->yaw * 0.01,
+                d->datagram.hisas_status.info->roll * 0.01, d->datagram.hisas_status.info->pitch * 0.01, d->datagram.hisas_status.info->heave * 0.01,
+                d->datagram.hisas_status.info->sound_speed * 0.1, d->datagram.hisas_status.info->log_file_size_port,
+                d->datagram.hisas_status.info->log_file_size_stbd, d->datagram.hisas_status.info->free_space_port,
+                d->datagram.hisas_status.info->free_space_stbd, d->datagram.hisas_status.info->cbmf_1_status,
+                d->datagram.hisas_status.info->cbmf_2_status, d->datagram.hisas_status.info->tru_board_status,
+                d->datagram.hisas_status.info->pu_status, d->datagram.hisas_status.info->cpu_temp,
+                d->datagram.hisas_status.info->lptx_temp, d->datagram.hisas_status.info->lprx_temp,
+                d->datagram.hisas_status.info->hdd_temp, d->datagram.hisas_status.info->last_nav_depth_input,
+                d->datagram.hisas_status.info->last_nav_altitude_input, d->datagram.hisas_status.info->transmitters_passive,
+                d->datagram.hisas_status.info->external_trigger_enabled, d->datagram.hisas_status.info->sidescan_bathy_enabled,
+                d->datagram.hisas_status.info->in_mission_sas_enabled);
+
+            break;
+
+        case EMX_DATAGRAM_SIDESCAN_STATUS :
+
+            fprintf (fp, "\
+file_format           : %u\n\
+system_type           : %u\n\
+sonar_type            : %u\n\
+nav_units             : %u\n\
+num_channels          : %u\n", d->datagram.sidescan_status.info->file_format, d->datagram.sidescan_status.info->system_type,
+                d->datagram.sidescan_status.info->sonar_type, d->datagram.sidescan_status.info->nav_units,
+                d->datagram.sidescan_status.info->num_channels);
+
+            for (i=0; i<d->datagram.sidescan_status.info->num_channels; i++) {
+
+                fprintf (fp, "\
+----- Channel %d -------\n\
+type_of_channel       : %u\n\
+sub_channel_number    : %u\n\
+correction_flags      : %u\n\
+uni_polar             : %u\n\
+bytes_per_sample      : %u\n\
+channel_name          : %s\n\
+frequency             : %0.1f Hz\n\
+horiz_beam_angle      : %0.1f deg\n\
+tilt_angle            : %0.1f deg\n\
+beam_width            : %0.1f deg\n\
+offset_x              : %0.3f m\n\
+offset_y              : %0.3f m\n\
+offset_z              : %0.3f m\n\
+offset_yaw            : %0.1f deg\n\
+offset_pitch          : %0.1f deg\n\
+offset_roll           : %0.1f deg\n", i, d->datagram.sidescan_status.info->channel[i].type_of_channel,
+                    d->datagram.sidescan_status.info->channel[i].sub_channel_number, d->datagram.sidescan_status.info->channel[i].correction_flags,
+                    d->datagram.sidescan_status.info->channel[i].uni_polar, d->datagram.sidescan_status.info->channel[i].bytes_per_sample,
+                    d->datagram.sidescan_status.info->channel[i].channel_name, d->datagram.sidescan_status.info->channel[i].frequency,
+                    d->datagram.sidescan_status.info->channel[i].horiz_beam_angle, d->datagram.sidescan_status.info->channel[i].tilt_angle,
+                    d->datagram.sidescan_status.info->channel[i].beam_width, d->datagram.sidescan_status.info->channel[i].offset_x,
+                    d->datagram.sidescan_status.info->channel[i].offset_y, d->datagram.sidescan_status.info->channel[i].offset_z,
+                    d->datagram.sidescan_status.info->channel[i].offset_yaw, d->datagram.sidescan_status.info->channel[i].offset_pitch,
+                    d->datagram.sidescan_status.info->channel[i].offset_roll);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_HISAS_1032_SIDESCAN :
+
+            fprintf (fp, "\
+magic_number          : 0x%x\n\
+header_type           : %u\n\
+beam_number           : %u\n\
+num_channels          : %u\n\
+num_bytes_record      : %u\n\
+year                  : %u\n\
+month                 : %u\n\
+day                   : %u\n\
+hour                  : %u\n\
+minute                : %u\n\
+second                : %u\n\
+hseconds              : %u\n\
+ping_number           : %u\n\
+sound_velocity_two_way: %0.1f m/s\n\
+sound_velocity        : %0.1f m/s\n\
+fix_time_hour         : %u\n\
+fix_time_minute       : %u\n\
+fix_time_second       : %u\n\
+fix_time_hsecond      : %u\n\
+sensor_speed          : %0.1f kts\n\
+sensor_lat            : %0.8f deg\n\
+sensor_lon            : %0.8f deg\n\
+sensor_depth          : %0.2f m\n\
+sensor_altitude       : %0.2f m\n\
+sensor_aux_altitude   : %0.2f m\n\
+sensor_pitch          : %0.1f deg\n\
+sensor_roll           : %0.1f deg\n\
+sensor_heading        : %0.1f deg\n", d->datagram.sidescan_data.info->magic_number, d->datagram.sidescan_data.info->header_type,
+                d->datagram.sidescan_data.info->beam_number, d->datagram.sidescan_data.info->num_channels,
+                d->datagram.sidescan_data.info->num_bytes_record, d->datagram.sidescan_data.info->year,
+                d->datagram.sidescan_data.info->month, d->datagram.sidescan_data.info->day, d->datagram.sidescan_data.info->hour,
+                d->datagram.sidescan_data.info->minute, d->datagram.sidescan_data.info->second, d->datagram.sidescan_data.info->hseconds,
+                d->datagram.sidescan_data.info->ping_number, d->datagram.sidescan_data.info->sound_velocity_two_way,
+                d->datagram.sidescan_data.info->sound_velocity, d->datagram.sidescan_data.info->fix_time_hour,
+                d->datagram.sidescan_data.info->fix_time_minute, d->datagram.sidescan_data.info->fix_time_second,
                 d->datagram.sidescan_data.info->fix_time_hsecond, d->datagram.sidescan_data.info->sensor_speed,
                 d->datagram.sidescan_data.info->sensor_lat, d->datagram.sidescan_data.info->sensor_lon,
                 d->datagram.sidescan_data.info->sensor_depth, d->datagram.sidescan_data.info->sensor_altitude,
                 d->datagram.sidescan_data.info->sensor_aux_altitude, d->datagram.sidescan_data.info->sensor_pitch,
                 d->datagram.sidescan_data.info->sensor_roll, d->datagram.sidescan_data.info->sensor_heading);
 
-            for (i=0; i<d->datagram.sidescan_data.info->num_channels; i++) {
+            for (i=0; i<d->datagram.sidescan_data.info->num_channels; i++) {
+
+                fprintf (fp, "\
+----- Channel %d -------\n\
+channel_number        : %u\n\
+slant_range           : %0.1f m\n\
+time_duration         : %0.4f s\n\
+seconds_per_ping      : %0.4f s\n\
+num_samples           : %u\n\
+weight                : %d\n", i, d->datagram.sidescan_data.channel[i].info->channel_number, d->datagram.sidescan_data.channel[i].info->slant_range,
+                    d->datagram.sidescan_data.channel[i].info->time_duration, d->datagram.sidescan_data.channel[i].info->seconds_per_ping,
+                    d->datagram.sidescan_data.channel[i].info->num_samples, d->datagram.sidescan_data.channel[i].info->weight);
+
+                if (output_level > 0) {
+
+                    int j;
+
+                    fputs ("data                  : ", fp);
+
+                    if (d->datagram.sidescan_data.channel[i].bytes_per_sample == 2) {
+                        for (j=0; j<d->datagram.sidescan_data.channel[i].info->num_samples; j++) {
+                            fprintf (fp, "%u ", d->datagram.sidescan_data.channel[i].data.u16[j]);
+                        }
+                    } else  {
+                        for (j=0; j<d->datagram.sidescan_data.channel[i].info->num_samples; j++) {
+                            fprintf (fp, "%0.1f ", d->datagram.sidescan_data.channel[i].data.f32[j]);
+                        }
+                    }
+
+                    fputc ('\n', fp);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_NAVIGATION_OUTPUT :
+
+            fprintf (fp, "\
+data_type             : %u\n\
+bytes_per_element     : %u\n\
+num_elements          : %u\n\
+date                  : %u\n\
+time_ms               : %u\n\
+time_offset           : %u\n\
+latitude              : %0.8f deg\n\
+longitude             : %0.8f deg\n\
+depth                 : %0.2f m\n\
+heading               : %0.1f deg\n\
+pitch                 : %0.1f deg\n\
+roll                  : %0.1f deg\n\
+velocity_forward      : %0.1f m/s\n\
+velocity_stbd         : %0.1f m/s\n\
+velocity_down         : %0.1f m/s\n\
+horizontal_uncertainty: %0.2f m\n\
+altitude              : %0.2f m\n\
+sound_speed           : %0.1f m/s\n\
+data_validity         : %u\n", d->datagram.navigation_output.info->data_type, d->datagram.navigation_output.info->bytes_per_element,
+                d->datagram.navigation_output.info->num_elements, d->datagram.navigation_output.info->date,
+                d->datagram.navigation_output.info->time_ms, d->datagram.navigation_output.info->time_offset,
+                d->datagram.navigation_output.info->latitude, d->datagram.navigation_output.info->longitude,
+                d->datagram.navigation_output.info->depth, d->datagram.navigation_output.info->heading,
+                d->datagram.navigation_output.info->pitch, d->datagram.navigation_output.info->roll,
+                d->datagram.navigation_output.info->velocity_forward, d->datagram.navigation_output.info->velocity_stbd,
+                d->datagram.navigation_output.info->velocity_down, d->datagram.navigation_output.info->horizontal_uncertainty,
+                d->datagram.navigation_output.info->altitude, d->datagram.navigation_output.info->sound_speed,
+                d->datagram.navigation_output.info->data_validity);
+
+            break;
+
+        default : break;
+    }
+}
+
+
+/******************************************************************************
+*
+* emx_set_ignore_wc - Set the boolean to ignore (or skip) watercolumn data
+*   while reading data from the file handle H.
+*
+******************************************************************************/
+
+void emx_set_ignore_wc (
+    emx_handle *h,
+    const int ignore_wc) {
+
+    assert (h);
+    emx_prefetch_stop (h);
+    h->ignore_wc = ignore_wc;
+}
+
+
+/******************************************************************************
+*
+* emx_set_ignore_checksum - Set the boolean to not verify the datagram checksum.
+*
+******************************************************************************/
+
+void emx_set_ignore_checksum (
+    emx_handle *h,
+    const int ignore_checksum) {
+
+    assert (h);
+    emx_prefetch_stop (h);
+    h->ignore_checksum = ignore_checksum;
+}
+
+
+/******************************************************************************
+*
+* emx_set_checksum_mode - Set the MODE used to verify the datagram checksums
+*   of the file handle H.  In the EMX_CHECKSUM_EAGER mode, which is the default,
+*   each checksum is verified by emx_read(), and datagrams with an invalid
+*   checksum are discarded unless emx_set_ignore_checksum() is set.  In the
+*   EMX_CHECKSUM_DEFERRED mode, the checksum is only verified if the caller
+*   calls emx_verify_checksum() before the next datagram is read, so no time is
+*   spent on files that are trusted.  In the EMX_CHECKSUM_THREAD mode, the
+*   checksum is verified on a worker thread while the caller processes the
+*   datagram, and emx_verify_checksum() waits for the result.  In both of these
+*   modes, datagrams with an invalid checksum are not discarded, and the result
+*   must be checked with emx_verify_checksum().  Files that are byte-swapped, or
+*   if a worker thread can not be created, are verified by emx_read() in the
+*   EMX_CHECKSUM_THREAD mode, but datagrams are still only discarded in the
+*   eager mode.  The data of a datagram must not be changed by the caller before
+*   its checksum is verified.
+*
+* Return: 0 if the mode was set, or
+*         CS_EINVAL if the mode is invalid.
+*
+******************************************************************************/
+
+int emx_set_checksum_mode (
+    emx_handle *h,
+    const int mode) {
+
+    assert (h);
+
+    if (emx_prefetch_stop (h) != 0) return h->emx_errno;
+
+    if ((mode != EMX_CHECKSUM_EAGER) && (mode != EMX_CHECKSUM_DEFERRED) && (mode != EMX_CHECKSUM_THREAD)) {
+        return CS_EINVAL;
+    }
+
+    if ((mode == EMX_CHECKSUM_THREAD) && !h->worker) {
+        h->worker = cpl_worker_create ();
+        if (!h->worker) {
+            cpl_debug (emx_debug, "Unable to create worker thread\n");
+        }
+    }
+
+    h->checksum_mode = mode;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_verify_checksum - Verify the checksum of the last datagram read from the
+*   file handle H, which is needed in the EMX_CHECKSUM_DEFERRED and
+*   EMX_CHECKSUM_THREAD modes set by emx_set_checksum_mode().  In the eager mode,
+*   the result of the verification by emx_read() is returned.
+*
+* Return: 1 if the checksum and end byte of the datagram are valid, or
+*         0 if the datagram is invalid.
+*
+******************************************************************************/
+
+int emx_verify_checksum (
+    emx_handle *h) {
+
+    assert (h);
+
+    if (h->checksum_pending) {
+        if (h->checksum_pending == EMX_CHECKSUM_THREAD) {
+            cpl_worker_wait (h->worker);
+        } else {
+            h->checksum.valid = emx_finish_checksum (&(h->checksum));
+        }
+
+        if (h->checksum.valid == 0) h->stats.checksum_failures++;
+    }
+
+    h->checksum_pending = 0;
+
+    return h->checksum.valid;
+}
+
+
+/******************************************************************************
+*
+* emx_set_lazy_swap - Set the boolean to byte swap the beam and sample arrays of
+*   the datagrams read from the file handle H only when they are accessed.  If
+*   set and the file is byte-swapped, then the arrays of the XYZ 88, raw range
+*   and angle 78, seabed image 89 and water column datagrams are left in the
+*   byte order of the file by emx_read(), and emx_get_array_data() must be
+*   called before the arrays are used, including by emx_print() and
+*   emx_get_xyz_columns().  The header and fixed fields are always swapped.
+*
+******************************************************************************/
+
+void emx_set_lazy_swap (
+    emx_handle *h,
+    const int lazy_swap) {
+
+    assert (h);
+    emx_prefetch_stop (h);
+    h->lazy_swap = lazy_swap;
+}
+
+
+/******************************************************************************
+*
+* emx_get_array_data - Get the data of the last datagram read from the file
+*   handle H with its beam and sample arrays byte swapped to the native byte
+*   order, if they were not swapped by emx_read() in the lazy mode set by
+*   emx_set_lazy_swap().
+*
+* Return: A pointer to the data of the last datagram read.
+*
+******************************************************************************/
+
+emx_data * emx_get_array_data (
+    emx_handle *h) {
+
+    assert (h);
+
+    if (h->swap_pending) {
+        emx_swap_arrays (&h->d.datagram, h->d.header.datagram_type);
+        h->swap_pending = 0;
+    }
+
+    return &(h->d);
+}
+
+
+/******************************************************************************
+*
+* emx_set_resync - Set the boolean to resynchronize after corrupt data while
+*   reading data from the file handle H.  If set, then an invalid datagram
+*   header, a missing end identifier, or a truncated datagram causes emx_read()
+*   to search forward for the next valid datagram instead of returning an error.
+*
+******************************************************************************/
+
+void emx_set_resync (
+    emx_handle *h,
+    const int resync) {
+
+    assert (h);
+    emx_prefetch_stop (h);
+    h->resync = resync;
+}
+
+
+/******************************************************************************
+*
+* emx_get_resync_info - Store the number of bytes and the number of corrupt
+*   datagrams skipped in resync mode by the file handle H in BYTES and COUNT.
+*   Consecutive corrupt datagrams are counted as one.
+*
+******************************************************************************/
+
+void emx_get_resync_info (
+    const emx_handle *h,
+    uint64_t *bytes,
+    uint64_t *count) {
+
+    assert (h);
+    assert (bytes);
+    assert (count);
+
+    *bytes = h->resync_bytes;
+    *count = h->resync_count;
+}
+
+
+/******************************************************************************
+*
+* emx_set_nav - Set the navigation store NAV, which must be initialized with
+*   cpl_nav_init(), to collect the attitude, network attitude, heading, and
+*   position datagrams read from the file handle H.  The samples are stored in
+*   time order by emx_read(), with the time of each entry given by the datagram
+*   time plus its record time.  The store is not freed by emx_close(), so the
+*   samples of several files can be collected.  If NAV is NULL, then no more
+*   samples are stored.
+*
+******************************************************************************/
+
+void emx_set_nav (
+    emx_handle *h,
+    cpl_nav *nav) {
+
+    assert (h);
+    h->nav = nav;
+}
+
+
+/******************************************************************************
+*
+* emx_set_type_filter - Set the datagram types to read from the file handle H.
+*   If EXCLUDE is false, then only datagrams with one of the N types given by
+*   TYPES are read, otherwise datagrams with these types are skipped.  Skipped
+*   datagrams are not read into memory and their checksum is not verified.  If
+*   N is zero, then the filter is removed and all datagram types are read.
+*
+* Return: 0 if the filter was set successfully, or
+*         CS_EINVAL if TYPES is NULL and N is not zero.
+*
+******************************************************************************/
+
+int emx_set_type_filter (
+    emx_handle *h,
+    const uint8_t *types,
+    const size_t n,
+    const int exclude) {
+
+    size_t i;
+
+
+    assert (h);
+
+    if (emx_prefetch_stop (h) != 0) return h->emx_errno;
+
+    if ((n > 0) && (types == NULL)) {
+        h->emx_errno = CS_EINVAL;
+        return CS_EINVAL;
+    }
+
+    if (n == 0) {
+        memset (h->skip_type, 0, sizeof (h->skip_type));
+        return CS_ENONE;
+    }
+
+    memset (h->skip_type, exclude ? 0 : 1, sizeof (h->skip_type));
+
+    for (i=0; i<n; i++) {
+        h->skip_type[types[i]] = exclude ? 1 : 0;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_set_block_size - Set the number of bytes read from the file at a time by
+*   the file handle H to BLOCK_SIZE.  Datagrams are served from this block, so a
+*   larger block reduces the number of system calls.  If BLOCK_SIZE is zero, then
+*   the default of CPL_BFILE_BLOCK_SIZE bytes is used.  This has no effect on a
+*   memory-mapped file.
+*
+******************************************************************************/
+
+void emx_set_block_size (
+    emx_handle *h,
+    const size_t block_size) {
+
+    assert (h);
+    emx_prefetch_stop (h);
+    emx_wait_checksum (h);
+    cpl_bfile_set_block_size (&(h->io), block_size);
+}
+
+
+/******************************************************************************
+*
+* emx_set_async_io - Keep DEPTH reads of the block size in flight ahead of the
+*   datagrams being parsed for the file handle H, which lets one thread keep a
+*   fast device busy, especially when reading many files at once.  On Linux,
+*   the reads are queued with io_uring, and elsewhere they are made with pread.
+*   If DIRECT is non-zero, then the file is read with O_DIRECT where supported,
+*   so a large file does not evict other data from the page cache.  Each read
+*   is the block size set by emx_set_block_size() before this call, rounded up
+*   to a multiple of CPL_BFILE_ALIGN bytes.  Seeking and the index work as before.
+*   If DEPTH is zero, then the file is read with plain blocking reads.  This has
+*   no effect on a memory-mapped file.
+*
+* Return: 0 if the reads were set successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EUNSUP if the file does not support seeking
+*
+******************************************************************************/
+
+int emx_set_async_io (
+    emx_handle *h,
+    const size_t depth,
+    const int direct) {
+
+    assert (h);
+
+    if (h->map) return CS_ENONE;
+
+    if (emx_prefetch_stop (h) != 0) return h->emx_errno;
+    emx_wait_checksum (h);
+
+    if (cpl_bfile_set_async (&(h->io), depth, direct ? CPL_BFILE_DIRECT : 0) != 0) {
+        h->emx_errno = (errno == ENOMEM) ? CS_ENOMEM : CS_EUNSUP;
+        return h->emx_errno;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_set_prefetch - Read datagrams ahead on an I/O thread for the file handle
+*   H, which fills a ring of DEPTH buffers that are each allocated with at least
+*   BUFFER_SIZE bytes and grow to fit larger datagrams.  The I/O thread reads and
+*   validates the datagrams and verifies their checksums, and emx_read() takes
+*   them from the ring in file order without a lock, so parsing overlaps the
+*   file reads.  In the EMX_CHECKSUM_DEFERRED and EMX_CHECKSUM_THREAD modes,
+*   the checksum is verified by the I/O thread and the result is returned by
+*   emx_verify_checksum().  The ring is flushed and read-ahead restarts at the
+*   new file position after a seek, an index is built, or the file is scanned,
+*   and changes to the read options take effect from the datagram after the
+*   last one returned.  If DEPTH is zero, then datagrams are read by the calling
+*   thread again.  Any data returned by a previous call to emx_read() is no
+*   longer valid.
+*
+* Return: 0 if read-ahead was set successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EUNSUP if the I/O thread could not be created
+*         CS_ESEEK
+*
+******************************************************************************/
+
+int emx_set_prefetch (
+    emx_handle *h,
+    const size_t depth,
+    const size_t buffer_size) {
+
+    emx_prefetch *p;
+    size_t i;
+
+
+    assert (h);
+
+    /* Any previous read-ahead returns the file position of the last datagram. */
+    if (h->prefetch) {
+        if (emx_prefetch_stop (h) != 0) return h->emx_errno;
+        emx_prefetch_free (h);
+    }
+
+    if (depth == 0) return CS_ENONE;
+
+    p = (emx_prefetch *) cpl_malloc (sizeof (emx_prefetch));
+    if (!p) {
+        h->emx_errno = CS_ENOMEM;
+        return CS_ENOMEM;
+    }
+
+    p->slots = (emx_prefetch_slot *) cpl_calloc (depth, sizeof (emx_prefetch_slot));
+    if (!p->slots) {
+        cpl_free (p);
+        h->emx_errno = CS_ENOMEM;
+        return CS_ENOMEM;
+    }
+
+    p->depth = depth;
+    p->ready = NULL;
+    p->free = NULL;
+    p->last = NULL;
+    p->position = 0;
+    p->count = 0;
+    p->stalls = 0;
+    p->running = 0;
+    p->worker = NULL;
+
+    /* The buffers are freed by emx_prefetch_free() if anything fails. */
+    h->prefetch = p;
+
+    if (buffer_size > 0) {
+        for (i=0; i<depth; i++) {
+            p->slots[i].buffer = (char *) cpl_malloc (buffer_size);
+            if (!p->slots[i].buffer) {
+                emx_prefetch_free (h);
+                h->emx_errno = CS_ENOMEM;
+                return CS_ENOMEM;
+            }
+            p->slots[i].buffer_size = buffer_size;
+        }
+    }
+
+    p->worker = cpl_worker_create ();
+    if (!p->worker) {
+        emx_prefetch_free (h);
+        h->emx_errno = CS_EUNSUP;
+        return CS_EUNSUP;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_set_decode_threads - Decode THREADS frames of a compressed file ahead of
+*   the reader of the file handle H on as many threads, or decode each frame by
+*   the calling thread when it is read if THREADS is zero.  The frames are
+*   decoded independently, so the threads keep a fast device busy while
+*   emx_read() parses the decoded data.  This has no effect unless the file is
+*   compressed.
+*
+* Return: 0 if the threads were set successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ESEEK
+*
+******************************************************************************/
+
+int emx_set_decode_threads (
+    emx_handle *h,
+    const size_t threads) {
+
+    assert (h);
+
+    if (emx_prefetch_stop (h) != 0) return h->emx_errno;
+
+    cpl_bfile_set_threads (&(h->io), threads);
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_get_prefetch_info - Store the number of datagrams read ahead on the I/O
+*   thread of the file handle H and the number of times emx_read() found the
+*   ring empty and waited for the I/O thread in COUNT and STALLS.  A stall count
+*   close to the datagram count means the read is limited by the file I/O, and
+*   a low count means the I/O is hidden behind the processing of the data.
+*
+******************************************************************************/
+
+void emx_get_prefetch_info (
+    const emx_handle *h,
+    uint64_t *count,
+    uint64_t *stalls) {
+
+    assert (h);
+    assert (count);
+    assert (stalls);
+
+    if (h->prefetch) {
+        *count = h->prefetch->count;
+        *stalls = h->prefetch->stalls;
+    } else {
+        *count = 0;
+        *stalls = 0;
+    }
+}
+
+
+/******************************************************************************
+*
+* emx_set_timing - Set the boolean to measure the time spent reading and
+*   parsing each datagram returned by the file handle H.  The times are added
+*   to the read statistics and given to the trace function.  Timing reads a
+*   clock three times per datagram, so it is not enabled by default.  With
+*   read-ahead, the time spent waiting for the I/O thread is counted as I/O.
+*
+******************************************************************************/
+
+void emx_set_timing (
+    emx_handle *h,
+    const int timing) {
+
+    assert (h);
+    h->timing = timing;
+}
+
+
+/******************************************************************************
+*
+* emx_set_trace - Set the trace function FN, which is called with the handle H,
+*   the datagram, the I/O and parse times in nanoseconds, and USER_DATA for
+*   each datagram returned by the handle, before the datagram is returned to
+*   the caller.  The times are zero unless emx_set_timing() is set.  With
+*   read-ahead, the function is called on the calling thread.  If FN is NULL,
+*   then no function is called, which costs nothing while reading.
+*
+******************************************************************************/
+
+void emx_set_trace (
+    emx_handle *h,
+    emx_trace_fn fn,
+    void *user_data) {
+
+    assert (h);
+
+    h->trace = fn;
+    h->trace_data = user_data;
+}
+
+
+/******************************************************************************
+*
+* emx_get_stats - Store the read statistics of the file handle H in STATS.  The
+*   datagrams and bytes are counted for the datagrams returned by the handle,
+*   and the reads, seeks, and bytes read include the datagrams that were
+*   skipped, the index, and the scan.  Invalid checksums are counted when they
+*   are verified, which is when emx_verify_checksum() is called unless the
+*   checksum mode is EMX_CHECKSUM_EAGER.  The times are only counted while
+*   timing is set by emx_set_timing().
+*
+******************************************************************************/
+
+void emx_get_stats (
+    const emx_handle *h,
+    emx_stats *stats) {
+
+    assert (h);
+    assert (stats);
+
+    *stats = h->stats;
+    stats->bytes_read = h->io.bytes_read;
+    stats->num_reads = h->io.num_reads;
+    stats->num_seeks = h->io.num_seeks;
+    stats->resync_bytes = h->resync_bytes;
+    stats->resync_count = h->resync_count;
+}
+
+
+/******************************************************************************
+*
+* emx_build_index - Build an index of all datagrams in the file given by the
+*   handle H.  Only the datagram headers are read, and the datagram bodies are
+*   skipped, and the checksum is not verified.  The index records the offset,
+*   size, type, time, and counter of each datagram, which allows random access with emx_seek_to_index().  The file
+*   position is restored when finished, but any data returned by a previous call
+*   to emx_read() is no longer valid.  If an invalid datagram header is found,
+*   then the index contains the datagrams up to that point.
+*
+* Return: 0 if the index was built successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EREAD
+*         CS_ESEEK
+*         CS_EBADDATA
+*         CS_EOVERFLOW if the file has more than UINT32_MAX datagrams
+*
+******************************************************************************/
+
+int emx_build_index (
+    emx_handle *h) {
+
+    emx_index_entry *entry;
+    uint64_t file_size;
+    uint64_t position;
+    uint64_t offset;
+    size_t alloc;
+    int status;
+
+
+    assert (h);
+
+    if (emx_prefetch_stop (h) != 0) return h->emx_errno;
+
+    emx_free_index (h);
+
+    /* The index is only useful if the file can be repositioned. */
+    if (emx_file_size (h, &file_size) != 0) {
+        cpl_debug (emx_debug, "Unable to get file size\n");
+        h->emx_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    position = emx_tell (h);
+
+    if (emx_seek (h, 0) != 0) {
+        h->emx_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    for (;;) {
+        offset = emx_tell (h);
+
+        status = emx_read_header (h);
+        if (status <= 0) break;
+
+        /* Stop at a truncated datagram at the end of the file.  The datagram size does not include the size field. */
+        if (offset + h->d.header.bytes_in_datagram + sizeof (uint32_t) > file_size) {
+            cpl_debug (emx_debug, "Unexpected end of file\n");
+            status = CS_EBADDATA;
+            break;
+        }
+
+        /* The index file stores the number of entries in 32 bits. */
+        if (h->index_size == UINT32_MAX) {
+            cpl_debug (emx_debug, "Too many datagrams to index\n");
+            status = CS_EOVERFLOW;
+            break;
+        }
+
+        alloc = h->index_alloc;
+        entry = (emx_index_entry *) cpl_realloc2 (h->index, h->index_size, sizeof (emx_index_entry), &alloc);
+        if (!entry) {
+            status = CS_ENOMEM;
+            break;
+        }
+
+        h->index = entry;
+        h->index_alloc = alloc;
+        entry = &(h->index[h->index_size++]);
+
+        entry->offset = offset;
+        entry->bytes_in_datagram = h->d.header.bytes_in_datagram;
+        entry->date = h->d.header.date;
+        entry->time_ms = h->d.header.time_ms;
+        entry->counter = h->d.header.counter;
+        entry->datagram_type = h->d.header.datagram_type;
+        entry->reserved = 0;
+
+        /* Skip the datagram body. */
+        status = emx_skip (h, h->d.header.bytes_in_datagram + sizeof (uint32_t) - sizeof (emx_datagram_header));
+        if (status != 0) break;
+    }
+
+    cpl_debug (emx_debug, "Indexed %lu datagrams\n", (unsigned long) h->index_size);
+
+    /* Keep the datagrams indexed before any invalid data, but discard the index on other errors. */
+    if ((status < 0) && (status != CS_EBADDATA)) {
+        emx_free_index (h);
+    } else if (emx_sort_index (h) != 0) {
+        emx_free_index (h);
+        status = CS_ENOMEM;
+    }
+
+    /* Restore the original file position. */
+    if ((emx_seek (h, position) != 0) && (status >= 0)) {
+        status = CS_ESEEK;
+    }
+
+    if (status < 0) {
+        h->emx_errno = status;
+        return status;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_save_index - Save the datagram index of the file handle H to the sidecar
+*   file given by FILE_NAME.  The index must have been created by calling
+*   emx_build_index() or emx_load_index().
+*
+* Return: 0 if the index was saved successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_EOPEN
+*         CS_EWRITE
+*         CS_ECLOSE
+*
+******************************************************************************/
+
+int emx_save_index (
+    const emx_handle *h,
+    const char *file_name) {
+
+    emx_index_file_header header;
+    uint64_t file_size;
+    FILE *fp;
+
+
+    assert (h);
+    assert (file_name);
+
+    if (!h->index_by_type) return CS_EINVAL;
+
+    if (emx_file_size (h, &file_size) != 0) return CS_EINVAL;
+
+    memcpy (header.magic, EMX_INDEX_MAGIC, sizeof (header.magic));
+    header.version = EMX_INDEX_VERSION;
+    header.byte_order = EMX_INDEX_BYTE_ORDER;
+    header.entry_size = sizeof (emx_index_entry);
+    header.num_entries = (uint32_t) h->index_size;
+    header.file_size = file_size;
+
+    fp = cpl_fopen (file_name, CPL_FOPEN_WRITE | CPL_FOPEN_BINARY);
+    if (!fp) return CS_EOPEN;
+
+    if ((fwrite (&header, sizeof (header), 1, fp) != 1) ||
+        ((h->index_size > 0) && (fwrite (h->index, sizeof (emx_index_entry), h->index_size, fp) != h->index_size))) {
+        cpl_debug (emx_debug, "Failed to write index file '%s'\n", file_name);
+        cpl_fclose (fp);
+        cpl_remove (file_name);
+        return CS_EWRITE;
+    }
+
+    if (cpl_fclose (fp) != 0) return CS_ECLOSE;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_load_index - Load the datagram index of the file handle H from the sidecar
+*   file given by FILE_NAME that was written by emx_save_index().  The index is
+*   rejected if it was not created for a file of the same size on a host of the
+*   same byte order, or if its entries are not in file order within the file.
+*
+* Return: 0 if the index was loaded successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EOPEN
+*         CS_EREAD
+*         CS_ESEEK
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+int emx_load_index (
+    emx_handle *h,
+    const char *file_name) {
+
+    emx_index_file_header header;
+    const emx_index_entry *e;
+    uint64_t file_size;
+    uint64_t end = 0;
+    size_t i, n;
+    FILE *fp;
+
+
+    assert (h);
+    assert (file_name);
+
+    emx_free_index (h);
+
+    if (emx_file_size (h, &file_size) != 0) return CS_ESEEK;
+
+    fp = cpl_fopen (file_name, CPL_FOPEN_READ | CPL_FOPEN_BINARY);
+    if (!fp) return CS_EOPEN;
+
+    if (cpl_fread (&header, sizeof (header), fp) != 1) {
+        cpl_fclose (fp);
+        return CS_EREAD;
+    }
+
+    if ((memcmp (header.magic, EMX_INDEX_MAGIC, sizeof (header.magic)) != 0) ||
+        (header.version != EMX_INDEX_VERSION) || (header.byte_order != EMX_INDEX_BYTE_ORDER) ||
+        (header.entry_size != sizeof (emx_index_entry)) || (header.file_size != file_size)) {
+        cpl_debug (emx_debug, "Invalid or out of date index file '%s'\n", file_name);
+        cpl_fclose (fp);
+        return CS_EBADDATA;
+    }
+
+    n = (size_t) header.num_entries;
+
+    if (n > 0) {
+        h->index = (emx_index_entry *) cpl_malloc (n * sizeof (emx_index_entry));
+        if (!h->index) {
+            cpl_fclose (fp);
+            return CS_ENOMEM;
+        }
+
+        h->index_alloc = n;
+
+        if (cpl_fread (h->index, n * sizeof (emx_index_entry), fp) != 1) {
+            cpl_fclose (fp);
+            emx_free_index (h);
+            return CS_EREAD;
+        }
+    }
+
+    cpl_fclose (fp);
+
+    /* The entries are used to seek, so they must be in file order and within the file. */
+    for (i=0; i<n; i++) {
+        e = &(h->index[i]);
+        if ((e->offset < end) || (e->offset > file_size) || (e->bytes_in_datagram < sizeof (emx_datagram_header) - sizeof (uint32_t)) ||
+            (e->bytes_in_datagram + sizeof (uint32_t) > file_size - e->offset)) {
+            cpl_debug (emx_debug, "Invalid index entry %lu in index file '%s'\n", (unsigned long) i, file_name);
+            emx_free_index (h);
+            return CS_EBADDATA;
+        }
+        end = e->offset + e->bytes_in_datagram + sizeof (uint32_t);
+    }
+
+    h->index_size = n;
+
+    if (emx_sort_index (h) != 0) {
+        emx_free_index (h);
+        return CS_ENOMEM;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_get_index - Return the datagram index of the file handle H and store the
+*   number of entries in N.  The index is sorted in file order.
+*
+* Return: A pointer to the array of index entries, or
+*         NULL if no index has been built or loaded.
+*
+******************************************************************************/
+
+const emx_index_entry * emx_get_index (
+    const emx_handle *h,
+    size_t *n) {
+
+    assert (h);
+    assert (n);
+
+    *n = h->index_size;
+    return h->index;
+}
+
+
+/******************************************************************************
+*
+* emx_find_index - Find the N'th (starting from zero) datagram of type TYPE in
+*   the datagram index of the file handle H and store the index entry number in
+*   ENTRY.  Datagrams of the same type are counted in time order.  If TYPE is
+*   zero, then the N'th datagram of any type in file order is found.
+*
+* Return: 0 if the datagram was found, or
+*         error condition if it was not found.
+*
+* Errors: CS_EINVAL
+*         CS_EDOM
+*
+******************************************************************************/
+
+int emx_find_index (
+    const emx_handle *h,
+    const uint8_t type,
+    const size_t n,
+    size_t *entry) {
+
+    size_t lo, hi, mid;
+
+
+    assert (h);
+    assert (entry);
+
+    if (!h->index_by_type) return CS_EINVAL;
+
+    if (type == 0) {
+        if (n >= h->index_size) return CS_EDOM;
+        *entry = n;
+        return CS_ENONE;
+    }
+
+    /* Find the first entry of the given type. */
+    lo = 0;
+    hi = h->index_size;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (h->index[h->index_by_type[mid]].datagram_type < type) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if ((n >= h->index_size - lo) || (h->index[h->index_by_type[lo + n]].datagram_type != type)) {
+        return CS_EDOM;
+    }
+
+    *entry = h->index_by_type[lo + n];
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_find_index_time - Find the first datagram of type TYPE at or after the time
+*   given by DATE (year*10000 + month*100 + day) and TIME_MS (milliseconds since
+*   midnight) in the datagram index of the file handle H and store the index
+*   entry number in ENTRY.  If TYPE is zero, then a
+*   datagram of any type is found.
+*
+* Return: 0 if the datagram was found, or
+*         error condition if it was not found.
+*
+* Errors: CS_EINVAL
+*         CS_EDOM
+*
+******************************************************************************/
+
+int emx_find_index_time (
+    const emx_handle *h,
+    const uint8_t type,
+    const uint32_t date,
+    const uint32_t time_ms,
+    size_t *entry) {
+
+    const emx_index_entry *e;
+    const uint32_t *order;
+    uint64_t t;
+    size_t lo, hi, mid;
+
+
+    assert (h);
+    assert (entry);
+
+    if (!h->index_by_type) return CS_EINVAL;
+
+    t = emx_index_time (date, time_ms);
+    order = type == 0 ? h->index_by_time : h->index_by_type;
+
+    /* Find the first entry not less than (type, time). */
+    lo = 0;
+    hi = h->index_size;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        e = &(h->index[order[mid]]);
+        if ((e->datagram_type < type) ||
+            (((type == 0) || (e->datagram_type == type)) && (emx_index_time (e->date, e->time_ms) < t))) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if ((lo == h->index_size) || ((type != 0) && (h->index[order[lo]].datagram_type != type))) {
+        return CS_EDOM;
+    }
+
+    *entry = order[lo];
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_seek_to_index - Set the file position of the file handle H to the datagram
+*   given by the index entry number ENTRY, so the next call to emx_read() will
+*   read this datagram.
+*
+* Return: 0 if the file position was set, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_EDOM
+*         CS_ESEEK
+*
+******************************************************************************/
+
+int emx_seek_to_index (
+    emx_handle *h,
+    const size_t entry) {
+
+    assert (h);
+
+    if (!h->index_by_type) {
+        h->emx_errno = CS_EINVAL;
+        return CS_EINVAL;
+    }
+
+    if (entry >= h->index_size) {
+        h->emx_errno = CS_EDOM;
+        return CS_EDOM;
+    }
+
+    if (emx_prefetch_stop (h) != 0) return h->emx_errno;
+
+    if (emx_seek (h, h->index[entry].offset) != 0) {
+        h->emx_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_scan - Scan all datagrams in the file given by the handle H and store the
+*   number and size of the datagrams of each type, the time span, and the EM
+*   model number in the summary S.  Only the datagram headers are read, and the
+*   datagram bodies are skipped without verifying the checksum.  The file
+*   position is restored when finished, but any data returned by a previous call
+*   to emx_read() is no longer valid.  If an invalid datagram header is found,
+*   then the summary contains the datagrams up to that point.
+*
+* Return: 0 if the file was scanned successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EREAD
+*         CS_ESEEK
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+int emx_scan (
+    emx_handle *h,
+    emx_scan_summary *s) {
+
+    const emx_datagram_header *header;
+    uint64_t file_size;
+    uint64_t position;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t t, t_first, t_last;
+    int status;
+
+
+    assert (h);
+    assert (s);
+
+    memset (s, 0, sizeof (emx_scan_summary));
+
+    if (emx_prefetch_stop (h) != 0) return h->emx_errno;
+
+    if (emx_file_size (h, &file_size) != 0) {
+        cpl_debug (emx_debug, "Unable to get file size\n");
+        h->emx_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    position = emx_tell (h);
+
+    if (emx_seek (h, 0) != 0) {
+        h->emx_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    header = &(h->d.header);
+    t_first = t_last = 0;
+
+    for (;;) {
+        offset = emx_tell (h);
+
+        status = emx_read_header (h);
+        if (status <= 0) break;
+
+        /* Stop at a truncated datagram at the end of the file.  The datagram size does not include the size field. */
+        size = header->bytes_in_datagram + sizeof (uint32_t);
+        if (offset + size > file_size) {
+            cpl_debug (emx_debug, "Unexpected end of file\n");
+            status = CS_EBADDATA;
+            break;
+        }
+
+        t = emx_index_time (header->date, header->time_ms);
+
+        if (s->num_datagrams == 0) {
+            s->em_model_number = header->em_model_number;
+            s->serial_number = header->serial_number;
+            t_first = t_last = t;
+            s->first_date = s->last_date = header->date;
+            s->first_time_ms = s->last_time_ms = header->time_ms;
+        } else if (t < t_first) {
+            t_first = t;
+            s->first_date = header->date;
+            s->first_time_ms = header->time_ms;
+        } else if (t > t_last) {
+            t_last = t;
+            s->last_date = header->date;
+            s->last_time_ms = header->time_ms;
+        }
+
+        s->num_datagrams++;
+        s->num_bytes += size;
+        s->count[header->datagram_type]++;
+        s->bytes[header->datagram_type] += size;
+
+        /* Skip the datagram body. */
+        status = emx_skip (h, size - sizeof (emx_datagram_header));
+        if (status != 0) break;
+    }
+
+    cpl_debug (emx_debug, "Scanned %lu datagrams\n", (unsigned long) s->num_datagrams);
+
+    /* Restore the original file position. */
+    if ((emx_seek (h, position) != 0) && (status >= 0)) {
+        status = CS_ESEEK;
+    }
+
+    if (status < 0) {
+        h->emx_errno = status;
+        return status;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_copy - Copy the datagrams of the file handle H from the current position
+*   to the file descriptor FD without parsing them, e.g., to make a copy of a
+*   file without the water column datagrams or to split a file.  Only the
+*   datagram headers are read, and the datagrams are written verbatim in the
+*   byte order of the file.  The datagrams rejected by the datagram type filter
+*   or by emx_set_ignore_wc() are skipped, as are the datagrams before the time
+*   START_TIME in nanoseconds since 1970-01-01 if it is not zero.
+*
+*   Copying stops before the first datagram copied at or after the time
+*   END_TIME if it is not zero, or before the datagram that would make the size
+*   written larger than MAX_SIZE bytes if it is not zero, and the handle is left
+*   at that datagram.  At least one datagram is always written.  Therefore, a
+*   file is split by calling this function again with the next output file
+*   until it returns zero.  If resync is set by emx_set_resync(), then corrupt
+*   data is skipped as by emx_read() and is not written.  The number of bytes
+*   written is stored in SIZE if not NULL.  The datagrams are written directly
+*   from a memory-mapped file or otherwise collected in a large buffer, so there
+*   are few writes.  Any data returned by a previous call to emx_read() is no
+*   longer valid.
+*
+* Return: 1 if copying stopped at END_TIME or MAX_SIZE,
+*         0 if the end of the file was reached, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EREAD
+*         CS_EWRITE
+*         CS_ESEEK
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+int emx_copy (
+    emx_handle *h,
+    const int fd,
+    const uint64_t start_time,
+    const uint64_t end_time,
+    const uint64_t max_size,
+    uint64_t *size) {
+
+    emx_datagram_header header;
+    const char *run;
+    char *buffer;
+    char *p;
+    uint64_t offset;
+    uint64_t written;
+    int64_t t;
+    size_t run_size;
+    size_t buffer_size;
+    size_t n;
+    ssize_t result;
+    int status;
+
+
+    assert (h);
+
+    if (size) *size = 0;
+
+    if (emx_prefetch_stop (h) != 0) return h->emx_errno;
+
+    /* The buffer of the previous datagram is reused, so its checksum must be verified first. */
+    emx_wait_checksum (h);
+    h->swap_pending = 0;
+
+    /* The datagram data is only valid until the next read, so buffered files are copied to the buffer. */
+    buffer = NULL;
+    if (!h->map) {
+        buffer = (char *) cpl_malloc (EMX_COPY_BUFFER_SIZE);
+        if (!buffer) {
+            h->emx_errno = CS_ENOMEM;
+            return CS_ENOMEM;
+        }
+    }
+
+    run = NULL;
+    run_size = 0;
+    buffer_size = 0;
+    written = 0;
+
+    for (;;) {
+        offset = emx_tell (h);
+
+        /* Look at the header without reading it, so the handle stays at a datagram that is not copied. */
+        result = emx_peek (h, offset, sizeof (emx_datagram_header), &p);
+        if (result <= 0) {
+            status = (int) result;
+            break;
+        }
+
+        if ((size_t) result < sizeof (emx_datagram_header)) {
+            cpl_debug (emx_debug, "Unexpected end of file\n");
+            if (h->resync) goto L1;
+            status = CS_EBADDATA;
+            break;
+        }
+
+        memcpy (&header, p, sizeof (emx_datagram_header));
+
+        status = emx_check_header (&header, &(h->swap));
+        if (status < 0) {
+            cpl_debug (emx_debug, "Invalid header\n");
+            if (h->resync && (status == CS_EBADDATA)) goto L1;
+            break;
+        }
+
+        /* The datagram size does not include the size field. */
+        n = header.bytes_in_datagram + sizeof (uint32_t);
+
+        status = emx_nav_time (h, header.date, header.time_ms, &t);
+        if (status != CS_ENONE) {
+            if (h->resync) goto L1;
+            status = CS_EBADDATA;
+            break;
+        }
+
+        if (!(h->ignore_wc && (header.datagram_type == EMX_DATAGRAM_WATER_COLUMN)) && !h->skip_type[header.datagram_type] &&
+            ((start_time == 0) || ((uint64_t) t >= start_time))) {
+
+            if ((written > 0) && (((end_time != 0) && ((uint64_t) t >= end_time)) || ((max_size != 0) && (written + n > max_size)))) {
+                status = 1;
+                break;
+            }
+
+            if (h->map) {
+                if (h->map_size - offset < n) {
+                    cpl_debug (emx_debug, "Unexpected end of file\n");
+                    if (h->resync) goto L1;
+                    status = CS_EBADDATA;
+                    break;
+                }
+
+                /* In resync mode, a missing end identifier means the datagram size is corrupt as in emx_read(). */
+                if (h->resync && (header.datagram_type != EMX_DATAGRAM_UNKNOWN2) && (h->map[offset + n - 3] != EMX_END_BYTE) && (h->map[offset + n - 3] != 0)) {
+                    cpl_debug (emx_debug, "Invalid end identifier (%u)\n", (uint8_t) h->map[offset + n - 3]);
+                    goto L1;
+                }
+
+                /* Consecutive datagrams are written from the map together. */
+                if (!run) run = (const char *) (h->map + offset);
+                run_size += n;
+                h->io.bytes_read += n;
+            } else {
+                result = emx_peek (h, offset, n, &p);
+                if (result < 0) {
+                    status = (int) result;
+                    break;
+                }
+
+                if ((size_t) result < n) {
+                    cpl_debug (emx_debug, "Unexpected end of file\n");
+                    if (h->resync) goto L1;
+                    status = CS_EBADDATA;
+                    break;
+                }
+
+                if (h->resync && (header.datagram_type != EMX_DATAGRAM_UNKNOWN2) && (p[n - 3] != EMX_END_BYTE) && (p[n - 3] != 0)) {
+                    cpl_debug (emx_debug, "Invalid end identifier (%u)\n", (uint8_t) p[n - 3]);
+                    goto L1;
+                }
+
+                if (buffer_size + n > EMX_COPY_BUFFER_SIZE) {
+                    status = emx_copy_write (fd, buffer, buffer_size);
+                    buffer_size = 0;
+                    if (status != CS_ENONE) break;
+                }
+
+                if (n > EMX_COPY_BUFFER_SIZE) {
+                    status = emx_copy_write (fd, p, n);
+                    if (status != CS_ENONE) break;
+                } else {
+                    memcpy (buffer + buffer_size, p, n);
+                    buffer_size += n;
+                }
+            }
+
+            written += n;
+        } else if (run) {
+            status = emx_copy_write (fd, run, run_size);
+            run = NULL;
+            run_size = 0;
+            if (status != CS_ENONE) break;
+        }
+
+        status = emx_skip (h, n);
+        if (status != 0) break;
+
+        continue;
+
+        /* The datagram at the offset is corrupt, so search for the next valid datagram.  The
+           datagrams collected from the map are not contiguous after it, so those are written first. */
+L1:     if (run) {
+            status = emx_copy_write (fd, run, run_size);
+            run = NULL;
+            run_size = 0;
+            if (status != CS_ENONE) break;
+        }
+
+        status = emx_resync (h, offset);
+        if (status <= 0) break;
+    }
+
+    /* Write the datagrams collected so far, even if an error occurred. */
+    if (run && (emx_copy_write (fd, run, run_size) != CS_ENONE) && (status >= 0)) {
+        status = CS_EWRITE;
+    }
+
+    if (buffer) {
+        if ((emx_copy_write (fd, buffer, buffer_size) != CS_ENONE) && (status >= 0)) {
+            status = CS_EWRITE;
+        }
+        cpl_free (buffer);
+    }
+
+    cpl_debug (emx_debug, "Copied %lu bytes\n", (unsigned long) written);
+
+    if (size) *size = written;
+
+    if (status < 0) h->emx_errno = status;
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* emx_read_files - Read all datagrams of the NUM_FILES files given by FILE_NAMES
+*   using a pool of NUM_THREADS threads, which reads one file per thread at a
+*   time.  If NUM_THREADS is zero or negative, then one thread per processor is
+*   used.  For each file, the callback function FN is first called with a NULL
+*   datagram after the file is opened, so the handle may be set up, e.g., with
+*   emx_set_type_filter().  Then FN is called with each datagram read from the
+*   file along with the file number and USER_DATA.  If FN returns non-zero, then
+*   the rest of the file is skipped.  FN is called for one file at a time per
+*   thread, so FN must be thread-safe if NUM_THREADS is not one, but the datagrams
+*   of a file are always passed in order by the same thread.
+*
+*   If OPTIONS includes EMX_BATCH_MMAP, then the files are opened with
+*   emx_open_mmap(), and if OPTIONS includes EMX_BATCH_SORT, then the datagrams
+*   of each file are passed in order of time using a datagram index.  If not
+*   NULL, then the status of each file is stored in FILE_STATUS, which is zero
+*   if the file was read successfully or an error condition.
+*
+*   Handles opened by the calling program may be used concurrently with this
+*   function, but emx_set_debug() and cpl_set_memory_functions() must not be
+*   called while it is running.
+*
+* Return: 0 if all files were read successfully,
+*         CS_ENOMEM if memory allocation failed, or
+*         CS_EFAIL if any file could not be read.
+*
+******************************************************************************/
+
+int emx_read_files (
+    const char **file_names,
+    const size_t num_files,
+    const int num_threads,
+    const int options,
+    emx_batch_fn fn,
+    void *user_data,
+    int *file_status) {
+
+    emx_batch b;
+    int status = CS_ENONE;
+    int threads_used;
+    size_t i;
+
+
+    assert (file_names);
+    assert (fn);
+
+    if (num_files == 0) return CS_ENONE;
+
+    b.file_names = file_names;
+    b.options = options;
+    b.fn = fn;
+    b.user_data = user_data;
+
+    /* Each thread stores the status of its files, which are checked after all are read. */
+    b.file_status = file_status ? file_status : (int *) cpl_malloc (num_files * sizeof (int));
+    if (!b.file_status) return CS_ENOMEM;
+
+    threads_used = cpl_thread_run (num_files, num_threads, emx_batch_task, &b);
+    cpl_debug (emx_debug, "Read %lu files using %d threads\n", (unsigned long) num_files, threads_used);
+
+    for (i=0; i<num_files; i++) {
+        if (b.file_status[i] != CS_ENONE) {
+            status = CS_EFAIL;
+            break;
+        }
+    }
+
+    if (!file_status) cpl_free (b.file_status);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* emx_read_chunks - Read all datagrams of the file given by FILE_NAME in
+*   parallel by splitting the file into NUM_CHUNKS ranges of about equal size,
+*   which are read by a pool of NUM_THREADS threads.  If NUM_THREADS is zero or
+*   negative, then one thread per processor is used, and if NUM_CHUNKS is zero,
+*   then one chunk per thread is used.  The ranges start at datagram boundaries
+*   found by building a datagram index.  Each chunk is read using its own file
+*   handle, and the callback function FN is first called with a NULL datagram
+*   after the handle is opened, so the handle may be set up, e.g., with
+*   emx_set_type_filter().  Then FN is called with each datagram of the chunk
+*   along with the chunk number and USER_DATA.  If FN returns non-zero, then the
+*   rest of the chunk is skipped.  The datagrams of a chunk are always passed in
+*   file order by the same thread, and the chunks are in order of the chunk
+*   number, so FN may collect the data of each chunk separately and the results
+*   may be joined in order of the chunk number.
+*
+*   If OPTIONS includes EMX_BATCH_MMAP, then the file is opened with
+*   emx_open_mmap().  The option EMX_BATCH_SORT is not supported.  The same
+*   limitations apply as with emx_read_files().
+*
+* Return: 0 if the file was read successfully, or
+*         error condition of the first chunk that could not be read.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EOPEN
+*         CS_ECLOSE
+*         Any error from emx_read() or emx_build_index()
+*
+******************************************************************************/
+
+int emx_read_chunks (
+    const char *file_name,
+    const size_t num_chunks,
+    const int num_threads,
+    const int options,
+    emx_batch_fn fn,
+    void *user_data) {
+
+    emx_chunks c;
+    emx_handle *h;
+    int status = CS_ENONE;
+    int threads_used;
+    size_t i, n;
+
+
+    assert (file_name);
+    assert (fn);
+
+    if (options & EMX_BATCH_SORT) return CS_EINVAL;
+
+    n = num_chunks;
+    if (n == 0) n = num_threads > 0 ? (size_t) num_threads : (size_t) cpl_thread_num_cpus ();
+
+    if (options & EMX_BATCH_MMAP) {
+        h = emx_open_mmap (file_name);
+    } else {
+        h = emx_open (file_name);
+    }
+
+    if (!h) return CS_EOPEN;
+
+    c.file_name = file_name;
+    c.options = options;
+    c.fn = fn;
+    c.user_data = user_data;
+
+    c.offsets = (uint64_t *) cpl_malloc ((n + 1) * sizeof (uint64_t));
+    c.chunk_status = (int *) cpl_malloc (n * sizeof (int));
+
+    if (!c.offsets || !c.chunk_status) {
+        status = CS_ENOMEM;
+    } else {
+        status = emx_split_chunks (h, c.offsets, n);
+    }
+
+    /* The index is only needed to find the chunks, so close the file before reading them. */
+    if ((emx_close (h) != 0) && (status == CS_ENONE)) {
+        status = CS_ECLOSE;
+    }
+
+    if (status == CS_ENONE) {
+        threads_used = cpl_thread_run (n, num_threads, emx_chunk_task, &c);
+        cpl_debug (emx_debug, "Read %lu chunks using %d threads\n", (unsigned long) n, threads_used);
+
+        for (i=0; i<n; i++) {
+            if (c.chunk_status[i] != CS_ENONE) {
+                status = c.chunk_status[i];
+                break;
+            }
+        }
+    }
+
+    cpl_free (c.offsets);
+    cpl_free (c.chunk_status);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* emx_get_errno - Return the error number from the last call.
+*
+******************************************************************************/
+
+int emx_get_errno (
+    const emx_handle *h) {
+
+    assert (h);
+    return h->emx_errno;
+}
+
+
+/******************************************************************************
+*
+* emx_set_debug - Set the debugging output level for the EMX reader.
+*
+******************************************************************************/
+
+void emx_set_debug (
+    const int debug) {
+
+    emx_debug = debug;
+}
+
+
+/******************************************************************************
+*
+* emx_identify - Determine if the file given by FILE_NAME is a EMX file.  The
+*   first EMX_IDENTIFY_SIZE bytes of the file are read once and checked by
+*   emx_identify_data().
+*
+* Return: 1 if the file is a EMX file,
+*         0 if the file is not a EMX file, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EOPEN
+*         CS_ENOMEM
+*         CS_EREAD
+*
+******************************************************************************/
+
+int emx_identify (
+    const char *file_name) {
+
+    ssize_t result;
+    char *buffer;
+    int fd;
+
+
+    if (!file_name) return 0;
+
+    /* Open the binary file for read-only access or return on failure. */
+    fd = cpl_open (file_name, CPL_OPEN_RDONLY | CPL_OPEN_BINARY | CPL_OPEN_SEQUENTIAL);
+
+    if (fd < 0) {
+        cpl_debug (emx_debug, "Open failed for file '%s'\n", file_name);
+        return CS_EOPEN;
+    }
+
+    buffer = (char *) cpl_malloc (EMX_IDENTIFY_SIZE);
+    if (!buffer) {
+        cpl_close (fd);
+        return CS_ENOMEM;
+    }
+
+    /* Read the start of the file and close the file. */
+    result = cpl_read (buffer, EMX_IDENTIFY_SIZE, fd);
+    cpl_close (fd);
+
+    if (result < 0) {
+        cpl_debug (emx_debug, "Read error occurred for file '%s'\n", file_name);
+        cpl_free (buffer);
+        return CS_EREAD;
+    }
+
+    /* Validate the datagram headers and return the result. */
+    result = emx_identify_data (buffer, (size_t) result);
+
+    cpl_free (buffer);
+
+    return (int) result;
+}
+
+
+/******************************************************************************
+*
+* emx_identify_data - Determine if the SIZE bytes DATA at the start of a file
+*   are EMX data.  Up to EMX_IDENTIFY_HEADERS consecutive datagram headers are
+*   validated using the byte order determined from the first header, and each
+*   datagram in DATA must end with the end byte, so random data is very
+*   unlikely to be taken as an EMX file.  A datagram that extends past the end
+*   of DATA ends the check.
+*
+* Return: 1 if the data is EMX data, or
+*         0 if the data is not EMX data.
+*
+******************************************************************************/
+
+int emx_identify_data (
+    const void *data,
+    const size_t size) {
+
+    emx_datagram_header header;
+    const char *p = (const char *) data;
+    size_t datagram_size;
+    size_t offset = 0;
+    size_t n = 0;
+    int swap = -1;
+    uint8_t etx;
+
+
+    assert (data || (size == 0));
+
+    while ((n < EMX_IDENTIFY_HEADERS) && (size - offset >= sizeof (emx_datagram_header))) {
+        memcpy (&header, p + offset, sizeof (emx_datagram_header));
+        if (emx_check_header (&header, &swap) <= 0) return 0;
+
+        n++;
+
+        /* The datagram size does not include the size field itself. */
+        datagram_size = (size_t) header.bytes_in_datagram + 4;
+        if (datagram_size > size - offset) break;
+
+        /* The end byte is followed by the checksum. */
+        if (header.datagram_type != EMX_DATAGRAM_UNKNOWN2) {
+            etx = (uint8_t) p[offset + datagram_size - 3];
+            if ((etx != EMX_END_BYTE) && (etx != 0)) {
+                cpl_debug (emx_debug, "Invalid end byte at end of datagram (%u)\n", etx);
+                return 0;
+            }
+        }
+
+        offset += datagram_size;
+    }
+
+    return n > 0;
+}
+
+
+/******************************************************************************
+*
+* emx_new_handle - Allocate a handle that reads from the open file descriptor
+*   FD and set the default read options.
+*
+* Return: A pointer to the new handle, or
+*         NULL if memory allocation failed.
+*
+******************************************************************************/
+
+static emx_handle * emx_new_handle (
+    const int fd) {
+
+    emx_handle *h;
+
+
+    assert (fd >= 0);
+
+    h = (emx_handle *) cpl_malloc (sizeof (emx_handle));
+    if (!h) return NULL;
+
+    /* Initialize the file buffer. */
+    h->buffer_size = 0;
+    h->buffer = NULL;
+
+    /* Initialize the buffered file reader.  The block is allocated on the first read. */
+    cpl_bfile_init (&(h->io), fd, CPL_BFILE_BLOCK_SIZE);
+
+    /* The file is not memory-mapped unless opened with emx_open_mmap. */
+    h->map = NULL;
+    h->map_size = 0;
+    h->map_offset = 0;
+
+    /* Initialize the file handle. */
+    h->emx_errno = CS_ENONE;
+    h->fd = fd;
+
+    /* Set boolean to ignore watercolumn data to false by default. */
+    h->ignore_wc = 0;
+
+    /* Set boolean to ignore the datagram checksum to false by default. */
+    h->ignore_checksum = 0;
+
+    /* Verify the datagram checksum when each datagram is read by default. */
+    h->checksum_mode = EMX_CHECKSUM_EAGER;
+    h->checksum_pending = 0;
+    h->checksum.valid = 1;
+    h->worker = NULL;
+
+    /* All datagram types are read by default. */
+    memset (h->skip_type, 0, sizeof (h->skip_type));
+
+    /* Set boolean to resynchronize after corrupt data to false by default. */
+    h->resync = 0;
+    h->resync_bytes = 0;
+    h->resync_count = 0;
+
+    /* Datagrams that are skipped are followed by the next datagram by default. */
+    h->read_one = 0;
+
+    /* Navigation samples are only stored if requested. */
+    h->nav = NULL;
+    h->body = NULL;
+    h->body_size = 0;
+    h->retained = NULL;
+    h->released = NULL;
+    h->nav_date = 0;
+    h->nav_day = 0;
+
+    /* Datagrams are read by the calling thread unless read-ahead is requested. */
+    h->prefetch = NULL;
+
+    /* The datagrams are counted, but not timed or traced unless requested. */
+    memset (&(h->stats), 0, sizeof (emx_stats));
+    h->timing = 0;
+    h->trace = NULL;
+    h->trace_data = NULL;
+
+    /* Set boolean to byte swap to be undefined. */
+    h->swap = -1;
+
+    /* The arrays of byte-swapped datagrams are swapped when read by default. */
+    h->lazy_swap = 0;
+    h->swap_pending = 0;
+
+    h->hisas_bytes_per_sample[0] = 0;
+    h->hisas_bytes_per_sample[1] = 0;
+    h->hisas_bytes_per_sample[2] = 0;
+    h->hisas_bytes_per_sample[3] = 0;
+    h->hisas_bytes_per_sample[4] = 0;
+    h->hisas_bytes_per_sample[5] = 0;
+
+    /* The datagram index is only created if requested. */
+    h->index = NULL;
+    h->index_size = 0;
+    h->index_alloc = 0;
+    h->index_by_type = NULL;
+    h->index_by_time = NULL;
+
+    return h;
+}
+
+
+/******************************************************************************
+*
+* emx_read_header - Read the datagram header at the current position of the file
+*   handle H into the header object of H, either from the memory-mapped file or
+*   from the buffered file.  The header is byte swapped and validated in the
+*   same way as emx_check_header().
+*
+* Return: 0 if the file is at EOF,
+*        >0 if the datagram header is read and is valid, or
+*        <0 if an error occurred reading the header or the header is invalid.
+*
+* Errors: CS_EREAD
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+static int emx_read_header (
+    emx_handle *h) {
+
+    size_t actual_read_size;
+    size_t read_size;
+    ssize_t result;
+    int swap;
+
+
+    assert (h);
+
+    /* The buffer of the previous datagram is reused, so its checksum must be verified first. */
+    emx_wait_checksum (h);
+    h->swap_pending = 0;
+
+    read_size = sizeof (emx_datagram_header);
+
+    if (h->map) {
+        /* Copy the datagram header from the memory-mapped file. */
+        actual_read_size = h->map_size - h->map_offset;
+        if (actual_read_size > read_size) actual_read_size = read_size;
+        memcpy (&(h->d.header), h->map + h->map_offset, actual_read_size);
+        h->map_offset += actual_read_size;
+        h->io.bytes_read += actual_read_size;
+    } else {
+        /* Read the datagram header from the buffered file. */
+        result = cpl_bfile_read (&(h->io), &(h->d.header), read_size);
+        if (result < 0) {
+            cpl_debug (emx_debug, "Read error occurred\n");
+            return CS_EREAD;
+        }
+
+        actual_read_size = (size_t) result;
+    }
+
+    /* If the read amount is zero, then it is EOF, otherwise if the read
+       amount is less than the datagram header size, then the file is corrupt. */
+    if (actual_read_size != read_size) {
+        if (actual_read_size != 0) {
+            cpl_debug (emx_debug, "Unexpected end of file\n");
+            return CS_EBADDATA;
+        }
+        return 0;
+    }
+
+    swap = h->swap;
+
+    if (emx_check_header (&(h->d.header), &(h->swap)) < 0) {
+        cpl_debug (emx_debug, "Invalid header (size=%u, type=%u, model=%u, date=%u, time=%u)\n", h->d.header.bytes_in_datagram,
+            h->d.header.datagram_type, h->d.header.em_model_number, h->d.header.date, h->d.header.time_ms);
+        return CS_EBADDATA;
+    }
+
+    if (swap < 0) cpl_debug (emx_debug, "Byte swap set to %s\n", h->swap == 0 ? "FALSE" : "TRUE");
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* emx_check_header - Determine the byte order of the datagram HEADER if SWAP is
+*   negative, byte swap the header if needed, and validate it.  Like
+*   emx_valid_header(), nothing is logged.
+*
+* Return: 1 if the datagram header is valid, or
+*         CS_EBADDATA if the header is invalid.
+*
+******************************************************************************/
+
+static int emx_check_header (
+    emx_datagram_header *header,
+    int *swap) {
+
+    assert (swap);
+    assert (header);
+
+    /* Check the date and model number fields to determine if the data is stored as big or little-endian.
+       Set the swap value to 1 if byte swapping is needed.  This test is only done if the swap value is negative. */
+    if (*swap < 0) {
+        *swap = emx_byte_order (header->date, header->em_model_number);
+        if (*swap < 0) return CS_EBADDATA;
+    }
+
+    /* Byte swap the header if necessary. */
+    if (*swap) emx_swap_header (header);
+
+    /* Validate the header and return the result. */
+    if (emx_valid_header (header)) return 1;
+
+    return CS_EBADDATA;
+}
+
+
+/******************************************************************************
+*
+* emx_byte_order - Determine the byte order given the date value in DATE and the
+*   system model number MODEL from the datagram header.
+*
+* Return: 0 if the date value is valid and requires no byte swapping,
+*         1 if the date value is valid and does require byte swapping, or
+*        -1 if the date value is invalid.
+*
+******************************************************************************/
+
+static int emx_byte_order (
+    const uint32_t date,
+    const uint16_t model) {
+
+    /* We determine byte order by byte swapping the date field and testing if the
+       result is a valid date.  Some data has been found with the date in the first
+       datagram set to zero, so for this case we test the model number field instead. */
+
+    if ((date != 0) && (date != 20001025) && (date != 20790529)) {
+
+        /* This test should be sufficient for all dates between the years 1970 to 2100
+           with the exception of 20001025 and 20790529.  When these dates are byte swapped
+           they equal themselves.  For these cases, we test the model number instead. */
+
+        if (emx_valid_date (date)) {
+            return 0;
+        }
+
+        if (emx_valid_date (CPL_BSWAP (date))) {
+            return 1;
+        }
+
+    } else {
+
+        if (emx_get_model (model)) {
+            return 0;
+        }
+
+        if (emx_get_model (CPL_BSWAP (model))) {
+            return 1;
+        }
+    }
+
+    return -1;
+}
+
+
+/******************************************************************************
+*
+* emx_valid_date - Return non-zero if the date is in the valid range.
+*
+******************************************************************************/
+
+static int emx_valid_date (
+    const uint32_t date) {
+
+    uint32_t year, month, day;
+
+
+    /* Make sure the date is within a reasonable time period, but be generous. */
+    if (date < 19700000 || date > 21000000) return 0;
+
+    /* Parse year, month, and day from date field. */
+    year = date / 10000;
+    month = (date / 100) % 100;
+    day = date % 100;
+
+    return cpl_valid_date (year, month, day, 0, 0, 0.0);
+}
+
+
+/******************************************************************************
+*
+* emx_valid_header - Return non-zero if the datagram header HEADER is valid.
+*   Nothing is logged, since the resync search tests a header at every STX
+*   byte, so the callers log the invalid headers they do not skip.
+*
+* Return: 1 if the header is valid,
+*         0 otherwise.
+*
+******************************************************************************/
+
+static int emx_valid_header (
+    const emx_datagram_header *header) {
+
+    assert (header);
+
+    /* Verify start byte of datagram. */
+    if (header->start_identifier != EMX_START_BYTE) return 0;
+
+    /* Verify datagram size is not too small. */
+    if (header->bytes_in_datagram < 16) return 0;
+
+    /* Verify the datagram size is not unreasonably large, but be generous. */
+    if (header->bytes_in_datagram > 1<<27) return 0;
+
+    /* Have found an unknown datagram with invalid millisecond field. */
+    if (header->datagram_type != EMX_DATAGRAM_UNKNOWN2) {
+
+        /* Verify milliseconds field. */
+        if (header->time_ms > 86399999) return 0;
+
+        /* Verify data field, but only if non-zero. */
+        if (header->date != 0) {
+            if (emx_valid_date (header->date) == 0) return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* emx_swap_header - Byte swap the datagram header.
+*
+******************************************************************************/
+
+static void emx_swap_header (
+    emx_datagram_header *header) {
+
+    assert (header);
+
+    header->bytes_in_datagram = CPL_BSWAP (header->bytes_in_datagram);
+    header->em_model_number = CPL_BSWAP (header->em_model_number);
+    header->date = CPL_BSWAP (header->date);
+    header->time_ms = CPL_BSWAP (header->time_ms);
+    header->counter = CPL_BSWAP (header->counter);
+    header->serial_number = CPL_BSWAP (header->serial_number);
+}
+
+
+/******************************************************************************
+*
+* emx_swap_datagram - Byte swap the datagram D.
+*
+******************************************************************************/
+
+static void emx_swap_datagram (
+    emx_datagram *d,
+    const int datagram_type) {
+
+    size_t i;
+
+
+    assert (d);
+
+    switch (datagram_type) {
+
+        case EMX_DATAGRAM_DEPTH :
+
+            d->depth.info->vessel_heading = CPL_BSWAP (d->depth.info->vessel_heading);
+            d->depth.info->sound_speed = CPL_BSWAP (d->depth.info->sound_speed);
+            d->depth.info->transducer_depth = CPL_BSWAP (d->depth.info->transducer_depth);
+            d->depth.info->sample_rate = CPL_BSWAP (d->depth.info->sample_rate);
+
+            for (i=0; i<d->depth.info->num_beams; i++) {
+                d->depth.beam[i].depth = CPL_BSWAP (d->depth.beam[i].depth);
+                d->depth.beam[i].across_track = CPL_BSWAP (d->depth.beam[i].across_track);
+                d->depth.beam[i].along_track = CPL_BSWAP (d->depth.beam[i].along_track);
+                d->depth.beam[i].beam_depression_angle = CPL_BSWAP (d->depth.beam[i].beam_depression_angle);
+                d->depth.beam[i].beam_azimuth_angle = CPL_BSWAP (d->depth.beam[i].beam_azimuth_angle);
+                d->depth.beam[i].range = CPL_BSWAP (d->depth.beam[i].range);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_DEPTH_NOMINAL :
+
+            d->depth_nominal.info->transducer_depth = CPL_BSWAPF (d->depth_nominal.info->transducer_depth);
+            d->depth_nominal.info->max_beams = CPL_BSWAP (d->depth_nominal.info->max_beams);
+            d->depth_nominal.info->num_beams = CPL_BSWAP (d->depth_nominal.info->num_beams);
+
+            for (i=0; i<d->depth_nominal.info->num_beams; i++) {
+                d->depth_nominal.beam[i].depth = CPL_BSWAPF (d->depth_nominal.beam[i].depth);
+                d->depth_nominal.beam[i].across_track = CPL_BSWAPF (d->depth_nominal.beam[i].across_track);
+                d->depth_nominal.beam[i].along_track = CPL_BSWAPF (d->depth_nominal.beam[i].along_track);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_XYZ :
+
+            d->xyz.info->vessel_heading = CPL_BSWAP (d->xyz.info->vessel_heading);
+            d->xyz.info->sound_speed = CPL_BSWAP (d->xyz.info->sound_speed);
+            d->xyz.info->transducer_depth = CPL_BSWAPF (d->xyz.info->transducer_depth);
+            d->xyz.info->num_beams = CPL_BSWAP (d->xyz.info->num_beams);
+            d->xyz.info->valid_beams = CPL_BSWAP (d->xyz.info->valid_beams);
+            d->xyz.info->sample_rate = CPL_BSWAPF (d->xyz.info->sample_rate);
+
+            break;
+
+        case EMX_DATAGRAM_EXTRA_DETECTIONS :
+
+            d->extra_detect.info->datagram_counter = CPL_BSWAP (d->extra_detect.info->datagram_counter);
+            d->extra_detect.info->datagram_version = CPL_BSWAP (d->extra_detect.info->datagram_version);
+            d->extra_detect.info->swath_counter = CPL_BSWAP (d->extra_detect.info->swath_counter);
+            d->extra_detect.info->swath_index = CPL_BSWAP (d->extra_detect.info->swath_index);
+            d->extra_detect.info->vessel_heading = CPL_BSWAP (d->extra_detect.info->vessel_heading);
+            d->extra_detect.info->sound_speed = CPL_BSWAP (d->extra_detect.info->sound_speed);
+            d->extra_detect.info->reference_depth = CPL_BSWAPF (d->extra_detect.info->reference_depth);
+            d->extra_detect.info->wc_sample_rate = CPL_BSWAPF (d->extra_detect.info->wc_sample_rate);
+            d->extra_detect.info->raw_amplitude_sample_rate = CPL_BSWAPF (d->extra_detect.info->raw_amplitude_sample_rate);
+            d->extra_detect.info->num_detects = CPL_BSWAP (d->extra_detect.info->num_detects);
+            d->extra_detect.info->num_classes = CPL_BSWAP (d->extra_detect.info->num_classes);
+            d->extra_detect.info->nbytes_class = CPL_BSWAP (d->extra_detect.info->nbytes_class);
+            d->extra_detect.info->nalarm_flags = CPL_BSWAP (d->extra_detect.info->nalarm_flags);
+            d->extra_detect.info->nbytes_detect = CPL_BSWAP (d->extra_detect.info->nbytes_detect);
+
+            for (i=0; i<d->extra_detect.info->num_classes; i++) {
+                d->extra_detect.classes[i].start_depth = CPL_BSWAP (d->extra_detect.classes[i].start_depth);
+                d->extra_detect.classes[i].stop_depth = CPL_BSWAP (d->extra_detect.classes[i].stop_depth);
+                d->extra_detect.classes[i].qf_threshold = CPL_BSWAP (d->extra_detect.classes[i].qf_threshold);
+                d->extra_detect.classes[i].bs_threshold = CPL_BSWAP (d->extra_detect.classes[i].bs_threshold);
+                d->extra_detect.classes[i].snr_threshold = CPL_BSWAP (d->extra_detect.classes[i].snr_threshold);
+                d->extra_detect.classes[i].alarm_threshold = CPL_BSWAP (d->extra_detect.classes[i].alarm_threshold);
+                d->extra_detect.classes[i].num_detects = CPL_BSWAP (d->extra_detect.classes[i].num_detects);
+            }
+
+            for (i=0; i<d->extra_detect.info->num_detects; i++) {
+                d->extra_detect.data[i].depth = CPL_BSWAPF (d->extra_detect.data[i].depth);
+                d->extra_detect.data[i].across_track = CPL_BSWAPF (d->extra_detect.data[i].across_track);
+                d->extra_detect.data[i].along_track = CPL_BSWAPF (d->extra_detect.data[i].along_track);
+                d->extra_detect.data[i].latitude_delta = CPL_BSWAPF (d->extra_detect.data[i].latitude_delta);
+                d->extra_detect.data[i].longitud_delta = CPL_BSWAPF (d->extra_detect.data[i].longitud_delta);
+                d->extra_detect.data[i].beam_angle = CPL_BSWAPF (d->extra_detect.data[i].beam_angle);
+                d->extra_detect.data[i].angle_correction = CPL_BSWAPF (d->extra_detect.data[i].angle_correction);
+                d->extra_detect.data[i].travel_time = CPL_BSWAPF (d->extra_detect.data[i].travel_time);
+                d->extra_detect.data[i].travel_time_correction = CPL_BSWAPF (d->extra_detect.data[i].travel_time_correction);
+                d->extra_detect.data[i].backscatter = CPL_BSWAP (d->extra_detect.data[i].backscatter);
+                d->extra_detect.data[i].tx_sector = CPL_BSWAP (d->extra_detect.data[i].tx_sector);
+                d->extra_detect.data[i].detection_window_length = CPL_BSWAP (d->extra_detect.data[i].detection_window_length);
+                d->extra_detect.data[i].quality_factor = CPL_BSWAP (d->extra_detect.data[i].quality_factor);
+                d->extra_detect.data[i].system_cleaning = CPL_BSWAP (d->extra_detect.data[i].system_cleaning);
+                d->extra_detect.data[i].range_factor = CPL_BSWAP (d->extra_detect.data[i].range_factor);
+                d->extra_detect.data[i].class_number = CPL_BSWAP (d->extra_detect.data[i].class_number);
+                d->extra_detect.data[i].confidence = CPL_BSWAP (d->extra_detect.data[i].confidence);
+                d->extra_detect.data[i].qf_ifremer = CPL_BSWAP (d->extra_detect.data[i].qf_ifremer);
+                d->extra_detect.data[i].wc_beam_number = CPL_BSWAP (d->extra_detect.data[i].wc_beam_number);
+                d->extra_detect.data[i].beam_angle_across = CPL_BSWAPF (d->extra_detect.data[i].beam_angle_across);
+                d->extra_detect.data[i].detected_range = CPL_BSWAP (d->extra_detect.data[i].detected_range);
+                d->extra_detect.data[i].raw_amplitude = CPL_BSWAP (d->extra_detect.data[i].raw_amplitude);
+            }
+
+            /* TODO: raw_amplitudes */
+
+            break;
+
+        case EMX_DATAGRAM_CENTRAL_BEAMS :
+
+            d->central_beams.info->mean_abs_coef = CPL_BSWAP (d->central_beams.info->mean_abs_coef);
+            d->central_beams.info->pulse_length = CPL_BSWAP (d->central_beams.info->pulse_length);
+            d->central_beams.info->range_norm = CPL_BSWAP (d->central_beams.info->range_norm);
+            d->central_beams.info->start_range = CPL_BSWAP (d->central_beams.info->start_range);
+            d->central_beams.info->stop_range = CPL_BSWAP (d->central_beams.info->stop_range);
+            d->central_beams.info->tx_beamwidth = CPL_BSWAP (d->central_beams.info->tx_beamwidth);
+
+            for (i=0; i<d->central_beams.info->num_beams; i++) {
+                d->central_beams.beam[i].num_samples = CPL_BSWAP (d->central_beams.beam[i].num_samples);
+                d->central_beams.beam[i].start_range = CPL_BSWAP (d->central_beams.beam[i].start_range);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_RRA_101 :
+
+            d->rra_101.info->vessel_heading = CPL_BSWAP (d->rra_101.info->vessel_heading);
+            d->rra_101.info->sound_speed = CPL_BSWAP (d->rra_101.info->sound_speed);
+            d->rra_101.info->transducer_depth = CPL_BSWAP (d->rra_101.info->transducer_depth);
+            d->rra_101.info->sample_rate = CPL_BSWAP (d->rra_101.info->sample_rate);
+            d->rra_101.info->status = CPL_BSWAP (d->rra_101.info->status);
+            d->rra_101.info->range_norm = CPL_BSWAP (d->rra_101.info->range_norm);
+            d->rra_101.info->yawstab_heading = CPL_BSWAP (d->rra_101.info->yawstab_heading);
+            d->rra_101.info->tx_sectors = CPL_BSWAP (d->rra_101.info->tx_sectors);
+
+
+            for (i=0; i<d->rra_101.info->tx_sectors; i++) {
+                d->rra_101.tx_beam[i].last_beam = CPL_BSWAP (d->rra_101.tx_beam[i].last_beam);
+                d->rra_101.tx_beam[i].tx_tilt_angle = CPL_BSWAP (d->rra_101.tx_beam[i].tx_tilt_angle);
+                d->rra_101.tx_beam[i].heading = CPL_BSWAP (d->rra_101.tx_beam[i].heading);
+                d->rra_101.tx_beam[i].roll = CPL_BSWAP (d->rra_101.tx_beam[i].roll);
+                d->rra_101.tx_beam[i].pitch = CPL_BSWAP (d->rra_101.tx_beam[i].pitch);
+                d->rra_101.tx_beam[i].heave = CPL_BSWAP (d->rra_101.tx_beam[i].heave);
+            }
+
+            for (i=0; i<d->rra_101.info->num_beams; i++) {
+                d->rra_101.rx_beam[i].range = CPL_BSWAP (d->rra_101.rx_beam[i].range);
+                d->rra_101.rx_beam[i].rx_beam_angle = CPL_BSWAP (d->rra_101.rx_beam[i].rx_beam_angle);
+                d->rra_101.rx_beam[i].rx_heading = CPL_BSWAP (d->rra_101.rx_beam[i].rx_heading);
+                d->rra_101.rx_beam[i].roll = CPL_BSWAP (d->rra_101.rx_beam[i].roll);
+                d->rra_101.rx_beam[i].pitch = CPL_BSWAP (d->rra_101.rx_beam[i].pitch);
+                d->rra_101.rx_beam[i].heave = CPL_BSWAP (d->rra_101.rx_beam[i].heave);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_RRA_70 :
+
+            d->rra_70.info->sound_speed = CPL_BSWAP (d->rra_70.info->sound_speed);
+
+            for (i=0; i<d->rra_70.info->num_beams; i++) {
+                d->rra_70.beam[i].beam_angle = CPL_BSWAP (d->rra_70.beam[i].beam_angle);
+                d->rra_70.beam[i].tx_tilt_angle = CPL_BSWAP (d->rra_70.beam[i].tx_tilt_angle);
+                d->rra_70.beam[i].range = CPL_BSWAP (d->rra_70.beam[i].range);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_RRA_102 :
+
+            d->rra_102.info->tx_sectors = CPL_BSWAP (d->rra_102.info->tx_sectors);
+            d->rra_102.info->num_beams = CPL_BSWAP (d->rra_102.info->num_beams);
+            d->rra_102.info->sample_rate = CPL_BSWAP (d->rra_102.info->sample_rate);
+            d->rra_102.info->rov_depth = CPL_BSWAP (d->rra_102.info->rov_depth);
+            d->rra_102.info->sound_speed = CPL_BSWAP (d->rra_102.info->sound_speed);
+            d->rra_102.info->max_beams = CPL_BSWAP (d->rra_102.info->max_beams);
+
+            for (i=0; i<d->rra_102.info->tx_sectors; i++) {
+                d->rra_102.tx_beam[i].tx_tilt_angle = CPL_BSWAP (d->rra_102.tx_beam[i].tx_tilt_angle);
+                d->rra_102.tx_beam[i].focus_range = CPL_BSWAP (d->rra_102.tx_beam[i].focus_range);
+                d->rra_102.tx_beam[i].signal_length = CPL_BSWAP (d->rra_102.tx_beam[i].signal_length);
+                d->rra_102.tx_beam[i].tx_offset = CPL_BSWAP (d->rra_102.tx_beam[i].tx_offset);
+                d->rra_102.tx_beam[i].center_freq = CPL_BSWAP (d->rra_102.tx_beam[i].center_freq);
+                d->rra_102.tx_beam[i].signal_bandwidth = CPL_BSWAP (d->rra_102.tx_beam[i].signal_bandwidth);
+            }
+
+            for (i=0; i<d->rra_102.info->num_beams; i++) {
+                d->rra_102.rx_beam[i].rx_beam_angle = CPL_BSWAP (d->rra_102.rx_beam[i].rx_beam_angle);
+                d->rra_102.rx_beam[i].range = CPL_BSWAP (d->rra_102.rx_beam[i].range);
+                d->rra_102.rx_beam[i].beam_number = CPL_BSWAP (d->rra_102.rx_beam[i].beam_number);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_RRA_78 :
+
+            d->rra_78.info->sound_speed = CPL_BSWAP (d->rra_78.info->sound_speed);
+            d->rra_78.info->tx_sectors = CPL_BSWAP (d->rra_78.info->tx_sectors);
+            d->rra_78.info->num_beams = CPL_BSWAP (d->rra_78.info->num_beams);
+            d->rra_78.info->valid_beams = CPL_BSWAP (d->rra_78.info->valid_beams);
+            d->rra_78.info->sample_rate = CPL_BSWAPF (d->rra_78.info->sample_rate);
+            d->rra_78.info->dscale = CPL_BSWAP (d->rra_78.info->dscale);
+
+            for (i=0; i<d->rra_78.info->tx_sectors; i++) {
+                d->rra_78.tx_beam[i].tx_tilt_angle = CPL_BSWAP (d->rra_78.tx_beam[i].tx_tilt_angle);
+                d->rra_78.tx_beam[i].focus_range = CPL_BSWAP (d->rra_78.tx_beam[i].focus_range);
+                d->rra_78.tx_beam[i].signal_length = CPL_BSWAPF (d->rra_78.tx_beam[i].signal_length);
+                d->rra_78.tx_beam[i].sector_tx_delay = CPL_BSWAPF (d->rra_78.tx_beam[i].sector_tx_delay);
+                d->rra_78.tx_beam[i].center_freq = CPL_BSWAPF (d->rra_78.tx_beam[i].center_freq);
+                d->rra_78.tx_beam[i].mean_absorption = CPL_BSWAP (d->rra_78.tx_beam[i].mean_absorption);
+                d->rra_78.tx_beam[i].signal_bandwidth = CPL_BSWAPF (d->rra_78.tx_beam[i].signal_bandwidth);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_SEABED_IMAGE_83 :
+
+            d->seabed_83.info->mean_abs_coef = CPL_BSWAP (d->seabed_83.info->mean_abs_coef);
+            d->seabed_83.info->pulse_length = CPL_BSWAP (d->seabed_83.info->pulse_length);
+            d->seabed_83.info->range_norm = CPL_BSWAP (d->seabed_83.info->range_norm);
+            d->seabed_83.info->start_range = CPL_BSWAP (d->seabed_83.info->start_range);
+            d->seabed_83.info->stop_range = CPL_BSWAP (d->seabed_83.info->stop_range);
+            d->seabed_83.info->tx_beamwidth = CPL_BSWAP (d->seabed_83.info->tx_beamwidth);
+
+            for (i=0; i<d->seabed_83.info->num_beams; i++) {
+                d->seabed_83.beam[i].num_samples = CPL_BSWAP (d->seabed_83.beam[i].num_samples);
+                d->seabed_83.beam[i].detect_sample = CPL_BSWAP (d->seabed_83.beam[i].detect_sample);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_SEABED_IMAGE_89 :
+
+            d->seabed_89.info->sample_rate = CPL_BSWAPF (d->seabed_89.info->sample_rate);
+            d->seabed_89.info->range_norm = CPL_BSWAP (d->seabed_89.info->range_norm);
+            d->seabed_89.info->normal_incidence_bs = CPL_BSWAP (d->seabed_89.info->normal_incidence_bs);
+            d->seabed_89.info->oblique_bs = CPL_BSWAP (d->seabed_89.info->oblique_bs);
+            d->seabed_89.info->tx_beamwidth = CPL_BSWAP (d->seabed_89.info->tx_beamwidth);
+            d->seabed_89.info->tvg_cross_over = CPL_BSWAP (d->seabed_89.info->tvg_cross_over);
+            d->seabed_89.info->num_beams = CPL_BSWAP (d->seabed_89.info->num_beams);
+
+            break;
+
+        case EMX_DATAGRAM_WATER_COLUMN :
+
+            d->wc.info->num_datagrams = CPL_BSWAP (d->wc.info->num_datagrams);
+            d->wc.info->datagram_number = CPL_BSWAP (d->wc.info->datagram_number);
+            d->wc.info->tx_sectors = CPL_BSWAP (d->wc.info->tx_sectors);
+            d->wc.info->num_beams = CPL_BSWAP (d->wc.info->num_beams);
+            d->wc.info->datagram_beams = CPL_BSWAP (d->wc.info->datagram_beams);
+            d->wc.info->sound_speed = CPL_BSWAP (d->wc.info->sound_speed);
+            d->wc.info->sample_rate = CPL_BSWAP (d->wc.info->sample_rate);
+            d->wc.info->tx_heave = CPL_BSWAP (d->wc.info->tx_heave);
+
+            for (i=0; i<d->wc.info->tx_sectors; i++) {
+                d->wc.txbeam[i].tx_tilt_angle = CPL_BSWAP (d->wc.txbeam[i].tx_tilt_angle);
+                d->wc.txbeam[i].center_freq = CPL_BSWAP (d->wc.txbeam[i].center_freq);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_QUALITY_FACTOR :
+
+            d->qf.info->num_beams = CPL_BSWAP (d->qf.info->num_beams);
+
+            cpl_bswap_array32 (d->qf.data, d->qf.info->num_beams);
+
+            break;
+
+        case EMX_DATAGRAM_ATTITUDE :
+
+            d->attitude.info->num_entries = CPL_BSWAP (d->attitude.info->num_entries);
+
+            for (i=0; i<d->attitude.info->num_entries; i++) {
+                d->attitude.data[i].record_time = CPL_BSWAP (d->attitude.data[i].record_time);
+                d->attitude.data[i].status = CPL_BSWAP (d->attitude.data[i].status);
+                d->attitude.data[i].roll = CPL_BSWAP (d->attitude.data[i].roll);
+                d->attitude.data[i].pitch = CPL_BSWAP (d->attitude.data[i].pitch);
+                d->attitude.data[i].heave = CPL_BSWAP (d->attitude.data[i].heave);
+                d->attitude.data[i].heading = CPL_BSWAP (d->attitude.data[i].heading);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_ATTITUDE_NETWORK :
+
+            d->attitude_network.info->num_entries = CPL_BSWAP (d->attitude_network.info->num_entries);
+
+            {
+                emx_datagram_attitude_network_data attitude_data;
+                const uint8_t *p = d->attitude_network.data;
+
+                for (i=0; i<d->attitude_network.info->num_entries; i++) {
+
+                    p = emx_get_attitude_network_data (&attitude_data, p);
+
+                    attitude_data.info->record_time = CPL_BSWAP (attitude_data.info->record_time);
+                    attitude_data.info->roll = CPL_BSWAP (attitude_data.info->roll);
+                    attitude_data.info->pitch = CPL_BSWAP (attitude_data.info->pitch);
+                    attitude_data.info->heave = CPL_BSWAP (attitude_data.info->heave);
+                    attitude_data.info->heading = CPL_BSWAP (attitude_data.info->heading);
+                }
+            }
+
+            break;
+
+        case EMX_DATAGRAM_CLOCK :
+
+            d->clock.info->date = CPL_BSWAP (d->clock.info->date);
+            d->clock.info->time_ms = CPL_BSWAP (d->clock.info->time_ms);
+
+            break;
+
+        case EMX_DATAGRAM_HEIGHT :
+
+            d->height.info->height = CPL_BSWAP (d->height.info->height);
+
+            break;
+
+        case EMX_DATAGRAM_HEADING :
+
+            d->heading.info->num_entries = CPL_BSWAP (d->heading.info->num_entries);
+
+            for (i=0; i<d->heading.info->num_entries; i++) {
+                d->heading.data[i].record_time = CPL_BSWAP (d->heading.data[i].record_time);
+                d->heading.data[i].heading = CPL_BSWAP (d->heading.data[i].heading);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_POSITION :
+
+            d->position.info->latitude = CPL_BSWAP (d->position.info->latitude);
+            d->position.info->longitude = CPL_BSWAP (d->position.info->longitude);
+            d->position.info->position_fix_quality = CPL_BSWAP (d->position.info->position_fix_quality);
+            d->position.info->vessel_speed = CPL_BSWAP (d->position.info->vessel_speed);
+            d->position.info->vessel_course = CPL_BSWAP (d->position.info->vessel_course);
+            d->position.info->vessel_heading = CPL_BSWAP (d->position.info->vessel_heading);
+
+            break;
+
+        case EMX_DATAGRAM_SINGLE_BEAM_DEPTH :
+
+            d->sb_depth.info->date = CPL_BSWAP (d->sb_depth.info->date);
+            d->sb_depth.info->time_ms = CPL_BSWAP (d->sb_depth.info->time_ms);
+            d->sb_depth.info->depth = CPL_BSWAP (d->sb_depth.info->depth);
+
+            break;
+
+        case EMX_DATAGRAM_TIDE :
+
+            d->tide.info->date = CPL_BSWAP (d->tide.info->date);
+            d->tide.info->time_ms = CPL_BSWAP (d->tide.info->time_ms);
+            d->tide.info->tide_offset = CPL_BSWAP (d->tide.info->tide_offset);
+
+            break;
+
+        case EMX_DATAGRAM_SSSV :
+
+            d->sssv.info->num_samples = CPL_BSWAP (d->sssv.info->num_samples);
+
+            for (i=0; i<d->sssv.info->num_samples; i++) {
+                d->sssv.data[i].record_time = CPL_BSWAP (d->sssv.data[i].record_time);
+                d->sssv.data[i].sound_speed = CPL_BSWAP (d->sssv.data[i].sound_speed);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_SVP :
+
+            d->svp.info->date = CPL_BSWAP (d->svp.info->date);
+            d->svp.info->time_ms = CPL_BSWAP (d->svp.info->time_ms);
+            d->svp.info->num_samples = CPL_BSWAP (d->svp.info->num_samples);
+            d->svp.info->depth_resolution = CPL_BSWAP (d->svp.info->depth_resolution);
+
+            for (i=0; i<d->svp.info->num_samples; i++) {
+                d->svp.data[i].depth = CPL_BSWAP (d->svp.data[i].depth);
+                d->svp.data[i].sound_speed = CPL_BSWAP (d->svp.data[i].sound_speed);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_SVP_EM3000 :
+
+            d->svp_em3000.info->date = CPL_BSWAP (d->svp_em3000.info->date);
+            d->svp_em3000.info->time_ms = CPL_BSWAP (d->svp_em3000.info->time_ms);
+            d->svp_em3000.info->num_samples = CPL_BSWAP (d->svp_em3000.info->num_samples);
+            d->svp_em3000.info->depth_resolution = CPL_BSWAP (d->svp_em3000.info->depth_resolution);
+
+            for (i=0; i<d->svp_em3000.info->num_samples; i++) {
+                d->svp_em3000.data[i].depth = CPL_BSWAP (d->svp_em3000.data[i].depth);
+                d->svp_em3000.data[i].sound_speed = CPL_BSWAP (d->svp_em3000.data[i].sound_speed);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_KM_SSP_OUTPUT :
+
+            break;
+
+        case EMX_DATAGRAM_INSTALL_PARAMS :
+
+            d->install_params.info->serial_number2 = CPL_BSWAP (d->install_params.info->serial_number2);
+
+            break;
+
+        case EMX_DATAGRAM_INSTALL_PARAMS_STOP :
+
+            d->install_params_stop.info->serial_number2 = CPL_BSWAP (d->install_params_stop.info->serial_number2);
+
+            break;
+
+        case EMX_DATAGRAM_INSTALL_PARAMS_REMOTE :
+
+            d->install_params_remote.info->serial_number2 = CPL_BSWAP (d->install_params_remote.info->serial_number2);
+
+            break;
+
+        case EMX_DATAGRAM_REMOTE_PARAMS_INFO :
+
+            break;
+
+        case EMX_DATAGRAM_RUNTIME_PARAMS :
+
+            d->runtime_params.info->min_depth = CPL_BSWAP (d->runtime_params.info->min_depth);
+            d->runtime_params.info->max_depth = CPL_BSWAP (d->runtime_params.info->max_depth);
+            d->runtime_params.info->absorption = CPL_BSWAP (d->runtime_params.info->absorption);
+            d->runtime_params.info->tx_pulse_length = CPL_BSWAP (d->runtime_params.info->tx_pulse_length);
+            d->runtime_params.info->tx_beamwidth = CPL_BSWAP (d->runtime_params.info->tx_beamwidth);
+            d->runtime_params.info->max_port_swath = CPL_BSWAP (d->runtime_params.info->max_port_swath);
+            d->runtime_params.info->max_stbd_swath = CPL_BSWAP (d->runtime_params.info->max_stbd_swath);
+            d->runtime_params.info->tx_along_tilt = CPL_BSWAP (d->runtime_params.info->tx_along_tilt);
+
+            break;
+
+        case EMX_DATAGRAM_EXTRA_PARAMS :
+
+            d->extra_params.info->content = CPL_BSWAP (d->extra_params.info->content);
+
+            switch (d->extra_params.info->content) {
+
+                /* TODO: Add content 1-5 here. */
+
+                case 6 :
+                    d->extra_params.data.bs_corr.num_chars = CPL_BSWAP (d->extra_params.data.bs_corr.num_chars);
+                    break;
+
+                default : break;
+            }
+
+            break;
+
+        case EMX_DATAGRAM_PU_OUTPUT :
+
+            d->pu_output.info->udp_port1 = CPL_BSWAP (d->pu_output.info->udp_port1);
+            d->pu_output.info->udp_port2 = CPL_BSWAP (d->pu_output.info->udp_port2);
+            d->pu_output.info->udp_port3 = CPL_BSWAP (d->pu_output.info->udp_port3);
+            d->pu_output.info->udp_port4 = CPL_BSWAP (d->pu_output.info->udp_port4);
+            d->pu_output.info->system_descriptor = CPL_BSWAP (d->pu_output.info->system_descriptor);
+            d->pu_output.info->host_ip_address = CPL_BSWAP (d->pu_output.info->host_ip_address);
+
+            break;
+
+        case EMX_DATAGRAM_PU_STATUS :
+
+            d->pu_status.info->ping_rate = CPL_BSWAP (d->pu_status.info->ping_rate);
+            d->pu_status.info->ping_counter = CPL_BSWAP (d->pu_status.info->ping_counter);
+            d->pu_status.info->swath_distance = CPL_BSWAP (d->pu_status.info->swath_distance);
+            d->pu_status.info->status_udp_port_2 = CPL_BSWAP (d->pu_status.info->status_udp_port_2);
+            d->pu_status.info->status_serial_port_1 = CPL_BSWAP (d->pu_status.info->status_serial_port_1);
+            d->pu_status.info->status_serial_port_2 = CPL_BSWAP (d->pu_status.info->status_serial_port_2);
+            d->pu_status.info->status_serial_port_3 = CPL_BSWAP (d->pu_status.info->status_serial_port_3);
+            d->pu_status.info->status_serial_port_4 = CPL_BSWAP (d->pu_status.info->status_serial_port_4);
+            d->pu_status.info->heading = CPL_BSWAP (d->pu_status.info->heading);
+            d->pu_status.info->roll = CPL_BSWAP (d->pu_status.info->roll);
+            d->pu_status.info->pitch = CPL_BSWAP (d->pu_status.info->pitch);
+            d->pu_status.info->heave = CPL_BSWAP (d->pu_status.info->heave);
+            d->pu_status.info->sound_speed = CPL_BSWAP (d->pu_status.info->sound_speed);
+            d->pu_status.info->depth = CPL_BSWAP (d->pu_status.info->depth);
+            d->pu_status.info->velocity = CPL_BSWAP (d->pu_status.info->velocity);
+            d->pu_status.info->range_normal = CPL_BSWAP (d->pu_status.info->range_normal);
+            d->pu_status.info->sound_speed_svp = CPL_BSWAP (d->pu_status.info->sound_speed_svp);
+            d->pu_status.info->yaw_stabilization = CPL_BSWAP (d->pu_status.info->yaw_stabilization);
+            d->pu_status.info->port_coverage2 = CPL_BSWAP (d->pu_status.info->port_coverage2);
+            d->pu_status.info->stbd_coverage2 = CPL_BSWAP (d->pu_status.info->stbd_coverage2);
+
+            break;
+
+        case EMX_DATAGRAM_PU_BIST_RESULT :
+
+            d->pu_bist_result.info->test_number = CPL_BSWAP (d->pu_bist_result.info->test_number);
+            d->pu_bist_result.info->test_result_status = CPL_BSWAP (d->pu_bist_result.info->test_result_status);
+
+            break;
+
+        case EMX_DATAGRAM_TRANSDUCER_TILT :
+
+            d->tilt.info->num_entries = CPL_BSWAP (d->tilt.info->num_entries);
+
+            for (i=0; i<d->tilt.info->num_entries; i++) {
+                d->tilt.data[i].record_time = CPL_BSWAP (d->tilt.data[i].record_time);
+                d->tilt.data[i].tilt = CPL_BSWAP (d->tilt.data[i].tilt);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_SYSTEM_STATUS :
+
+            /* TODO: */
+
+            break;
+
+        case EMX_DATAGRAM_HISAS_STATUS        : CPL_ATTRIBUTE_FALLTHROUGH;
+        case EMX_DATAGRAM_NAVIGATION_OUTPUT   : CPL_ATTRIBUTE_FALLTHROUGH;
+        case EMX_DATAGRAM_SIDESCAN_STATUS     : CPL_ATTRIBUTE_FALLTHROUGH;
+        case EMX_DATAGRAM_HISAS_1032_SIDESCAN : CPL_ATTRIBUTE_FALLTHROUGH;
+        case EMX_DATAGRAM_RRA_123             :  /* No byte swapping on HISAS datagrams. */
+            break;
+
+        default : break;
+    }
+}
+
+
+/******************************************************************************
+*
+* emx_swap_arrays - Byte swap the beam and sample arrays of the datagram D,
+*   which are not swapped by emx_swap_datagram(), so these can be swapped only
+*   if needed.  The info of the datagram must already be swapped.
+*
+******************************************************************************/
+
+static void emx_swap_arrays (
+    emx_datagram *d,
+    const int datagram_type) {
+
+    size_t num_samples;
+    size_t i;
+
+
+    assert (d);
+
+    switch (datagram_type) {
+
+        case EMX_DATAGRAM_XYZ :
+            for (i=0; i<d->xyz.info->num_beams; i++) {
+                d->xyz.beam[i].depth = CPL_BSWAPF (d->xyz.beam[i].depth);
+                d->xyz.beam[i].across_track = CPL_BSWAPF (d->xyz.beam[i].across_track);
+                d->xyz.beam[i].along_track = CPL_BSWAPF (d->xyz.beam[i].along_track);
+                d->xyz.beam[i].detect_window_length = CPL_BSWAP (d->xyz.beam[i].detect_window_length);
+                d->xyz.beam[i].backscatter = CPL_BSWAP (d->xyz.beam[i].backscatter);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_RRA_78 :
+            for (i=0; i<d->rra_78.info->num_beams; i++) {
+                d->rra_78.rx_beam[i].rx_beam_angle = CPL_BSWAP (d->rra_78.rx_beam[i].rx_beam_angle);
+                d->rra_78.rx_beam[i].detect_window_length = CPL_BSWAP (d->rra_78.rx_beam[i].detect_window_length);
+                d->rra_78.rx_beam[i].two_way_travel_time = CPL_BSWAPF (d->rra_78.rx_beam[i].two_way_travel_time);
+                d->rra_78.rx_beam[i].backscatter = CPL_BSWAP (d->rra_78.rx_beam[i].backscatter);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_SEABED_IMAGE_89 :
+            num_samples = 0;
+            for (i=0; i<d->seabed_89.info->num_beams; i++) {
+                d->seabed_89.beam[i].num_samples = CPL_BSWAP (d->seabed_89.beam[i].num_samples);
+                d->seabed_89.beam[i].detect_sample = CPL_BSWAP (d->seabed_89.beam[i].detect_sample);
+                num_samples += d->seabed_89.beam[i].num_samples;
+            }
+
+            cpl_bswap_array16 (d->seabed_89.amplitude, num_samples);
+
+            break;
+
+        case EMX_DATAGRAM_WATER_COLUMN :
+            {
+                emx_datagram_wc_rx_beam wc_rx_beam;
+                const uint8_t *p = d->wc.beamData;
+
+                for (i=0; i<d->wc.info->datagram_beams; i++) {
+
+                    emx_datagram_wc_rx_beam_info *wc_rx_info = (emx_datagram_wc_rx_beam_info *) p;
+
+                    /* We arrange the code this way to swap num_samples before calling emx_get_wc_rxbeam. */
+                    wc_rx_info->beam_angle = CPL_BSWAP (wc_rx_info->beam_angle);
+                    wc_rx_info->detected_range = CPL_BSWAP (wc_rx_info->detected_range);
+                    wc_rx_info->num_samples = CPL_BSWAP (wc_rx_info->num_samples);
+                    wc_rx_info->start_range = CPL_BSWAP (wc_rx_info->start_range);
+
+                    p = emx_get_wc_rxbeam (&wc_rx_beam, p);
+                }
+            }
+
+            break;
+
+        default : break;
+    }
+}
+
+
+/******************************************************************************
+*
+* emx_valid_checksum - Return non-zero if the datagram check sum is valid and
+*   the end byte (ETX) is valid.  The checksum is a simple sum of the bytes
+*   between the STX and ETX bytes.
+*
+******************************************************************************/
+
+static int emx_valid_checksum (
+    const emx_datagram_header *header,
+    const char *buffer,
+    const int swap) {
+
+    emx_checksum checksum;
+
+
+    assert (header);
+    assert (buffer);
+
+    if (emx_prepare_checksum (header, buffer, swap, &checksum) == 0) return 0;
+
+    return emx_finish_checksum (&checksum);
+}
+
+
+/******************************************************************************
+*
+* emx_prepare_checksum - Verify the end byte (ETX) of the datagram given by
+*   HEADER and BUFFER, and store the checksum stored in the datagram along with
+*   the sum of the header bytes and the location of the data to sum in C, so the
+*   checksum can be verified later by emx_finish_checksum().
+*
+* Return: 1 if the end byte is valid, or
+*         0 if the end byte is invalid.
+*
+******************************************************************************/
+
+static int emx_prepare_checksum (
+    const emx_datagram_header *header,
+    const char *buffer,
+    const int swap,
+    emx_checksum *c) {
+
+    const uint8_t *p;
+    uint16_t chksum_file;
+    size_t n;
+
+
+    assert (header);
+    assert (buffer);
+    assert (c);
+
+    /* Calculate the number of bytes between STX and the end of the datagram.
+       emx_valid_header has already verified that bytes_in_datagram is >= 16. */
+    n = header->bytes_in_datagram - 16;
+
+    /* Make sure we have an End-of-Text (ETX) character. */
+    if (n < 3) return 0;
+
+    p = (const uint8_t *) buffer;
+
+    /* Have found some data with end byte set to zero, so allow this also. */
+    if ((p[n-3] != EMX_END_BYTE) && (p[n-3] != 0)) {
+        cpl_debug (emx_debug, "Missing ETX end byte (%u, counter=%u, datagram_type=%u)\n", p[n-3], header->counter, header->datagram_type);
+        return 0;
+    }
+
+    /* Extract the checksum from the datagram. */
+    if (swap) {
+        chksum_file = p[n-2];
+        chksum_file = p[n-1] + 256 * chksum_file;
+    } else {
+        chksum_file = p[n-1];
+        chksum_file = p[n-2] + 256 * chksum_file;
+    }
+
+    /* Calculate the checksum of the header, which is byte-swapped in place, but the sum of
+       the bytes does not change.  The rest of the datagram is summed by emx_finish_checksum. */
+    c->header_sum = emx_sum_bytes (&(header->datagram_type), 15);
+    c->file_sum = chksum_file;
+    c->data = p;
+    c->size = n - 3;
+    c->counter = header->counter;
+    c->datagram_type = header->datagram_type;
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* emx_finish_checksum - Return non-zero if the checksum prepared in C by
+*   emx_prepare_checksum() is valid.
+*
+******************************************************************************/
+
+static int emx_finish_checksum (
+    const emx_checksum *c) {
+
+    uint16_t chksum;
+
+
+    assert (c);
+
+    chksum = c->header_sum + emx_sum_bytes (c->data, c->size);
+
+    /* If the checksum is zero, then skip the test. */
+    if ((c->file_sum == 0) && (chksum != 0)) {
+        cpl_debug (emx_debug, "Missing or zero checksum (counter=%u, datagram_type=%u)\n", c->counter, c->datagram_type);
+        return 1;
+    }
+
+    /* Compare the checksum values and return the result. */
+    if (chksum != c->file_sum) {
+        cpl_debug (emx_debug, "Checksum failure (chksum=%u, chksum_file=%u, counter=%u, datagram_type=%u)\n", chksum, c->file_sum, c->counter, c->datagram_type);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* emx_sum_bytes - Return the sum modulo 65536 of the N bytes given by P.  The
+*   bytes are summed 32 or 16 at a time using AVX2, SSE2, or NEON instructions
+*   if available when compiled, which sums the large water column and seabed
+*   image datagrams several times faster.
+*
+******************************************************************************/
+
+static uint16_t emx_sum_bytes (
+    const uint8_t *p,
+    const size_t n) {
+
+#if defined (CPL_SIMD_AVX2)
+    uint64_t lane[4];
+    __m256i zero;
+    __m256i acc;
+#elif defined (CPL_SIMD_SSE2)
+    uint64_t lane[2];
+    __m128i zero;
+    __m128i acc;
+#elif defined (CPL_SIMD_NEON)
+    uint16_t lane[8];
+    uint16x8_t acc;
+#endif
+    uint32_t sum = 0;
+    size_t i = 0;
+
+
+#if defined (CPL_SIMD_AVX2)
+    /* The sum of absolute differences to zero adds each group of 8 bytes into a 64-bit lane. */
+    zero = _mm256_setzero_si256 ();
+    acc = _mm256_setzero_si256 ();
+
+    for (; i+32<=n; i+=32) {
+        acc = _mm256_add_epi64 (acc, _mm256_sad_epu8 (_mm256_loadu_si256 ((const __m256i *) (p + i)), zero));
+    }
+
+    _mm256_storeu_si256 ((__m256i *) lane, acc);
+    sum = (uint32_t) (lane[0] + lane[1] + lane[2] + lane[3]);
+#elif defined (CPL_SIMD_SSE2)
+    /* The sum of absolute differences to zero adds each group of 8 bytes into a 64-bit lane. */
+    zero = _mm_setzero_si128 ();
+    acc = _mm_setzero_si128 ();
+
+    for (; i+16<=n; i+=16) {
+        acc = _mm_add_epi64 (acc, _mm_sad_epu8 (_mm_loadu_si128 ((const __m128i *) (p + i)), zero));
+    }
+
+    _mm_storeu_si128 ((__m128i *) lane, acc);
+    sum = (uint32_t) (lane[0] + lane[1]);
+#elif defined (CPL_SIMD_NEON)
+    /* Pairs of bytes are added into 16-bit lanes, which may overflow since only the sum
+       modulo 65536 is needed. */
+    acc = vdupq_n_u16 (0);
+
+    for (; i+16<=n; i+=16) {
+        acc = vpadalq_u8 (acc, vld1q_u8 (p + i));
+    }
+
+    vst1q_u16 (lane, acc);
+    sum = (uint32_t) lane[0] + lane[1] + lane[2] + lane[3] + lane[4] + lane[5] + lane[6] + lane[7];
+#endif
+
+    for (; i<n; i++) {
+        sum += p[i];
+    }
+
+    return (uint16_t) sum;
+}
+
+
+/******************************************************************************
+*
+* emx_checksum_task - Verify the checksum of the last datagram read from the
+*   file handle ARG on the worker thread.
+*
+******************************************************************************/
+
+static void emx_checksum_task (
+    void *arg,
+    const size_t n) {
+
+    emx_handle *h = (emx_handle *) arg;
+
+
+    assert (h);
+    (void) n;
+
+    h->checksum.valid = emx_finish_checksum (&(h->checksum));
+}
+
+
+/******************************************************************************
+*
+* emx_wait_checksum - Finish any checksum verification of the last datagram read
+*   from the file handle H that is running on the worker thread.  A deferred
+*   verification is discarded, since the datagram is no longer available.
+*
+******************************************************************************/
+
+static void emx_wait_checksum (
+    emx_handle *h) {
+
+    assert (h);
+
+    if (h->checksum_pending == EMX_CHECKSUM_THREAD) {
+        cpl_worker_wait (h->worker);
+        if (h->checksum.valid == 0) {
+            cpl_debug (emx_debug, "Bad datagram was not discarded\n");
+        }
+    }
+
+    h->checksum_pending = 0;
+}
+
+
+/******************************************************************************
+*
+* emx_add_nav - Add the samples of the last datagram read from the file handle H
+*   to its navigation store if it is an attitude, network attitude, heading, or
+*   position datagram.  The angles are converted to degrees, and the heave to
+*   meters.
+*
+* Return: 0 if the samples were added or the datagram has no samples, or
+*         CS_ENOMEM if memory could not be allocated.
+*
+******************************************************************************/
+
+static int emx_add_nav (
+    emx_handle *h) {
+
+    emx_datagram_attitude_network_data attitude_data;
+    const emx_datagram *d;
+    const uint8_t *p;
+    int64_t t0, t;
+    size_t i;
+    int status = CS_ENONE;
+
+
+    assert (h);
+    assert (h->nav);
+
+    switch (h->d.header.datagram_type) {
+        case EMX_DATAGRAM_ATTITUDE :
+        case EMX_DATAGRAM_ATTITUDE_NETWORK :
+        case EMX_DATAGRAM_HEADING :
+        case EMX_DATAGRAM_POSITION :
+            break;
+
+        default : return CS_ENONE;
+    }
+
+    if (emx_nav_time (h, h->d.header.date, h->d.header.time_ms, &t0) != CS_ENONE) {
+        cpl_debug (emx_debug, "Invalid navigation date (%u)\n", h->d.header.date);
+        return CS_ENONE;
+    }
+
+    d = &(h->d.datagram);
+
+    switch (h->d.header.datagram_type) {
+
+        case EMX_DATAGRAM_ATTITUDE :
+            for (i=0; (i<d->attitude.info->num_entries) && (status == CS_ENONE); i++) {
+                t = t0 + (int64_t) d->attitude.data[i].record_time * 1000000;
+
+                status = cpl_nav_add_attitude (h->nav, t, d->attitude.data[i].roll * 0.01, d->attitude.data[i].pitch * 0.01,
+                    d->attitude.data[i].heave * 0.01);
+                if (status == CS_ENONE) status = cpl_nav_add_heading (h->nav, t, d->attitude.data[i].heading * 0.01);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_ATTITUDE_NETWORK :
+            p = d->attitude_network.data;
+            for (i=0; (i<d->attitude_network.info->num_entries) && (status == CS_ENONE); i++) {
+                p = emx_get_attitude_network_data (&attitude_data, p);
+                t = t0 + (int64_t) attitude_data.info->record_time * 1000000;
+
+                status = cpl_nav_add_attitude (h->nav, t, attitude_data.info->roll * 0.01, attitude_data.info->pitch * 0.01,
+                    attitude_data.info->heave * 0.01);
+                if (status == CS_ENONE) status = cpl_nav_add_heading (h->nav, t, attitude_data.info->heading * 0.01);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_HEADING :
+            for (i=0; (i<d->heading.info->num_entries) && (status == CS_ENONE); i++) {
+                status = cpl_nav_add_heading (h->nav, t0 + (int64_t) d->heading.data[i].record_time * 1000000,
+                    d->heading.data[i].heading * 0.01);
+            }
+
+            break;
+
+        case EMX_DATAGRAM_POSITION :
+            status = cpl_nav_add_position (h->nav, t0, d->position.info->latitude / 20000000.0,
+                d->position.info->longitude / 10000000.0);
+
+            break;
+
+        default : break;
+    }
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* emx_nav_time - Store the time given by DATE and TIME_MS in nanoseconds since
+*   1970-01-01 in T for the navigation store of the file handle H.  The start of
+*   the last date is saved, since the date seldom changes from one datagram to
+*   the next, so cpl_mktime() is only called once per day.
+*
+* Return: 0 if the time was stored, or
+*         CS_EINVAL if the date is invalid.
+*
+******************************************************************************/
+
+static int emx_nav_time (
+    emx_handle *h,
+    const uint32_t date,
+    const uint32_t time_ms,
+    int64_t *t) {
+
+    double day;
+
+
+    assert (h);
+    assert (t);
+
+    if ((date != h->nav_date) || (date == 0)) {
+        day = cpl_mktime ((int) (date / 10000), (int) ((date / 100) % 100), (int) (date % 100), 0, 0, 0.0);
+        if (day < 0) return CS_EINVAL;
 
-                fprintf (fp, "\
------ Channel %d -------\n\
-channel_number        : %u\n\
-slant_range           : %0.1f m\n\
-time_duration         : %0.4f s\n\
-seconds_per_ping      : %0.4f s\n\
-num_samples           : %u\n\
-weight                : %d\n", i, d->datagram.sidescan_data.channel[i].info->channel_number, d->datagram.sidescan_data.channel[i].info->slant_range,
-                    d->datagram.sidescan_data.channel[i].info->time_duration, d->datagram.sidescan_data.channel[i].info->seconds_per_ping,
-                    d->datagram.sidescan_data.channel[i].info->num_samples, d->datagram.sidescan_data.channel[i].info->weight);
+        h->nav_date = date;
+        h->nav_day = (int64_t) day * 1000000000;
+    }
 
-                if (output_level > 0) {
+    *t = h->nav_day + (int64_t) time_ms * 1000000;
 
-                    int j;
+    return CS_ENONE;
+}
 
-                    fputs ("data                  : ", fp);
 
-                    if (d->datagram.sidescan_data.channel[i].bytes_per_sample == 2) {
-                        for (j=0; j<d->datagram.sidescan_data.channel[i].info->num_samples; j++) {
-                            fprintf (fp, "%u ", d->datagram.sidescan_data.channel[i].data.u16[j]);
-                        }
-                    } else  {
-                        for (j=0; j<d->datagram.sidescan_data.channel[i].info->num_samples; j++) {
-                            fprintf (fp, "%0.1f ", d->datagram.sidescan_data.channel[i].data.f32[j]);
-                        }
-                    }
+/******************************************************************************
+*
+* emx_skip - Skip SIZE bytes forward from the current position of the file
+*   handle H without reading the data.
+*
+* Return: 0 if the data was skipped, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ESEEK
+*
+******************************************************************************/
 
-                    fputc ('\n', fp);
-                }
-            }
+static int emx_skip (
+    emx_handle *h,
+    const size_t size) {
 
-            break;
+    assert (h);
 
-        case EMX_DATAGRAM_NAVIGATION_OUTPUT :
+    if (h->map) {
+        /* Clamp to the end of the map, which behaves the same as seeking past EOF. */
+        if (h->map_size - h->map_offset < size) {
+            h->map_offset = h->map_size;
+        } else {
+            h->map_offset += size;
+        }
+    } else if (cpl_bfile_skip (&(h->io), size) != 0) {
+        cpl_debug (emx_debug, "Seek failed\n");
+        h->emx_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
 
-            fprintf (fp, "\
-data_type             : %u\n\
-bytes_per_element     : %u\n\
-num_elements          : %u\n\
-date                  : %u\n\
-time_ms               : %u\n\
-time_offset           : %u\n\
-latitude              : %0.8f deg\n\
-longitude             : %0.8f deg\n\
-depth                 : %0.2f m\n\
-heading               : %0.1f deg\n\
-pitch                 : %0.1f deg\n\
-roll                  : %0.1f deg\n\
-velocity_forward      : %0.1f m/s\n\
-velocity_stbd         : %0.1f m/s\n\
-velocity_down         : %0.1f m/s\n\
-horizontal_uncertainty: %0.2f m\n\
-altitude              : %0.2f m\n\
-sound_speed           : %0.1f m/s\n\
-data_validity         : %u\n", d->datagram.navigation_output.info->data_type, d->datagram.navigation_output.info->bytes_per_element,
-                d->datagram.navigation_output.info->num_elements, d->datagram.navigation_output.info->date,
-                d->datagram.navigation_output.info->time_ms, d->datagram.navigation_output.info->time_offset,
-                d->datagram.navigation_output.info->latitude, d->datagram.navigation_output.info->longitude,
-                d->datagram.navigation_output.info->depth, d->datagram.navigation_output.info->heading,
-                d->datagram.navigation_output.info->pitch, d->datagram.navigation_output.info->roll,
-                d->datagram.navigation_output.info->velocity_forward, d->datagram.navigation_output.info->velocity_stbd,
-                d->datagram.navigation_output.info->velocity_down, d->datagram.navigation_output.info->horizontal_uncertainty,
-                d->datagram.navigation_output.info->altitude, d->datagram.navigation_output.info->sound_speed,
-                d->datagram.navigation_output.info->data_validity);
+    return CS_ENONE;
+}
 
-            break;
 
-        default : break;
+/******************************************************************************
+*
+* emx_copy_write - Write SIZE bytes at P to the file descriptor FD.
+*
+* Return: 0 if the data was written, or
+*         CS_EWRITE if an error occurred.
+*
+******************************************************************************/
+
+static int emx_copy_write (
+    const int fd,
+    const char *p,
+    const size_t size) {
+
+    assert (p);
+
+    if ((size > 0) && (cpl_write (fd, p, size) != (ssize_t) size)) {
+        cpl_debug (emx_debug, "Failed to write datagrams (%lu bytes)\n", (unsigned long) size);
+        return CS_EWRITE;
     }
+
+    return CS_ENONE;
 }
 
 
 /******************************************************************************
 *
-* emx_set_ignore_wc - Set the boolean to ignore (or skip) watercolumn data
-*   while reading data from the file handle H.
+* emx_delta_wc - Delta code the amplitude samples of each of the NUM_BEAMS
+*   beams of the water column beam data P, which ends at END.  If DECODE is
+*   true, the delta coding is undone instead.  Each sample is replaced by its
+*   difference to the previous sample of the beam, which is near zero for the
+*   slowly varying amplitudes, so the samples compress far better.  The beam
+*   info is not changed, so beams past any corrupt info are left as is in both
+*   directions.
 *
 ******************************************************************************/
 
-void emx_set_ignore_wc (
-    emx_handle *h,
-    const int ignore_wc) {
+static void emx_delta_wc (
+    uint8_t *p,
+    const uint8_t *end,
+    const size_t num_beams,
+    const int decode) {
 
-    assert (h);
-    h->ignore_wc = ignore_wc;
+    emx_datagram_wc_rx_beam_info info;
+    size_t i, j;
+
+
+    assert (p);
+    assert (end);
+
+    for (i=0; i<num_beams; i++) {
+        if ((size_t) (end - p) < sizeof (emx_datagram_wc_rx_beam_info)) return;
+
+        memcpy (&info, p, sizeof (emx_datagram_wc_rx_beam_info));
+        p += sizeof (emx_datagram_wc_rx_beam_info);
+
+        if ((size_t) (end - p) < info.num_samples) return;
+
+        if (decode) {
+            for (j=1; j<info.num_samples; j++) {
+                p[j] = (uint8_t) (p[j] + p[j-1]);
+            }
+        } else {
+            for (j=info.num_samples; j>1; j--) {
+                p[j-1] = (uint8_t) (p[j-1] - p[j-2]);
+            }
+        }
+
+        p += info.num_samples;
+    }
 }
 
 
 /******************************************************************************
 *
-* emx_set_ignore_checksum - Set the boolean to not verify the datagram checksum.
+* emx_resync - Search forward for the next valid datagram after the corrupt
+*   datagram at file offset OFFSET in the file handle H, and set the file
+*   position to its start.  A datagram is valid if it starts with the STX byte,
+*   the header has a valid date and model number, and the datagram ends with the
+*   ETX byte or a zero byte, as allowed by emx_prepare_checksum().  The data is
+*   searched in blocks using memchr, so the search costs about the same as
+*   reading the data.
+*
+* Return: 1 if a valid datagram was found,
+*         0 if EOF was reached, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EREAD
+*         CS_ESEEK
 *
 ******************************************************************************/
 
-void emx_set_ignore_checksum (
+static int emx_resync (
     emx_handle *h,
-    const int ignore_checksum) {
+    const uint64_t offset) {
+
+    emx_datagram_header header;
+    uint64_t position;
+    size_t window;
+    size_t i, n, end;
+    ssize_t result;
+    char *p, *q;
+    int swap;
+
 
     assert (h);
-    h->ignore_checksum = ignore_checksum;
+
+    cpl_debug (emx_debug, "Searching for a valid datagram after offset %lu\n", (unsigned long) offset);
+
+    /* Search the whole memory-mapped file at once, otherwise a block at a time. */
+    window = h->map ? h->map_size : h->io.block_size;
+    if (window < 4096) window = 4096;
+
+    position = offset + 1;
+
+    for (;;) {
+        result = emx_peek (h, position, window, &p);
+        if (result < 0) return (int) result;
+
+        n = (size_t) result;
+        if (n < sizeof (emx_datagram_header)) break;
+
+        /* The STX byte follows the datagram size at offset 4 of the header, and only
+           datagrams with the whole header in the block are tested. */
+        i = 4;
+        while (i <= n - sizeof (emx_datagram_header) + 4) {
+            q = (char *) memchr (p + i, EMX_START_BYTE, n - sizeof (emx_datagram_header) + 5 - i);
+            if (!q) break;
+
+            i = (size_t) (q - p);
+            memcpy (&header, q - 4, sizeof (emx_datagram_header));
+
+            /* Use a copy of the byte order in case the first datagram header was corrupt. */
+            swap = h->swap;
+
+            if ((emx_check_header (&header, &swap) > 0) && (header.date != 0) && (emx_get_model (header.em_model_number) != 0)) {
+                /* Get the ETX byte, which is three bytes before the end of the datagram and may be past the block. */
+                end = i - 4 + header.bytes_in_datagram + 1;
+
+                if (end < n) {
+                    q = p + end;
+                } else {
+                    q = NULL;
+
+                    result = emx_peek (h, position + end, 1, &q);
+                    if (result < 0) return (int) result;
+                    if (result != 1) q = NULL;
+                }
+
+                if (q && ((*q == EMX_END_BYTE) || (*q == 0))) {
+                    position += i - 4;
+                    cpl_debug (emx_debug, "Found valid datagram at offset %lu\n", (unsigned long) position);
+
+                    h->resync_bytes += position - offset;
+                    h->resync_count++;
+                    h->swap = swap;
+
+                    if (emx_seek (h, position) != 0) return CS_ESEEK;
+
+                    return 1;
+                }
+
+                /* Get the search block again. */
+                if (end >= n) {
+                    result = emx_peek (h, position, window, &p);
+                    if (result < 0) return (int) result;
+                    if ((size_t) result != n) return CS_EREAD;
+                }
+            }
+
+            i++;
+        }
+
+        /* Stop at EOF, otherwise search the next block starting with the datagram headers
+           that did not fit in this block. */
+        if (n < window) break;
+
+        position += n - sizeof (emx_datagram_header) + 1;
+    }
+
+    /* No valid datagram was found, so skip to EOF. */
+    position += n;
+    cpl_debug (emx_debug, "No valid datagram found before end of file\n");
+
+    h->resync_bytes += position - offset;
+    h->resync_count++;
+
+    if (emx_seek (h, position) != 0) return CS_ESEEK;
+
+    return 0;
 }
 
 
 /******************************************************************************
 *
-* emx_get_errno - Return the error number from the last call.
+* emx_peek - Set the file position of the handle H to OFFSET and set P to the
+*   next SIZE bytes without moving the file position.  The data remains valid
+*   until the next read from H.
+*
+* Return: The number of bytes available at P, which is less than SIZE only at
+*           EOF, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EREAD
+*         CS_ESEEK
 *
 ******************************************************************************/
 
-int emx_get_errno (
-    const emx_handle *h) {
+static ssize_t emx_peek (
+    emx_handle *h,
+    const uint64_t offset,
+    const size_t size,
+    char **p) {
+
+    ssize_t result;
+
 
     assert (h);
-    return h->emx_errno;
+    assert (p);
+
+    if (h->map) {
+        if (offset >= h->map_size) return 0;
+        *p = (char *) (h->map + offset);
+        return (ssize_t) (h->map_size - offset < size ? h->map_size - offset : size);
+    }
+
+    if (cpl_bfile_seek (&(h->io), (off_t) offset) != 0) {
+        cpl_debug (emx_debug, "Seek failed\n");
+        return CS_ESEEK;
+    }
+
+    if (cpl_bfile_reserve (&(h->io), size) != 0) {
+        return CS_ENOMEM;
+    }
+
+    result = cpl_bfile_peek (&(h->io), p, size);
+    if (result < 0) {
+        cpl_debug (emx_debug, "Read error occurred\n");
+        return CS_EREAD;
+    }
+
+    return result;
 }
 
 
 /******************************************************************************
 *
-* emx_set_debug - Set the debugging output level for the EMX reader.
+* emx_batch_task - Read the file number N of the batch read state ARG as a task
+*   of the thread pool used by emx_read_files().
 *
 ******************************************************************************/
 
-void emx_set_debug (
-    const int debug) {
+static void emx_batch_task (
+    void *arg,
+    const size_t n) {
 
-    emx_debug = debug;
+    emx_batch *b = (emx_batch *) arg;
+
+
+    assert (b);
+    b->file_status[n] = emx_batch_file (b, n);
 }
 
 
 /******************************************************************************
 *
-* emx_identify - Determine if the file given by FILE_NAME is a EMX file.
+* emx_batch_file - Read the file number N of the batch read state B and pass
+*   each datagram to the callback function.
 *
-* Return: 1 if the file is a EMX file,
-*         0 if the file is not a EMX file, or
+* Return: 0 if the file was read successfully, or
 *         error condition if an error occurred.
 *
 * Errors: CS_EOPEN
-*         CS_EREAD
+*         CS_ECLOSE
+*         Any error from emx_read() or emx_build_index()
 *
 ******************************************************************************/
 
-int emx_identify (
-    const char *file_name) {
+static int emx_batch_file (
+    emx_batch *b,
+    const size_t n) {
 
-    emx_datagram_header header;
-    int swap = -1;
+    const emx_index_entry *entry;
+    const emx_data *d;
+    emx_handle *h;
+    size_t i;
     int status;
-    int fd;
 
 
-    if (!file_name) return 0;
+    assert (b);
 
-    /* Open the binary file for read-only access or return on failure. */
-    fd = cpl_open (file_name, CPL_OPEN_RDONLY | CPL_OPEN_BINARY | CPL_OPEN_SEQUENTIAL);
+    if (b->options & EMX_BATCH_MMAP) {
+        h = emx_open_mmap (b->file_names[n]);
+    } else {
+        h = emx_open (b->file_names[n]);
+    }
 
-    if (fd < 0) {
-        cpl_debug (emx_debug, "Open failed for file '%s'\n", file_name);
-        return CS_EOPEN;
+    if (!h) return CS_EOPEN;
+
+    /* The threads already read in parallel, so each frame of a compressed file is decoded when it is read. */
+    cpl_bfile_set_threads (&(h->io), 0);
+
+    /* Let the caller set up the handle before reading. */
+    if (b->fn (h, NULL, n, b->user_data) != 0) {
+        return emx_close (h);
+    }
+
+    if (b->options & EMX_BATCH_SORT) {
+        /* Use the datagrams indexed before any invalid data. */
+        status = emx_build_index (h);
+
+        if ((status == CS_ENONE) || (status == CS_EBADDATA)) {
+            h->read_one = 1;
+            h->emx_errno = CS_ENONE;
+
+            /* Read one datagram at each index entry in order of time.  A datagram rejected by
+               the type filter or with an invalid checksum returns NULL. */
+            for (i=0; i<h->index_size; i++) {
+                entry = &(h->index[h->index_by_time[i]]);
+
+                if ((emx_tell (h) != entry->offset) && (emx_seek (h, entry->offset) != 0)) {
+                    h->emx_errno = CS_ESEEK;
+                    break;
+                }
+
+                d = emx_read (h);
+
+                if (!d) {
+                    if (h->emx_errno != CS_ENONE) break;
+                    continue;
+                }
+
+                if (b->fn (h, d, n, b->user_data) != 0) break;
+            }
+
+            if (h->emx_errno != CS_ENONE) status = h->emx_errno;
+        }
+    } else {
+        while ((d = emx_read (h)) != NULL) {
+            if (b->fn (h, d, n, b->user_data) != 0) break;
+        }
+
+        status = h->emx_errno;
+    }
+
+    if (emx_close (h) != 0) {
+        if (status == CS_ENONE) status = CS_ECLOSE;
+    }
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* emx_split_chunks - Store the start offsets of NUM_CHUNKS ranges of about equal
+*   size of the file given by the handle H in OFFSETS, followed by the file size.
+*   Each offset is that of an indexed datagram.  Chunks that would start past the
+*   last indexed datagram are empty, so any data after the index, e.g., after
+*   invalid data, is read by the last chunk that is not empty.
+*
+* Return: 0 if the offsets were stored, or
+*         error condition if an error occurred.
+*
+* Errors: Any error from emx_build_index()
+*
+******************************************************************************/
+
+static int emx_split_chunks (
+    emx_handle *h,
+    uint64_t *offsets,
+    const size_t num_chunks) {
+
+    uint64_t file_size;
+    uint64_t target;
+    size_t i = 0;
+    size_t n;
+    int status;
+
+
+    assert (h);
+    assert (offsets);
+
+    /* Use the datagrams indexed before any invalid data. */
+    status = emx_build_index (h);
+    if ((status != CS_ENONE) && (status != CS_EBADDATA)) return status;
+
+    if (emx_file_size (h, &file_size) != 0) return CS_ESEEK;
+
+    offsets[0] = 0;
+    offsets[num_chunks] = file_size;
+
+    for (n=1; n<num_chunks; n++) {
+        target = file_size / num_chunks * n;
+
+        /* Find the first datagram at or after the target in file order. */
+        while ((i < h->index_size) && (h->index[i].offset < target)) i++;
+
+        offsets[n] = i < h->index_size ? h->index[i].offset : file_size;
     }
 
-    /* TODO: Read several datagrams instead of just one. */
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* emx_chunk_task - Read the chunk number N of the chunked read state ARG as a
+*   task of the thread pool used by emx_read_chunks().
+*
+******************************************************************************/
 
-    /* Read the first datagram header and validate it, then close the file. */
-    status = emx_get_header (&header, &swap, fd);
+static void emx_chunk_task (
+    void *arg,
+    const size_t n) {
 
-    cpl_close (fd);
+    emx_chunks *c = (emx_chunks *) arg;
 
-    if (status > 0) return 1;
-    if (status == CS_EREAD) return status;
 
-    return 0;
+    assert (c);
+    c->chunk_status[n] = emx_chunk_file (c, n);
 }
 
 
 /******************************************************************************
 *
-* emx_get_header - Read the datagram header from the open file descriptor FD at
-*   the current file position to the object HEADER.  If the value of SWAP is
-*   positive, then the header will be byte swapped.  If SWAP is zero, then no
-*   byte swapping is done.  If SWAP is negative, the byte swapping will be
-*   determined from the data and SWAP will be set accordingly.  The data in the
-*   header will be validated.
+* emx_chunk_file - Read the chunk number N of the chunked read state C using a
+*   new file handle and pass each datagram to the callback function.
 *
-* Return: 0 if the file is at EOF,
-*        >0 if the datagram header is read and is valid, or
-*        <0 if an error occurred reading the header or the header is invalid.
+* Return: 0 if the chunk was read successfully, or
+*         error condition if an error occurred.
 *
-* Errors: CS_EREAD
-*         CS_EBADDATA
+* Errors: CS_EOPEN
+*         CS_ECLOSE
+*         CS_ESEEK
+*         Any error from emx_read()
 *
 ******************************************************************************/
 
-static int emx_get_header (
-    emx_datagram_header *header,
-    int *swap,
-    const int fd) {
+static int emx_chunk_file (
+    emx_chunks *c,
+    const size_t n) {
 
-    size_t actual_read_size;
-    size_t read_size;
-    ssize_t result;
+    const emx_data *d;
+    emx_handle *h;
+    uint64_t offset;
+    int status;
 
 
-    assert (swap);
-    assert (header);
-    assert (fd != -1);
+    assert (c);
 
-    /* Set the read size to the datagram header size. */
-    read_size = sizeof (emx_datagram_header);
+    if (c->offsets[n] >= c->offsets[n+1]) return CS_ENONE;
 
-    /* Read the datagram header from the open file descriptor FD. */
-    result = cpl_read (header, read_size, fd);
-    if (result < 0) {
-        cpl_debug (emx_debug, "Read error occurred\n");
-        return CS_EREAD;
+    if (c->options & EMX_BATCH_MMAP) {
+        h = emx_open_mmap (c->file_name);
+    } else {
+        h = emx_open (c->file_name);
     }
 
-    actual_read_size = (size_t) result;
+    if (!h) return CS_EOPEN;
 
-    /* If the read amount is zero, then it is EOF, otherwise if the read
-       amount is less than the datagram header size, then the file is corrupt. */
-    if (actual_read_size != read_size) {
-        if (actual_read_size != 0) {
-            cpl_debug (emx_debug, "Unexpected end of file\n");
-            return CS_EBADDATA;
-        }
-        return 0;
+    /* The threads already read in parallel, so each frame of a compressed file is decoded when it is read. */
+    cpl_bfile_set_threads (&(h->io), 0);
+
+    /* Let the caller set up the handle before reading. */
+    if (c->fn (h, NULL, n, c->user_data) != 0) {
+        return emx_close (h);
     }
 
-    /* Check the date and model number fields to determine if the data is stored as big or little-endian.
-       Set the swap value to 1 if byte swapping is needed.  This test is only done if the swap value is negative. */
-    if (*swap < 0) {
-        *swap = emx_byte_order (header->date, header->em_model_number);
-        if (*swap < 0) {
-            cpl_debug (emx_debug, "Invalid date or model number (%u, %u)\n", header->date, header->em_model_number);
-            return CS_EBADDATA;
+    if (emx_seek (h, c->offsets[n]) != 0) {
+        h->emx_errno = CS_ESEEK;
+    } else {
+        /* Read one datagram at a time, so no datagram starting in the next chunk is read.  A datagram
+           rejected by the type filter or with an invalid checksum returns NULL. */
+        h->read_one = 1;
+
+        while ((offset = emx_tell (h)) < c->offsets[n+1]) {
+            d = emx_read (h);
+
+            if (!d) {
+                if ((h->emx_errno != CS_ENONE) || (emx_tell (h) == offset)) break;
+                continue;
+            }
+
+            if (c->fn (h, d, n, c->user_data) != 0) break;
         }
-        cpl_debug (emx_debug, "Byte swap set to %s\n", *swap == 0 ? "FALSE" : "TRUE");
     }
 
-    /* Byte swap the header if necessary. */
-    if (*swap) emx_swap_header (header);
+    status = h->emx_errno;
 
-    /* Validate the header and return the result. */
-    if (emx_valid_header (header)) return 1;
+    if ((emx_close (h) != 0) && (status == CS_ENONE)) {
+        status = CS_ECLOSE;
+    }
 
-    return CS_EBADDATA;
+    return status;
 }
 
 
 /******************************************************************************
 *
-* emx_byte_order - Determine the byte order given the date value in DATE and the
-*   system model number MODEL from the datagram header.
-*
-* Return: 0 if the date value is valid and requires no byte swapping,
-*         1 if the date value is valid and does require byte swapping, or
-*        -1 if the date value is invalid.
+* emx_tell - Return the file offset of the next datagram to be read from the
+*   file handle H.
 *
 ******************************************************************************/
 
-static int emx_byte_order (
-    const uint32_t date,
-    const uint16_t model) {
+static uint64_t emx_tell (
+    const emx_handle *h) {
 
-    /* We determine byte order by byte swapping the date field and testing if the
-       result is a valid date.  Some data has been found with the date in the first
-       datagram set to zero, so for this case we test the model number field instead. */
+    assert (h);
 
-    if ((date != 0) && (date != 20001025) && (date != 20790529)) {
+    if (h->map) return h->map_offset;
 
-        /* This test should be sufficient for all dates between the years 1970 to 2100
-           with the exception of 20001025 and 20790529.  When these dates are byte swapped
-           they equal themselves.  For these cases, we test the model number instead. */
+    return (uint64_t) cpl_bfile_tell (&(h->io));
+}
 
-        if (emx_valid_date (date)) {
-            return 0;
-        }
 
-        if (emx_valid_date (CPL_BSWAP (date))) {
-            return 1;
-        }
+/******************************************************************************
+*
+* emx_seek - Set the file offset of the next datagram to be read from the file
+*   handle H to OFFSET.
+*
+* Return: 0 if the file position was set, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
 
-    } else {
+static int emx_seek (
+    emx_handle *h,
+    const uint64_t offset) {
 
-        if (emx_get_model (model)) {
-            return 0;
-        }
+    assert (h);
 
-        if (emx_get_model (CPL_BSWAP (model))) {
-            return 1;
-        }
+    if (h->map) {
+        if (offset > h->map_size) return -1;
+        h->map_offset = (size_t) offset;
+        return 0;
     }
 
-    return -1;
+    /* Datagrams are byte swapped and changed in place in the file block, so data
+       before the file position must be read from the file again. */
+    if ((offset < (uint64_t) cpl_bfile_tell (&(h->io))) && (cpl_bfile_discard (&(h->io)) != 0)) {
+        return -1;
+    }
+
+    return cpl_bfile_seek (&(h->io), (off_t) offset);
 }
 
 
 /******************************************************************************
 *
-* emx_valid_date - Return non-zero if the date is in the valid range.
+* emx_file_size - Store the size in bytes of the file given by the handle H in
+*   SIZE.
+*
+* Return: 0 if the file size is known, or
+*        -1 if the file is not a regular file.
 *
 ******************************************************************************/
 
-static int emx_valid_date (
-    const uint32_t date) {
+static int emx_file_size (
+    const emx_handle *h,
+    uint64_t *size) {
 
-    uint32_t year, month, day;
+    cpl_stat_t stbuf;
 
 
-    /* Make sure the date is within a reasonable time period, but be generous. */
-    if (date < 19700000 || date > 21000000) return 0;
+    assert (h);
+    assert (size);
 
-    /* Parse year, month, and day from date field. */
-    year = date / 10000;
-    month = (date / 100) % 100;
-    day = date % 100;
+    if (h->map) {
+        *size = h->map_size;
+        return 0;
+    }
 
-    return cpl_valid_date (year, month, day, 0, 0, 0.0);
+    if (h->io.zfile) {
+        *size = cpl_zfile_get_size (h->io.zfile);
+        return 0;
+    }
+
+    if ((cpl_fstat (h->fd, &stbuf) != 0) || (stbuf.s_isreg == 0)) return -1;
+
+    *size = (uint64_t) stbuf.file_size;
+
+    return 0;
 }
 
 
 /******************************************************************************
 *
-* emx_valid_header - Return non-zero if the datagram header HEADER is valid.
-*
-* Return: 1 if the header is valid,
-*         0 otherwise.
+* emx_index_time - Return the time given by DATE and TIME_MS as a single value
+*   that is used to sort and search the index.  The date is stored as a decimal
+*   number year*10000 + month*100 + day, which already sorts in time order, so
+*   there is no need to convert it to days.
 *
 ******************************************************************************/
 
-static int emx_valid_header (
-    const emx_datagram_header *header) {
+static uint64_t emx_index_time (
+    const uint32_t date,
+    const uint32_t time_ms) {
 
-    assert (header);
+    return (uint64_t) date * 100000000 + time_ms;
+}
 
-    /* Verify start byte of datagram. */
-    if (header->start_identifier != EMX_START_BYTE) {
-        cpl_debug (emx_debug, "Invalid start byte (%u)\n", header->start_identifier);
-        return 0;
-    }
 
-    /* Verify datagram size is not too small. */
-    if (header->bytes_in_datagram < 16) {
-        cpl_debug (emx_debug, "Invalid datagram size (%u)\n", header->bytes_in_datagram);
-        return 0;
-    }
+/******************************************************************************
+*
+* emx_compare_type - Compare the index sort keys A and B by datagram type, time,
+*   and file order for qsort.
+*
+******************************************************************************/
 
-    /* Verify the datagram size is not unreasonably large, but be generous. */
-    if (header->bytes_in_datagram > 1<<27) {
-        cpl_debug (emx_debug, "Invalid datagram size (%u)\n", header->bytes_in_datagram);
-        return 0;
-    }
+static int emx_compare_type (
+    const void *a,
+    const void *b) {
 
-    /* Have found an unknown datagram with invalid millisecond field. */
-    if (header->datagram_type != EMX_DATAGRAM_UNKNOWN2) {
+    const emx_index_key *ka = (const emx_index_key *) a;
+    const emx_index_key *kb = (const emx_index_key *) b;
 
-        /* Verify milliseconds field. */
-        if (header->time_ms > 86399999) {
-            cpl_debug (emx_debug, "Invalid millisecond field (%u)\n", header->time_ms);
-            return 0;
-        }
 
-        /* Verify data field, but only if non-zero. */
-        if (header->date != 0) {
-            if (emx_valid_date (header->date) == 0) {
-                cpl_debug (emx_debug, "Invalid date (%u)\n", header->date);
-                return 0;
-            }
-        }
-    }
+    if (ka->type != kb->type) return ka->type < kb->type ? -1 : 1;
 
-    return 1;
+    return emx_compare_time (a, b);
 }
 
 
 /******************************************************************************
 *
-* emx_swap_header - Byte swap the datagram header.
+* emx_compare_time - Compare the index sort keys A and B by time and file order
+*   for qsort.
 *
 ******************************************************************************/
 
-static void emx_swap_header (
-    emx_datagram_header *header) {
+static int emx_compare_time (
+    const void *a,
+    const void *b) {
 
-    assert (header);
+    const emx_index_key *ka = (const emx_index_key *) a;
+    const emx_index_key *kb = (const emx_index_key *) b;
 
-    header->bytes_in_datagram = CPL_BSWAP (header->bytes_in_datagram);
-    header->em_model_number = CPL_BSWAP (header->em_model_number);
-    header->date = CPL_BSWAP (header->date);
-    header->time_ms = CPL_BSWAP (header->time_ms);
-    header->counter = CPL_BSWAP (header->counter);
-    header->serial_number = CPL_BSWAP (header->serial_number);
+
+    if (ka->time != kb->time) return ka->time < kb->time ? -1 : 1;
+    if (ka->entry != kb->entry) return ka->entry < kb->entry ? -1 : 1;
+
+    return 0;
 }
 
 
 /******************************************************************************
 *
-* emx_swap_datagram - Byte swap the datagram D.
+* emx_sort_index - Create the sorted index entry arrays of the file handle H,
+*   which are used to search the index by datagram type and time.
+*
+* Return: 0 if the arrays were created, or
+*        -1 if memory allocation failed.
 *
 ******************************************************************************/
 
-static void emx_swap_datagram (
-    emx_datagram *d,
-    const int datagram_type) {
+static int emx_sort_index (
+    emx_handle *h) {
 
-    size_t num_samples;
-    size_t i;
+    emx_index_key *keys;
+    size_t i, n;
 
 
-    assert (d);
+    assert (h);
 
-    switch (datagram_type) {
+    if (h->index_by_type) cpl_free (h->index_by_type);
+    if (h->index_by_time) cpl_free (h->index_by_time);
 
-        case EMX_DATAGRAM_DEPTH :
+    /* Allocate at least one element so an empty index is still valid. */
+    n = h->index_size > 0 ? h->index_size : 1;
 
-            d->depth.info->vessel_heading = CPL_BSWAP (d->depth.info->vessel_heading);
-            d->depth.info->sound_speed = CPL_BSWAP (d->depth.info->sound_speed);
-            d->depth.info->transducer_depth = CPL_BSWAP (d->depth.info->transducer_depth);
-            d->depth.info->sample_rate = CPL_BSWAP (d->depth.info->sample_rate);
+    h->index_by_type = (uint32_t *) cpl_malloc (n * sizeof (uint32_t));
+    h->index_by_time = (uint32_t *) cpl_malloc (n * sizeof (uint32_t));
+    keys = (emx_index_key *) cpl_malloc (n * sizeof (emx_index_key));
 
-            for (i=0; i<d->depth.info->num_beams; i++) {
-                d->depth.beam[i].depth = CPL_BSWAP (d->depth.beam[i].depth);
-                d->depth.beam[i].across_track = CPL_BSWAP (d->depth.beam[i].across_track);
-                d->depth.beam[i].along_track = CPL_BSWAP (d->depth.beam[i].along_track);
-                d->depth.beam[i].beam_depression_angle = CPL_BSWAP (d->depth.beam[i].beam_depression_angle);
-                d->depth.beam[i].beam_azimuth_angle = CPL_BSWAP (d->depth.beam[i].beam_azimuth_angle);
-                d->depth.beam[i].range = CPL_BSWAP (d->depth.beam[i].range);
-            }
+    if (!h->index_by_type || !h->index_by_time || !keys) {
+        if (keys) cpl_free (keys);
+        if (h->index_by_type) cpl_free (h->index_by_type);
+        if (h->index_by_time) cpl_free (h->index_by_time);
+        h->index_by_type = NULL;
+        h->index_by_time = NULL;
+        return -1;
+    }
 
-            break;
+    for (i=0; i<h->index_size; i++) {
+        keys[i].time = emx_index_time (h->index[i].date, h->index[i].time_ms);
+        keys[i].type = h->index[i].datagram_type;
+        keys[i].entry = (uint32_t) i;
+    }
 
-        case EMX_DATAGRAM_DEPTH_NOMINAL :
+    qsort (keys, h->index_size, sizeof (emx_index_key), emx_compare_type);
 
-            d->depth_nominal.info->transducer_depth = CPL_BSWAPF (d->depth_nominal.info->transducer_depth);
-            d->depth_nominal.info->max_beams = CPL_BSWAP (d->depth_nominal.info->max_beams);
-            d->depth_nominal.info->num_beams = CPL_BSWAP (d->depth_nominal.info->num_beams);
+    for (i=0; i<h->index_size; i++) {
+        h->index_by_type[i] = keys[i].entry;
+    }
 
-            for (i=0; i<d->depth_nominal.info->num_beams; i++) {
-                d->depth_nominal.beam[i].depth = CPL_BSWAPF (d->depth_nominal.beam[i].depth);
-                d->depth_nominal.beam[i].across_track = CPL_BSWAPF (d->depth_nominal.beam[i].across_track);
-                d->depth_nominal.beam[i].along_track = CPL_BSWAPF (d->depth_nominal.beam[i].along_track);
-            }
+    qsort (keys, h->index_size, sizeof (emx_index_key), emx_compare_time);
 
-            break;
+    for (i=0; i<h->index_size; i++) {
+        h->index_by_time[i] = keys[i].entry;
+    }
 
-        case EMX_DATAGRAM_XYZ :
+    cpl_free (keys);
 
-            d->xyz.info->vessel_heading = CPL_BSWAP (d->xyz.info->vessel_heading);
-            d->xyz.info->sound_speed = CPL_BSWAP (d->xyz.info->sound_speed);
-            d->xyz.info->transducer_depth = CPL_BSWAPF (d->xyz.info->transducer_depth);
-            d->xyz.info->num_beams = CPL_BSWAP (d->xyz.info->num_beams);
-            d->xyz.info->valid_beams = CPL_BSWAP (d->xyz.info->valid_beams);
-            d->xyz.info->sample_rate = CPL_BSWAPF (d->xyz.info->sample_rate);
+    return 0;
+}
 
-            for (i=0; i<d->xyz.info->num_beams; i++) {
-                d->xyz.beam[i].depth = CPL_BSWAPF (d->xyz.beam[i].depth);
-                d->xyz.beam[i].across_track = CPL_BSWAPF (d->xyz.beam[i].across_track);
-                d->xyz.beam[i].along_track = CPL_BSWAPF (d->xyz.beam[i].along_track);
-                d->xyz.beam[i].detect_window_length = CPL_BSWAP (d->xyz.beam[i].detect_window_length);
-                d->xyz.beam[i].backscatter = CPL_BSWAP (d->xyz.beam[i].backscatter);
-            }
 
-            break;
+/******************************************************************************
+*
+* emx_free_index - Free the datagram index of the file handle H.
+*
+******************************************************************************/
 
-        case EMX_DATAGRAM_EXTRA_DETECTIONS :
+static void emx_free_index (
+    emx_handle *h) {
 
-            d->extra_detect.info->datagram_counter = CPL_BSWAP (d->extra_detect.info->datagram_counter);
-            d->extra_detect.info->datagram_version = CPL_BSWAP (d->extra_detect.info->datagram_version);
-            d->extra_detect.info->swath_counter = CPL_BSWAP (d->extra_detect.info->swath_counter);
-            d->extra_detect.info->swath_index = CPL_BSWAP (d->extra_detect.info->swath_index);
-            d->extra_detect.info->vessel_heading = CPL_BSWAP (d->extra_detect.info->vessel_heading);
-            d->extra_detect.info->sound_speed = CPL_BSWAP (d->extra_detect.info->sound_speed);
-            d->extra_detect.info->reference_depth = CPL_BSWAPF (d->extra_detect.info->reference_depth);
-            d->extra_detect.info->wc_sample_rate = CPL_BSWAPF (d->extra_detect.info->wc_sample_rate);
-            d->extra_detect.info->raw_amplitude_sample_rate = CPL_BSWAPF (d->extra_detect.info->raw_amplitude_sample_rate);
-            d->extra_detect.info->num_detects = CPL_BSWAP (d->extra_detect.info->num_detects);
-            d->extra_detect.info->num_classes = CPL_BSWAP (d->extra_detect.info->num_classes);
-            d->extra_detect.info->nbytes_class = CPL_BSWAP (d->extra_detect.info->nbytes_class);
-            d->extra_detect.info->nalarm_flags = CPL_BSWAP (d->extra_detect.info->nalarm_flags);
-            d->extra_detect.info->nbytes_detect = CPL_BSWAP (d->extra_detect.info->nbytes_detect);
+    assert (h);
 
-            for (i=0; i<d->extra_detect.info->num_classes; i++) {
-                d->extra_detect.classes[i].start_depth = CPL_BSWAP (d->extra_detect.classes[i].start_depth);
-                d->extra_detect.classes[i].stop_depth = CPL_BSWAP (d->extra_detect.classes[i].stop_depth);
-                d->extra_detect.classes[i].qf_threshold = CPL_BSWAP (d->extra_detect.classes[i].qf_threshold);
-                d->extra_detect.classes[i].bs_threshold = CPL_BSWAP (d->extra_detect.classes[i].bs_threshold);
-                d->extra_detect.classes[i].snr_threshold = CPL_BSWAP (d->extra_detect.classes[i].snr_threshold);
-                d->extra_detect.classes[i].alarm_threshold = CPL_BSWAP (d->extra_detect.classes[i].alarm_threshold);
-                d->extra_detect.classes[i].num_detects = CPL_BSWAP (d->extra_detect.classes[i].num_detects);
-            }
+    if (h->index) cpl_free (h->index);
+    if (h->index_by_type) cpl_free (h->index_by_type);
+    if (h->index_by_time) cpl_free (h->index_by_time);
+
+    h->index = NULL;
+    h->index_size = 0;
+    h->index_alloc = 0;
+    h->index_by_type = NULL;
+    h->index_by_time = NULL;
+}
+
+
+/******************************************************************************
+*
+* set_buffer_size - Set the internal allocated read buffer size given by the
+*   file handle H to at least SIZE bytes.
+*
+* Return: Non-zero if memory allocation failed.
+*
+* Errors: CS_ENOMEM
+*
+******************************************************************************/
 
-            for (i=0; i<d->extra_detect.info->num_detects; i++) {
-                d->extra_detect.data[i].depth = CPL_BSWAPF (d->extra_detect.data[i].depth);
-                d->extra_detect.data[i].across_track = CPL_BSWAPF (d->extra_detect.data[i].across_track);
-                d->extra_detect.data[i].along_track = CPL_BSWAPF (d->extra_detect.data[i].along_track);
-                d->extra_detect.data[i].latitude_delta = CPL_BSWAPF (d->extra_detect.data[i].latitude_delta);
-                d->extra_detect.data[i].longitud_delta = CPL_BSWAPF (d->extra_detect.data[i].longitud_delta);
-                d->extra_detect.data[i].beam_angle = CPL_BSWAPF (d->extra_detect.data[i].beam_angle);
-                d->extra_detect.data[i].angle_correction = CPL_BSWAPF (d->extra_detect.data[i].angle_correction);
-                d->extra_detect.data[i].travel_time = CPL_BSWAPF (d->extra_detect.data[i].travel_time);
-                d->extra_detect.data[i].travel_time_correction = CPL_BSWAPF (d->extra_detect.data[i].travel_time_correction);
-                d->extra_detect.data[i].backscatter = CPL_BSWAP (d->extra_detect.data[i].backscatter);
-                d->extra_detect.data[i].tx_sector = CPL_BSWAP (d->extra_detect.data[i].tx_sector);
-                d->extra_detect.data[i].detection_window_length = CPL_BSWAP (d->extra_detect.data[i].detection_window_length);
-                d->extra_detect.data[i].quality_factor = CPL_BSWAP (d->extra_detect.data[i].quality_factor);
-                d->extra_detect.data[i].system_cleaning = CPL_BSWAP (d->extra_detect.data[i].system_cleaning);
-                d->extra_detect.data[i].range_factor = CPL_BSWAP (d->extra_detect.data[i].range_factor);
-                d->extra_detect.data[i].class_number = CPL_BSWAP (d->extra_detect.data[i].class_number);
-                d->extra_detect.data[i].confidence = CPL_BSWAP (d->extra_detect.data[i].confidence);
-                d->extra_detect.data[i].qf_ifremer = CPL_BSWAP (d->extra_detect.data[i].qf_ifremer);
-                d->extra_detect.data[i].wc_beam_number = CPL_BSWAP (d->extra_detect.data[i].wc_beam_number);
-                d->extra_detect.data[i].beam_angle_across = CPL_BSWAPF (d->extra_detect.data[i].beam_angle_across);
-                d->extra_detect.data[i].detected_range = CPL_BSWAP (d->extra_detect.data[i].detected_range);
-                d->extra_detect.data[i].raw_amplitude = CPL_BSWAP (d->extra_detect.data[i].raw_amplitude);
-            }
+static int set_buffer_size (
+    emx_handle *h,
+    const size_t size) {
 
-            /* TODO: raw_amplitudes */
+    assert (h);
 
-            break;
+    if (size > h->buffer_size) {
 
-        case EMX_DATAGRAM_CENTRAL_BEAMS :
+        /* Allocate a new size of 1.5 * size bytes.  Use free/malloc instead of
+           realloc to avoid copying an empty buffer. */
+        h->buffer_size = size + (size + 1) / 2;
+        if (h->buffer) cpl_free (h->buffer);
 
-            d->central_beams.info->mean_abs_coef = CPL_BSWAP (d->central_beams.info->mean_abs_coef);
-            d->central_beams.info->pulse_length = CPL_BSWAP (d->central_beams.info->pulse_length);
-            d->central_beams.info->range_norm = CPL_BSWAP (d->central_beams.info->range_norm);
-            d->central_beams.info->start_range = CPL_BSWAP (d->central_beams.info->start_range);
-            d->central_beams.info->stop_range = CPL_BSWAP (d->central_beams.info->stop_range);
-            d->central_beams.info->tx_beamwidth = CPL_BSWAP (d->central_beams.info->tx_beamwidth);
+        h->buffer = (char *) cpl_malloc (h->buffer_size);
+        if (!h->buffer) return CS_ENOMEM;
+    }
 
-            for (i=0; i<d->central_beams.info->num_beams; i++) {
-                d->central_beams.beam[i].num_samples = CPL_BSWAP (d->central_beams.beam[i].num_samples);
-                d->central_beams.beam[i].start_range = CPL_BSWAP (d->central_beams.beam[i].start_range);
-            }
+    return 0;
+}
 
-            break;
 
-        case EMX_DATAGRAM_RRA_101 :
+/******************************************************************************
+*
+* emx_get_model - Return the system model number or return zero if the model
+*   number is unrecognized.
+*
+******************************************************************************/
 
-            d->rra_101.info->vessel_heading = CPL_BSWAP (d->rra_101.info->vessel_heading);
-            d->rra_101.info->sound_speed = CPL_BSWAP (d->rra_101.info->sound_speed);
-            d->rra_101.info->transducer_depth = CPL_BSWAP (d->rra_101.info->transducer_depth);
-            d->rra_101.info->sample_rate = CPL_BSWAP (d->rra_101.info->sample_rate);
-            d->rra_101.info->status = CPL_BSWAP (d->rra_101.info->status);
-            d->rra_101.info->range_norm = CPL_BSWAP (d->rra_101.info->range_norm);
-            d->rra_101.info->yawstab_heading = CPL_BSWAP (d->rra_101.info->yawstab_heading);
-            d->rra_101.info->tx_sectors = CPL_BSWAP (d->rra_101.info->tx_sectors);
+int emx_get_model (
+    const uint16_t em_model_number) {
 
+    int model;
 
-            for (i=0; i<d->rra_101.info->tx_sectors; i++) {
-                d->rra_101.tx_beam[i].last_beam = CPL_BSWAP (d->rra_101.tx_beam[i].last_beam);
-                d->rra_101.tx_beam[i].tx_tilt_angle = CPL_BSWAP (d->rra_101.tx_beam[i].tx_tilt_angle);
-                d->rra_101.tx_beam[i].heading = CPL_BSWAP (d->rra_101.tx_beam[i].heading);
-                d->rra_101.tx_beam[i].roll = CPL_BSWAP (d->rra_101.tx_beam[i].roll);
-                d->rra_101.tx_beam[i].pitch = CPL_BSWAP (d->rra_101.tx_beam[i].pitch);
-                d->rra_101.tx_beam[i].heave = CPL_BSWAP (d->rra_101.tx_beam[i].heave);
-            }
 
-            for (i=0; i<d->rra_101.info->num_beams; i++) {
-                d->rra_101.rx_beam[i].range = CPL_BSWAP (d->rra_101.rx_beam[i].range);
-                d->rra_101.rx_beam[i].rx_beam_angle = CPL_BSWAP (d->rra_101.rx_beam[i].rx_beam_angle);
-                d->rra_101.rx_beam[i].rx_heading = CPL_BSWAP (d->rra_101.rx_beam[i].rx_heading);
-                d->rra_101.rx_beam[i].roll = CPL_BSWAP (d->rra_101.rx_beam[i].roll);
-                d->rra_101.rx_beam[i].pitch = CPL_BSWAP (d->rra_101.rx_beam[i].pitch);
-                d->rra_101.rx_beam[i].heave = CPL_BSWAP (d->rra_101.rx_beam[i].heave);
-            }
+    switch (em_model_number) {
+        case  120 : model = EM_MODEL_120;          break;
+        case  121 : model = EM_MODEL_121A;         break;
+        case  122 : model = EM_MODEL_122;          break;
+        case  124 : model = EM_MODEL_124;          break;
+        case  300 : model = EM_MODEL_300;          break;
+        case  302 : model = EM_MODEL_302;          break;
+        case  710 : model = EM_MODEL_710;          break;
+        case  712 : model = EM_MODEL_712;          break;
+        case  850 : model = EM_MODEL_ME70BO;       break;
+        case 1002 : model = EM_MODEL_1002;         break;
+        case 2000 : model = EM_MODEL_2000;         break;
+        case 2040 : model = EM_MODEL_2040;         break;
+        case 2045 : model = EM_MODEL_2040C;        break;
+        case 3000 : model = EM_MODEL_3000;         break;
+        case 3002 : CPL_ATTRIBUTE_FALLTHROUGH;
+        case 3003 : CPL_ATTRIBUTE_FALLTHROUGH;
+        case 3004 : CPL_ATTRIBUTE_FALLTHROUGH;
+        case 3005 : CPL_ATTRIBUTE_FALLTHROUGH;
+        case 3006 : CPL_ATTRIBUTE_FALLTHROUGH;
+        case 3007 : CPL_ATTRIBUTE_FALLTHROUGH;
+        case 3008 : model = EM_MODEL_3000D;        break;
+        case 3020 : model = EM_MODEL_3002;         break;
+        case 10120 : model = 0;                    break;  /* TODO: */
+        case 11032 : model = EM_MODEL_HISAS_1032;  break;
+        case 11034 : model = EM_MODEL_HISAS_1032D; break;
+        case 12040 : model = EM_MODEL_HISAS_2040;  break;
+        default : model = 0; break;
+    }
 
-            break;
+    return model;
+}
 
-        case EMX_DATAGRAM_RRA_70 :
 
-            d->rra_70.info->sound_speed = CPL_BSWAP (d->rra_70.info->sound_speed);
+/******************************************************************************
+*
+* emx_get_em3000d_sample_rate - Return the sample rate in Hertz of the EM3000D
+*   given the EM_MODEL_NUMBER and SONAR_HEAD.  The sonar head is 1 for port
+*   and 2 for starboard.
+*
+******************************************************************************/
 
-            for (i=0; i<d->rra_70.info->num_beams; i++) {
-                d->rra_70.beam[i].beam_angle = CPL_BSWAP (d->rra_70.beam[i].beam_angle);
-                d->rra_70.beam[i].tx_tilt_angle = CPL_BSWAP (d->rra_70.beam[i].tx_tilt_angle);
-                d->rra_70.beam[i].range = CPL_BSWAP (d->rra_70.beam[i].range);
-            }
+unsigned int emx_get_em3000d_sample_rate (
+    const uint16_t em_model_number,
+    const int sonar_head) {
+                                     /* 3002,  3003,  3004,  3005,  3006,  3007,  3008 */
+    static const unsigned int s1[] = { 13956, 13956, 14293, 13956, 14621, 14293, 14621 };
+    static const unsigned int s2[] = { 14621, 14621, 14621, 14293, 14293, 13956, 13956 };
 
-            break;
 
-        case EMX_DATAGRAM_RRA_102 :
+    assert ((sonar_head == 1) || (sonar_head == 2));
 
-            d->rra_102.info->tx_sectors = CPL_BSWAP (d->rra_102.info->tx_sectors);
-            d->rra_102.info->num_beams = CPL_BSWAP (d->rra_102.info->num_beams);
-            d->rra_102.info->sample_rate = CPL_BSWAP (d->rra_102.info->sample_rate);
-            d->rra_102.info->rov_depth = CPL_BSWAP (d->rra_102.info->rov_depth);
-            d->rra_102.info->sound_speed = CPL_BSWAP (d->rra_102.info->sound_speed);
-            d->rra_102.info->max_beams = CPL_BSWAP (d->rra_102.info->max_beams);
+    if ((em_model_number >= 3002) && (em_model_number <= 3008)) {
+        if (sonar_head == 1) {
+            return s1[em_model_number - 3002];
+        }
+        if (sonar_head == 2) {
+            return s2[em_model_number - 3002];
+        }
+    }
 
-            for (i=0; i<d->rra_102.info->tx_sectors; i++) {
-                d->rra_102.tx_beam[i].tx_tilt_angle = CPL_BSWAP (d->rra_102.tx_beam[i].tx_tilt_angle);
-                d->rra_102.tx_beam[i].focus_range = CPL_BSWAP (d->rra_102.tx_beam[i].focus_range);
-                d->rra_102.tx_beam[i].signal_length = CPL_BSWAP (d->rra_102.tx_beam[i].signal_length);
-                d->rra_102.tx_beam[i].tx_offset = CPL_BSWAP (d->rra_102.tx_beam[i].tx_offset);
-                d->rra_102.tx_beam[i].center_freq = CPL_BSWAP (d->rra_102.tx_beam[i].center_freq);
-                d->rra_102.tx_beam[i].signal_bandwidth = CPL_BSWAP (d->rra_102.tx_beam[i].signal_bandwidth);
-            }
+    return 0;
+}
 
-            for (i=0; i<d->rra_102.info->num_beams; i++) {
-                d->rra_102.rx_beam[i].rx_beam_angle = CPL_BSWAP (d->rra_102.rx_beam[i].rx_beam_angle);
-                d->rra_102.rx_beam[i].range = CPL_BSWAP (d->rra_102.rx_beam[i].range);
-                d->rra_102.rx_beam[i].beam_number = CPL_BSWAP (d->rra_102.rx_beam[i].beam_number);
-            }
 
-            break;
+/******************************************************************************
+*
+* emx_get_datagram_name - Return a character string of the name of the datagram
+*   given by DATAGRAM_TYPE.  This string should not be modified by the caller.
+*
+******************************************************************************/
 
-        case EMX_DATAGRAM_RRA_78 :
+const char * emx_get_datagram_name (
+    const uint8_t datagram_type) {
 
-            d->rra_78.info->sound_speed = CPL_BSWAP (d->rra_78.info->sound_speed);
-            d->rra_78.info->tx_sectors = CPL_BSWAP (d->rra_78.info->tx_sectors);
-            d->rra_78.info->num_beams = CPL_BSWAP (d->rra_78.info->num_beams);
-            d->rra_78.info->valid_beams = CPL_BSWAP (d->rra_78.info->valid_beams);
-            d->rra_78.info->sample_rate = CPL_BSWAPF (d->rra_78.info->sample_rate);
-            d->rra_78.info->dscale = CPL_BSWAP (d->rra_78.info->dscale);
+    const char *s;
 
-            for (i=0; i<d->rra_78.info->tx_sectors; i++) {
-                d->rra_78.tx_beam[i].tx_tilt_angle = CPL_BSWAP (d->rra_78.tx_beam[i].tx_tilt_angle);
-                d->rra_78.tx_beam[i].focus_range = CPL_BSWAP (d->rra_78.tx_beam[i].focus_range);
-                d->rra_78.tx_beam[i].signal_length = CPL_BSWAPF (d->rra_78.tx_beam[i].signal_length);
-                d->rra_78.tx_beam[i].sector_tx_delay = CPL_BSWAPF (d->rra_78.tx_beam[i].sector_tx_delay);
-                d->rra_78.tx_beam[i].center_freq = CPL_BSWAPF (d->rra_78.tx_beam[i].center_freq);
-                d->rra_78.tx_beam[i].mean_absorption = CPL_BSWAP (d->rra_78.tx_beam[i].mean_absorption);
-                d->rra_78.tx_beam[i].signal_bandwidth = CPL_BSWAPF (d->rra_78.tx_beam[i].signal_bandwidth);
-            }
 
-            for (i=0; i<d->rra_78.info->num_beams; i++) {
-                d->rra_78.rx_beam[i].rx_beam_angle = CPL_BSWAP (d->rra_78.rx_beam[i].rx_beam_angle);
-                d->rra_78.rx_beam[i].detect_window_length = CPL_BSWAP (d->rra_78.rx_beam[i].detect_window_length);
-                d->rra_78.rx_beam[i].two_way_travel_time = CPL_BSWAPF (d->rra_78.rx_beam[i].two_way_travel_time);
-                d->rra_78.rx_beam[i].backscatter = CPL_BSWAP (d->rra_78.rx_beam[i].backscatter);
-            }
+    switch (datagram_type) {
 
-            break;
+        case EMX_DATAGRAM_DEPTH                 : s = "EMX_DATAGRAM_DEPTH";                 break;
+        case EMX_DATAGRAM_DEPTH_NOMINAL         : s = "EMX_DATAGRAM_DEPTH_NOMINAL";         break;
+        case EMX_DATAGRAM_XYZ                   : s = "EMX_DATAGRAM_XYZ";                   break;
+        case EMX_DATAGRAM_EXTRA_DETECTIONS      : s = "EMX_DATAGRAM_EXTRA_DETECTIONS";      break;
+        case EMX_DATAGRAM_CENTRAL_BEAMS         : s = "EMX_DATAGRAM_CENTRAL_BEAMS";         break;
+        case EMX_DATAGRAM_RRA_101               : s = "EMX_DATAGRAM_RRA_101";               break;
+        case EMX_DATAGRAM_RRA_70                : s = "EMX_DATAGRAM_RRA_70";                break;
+        case EMX_DATAGRAM_RRA_102               : s = "EMX_DATAGRAM_RRA_102";               break;
+        case EMX_DATAGRAM_RRA_78                : s = "EMX_DATAGRAM_RRA_78";                break;
+        case EMX_DATAGRAM_SEABED_IMAGE_83       : s = "EMX_DATAGRAM_SEABED_IMAGE_83";       break;
+        case EMX_DATAGRAM_SEABED_IMAGE_89       : s = "EMX_DATAGRAM_SEABED_IMAGE_89";       break;
+        case EMX_DATAGRAM_WATER_COLUMN          : s = "EMX_DATAGRAM_WATER_COLUMN";          break;
+        case EMX_DATAGRAM_QUALITY_FACTOR        : s = "EMX_DATAGRAM_QUALITY_FACTOR";        break;
+        case EMX_DATAGRAM_ATTITUDE              : s = "EMX_DATAGRAM_ATTITUDE";              break;
+        case EMX_DATAGRAM_ATTITUDE_NETWORK      : s = "EMX_DATAGRAM_ATTITUDE_NETWORK";      break;
+        case EMX_DATAGRAM_CLOCK                 : s = "EMX_DATAGRAM_CLOCK";                 break;
+        case EMX_DATAGRAM_HEIGHT                : s = "EMX_DATAGRAM_HEIGHT";                break;
+        case EMX_DATAGRAM_HEADING               : s = "EMX_DATAGRAM_HEADING";               break;
+        case EMX_DATAGRAM_POSITION              : s = "EMX_DATAGRAM_POSITION";              break;
+        case EMX_DATAGRAM_SINGLE_BEAM_DEPTH     : s = "EMX_DATAGRAM_SINGLE_BEAM_DEPTH";     break;
+        case EMX_DATAGRAM_TIDE                  : s = "EMX_DATAGRAM_TIDE";                  break;
+        case EMX_DATAGRAM_SSSV                  : s = "EMX_DATAGRAM_SSSV";                  break;
+        case EMX_DATAGRAM_SVP                   : s = "EMX_DATAGRAM_SVP";                   break;
+        case EMX_DATAGRAM_SVP_EM3000            : s = "EMX_DATAGRAM_SVP_EM3000";            break;
+        case EMX_DATAGRAM_KM_SSP_OUTPUT         : s = "EMX_DATAGRAM_KM_SSP_OUTPUT";         break;
+        case EMX_DATAGRAM_INSTALL_PARAMS        : s = "EMX_DATAGRAM_INSTALL_PARAMS";        break;
+        case EMX_DATAGRAM_INSTALL_PARAMS_STOP   : s = "EMX_DATAGRAM_INSTALL_PARAMS_STOP";   break;
+        case EMX_DATAGRAM_INSTALL_PARAMS_REMOTE : s = "EMX_DATAGRAM_INSTALL_PARAMS_REMOTE"; break;
+        case EMX_DATAGRAM_REMOTE_PARAMS_INFO    : s = "EMX_DATAGRAM_REMOTE_PARAMS_INFO";    break;
+        case EMX_DATAGRAM_RUNTIME_PARAMS        : s = "EMX_DATAGRAM_RUNTIME_PARAMS";        break;
+        case EMX_DATAGRAM_EXTRA_PARAMS          : s = "EMX_DATAGRAM_EXTRA_PARAMS";          break;
+        case EMX_DATAGRAM_PU_OUTPUT             : s = "EMX_DATAGRAM_PU_OUTPUT";             break;
+        case EMX_DATAGRAM_PU_STATUS             : s = "EMX_DATAGRAM_PU_STATUS";             break;
+        case EMX_DATAGRAM_PU_BIST_RESULT        : s = "EMX_DATAGRAM_PU_BIST_RESULT";        break;
+        case EMX_DATAGRAM_TRANSDUCER_TILT       : s = "EMX_DATAGRAM_TRANSDUCER_TILT";       break;
+        case EMX_DATAGRAM_SYSTEM_STATUS         : s = "EMX_DATAGRAM_SYSTEM_STATUS";         break;
+        case EMX_DATAGRAM_STAVE                 : s = "EMX_DATAGRAM_STAVE";                 break;
+        case EMX_DATAGRAM_HISAS_STATUS          : s = "EMX_DATAGRAM_HISAS_STATUS";          break;
+        case EMX_DATAGRAM_NAVIGATION_OUTPUT     : s = "EMX_DATAGRAM_NAVIGATION_OUTPUT";     break;
+        case EMX_DATAGRAM_SIDESCAN_STATUS       : s = "EMX_DATAGRAM_SIDESCAN_STATUS";       break;
+        case EMX_DATAGRAM_HISAS_1032_SIDESCAN   : s = "EMX_DATAGRAM_HISAS_1032_SIDESCAN";   break;
+        case EMX_DATAGRAM_RRA_123               : s = "EMX_DATAGRAM_RRA_123";               break;
+        default                                 : s = "UNKNOWN";                            break;
+    }
+
+    return s;
+}
 
-        case EMX_DATAGRAM_SEABED_IMAGE_83 :
 
-            d->seabed_83.info->mean_abs_coef = CPL_BSWAP (d->seabed_83.info->mean_abs_coef);
-            d->seabed_83.info->pulse_length = CPL_BSWAP (d->seabed_83.info->pulse_length);
-            d->seabed_83.info->range_norm = CPL_BSWAP (d->seabed_83.info->range_norm);
-            d->seabed_83.info->start_range = CPL_BSWAP (d->seabed_83.info->start_range);
-            d->seabed_83.info->stop_range = CPL_BSWAP (d->seabed_83.info->stop_range);
-            d->seabed_83.info->tx_beamwidth = CPL_BSWAP (d->seabed_83.info->tx_beamwidth);
+/******************************************************************************
+*
+* emx_relocate - Change the pointers of the datagram D into the datagram body
+*   SRC of SIZE bytes to the same offsets into the copy of the body DST.  The
+*   datagram structs also contain values that are not pointers, so only the
+*   pointers set by emx_read() for the datagram type are relocated.
+*
+******************************************************************************/
 
-            for (i=0; i<d->seabed_83.info->num_beams; i++) {
-                d->seabed_83.beam[i].num_samples = CPL_BSWAP (d->seabed_83.beam[i].num_samples);
-                d->seabed_83.beam[i].detect_sample = CPL_BSWAP (d->seabed_83.beam[i].detect_sample);
-            }
+static void emx_relocate (
+    emx_data *d,
+    const char *src,
+    const size_t size,
+    char *dst) {
 
-            break;
+    emx_datagram *g;
+    int i;
 
-        case EMX_DATAGRAM_SEABED_IMAGE_89 :
 
-            d->seabed_89.info->sample_rate = CPL_BSWAPF (d->seabed_89.info->sample_rate);
-            d->seabed_89.info->range_norm = CPL_BSWAP (d->seabed_89.info->range_norm);
-            d->seabed_89.info->normal_incidence_bs = CPL_BSWAP (d->seabed_89.info->normal_incidence_bs);
-            d->seabed_89.info->oblique_bs = CPL_BSWAP (d->seabed_89.info->oblique_bs);
-            d->seabed_89.info->tx_beamwidth = CPL_BSWAP (d->seabed_89.info->tx_beamwidth);
-            d->seabed_89.info->tvg_cross_over = CPL_BSWAP (d->seabed_89.info->tvg_cross_over);
-            d->seabed_89.info->num_beams = CPL_BSWAP (d->seabed_89.info->num_beams);
+    assert (d);
+    assert (src);
+    assert (dst);
 
-            num_samples = 0;
-            for (i=0; i<d->seabed_89.info->num_beams; i++) {
-                d->seabed_89.beam[i].num_samples = CPL_BSWAP (d->seabed_89.beam[i].num_samples);
-                d->seabed_89.beam[i].detect_sample = CPL_BSWAP (d->seabed_89.beam[i].detect_sample);
-                num_samples += d->seabed_89.beam[i].num_samples;
-            }
+    g = &(d->datagram);
 
-            for (i=0; i<num_samples; i++) {
-                d->seabed_89.amplitude[i] = CPL_BSWAP (d->seabed_89.amplitude[i]);
-            }
+    switch (d->header.datagram_type) {
 
+        case EMX_DATAGRAM_DEPTH :
+            EMX_RELOCATE (g->depth.info);
+            EMX_RELOCATE (g->depth.beam);
             break;
 
-        case EMX_DATAGRAM_WATER_COLUMN :
-
-            d->wc.info->num_datagrams = CPL_BSWAP (d->wc.info->num_datagrams);
-            d->wc.info->datagram_number = CPL_BSWAP (d->wc.info->datagram_number);
-            d->wc.info->tx_sectors = CPL_BSWAP (d->wc.info->tx_sectors);
-            d->wc.info->num_beams = CPL_BSWAP (d->wc.info->num_beams);
-            d->wc.info->datagram_beams = CPL_BSWAP (d->wc.info->datagram_beams);
-            d->wc.info->sound_speed = CPL_BSWAP (d->wc.info->sound_speed);
-            d->wc.info->sample_rate = CPL_BSWAP (d->wc.info->sample_rate);
-            d->wc.info->tx_heave = CPL_BSWAP (d->wc.info->tx_heave);
+        case EMX_DATAGRAM_DEPTH_NOMINAL :
+            EMX_RELOCATE (g->depth_nominal.info);
+            EMX_RELOCATE (g->depth_nominal.beam);
+            break;
 
-            for (i=0; i<d->wc.info->tx_sectors; i++) {
-                d->wc.txbeam[i].tx_tilt_angle = CPL_BSWAP (d->wc.txbeam[i].tx_tilt_angle);
-                d->wc.txbeam[i].center_freq = CPL_BSWAP (d->wc.txbeam[i].center_freq);
-            }
+        case EMX_DATAGRAM_XYZ :
+            EMX_RELOCATE (g->xyz.info);
+            EMX_RELOCATE (g->xyz.beam);
+            break;
 
-            {
-                emx_datagram_wc_rx_beam wc_rx_beam;
-                const uint8_t *p = d->wc.beamData;
+        case EMX_DATAGRAM_EXTRA_DETECTIONS :
+            EMX_RELOCATE (g->extra_detect.info);
+            EMX_RELOCATE (g->extra_detect.classes);
+            EMX_RELOCATE (g->extra_detect.data);
+            EMX_RELOCATE (g->extra_detect.raw_amplitude);
+            break;
 
-                for (i=0; i<d->wc.info->datagram_beams; i++) {
+        case EMX_DATAGRAM_CENTRAL_BEAMS :
+            EMX_RELOCATE (g->central_beams.info);
+            EMX_RELOCATE (g->central_beams.beam);
+            EMX_RELOCATE (g->central_beams.amplitude);
+            break;
 
-                    emx_datagram_wc_rx_beam_info *wc_rx_info = (emx_datagram_wc_rx_beam_info *) p;
+        case EMX_DATAGRAM_RRA_101 :
+            EMX_RELOCATE (g->rra_101.info);
+            EMX_RELOCATE (g->rra_101.tx_beam);
+            EMX_RELOCATE (g->rra_101.rx_beam);
+            break;
 
-                    /* We arrange the code this way to swap num_samples before calling emx_get_wc_rxbeam. */
-                    wc_rx_info->beam_angle = CPL_BSWAP (wc_rx_info->beam_angle);
-                    wc_rx_info->detected_range = CPL_BSWAP (wc_rx_info->detected_range);
-                    wc_rx_info->num_samples = CPL_BSWAP (wc_rx_info->num_samples);
-                    wc_rx_info->start_range = CPL_BSWAP (wc_rx_info->start_range);
+        case EMX_DATAGRAM_RRA_70 :
+            EMX_RELOCATE (g->rra_70.info);
+            EMX_RELOCATE (g->rra_70.beam);
+            break;
 
-                    p = emx_get_wc_rxbeam (&wc_rx_beam, p);
-                }
-            }
+        case EMX_DATAGRAM_RRA_102 :
+            EMX_RELOCATE (g->rra_102.info);
+            EMX_RELOCATE (g->rra_102.tx_beam);
+            EMX_RELOCATE (g->rra_102.rx_beam);
+            break;
 
+        case EMX_DATAGRAM_RRA_78 :
+            EMX_RELOCATE (g->rra_78.info);
+            EMX_RELOCATE (g->rra_78.tx_beam);
+            EMX_RELOCATE (g->rra_78.rx_beam);
             break;
 
-        case EMX_DATAGRAM_QUALITY_FACTOR :
+        case EMX_DATAGRAM_SEABED_IMAGE_83 :
+            EMX_RELOCATE (g->seabed_83.info);
+            EMX_RELOCATE (g->seabed_83.beam);
+            EMX_RELOCATE (g->seabed_83.amplitude);
+            break;
 
-            d->qf.info->num_beams = CPL_BSWAP (d->qf.info->num_beams);
+        case EMX_DATAGRAM_SEABED_IMAGE_89 :
+            EMX_RELOCATE (g->seabed_89.info);
+            EMX_RELOCATE (g->seabed_89.beam);
+            EMX_RELOCATE (g->seabed_89.amplitude);
+            break;
 
-            for (i=0; i<d->qf.info->num_beams; i++) {
-                d->qf.data[i] = CPL_BSWAPF (d->qf.data[i]);
-            }
+        case EMX_DATAGRAM_WATER_COLUMN :
+            EMX_RELOCATE (g->wc.info);
+            EMX_RELOCATE (g->wc.txbeam);
+            EMX_RELOCATE (g->wc.beamData);
+            break;
 
+        case EMX_DATAGRAM_QUALITY_FACTOR :
+            EMX_RELOCATE (g->qf.info);
+            EMX_RELOCATE (g->qf.data);
             break;
 
         case EMX_DATAGRAM_ATTITUDE :
-
-            d->attitude.info->num_entries = CPL_BSWAP (d->attitude.info->num_entries);
-
-            for (i=0; i<d->attitude.info->num_entries; i++) {
-                d->attitude.data[i].record_time = CPL_BSWAP (d->attitude.data[i].record_time);
-                d->attitude.data[i].status = CPL_BSWAP (d->attitude.data[i].status);
-                d->attitude.data[i].roll = CPL_BSWAP (d->attitude.data[i].roll);
-                d->attitude.data[i].pitch = CPL_BSWAP (d->attitude.data[i].pitch);
-                d->attitude.data[i].heave = CPL_BSWAP (d->attitude.data[i].heave);
-                d->attitude.data[i].heading = CPL_BSWAP (d->attitude.data[i].heading);
-            }
-
+            EMX_RELOCATE (g->attitude.info);
+            EMX_RELOCATE (g->attitude.data);
             break;
 
         case EMX_DATAGRAM_ATTITUDE_NETWORK :
-
-            d->attitude_network.info->num_entries = CPL_BSWAP (d->attitude_network.info->num_entries);
-
-            {
-                emx_datagram_attitude_network_data attitude_data;
-                const uint8_t *p = d->attitude_network.data;
-
-                for (i=0; i<d->attitude_network.info->num_entries; i++) {
-
-                    p = emx_get_attitude_network_data (&attitude_data, p);
-
-                    attitude_data.info->record_time = CPL_BSWAP (attitude_data.info->record_time);
-                    attitude_data.info->roll = CPL_BSWAP (attitude_data.info->roll);
-                    attitude_data.info->pitch = CPL_BSWAP (attitude_data.info->pitch);
-                    attitude_data.info->heave = CPL_BSWAP (attitude_data.info->heave);
-                    attitude_data.info->heading = CPL_BSWAP (attitude_data.info->heading);
-                }
-            }
-
+            EMX_RELOCATE (g->attitude_network.info);
+            EMX_RELOCATE (g->attitude_network.data);
             break;
 
         case EMX_DATAGRAM_CLOCK :
-
-            d->clock.info->date = CPL_BSWAP (d->clock.info->date);
-            d->clock.info->time_ms = CPL_BSWAP (d->clock.info->time_ms);
-
+            EMX_RELOCATE (g->clock.info);
             break;
 
         case EMX_DATAGRAM_HEIGHT :
-
-            d->height.info->height = CPL_BSWAP (d->height.info->height);
-
+            EMX_RELOCATE (g->height.info);
             break;
 
         case EMX_DATAGRAM_HEADING :
-
-            d->heading.info->num_entries = CPL_BSWAP (d->heading.info->num_entries);
-
-            for (i=0; i<d->heading.info->num_entries; i++) {
-                d->heading.data[i].record_time = CPL_BSWAP (d->heading.data[i].record_time);
-                d->heading.data[i].heading = CPL_BSWAP (d->heading.data[i].heading);
-            }
-
+            EMX_RELOCATE (g->heading.info);
+            EMX_RELOCATE (g->heading.data);
             break;
 
         case EMX_DATAGRAM_POSITION :
-
-            d->position.info->latitude = CPL_BSWAP (d->position.info->latitude);
-            d->position.info->longitude = CPL_BSWAP (d->position.info->longitude);
-            d->position.info->position_fix_quality = CPL_BSWAP (d->position.info->position_fix_quality);
-            d->position.info->vessel_speed = CPL_BSWAP (d->position.info->vessel_speed);
-            d->position.info->vessel_course = CPL_BSWAP (d->position.info->vessel_course);
-            d->position.info->vessel_heading = CPL_BSWAP (d->position.info->vessel_heading);
-
+            EMX_RELOCATE (g->position.info);
+            EMX_RELOCATE (g->position.message);
             break;
 
         case EMX_DATAGRAM_SINGLE_BEAM_DEPTH :
-
-            d->sb_depth.info->date = CPL_BSWAP (d->sb_depth.info->date);
-            d->sb_depth.info->time_ms = CPL_BSWAP (d->sb_depth.info->time_ms);
-            d->sb_depth.info->depth = CPL_BSWAP (d->sb_depth.info->depth);
-
+            EMX_RELOCATE (g->sb_depth.info);
             break;
 
         case EMX_DATAGRAM_TIDE :
-
-            d->tide.info->date = CPL_BSWAP (d->tide.info->date);
-            d->tide.info->time_ms = CPL_BSWAP (d->tide.info->time_ms);
-            d->tide.info->tide_offset = CPL_BSWAP (d->tide.info->tide_offset);
-
+            EMX_RELOCATE (g->tide.info);
             break;
 
         case EMX_DATAGRAM_SSSV :
-
-            d->sssv.info->num_samples = CPL_BSWAP (d->sssv.info->num_samples);
-
-            for (i=0; i<d->sssv.info->num_samples; i++) {
-                d->sssv.data[i].record_time = CPL_BSWAP (d->sssv.data[i].record_time);
-                d->sssv.data[i].sound_speed = CPL_BSWAP (d->sssv.data[i].sound_speed);
-            }
-
+            EMX_RELOCATE (g->sssv.info);
+            EMX_RELOCATE (g->sssv.data);
             break;
 
         case EMX_DATAGRAM_SVP :
-
-            d->svp.info->date = CPL_BSWAP (d->svp.info->date);
-            d->svp.info->time_ms = CPL_BSWAP (d->svp.info->time_ms);
-            d->svp.info->num_samples = CPL_BSWAP (d->svp.info->num_samples);
-            d->svp.info->depth_resolution = CPL_BSWAP (d->svp.info->depth_resolution);
-
-            for (i=0; i<d->svp.info->num_samples; i++) {
-                d->svp.data[i].depth = CPL_BSWAP (d->svp.data[i].depth);
-                d->svp.data[i].sound_speed = CPL_BSWAP (d->svp.data[i].sound_speed);
-            }
-
+            EMX_RELOCATE (g->svp.info);
+            EMX_RELOCATE (g->svp.data);
             break;
 
         case EMX_DATAGRAM_SVP_EM3000 :
-
-            d->svp_em3000.info->date = CPL_BSWAP (d->svp_em3000.info->date);
-            d->svp_em3000.info->time_ms = CPL_BSWAP (d->svp_em3000.info->time_ms);
-            d->svp_em3000.info->num_samples = CPL_BSWAP (d->svp_em3000.info->num_samples);
-            d->svp_em3000.info->depth_resolution = CPL_BSWAP (d->svp_em3000.info->depth_resolution);
-
-            for (i=0; i<d->svp_em3000.info->num_samples; i++) {
-                d->svp_em3000.data[i].depth = CPL_BSWAP (d->svp_em3000.data[i].depth);
-                d->svp_em3000.data[i].sound_speed = CPL_BSWAP (d->svp_em3000.data[i].sound_speed);
-            }
-
+            EMX_RELOCATE (g->svp_em3000.info);
+            EMX_RELOCATE (g->svp_em3000.data);
             break;
 
         case EMX_DATAGRAM_KM_SSP_OUTPUT :
-
+            EMX_RELOCATE (g->ssp_output.data);
             break;
 
         case EMX_DATAGRAM_INSTALL_PARAMS :
-
-            d->install_params.info->serial_number2 = CPL_BSWAP (d->install_params.info->serial_number2);
-
+            EMX_RELOCATE (g->install_params.info);
+            EMX_RELOCATE (g->install_params.text);
             break;
 
         case EMX_DATAGRAM_INSTALL_PARAMS_STOP :
-
-            d->install_params_stop.info->serial_number2 = CPL_BSWAP (d->install_params_stop.info->serial_number2);
-
+            EMX_RELOCATE (g->install_params_stop.info);
+            EMX_RELOCATE (g->install_params_stop.text);
             break;
 
         case EMX_DATAGRAM_INSTALL_PARAMS_REMOTE :
-
-            d->install_params_remote.info->serial_number2 = CPL_BSWAP (d->install_params_remote.info->serial_number2);
-
-            break;
-
-        case EMX_DATAGRAM_REMOTE_PARAMS_INFO :
-
+            EMX_RELOCATE (g->install_params_remote.info);
+            EMX_RELOCATE (g->install_params_remote.text);
             break;
 
         case EMX_DATAGRAM_RUNTIME_PARAMS :
-
-            d->runtime_params.info->min_depth = CPL_BSWAP (d->runtime_params.info->min_depth);
-            d->runtime_params.info->max_depth = CPL_BSWAP (d->runtime_params.info->max_depth);
-            d->runtime_params.info->absorption = CPL_BSWAP (d->runtime_params.info->absorption);
-            d->runtime_params.info->tx_pulse_length = CPL_BSWAP (d->runtime_params.info->tx_pulse_length);
-            d->runtime_params.info->tx_beamwidth = CPL_BSWAP (d->runtime_params.info->tx_beamwidth);
-            d->runtime_params.info->max_port_swath = CPL_BSWAP (d->runtime_params.info->max_port_swath);
-            d->runtime_params.info->max_stbd_swath = CPL_BSWAP (d->runtime_params.info->max_stbd_swath);
-            d->runtime_params.info->tx_along_tilt = CPL_BSWAP (d->runtime_params.info->tx_along_tilt);
-
+            EMX_RELOCATE (g->runtime_params.info);
             break;
 
         case EMX_DATAGRAM_EXTRA_PARAMS :
-
-            d->extra_params.info->content = CPL_BSWAP (d->extra_params.info->content);
-
-            switch (d->extra_params.info->content) {
-
-                /* TODO: Add content 1-5 here. */
-
-                case 6 :
-                    d->extra_params.data.bs_corr.num_chars = CPL_BSWAP (d->extra_params.data.bs_corr.num_chars);
-                    break;
-
-                default : break;
-            }
-
+            EMX_RELOCATE (g->extra_params.info);
+            EMX_RELOCATE (g->extra_params.data.bs_corr.text);
             break;
 
         case EMX_DATAGRAM_PU_OUTPUT :
+            EMX_RELOCATE (g->pu_output.info);
+            break;
 
-            d->pu_output.info->udp_port1 = CPL_BSWAP (d->pu_output.info->udp_port1);
-            d->pu_output.info->udp_port2 = CPL_BSWAP (d->pu_output.info->udp_port2);
-            d->pu_output.info->udp_port3 = CPL_BSWAP (d->pu_output.info->udp_port3);
-            d->pu_output.info->udp_port4 = CPL_BSWAP (d->pu_output.info->udp_port4);
-            d->pu_output.info->system_descriptor = CPL_BSWAP (d->pu_output.info->system_descriptor);
-            d->pu_output.info->host_ip_address = CPL_BSWAP (d->pu_output.info->host_ip_address);
+        case EMX_DATAGRAM_PU_STATUS :
+            EMX_RELOCATE (g->pu_status.info);
+            break;
 
+        case EMX_DATAGRAM_PU_BIST_RESULT :
+            EMX_RELOCATE (g->pu_bist_result.info);
+            EMX_RELOCATE (g->pu_bist_result.text);
             break;
 
-        case EMX_DATAGRAM_PU_STATUS :
+        case EMX_DATAGRAM_TRANSDUCER_TILT :
+            EMX_RELOCATE (g->tilt.info);
+            EMX_RELOCATE (g->tilt.data);
+            break;
 
-            d->pu_status.info->ping_rate = CPL_BSWAP (d->pu_status.info->ping_rate);
-            d->pu_status.info->ping_counter = CPL_BSWAP (d->pu_status.info->ping_counter);
-            d->pu_status.info->swath_distance = CPL_BSWAP (d->pu_status.info->swath_distance);
-            d->pu_status.info->status_udp_port_2 = CPL_BSWAP (d->pu_status.info->status_udp_port_2);
-            d->pu_status.info->status_serial_port_1 = CPL_BSWAP (d->pu_status.info->status_serial_port_1);
-            d->pu_status.info->status_serial_port_2 = CPL_BSWAP (d->pu_status.info->status_serial_port_2);
-            d->pu_status.info->status_serial_port_3 = CPL_BSWAP (d->pu_status.info->status_serial_port_3);
-            d->pu_status.info->status_serial_port_4 = CPL_BSWAP (d->pu_status.info->status_serial_port_4);
-            d->pu_status.info->heading = CPL_BSWAP (d->pu_status.info->heading);
-            d->pu_status.info->roll = CPL_BSWAP (d->pu_status.info->roll);
-            d->pu_status.info->pitch = CPL_BSWAP (d->pu_status.info->pitch);
-            d->pu_status.info->heave = CPL_BSWAP (d->pu_status.info->heave);
-            d->pu_status.info->sound_speed = CPL_BSWAP (d->pu_status.info->sound_speed);
-            d->pu_status.info->depth = CPL_BSWAP (d->pu_status.info->depth);
-            d->pu_status.info->velocity = CPL_BSWAP (d->pu_status.info->velocity);
-            d->pu_status.info->range_normal = CPL_BSWAP (d->pu_status.info->range_normal);
-            d->pu_status.info->sound_speed_svp = CPL_BSWAP (d->pu_status.info->sound_speed_svp);
-            d->pu_status.info->yaw_stabilization = CPL_BSWAP (d->pu_status.info->yaw_stabilization);
-            d->pu_status.info->port_coverage2 = CPL_BSWAP (d->pu_status.info->port_coverage2);
-            d->pu_status.info->stbd_coverage2 = CPL_BSWAP (d->pu_status.info->stbd_coverage2);
+        case EMX_DATAGRAM_HISAS_STATUS :
+            EMX_RELOCATE (g->hisas_status.info);
+            break;
 
+        case EMX_DATAGRAM_SIDESCAN_STATUS :
+            EMX_RELOCATE (g->sidescan_status.info);
             break;
 
-        case EMX_DATAGRAM_PU_BIST_RESULT :
+        case EMX_DATAGRAM_HISAS_1032_SIDESCAN :
+            EMX_RELOCATE (g->sidescan_data.info);
 
-            d->pu_bist_result.info->test_number = CPL_BSWAP (d->pu_bist_result.info->test_number);
-            d->pu_bist_result.info->test_result_status = CPL_BSWAP (d->pu_bist_result.info->test_result_status);
+            /* Channels that are not in the datagram keep pointers that are not relocated. */
+            for (i=0; i<6; i++) {
+                EMX_RELOCATE (g->sidescan_data.channel[i].info);
+                EMX_RELOCATE (g->sidescan_data.channel[i].data.ptr);
+            }
 
             break;
 
-        case EMX_DATAGRAM_TRANSDUCER_TILT :
+        case EMX_DATAGRAM_NAVIGATION_OUTPUT :
+            EMX_RELOCATE (g->navigation_output.info);
+            break;
 
-            d->tilt.info->num_entries = CPL_BSWAP (d->tilt.info->num_entries);
+        default :
+            break;
+    }
+}
 
-            for (i=0; i<d->tilt.info->num_entries; i++) {
-                d->tilt.data[i].record_time = CPL_BSWAP (d->tilt.data[i].record_time);
-                d->tilt.data[i].tilt = CPL_BSWAP (d->tilt.data[i].tilt);
-            }
 
-            break;
+/******************************************************************************
+*
+* emx_relocate_ptr - Relocate the pointer PTR into the datagram body SRC of SIZE
+*   bytes to the same offset into the copy of the body DST.
+*
+* Return: The relocated pointer, or
+*         PTR if it does not point into SRC.
+*
+******************************************************************************/
 
-        case EMX_DATAGRAM_SYSTEM_STATUS :
+static void * emx_relocate_ptr (
+    const void *ptr,
+    const char *src,
+    const size_t size,
+    char *dst) {
 
-            /* TODO: */
+    const char *p = (const char *) ptr;
 
-            break;
 
-        case EMX_DATAGRAM_HISAS_STATUS        : CPL_ATTRIBUTE_FALLTHROUGH;
-        case EMX_DATAGRAM_NAVIGATION_OUTPUT   : CPL_ATTRIBUTE_FALLTHROUGH;
-        case EMX_DATAGRAM_SIDESCAN_STATUS     : CPL_ATTRIBUTE_FALLTHROUGH;
-        case EMX_DATAGRAM_HISAS_1032_SIDESCAN : CPL_ATTRIBUTE_FALLTHROUGH;
-        case EMX_DATAGRAM_RRA_123             :  /* No byte swapping on HISAS datagrams. */
-            break;
+    assert (src);
+    assert (dst);
 
-        default : break;
+    if (p && (p >= src) && (p <= src + size)) {
+        return dst + (p - src);
     }
+
+    return (void *) ptr;
 }
 
 
 /******************************************************************************
 *
-* emx_valid_checksum - Return non-zero if the datagram check sum is valid and
-*   the end byte (ETX) is valid.  The checksum is a simple sum of the bytes
-*   between the STX and ETX bytes.
+* emx_count_datagram - Add the datagram returned by the file handle H to the
+*   read statistics, and call the trace function if set.  If timing is enabled,
+*   then START is the clock time when the read started and PARSE_TIME is the
+*   time spent verifying and parsing the datagram, and the rest of the time is
+*   counted as I/O.
 *
 ******************************************************************************/
 
-static int emx_valid_checksum (
-    const emx_datagram_header *header,
-    const char *buffer,
-    const int swap) {
-
-    const uint8_t *p;
-    uint16_t chksum_file;
-    uint16_t chksum;
-    size_t i, n;
+static void emx_count_datagram (
+    emx_handle *h,
+    const uint64_t start,
+    const uint64_t parse_time) {
 
+    uint64_t io_time = 0;
+    uint64_t size;
+    uint8_t type;
 
-    assert (header);
-    assert (buffer);
 
-    /* Calculate the number of bytes between STX and the end of the datagram.
-       emx_valid_header has already verified that bytes_in_datagram is >= 16. */
-    n = header->bytes_in_datagram - 16;
+    assert (h);
 
-    /* Make sure we have an End-of-Text (ETX) character. */
-    if (n < 3) return 0;
+    size = (uint64_t) h->d.header.bytes_in_datagram + sizeof (uint32_t);
+    type = h->d.header.datagram_type;
 
-    p = (const uint8_t *) buffer;
+    h->stats.num_datagrams++;
+    h->stats.num_bytes += size;
+    h->stats.count[type]++;
+    h->stats.bytes[type] += size;
 
-    /* Have found some data with end byte set to zero, so allow this also. */
-    if ((p[n-3] != EMX_END_BYTE) && (p[n-3] != 0)) {
-        cpl_debug (emx_debug, "Missing ETX end byte (%u, counter=%u, datagram_type=%u)\n", p[n-3], header->counter, header->datagram_type);
-        return 0;
+    if (h->timing) {
+        io_time = cpl_clock_ns () - start - parse_time;
+        h->stats.io_time += io_time;
+        h->stats.parse_time += parse_time;
     }
 
-    /* Extract the checksum from the datagram. */
-    if (swap) {
-        chksum_file = p[n-2];
-        chksum_file = p[n-1] + 256 * chksum_file;
-    } else {
-        chksum_file = p[n-1];
-        chksum_file = p[n-2] + 256 * chksum_file;
-    }
+    if (h->trace) h->trace (h, &(h->d), io_time, parse_time, h->trace_data);
+}
+
+
+/******************************************************************************
+*
+* emx_prefetch_read - Return the next datagram read ahead by the I/O thread of
+*   the file handle H, and start the I/O thread at the current file position if
+*   it is not running.  The buffer of the previous datagram is given back to the
+*   I/O thread, and the datagram is copied to the handle so that emx_retain(),
+*   emx_verify_checksum(), emx_get_array_data(), and the navigation store see
+*   it as if it were read directly.
+*
+* Return: A pointer to the data struct if the data was read successfully,
+*         NULL if no valid data was found or EOF was reached.
+*
+* Errors: Any error from emx_read()
+*
+******************************************************************************/
+
+static emx_data * emx_prefetch_read (
+    emx_handle *h) {
+
+    emx_prefetch *p;
+    emx_prefetch_slot *s;
+    int status;
+
 
-    /* Calculate the checksum of the header. */
-    p = &(header->datagram_type);
+    assert (h);
+    assert (h->prefetch);
+
+    p = h->prefetch;
+    h->body = NULL;
+    h->swap_pending = 0;
 
-    chksum = 0;
-    for (i=0; i<15; i++) {
-        chksum += p[i];
+    if (!p->running) {
+        status = emx_prefetch_start (h);
+        if (status != CS_ENONE) {
+            h->emx_errno = status;
+            return NULL;
+        }
     }
 
-    /* Now calculate the checksum of the rest of the datagram. */
-    p = (const uint8_t *) buffer;
+    /* The end of the data stays in the ring until read-ahead is restarted. */
+    if (p->last) {
+        if (!p->last->body) return NULL;
+        cpl_ring_push (p->free, p->last);
+        p->last = NULL;
+    }
 
-    for (i=0; i<n-3; i++) {
-        chksum += p[i];
+    s = (emx_prefetch_slot *) cpl_ring_pop (p->ready);
+    if (!s) {
+        p->stalls++;
+        s = (emx_prefetch_slot *) cpl_ring_wait (p->ready);
     }
 
-    /* If the checksum is zero, then skip the test. */
-    if ((chksum_file == 0) && (chksum != 0)) {
-        cpl_debug (emx_debug, "Missing or zero checksum (counter=%u, datagram_type=%u)\n", header->counter, header->datagram_type);
-        return 1;
+    assert (s);
+
+    p->last = s;
+    p->position = s->end;
+    h->resync_bytes = s->resync_bytes;
+    h->resync_count = s->resync_count;
+    h->io.bytes_read = s->bytes_read;
+    h->io.num_reads = s->num_reads;
+    h->io.num_seeks = s->num_seeks;
+    h->stats.checksum_failures = s->checksum_failures;
+
+    if (!s->body) {
+        if (s->status != CS_ENONE) h->emx_errno = s->status;
+        return NULL;
     }
 
-    /* Compare the checksum values and return the result. */
-    if (chksum != chksum_file) {
-        cpl_debug (emx_debug, "Checksum failure (chksum=%u, chksum_file=%u, counter=%u, datagram_type=%u)\n", chksum, chksum_file, header->counter, header->datagram_type);
-        return 0;
+    p->count++;
+    h->d = s->d;
+    h->body = s->body;
+    h->body_size = s->body_size;
+    h->checksum.valid = s->checksum_valid;
+    h->swap_pending = s->swap_pending;
+
+    /* Store the navigation samples in the order the datagrams are returned. */
+    if (h->nav) {
+        status = emx_add_nav (h);
+        if (status != CS_ENONE) {
+            h->emx_errno = status;
+            return NULL;
+        }
     }
 
-    return 1;
+    return &(h->d);
 }
 
 
 /******************************************************************************
 *
-* set_buffer_size - Set the internal allocated read buffer size given by the
-*   file handle H to at least SIZE bytes.
+* emx_prefetch_start - Start the I/O thread of the file handle H reading ahead
+*   at the current file position.  The I/O thread uses a copy of the handle, so
+*   that the file state is owned by one thread at a time, and all buffers are
+*   given to it.
 *
-* Return: Non-zero if memory allocation failed.
+* Return: 0 if read-ahead was started, or
+*         error condition if an error occurred.
 *
 * Errors: CS_ENOMEM
 *
 ******************************************************************************/
 
-static int set_buffer_size (
-    emx_handle *h,
-    const size_t size) {
+static int emx_prefetch_start (
+    emx_handle *h) {
+
+    emx_prefetch *p;
+    size_t i;
+
 
     assert (h);
+    assert (h->prefetch);
 
-    if (size > h->buffer_size) {
+    p = h->prefetch;
 
-        /* Allocate a new size of 1.5 * size bytes.  Use free/malloc instead of
-           realloc to avoid copying an empty buffer. */
-        h->buffer_size = size + (size + 1) / 2;
-        if (h->buffer) cpl_free (h->buffer);
+    assert (!p->running);
 
-        h->buffer = (char *) cpl_malloc (h->buffer_size);
-        if (!h->buffer) return CS_ENOMEM;
+    p->ready = cpl_ring_create (p->depth);
+    p->free = cpl_ring_create (p->depth);
+
+    if (!p->ready || !p->free) {
+        cpl_ring_destroy (p->ready);
+        cpl_ring_destroy (p->free);
+        p->ready = NULL;
+        p->free = NULL;
+        return CS_ENOMEM;
     }
 
-    return 0;
+    for (i=0; i<p->depth; i++) {
+        cpl_ring_push (p->free, &(p->slots[i]));
+    }
+
+    /* The checksum of the last datagram read directly is verified first. */
+    emx_wait_checksum (h);
+
+    /* The copy reads the file without storing navigation or retaining data.  A
+       checksum left for the worker thread is summed on the I/O thread instead. */
+    p->h = *h;
+    p->h.emx_errno = CS_ENONE;
+    p->h.worker = NULL;
+    if (p->h.checksum_mode == EMX_CHECKSUM_THREAD) p->h.checksum_mode = EMX_CHECKSUM_DEFERRED;
+    p->h.nav = NULL;
+    p->h.body = NULL;
+    p->h.retained = NULL;
+    p->h.released = NULL;
+    p->h.prefetch = NULL;
+    p->h.timing = 0;
+    p->h.trace = NULL;
+
+    p->last = NULL;
+    p->position = emx_tell (h);
+    p->running = 1;
+
+    cpl_worker_start (p->worker, emx_prefetch_task, p, 0);
+
+    return CS_ENONE;
 }
 
 
 /******************************************************************************
 *
-* emx_get_model - Return the system model number or return zero if the model
-*   number is unrecognized.
+* emx_prefetch_stop - Stop the I/O thread of the file handle H, if any, and move
+*   the file state back to the handle at the position after the last datagram
+*   returned by emx_read().  The datagrams read ahead are discarded, but the
+*   last datagram returned stays valid until the next read.
+*
+* Return: 0 if read-ahead was stopped or not running, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ESEEK
 *
 ******************************************************************************/
 
-int emx_get_model (
-    const uint16_t em_model_number) {
+static int emx_prefetch_stop (
+    emx_handle *h) {
 
-    int model;
+    emx_prefetch *p;
 
 
-    switch (em_model_number) {
-        case  120 : model = EM_MODEL_120;          break;
-        case  121 : model = EM_MODEL_121A;         break;
-        case  122 : model = EM_MODEL_122;          break;
-        case  124 : model = EM_MODEL_124;          break;
-        case  300 : model = EM_MODEL_300;          break;
-        case  302 : model = EM_MODEL_302;          break;
-        case  710 : model = EM_MODEL_710;          break;
-        case  712 : model = EM_MODEL_712;          break;
-        case  850 : model = EM_MODEL_ME70BO;       break;
-        case 1002 : model = EM_MODEL_1002;         break;
-        case 2000 : model = EM_MODEL_2000;         break;
-        case 2040 : model = EM_MODEL_2040;         break;
-        case 2045 : model = EM_MODEL_2040C;        break;
-        case 3000 : model = EM_MODEL_3000;         break;
-        case 3002 : CPL_ATTRIBUTE_FALLTHROUGH;
-        case 3003 : CPL_ATTRIBUTE_FALLTHROUGH;
-        case 3004 : CPL_ATTRIBUTE_FALLTHROUGH;
-        case 3005 : CPL_ATTRIBUTE_FALLTHROUGH;
-        case 3006 : CPL_ATTRIBUTE_FALLTHROUGH;
-        case 3007 : CPL_ATTRIBUTE_FALLTHROUGH;
-        case 3008 : model = EM_MODEL_3000D;        break;
-        case 3020 : model = EM_MODEL_3002;         break;
-        case 10120 : model = 0;                    break;  /* TODO: */
-        case 11032 : model = EM_MODEL_HISAS_1032;  break;
-        case 11034 : model = EM_MODEL_HISAS_1032D; break;
-        case 12040 : model = EM_MODEL_HISAS_2040;  break;
-        default : model = 0; break;
+    assert (h);
+
+    p = h->prefetch;
+    if (!p || !p->running) return CS_ENONE;
+
+    /* The I/O thread finishes the datagram being read and then stops. */
+    cpl_ring_close (p->free);
+    cpl_worker_wait (p->worker);
+
+    cpl_ring_destroy (p->ready);
+    cpl_ring_destroy (p->free);
+    p->ready = NULL;
+    p->free = NULL;
+    p->running = 0;
+
+    /* The buffered file, the copy buffer, the byte order, and the sidescan
+       sample sizes may have changed while reading ahead. */
+    h->io = p->h.io;
+    h->map_offset = p->h.map_offset;
+    h->buffer = p->h.buffer;
+    h->buffer_size = p->h.buffer_size;
+    h->swap = p->h.swap;
+    memcpy (h->hisas_bytes_per_sample, p->h.hisas_bytes_per_sample, sizeof (h->hisas_bytes_per_sample));
+
+    if (emx_seek (h, p->position) != 0) {
+        h->emx_errno = CS_ESEEK;
+        return CS_ESEEK;
     }
 
-    return model;
+    return CS_ENONE;
 }
 
 
 /******************************************************************************
 *
-* emx_get_em3000d_sample_rate - Return the sample rate in Hertz of the EM3000D
-*   given the EM_MODEL_NUMBER and SONAR_HEAD.  The sonar head is 1 for port
-*   and 2 for starboard.
+* emx_prefetch_free - Stop the I/O thread of the file handle H, if any, and free
+*   the read-ahead buffers.
 *
 ******************************************************************************/
 
-unsigned int emx_get_em3000d_sample_rate (
-    const uint16_t em_model_number,
-    const int sonar_head) {
-                                     /* 3002,  3003,  3004,  3005,  3006,  3007,  3008 */
-    static const unsigned int s1[] = { 13956, 13956, 14293, 13956, 14621, 14293, 14621 };
-    static const unsigned int s2[] = { 14621, 14621, 14621, 14293, 14293, 13956, 13956 };
+static void emx_prefetch_free (
+    emx_handle *h) {
 
+    emx_prefetch *p;
+    size_t i;
 
-    assert ((sonar_head == 1) || (sonar_head == 2));
 
-    if ((em_model_number >= 3002) && (em_model_number <= 3008)) {
-        if (sonar_head == 1) {
-            return s1[em_model_number - 3002];
-        }
-        if (sonar_head == 2) {
-            return s2[em_model_number - 3002];
-        }
+    assert (h);
+
+    p = h->prefetch;
+    if (!p) return;
+
+    emx_prefetch_stop (h);
+
+    /* The last datagram points into a buffer that is freed. */
+    if (p->last) {
+        h->body = NULL;
+        h->swap_pending = 0;
     }
 
-    return 0;
+    for (i=0; i<p->depth; i++) {
+        if (p->slots[i].buffer) cpl_free (p->slots[i].buffer);
+    }
+
+    cpl_worker_destroy (p->worker);
+    cpl_free (p->slots);
+    cpl_free (p);
+
+    h->prefetch = NULL;
 }
 
 
 /******************************************************************************
 *
-* emx_get_datagram_name - Return a character string of the name of the datagram
-*   given by DATAGRAM_TYPE.  This string should not be modified by the caller.
+* emx_prefetch_task - Run the I/O thread of the read-ahead state ARG, which
+*   reads the next datagram into each buffer given back by the consumer until
+*   the end of the data or the free ring is closed.  A deferred checksum is
+*   verified before the datagram is copied.  The datagram body is copied to the
+*   buffer unless it points into a memory-mapped file, and the buffer at the end
+*   of the data has no body and holds the error condition.
 *
 ******************************************************************************/
 
-const char * emx_get_datagram_name (
-    const uint8_t datagram_type) {
+static void emx_prefetch_task (
+    void *arg,
+    const size_t task) {
 
-    const char *s;
+    emx_prefetch *p = (emx_prefetch *) arg;
+    emx_prefetch_slot *s;
+    emx_handle *h;
+    emx_data *d;
+    char *buffer;
 
 
-    switch (datagram_type) {
+    assert (p);
 
-        case EMX_DATAGRAM_DEPTH                 : s = "EMX_DATAGRAM_DEPTH";                 break;
-        case EMX_DATAGRAM_DEPTH_NOMINAL         : s = "EMX_DATAGRAM_DEPTH_NOMINAL";         break;
-        case EMX_DATAGRAM_XYZ                   : s = "EMX_DATAGRAM_XYZ";                   break;
-        case EMX_DATAGRAM_EXTRA_DETECTIONS      : s = "EMX_DATAGRAM_EXTRA_DETECTIONS";      break;
-        case EMX_DATAGRAM_CENTRAL_BEAMS         : s = "EMX_DATAGRAM_CENTRAL_BEAMS";         break;
-        case EMX_DATAGRAM_RRA_101               : s = "EMX_DATAGRAM_RRA_101";               break;
-        case EMX_DATAGRAM_RRA_70                : s = "EMX_DATAGRAM_RRA_70";                break;
-        case EMX_DATAGRAM_RRA_102               : s = "EMX_DATAGRAM_RRA_102";               break;
-        case EMX_DATAGRAM_RRA_78                : s = "EMX_DATAGRAM_RRA_78";                break;
-        case EMX_DATAGRAM_SEABED_IMAGE_83       : s = "EMX_DATAGRAM_SEABED_IMAGE_83";       break;
-        case EMX_DATAGRAM_SEABED_IMAGE_89       : s = "EMX_DATAGRAM_SEABED_IMAGE_89";       break;
-        case EMX_DATAGRAM_WATER_COLUMN          : s = "EMX_DATAGRAM_WATER_COLUMN";          break;
-        case EMX_DATAGRAM_QUALITY_FACTOR        : s = "EMX_DATAGRAM_QUALITY_FACTOR";        break;
-        case EMX_DATAGRAM_ATTITUDE              : s = "EMX_DATAGRAM_ATTITUDE";              break;
-        case EMX_DATAGRAM_ATTITUDE_NETWORK      : s = "EMX_DATAGRAM_ATTITUDE_NETWORK";      break;
-        case EMX_DATAGRAM_CLOCK                 : s = "EMX_DATAGRAM_CLOCK";                 break;
-        case EMX_DATAGRAM_HEIGHT                : s = "EMX_DATAGRAM_HEIGHT";                break;
-        case EMX_DATAGRAM_HEADING               : s = "EMX_DATAGRAM_HEADING";               break;
-        case EMX_DATAGRAM_POSITION              : s = "EMX_DATAGRAM_POSITION";              break;
-        case EMX_DATAGRAM_SINGLE_BEAM_DEPTH     : s = "EMX_DATAGRAM_SINGLE_BEAM_DEPTH";     break;
-        case EMX_DATAGRAM_TIDE                  : s = "EMX_DATAGRAM_TIDE";                  break;
-        case EMX_DATAGRAM_SSSV                  : s = "EMX_DATAGRAM_SSSV";                  break;
-        case EMX_DATAGRAM_SVP                   : s = "EMX_DATAGRAM_SVP";                   break;
-        case EMX_DATAGRAM_SVP_EM3000            : s = "EMX_DATAGRAM_SVP_EM3000";            break;
-        case EMX_DATAGRAM_KM_SSP_OUTPUT         : s = "EMX_DATAGRAM_KM_SSP_OUTPUT";         break;
-        case EMX_DATAGRAM_INSTALL_PARAMS        : s = "EMX_DATAGRAM_INSTALL_PARAMS";        break;
-        case EMX_DATAGRAM_INSTALL_PARAMS_STOP   : s = "EMX_DATAGRAM_INSTALL_PARAMS_STOP";   break;
-        case EMX_DATAGRAM_INSTALL_PARAMS_REMOTE : s = "EMX_DATAGRAM_INSTALL_PARAMS_REMOTE"; break;
-        case EMX_DATAGRAM_REMOTE_PARAMS_INFO    : s = "EMX_DATAGRAM_REMOTE_PARAMS_INFO";    break;
-        case EMX_DATAGRAM_RUNTIME_PARAMS        : s = "EMX_DATAGRAM_RUNTIME_PARAMS";        break;
-        case EMX_DATAGRAM_EXTRA_PARAMS          : s = "EMX_DATAGRAM_EXTRA_PARAMS";          break;
-        case EMX_DATAGRAM_PU_OUTPUT             : s = "EMX_DATAGRAM_PU_OUTPUT";             break;
-        case EMX_DATAGRAM_PU_STATUS             : s = "EMX_DATAGRAM_PU_STATUS";             break;
-        case EMX_DATAGRAM_PU_BIST_RESULT        : s = "EMX_DATAGRAM_PU_BIST_RESULT";        break;
-        case EMX_DATAGRAM_TRANSDUCER_TILT       : s = "EMX_DATAGRAM_TRANSDUCER_TILT";       break;
-        case EMX_DATAGRAM_SYSTEM_STATUS         : s = "EMX_DATAGRAM_SYSTEM_STATUS";         break;
-        case EMX_DATAGRAM_STAVE                 : s = "EMX_DATAGRAM_STAVE";                 break;
-        case EMX_DATAGRAM_HISAS_STATUS          : s = "EMX_DATAGRAM_HISAS_STATUS";          break;
-        case EMX_DATAGRAM_NAVIGATION_OUTPUT     : s = "EMX_DATAGRAM_NAVIGATION_OUTPUT";     break;
-        case EMX_DATAGRAM_SIDESCAN_STATUS       : s = "EMX_DATAGRAM_SIDESCAN_STATUS";       break;
-        case EMX_DATAGRAM_HISAS_1032_SIDESCAN   : s = "EMX_DATAGRAM_HISAS_1032_SIDESCAN";   break;
-        case EMX_DATAGRAM_RRA_123               : s = "EMX_DATAGRAM_RRA_123";               break;
-        default                                 : s = "UNKNOWN";                            break;
-    }
+    (void) task;
 
-    return s;
+    h = &(p->h);
+
+    while ((s = (emx_prefetch_slot *) cpl_ring_wait (p->free)) != NULL) {
+        d = emx_read (h);
+
+        s->body = NULL;
+        s->status = h->emx_errno;
+        s->end = emx_tell (h);
+        s->resync_bytes = h->resync_bytes;
+        s->resync_count = h->resync_count;
+
+        if (d) {
+            s->checksum_valid = emx_verify_checksum (h);
+            s->swap_pending = h->swap_pending;
+            s->body_size = h->body_size;
+            s->d = *d;
+
+            if (h->map && (h->body >= h->map) && (h->body + h->body_size <= h->map + h->map_size)) {
+                s->body = h->body;
+            } else {
+                buffer = (char *) cpl_resize (s->buffer, h->body_size, sizeof (char), &(s->buffer_size));
+                if (buffer) {
+                    s->buffer = buffer;
+                    memcpy (s->buffer, h->body, h->body_size);
+                    emx_relocate (&(s->d), h->body, h->body_size, s->buffer);
+                    s->body = s->buffer;
+                } else {
+                    s->buffer = NULL;
+                    s->buffer_size = 0;
+                    s->status = CS_ENOMEM;
+                }
+            }
+        }
+
+        /* The counters include the checksum verified above. */
+        s->bytes_read = h->io.bytes_read;
+        s->num_reads = h->io.num_reads;
+        s->num_seeks = h->io.num_seeks;
+        s->checksum_failures = h->stats.checksum_failures;
+
+        /* The ready ring holds every buffer, so it is never full. */
+        cpl_ring_push (p->ready, s);
+
+        if (!s->body) break;
+    }
 }
@@ -54,6 +54,11 @@
 
 #define CPL_NEED_FIXED_WIDTH_T  /* Tell cpl_spec.h we need fixed-width types. */
 #include "cpl_spec.h"
+#include "cpl_alloc.h"
+#include "cpl_nav.h"
+#include "cpl_table.h"
+#include "cpl_snippets.h"
+#include "cpl_wcfile.h"
 
 
 /******************************* DEFINITIONS *********************************/
@@ -1626,27 +1631,192 @@ typedef struct {
 } emx_data;
 
 
+/* EMX Datagram Index Entry (24 Bytes) */
+typedef struct CPL_ATTRIBUTE_PACKED CPL_ATTRIBUTE_GCC_STRUCT {
+    uint64_t offset;                         /* File offset of the datagram size field.                     */
+    uint32_t bytes_in_datagram;              /* Number of bytes in the datagram (not including size field). */
+    uint32_t date;                           /* Date = year*10000 + month*100 + day.                        */
+    uint32_t time_ms;                        /* Time since midnight in milliseconds (0-86399999).           */
+    uint16_t counter;                        /* Counter (sequential counter) (0-65535).                     */
+    uint8_t datagram_type;                   /* Type of datagram.                                           */
+    uint8_t reserved;                        /* Reserved for future use.                                    */
+} emx_index_entry;
+
+
+/* EMX Scan Summary */
+typedef struct {
+    uint64_t num_datagrams;                  /* Total number of datagrams.                                  */
+    uint64_t num_bytes;                      /* Total size of all datagrams in bytes.                       */
+    uint64_t count[256];                     /* Number of datagrams of each type.                           */
+    uint64_t bytes[256];                     /* Total size of the datagrams of each type in bytes.          */
+    uint32_t first_date;                     /* Date of the earliest datagram.                              */
+    uint32_t first_time_ms;                  /* Time of the earliest datagram since midnight in ms.         */
+    uint32_t last_date;                      /* Date of the latest datagram.                                */
+    uint32_t last_time_ms;                   /* Time of the latest datagram since midnight in ms.           */
+    uint16_t em_model_number;                /* EM model number of the first datagram.                      */
+    uint16_t serial_number;                  /* System serial number of the first datagram.                 */
+} emx_scan_summary;
+
+
+/* EMX Read Statistics */
+typedef struct {
+    uint64_t bytes_read;                     /* Number of bytes read from the file or memory map.           */
+    uint64_t num_reads;                      /* Number of reads from the file.                              */
+    uint64_t num_seeks;                      /* Number of seeks in the file.                                */
+    uint64_t num_datagrams;                  /* Number of datagrams returned.                               */
+    uint64_t num_bytes;                      /* Total size of the datagrams returned in bytes.              */
+    uint64_t count[256];                     /* Number of datagrams returned of each type.                  */
+    uint64_t bytes[256];                     /* Total size of the datagrams returned of each type in bytes. */
+    uint64_t checksum_failures;              /* Number of datagrams with an invalid checksum.               */
+    uint64_t resync_bytes;                   /* Number of bytes skipped by resync.                          */
+    uint64_t resync_count;                   /* Number of bad datagrams skipped by resync.                  */
+    uint64_t io_time;                        /* Time reading the datagrams in ns if timing is enabled.      */
+    uint64_t parse_time;                     /* Time parsing the datagrams in ns if timing is enabled.      */
+} emx_stats;
+
+
+/* EMX Checksum Verification Modes */
+#define EMX_CHECKSUM_EAGER     0  /* Verify each datagram when read by emx_read().   */
+#define EMX_CHECKSUM_DEFERRED  1  /* Verify when emx_verify_checksum() is called.    */
+#define EMX_CHECKSUM_THREAD    2  /* Verify on a worker thread after emx_read().     */
+
+
+/* EMX XYZ Beam Columns */
+#define EMX_XYZ_COLUMN_DEPTH                 0x0001  /* depth in meters.                      */
+#define EMX_XYZ_COLUMN_ACROSS_TRACK          0x0002  /* across_track in meters.               */
+#define EMX_XYZ_COLUMN_ALONG_TRACK           0x0004  /* along_track in meters.                */
+#define EMX_XYZ_COLUMN_DETECT_WINDOW_LENGTH  0x0008  /* detect_window_length in samples.      */
+#define EMX_XYZ_COLUMN_QUALITY_FACTOR        0x0010  /* quality_factor.                       */
+#define EMX_XYZ_COLUMN_BEAM_ADJUSTMENT       0x0020  /* beam_adjustment in degrees.           */
+#define EMX_XYZ_COLUMN_DETECTION_INFO        0x0040  /* detection_info.                       */
+#define EMX_XYZ_COLUMN_SYSTEM_CLEANING       0x0080  /* system_cleaning.                      */
+#define EMX_XYZ_COLUMN_BACKSCATTER           0x0100  /* backscatter in dB.                    */
+#define EMX_XYZ_NUM_COLUMNS                  9
+
+
+/* EMX XYZ Beam Column Arrays */
+typedef struct {
+    float *depth;                            /* Array of depth or NULL.                                     */
+    float *across_track;                     /* Array of across_track or NULL.                              */
+    float *along_track;                      /* Array of along_track or NULL.                               */
+    float *detect_window_length;             /* Array of detect_window_length or NULL.                      */
+    float *quality_factor;                   /* Array of quality_factor or NULL.                            */
+    float *beam_adjustment;                  /* Array of beam_adjustment in degrees or NULL.                */
+    float *detection_info;                   /* Array of detection_info or NULL.                            */
+    float *system_cleaning;                  /* Array of system_cleaning or NULL.                           */
+    float *backscatter;                      /* Array of backscatter in dB or NULL.                         */
+} emx_xyz_columns;
+
+
+/* EMX Water Column Ping Maximum TX Sectors */
+#define EMX_WC_MAX_TX_SECTORS  20
+
+
+/* EMX Water Column Ping */
+typedef struct {
+    emx_datagram_header header;              /* Header of the first datagram of the ping.                   */
+    emx_datagram_wc_info info;               /* Info of the first datagram of the ping.                     */
+    emx_datagram_wc_tx_beam txbeam[EMX_WC_MAX_TX_SECTORS]; /* Array of info.tx_sectors TX beams.            */
+    uint8_t *beamData;                       /* RX beams of all datagrams of the ping in order.             */
+    size_t *offset;                          /* Array of num_beams offsets of the RX beams in beamData.     */
+    size_t num_beams;                        /* Number of RX beams in the ping.                             */
+    size_t max_samples;                      /* Maximum num_samples of the RX beams.                        */
+    size_t data_size;                        /* Number of bytes of beamData used.                           */
+    size_t data_alloc;                       /* Number of bytes of beamData allocated.                      */
+    size_t offset_alloc;                     /* Number of offsets allocated.                                */
+    uint16_t next_datagram;                  /* Datagram number expected next, or 0 if none.                */
+    int complete;                            /* Boolean if all datagrams of the ping were added.            */
+} emx_wc_ping;
+
+
 /* Opaque EMX File Handle */
 typedef struct emx_handle_struct emx_handle;
 
 
+/* Opaque EMX Compressed Water Column File Type */
+typedef struct emx_wc_file_struct emx_wc_file;
+
+
+/* EMX Batch Read Callback Function */
+typedef int (*emx_batch_fn) (emx_handle *, const emx_data *, const size_t, void *);
+
+
+/* EMX Trace Callback Function */
+typedef void (*emx_trace_fn) (const emx_handle *, const emx_data *, const uint64_t, const uint64_t, void *);
+
+
+/* EMX Batch Read Options */
+#define EMX_BATCH_MMAP  0x01  /* Open the files with emx_open_mmap().          */
+#define EMX_BATCH_SORT  0x02  /* Read the datagrams of each file in time order. */
+
+
 /******************************* API Functions *******************************/
 
 CPL_CLINKAGE_START
 
 emx_handle * emx_open (const char *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+emx_handle * emx_open_mmap (const char *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+emx_handle * emx_open_fd (const int, char *, const size_t, const size_t) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
 int emx_close (emx_handle *);
 emx_data * emx_read (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+emx_data * emx_retain (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+void emx_release (emx_handle *, emx_data *) CPL_ATTRIBUTE_NONNULL (1);
 void emx_print (FILE *, const emx_data *, const int) CPL_ATTRIBUTE_NONNULL (1);
 void emx_set_ignore_wc (emx_handle *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
 void emx_set_ignore_checksum (emx_handle *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_set_checksum_mode (emx_handle *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_verify_checksum (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+void emx_set_lazy_swap (emx_handle *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+emx_data * emx_get_array_data (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+void emx_set_resync (emx_handle *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+void emx_get_resync_info (const emx_handle *, uint64_t *, uint64_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+void emx_set_nav (emx_handle *, cpl_nav *) CPL_ATTRIBUTE_NONNULL (1);
+int emx_set_type_filter (emx_handle *, const uint8_t *, const size_t, const int) CPL_ATTRIBUTE_NONNULL (1);
+void emx_set_block_size (emx_handle *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_set_async_io (emx_handle *, const size_t, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_set_prefetch (emx_handle *, const size_t, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_set_decode_threads (emx_handle *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+void emx_get_prefetch_info (const emx_handle *, uint64_t *, uint64_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+void emx_set_timing (emx_handle *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+void emx_set_trace (emx_handle *, emx_trace_fn, void *) CPL_ATTRIBUTE_NONNULL (1);
+void emx_get_stats (const emx_handle *, emx_stats *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_build_index (emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_save_index (const emx_handle *, const char *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_load_index (emx_handle *, const char *) CPL_ATTRIBUTE_NONNULL_ALL;
+const emx_index_entry * emx_get_index (const emx_handle *, size_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_find_index (const emx_handle *, const uint8_t, const size_t, size_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_find_index_time (const emx_handle *, const uint8_t, const uint32_t, const uint32_t, size_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_seek_to_index (emx_handle *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_scan (emx_handle *, emx_scan_summary *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_copy (emx_handle *, const int, const uint64_t, const uint64_t, const uint64_t, uint64_t *) CPL_ATTRIBUTE_NONNULL (1);
+int emx_read_files (const char **, const size_t, const int, const int, emx_batch_fn, void *, int *) CPL_ATTRIBUTE_NONNULL (1) CPL_ATTRIBUTE_NONNULL (5);
+int emx_read_chunks (const char *, const size_t, const int, const int, emx_batch_fn, void *) CPL_ATTRIBUTE_NONNULL (1) CPL_ATTRIBUTE_NONNULL (5);
+size_t emx_get_xyz_columns (const emx_datagram_xyz *, const unsigned int, const emx_xyz_columns *, const size_t, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_alloc_xyz_columns (emx_xyz_columns *, const unsigned int, const size_t, cpl_arena *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_add_xyz_table_columns (cpl_table *, const unsigned int) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_write_xyz_table (cpl_table *, const emx_data *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_get_seabed_89_snippets (const emx_datagram_seabed_89 *, cpl_snippets *) CPL_ATTRIBUTE_NONNULL_ALL;
 const uint8_t * emx_get_wc_rxbeam (emx_datagram_wc_rx_beam *, const uint8_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+void emx_init_wc_ping (emx_wc_ping *) CPL_ATTRIBUTE_NONNULL_ALL;
+void emx_free_wc_ping (emx_wc_ping *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_add_wc_ping (emx_wc_ping *, const emx_data *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_get_wc_ping_beam (const emx_wc_ping *, const size_t, emx_datagram_wc_rx_beam *) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_write_wc_file (emx_handle *, const char *) CPL_ATTRIBUTE_NONNULL_ALL;
+emx_wc_file * emx_wc_file_open (const char *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int emx_wc_file_close (emx_wc_file *);
+emx_data * emx_wc_file_read (emx_wc_file *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+size_t emx_wc_file_get_num_datagrams (const emx_wc_file *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+const cpl_wcfile_entry * emx_wc_file_get_entry (const emx_wc_file *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+size_t emx_wc_file_find_time (const emx_wc_file *, const uint32_t, const uint32_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int emx_wc_file_get_errno (const emx_wc_file *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+int emx_get_wc_matrix (const emx_wc_ping *, float *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
 const uint8_t * emx_get_attitude_network_data (emx_datagram_attitude_network_data *, const uint8_t *) CPL_ATTRIBUTE_NONNULL_ALL;
 int emx_get_model (const uint16_t) CPL_ATTRIBUTE_CONST;
 const char * emx_get_datagram_name (const uint8_t) CPL_ATTRIBUTE_RETURNS_NONNULL;
 unsigned int emx_get_em3000d_sample_rate (const uint16_t, const int) CPL_ATTRIBUTE_PURE;
 int emx_get_errno (const emx_handle *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
 int emx_identify (const char *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int emx_identify_data (const void *, const size_t) CPL_ATTRIBUTE_PURE;
 void emx_set_debug (const int);
 
 
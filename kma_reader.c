@@ -15,40 +15,301 @@
    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
 #include <assert.h>
 #include "kma_reader.h"
 #include "cpl_alloc.h"
 #include "cpl_error.h"
 #include "cpl_debug.h"
 #include "cpl_file.h"
+#include "cpl_zfile.h"
+#include "cpl_thread.h"
+#include "cpl_timedate.h"
+#include "cpl_table.h"
+#include "cpl_wcfile.h"
+#include "cpl_simd.h"
+
+
+/* KMA Retained Datagram */
+typedef struct kma_retained_struct kma_retained;
+
+struct kma_retained_struct {
+    kma_data d;              /* Datagram pointing into the buffer.   */
+    char *buffer;            /* Copy of the datagram body or NULL.   */
+    size_t buffer_size;      /* Allocated size of the buffer.        */
+    kma_retained *next;      /* Next retained datagram or NULL.      */
+    kma_retained *next_free; /* Next released datagram or NULL.      */
+};
+
+
+/* KMA Read-Ahead Buffer */
+typedef struct {
+    kma_data d;              /* Datagram pointing into the body.     */
+    char *body;              /* Datagram body or NULL at the end.    */
+    char *buffer;            /* Copy of the datagram body or NULL.   */
+    size_t buffer_size;      /* Allocated size of the buffer.        */
+    uint64_t end;            /* File offset after the datagram.      */
+    uint64_t resync_bytes;   /* Bytes skipped by resync so far.      */
+    uint64_t resync_count;   /* Datagrams skipped by resync so far.  */
+    uint64_t bytes_read;     /* Bytes read from the file so far.     */
+    uint64_t num_reads;      /* Reads from the file so far.          */
+    uint64_t num_seeks;      /* Seeks in the file so far.            */
+    int status;              /* Error condition at the end.          */
+} kma_prefetch_slot;
+
+
+/* KMA Read-Ahead State */
+typedef struct kma_prefetch_struct kma_prefetch;
 
 
 /* KMA File Handle */
 struct kma_handle_struct {
-    char *buffer;            /* File I/O buffer.            */
-    size_t buffer_size;      /* Allocated buffer size.      */
-    kma_data d;              /* Static kma_data struct.     */
-    int fd;                  /* File descriptor.            */
-    int kma_errno;           /* Error condition code.       */
-    int ignore_mwc;          /* Boolean to ignore MWC data. */
-    int ignore_mrz;          /* Boolean to ignore MRZ data. */
+    cpl_bfile_t io;          /* Buffered file reader.                */
+    const char *map;         /* Memory-mapped file or NULL.          */
+    size_t map_size;         /* Size of the memory-mapped file.      */
+    size_t map_offset;       /* Current read offset into the map.    */
+    kma_data d;              /* Static kma_data struct.              */
+    int fd;                  /* File descriptor.                     */
+    int kma_errno;           /* Error condition code.                */
+    int ignore_mwc;          /* Boolean to ignore MWC data.          */
+    int ignore_mrz;          /* Boolean to ignore MRZ data.          */
+    uint32_t *filter;        /* Datagram type filter or NULL.        */
+    size_t filter_size;      /* Number of types in the filter.       */
+    int filter_exclude;      /* Boolean to skip the filter types.    */
+    int resync;              /* Boolean to resync after bad data.    */
+    uint64_t resync_bytes;   /* Number of bytes skipped by resync.   */
+    uint64_t resync_count;   /* Number of bad datagrams skipped.     */
+    int read_one;            /* Boolean to read only one datagram.   */
+    char *buffer;            /* Datagram partition buffer.           */
+    size_t buffer_size;      /* Allocated partition buffer size.     */
+    size_t part_size;        /* Number of bytes joined so far.       */
+    uint32_t part_type;      /* Type of the partitioned datagram.    */
+    uint32_t part_time_sec;  /* Time of the partitioned datagram.    */
+    uint32_t part_time_nsec; /* Nanosecond part of the time.         */
+    uint16_t part_count;     /* Number of datagram partitions.       */
+    uint16_t part_num;       /* Last joined partition or zero.       */
+    kma_index_entry *index;  /* Datagram index or NULL.              */
+    size_t index_size;       /* Number of datagrams in the index.    */
+    size_t index_alloc;      /* Allocated number of index entries.   */
+    uint32_t *index_by_type; /* Index entries sorted by type, time.  */
+    uint32_t *index_by_time; /* Index entries sorted by time.        */
+    cpl_nav *nav;            /* Navigation store or NULL.            */
+    char *body;              /* Body of the last datagram or NULL.   */
+    kma_retained *retained;  /* List of all retained datagrams.      */
+    kma_retained *released;  /* List of released retained datagrams. */
+    kma_prefetch *prefetch;  /* Read-ahead state or NULL.            */
+    kma_stats stats;         /* Datagram counts and times.           */
+    int timing;              /* Boolean to measure the read times.   */
+    kma_trace_fn trace;      /* Datagram trace function or NULL.     */
+    void *trace_data;        /* Trace function user data.            */
+};
+
+
+/* KMA Read-Ahead State */
+struct kma_prefetch_struct {
+    kma_handle h;              /* File handle of the I/O thread.       */
+    kma_prefetch_slot *slots;  /* Array of depth buffers.              */
+    size_t depth;              /* Number of buffers.                   */
+    cpl_ring *ready;           /* Buffers read by the I/O thread.      */
+    cpl_ring *free;            /* Buffers returned by the consumer.    */
+    cpl_worker *worker;        /* I/O thread.                          */
+    kma_prefetch_slot *last;   /* Buffer of the last datagram or NULL. */
+    uint64_t position;         /* File offset after the last datagram. */
+    uint64_t count;            /* Number of datagrams read ahead.      */
+    uint64_t stalls;           /* Number of waits for the I/O thread.  */
+    int running;               /* Boolean if the I/O thread is used.   */
+};
+
+
+/* KMA Index File Header (32 Bytes) */
+typedef struct CPL_ATTRIBUTE_PACKED CPL_ATTRIBUTE_GCC_STRUCT {
+    char magic[8];           /* Magic string "KMAINDEX".             */
+    uint32_t version;        /* Index file version.                  */
+    uint32_t byte_order;     /* 0x01020304 in the file byte order.   */
+    uint32_t entry_size;     /* Size of each index entry in bytes.   */
+    uint32_t num_entries;    /* Number of index entries.             */
+    uint64_t file_size;      /* Size of the indexed file in bytes.   */
+} kma_index_file_header;
+
+
+/* KMA Index Sort Key */
+typedef struct {
+    uint64_t time;           /* Time in nanoseconds.                 */
+    uint32_t type;           /* Datagram type.                       */
+    uint32_t entry;          /* Index entry number.                  */
+} kma_index_key;
+
+
+/* KMA Batch Read State */
+typedef struct {
+    const char **file_names; /* File names to read.                  */
+    int *file_status;        /* Status of each file.                 */
+    int options;             /* Batch read options.                  */
+    kma_batch_fn fn;         /* Datagram callback function.          */
+    void *user_data;         /* Callback function user data.         */
+} kma_batch;
+
+
+/* KMA Chunked Read State */
+typedef struct {
+    const char *file_name;   /* File name to read.                   */
+    uint64_t *offsets;       /* Start offset of each chunk.          */
+    int *chunk_status;       /* Status of each chunk.                */
+    int options;             /* Batch read options.                  */
+    kma_batch_fn fn;         /* Datagram callback function.          */
+    void *user_data;         /* Callback function user data.         */
+} kma_chunks;
+
+
+/* KMA Merged Stream Input */
+typedef struct {
+    kma_handle *h;           /* File handle of the input.            */
+    kma_data *d;             /* Next datagram or NULL at the end.    */
+    uint64_t time;           /* Time of the next datagram in ns.     */
+    size_t next;             /* Next index entry if reading sorted.  */
+} kma_merge_input;
+
+
+/* KMA Merged Stream Handle */
+struct kma_merge_struct {
+    kma_merge_input *input;  /* Array of num_inputs inputs.          */
+    size_t *heap;            /* Heap of inputs by time of next data. */
+    size_t num_inputs;       /* Number of inputs.                    */
+    size_t heap_size;        /* Number of inputs in the heap.        */
+    size_t last;             /* Input returned last or num_inputs.   */
+    int options;             /* Batch read options.                  */
+    int started;             /* Boolean if the inputs were read.     */
+    int merge_errno;         /* Error condition code.                */
+};
+
+
+/* KMA Push Parser */
+struct kma_parser_struct {
+    kma_handle *h;           /* Handle of the datagram and options.  */
+    const char *data;        /* Unparsed data of the last feed.      */
+    size_t data_size;        /* Number of unparsed bytes in data.    */
+    char *carry;             /* Data of a datagram split by feeds.   */
+    size_t carry_start;      /* Offset of the first unparsed byte.   */
+    size_t carry_end;        /* Offset after the last carried byte.  */
+    size_t carry_size;       /* Allocated size of the carry buffer.  */
+    size_t skip;             /* Bytes left of a skipped datagram.    */
+    int searching;           /* Boolean if resync is searching.      */
+};
+
+
+/* KMA Water Column File */
+struct kma_wc_file_struct {
+    cpl_wcfile *w;           /* Compressed water column file.        */
+    kma_handle *h;           /* Handle of the decoded datagram.      */
 };
 
 
+/* KMA MRZ Sounding Column Definition */
+typedef struct {
+    const char *name;        /* Name of the field.                   */
+    size_t offset;           /* Offset of the field in a sounding.   */
+    int is_float;            /* Boolean if the field is a float.     */
+} kma_mrz_column_def;
+
+
+/* KMA Index File Definitions */
+#define KMA_INDEX_MAGIC       "KMAINDEX"
+#define KMA_INDEX_VERSION     2
+#define KMA_INDEX_BYTE_ORDER  0x01020304
+
+
+/* Size of the Output Buffer Used by kma_copy() */
+#define KMA_COPY_BUFFER_SIZE  (1<<20)
+
+
+/* Size of the File Prefix Read by kma_identify() */
+#define KMA_IDENTIFY_SIZE     (1<<16)
+
+
+/* Number of Consecutive Datagram Headers Validated to Identify a File */
+#define KMA_IDENTIFY_HEADERS  4
+
+
 /* Private Function Prototypes */
+static kma_handle * kma_new_handle (const int) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
 static int kma_valid_header (const kma_datagram_header *) CPL_ATTRIBUTE_NONNULL_ALL;
-static int set_buffer_size (kma_handle *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_read_header (kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_skip (kma_handle *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_parse (kma_handle *, char *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_filter_type (const kma_handle *, const uint32_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static int kma_copy_type (const kma_handle *, const uint32_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static int kma_copy_write (const int, const char *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_join_partition (kma_handle *, char **, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_resync (kma_handle *, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static ssize_t kma_peek (kma_handle *, const uint64_t, const size_t, char **) CPL_ATTRIBUTE_NONNULL_ALL;
+static uint64_t kma_tell (const kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static int kma_seek (kma_handle *, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_file_size (const kma_handle *, uint64_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_sort_index (kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void kma_free_index (kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_compare_type (const void *, const void *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static int kma_compare_time (const void *, const void *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static uint64_t kma_index_time (const uint32_t, const uint32_t) CPL_ATTRIBUTE_CONST;
+static size_t kma_mrz_num_soundings (const kma_data *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void kma_batch_task (void *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
+static int kma_batch_file (kma_batch *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static kma_data * kma_read_indexed (kma_handle *, size_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_merge_start (kma_merge *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_merge_advance (kma_merge *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_merge_before (const kma_merge *, const size_t, const size_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+static void kma_merge_sift_down (kma_merge *, size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void kma_merge_sift_up (kma_merge *, size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_split_chunks (kma_handle *, uint64_t *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void kma_chunk_task (void *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
+static int kma_chunk_file (kma_chunks *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_add_nav (cpl_nav *, const kma_data *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void kma_relocate (kma_datagram *, const char *, const size_t, char *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_parser_carry (kma_parser *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_parser_fill (kma_parser *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static void kma_parser_skip_byte (kma_parser *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_parser_search (kma_parser *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void kma_delta_mwc (uint8_t *, const uint8_t *, const kma_datagram_mwc_rx_info *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+static void kma_count_datagram (kma_handle *, const uint64_t, const uint64_t) CPL_ATTRIBUTE_NONNULL_ALL;
+static kma_data * kma_prefetch_read (kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_prefetch_start (kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static int kma_prefetch_stop (kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void kma_prefetch_free (kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+static void kma_prefetch_task (void *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
 
 
 /* Private Variables */
 static int kma_debug = 0;
 
+/* Fields of the MRZ sounding columns in the order of the column flags. */
+static const kma_mrz_column_def kma_mrz_column[KMA_MRZ_NUM_COLUMNS] = {
+    { "x_reRefPoint_m", offsetof (kma_datagram_mrz_sounding, x_reRefPoint_m), 1 },
+    { "y_reRefPoint_m", offsetof (kma_datagram_mrz_sounding, y_reRefPoint_m), 1 },
+    { "z_reRefPoint_m", offsetof (kma_datagram_mrz_sounding, z_reRefPoint_m), 1 },
+    { "detectionType", offsetof (kma_datagram_mrz_sounding, detectionType), 0 },
+    { "reflectivity1_dB", offsetof (kma_datagram_mrz_sounding, reflectivity1_dB), 1 },
+    { "beamAngleReRx_deg", offsetof (kma_datagram_mrz_sounding, beamAngleReRx_deg), 1 },
+    { "reflectivity2_dB", offsetof (kma_datagram_mrz_sounding, reflectivity2_dB), 1 },
+    { "twoWayTravelTime_sec", offsetof (kma_datagram_mrz_sounding, twoWayTravelTime_sec), 1 },
+    { "qualityFactor", offsetof (kma_datagram_mrz_sounding, qualityFactor), 1 },
+    { "detectionUncertaintyVer_m", offsetof (kma_datagram_mrz_sounding, detectionUncertaintyVer_m), 1 },
+    { "detectionUncertaintyHor_m", offsetof (kma_datagram_mrz_sounding, detectionUncertaintyHor_m), 1 },
+    { "deltaLatitude_deg", offsetof (kma_datagram_mrz_sounding, deltaLatitude_deg), 1 },
+    { "deltaLongitude_deg", offsetof (kma_datagram_mrz_sounding, deltaLongitude_deg), 1 }
+};
+
 
 /******************************************************************************
 *
 * kma_open - Open the file given by FILE_NAME and return a handle to it.  The
 *   caller must call kma_close() to close the file and free the memory after use.
+*   A file written by cpl_zfile_compress() is decoded as it is read, with
+*   CPL_ZFILE_THREADS frames decoded ahead (see kma_set_decode_threads()), and
+*   all file offsets and sizes, such as those of the index, are of the decoded
+*   data.
 *
 * Return: A file handle pointer to the open file, or
 *         NULL if the file can not be opened for reading.
@@ -64,6 +325,7 @@ kma_handle * kma_open (
 
     /* Make sure there is no padding in the data structs. */
     assert (sizeof (kma_datagram_header) == 20);
+    assert (sizeof (kma_datagram) % sizeof (void *) == 0);
     assert (sizeof (kma_datagram_iip_data) == 6);
     assert (sizeof (kma_datagram_iop_data) == 6);
     assert (sizeof (kma_datagram_m_partition) == 4);
@@ -108,25 +370,96 @@ kma_handle * kma_open (
     }
 
     /* Allocate memory storage for the handle.  This must be free'd later. */
-    h = (kma_handle *) cpl_malloc (sizeof (kma_handle));
+    h = kma_new_handle (fd);
     if (!h) {
         cpl_close (fd);
         return NULL;
     }
 
-    /* Initialize the file buffer. */
-    h->buffer_size = 0;
-    h->buffer = NULL;
+    /* A compressed file is decoded as it is read.  Any read error is returned by the first read. */
+    cpl_bfile_detect (&(h->io), CPL_ZFILE_THREADS);
 
-    /* Initialize the file handle. */
-    h->kma_errno = CS_ENONE;
-    h->fd = fd;
+    return h;
+}
 
-    /* Set boolean to ignore watercolumn data to false by default. */
-    h->ignore_mwc = 0;
 
-    /* Set boolean to ignore multibeam sounding data to false by default. */
-    h->ignore_mrz = 0;
+/******************************************************************************
+*
+* kma_open_fd - Return a handle that reads from the open file descriptor FD,
+*   such as a file opened and identified by ns_open().  If BUFFER is not NULL,
+*   then its first N bytes are the data read from FD just before its current
+*   position, which are returned by the first reads instead of being read
+*   again.  BUFFER of BUFFER_SIZE bytes must be allocated with cpl_malloc().
+*   If successful, the handle owns FD and BUFFER, and kma_close() closes FD.
+*   Otherwise, both are still owned by the caller.  A compressed file is
+*   decoded as by kma_open().
+*
+* Return: A file handle pointer to the open file, or
+*         NULL if memory allocation failed.
+*
+******************************************************************************/
+
+kma_handle * kma_open_fd (
+    const int fd,
+    char *buffer,
+    const size_t buffer_size,
+    const size_t n) {
+
+    kma_handle *h;
+
+
+    if (fd < 0) return NULL;
+
+    h = kma_new_handle (fd);
+    if (!h) return NULL;
+
+    if (buffer) cpl_bfile_set_buffer (&(h->io), buffer, buffer_size, n);
+
+    /* A compressed file is decoded as it is read.  Any read error is returned by the first read. */
+    cpl_bfile_detect (&(h->io), CPL_ZFILE_THREADS);
+
+    return h;
+}
+
+
+/******************************************************************************
+*
+* kma_open_mmap - Open the file given by FILE_NAME and map its contents into
+*   memory for reading.  The datagram pointers returned by kma_read() point
+*   directly into the mapped file instead of an internal copy, so no per-datagram
+*   read or copy is done, and the data remains valid until kma_close() is called.
+*   The mapped data is read-only and must not be modified by the caller.  If the
+*   file can not be mapped (e.g., not a regular file), then the handle falls back
+*   to the reads used by kma_open().
+*
+* Return: A file handle pointer to the open file, or
+*         NULL if the file can not be opened for reading.
+*
+******************************************************************************/
+
+kma_handle * kma_open_mmap (
+    const char *file_name) {
+
+    kma_handle *h;
+
+
+    h = kma_open (file_name);
+    if (!h) return NULL;
+
+    /* The decoded data of a compressed file is not in the file. */
+    if (h->io.zfile) {
+        cpl_debug (kma_debug, "File is compressed, using buffered reads\n");
+        return h;
+    }
+
+    h->map = (const char *) cpl_mmap (h->fd, &(h->map_size));
+
+    if (h->map) {
+        cpl_debug (kma_debug, "Mapped %lu bytes into memory\n", (unsigned long) h->map_size);
+    } else {
+        cpl_debug (kma_debug, "Failed to map file, using buffered reads\n");
+        h->map_size = 0;
+    }
 
     return h;
 }
@@ -146,12 +479,16 @@ kma_handle * kma_open (
 int kma_close (
     kma_handle *h) {
 
+    kma_retained *r;
     int status = CS_ENONE;
 
 
     if (h) {
         cpl_debug (kma_debug, "Closing file\n");
 
+        /* Stop the I/O thread, which returns the file state to the handle. */
+        kma_prefetch_free (h);
+
         /* Close the file if it wasn't already closed. */
         if (h->fd != -1) {
             if (cpl_close (h->fd) != 0) {
@@ -160,10 +497,32 @@ int kma_close (
             h->fd = -1;
         }
 
+        /* Release the memory-mapped file. */
+        if (h->map) {
+            if (cpl_munmap ((void *) h->map, h->map_size) != 0) {
+                status = CS_ECLOSE;
+            }
+            h->map = NULL;
+        }
+
         /* Free the internal storage buffer. */
-        if (h->buffer) {
-            cpl_free (h->buffer);
-            h->buffer = NULL;
+        cpl_bfile_free (&(h->io));
+
+        /* Free the datagram type filter. */
+        cpl_free (h->filter);
+
+        /* Free the datagram partition buffer. */
+        cpl_free (h->buffer);
+
+        /* Free the datagram index. */
+        kma_free_index (h);
+
+        /* Free the retained datagrams, whether released or not. */
+        while (h->retained) {
+            r = h->retained;
+            h->retained = r->next;
+            if (r->buffer) cpl_free (r->buffer);
+            cpl_free (r);
         }
 
         /* Free the file handle. */
@@ -181,7 +540,10 @@ int kma_close (
 *   file pointer will be at the start of the next datagram.  The memory
 *   storage for the datagram will be overwritten in subsequent calls to this
 *   function or if the file is closed.  If they are to be preserved, then they
-*   should be copied to a user-defined buffer location.
+*   should be copied to a user-defined buffer location.  MRZ and MWC datagrams
+*   that are split into several partitions are returned as one joined datagram
+*   after the last partition is read.  If resync mode is set, then corrupt
+*   datagrams are skipped by searching for the next valid datagram.
 *
 * Return: A pointer to the data struct if the data was read successfully,
 *         NULL if no valid data was found or EOF was reached.
@@ -197,41 +559,52 @@ kma_data * kma_read (
     kma_handle *h) {
 
     uint32_t datagram_size;
+    uint64_t offset;
+    uint64_t start = 0;
+    uint64_t parse_start;
+    uint64_t parse_time = 0;
     size_t actual_read_size;
     size_t read_size;
     ssize_t result;
+    int count = 0;
+    int status;
+    kma_data *d;
     char *p;
 
 
     assert (h);
 
-    /* Set the read size to the datagram header size. */
-L1: read_size = sizeof (kma_datagram_header);
+    if (h->timing) start = cpl_clock_ns ();
 
-    /* Read the datagram header from the file descriptor. */
-    result = cpl_read (&(h->d.header), read_size, h->fd);
-    if (result < 0) {
-        cpl_debug (kma_debug, "Read error occurred\n");
-        h->kma_errno = CS_EREAD;
-        return NULL;
+    /* Datagrams read ahead by the I/O thread are returned in file order, but a
+       read of only one datagram follows a seek, so it is read directly. */
+    if (h->prefetch) {
+        if (!h->read_one) {
+            d = kma_prefetch_read (h);
+            if (d) kma_count_datagram (h, start, 0);
+            return d;
+        }
+        if (kma_prefetch_stop (h) != 0) return NULL;
     }
 
-    actual_read_size = (size_t) result;
+    h->body = NULL;
 
-    /* If the read amount is zero, then it is EOF, otherwise if the read
-       amount is less than the datagram size, then the file is corrupt. */
-    if (actual_read_size != read_size) {
-        if (actual_read_size != 0) {
-            cpl_debug (kma_debug, "Unexpected end of file\n");
-            h->kma_errno = CS_EBADDATA;
-        }
-        return NULL;
-    }
+    /* When reading in index order, a skipped datagram must not be followed by the next one in the file. */
+L1: if (h->read_one && (count++ > 0)) return NULL;
 
-    /* Verify that the datagram header is valid. */
-    if (kma_valid_header (&(h->d.header)) == 0) {
-        cpl_debug (kma_debug, "Invalid header\n");
-        h->kma_errno = CS_EBADDATA;
+    /* Save the datagram offset, which is needed to resynchronize after corrupt data. */
+    offset = kma_tell (h);
+
+    /* Read the datagram header from the file and validate it. */
+    status = kma_read_header (h);
+
+    /* Check for EOF. */
+    if (status == 0) return NULL;
+
+    /* Check for error condition. */
+    if (status < 0) {
+        if (h->resync && (status == CS_EBADDATA)) goto L2;
+        h->kma_errno = status;
         return NULL;
     }
 
@@ -247,9 +620,7 @@ L1: read_size = sizeof (kma_datagram_header);
        the read time is greater than the seek time on the storage device, then seeking
        past this data is advantageous if this data is not desired. */
     if (h->ignore_mwc && (h->d.header.dgmType == KMA_DATAGRAM_MWC)) {
-        if (cpl_seek (h->fd, read_size, SEEK_CUR) < 0) {
-            cpl_debug (kma_debug, "Seek failed\n");
-            h->kma_errno = CS_ESEEK;
+        if (kma_skip (h, read_size) != 0) {
             return NULL;
         }
 
@@ -259,9 +630,7 @@ L1: read_size = sizeof (kma_datagram_header);
 
     /* Skip any multibeam datagrams if requested. */
     if (h->ignore_mrz && (h->d.header.dgmType == KMA_DATAGRAM_MRZ)) {
-        if (cpl_seek (h->fd, read_size, SEEK_CUR) < 0) {
-            cpl_debug (kma_debug, "Seek failed\n");
-            h->kma_errno = CS_ESEEK;
+        if (kma_skip (h, read_size) != 0) {
             return NULL;
         }
 
@@ -269,394 +638,204 @@ L1: read_size = sizeof (kma_datagram_header);
         goto L1;
     }
 
-    /* Resize the buffer as needed to fit the datagram size. */
-    if (set_buffer_size (h, read_size) != 0) {
-        h->kma_errno = CS_ENOMEM;
-        return NULL;
+    /* Skip any datagrams rejected by the datagram type filter. */
+    if (h->filter && kma_filter_type (h, h->d.header.dgmType)) {
+        if (kma_skip (h, read_size) != 0) {
+            return NULL;
+        }
+
+        /* Now go back and read another datagram. */
+        goto L1;
     }
 
-    /* Read the rest of the datagram from the file descriptor to the buffer. */
-    result = cpl_read (h->buffer, read_size, h->fd);
-    if (result < 0) {
-        cpl_debug (kma_debug, "Read error occurred\n");
-        h->kma_errno = CS_EREAD;
-        return NULL;
+    if (h->map) {
+        /* Point directly into the memory-mapped file instead of copying the datagram. */
+        if (h->map_size - h->map_offset < read_size) {
+            cpl_debug (kma_debug, "Unexpected end of file\n");
+            if (h->resync) goto L2;
+            h->kma_errno = CS_EBADDATA;
+            return NULL;
+        }
+
+        /* The datagram pointers are never written to, so casting away const is safe. */
+        p = (char *) (h->map + h->map_offset);
+        h->map_offset += read_size;
+        h->io.bytes_read += read_size;
+    } else {
+        /* Resize the file block as needed to fit the datagram size. */
+        if (cpl_bfile_reserve (&(h->io), read_size) != 0) {
+            h->kma_errno = CS_ENOMEM;
+            return NULL;
+        }
+
+        /* Get the rest of the datagram from the file block.  The pointer p is set to the
+           start of the datagram (after the header) so no copy of the data is made. */
+        result = cpl_bfile_get (&(h->io), &p, read_size);
+        if (result < 0) {
+            cpl_debug (kma_debug, "Read error occurred\n");
+            h->kma_errno = CS_EREAD;
+            return NULL;
+        }
+
+        actual_read_size = (size_t) result;
+
+        /* Make sure we read at least the minimum size. */
+        if (actual_read_size != read_size) {
+            /* If the expected amount was not read, then the file is corrupt. */
+            cpl_debug (kma_debug, "Unexpected end of file\n");
+            if (h->resync) goto L2;
+            h->kma_errno = CS_EBADDATA;
+            return NULL;
+        }
+    }
+
+    /* In resync mode, verify that the datagram size at the end of the datagram agrees with the
+       header, otherwise the datagram size is corrupt and the next datagram can not be found. */
+    if (h->resync) {
+        memcpy (&datagram_size, p + read_size - sizeof (uint32_t), sizeof (uint32_t));
+        if (datagram_size != h->d.header.numBytesDgm) {
+            cpl_debug (kma_debug, "Invalid datagram size at end of datagram (%u,%u)\n", datagram_size, h->d.header.numBytesDgm);
+            goto L2;
+        }
     }
 
-    actual_read_size = (size_t) result;
+    /* Join the partitions and set the datagram pointers into the body p. */
+    if (h->timing) {
+        parse_start = cpl_clock_ns ();
+        status = kma_parse (h, p, read_size);
+        parse_time += cpl_clock_ns () - parse_start;
+    } else {
+        status = kma_parse (h, p, read_size);
+    }
 
-    /* Make sure we read at least the minimum size. */
-    if (actual_read_size != read_size) {
-        /* If the expected amount was not read, then the file is corrupt. */
-        cpl_debug (kma_debug, "Unexpected end of file\n");
-        h->kma_errno = CS_EBADDATA;
+    if (status < 0) {
+        h->kma_errno = status;
         return NULL;
     }
 
-    /* Set the pointer p to the buffer, which is the start of the datagram (after the header). */
-    p = h->buffer;
+    /* Now go back and read the next partition. */
+    if (status == 0) goto L1;
 
-    /* Set the pointers of the datagram array (channel) data into the correct places in the buffer. */
-    switch (h->d.header.dgmType) {
+    kma_count_datagram (h, start, parse_time);
 
-        case KMA_DATAGRAM_IIP :
+    return &(h->d);
 
-            h->d.datagram.iip.data = (kma_datagram_iip_data *) p;
-            p += sizeof (kma_datagram_iip_data);
-            h->d.datagram.iip.install_text = (uint8_t *) p;
+    /* The datagram at the saved offset is corrupt, so search for the next valid datagram. */
+L2: status = kma_resync (h, offset);
 
-            datagram_size = h->d.datagram.iip.data->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+    /* Now go back and read the datagram that was found. */
+    if (status > 0) goto L1;
 
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected IIP datagram size (%u,%u)\n", h->d.datagram.iip.data->numBytesCmnPart, h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
+    if (status < 0) h->kma_errno = status;
 
-            break;
+    return NULL;
+}
 
-        case KMA_DATAGRAM_IOP :
 
-            h->d.datagram.iop.data = (kma_datagram_iop_data *) p;
-            p += sizeof (kma_datagram_iop_data);
-            h->d.datagram.iop.runtime_text = (uint8_t *) p;
+/******************************************************************************
+*
+* kma_retain - Retain the datagram returned by the last call to kma_read() for
+*   the file handle H, so it stays valid after further datagrams are read.  The
+*   datagram of a memory-mapped file points into the map and is not copied,
+*   which includes all datagrams read using kma_open_mmap() except joined
+*   partitions.  Otherwise, the datagram body is copied to a buffer owned by the
+*   retained datagram, and its pointers are set to the copy.  The buffers of
+*   released datagrams are reused, so holding a window of N pings costs N
+*   buffers that are allocated only once.  The caller must call kma_release()
+*   when finished, and all retained datagrams are freed by kma_close().
+*
+* Return: A pointer to the retained kma_data struct, or
+*         NULL if no datagram was read or memory allocation failed.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*
+******************************************************************************/
 
-            datagram_size = h->d.datagram.iop.data->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+kma_data * kma_retain (
+    kma_handle *h) {
 
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected IOP datagram size (%u,%u)\n", h->d.datagram.iop.data->numBytesCmnPart, h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
+    kma_retained *r;
+    size_t size;
+    char *buffer;
 
-            break;
 
-        case KMA_DATAGRAM_IBE :
+    assert (h);
 
-            h->d.datagram.ibe.data = (kma_datagram_b_data *) p;
-            p += sizeof (kma_datagram_b_data);
-            h->d.datagram.ibe.bist_text = (uint8_t *) p;
+    if (!h->body) {
+        h->kma_errno = CS_EINVAL;
+        return NULL;
+    }
 
-            datagram_size = h->d.datagram.ibe.data->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+    size = h->d.header.numBytesDgm - sizeof (kma_datagram_header);
 
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected IBE datagram size (%u,%u)\n", h->d.datagram.ibe.data->numBytesCmnPart, h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
+    /* Reuse a released datagram, which keeps its buffer, before allocating a new one. */
+    if (h->released) {
+        r = h->released;
+        h->released = r->next_free;
+    } else {
+        r = (kma_retained *) cpl_malloc (sizeof (kma_retained));
+        if (!r) {
+            h->kma_errno = CS_ENOMEM;
+            return NULL;
+        }
 
-            break;
+        r->buffer = NULL;
+        r->buffer_size = 0;
+        r->next = h->retained;
+        h->retained = r;
+    }
 
-        case KMA_DATAGRAM_IBR :
+    r->next_free = NULL;
+    r->d = h->d;
 
-            h->d.datagram.ibr.data = (kma_datagram_b_data *) p;
-            p += sizeof (kma_datagram_b_data);
-            h->d.datagram.ibr.bist_text = (uint8_t *) p;
+    /* The contents of the map do not change, so only a joined datagram needs a copy. */
+    if (h->map && (h->body >= h->map) && (h->body + size <= h->map + h->map_size)) {
+        return &(r->d);
+    }
 
-            datagram_size = h->d.datagram.ibr.data->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+    buffer = (char *) cpl_resize (r->buffer, size, sizeof (char), &(r->buffer_size));
+    if (!buffer) {
+        r->buffer = NULL;
+        r->buffer_size = 0;
+        r->next_free = h->released;
+        h->released = r;
+        h->kma_errno = CS_ENOMEM;
+        return NULL;
+    }
 
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected IBR datagram size (%u,%u)\n", h->d.datagram.ibr.data->numBytesCmnPart, h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
+    r->buffer = buffer;
+    memcpy (r->buffer, h->body, size);
+    kma_relocate (&(r->d.datagram), h->body, size, r->buffer);
 
-            break;
+    return &(r->d);
+}
 
-        case KMA_DATAGRAM_IBS :
 
-            h->d.datagram.ibs.data = (kma_datagram_b_data *) p;
-            p += sizeof (kma_datagram_b_data);
-            h->d.datagram.ibs.bist_text = (uint8_t *) p;
+/******************************************************************************
+*
+* kma_release - Release the datagram D retained by kma_retain() for the file
+*   handle H, so its buffer may be reused by a later call to kma_retain().  If D
+*   is NULL, then nothing is done.
+*
+******************************************************************************/
 
-            datagram_size = h->d.datagram.ibs.data->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+void kma_release (
+    kma_handle *h,
+    kma_data *d) {
 
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected IBS datagram size (%u,%u)\n", h->d.datagram.ibs.data->numBytesCmnPart, h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
+    kma_retained *r;
 
-            break;
 
-        case KMA_DATAGRAM_MRZ :
+    assert (h);
 
-            h->d.datagram.mrz.partition = (kma_datagram_m_partition *) p;
-            p += sizeof (kma_datagram_m_partition);
+    if (!d) return;
 
-            if ((h->d.datagram.mrz.partition->dgmNum != 1) || (h->d.datagram.mrz.partition->numOfDgms != 1)) {
-                cpl_debug (kma_debug, "Unexpected datagram partition (%u,%u)\n", h->d.datagram.mrz.partition->dgmNum, h->d.datagram.mrz.partition->numOfDgms);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            /* TODO: Sanity check that all pointers are contained within the datagram buffer. */
-            h->d.datagram.mrz.common = (kma_datagram_m_common *) p;
-            p += h->d.datagram.mrz.common->numBytesCmnPart;
-            h->d.datagram.mrz.pingInfo = (kma_datagram_mrz_ping_info *) p;
-            p += h->d.datagram.mrz.pingInfo->numBytesInfoData;
-            if (h->d.header.dgmVersion == 0) {
-                h->d.datagram.mrz.txSectorInfo.v0 = (kma_datagram_mrz_tx_sector_info_v0 *) p;
-                h->d.datagram.mrz.txSectorInfo.v1 = NULL;
-            } else {
-                h->d.datagram.mrz.txSectorInfo.v0 = NULL;
-                h->d.datagram.mrz.txSectorInfo.v1 = (kma_datagram_mrz_tx_sector_info_v1 *) p;
-            }
-            p += h->d.datagram.mrz.pingInfo->numTxSectors * h->d.datagram.mrz.pingInfo->numBytesPerTxSector;
-            h->d.datagram.mrz.rxInfo = (kma_datagram_mrz_rx_info *) p;
-            p += h->d.datagram.mrz.rxInfo->numBytesRxInfo;
-            h->d.datagram.mrz.extraDetInfo = (kma_datagram_mrz_extra_det_info *) p;
-            p += h->d.datagram.mrz.rxInfo->numExtraDetectionClasses * h->d.datagram.mrz.rxInfo->numBytesPerClass;
-            h->d.datagram.mrz.sounding = (kma_datagram_mrz_sounding *) p;
-            p += (h->d.datagram.mrz.rxInfo->numSoundingsMaxMain + h->d.datagram.mrz.rxInfo->numExtraDetections) * h->d.datagram.mrz.rxInfo->numBytesPerSounding;
-            h->d.datagram.mrz.sample = (int16_t *) p;
-
-            if (h->d.datagram.mrz.pingInfo->numTxSectors == 0) {
-                h->d.datagram.mrz.txSectorInfo.v0 = NULL;
-                h->d.datagram.mrz.txSectorInfo.v1 = NULL;
-            }
-
-            if (h->d.datagram.mrz.rxInfo->numExtraDetectionClasses == 0) {
-                h->d.datagram.mrz.extraDetInfo = NULL;
-            }
-
-            if (h->d.datagram.mrz.rxInfo->numSoundingsMaxMain + h->d.datagram.mrz.rxInfo->numExtraDetections == 0) {
-                h->d.datagram.mrz.sounding = NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_MWC :
-
-            h->d.datagram.mwc.partition = (kma_datagram_m_partition *) p;
-            p += sizeof (kma_datagram_m_partition);
-
-            if ((h->d.datagram.mwc.partition->dgmNum != 1) || (h->d.datagram.mwc.partition->numOfDgms != 1)) {
-                cpl_debug (kma_debug, "Unexpected datagram partition (%u,%u)\n", h->d.datagram.mwc.partition->dgmNum, h->d.datagram.mwc.partition->numOfDgms);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            /* TODO: Sanity check that all pointers are contained within the datagram buffer. */
-            h->d.datagram.mwc.common = (kma_datagram_m_common *) p;
-            p += h->d.datagram.mwc.common->numBytesCmnPart;
-            h->d.datagram.mwc.txInfo = (kma_datagram_mwc_tx_info *) p;
-            p += h->d.datagram.mwc.txInfo->numBytesTxInfo;
-            h->d.datagram.mwc.txSectorInfo = (kma_datagram_mwc_tx_sector_info *) p;
-            p += h->d.datagram.mwc.txInfo->numTxSectors * h->d.datagram.mwc.txInfo->numBytesPerTxSector;
-            h->d.datagram.mwc.rxInfo = (kma_datagram_mwc_rx_info *) p;
-            p += h->d.datagram.mwc.rxInfo->numBytesRxInfo;
-            h->d.datagram.mwc.beamData = (uint8_t *) p;
-
-            if (h->d.datagram.mwc.rxInfo->numBeams == 0) {
-                h->d.datagram.mwc.beamData = NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_SPO :
-
-            h->d.datagram.spo.common = (kma_datagram_s_common *) p;
-            p += h->d.datagram.spo.common->numBytesCmnPart;
-            h->d.datagram.spo.data = (kma_datagram_spo_data *) p;
-            p += sizeof (kma_datagram_spo_data);
-            h->d.datagram.spo.dataFromSensor = (uint8_t *) p;
-
-            datagram_size = h->d.datagram.spo.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
-
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected SPO datagram size (%u,%u)\n", h->d.datagram.spo.common->numBytesCmnPart, h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_SKM :
-
-            h->d.datagram.skm.info = (kma_datagram_skm_info *) p;
-            p += h->d.datagram.skm.info->numBytesInfoPart;
-            h->d.datagram.skm.data = (kma_datagram_skm_sample *) p;
-
-            datagram_size = h->d.datagram.skm.info->numBytesInfoPart + ((uint32_t) h->d.datagram.skm.info->numBytesPerSample) * h->d.datagram.skm.info->numSamples +
-                sizeof (kma_datagram_header) + sizeof (uint32_t);
-
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected SKM datagram size (%u)\n", h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            if (h->d.datagram.skm.info->numSamples == 0) {
-                h->d.datagram.skm.data = NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_SVP :
-
-            h->d.datagram.svp.info = (kma_datagram_svp_info *) p;
-            p += h->d.datagram.svp.info->numBytesInfoPart;
-            h->d.datagram.svp.data = (kma_datagram_svp_sample *) p;
-
-            datagram_size = h->d.datagram.svp.info->numBytesInfoPart + h->d.datagram.svp.info->numSamples * sizeof (kma_datagram_svp_sample) + sizeof (kma_datagram_header) + sizeof (uint32_t);
-
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected SVP datagram size (%u,%u)\n", h->d.datagram.svp.info->numSamples, h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            if (h->d.datagram.svp.info->numSamples == 0) {
-                h->d.datagram.svp.data = NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_SVT :
-
-            h->d.datagram.svt.info = (kma_datagram_svt_info *) p;
-            p += h->d.datagram.svt.info->numBytesInfoPart;
-            h->d.datagram.svt.data = (kma_datagram_svt_sample *) p;
-
-            datagram_size = h->d.datagram.svt.info->numBytesInfoPart + ((uint32_t) h->d.datagram.svt.info->numBytesPerSample) * h->d.datagram.svt.info->numSamples + sizeof (kma_datagram_header) + sizeof (uint32_t);
-
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected SVT datagram size (%u,%u)\n", h->d.datagram.svt.info->numSamples, h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            if (h->d.datagram.svp.info->numSamples == 0) {
-                h->d.datagram.svp.data = NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_SCL :
-
-            h->d.datagram.scl.common = (kma_datagram_s_common *) p;
-            p += h->d.datagram.scl.common->numBytesCmnPart;
-            h->d.datagram.scl.data = (kma_datagram_scl_data *) p;
-            p += sizeof (kma_datagram_scl_data);
-            h->d.datagram.scl.dataFromSensor = (uint8_t *) p;
-
-            datagram_size = h->d.datagram.scl.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
-
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected SCL datagram size (%u)\n", h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_SDE :
-
-            h->d.datagram.sde.common = (kma_datagram_s_common *) p;
-            p += h->d.datagram.sde.common->numBytesCmnPart;
-            if (h->d.header.dgmVersion == 0) {
-                h->d.datagram.sde.data.v0 = (kma_datagram_sde_data_v0 *) p;
-                h->d.datagram.sde.data.v1 = NULL;
-                p += sizeof (kma_datagram_sde_data_v0);
-            } else if (h->d.header.dgmVersion >= 1) {
-                h->d.datagram.sde.data.v0 = NULL;
-                h->d.datagram.sde.data.v1 = (kma_datagram_sde_data_v1 *) p;
-                p += sizeof (kma_datagram_sde_data_v1);
-            }
-            h->d.datagram.sde.dataFromSensor = (uint8_t *) p;
-
-            datagram_size = h->d.datagram.sde.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
-
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected SDE datagram size (%u)\n", h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_SHI :
-
-            h->d.datagram.shi.common = (kma_datagram_s_common *) p;
-            p += h->d.datagram.shi.common->numBytesCmnPart;
-            h->d.datagram.shi.data = (kma_datagram_shi_data *) p;
-            p += sizeof (kma_datagram_shi_data);
-            h->d.datagram.shi.dataFromSensor = (uint8_t *) p;
-
-            datagram_size = h->d.datagram.shi.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
-
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected SHI datagram size (%u)\n", h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_CPO :
-
-            h->d.datagram.cpo.common = (kma_datagram_s_common *) p;
-            p += h->d.datagram.cpo.common->numBytesCmnPart;
-            h->d.datagram.cpo.data = (kma_datagram_cpo_data *) p;
-            p += sizeof (kma_datagram_cpo_data);
-            h->d.datagram.cpo.dataFromSensor = (uint8_t *) p;
-
-            datagram_size = h->d.datagram.cpo.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
-
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected CPO datagram size (%u)\n", h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_CHE :
-
-            h->d.datagram.che.common = (kma_datagram_m_common *) p;
-            p += h->d.datagram.che.common->numBytesCmnPart;
-            h->d.datagram.che.data = (kma_datagram_che_data *) p;
-
-            datagram_size = h->d.datagram.che.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
-
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected CHE datagram size (%u)\n", h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            break;
-
-        case KMA_DATAGRAM_FCF :
-
-            h->d.datagram.fcf.partition = (kma_datagram_m_partition *) p;
-            p += sizeof (kma_datagram_m_partition);
-            h->d.datagram.fcf.common = (kma_datagram_f_common *) p;
-            h->d.datagram.fcf.fileName = (char *) (p + sizeof (kma_datagram_f_common));
-            p += h->d.datagram.fcf.common->numBytesCmnPart;
-            h->d.datagram.fcf.bsCalibrationFile = (uint8_t *) p;
-
-            datagram_size = h->d.datagram.fcf.common->numBytesCmnPart + sizeof (kma_datagram_m_partition) + sizeof (kma_datagram_header) + sizeof (uint32_t);
-
-            if (datagram_size > h->d.header.numBytesDgm) {
-                cpl_debug (kma_debug, "Unexpected FCF datagram size (%u)\n", h->d.header.numBytesDgm);
-                h->kma_errno = CS_EBADDATA;
-                return NULL;
-            }
-
-            break;
-
-        default :
-
-            cpl_debug (kma_debug, "Unknown message type (%u) of size %u bytes\n",
-                h->d.header.dgmType, h->d.header.numBytesDgm);
-
-            break;
-    }
-
-    return &(h->d);
-}
+    /* The kma_data struct is the first member of the retained datagram. */
+    r = (kma_retained *) d;
+    r->next_free = h->released;
+    h->released = r;
+}
 
 
 /******************************************************************************
@@ -1866,6 +2045,7 @@ void kma_set_ignore_mwc (
     const int ignore_mwc) {
 
     assert (h);
+    kma_prefetch_stop (h);
     h->ignore_mwc = ignore_mwc;
 }
 
@@ -1882,262 +2062,5514 @@ void kma_set_ignore_mrz (
     const int ignore_mrz) {
 
     assert (h);
+    kma_prefetch_stop (h);
     h->ignore_mrz = ignore_mrz;
 }
 
 
 /******************************************************************************
 *
-* kma_get_mwc_rx_beam_data - The MWC RX beam data stored in the .kmall format
-*   consists of the kma_datagram_mwc_rx_beam_data struct followed by numSamples
-*   of amplitude data and optionally 8-bit or 16-bit phase data.  This function
-*   will set the pointers in the Rx beam data object D for the data stream
-*   starting at P with PHASE_FLAG.  The start of the next RX beam data stream
-*   will be returned.  Note: Check sample and beamphase arrays are not NULL
-*   when function returns.
-*
-* Return: A pointer to the next RX beam data, or
-*         NULL if numBytesPerBeamEntry is invalid.
+* kma_set_resync - Set the boolean to resynchronize after corrupt data while
+*   reading data from the file handle H.  If set, then an invalid datagram
+*   header, a datagram size that does not agree with the size at the end of the
+*   datagram, or a truncated datagram causes kma_read() to search forward for
+*   the next valid datagram instead of returning an error.
 *
 ******************************************************************************/
 
-const uint8_t * kma_get_mwc_rx_beam_data (
-    kma_datagram_mwc_rx_beam *d,
-    const uint8_t *p,
-    const uint8_t phase_flag,
-    const uint8_t numBytesPerBeamEntry) {
-
-    assert (d);
-    assert (p);
+void kma_set_resync (
+    kma_handle *h,
+    const int resync) {
 
-    d->data = NULL;
-    d->sampleAmplitude_05dB = NULL;
-    d->rxBeamPhase1 = NULL;
-    d->rxBeamPhase2 = NULL;
+    assert (h);
+    kma_prefetch_stop (h);
+    h->resync = resync;
+}
 
-    if (numBytesPerBeamEntry == 0) {
-        cpl_debug (kma_debug, "Invalid numBytesPerBeamEntry\n");
-        return NULL;
-    }
 
-    d->data = (kma_datagram_mwc_rx_beam_data *) p;
-    p = p + numBytesPerBeamEntry;
+/******************************************************************************
+*
+* kma_get_resync_info - Store the number of bytes and the number of corrupt
+*   datagrams skipped in resync mode by the file handle H in BYTES and COUNT.
+*   Consecutive corrupt datagrams are counted as one.
+*
+******************************************************************************/
 
-    if (d->data->numSamples > 0) {
-        d->sampleAmplitude_05dB = (int8_t *) p;
-        p = p + d->data->numSamples * sizeof (int8_t);
+void kma_get_resync_info (
+    const kma_handle *h,
+    uint64_t *bytes,
+    uint64_t *count) {
 
-        if (phase_flag == KMA_MWC_RX_PHASE_LOW) {
-            d->rxBeamPhase1 = (int8_t *) p;
-            p = p + d->data->numSamples * sizeof (int8_t);
-        } else if (phase_flag == KMA_MWC_RX_PHASE_HIGH) {
-            d->rxBeamPhase2 = (int16_t *) p;
-            p = p + d->data->numSamples * sizeof (int16_t);
-        }
-    }
+    assert (h);
+    assert (bytes);
+    assert (count);
 
-    return p;
+    *bytes = h->resync_bytes;
+    *count = h->resync_count;
 }
 
 
 /******************************************************************************
 *
-* kma_get_errno - Return the error number from the last call.
+* kma_set_nav - Set the navigation store NAV, which must be initialized with
+*   cpl_nav_init(), to collect the KM binary samples of the SKM datagrams read
+*   from the file handle H.  The position, attitude, and heading of each sample
+*   are stored in time order by kma_read(), except for fields that are marked
+*   as invalid in the sample status.  The store is not freed by kma_close(),
+*   so the samples of several files can be collected.  If NAV is NULL, then no
+*   more samples are stored.
 *
 ******************************************************************************/
 
-int kma_get_errno (
-    const kma_handle *h) {
+void kma_set_nav (
+    kma_handle *h,
+    cpl_nav *nav) {
 
     assert (h);
-    return h->kma_errno;
+    h->nav = nav;
 }
 
 
 /******************************************************************************
 *
-* kma_identify - Determine if the file given by FILE_NAME is a KMA file.
+* kma_set_type_filter - Set the datagram types to read from the file handle H.
+*   If EXCLUDE is false, then only datagrams with one of the N types given by
+*   TYPES are read, otherwise datagrams with these types are skipped.  Skipped
+*   datagrams are not read into memory.  If N is zero, then the filter is
+*   removed and all datagram types are read.
 *
-* Return: 1 if the file is a KMA file,
-*         0 if the file is not a KMA file, or
+* Return: 0 if the filter was set successfully, or
 *         error condition if an error occurred.
 *
-* Errors: CS_EOPEN
-*         CS_EREAD
+* Errors: CS_EINVAL
+*         CS_ENOMEM
 *
 ******************************************************************************/
 
-int kma_identify (
-    const char *file_name) {
+int kma_set_type_filter (
+    kma_handle *h,
+    const uint32_t *types,
+    const size_t n,
+    const int exclude) {
 
-    kma_datagram_header header;
-    size_t actual_read_size;
-    size_t read_size;
-    ssize_t result;
-    int fd;
+    uint32_t *filter = NULL;
 
 
-    if (!file_name) return 0;
+    assert (h);
 
-    /* TODO: Read and validate several datagram headers instead of just one.  This will
-       increase accuracy of id. */
+    if (kma_prefetch_stop (h) != 0) return h->kma_errno;
 
-    /* Open the binary file for read-only access or return on failure. */
-    fd = cpl_open (file_name, CPL_OPEN_RDONLY | CPL_OPEN_BINARY | CPL_OPEN_SEQUENTIAL);
+    if ((n > 0) && (types == NULL)) {
+        h->kma_errno = CS_EINVAL;
+        return CS_EINVAL;
+    }
 
-    if (fd < 0) {
-        cpl_debug (kma_debug, "Open failed for file '%s'\n", file_name);
-        return CS_EOPEN;
+    if (n > 0) {
+        filter = (uint32_t *) cpl_malloc (n * sizeof (uint32_t));
+        if (!filter) {
+            h->kma_errno = CS_ENOMEM;
+            return CS_ENOMEM;
+        }
+
+        memcpy (filter, types, n * sizeof (uint32_t));
     }
 
-    read_size = sizeof (kma_datagram_header);
+    cpl_free (h->filter);
 
-    /* Read the datagram header and close the file. */
-    result = cpl_read (&header, read_size, fd);
-    cpl_close (fd);
+    h->filter = filter;
+    h->filter_size = n;
+    h->filter_exclude = exclude;
 
-    if (result < 0) {
-        cpl_debug (kma_debug, "Read error occurred for file '%s'\n", file_name);
-        return CS_EREAD;
-    }
+    return CS_ENONE;
+}
 
-    actual_read_size = (size_t) result;
 
-    /* Make sure we read at least the minimum size. */
-    if (actual_read_size != read_size) {
-        cpl_debug (kma_debug, "Unexpected end of file for file '%s'\n", file_name);
-        return 0;
+/******************************************************************************
+*
+* kma_set_block_size - Set the number of bytes read from the file at a time by
+*   the file handle H to BLOCK_SIZE.  Datagrams are served from this block, so a
+*   larger block reduces the number of system calls.  If BLOCK_SIZE is zero, then
+*   the default of CPL_BFILE_BLOCK_SIZE bytes is used.  This has no effect on a
+*   memory-mapped file.
+*
+******************************************************************************/
+
+void kma_set_block_size (
+    kma_handle *h,
+    const size_t block_size) {
+
+    assert (h);
+    kma_prefetch_stop (h);
+    cpl_bfile_set_block_size (&(h->io), block_size);
+}
+
+
+/******************************************************************************
+*
+* kma_set_async_io - Keep DEPTH reads of the block size in flight ahead of the
+*   datagrams being parsed for the file handle H, which lets one thread keep a
+*   fast device busy, especially when reading many files at once.  On Linux,
+*   the reads are queued with io_uring, and elsewhere they are made with pread.
+*   If DIRECT is non-zero, then the file is read with O_DIRECT where supported,
+*   so a large file does not evict other data from the page cache.  Each read
+*   is the block size set by kma_set_block_size() before this call, rounded up
+*   to a multiple of CPL_BFILE_ALIGN bytes.  Seeking and the index work as before.
+*   If DEPTH is zero, then the file is read with plain blocking reads.  This has
+*   no effect on a memory-mapped file.
+*
+* Return: 0 if the reads were set successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EUNSUP if the file does not support seeking
+*
+******************************************************************************/
+
+int kma_set_async_io (
+    kma_handle *h,
+    const size_t depth,
+    const int direct) {
+
+    assert (h);
+
+    if (h->map) return CS_ENONE;
+
+    if (kma_prefetch_stop (h) != 0) return h->kma_errno;
+
+    if (cpl_bfile_set_async (&(h->io), depth, direct ? CPL_BFILE_DIRECT : 0) != 0) {
+        h->kma_errno = (errno == ENOMEM) ? CS_ENOMEM : CS_EUNSUP;
+        return h->kma_errno;
     }
 
-    /* Validate the header and return the result. */
-    return kma_valid_header (&header);
+    return CS_ENONE;
 }
 
 
 /******************************************************************************
 *
-* kma_valid_header - Return non-zero if the header HEADER appears to be valid.
+* kma_set_prefetch - Read datagrams ahead on an I/O thread for the file handle
+*   H, which fills a ring of DEPTH buffers that are each allocated with at least
+*   BUFFER_SIZE bytes and grow to fit larger datagrams.  The I/O thread reads,
+*   validates, and joins the datagrams, and kma_read() takes them from the ring
+*   in file order without a lock, so parsing overlaps the file reads.  The ring
+*   is flushed and read-ahead restarts at the new file position after a seek,
+*   an index is built, or the file is scanned, and changes to the read options
+*   take effect from the datagram after the last one returned.  If DEPTH is
+*   zero, then datagrams are read by the calling thread again.  Any data
+*   returned by a previous call to kma_read() is no longer valid.
 *
-* Return: 1 if the header is valid,
-*         0 otherwise.
+* Return: 0 if read-ahead was set successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EUNSUP if the I/O thread could not be created
+*         CS_ESEEK
 *
 ******************************************************************************/
 
-static int kma_valid_header (
-    const kma_datagram_header *header) {
+int kma_set_prefetch (
+    kma_handle *h,
+    const size_t depth,
+    const size_t buffer_size) {
 
-    assert (header);
+    kma_prefetch *p;
+    size_t i;
 
-    /* Datagram size must be at least as large as the header plus 4-byte length field. */
-    if (header->numBytesDgm < sizeof (kma_datagram_header) + 4) {
-        cpl_debug (kma_debug, "Invalid datagram size (%u)\n", header->numBytesDgm);
-        return 0;
+
+    assert (h);
+
+    /* Any previous read-ahead returns the file position of the last datagram. */
+    if (h->prefetch) {
+        if (kma_prefetch_stop (h) != 0) return h->kma_errno;
+        kma_prefetch_free (h);
     }
 
-    /* Make sure the datagram size is not unreasonably large, but be generous. */
-    if (header->numBytesDgm > 1<<30) {
-        cpl_debug (kma_debug, "Invalid datagram size (%u)\n", header->numBytesDgm);
-        return 0;
+    if (depth == 0) return CS_ENONE;
+
+    p = (kma_prefetch *) cpl_malloc (sizeof (kma_prefetch));
+    if (!p) {
+        h->kma_errno = CS_ENOMEM;
+        return CS_ENOMEM;
     }
 
-    /* Verify that the datagram type field starts with '#'. */
-    if ((header->dgmType & 0x000000FF) != 0x00000023) {
-        cpl_debug (kma_debug, "Invalid datagram magic byte (%u)\n", header->dgmType);
-        return 0;
+    p->slots = (kma_prefetch_slot *) cpl_calloc (depth, sizeof (kma_prefetch_slot));
+    if (!p->slots) {
+        cpl_free (p);
+        h->kma_errno = CS_ENOMEM;
+        return CS_ENOMEM;
     }
 
-    /* Verify nanosecond field is not out of range. */
-    if (header->time_nanosec > 1e9) {
-        cpl_debug (kma_debug, "Invalid time field (%u)\n", header->time_nanosec);
-        return 0;
+    p->depth = depth;
+    p->ready = NULL;
+    p->free = NULL;
+    p->last = NULL;
+    p->position = 0;
+    p->count = 0;
+    p->stalls = 0;
+    p->running = 0;
+    p->worker = NULL;
+
+    /* The buffers are freed by kma_prefetch_free() if anything fails. */
+    h->prefetch = p;
+
+    if (buffer_size > 0) {
+        for (i=0; i<depth; i++) {
+            p->slots[i].buffer = (char *) cpl_malloc (buffer_size);
+            if (!p->slots[i].buffer) {
+                kma_prefetch_free (h);
+                h->kma_errno = CS_ENOMEM;
+                return CS_ENOMEM;
+            }
+            p->slots[i].buffer_size = buffer_size;
+        }
     }
 
-    /* We could check the datagram type field against the known datagrams, but could
-       never guarantee we don't encounter a new or undocumented datagram type. */
+    p->worker = cpl_worker_create ();
+    if (!p->worker) {
+        kma_prefetch_free (h);
+        h->kma_errno = CS_EUNSUP;
+        return CS_EUNSUP;
+    }
 
-    return 1;
+    return CS_ENONE;
 }
 
 
 /******************************************************************************
 *
-* kma_set_debug - Set the debugging output level for the KMA reader.
+* kma_set_decode_threads - Decode THREADS frames of a compressed file ahead of
+*   the reader of the file handle H on as many threads, or decode each frame by
+*   the calling thread when it is read if THREADS is zero.  The frames are
+*   decoded independently, so the threads keep a fast device busy while
+*   kma_read() parses the decoded data.  This has no effect unless the file is
+*   compressed.
+*
+* Return: 0 if the threads were set successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ESEEK
 *
 ******************************************************************************/
 
-void kma_set_debug (
-    const int debug) {
+int kma_set_decode_threads (
+    kma_handle *h,
+    const size_t threads) {
 
-    kma_debug = debug;
+    assert (h);
+
+    if (kma_prefetch_stop (h) != 0) return h->kma_errno;
+
+    cpl_bfile_set_threads (&(h->io), threads);
+
+    return CS_ENONE;
 }
 
 
 /******************************************************************************
 *
-* kma_get_datagram_name - Return a character string of the name of the datagram
-*   given by DGMTYPE.  This string should not be modified by the caller.
+* kma_get_prefetch_info - Store the number of datagrams read ahead on the I/O
+*   thread of the file handle H and the number of times kma_read() found the
+*   ring empty and waited for the I/O thread in COUNT and STALLS.  A stall count
+*   close to the datagram count means the read is limited by the file I/O, and
+*   a low count means the I/O is hidden behind the processing of the data.
 *
 ******************************************************************************/
 
-const char * kma_get_datagram_name (
-    const uint32_t dgmType) {
+void kma_get_prefetch_info (
+    const kma_handle *h,
+    uint64_t *count,
+    uint64_t *stalls) {
 
-    const char *s;
+    assert (h);
+    assert (count);
+    assert (stalls);
+
+    if (h->prefetch) {
+        *count = h->prefetch->count;
+        *stalls = h->prefetch->stalls;
+    } else {
+        *count = 0;
+        *stalls = 0;
+    }
+}
 
 
-    switch (dgmType) {
+/******************************************************************************
+*
+* kma_set_timing - Set the boolean to measure the time spent reading and
+*   parsing each datagram returned by the file handle H.  The times are added
+*   to the read statistics and given to the trace function.  Timing reads a
+*   clock three times per datagram, so it is not enabled by default.  With
+*   read-ahead, the time spent waiting for the I/O thread is counted as I/O.
+*
+******************************************************************************/
 
-        case KMA_DATAGRAM_IIP : s = "IIP"; break;
-        case KMA_DATAGRAM_IOP : s = "IOP"; break;
-        case KMA_DATAGRAM_IBE : s = "IBE"; break;
-        case KMA_DATAGRAM_IBR : s = "IBR"; break;
-        case KMA_DATAGRAM_IBS : s = "IBS"; break;
-        case KMA_DATAGRAM_MRZ : s = "MRZ"; break;
-        case KMA_DATAGRAM_MWC : s = "MWC"; break;
-        case KMA_DATAGRAM_SPO : s = "SPO"; break;
-        case KMA_DATAGRAM_SKM : s = "SKM"; break;
-        case KMA_DATAGRAM_SVP : s = "SVP"; break;
-        case KMA_DATAGRAM_SVT : s = "SVT"; break;
-        case KMA_DATAGRAM_SCL : s = "SCL"; break;
-        case KMA_DATAGRAM_SDE : s = "SDE"; break;
-        case KMA_DATAGRAM_SHI : s = "SHI"; break;
-        case KMA_DATAGRAM_CPO : s = "CPO"; break;
-        case KMA_DATAGRAM_CHE : s = "CHE"; break;
-        case KMA_DATAGRAM_FCF : s = "FCF"; break;
-        default               : s = "UNKNOWN"; break;
-    }
+void kma_set_timing (
+    kma_handle *h,
+    const int timing) {
 
-    return s;
+    assert (h);
+    h->timing = timing;
+}
+
+
+/******************************************************************************
+*
+* kma_set_trace - Set the trace function FN, which is called with the handle H,
+*   the datagram, the I/O and parse times in nanoseconds, and USER_DATA for
+*   each datagram returned by the handle, before the datagram is returned to
+*   the caller.  The times are zero unless kma_set_timing() is set.  With
+*   read-ahead, the function is called on the calling thread.  If FN is NULL,
+*   then no function is called, which costs nothing while reading.
+*
+******************************************************************************/
+
+void kma_set_trace (
+    kma_handle *h,
+    kma_trace_fn fn,
+    void *user_data) {
+
+    assert (h);
+
+    h->trace = fn;
+    h->trace_data = user_data;
+}
+
+
+/******************************************************************************
+*
+* kma_get_stats - Store the read statistics of the file handle H in STATS.  The
+*   datagrams and bytes are counted for the datagrams returned by the handle,
+*   and the reads, seeks, and bytes read include the datagrams that were
+*   skipped, the index, and the scan.  The reads and bytes of a push parser
+*   are the data given to it.  The times are only counted while timing is set
+*   by kma_set_timing().
+*
+******************************************************************************/
+
+void kma_get_stats (
+    const kma_handle *h,
+    kma_stats *stats) {
+
+    assert (h);
+    assert (stats);
+
+    *stats = h->stats;
+    stats->bytes_read = h->io.bytes_read;
+    stats->num_reads = h->io.num_reads;
+    stats->num_seeks = h->io.num_seeks;
+    stats->resync_bytes = h->resync_bytes;
+    stats->resync_count = h->resync_count;
 }
 
 
 /******************************************************************************
 *
-* set_buffer_size - Set the internal allocated read buffer size given by the
-*   file handle H to at least SIZE bytes.
+* kma_build_index - Build an index of all datagrams in the file given by the
+*   handle H.  Only the datagram headers are read, and the datagram bodies are
+*   skipped.  The index records the offset, size, type, and time of each
+*   datagram, which allows random access with kma_seek_to_index().  The file
+*   position is restored when finished, but any data returned by a previous call
+*   to kma_read() is no longer valid.  If an invalid datagram header is found,
+*   then the index contains the datagrams up to that point.
 *
-* Return: Non-zero if memory allocation failed.
+* Return: 0 if the index was built successfully, or
+*         error condition if an error occurred.
 *
 * Errors: CS_ENOMEM
+*         CS_EREAD
+*         CS_ESEEK
+*         CS_EBADDATA
+*         CS_EOVERFLOW if the file has more than UINT32_MAX datagrams
 *
 ******************************************************************************/
 
-static int set_buffer_size (
-    kma_handle *h,
-    const size_t size) {
+int kma_build_index (
+    kma_handle *h) {
+
+    kma_index_entry *entry;
+    uint64_t file_size;
+    uint64_t position;
+    uint64_t offset;
+    size_t alloc;
+    int status;
+
 
     assert (h);
 
-    if (size > h->buffer_size) {
+    if (kma_prefetch_stop (h) != 0) return h->kma_errno;
 
-        /* Allocate a new size of 1.5 * size bytes.  Use free/malloc instead of
-           realloc to avoid copying an empty buffer. */
-        h->buffer_size = size + (size + 1) / 2;
-        if (h->buffer) cpl_free (h->buffer);
+    kma_free_index (h);
 
-        h->buffer = (char *) cpl_malloc (h->buffer_size);
-        if (!h->buffer) return CS_ENOMEM;
+    /* The index is only useful if the file can be repositioned. */
+    if (kma_file_size (h, &file_size) != 0) {
+        cpl_debug (kma_debug, "Unable to get file size\n");
+        h->kma_errno = CS_ESEEK;
+        return CS_ESEEK;
     }
 
-    return 0;
+    position = kma_tell (h);
+
+    if (kma_seek (h, 0) != 0) {
+        h->kma_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    for (;;) {
+        offset = kma_tell (h);
+
+        status = kma_read_header (h);
+        if (status <= 0) break;
+
+        /* Stop at a truncated datagram at the end of the file. */
+        if (offset + h->d.header.numBytesDgm > file_size) {
+            cpl_debug (kma_debug, "Unexpected end of file\n");
+            status = CS_EBADDATA;
+            break;
+        }
+
+        /* The index file stores the number of entries in 32 bits. */
+        if (h->index_size == UINT32_MAX) {
+            cpl_debug (kma_debug, "Too many datagrams to index\n");
+            status = CS_EOVERFLOW;
+            break;
+        }
+
+        alloc = h->index_alloc;
+        entry = (kma_index_entry *) cpl_realloc2 (h->index, h->index_size, sizeof (kma_index_entry), &alloc);
+        if (!entry) {
+            status = CS_ENOMEM;
+            break;
+        }
+
+        h->index = entry;
+        h->index_alloc = alloc;
+        entry = &(h->index[h->index_size++]);
+
+        entry->offset = offset;
+        entry->numBytesDgm = h->d.header.numBytesDgm;
+        entry->dgmType = h->d.header.dgmType;
+        entry->time_sec = h->d.header.time_sec;
+        entry->time_nanosec = h->d.header.time_nanosec;
+
+        /* Skip the datagram body. */
+        status = kma_skip (h, h->d.header.numBytesDgm - sizeof (kma_datagram_header));
+        if (status != 0) break;
+    }
+
+    cpl_debug (kma_debug, "Indexed %lu datagrams\n", (unsigned long) h->index_size);
+
+    /* Keep the datagrams indexed before any invalid data, but discard the index on other errors. */
+    if ((status < 0) && (status != CS_EBADDATA)) {
+        kma_free_index (h);
+    } else if (kma_sort_index (h) != 0) {
+        kma_free_index (h);
+        status = CS_ENOMEM;
+    }
+
+    /* Restore the original file position. */
+    if ((kma_seek (h, position) != 0) && (status >= 0)) {
+        status = CS_ESEEK;
+    }
+
+    if (status < 0) {
+        h->kma_errno = status;
+        return status;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_save_index - Save the datagram index of the file handle H to the sidecar
+*   file given by FILE_NAME.  The index must have been created by calling
+*   kma_build_index() or kma_load_index().
+*
+* Return: 0 if the index was saved successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_EOPEN
+*         CS_EWRITE
+*         CS_ECLOSE
+*
+******************************************************************************/
+
+int kma_save_index (
+    const kma_handle *h,
+    const char *file_name) {
+
+    kma_index_file_header header;
+    uint64_t file_size;
+    FILE *fp;
+
+
+    assert (h);
+    assert (file_name);
+
+    if (!h->index_by_type) return CS_EINVAL;
+
+    if (kma_file_size (h, &file_size) != 0) return CS_EINVAL;
+
+    memcpy (header.magic, KMA_INDEX_MAGIC, sizeof (header.magic));
+    header.version = KMA_INDEX_VERSION;
+    header.byte_order = KMA_INDEX_BYTE_ORDER;
+    header.entry_size = sizeof (kma_index_entry);
+    header.num_entries = (uint32_t) h->index_size;
+    header.file_size = file_size;
+
+    fp = cpl_fopen (file_name, CPL_FOPEN_WRITE | CPL_FOPEN_BINARY);
+    if (!fp) return CS_EOPEN;
+
+    if ((fwrite (&header, sizeof (header), 1, fp) != 1) ||
+        ((h->index_size > 0) && (fwrite (h->index, sizeof (kma_index_entry), h->index_size, fp) != h->index_size))) {
+        cpl_debug (kma_debug, "Failed to write index file '%s'\n", file_name);
+        cpl_fclose (fp);
+        cpl_remove (file_name);
+        return CS_EWRITE;
+    }
+
+    if (cpl_fclose (fp) != 0) return CS_ECLOSE;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_load_index - Load the datagram index of the file handle H from the sidecar
+*   file given by FILE_NAME that was written by kma_save_index().  The index is
+*   rejected if it was not created for a file of the same size on a host of the
+*   same byte order, or if its entries are not in file order within the file.
+*
+* Return: 0 if the index was loaded successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EOPEN
+*         CS_EREAD
+*         CS_ESEEK
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+int kma_load_index (
+    kma_handle *h,
+    const char *file_name) {
+
+    kma_index_file_header header;
+    const kma_index_entry *e;
+    uint64_t file_size;
+    uint64_t end = 0;
+    size_t i, n;
+    FILE *fp;
+
+
+    assert (h);
+    assert (file_name);
+
+    kma_free_index (h);
+
+    if (kma_file_size (h, &file_size) != 0) return CS_ESEEK;
+
+    fp = cpl_fopen (file_name, CPL_FOPEN_READ | CPL_FOPEN_BINARY);
+    if (!fp) return CS_EOPEN;
+
+    if (cpl_fread (&header, sizeof (header), fp) != 1) {
+        cpl_fclose (fp);
+        return CS_EREAD;
+    }
+
+    if ((memcmp (header.magic, KMA_INDEX_MAGIC, sizeof (header.magic)) != 0) ||
+        (header.version != KMA_INDEX_VERSION) || (header.byte_order != KMA_INDEX_BYTE_ORDER) ||
+        (header.entry_size != sizeof (kma_index_entry)) || (header.file_size != file_size)) {
+        cpl_debug (kma_debug, "Invalid or out of date index file '%s'\n", file_name);
+        cpl_fclose (fp);
+        return CS_EBADDATA;
+    }
+
+    n = (size_t) header.num_entries;
+
+    if (n > 0) {
+        h->index = (kma_index_entry *) cpl_malloc (n * sizeof (kma_index_entry));
+        if (!h->index) {
+            cpl_fclose (fp);
+            return CS_ENOMEM;
+        }
+
+        h->index_alloc = n;
+
+        if (cpl_fread (h->index, n * sizeof (kma_index_entry), fp) != 1) {
+            cpl_fclose (fp);
+            kma_free_index (h);
+            return CS_EREAD;
+        }
+    }
+
+    cpl_fclose (fp);
+
+    /* The entries are used to seek, so they must be in file order and within the file. */
+    for (i=0; i<n; i++) {
+        e = &(h->index[i]);
+        if ((e->offset < end) || (e->offset > file_size) || (e->numBytesDgm < sizeof (kma_datagram_header)) ||
+            (e->numBytesDgm > file_size - e->offset)) {
+            cpl_debug (kma_debug, "Invalid index entry %lu in index file '%s'\n", (unsigned long) i, file_name);
+            kma_free_index (h);
+            return CS_EBADDATA;
+        }
+        end = e->offset + e->numBytesDgm;
+    }
+
+    h->index_size = n;
+
+    if (kma_sort_index (h) != 0) {
+        kma_free_index (h);
+        return CS_ENOMEM;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_get_index - Return the datagram index of the file handle H and store the
+*   number of entries in N.  The index is sorted in file order.
+*
+* Return: A pointer to the array of index entries, or
+*         NULL if no index has been built or loaded.
+*
+******************************************************************************/
+
+const kma_index_entry * kma_get_index (
+    const kma_handle *h,
+    size_t *n) {
+
+    assert (h);
+    assert (n);
+
+    *n = h->index_size;
+    return h->index;
+}
+
+
+/******************************************************************************
+*
+* kma_find_index - Find the N'th (starting from zero) datagram of type TYPE in
+*   the datagram index of the file handle H and store the index entry number in
+*   ENTRY.  Datagrams of the same type are counted in time order.  The
+*   partitions of a split MRZ or MWC datagram have the same time, as required
+*   by kma_join_partition(), so they are counted as one datagram and ENTRY is
+*   that of the first partition.  If TYPE is zero, then the N'th datagram of any
+*   type in file order is found.
+*
+* Return: 0 if the datagram was found, or
+*         error condition if it was not found.
+*
+* Errors: CS_EINVAL
+*         CS_EDOM
+*
+******************************************************************************/
+
+int kma_find_index (
+    const kma_handle *h,
+    const uint32_t type,
+    const size_t n,
+    size_t *entry) {
+
+    const kma_index_entry *e, *last = NULL;
+    size_t lo, hi, mid;
+    size_t i, count = 0;
+
+
+    assert (h);
+    assert (entry);
+
+    if (!h->index_by_type) return CS_EINVAL;
+
+    if (type == 0) {
+        if (n >= h->index_size) return CS_EDOM;
+        *entry = n;
+        return CS_ENONE;
+    }
+
+    /* Find the first entry of the given type. */
+    lo = 0;
+    hi = h->index_size;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (h->index[h->index_by_type[mid]].dgmType < type) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if ((n >= h->index_size - lo) || (h->index[h->index_by_type[lo + n]].dgmType != type)) {
+        return CS_EDOM;
+    }
+
+    if ((type != KMA_DATAGRAM_MRZ) && (type != KMA_DATAGRAM_MWC)) {
+        *entry = h->index_by_type[lo + n];
+        return CS_ENONE;
+    }
+
+    /* Count the pings, which start at the first of the entries with the same time. */
+    for (i=lo; i<h->index_size; i++) {
+        e = &(h->index[h->index_by_type[i]]);
+        if (e->dgmType != type) break;
+
+        if (!last || (e->time_sec != last->time_sec) || (e->time_nanosec != last->time_nanosec)) {
+            if (count++ == n) {
+                *entry = h->index_by_type[i];
+                return CS_ENONE;
+            }
+        }
+
+        last = e;
+    }
+
+    return CS_EDOM;
+}
+
+
+/******************************************************************************
+*
+* kma_find_index_time - Find the first datagram of type TYPE at or after the time
+*   given by TIME_SEC and TIME_NANOSEC in the datagram index of the file handle
+*   H and store the index entry number in ENTRY.  If TYPE is zero, then a
+*   datagram of any type is found.
+*
+* Return: 0 if the datagram was found, or
+*         error condition if it was not found.
+*
+* Errors: CS_EINVAL
+*         CS_EDOM
+*
+******************************************************************************/
+
+int kma_find_index_time (
+    const kma_handle *h,
+    const uint32_t type,
+    const uint32_t time_sec,
+    const uint32_t time_nanosec,
+    size_t *entry) {
+
+    const kma_index_entry *e;
+    const uint32_t *order;
+    uint64_t t;
+    size_t lo, hi, mid;
+
+
+    assert (h);
+    assert (entry);
+
+    if (!h->index_by_type) return CS_EINVAL;
+
+    t = kma_index_time (time_sec, time_nanosec);
+    order = type == 0 ? h->index_by_time : h->index_by_type;
+
+    /* Find the first entry not less than (type, time). */
+    lo = 0;
+    hi = h->index_size;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        e = &(h->index[order[mid]]);
+        if ((e->dgmType < type) ||
+            (((type == 0) || (e->dgmType == type)) && (kma_index_time (e->time_sec, e->time_nanosec) < t))) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if ((lo == h->index_size) || ((type != 0) && (h->index[order[lo]].dgmType != type))) {
+        return CS_EDOM;
+    }
+
+    *entry = order[lo];
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_seek_to_index - Set the file position of the file handle H to the datagram
+*   given by the index entry number ENTRY, so the next call to kma_read() will
+*   read this datagram.
+*
+* Return: 0 if the file position was set, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_EDOM
+*         CS_ESEEK
+*
+******************************************************************************/
+
+int kma_seek_to_index (
+    kma_handle *h,
+    const size_t entry) {
+
+    assert (h);
+
+    if (!h->index_by_type) {
+        h->kma_errno = CS_EINVAL;
+        return CS_EINVAL;
+    }
+
+    if (entry >= h->index_size) {
+        h->kma_errno = CS_EDOM;
+        return CS_EDOM;
+    }
+
+    if (kma_prefetch_stop (h) != 0) return h->kma_errno;
+
+    if (kma_seek (h, h->index[entry].offset) != 0) {
+        h->kma_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    /* Discard any partially joined datagram. */
+    h->part_num = 0;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_scan - Scan all datagrams in the file given by the handle H and store the
+*   number and size of the datagrams of each type, the time span, and the echo
+*   sounder identity in the summary S.  Only the datagram headers are read, and
+*   the datagram bodies are skipped.  The file position is restored when
+*   finished, but any data returned by a previous call to kma_read() is no
+*   longer valid.  If an invalid datagram header is found, then the summary
+*   contains the datagrams up to that point.
+*
+* Return: 0 if the file was scanned successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EREAD
+*         CS_ESEEK
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+int kma_scan (
+    kma_handle *h,
+    kma_scan_summary *s) {
+
+    const kma_datagram_header *header;
+    uint64_t file_size;
+    uint64_t position;
+    uint64_t offset;
+    uint64_t t, t_first, t_last;
+    size_t i, last_type;
+    int status;
+
+
+    assert (h);
+    assert (s);
+
+    memset (s, 0, sizeof (kma_scan_summary));
+
+    if (kma_prefetch_stop (h) != 0) return h->kma_errno;
+
+    if (kma_file_size (h, &file_size) != 0) {
+        cpl_debug (kma_debug, "Unable to get file size\n");
+        h->kma_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    position = kma_tell (h);
+
+    if (kma_seek (h, 0) != 0) {
+        h->kma_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    header = &(h->d.header);
+    t_first = t_last = 0;
+    last_type = 0;
+
+    for (;;) {
+        offset = kma_tell (h);
+
+        status = kma_read_header (h);
+        if (status <= 0) break;
+
+        /* Stop at a truncated datagram at the end of the file. */
+        if (offset + header->numBytesDgm > file_size) {
+            cpl_debug (kma_debug, "Unexpected end of file\n");
+            status = CS_EBADDATA;
+            break;
+        }
+
+        t = kma_index_time (header->time_sec, header->time_nanosec);
+
+        if (s->num_datagrams == 0) {
+            s->echoSounderID = header->echoSounderID;
+            s->systemID = header->systemID;
+            t_first = t_last = t;
+            s->first_time_sec = s->last_time_sec = header->time_sec;
+            s->first_time_nanosec = s->last_time_nanosec = header->time_nanosec;
+        } else if (t < t_first) {
+            t_first = t;
+            s->first_time_sec = header->time_sec;
+            s->first_time_nanosec = header->time_nanosec;
+        } else if (t > t_last) {
+            t_last = t;
+            s->last_time_sec = header->time_sec;
+            s->last_time_nanosec = header->time_nanosec;
+        }
+
+        s->num_datagrams++;
+        s->num_bytes += header->numBytesDgm;
+
+        /* Find the statistics for this type.  Datagrams of the same type tend to
+           appear together, so check the previous type first. */
+        if ((s->num_types == 0) || (s->type[last_type].dgmType != header->dgmType)) {
+            for (i=0; i<s->num_types; i++) {
+                if (s->type[i].dgmType == header->dgmType) break;
+            }
+
+            if (i == s->num_types) {
+                if (i < KMA_SCAN_MAX_TYPES) {
+                    s->type[i].dgmType = header->dgmType;
+                    s->num_types++;
+                } else {
+                    cpl_debug (kma_debug, "Too many datagram types (%u)\n", header->dgmType);
+                }
+            }
+
+            last_type = i;
+        }
+
+        if (last_type < s->num_types) {
+            s->type[last_type].count++;
+            s->type[last_type].bytes += header->numBytesDgm;
+        }
+
+        /* Skip the datagram body. */
+        status = kma_skip (h, header->numBytesDgm - sizeof (kma_datagram_header));
+        if (status != 0) break;
+    }
+
+    cpl_debug (kma_debug, "Scanned %lu datagrams of %lu types\n", (unsigned long) s->num_datagrams, (unsigned long) s->num_types);
+
+    /* Restore the original file position. */
+    if ((kma_seek (h, position) != 0) && (status >= 0)) {
+        status = CS_ESEEK;
+    }
+
+    if (status < 0) {
+        h->kma_errno = status;
+        return status;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_copy - Copy the datagrams of the file handle H from the current position
+*   to the file descriptor FD without parsing them, e.g., to make a copy of a
+*   file without the water column datagrams or to split a file.  Only the
+*   datagram headers are read, and the datagrams are written verbatim.  The
+*   datagrams rejected by the datagram type filter or by kma_set_ignore_mwc()
+*   and kma_set_ignore_mrz() are skipped, as are the datagrams before the time
+*   START_TIME in nanoseconds since 1970-01-01 if it is not zero.
+*
+*   Copying stops before the first datagram copied at or after the time
+*   END_TIME if it is not zero, or before the datagram that would make the size
+*   written larger than MAX_SIZE bytes if it is not zero, and the handle is left
+*   at that datagram.  At least one datagram is always written.  Therefore, a
+*   file is split by calling this function again with the next output file
+*   until it returns zero.  If resync is set by kma_set_resync(), then corrupt
+*   data is skipped as by kma_read() and is not written.  The number of bytes
+*   written is stored in SIZE if not NULL.  The datagrams are written directly
+*   from a memory-mapped file or otherwise collected in a large buffer, so there
+*   are few writes.  Any data returned by a previous call to kma_read() is no
+*   longer valid.
+*
+* Return: 1 if copying stopped at END_TIME or MAX_SIZE,
+*         0 if the end of the file was reached, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EREAD
+*         CS_EWRITE
+*         CS_ESEEK
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+int kma_copy (
+    kma_handle *h,
+    const int fd,
+    const uint64_t start_time,
+    const uint64_t end_time,
+    const uint64_t max_size,
+    uint64_t *size) {
+
+    kma_datagram_header header;
+    uint32_t datagram_size;
+    const char *run;
+    char *buffer;
+    char *p;
+    uint64_t offset;
+    uint64_t written;
+    uint64_t t;
+    size_t run_size;
+    size_t buffer_size;
+    size_t n;
+    ssize_t result;
+    int status;
+
+
+    assert (h);
+
+    if (size) *size = 0;
+
+    if (kma_prefetch_stop (h) != 0) return h->kma_errno;
+
+    /* The datagram data is only valid until the next read, so buffered files are copied to the buffer. */
+    buffer = NULL;
+    if (!h->map) {
+        buffer = (char *) cpl_malloc (KMA_COPY_BUFFER_SIZE);
+        if (!buffer) {
+            h->kma_errno = CS_ENOMEM;
+            return CS_ENOMEM;
+        }
+    }
+
+    run = NULL;
+    run_size = 0;
+    buffer_size = 0;
+    written = 0;
+
+    for (;;) {
+        offset = kma_tell (h);
+
+        /* Look at the header without reading it, so the handle stays at a datagram that is not copied. */
+        result = kma_peek (h, offset, sizeof (kma_datagram_header), &p);
+        if (result <= 0) {
+            status = (int) result;
+            break;
+        }
+
+        if ((size_t) result < sizeof (kma_datagram_header)) {
+            cpl_debug (kma_debug, "Unexpected end of file\n");
+            if (h->resync) goto L1;
+            status = CS_EBADDATA;
+            break;
+        }
+
+        memcpy (&header, p, sizeof (kma_datagram_header));
+
+        if (kma_valid_header (&header) == 0) {
+            cpl_debug (kma_debug, "Invalid header (size=%u, type=0x%08x, nanosec=%u)\n", header.numBytesDgm, header.dgmType, header.time_nanosec);
+            if (h->resync) goto L1;
+            status = CS_EBADDATA;
+            break;
+        }
+
+        n = header.numBytesDgm;
+        t = kma_index_time (header.time_sec, header.time_nanosec);
+
+        if (kma_copy_type (h, header.dgmType) && ((start_time == 0) || (t >= start_time))) {
+            if ((written > 0) && (((end_time != 0) && (t >= end_time)) || ((max_size != 0) && (written + n > max_size)))) {
+                status = 1;
+                break;
+            }
+
+            if (h->map) {
+                if (h->map_size - offset < n) {
+                    cpl_debug (kma_debug, "Unexpected end of file\n");
+                    if (h->resync) goto L1;
+                    status = CS_EBADDATA;
+                    break;
+                }
+
+                /* In resync mode, verify the datagram size at the end of the datagram as kma_read() does. */
+                if (h->resync) {
+                    memcpy (&datagram_size, h->map + offset + n - sizeof (uint32_t), sizeof (uint32_t));
+                    if (datagram_size != header.numBytesDgm) {
+                        cpl_debug (kma_debug, "Invalid datagram size at end of datagram (%u,%u)\n", datagram_size, header.numBytesDgm);
+                        goto L1;
+                    }
+                }
+
+                /* Consecutive datagrams are written from the map together. */
+                if (!run) run = (const char *) (h->map + offset);
+                run_size += n;
+                h->io.bytes_read += n;
+            } else {
+                result = kma_peek (h, offset, n, &p);
+                if (result < 0) {
+                    status = (int) result;
+                    break;
+                }
+
+                if ((size_t) result < n) {
+                    cpl_debug (kma_debug, "Unexpected end of file\n");
+                    if (h->resync) goto L1;
+                    status = CS_EBADDATA;
+                    break;
+                }
+
+                if (h->resync) {
+                    memcpy (&datagram_size, p + n - sizeof (uint32_t), sizeof (uint32_t));
+                    if (datagram_size != header.numBytesDgm) {
+                        cpl_debug (kma_debug, "Invalid datagram size at end of datagram (%u,%u)\n", datagram_size, header.numBytesDgm);
+                        goto L1;
+                    }
+                }
+
+                if (buffer_size + n > KMA_COPY_BUFFER_SIZE) {
+                    status = kma_copy_write (fd, buffer, buffer_size);
+                    buffer_size = 0;
+                    if (status != CS_ENONE) break;
+                }
+
+                if (n > KMA_COPY_BUFFER_SIZE) {
+                    status = kma_copy_write (fd, p, n);
+                    if (status != CS_ENONE) break;
+                } else {
+                    memcpy (buffer + buffer_size, p, n);
+                    buffer_size += n;
+                }
+            }
+
+            written += n;
+        } else if (run) {
+            status = kma_copy_write (fd, run, run_size);
+            run = NULL;
+            run_size = 0;
+            if (status != CS_ENONE) break;
+        }
+
+        status = kma_skip (h, n);
+        if (status != 0) break;
+
+        continue;
+
+        /* The datagram at the offset is corrupt, so search for the next valid datagram.  The
+           datagrams collected from the map are not contiguous after it, so those are written first. */
+L1:     if (run) {
+            status = kma_copy_write (fd, run, run_size);
+            run = NULL;
+            run_size = 0;
+            if (status != CS_ENONE) break;
+        }
+
+        status = kma_resync (h, offset);
+        if (status <= 0) break;
+    }
+
+    /* Write the datagrams collected so far, even if an error occurred. */
+    if (run && (kma_copy_write (fd, run, run_size) != CS_ENONE) && (status >= 0)) {
+        status = CS_EWRITE;
+    }
+
+    if (buffer) {
+        if ((kma_copy_write (fd, buffer, buffer_size) != CS_ENONE) && (status >= 0)) {
+            status = CS_EWRITE;
+        }
+        cpl_free (buffer);
+    }
+
+    cpl_debug (kma_debug, "Copied %lu bytes\n", (unsigned long) written);
+
+    /* Discard any partially joined datagram. */
+    h->part_num = 0;
+
+    if (size) *size = written;
+
+    if (status < 0) h->kma_errno = status;
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* kma_read_files - Read all datagrams of the NUM_FILES files given by FILE_NAMES
+*   using a pool of NUM_THREADS threads, which reads one file per thread at a
+*   time.  If NUM_THREADS is zero or negative, then one thread per processor is
+*   used.  For each file, the callback function FN is first called with a NULL
+*   datagram after the file is opened, so the handle may be set up, e.g., with
+*   kma_set_type_filter().  Then FN is called with each datagram read from the
+*   file along with the file number and USER_DATA.  If FN returns non-zero, then
+*   the rest of the file is skipped.  FN is called for one file at a time per
+*   thread, so FN must be thread-safe if NUM_THREADS is not one, but the datagrams
+*   of a file are always passed in order by the same thread.
+*
+*   If OPTIONS includes KMA_BATCH_MMAP, then the files are opened with
+*   kma_open_mmap(), and if OPTIONS includes KMA_BATCH_SORT, then the datagrams
+*   of each file are passed in order of time using a datagram index.  If not
+*   NULL, then the status of each file is stored in FILE_STATUS, which is zero
+*   if the file was read successfully or an error condition.
+*
+*   Handles opened by the calling program may be used concurrently with this
+*   function, but kma_set_debug() and cpl_set_memory_functions() must not be
+*   called while it is running.
+*
+* Return: 0 if all files were read successfully,
+*         CS_ENOMEM if memory allocation failed, or
+*         CS_EFAIL if any file could not be read.
+*
+******************************************************************************/
+
+int kma_read_files (
+    const char **file_names,
+    const size_t num_files,
+    const int num_threads,
+    const int options,
+    kma_batch_fn fn,
+    void *user_data,
+    int *file_status) {
+
+    kma_batch b;
+    int status = CS_ENONE;
+    int threads_used;
+    size_t i;
+
+
+    assert (file_names);
+    assert (fn);
+
+    if (num_files == 0) return CS_ENONE;
+
+    b.file_names = file_names;
+    b.options = options;
+    b.fn = fn;
+    b.user_data = user_data;
+
+    /* Each thread stores the status of its files, which are checked after all are read. */
+    b.file_status = file_status ? file_status : (int *) cpl_malloc (num_files * sizeof (int));
+    if (!b.file_status) return CS_ENOMEM;
+
+    threads_used = cpl_thread_run (num_files, num_threads, kma_batch_task, &b);
+    cpl_debug (kma_debug, "Read %lu files using %d threads\n", (unsigned long) num_files, threads_used);
+
+    for (i=0; i<num_files; i++) {
+        if (b.file_status[i] != CS_ENONE) {
+            status = CS_EFAIL;
+            break;
+        }
+    }
+
+    if (!file_status) cpl_free (b.file_status);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* kma_read_chunks - Read all datagrams of the file given by FILE_NAME in
+*   parallel by splitting the file into NUM_CHUNKS ranges of about equal size,
+*   which are read by a pool of NUM_THREADS threads.  If NUM_THREADS is zero or
+*   negative, then one thread per processor is used, and if NUM_CHUNKS is zero,
+*   then one chunk per thread is used.  The ranges start at datagram boundaries
+*   found by building a datagram index, and the partitions of a split MRZ or
+*   MWC datagram are always in the same chunk.  Each chunk is read using its
+*   own file handle, and the callback function FN is first called with a NULL
+*   datagram after the handle is opened, so the handle may be set up, e.g.,
+*   with kma_set_type_filter().  Then FN is called with each datagram of the chunk
+*   along with the chunk number and USER_DATA.  If FN returns non-zero, then the
+*   rest of the chunk is skipped.  The datagrams of a chunk are always passed in
+*   file order by the same thread, and the chunks are in order of the chunk
+*   number, so FN may collect the data of each chunk separately and the results
+*   may be joined in order of the chunk number.
+*
+*   If OPTIONS includes KMA_BATCH_MMAP, then the file is opened with
+*   kma_open_mmap().  The option KMA_BATCH_SORT is not supported.  The same
+*   limitations apply as with kma_read_files().
+*
+* Return: 0 if the file was read successfully, or
+*         error condition of the first chunk that could not be read.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EOPEN
+*         CS_ECLOSE
+*         Any error from kma_read() or kma_build_index()
+*
+******************************************************************************/
+
+int kma_read_chunks (
+    const char *file_name,
+    const size_t num_chunks,
+    const int num_threads,
+    const int options,
+    kma_batch_fn fn,
+    void *user_data) {
+
+    kma_chunks c;
+    kma_handle *h;
+    int status = CS_ENONE;
+    int threads_used;
+    size_t i, n;
+
+
+    assert (file_name);
+    assert (fn);
+
+    if (options & KMA_BATCH_SORT) return CS_EINVAL;
+
+    n = num_chunks;
+    if (n == 0) n = num_threads > 0 ? (size_t) num_threads : (size_t) cpl_thread_num_cpus ();
+
+    if (options & KMA_BATCH_MMAP) {
+        h = kma_open_mmap (file_name);
+    } else {
+        h = kma_open (file_name);
+    }
+
+    if (!h) return CS_EOPEN;
+
+    c.file_name = file_name;
+    c.options = options;
+    c.fn = fn;
+    c.user_data = user_data;
+
+    c.offsets = (uint64_t *) cpl_malloc ((n + 1) * sizeof (uint64_t));
+    c.chunk_status = (int *) cpl_malloc (n * sizeof (int));
+
+    if (!c.offsets || !c.chunk_status) {
+        status = CS_ENOMEM;
+    } else {
+        status = kma_split_chunks (h, c.offsets, n);
+    }
+
+    /* The index is only needed to find the chunks, so close the file before reading them. */
+    if ((kma_close (h) != 0) && (status == CS_ENONE)) {
+        status = CS_ECLOSE;
+    }
+
+    if (status == CS_ENONE) {
+        threads_used = cpl_thread_run (n, num_threads, kma_chunk_task, &c);
+        cpl_debug (kma_debug, "Read %lu chunks using %d threads\n", (unsigned long) n, threads_used);
+
+        for (i=0; i<n; i++) {
+            if (c.chunk_status[i] != CS_ENONE) {
+                status = c.chunk_status[i];
+                break;
+            }
+        }
+    }
+
+    cpl_free (c.offsets);
+    cpl_free (c.chunk_status);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* kma_merge_open - Open the NUM_FILES files given by FILE_NAMES as one merged
+*   stream and return a handle to it.  The datagrams of all files are returned
+*   by kma_merge_read() in order of time using a k-way merge, which only keeps
+*   the next datagram of each file in memory, e.g., to read the water column of
+*   a .kmwcd file along with the depths of its .kmall file, or the files of
+*   several concurrent systems.  If OPTIONS includes KMA_BATCH_MMAP, then the
+*   files are opened with kma_open_mmap(), and if OPTIONS includes
+*   KMA_BATCH_SORT, then the datagrams of each file are read in order of time
+*   using a datagram index.  Otherwise, the datagrams of each file are read in
+*   file order, which is close to but not always in order of time.  The handle of
+*   each file is given by kma_merge_get_handle(), so it may be set up, e.g., with
+*   kma_set_type_filter() or kma_load_index() before the first datagram is read.
+*   The caller must call kma_merge_close() to close the files after use.
+*
+* Return: A merged stream handle, or
+*         NULL if a file can not be opened or memory allocation failed.
+*
+******************************************************************************/
+
+kma_merge * kma_merge_open (
+    const char **file_names,
+    const size_t num_files,
+    const int options) {
+
+    kma_merge *m;
+    size_t i;
+
+
+    assert (file_names);
+
+    m = (kma_merge *) cpl_malloc (sizeof (kma_merge));
+    if (!m) return NULL;
+
+    m->input = (kma_merge_input *) cpl_calloc (num_files + 1, sizeof (kma_merge_input));
+    m->heap = (size_t *) cpl_malloc ((num_files + 1) * sizeof (size_t));
+    m->num_inputs = 0;
+    m->heap_size = 0;
+    m->last = num_files;
+    m->options = options;
+    m->started = 0;
+    m->merge_errno = CS_ENONE;
+
+    if (!m->input || !m->heap) {
+        kma_merge_close (m);
+        return NULL;
+    }
+
+    for (i=0; i<num_files; i++) {
+        if (options & KMA_BATCH_MMAP) {
+            m->input[i].h = kma_open_mmap (file_names[i]);
+        } else {
+            m->input[i].h = kma_open (file_names[i]);
+        }
+
+        if (!m->input[i].h) {
+            cpl_debug (kma_debug, "Unable to open merge input %lu\n", (unsigned long) i);
+            kma_merge_close (m);
+            return NULL;
+        }
+
+        m->num_inputs++;
+    }
+
+    return m;
+}
+
+
+/******************************************************************************
+*
+* kma_merge_close - Close the files and free allocated memory given by the
+*   merged stream handle M.
+*
+* Return: 0 if the files are successfully closed, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ECLOSE
+*
+******************************************************************************/
+
+int kma_merge_close (
+    kma_merge *m) {
+
+    int status = CS_ENONE;
+    size_t i;
+
+
+    if (m) {
+        if (m->input) {
+            for (i=0; i<m->num_inputs; i++) {
+                if (kma_close (m->input[i].h) != 0) status = CS_ECLOSE;
+            }
+
+            cpl_free (m->input);
+        }
+
+        if (m->heap) cpl_free (m->heap);
+        cpl_free (m);
+    }
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* kma_merge_read - Read the next datagram of the merged stream given by the
+*   handle M, which is the datagram with the earliest time of the next datagrams
+*   of all files.  Datagrams with the same time are returned in order of the file
+*   number, so the files should be given with the .kmall file before its .kmwcd
+*   file for the MRZ datagram of a ping to be returned before its MWC datagram.
+*   If not NULL, the file number of the datagram is stored in FILE.  The data is
+*   valid until the next call to kma_merge_read() or kma_merge_close(), and must
+*   not be modified.
+*
+* Return: A pointer to the kma_data struct, or
+*         NULL if the end of all files was reached or an error occurred.
+*
+******************************************************************************/
+
+kma_data * kma_merge_read (
+    kma_merge *m,
+    size_t *file) {
+
+    kma_data *d;
+    size_t n;
+    int status;
+
+
+    assert (m);
+
+    if (m->merge_errno != CS_ENONE) return NULL;
+
+    /* Read the first datagram of each file, or replace the datagram returned last. */
+    if (!m->started) {
+        status = kma_merge_start (m);
+    } else if (m->last < m->num_inputs) {
+        status = kma_merge_advance (m, m->last);
+    } else {
+        status = CS_ENONE;
+    }
+
+    m->last = m->num_inputs;
+
+    if (status != CS_ENONE) {
+        m->merge_errno = status;
+        return NULL;
+    }
+
+    if (m->heap_size == 0) return NULL;
+
+    /* The earliest datagram is at the top of the heap, which is replaced on the next call. */
+    n = m->heap[0];
+    d = m->input[n].d;
+    m->last = n;
+
+    if (file) *file = n;
+
+    return d;
+}
+
+
+/******************************************************************************
+*
+* kma_merge_get_handle - Return the file handle of the file number N of the
+*   merged stream given by the handle M.  The handle is owned by the merged
+*   stream and must not be read or closed by the caller.
+*
+* Return: The file handle, or
+*         NULL if N is not a valid file number.
+*
+******************************************************************************/
+
+kma_handle * kma_merge_get_handle (
+    const kma_merge *m,
+    const size_t n) {
+
+    assert (m);
+
+    if (n >= m->num_inputs) return NULL;
+    return m->input[n].h;
+}
+
+
+/******************************************************************************
+*
+* kma_merge_get_errno - Return the error condition code of the merged stream
+*   given by the handle M.
+*
+******************************************************************************/
+
+int kma_merge_get_errno (
+    const kma_merge *m) {
+
+    assert (m);
+    return m->merge_errno;
+}
+
+
+/******************************************************************************
+*
+* kma_parser_open - Return a push parser, which parses datagrams from data given
+*   by the caller with kma_parser_feed() instead of reading a file, such as the
+*   packets of a live stream from the PU.  Resync mode is set by default, since
+*   a lost packet leaves a partial datagram in the stream.  After corrupt data,
+*   the next datagram with a valid header and datagram size is parsed, so a
+*   corrupt size does not hold back the stream.  The caller must call
+*   kma_parser_close() to free the parser after use.
+*
+* Return: A pointer to the new parser, or
+*         NULL if memory allocation failed.
+*
+******************************************************************************/
+
+kma_parser * kma_parser_open (void) {
+
+    kma_parser *p;
+
+
+    p = (kma_parser *) cpl_malloc (sizeof (kma_parser));
+    if (!p) return NULL;
+
+    /* The handle holds the datagram and the read options, but has no file. */
+    p->h = kma_new_handle (-1);
+    if (!p->h) {
+        cpl_free (p);
+        return NULL;
+    }
+
+    p->h->resync = 1;
+
+    p->data = NULL;
+    p->data_size = 0;
+    p->carry = NULL;
+    p->carry_start = 0;
+    p->carry_end = 0;
+    p->carry_size = 0;
+    p->skip = 0;
+    p->searching = 0;
+
+    return p;
+}
+
+
+/******************************************************************************
+*
+* kma_parser_close - Free the push parser P and its handle.
+*
+* Return: 0 if the parser is successfully closed, or
+*         error condition if an error occurred.
+*
+******************************************************************************/
+
+int kma_parser_close (
+    kma_parser *p) {
+
+    int status = CS_ENONE;
+
+
+    if (p) {
+        status = kma_close (p->h);
+        if (p->carry) cpl_free (p->carry);
+        cpl_free (p);
+    }
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* kma_parser_feed - Give the next SIZE bytes DATA of the stream to the push
+*   parser P.  The data is not copied, so it must remain valid and unchanged
+*   until kma_parser_read() returns NULL.  Any data of an earlier feed that was
+*   not parsed yet is copied to the parser first, so a datagram may be split
+*   across any number of feeds.
+*
+* Return: 0 if the data was added successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*
+******************************************************************************/
+
+int kma_parser_feed (
+    kma_parser *p,
+    const void *data,
+    const size_t size) {
+
+    int status;
+
+
+    assert (p);
+
+    /* Keep the rest of the previous feed, which the caller may now reuse. */
+    if (p->data_size > 0) {
+        status = kma_parser_carry (p, p->data_size);
+        if (status != CS_ENONE) {
+            p->h->kma_errno = status;
+            return status;
+        }
+    }
+
+    p->data = (const char *) data;
+    p->data_size = data ? size : 0;
+
+    /* Each feed is counted as a read from the file. */
+    p->h->io.num_reads++;
+    p->h->io.bytes_read += p->data_size;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_parser_read - Return the next complete datagram of the data given to the
+*   push parser P, with the same pointer setup and read options as kma_read().
+*   A datagram that is entirely in the last feed is parsed in place, and only a
+*   datagram that is split across feeds is copied, so the datagram is returned
+*   as soon as its last byte is fed.  The datagram is valid until the next call
+*   using P, or until kma_retain() is called on the handle of the parser.  The
+*   caller should read until NULL is returned after each feed.
+*
+* Return: A pointer to the data struct if a datagram is complete, or
+*         NULL if more data is needed or an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+kma_data * kma_parser_read (
+    kma_parser *p) {
+
+    kma_handle *h;
+    uint32_t datagram_size;
+    uint64_t start = 0;
+    uint64_t parse_start;
+    uint64_t parse_time = 0;
+    size_t size, n;
+    int in_carry;
+    int status;
+    char *src;
+
+
+    assert (p);
+
+    h = p->h;
+    h->body = NULL;
+
+    if (h->timing) start = cpl_clock_ns ();
+
+    for (;;) {
+        /* Drop the rest of a datagram rejected by the read options without copying it. */
+        if (p->skip > 0) {
+            n = p->carry_end - p->carry_start;
+            if (n > p->skip) n = p->skip;
+            p->carry_start += n;
+            p->skip -= n;
+
+            n = p->data_size < p->skip ? p->data_size : p->skip;
+            p->data += n;
+            p->data_size -= n;
+            p->skip -= n;
+
+            if (p->skip > 0) return NULL;
+        }
+
+        /* While searching for a valid datagram, all data is copied to the carry buffer. */
+        if (p->searching) {
+            if (p->data_size > 0) {
+                status = kma_parser_carry (p, p->data_size);
+                if (status != CS_ENONE) {
+                    h->kma_errno = status;
+                    return NULL;
+                }
+            }
+
+            if (kma_parser_search (p) == 0) return NULL;
+        }
+
+        if (p->carry_start == p->carry_end) {
+            p->carry_start = p->carry_end = 0;
+        }
+
+        /* The start of a datagram that was split by feeds is in the carry buffer. */
+        in_carry = p->carry_end > 0;
+
+        if (in_carry) {
+            status = kma_parser_fill (p, sizeof (kma_datagram_header));
+            if (status != CS_ENONE) {
+                h->kma_errno = status;
+                return NULL;
+            }
+
+            if (p->carry_end - p->carry_start < sizeof (kma_datagram_header)) return NULL;
+            src = p->carry + p->carry_start;
+        } else {
+            /* Keep the start of the header until the rest of it is fed. */
+            if (p->data_size < sizeof (kma_datagram_header)) {
+                if (p->data_size > 0) {
+                    status = kma_parser_carry (p, p->data_size);
+                    if (status != CS_ENONE) h->kma_errno = status;
+                }
+                return NULL;
+            }
+            src = (char *) p->data;
+        }
+
+        memcpy (&(h->d.header), src, sizeof (kma_datagram_header));
+
+        if (kma_valid_header (&(h->d.header)) == 0) {
+            cpl_debug (kma_debug, "Invalid header (size=%u, type=0x%08x, nanosec=%u)\n", h->d.header.numBytesDgm, h->d.header.dgmType, h->d.header.time_nanosec);
+            if (!h->resync) {
+                h->kma_errno = CS_EBADDATA;
+                return NULL;
+            }
+            kma_parser_skip_byte (p, in_carry);
+            continue;
+        }
+
+        size = h->d.header.numBytesDgm;
+
+        /* Skip the datagrams rejected by the read options. */
+        if ((h->ignore_mwc && (h->d.header.dgmType == KMA_DATAGRAM_MWC)) ||
+            (h->ignore_mrz && (h->d.header.dgmType == KMA_DATAGRAM_MRZ)) ||
+            (h->filter && kma_filter_type (h, h->d.header.dgmType))) {
+            p->skip = size;
+            continue;
+        }
+
+        /* A datagram split by feeds is completed in the carry buffer, otherwise it is parsed in place. */
+        if (in_carry) {
+            status = kma_parser_fill (p, size);
+            if (status != CS_ENONE) {
+                h->kma_errno = status;
+                return NULL;
+            }
+
+            if (p->carry_end - p->carry_start < size) return NULL;
+            src = p->carry + p->carry_start;
+        } else if (p->data_size < size) {
+            status = kma_parser_carry (p, p->data_size);
+            if (status != CS_ENONE) h->kma_errno = status;
+            return NULL;
+        }
+
+        /* In resync mode, verify that the datagram size at the end of the datagram agrees with the header. */
+        if (h->resync) {
+            memcpy (&datagram_size, src + size - sizeof (uint32_t), sizeof (uint32_t));
+            if (datagram_size != h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Invalid datagram size at end of datagram (%u,%u)\n", datagram_size, h->d.header.numBytesDgm);
+                kma_parser_skip_byte (p, in_carry);
+                continue;
+            }
+        }
+
+        /* The datagram is consumed now, but its data stays in place until the next call. */
+        if (in_carry) {
+            p->carry_start += size;
+        } else {
+            p->data += size;
+            p->data_size -= size;
+        }
+
+        if (h->timing) {
+            parse_start = cpl_clock_ns ();
+            status = kma_parse (h, src + sizeof (kma_datagram_header), size - sizeof (kma_datagram_header));
+            parse_time += cpl_clock_ns () - parse_start;
+        } else {
+            status = kma_parse (h, src + sizeof (kma_datagram_header), size - sizeof (kma_datagram_header));
+        }
+
+        if (status < 0) {
+            h->kma_errno = status;
+            return NULL;
+        }
+
+        /* Now go back and parse the next partition. */
+        if (status == 0) continue;
+
+        kma_count_datagram (h, start, parse_time);
+
+        return &(h->d);
+    }
+}
+
+
+/******************************************************************************
+*
+* kma_parser_reset - Discard any data given to the push parser P that was not
+*   parsed yet, including a partially joined datagram, such as after the
+*   connection to the PU is lost.  The read options are not changed.
+*
+******************************************************************************/
+
+void kma_parser_reset (
+    kma_parser *p) {
+
+    assert (p);
+
+    p->data = NULL;
+    p->data_size = 0;
+    p->carry_start = 0;
+    p->carry_end = 0;
+    p->skip = 0;
+    p->searching = 0;
+    p->h->part_num = 0;
+    p->h->body = NULL;
+}
+
+
+/******************************************************************************
+*
+* kma_parser_get_handle - Return the handle of the push parser P, which is used
+*   to set the read options, the navigation store, and to retain datagrams, and
+*   holds the error condition and resync counts.  The handle is owned by the
+*   parser and must not be read, seeked, or closed by the caller.
+*
+******************************************************************************/
+
+kma_handle * kma_parser_get_handle (
+    const kma_parser *p) {
+
+    assert (p);
+    return p->h;
+}
+
+
+/******************************************************************************
+*
+* kma_parser_get_errno - Return the error condition code of the push parser P.
+*
+******************************************************************************/
+
+int kma_parser_get_errno (
+    const kma_parser *p) {
+
+    assert (p);
+    return p->h->kma_errno;
+}
+
+
+/******************************************************************************
+*
+* kma_write_wc_file - Write the MWC datagrams read from the handle H to the
+*   compressed water column file given by FILE_NAME.  The datagrams are read
+*   from the current position to the end of the file with kma_read(), so the
+*   partitions are joined, and the read options of H apply.  The amplitude
+*   samples of each beam are delta coded before the datagram is rANS encoded,
+*   and the datagrams are read back by kma_wc_file_read().  Setting a type
+*   filter of only MWC datagrams on H avoids parsing the other datagrams.
+*
+* Return: 0 if the file was written successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EOPEN
+*         CS_ENOMEM
+*         CS_EWRITE
+*         CS_ECLOSE
+*         Any error of kma_read()
+*
+******************************************************************************/
+
+int kma_write_wc_file (
+    kma_handle *h,
+    const char *file_name) {
+
+    const kma_datagram_mwc *mwc;
+    cpl_wcfile *w;
+    kma_data *d;
+    uint8_t *buffer = NULL;
+    uint8_t *p;
+    size_t buffer_size = 0;
+    size_t alloc;
+    size_t size;
+    int64_t time;
+    int status = CS_ENONE;
+
+
+    assert (h);
+    assert (file_name);
+
+    w = cpl_wcfile_create (file_name, CPL_WCFILE_KMA);
+    if (!w) {
+        cpl_debug (kma_debug, "Failed to create water column file\n");
+        return CS_EOPEN;
+    }
+
+    while ((d = kma_read (h)) != NULL) {
+        if (d->header.dgmType != KMA_DATAGRAM_MWC) continue;
+
+        mwc = &(d->datagram.mwc);
+
+        /* The header and the joined body are copied, so the samples can be delta coded. */
+        size = d->header.numBytesDgm;
+        if (size < sizeof (kma_datagram_header)) continue;
+
+        if (size > buffer_size) {
+            alloc = buffer_size;
+            p = (uint8_t *) cpl_realloc2 (buffer, size, sizeof (uint8_t), &alloc);
+            if (!p) {
+                status = CS_ENOMEM;
+                break;
+            }
+            buffer = p;
+            buffer_size = alloc;
+        }
+
+        memcpy (buffer, &(d->header), sizeof (kma_datagram_header));
+        memcpy (buffer + sizeof (kma_datagram_header), h->body, size - sizeof (kma_datagram_header));
+
+        if (mwc->beamData) {
+            p = buffer + sizeof (kma_datagram_header) + ((const char *) mwc->beamData - h->body);
+            if (p <= buffer + size) {
+                kma_delta_mwc (p, buffer + size, mwc->rxInfo, 0);
+            }
+        }
+
+        time = (int64_t) d->header.time_sec * 1000000000 + d->header.time_nanosec;
+
+        status = cpl_wcfile_write (w, buffer, size, time, mwc->common->pingCnt);
+        if (status != CS_ENONE) break;
+    }
+
+    if (status == CS_ENONE) status = h->kma_errno;
+
+    if (buffer) cpl_free (buffer);
+
+    if ((cpl_wcfile_close (w) != CS_ENONE) && (status == CS_ENONE)) status = CS_EWRITE;
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* kma_wc_file_open - Open the compressed water column file given by FILE_NAME,
+*   which was written by kma_write_wc_file().  The caller must call
+*   kma_wc_file_close() to close the file after use.
+*
+* Return: A pointer to the water column file, or
+*         NULL if the file could not be opened, is not a valid KMA water
+*           column file, or memory allocation failed.
+*
+******************************************************************************/
+
+kma_wc_file * kma_wc_file_open (
+    const char *file_name) {
+
+    kma_wc_file *f;
+
+
+    assert (file_name);
+
+    f = (kma_wc_file *) cpl_malloc (sizeof (kma_wc_file));
+    if (!f) return NULL;
+
+    f->w = cpl_wcfile_open (file_name, CPL_WCFILE_KMA);
+    if (!f->w) {
+        cpl_free (f);
+        return NULL;
+    }
+
+    /* The handle holds the decoded datagram, but has no file. */
+    f->h = kma_new_handle (-1);
+    if (!f->h) {
+        cpl_wcfile_close (f->w);
+        cpl_free (f);
+        return NULL;
+    }
+
+    return f;
+}
+
+
+/******************************************************************************
+*
+* kma_wc_file_close - Close the water column file F and free its handle.
+*
+* Return: 0 if the file is successfully closed, or
+*         error condition if an error occurred.
+*
+******************************************************************************/
+
+int kma_wc_file_close (
+    kma_wc_file *f) {
+
+    int status = CS_ENONE;
+
+
+    if (f) {
+        status = kma_close (f->h);
+        if ((cpl_wcfile_close (f->w) != CS_ENONE) && (status == CS_ENONE)) status = CS_ECLOSE;
+        cpl_free (f);
+    }
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* kma_wc_file_read - Read and decode the MWC datagram number N of the water
+*   column file F.  The datagram has the same pointer setup as kma_read(), so
+*   it can be used with kma_build_mwc_table() and kma_get_mwc_rx_beam_data().
+*   Only this datagram is read from the file.  The datagram is valid until the
+*   next call using F, or until kma_retain() is called on the handle of F.
+*
+* Return: A pointer to the data struct, or
+*         NULL if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*         CS_EREAD
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+kma_data * kma_wc_file_read (
+    kma_wc_file *f,
+    const size_t n) {
+
+    const cpl_wcfile_entry *e;
+    kma_handle *h;
+    uint8_t *data;
+    int status;
+
+
+    assert (f);
+
+    h = f->h;
+
+    status = cpl_wcfile_read (f->w, n, &data);
+    if (status != CS_ENONE) {
+        h->kma_errno = status;
+        return NULL;
+    }
+
+    e = cpl_wcfile_get_entry (f->w, n);
+
+    if (e->size < sizeof (kma_datagram_header) + sizeof (kma_datagram_m_partition) + sizeof (uint32_t)) {
+        h->kma_errno = CS_EBADDATA;
+        return NULL;
+    }
+
+    memcpy (&(h->d.header), data, sizeof (kma_datagram_header));
+
+    if ((h->d.header.dgmType != KMA_DATAGRAM_MWC) || (h->d.header.numBytesDgm != e->size)) {
+        cpl_debug (kma_debug, "Invalid water column file datagram (%lu)\n", (unsigned long) n);
+        h->kma_errno = CS_EBADDATA;
+        return NULL;
+    }
+
+    h->part_num = 0;
+
+    status = kma_parse (h, (char *) data + sizeof (kma_datagram_header), e->size - sizeof (kma_datagram_header));
+    if (status <= 0) {
+        h->kma_errno = (status < 0) ? status : CS_EBADDATA;
+        return NULL;
+    }
+
+    if (h->d.datagram.mwc.beamData && (h->d.datagram.mwc.beamData <= data + e->size)) {
+        kma_delta_mwc (h->d.datagram.mwc.beamData, data + e->size, h->d.datagram.mwc.rxInfo, 1);
+    }
+
+    h->kma_errno = CS_ENONE;
+
+    return &(h->d);
+}
+
+
+/******************************************************************************
+*
+* kma_wc_file_get_num_pings - Return the number of MWC datagrams of the water
+*   column file F.
+*
+******************************************************************************/
+
+size_t kma_wc_file_get_num_pings (
+    const kma_wc_file *f) {
+
+    assert (f);
+    return cpl_wcfile_get_num_entries (f->w);
+}
+
+
+/******************************************************************************
+*
+* kma_wc_file_get_entry - Return the index entry of the MWC datagram number N
+*   of the water column file F, which gives the time and pingCnt of the ping
+*   without reading the datagram, or NULL if N is not a valid datagram number.
+*
+******************************************************************************/
+
+const cpl_wcfile_entry * kma_wc_file_get_entry (
+    const kma_wc_file *f,
+    const size_t n) {
+
+    assert (f);
+    return cpl_wcfile_get_entry (f->w, n);
+}
+
+
+/******************************************************************************
+*
+* kma_wc_file_find_time - Return the number of the first MWC datagram of the
+*   water column file F at or after the time TIME_SEC and TIME_NANOSEC, or the
+*   number of datagrams if there is none.
+*
+******************************************************************************/
+
+size_t kma_wc_file_find_time (
+    const kma_wc_file *f,
+    const uint32_t time_sec,
+    const uint32_t time_nanosec) {
+
+    assert (f);
+    return cpl_wcfile_find_time (f->w, (int64_t) time_sec * 1000000000 + time_nanosec);
+}
+
+
+/******************************************************************************
+*
+* kma_wc_file_get_handle - Return the handle of the water column file F, which
+*   is used to retain datagrams.  The handle is owned by F and must not be
+*   read, seeked, or closed by the caller.
+*
+******************************************************************************/
+
+kma_handle * kma_wc_file_get_handle (
+    const kma_wc_file *f) {
+
+    assert (f);
+    return f->h;
+}
+
+
+/******************************************************************************
+*
+* kma_wc_file_get_errno - Return the error condition code of the water column
+*   file F.
+*
+******************************************************************************/
+
+int kma_wc_file_get_errno (
+    const kma_wc_file *f) {
+
+    assert (f);
+    return f->h->kma_errno;
+}
+
+
+/******************************************************************************
+*
+* kma_get_mrz_columns - Copy the sounding fields selected by the KMA_MRZ_COLUMN
+*   flags in MASK of the MRZ datagram in D to the arrays of the column set C, which
+*   stores each field in a separate contiguous array of floats.  The soundings
+*   are stored starting at element N of each array, and no more than MAX_SIZE
+*   elements in total are used, so the soundings of several pings can be stored
+*   one after the other by passing the number of soundings stored so far as N.
+*   The arrays of columns not selected by MASK are not used and may be NULL, and
+*   selected columns with a NULL array are skipped.  Both the main soundings and
+*   the extra detections are stored, which are given by detectionType.  Fields
+*   that are not present in soundings of an older format are set to NaN.
+*
+*   Nothing is stored if D is not an MRZ datagram, and the number of soundings
+*   is limited to those that fit in the datagram size.
+*
+* Return: The number of soundings stored, which is less than the number in the
+*           datagram only if MAX_SIZE is reached or the datagram is truncated.
+*
+******************************************************************************/
+
+size_t kma_get_mrz_columns (
+    const kma_data *d,
+    const unsigned int mask,
+    const kma_mrz_columns *c,
+    const size_t n,
+    const size_t max_size) {
+
+    const kma_datagram_mrz *mrz;
+    float *column[KMA_MRZ_NUM_COLUMNS];
+    const uint8_t *q;
+    size_t num_soundings;
+    size_t stride;
+    size_t i, j;
+    float *out;
+
+
+    assert (d);
+    assert (c);
+
+    if (n >= max_size) return 0;
+
+    num_soundings = kma_mrz_num_soundings (d);
+    if (num_soundings > max_size - n) num_soundings = max_size - n;
+    if (num_soundings == 0) return 0;
+
+    mrz = &(d->datagram.mrz);
+    stride = mrz->rxInfo->numBytesPerSounding;
+
+    column[0] = c->x_reRefPoint_m;
+    column[1] = c->y_reRefPoint_m;
+    column[2] = c->z_reRefPoint_m;
+    column[3] = c->detectionType;
+    column[4] = c->reflectivity1_dB;
+    column[5] = c->beamAngleReRx_deg;
+    column[6] = c->reflectivity2_dB;
+    column[7] = c->twoWayTravelTime_sec;
+    column[8] = c->qualityFactor;
+    column[9] = c->detectionUncertaintyVer_m;
+    column[10] = c->detectionUncertaintyHor_m;
+    column[11] = c->deltaLatitude_deg;
+    column[12] = c->deltaLongitude_deg;
+
+    /* Fill one column at a time, so each output array is written sequentially. */
+    for (j=0; j<KMA_MRZ_NUM_COLUMNS; j++) {
+        if (!(mask & (1U << j)) || !column[j]) continue;
+
+        out = column[j] + n;
+        q = (const uint8_t *) mrz->sounding + kma_mrz_column[j].offset;
+
+        if (kma_mrz_column[j].offset + (kma_mrz_column[j].is_float ? sizeof (float) : sizeof (uint8_t)) > stride) {
+            for (i=0; i<num_soundings; i++) {
+                out[i] = NAN;
+            }
+        } else if (kma_mrz_column[j].is_float) {
+            for (i=0; i<num_soundings; i++, q+=stride) {
+                memcpy (&(out[i]), q, sizeof (float));
+            }
+        } else {
+            for (i=0; i<num_soundings; i++, q+=stride) {
+                out[i] = (float) *q;
+            }
+        }
+    }
+
+    return num_soundings;
+}
+
+
+/******************************************************************************
+*
+* kma_alloc_mrz_columns - Allocate the arrays of the column set C selected by
+*   the KMA_MRZ_COLUMN flags in MASK from the memory arena A, with room for N
+*   soundings each.  The arrays of columns not selected are set to NULL.  The
+*   arrays are released with the arena, e.g., by cpl_arena_reset() after
+*   each ping, and must not be freed otherwise.
+*
+* Return: 0 if the arrays were allocated, or
+*         CS_ENOMEM if memory allocation failed.
+*
+******************************************************************************/
+
+int kma_alloc_mrz_columns (
+    kma_mrz_columns *c,
+    const unsigned int mask,
+    const size_t n,
+    cpl_arena *a) {
+
+    float **column[KMA_MRZ_NUM_COLUMNS];
+    size_t j;
+
+
+    assert (c);
+    assert (a);
+
+    column[0] = &(c->x_reRefPoint_m);
+    column[1] = &(c->y_reRefPoint_m);
+    column[2] = &(c->z_reRefPoint_m);
+    column[3] = &(c->detectionType);
+    column[4] = &(c->reflectivity1_dB);
+    column[5] = &(c->beamAngleReRx_deg);
+    column[6] = &(c->reflectivity2_dB);
+    column[7] = &(c->twoWayTravelTime_sec);
+    column[8] = &(c->qualityFactor);
+    column[9] = &(c->detectionUncertaintyVer_m);
+    column[10] = &(c->detectionUncertaintyHor_m);
+    column[11] = &(c->deltaLatitude_deg);
+    column[12] = &(c->deltaLongitude_deg);
+
+    for (j=0; j<KMA_MRZ_NUM_COLUMNS; j++) {
+        *column[j] = NULL;
+    }
+
+    for (j=0; j<KMA_MRZ_NUM_COLUMNS; j++) {
+        if (!(mask & (1U << j))) continue;
+
+        *column[j] = (float *) cpl_arena_calloc (a, n, sizeof (float));
+        if (!*column[j]) return CS_ENOMEM;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_add_mrz_table_columns - Add the columns of the MRZ soundings selected by
+*   the KMA_MRZ_COLUMN flags in MASK to the table T, which is then written by
+*   kma_write_mrz_table().  Each row is one sounding, with the columns "time"
+*   in nanoseconds since 1970-01-01 (int64), "pingCnt" (uint16), and
+*   "soundingIndex" (uint16), followed by the selected fields named as in
+*   kma_mrz_columns (float).
+*
+* Return: 0 if the columns were added, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EINVAL
+*         CS_ENOMEM
+*
+******************************************************************************/
+
+int kma_add_mrz_table_columns (
+    cpl_table *t,
+    const unsigned int mask) {
+
+    int status;
+    size_t j;
+
+
+    assert (t);
+
+    if ((status = cpl_table_add_column (t, "time", CPL_TABLE_INT64)) < 0) return status;
+    if ((status = cpl_table_add_column (t, "pingCnt", CPL_TABLE_UINT16)) < 0) return status;
+    if ((status = cpl_table_add_column (t, "soundingIndex", CPL_TABLE_UINT16)) < 0) return status;
+
+    for (j=0; j<KMA_MRZ_NUM_COLUMNS; j++) {
+        if (!(mask & (1U << j))) continue;
+        if ((status = cpl_table_add_column (t, kma_mrz_column[j].name, CPL_TABLE_FLOAT32)) < 0) return status;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_write_mrz_table - Add the soundings of the MRZ datagram in D as rows of
+*   the table T, which has the columns added by kma_add_mrz_table_columns().
+*   The fields are copied by kma_get_mrz_columns() directly into the column
+*   arrays of the table, and columns of the table not known here are left as
+*   zero.  Nothing is done if D is not an MRZ datagram or has no soundings,
+*   and soundings that do not fit in the datagram size are not added.
+*
+* Return: The number of soundings added, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EWRITE
+*
+******************************************************************************/
+
+int kma_write_mrz_table (
+    cpl_table *t,
+    const kma_data *d) {
+
+    const kma_datagram_mrz *mrz;
+    float **column[KMA_MRZ_NUM_COLUMNS];
+    kma_mrz_columns c;
+    const uint8_t *q;
+    unsigned int mask;
+    size_t num_soundings;
+    size_t stride;
+    size_t i, j;
+    int64_t *time;
+    uint16_t *ping, *index;
+    int status;
+    int k;
+
+
+    assert (t);
+    assert (d);
+
+    mrz = &(d->datagram.mrz);
+
+    num_soundings = kma_mrz_num_soundings (d);
+    if (num_soundings == 0) return 0;
+
+    status = cpl_table_reserve (t, num_soundings);
+    if (status != CS_ENONE) return status;
+
+    column[0] = &(c.x_reRefPoint_m);
+    column[1] = &(c.y_reRefPoint_m);
+    column[2] = &(c.z_reRefPoint_m);
+    column[3] = &(c.detectionType);
+    column[4] = &(c.reflectivity1_dB);
+    column[5] = &(c.beamAngleReRx_deg);
+    column[6] = &(c.reflectivity2_dB);
+    column[7] = &(c.twoWayTravelTime_sec);
+    column[8] = &(c.qualityFactor);
+    column[9] = &(c.detectionUncertaintyVer_m);
+    column[10] = &(c.detectionUncertaintyHor_m);
+    column[11] = &(c.deltaLatitude_deg);
+    column[12] = &(c.deltaLongitude_deg);
+
+    mask = 0;
+    for (j=0; j<KMA_MRZ_NUM_COLUMNS; j++) {
+        k = cpl_table_find_column (t, kma_mrz_column[j].name);
+        if (k >= 0) {
+            *column[j] = (float *) cpl_table_get_column (t, k);
+            mask |= 1U << j;
+        } else {
+            *column[j] = NULL;
+        }
+    }
+
+    kma_get_mrz_columns (d, mask, &c, 0, num_soundings);
+
+    if ((k = cpl_table_find_column (t, "time")) >= 0) {
+        time = (int64_t *) cpl_table_get_column (t, k);
+        for (i=0; i<num_soundings; i++) {
+            time[i] = (int64_t) d->header.time_sec * 1000000000 + d->header.time_nanosec;
+        }
+    }
+
+    if (((k = cpl_table_find_column (t, "pingCnt")) >= 0) && mrz->common) {
+        ping = (uint16_t *) cpl_table_get_column (t, k);
+        for (i=0; i<num_soundings; i++) {
+            ping[i] = mrz->common->pingCnt;
+        }
+    }
+
+    stride = mrz->rxInfo->numBytesPerSounding;
+    if (((k = cpl_table_find_column (t, "soundingIndex")) >= 0) && (stride >= sizeof (uint16_t))) {
+        index = (uint16_t *) cpl_table_get_column (t, k);
+        q = (const uint8_t *) mrz->sounding + offsetof (kma_datagram_mrz_sounding, soundingIndex);
+        for (i=0; i<num_soundings; i++, q+=stride) {
+            memcpy (&(index[i]), q, sizeof (uint16_t));
+        }
+    }
+
+    cpl_table_commit (t, num_soundings);
+
+    return (int) num_soundings;
+}
+
+
+/******************************************************************************
+*
+* kma_get_mrz_snippets - Append the seabed image samples of each sounding of the
+*   MRZ datagram D to the snippet buffer S, which stores the samples of all
+*   beams in one flat array of floats converted from 0.1 dB to dB.  The offset
+*   of the first sample of each beam in the sample array and its number of
+*   samples SInumSamples are stored in the offset and length arrays, with one
+*   entry per sounding in the same order as the soundings, so that beams with
+*   no samples have a length of zero.  The snippets of several pings can be
+*   stored one after the other, since the samples and beams are stored after
+*   the num_samples and num_beams already in S.  The same layout is used by
+*   emx_get_seabed_89_snippets() for the EMX format.  Nothing is stored if D
+*   is not an MRZ datagram.
+*
+* Return: 0 if the snippets of the ping were stored,
+*         CS_EBADDATA if the soundings or samples are larger than the datagram,
+*           or
+*         CS_EOVERFLOW if the ping does not fit in the arrays of S, in which
+*           case S is unchanged.
+*
+******************************************************************************/
+
+int kma_get_mrz_snippets (
+    const kma_data *d,
+    cpl_snippets *s) {
+
+    const kma_datagram_mrz *mrz;
+    const uint8_t *q;
+    const char *end;
+    size_t num_soundings;
+    size_t num_samples;
+    size_t stride;
+    size_t i;
+    uint16_t n;
+
+
+    assert (d);
+    assert (s);
+
+    mrz = &(d->datagram.mrz);
+
+    if ((d->header.dgmType != KMA_DATAGRAM_MRZ) || !mrz->partition || !mrz->rxInfo || !mrz->sounding) return CS_ENONE;
+
+    /* The datagram body starts with the partition info and ends with the datagram size. */
+    if (d->header.numBytesDgm < sizeof (kma_datagram_header) + sizeof (uint32_t)) return CS_EBADDATA;
+    end = (const char *) mrz->partition + d->header.numBytesDgm - sizeof (kma_datagram_header) - sizeof (uint32_t);
+
+    num_soundings = mrz->rxInfo->numSoundingsMaxMain + mrz->rxInfo->numExtraDetections;
+    stride = mrz->rxInfo->numBytesPerSounding;
+
+    if (((const char *) mrz->sounding > end) || ((const char *) mrz->sample > end) ||
+        (num_soundings * stride > (size_t) (end - (const char *) mrz->sounding))) {
+        cpl_debug (kma_debug, "Invalid number of MRZ soundings (%lu)\n", (unsigned long) num_soundings);
+        return CS_EBADDATA;
+    }
+
+    /* Soundings of an older format without the seabed image fields have no samples. */
+    if (offsetof (kma_datagram_mrz_sounding, SInumSamples) + sizeof (uint16_t) > stride) {
+        q = NULL;
+    } else {
+        q = (const uint8_t *) mrz->sounding + offsetof (kma_datagram_mrz_sounding, SInumSamples);
+    }
+
+    /* Find the total number of samples first, so nothing is stored if the ping does not fit. */
+    num_samples = 0;
+    if (q) {
+        for (i=0; i<num_soundings; i++) {
+            memcpy (&n, q + i * stride, sizeof (uint16_t));
+            num_samples += n;
+        }
+    }
+
+    if (num_samples * sizeof (int16_t) > (size_t) (end - (const char *) mrz->sample)) {
+        cpl_debug (kma_debug, "Invalid number of seabed image samples (%lu)\n", (unsigned long) num_samples);
+        return CS_EBADDATA;
+    }
+
+    if ((num_soundings > s->max_beams - s->num_beams) || (num_samples > s->max_samples - s->num_samples)) {
+        return CS_EOVERFLOW;
+    }
+
+    num_samples = 0;
+    for (i=0; i<num_soundings; i++) {
+        n = 0;
+        if (q) memcpy (&n, q + i * stride, sizeof (uint16_t));
+
+        s->offset[s->num_beams] = s->num_samples;
+        s->length[s->num_beams] = n;
+        s->num_beams++;
+
+        if (n > 0) {
+            cpl_convert_samples16 (s->sample + s->num_samples, mrz->sample + num_samples, n, 0.1f);
+            s->num_samples += n;
+            num_samples += n;
+        }
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_get_mwc_rx_beam_data - The MWC RX beam data stored in the .kmall format
+*   consists of the kma_datagram_mwc_rx_beam_data struct followed by numSamples
+*   of amplitude data and optionally 8-bit or 16-bit phase data.  This function
+*   will set the pointers in the Rx beam data object D for the data stream
+*   starting at P with PHASE_FLAG.  The start of the next RX beam data stream
+*   will be returned.  Note: Check sample and beamphase arrays are not NULL
+*   when function returns.
+*
+* Return: A pointer to the next RX beam data, or
+*         NULL if numBytesPerBeamEntry is invalid.
+*
+******************************************************************************/
+
+const uint8_t * kma_get_mwc_rx_beam_data (
+    kma_datagram_mwc_rx_beam *d,
+    const uint8_t *p,
+    const uint8_t phase_flag,
+    const uint8_t numBytesPerBeamEntry) {
+
+    assert (d);
+    assert (p);
+
+    d->data = NULL;
+    d->sampleAmplitude_05dB = NULL;
+    d->rxBeamPhase1 = NULL;
+    d->rxBeamPhase2 = NULL;
+
+    if (numBytesPerBeamEntry == 0) {
+        cpl_debug (kma_debug, "Invalid numBytesPerBeamEntry\n");
+        return NULL;
+    }
+
+    d->data = (kma_datagram_mwc_rx_beam_data *) p;
+    p = p + numBytesPerBeamEntry;
+
+    if (d->data->numSamples > 0) {
+        d->sampleAmplitude_05dB = (int8_t *) p;
+        p = p + d->data->numSamples * sizeof (int8_t);
+
+        if (phase_flag == KMA_MWC_RX_PHASE_LOW) {
+            d->rxBeamPhase1 = (int8_t *) p;
+            p = p + d->data->numSamples * sizeof (int8_t);
+        } else if (phase_flag == KMA_MWC_RX_PHASE_HIGH) {
+            d->rxBeamPhase2 = (int16_t *) p;
+            p = p + d->data->numSamples * sizeof (int16_t);
+        }
+    }
+
+    return p;
+}
+
+
+/******************************************************************************
+*
+* kma_init_mwc_table - Initialize the MWC beam table T, which must be done
+*   before it is used by kma_build_mwc_table().
+*
+******************************************************************************/
+
+void kma_init_mwc_table (
+    kma_mwc_table *t) {
+
+    assert (t);
+
+    t->beam = NULL;
+    t->num_beams = 0;
+    t->max_samples = 0;
+    t->beam_alloc = 0;
+    t->phaseFlag = KMA_MWC_RX_PHASE_OFF;
+    t->numBytesPerBeamEntry = 0;
+}
+
+
+/******************************************************************************
+*
+* kma_free_mwc_table - Free the memory used by the MWC beam table T.
+*
+******************************************************************************/
+
+void kma_free_mwc_table (
+    kma_mwc_table *t) {
+
+    assert (t);
+
+    if (t->beam) cpl_free ((void *) t->beam);
+
+    kma_init_mwc_table (t);
+}
+
+
+/******************************************************************************
+*
+* kma_build_mwc_table - Build the table T of the RX beams of the water column
+*   datagram D.  Since the position of each RX beam depends on the numSamples
+*   and phaseFlag of the beams before it, the beams are walked once here so
+*   that any beam can then be found in constant time by kma_get_mwc_table_beam(),
+*   and the maximum number of samples of the beams is found for
+*   kma_get_mwc_matrix().  The table points into the datagram, so it is only
+*   valid until the next datagram is read, and the memory of the table is
+*   reused if it is built again for the next ping.
+*
+* Return: 0 if the table was built,
+*         CS_ENOMEM if memory could not be allocated, or
+*         CS_EBADDATA if numBytesPerBeamEntry is invalid.
+*
+******************************************************************************/
+
+int kma_build_mwc_table (
+    kma_mwc_table *t,
+    const kma_datagram_mwc *d) {
+
+    kma_datagram_mwc_rx_beam rx_beam;
+    const uint8_t **beam;
+    const uint8_t *p;
+    size_t num_beams;
+    size_t i;
+
+
+    assert (t);
+    assert (d);
+
+    t->num_beams = 0;
+    t->max_samples = 0;
+
+    if (!d->rxInfo || !d->beamData) return CS_ENONE;
+
+    t->phaseFlag = d->rxInfo->phaseFlag;
+    t->numBytesPerBeamEntry = d->rxInfo->numBytesPerBeamEntry;
+
+    num_beams = d->rxInfo->numBeams;
+    if (num_beams > t->beam_alloc) {
+        beam = (const uint8_t **) cpl_realloc ((void *) t->beam, num_beams * sizeof (const uint8_t *));
+        if (!beam) return CS_ENOMEM;
+
+        t->beam = beam;
+        t->beam_alloc = num_beams;
+    }
+
+    p = d->beamData;
+    for (i=0; i<num_beams; i++) {
+        t->beam[i] = p;
+
+        p = kma_get_mwc_rx_beam_data (&rx_beam, p, t->phaseFlag, t->numBytesPerBeamEntry);
+        if (!p) return CS_EBADDATA;
+
+        if (rx_beam.data->numSamples > t->max_samples) {
+            t->max_samples = rx_beam.data->numSamples;
+        }
+    }
+
+    t->num_beams = num_beams;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_get_mwc_table_beam - Set the pointers in the Rx beam data object D for
+*   the BEAM_NUM beam in the MWC beam table T, which is the same as walking the
+*   beams with kma_get_mwc_rx_beam_data().
+*
+* Return: 0 if the beam was found, or
+*         CS_EINVAL if BEAM_NUM is not in the table.
+*
+******************************************************************************/
+
+int kma_get_mwc_table_beam (
+    const kma_mwc_table *t,
+    const size_t beam_num,
+    kma_datagram_mwc_rx_beam *d) {
+
+    assert (t);
+    assert (d);
+
+    if (beam_num >= t->num_beams) return CS_EINVAL;
+
+    kma_get_mwc_rx_beam_data (d, t->beam[beam_num], t->phaseFlag, t->numBytesPerBeamEntry);
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_get_mwc_matrix - Fill the dense matrices AMPLITUDE and PHASE with the
+*   samples of the RX beams in the MWC beam table T.  Each matrix stores one
+*   beam per row of ROW_SIZE floats, which must be at least the max_samples of
+*   the table, so the caller must provide num_beams * ROW_SIZE floats.  The
+*   amplitudes are converted from 0.5 dB to dB, and the phases are converted to
+*   degrees.  Samples past the numSamples of a beam are set to NaN, as are the
+*   phases if the datagram has no phase data.  Either AMPLITUDE or PHASE may be
+*   NULL if not needed.  Note: Null amplitudes of -128 are converted to -64 dB.
+*
+* Return: 0 if the matrices were filled, or
+*         CS_EINVAL if ROW_SIZE is less than max_samples.
+*
+******************************************************************************/
+
+int kma_get_mwc_matrix (
+    const kma_mwc_table *t,
+    float *amplitude,
+    float *phase,
+    const size_t row_size) {
+
+    kma_datagram_mwc_rx_beam rx_beam;
+    const uint8_t *q;
+    size_t num_samples;
+    size_t i, j;
+    float *out;
+
+
+    assert (t);
+
+    if (row_size < t->max_samples) return CS_EINVAL;
+
+    for (i=0; i<t->num_beams; i++) {
+
+        kma_get_mwc_rx_beam_data (&rx_beam, t->beam[i], t->phaseFlag, t->numBytesPerBeamEntry);
+        num_samples = rx_beam.sampleAmplitude_05dB ? rx_beam.data->numSamples : 0;
+
+        if (amplitude) {
+            out = amplitude + i * row_size;
+
+            if (num_samples > 0) {
+                cpl_convert_samples8 (out, rx_beam.sampleAmplitude_05dB, num_samples, 0.5f);
+            }
+
+            for (j=num_samples; j<row_size; j++) {
+                out[j] = NAN;
+            }
+        }
+
+        if (phase) {
+            out = phase + i * row_size;
+            j = 0;
+
+            if (rx_beam.rxBeamPhase1) {
+                cpl_convert_samples8 (out, rx_beam.rxBeamPhase1, num_samples, 180.0f / 128.0f);
+                j = num_samples;
+            } else if (rx_beam.rxBeamPhase2) {
+                /* The 16-bit phases are little-endian and may not be aligned in the datagram. */
+                q = (const uint8_t *) rx_beam.rxBeamPhase2;
+                for (; j<num_samples; j++, q+=2) {
+                    out[j] = (int16_t) (q[0] | (q[1] << 8)) * 0.01f;
+                }
+            }
+
+            for (; j<row_size; j++) {
+                out[j] = NAN;
+            }
+        }
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_get_errno - Return the error number from the last call.
+*
+******************************************************************************/
+
+int kma_get_errno (
+    const kma_handle *h) {
+
+    assert (h);
+    return h->kma_errno;
+}
+
+
+/******************************************************************************
+*
+* kma_identify - Determine if the file given by FILE_NAME is a KMA file.  The
+*   first KMA_IDENTIFY_SIZE bytes of the file are read once and checked by
+*   kma_identify_data().
+*
+* Return: 1 if the file is a KMA file,
+*         0 if the file is not a KMA file, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EOPEN
+*         CS_ENOMEM
+*         CS_EREAD
+*
+******************************************************************************/
+
+int kma_identify (
+    const char *file_name) {
+
+    ssize_t result;
+    char *buffer;
+    int fd;
+
+
+    if (!file_name) return 0;
+
+    /* Open the binary file for read-only access or return on failure. */
+    fd = cpl_open (file_name, CPL_OPEN_RDONLY | CPL_OPEN_BINARY | CPL_OPEN_SEQUENTIAL);
+
+    if (fd < 0) {
+        cpl_debug (kma_debug, "Open failed for file '%s'\n", file_name);
+        return CS_EOPEN;
+    }
+
+    buffer = (char *) cpl_malloc (KMA_IDENTIFY_SIZE);
+    if (!buffer) {
+        cpl_close (fd);
+        return CS_ENOMEM;
+    }
+
+    /* Read the start of the file and close the file. */
+    result = cpl_read (buffer, KMA_IDENTIFY_SIZE, fd);
+    cpl_close (fd);
+
+    if (result < 0) {
+        cpl_debug (kma_debug, "Read error occurred for file '%s'\n", file_name);
+        cpl_free (buffer);
+        return CS_EREAD;
+    }
+
+    /* Validate the datagram headers and return the result. */
+    result = kma_identify_data (buffer, (size_t) result);
+
+    cpl_free (buffer);
+
+    return (int) result;
+}
+
+
+/******************************************************************************
+*
+* kma_identify_data - Determine if the SIZE bytes DATA at the start of a file
+*   are KMA data.  Up to KMA_IDENTIFY_HEADERS consecutive datagram headers are
+*   validated, and the datagram size at the end of each datagram in DATA must
+*   match its header, so random data is very unlikely to be taken as a KMA
+*   file.  A datagram that extends past the end of DATA ends the check.
+*
+* Return: 1 if the data is KMA data, or
+*         0 if the data is not KMA data.
+*
+******************************************************************************/
+
+int kma_identify_data (
+    const void *data,
+    const size_t size) {
+
+    kma_datagram_header header;
+    const char *p = (const char *) data;
+    uint32_t datagram_size;
+    size_t offset = 0;
+    size_t n = 0;
+
+
+    assert (data || (size == 0));
+
+    while ((n < KMA_IDENTIFY_HEADERS) && (size - offset >= sizeof (kma_datagram_header))) {
+        memcpy (&header, p + offset, sizeof (kma_datagram_header));
+        if (!kma_valid_header (&header)) return 0;
+
+        n++;
+
+        if (header.numBytesDgm > size - offset) break;
+
+        memcpy (&datagram_size, p + offset + header.numBytesDgm - sizeof (uint32_t), sizeof (uint32_t));
+        if (datagram_size != header.numBytesDgm) {
+            cpl_debug (kma_debug, "Invalid datagram size at end of datagram (%u,%u)\n", datagram_size, header.numBytesDgm);
+            return 0;
+        }
+
+        offset += header.numBytesDgm;
+    }
+
+    return n > 0;
+}
+
+
+/******************************************************************************
+*
+* kma_new_handle - Allocate a handle that reads from the open file descriptor
+*   FD, or from data given to a push parser if FD is -1, and set the default
+*   read options.
+*
+* Return: A pointer to the new handle, or
+*         NULL if memory allocation failed.
+*
+******************************************************************************/
+
+static kma_handle * kma_new_handle (
+    const int fd) {
+
+    kma_handle *h;
+
+
+    h = (kma_handle *) cpl_malloc (sizeof (kma_handle));
+    if (!h) return NULL;
+
+    /* Initialize the buffered file reader.  The block is allocated on the first read. */
+    cpl_bfile_init (&(h->io), fd, CPL_BFILE_BLOCK_SIZE);
+
+    /* The file is not memory-mapped unless opened with kma_open_mmap. */
+    h->map = NULL;
+    h->map_size = 0;
+    h->map_offset = 0;
+
+    /* Initialize the file handle. */
+    h->kma_errno = CS_ENONE;
+    h->fd = fd;
+
+    /* Set boolean to ignore watercolumn data to false by default. */
+    h->ignore_mwc = 0;
+
+    /* Set boolean to ignore multibeam sounding data to false by default. */
+    h->ignore_mrz = 0;
+
+    /* All datagram types are read by default. */
+    h->filter = NULL;
+    h->filter_size = 0;
+    h->filter_exclude = 0;
+
+    /* Set boolean to resynchronize after corrupt data to false by default. */
+    h->resync = 0;
+    h->resync_bytes = 0;
+    h->resync_count = 0;
+
+    /* Datagrams that are skipped are followed by the next datagram by default. */
+    h->read_one = 0;
+
+    /* Navigation samples are only stored if requested. */
+    h->nav = NULL;
+    h->body = NULL;
+    h->retained = NULL;
+    h->released = NULL;
+
+    /* Datagrams are read by the calling thread unless read-ahead is requested. */
+    h->prefetch = NULL;
+
+    /* The datagrams are counted, but not timed or traced unless requested. */
+    memset (&(h->stats), 0, sizeof (kma_stats));
+    h->timing = 0;
+    h->trace = NULL;
+    h->trace_data = NULL;
+
+    /* The partition buffer is only allocated if a datagram is split into partitions. */
+    h->buffer = NULL;
+    h->buffer_size = 0;
+    h->part_size = 0;
+    h->part_type = 0;
+    h->part_time_sec = 0;
+    h->part_time_nsec = 0;
+    h->part_count = 0;
+    h->part_num = 0;
+
+    /* The datagram index is only created if requested. */
+    h->index = NULL;
+    h->index_size = 0;
+    h->index_alloc = 0;
+    h->index_by_type = NULL;
+    h->index_by_time = NULL;
+
+    return h;
+}
+
+
+/******************************************************************************
+*
+* kma_valid_header - Return non-zero if the header HEADER appears to be valid.
+*   Nothing is logged, since the resync search tests a header at every '#'
+*   byte, so the callers log the invalid headers they do not skip.
+*
+* Return: 1 if the header is valid,
+*         0 otherwise.
+*
+******************************************************************************/
+
+static int kma_valid_header (
+    const kma_datagram_header *header) {
+
+    assert (header);
+
+    /* Datagram size must be at least as large as the header plus 4-byte length field. */
+    if (header->numBytesDgm < sizeof (kma_datagram_header) + 4) return 0;
+
+    /* Make sure the datagram size is not unreasonably large, but be generous. */
+    if (header->numBytesDgm > 1<<30) return 0;
+
+    /* Verify that the datagram type field starts with '#'. */
+    if ((header->dgmType & 0x000000FF) != 0x00000023) return 0;
+
+    /* Verify nanosecond field is not out of range. */
+    if (header->time_nanosec > 1e9) return 0;
+
+    /* We could check the datagram type field against the known datagrams, but could
+       never guarantee we don't encounter a new or undocumented datagram type. */
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* kma_set_debug - Set the debugging output level for the KMA reader.
+*
+******************************************************************************/
+
+void kma_set_debug (
+    const int debug) {
+
+    kma_debug = debug;
+}
+
+
+/******************************************************************************
+*
+* kma_get_datagram_name - Return a character string of the name of the datagram
+*   given by DGMTYPE.  This string should not be modified by the caller.
+*
+******************************************************************************/
+
+const char * kma_get_datagram_name (
+    const uint32_t dgmType) {
+
+    const char *s;
+
+
+    switch (dgmType) {
+
+        case KMA_DATAGRAM_IIP : s = "IIP"; break;
+        case KMA_DATAGRAM_IOP : s = "IOP"; break;
+        case KMA_DATAGRAM_IBE : s = "IBE"; break;
+        case KMA_DATAGRAM_IBR : s = "IBR"; break;
+        case KMA_DATAGRAM_IBS : s = "IBS"; break;
+        case KMA_DATAGRAM_MRZ : s = "MRZ"; break;
+        case KMA_DATAGRAM_MWC : s = "MWC"; break;
+        case KMA_DATAGRAM_SPO : s = "SPO"; break;
+        case KMA_DATAGRAM_SKM : s = "SKM"; break;
+        case KMA_DATAGRAM_SVP : s = "SVP"; break;
+        case KMA_DATAGRAM_SVT : s = "SVT"; break;
+        case KMA_DATAGRAM_SCL : s = "SCL"; break;
+        case KMA_DATAGRAM_SDE : s = "SDE"; break;
+        case KMA_DATAGRAM_SHI : s = "SHI"; break;
+        case KMA_DATAGRAM_CPO : s = "CPO"; break;
+        case KMA_DATAGRAM_CHE : s = "CHE"; break;
+        case KMA_DATAGRAM_FCF : s = "FCF"; break;
+        default               : s = "UNKNOWN"; break;
+    }
+
+    return s;
+}
+
+
+/******************************************************************************
+*
+* kma_read_header - Read the datagram header at the current position of the file
+*   handle H into the header object of H and validate it.
+*
+* Return: 0 if the file is at EOF,
+*        >0 if the datagram header is read and is valid, or
+*        <0 if an error occurred reading the header or the header is invalid.
+*
+* Errors: CS_EREAD
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+static int kma_read_header (
+    kma_handle *h) {
+
+    size_t actual_read_size;
+    size_t read_size;
+    ssize_t result;
+
+
+    assert (h);
+
+    /* Set the read size to the datagram header size. */
+    read_size = sizeof (kma_datagram_header);
+
+    if (h->map) {
+        /* Copy the datagram header from the memory-mapped file. */
+        actual_read_size = h->map_size - h->map_offset;
+        if (actual_read_size > read_size) actual_read_size = read_size;
+        memcpy (&(h->d.header), h->map + h->map_offset, actual_read_size);
+        h->map_offset += actual_read_size;
+        h->io.bytes_read += actual_read_size;
+    } else {
+        /* Read the datagram header from the buffered file. */
+        result = cpl_bfile_read (&(h->io), &(h->d.header), read_size);
+        if (result < 0) {
+            cpl_debug (kma_debug, "Read error occurred\n");
+            return CS_EREAD;
+        }
+
+        actual_read_size = (size_t) result;
+    }
+
+    /* If the read amount is zero, then it is EOF, otherwise if the read
+       amount is less than the datagram size, then the file is corrupt. */
+    if (actual_read_size != read_size) {
+        if (actual_read_size != 0) {
+            cpl_debug (kma_debug, "Unexpected end of file\n");
+            return CS_EBADDATA;
+        }
+        return 0;
+    }
+
+    /* Verify that the datagram header is valid. */
+    if (kma_valid_header (&(h->d.header)) == 0) {
+        cpl_debug (kma_debug, "Invalid header (size=%u, type=0x%08x, nanosec=%u)\n", h->d.header.numBytesDgm, h->d.header.dgmType, h->d.header.time_nanosec);
+        return CS_EBADDATA;
+    }
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* kma_parse - Set the datagram pointers of the file handle H into the datagram
+*   body P of size READ_SIZE (after the header in h->d.header).  Partitions of
+*   MRZ and MWC datagrams are joined first, and the navigation samples are
+*   stored if requested.  This is shared by kma_read() and the push parser.
+*
+* Return: 1 if the datagram is complete,
+*         0 if more partitions must be read, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+static int kma_parse (
+    kma_handle *h,
+    char *p,
+    const size_t read_size) {
+
+    uint32_t datagram_size;
+    int status;
+
+
+    assert (h);
+    assert (p);
+
+    /* Rejoin any multibeam or water column datagram that was split into several partitions.
+       The partitions are collected in the handle buffer until the last one is read, and
+       then the pointer p is set to the start of the joined datagram. */
+    if ((h->d.header.dgmType == KMA_DATAGRAM_MRZ) || (h->d.header.dgmType == KMA_DATAGRAM_MWC)) {
+        status = kma_join_partition (h, &p, read_size);
+
+        /* Either more partitions must be read or an error occurred. */
+        if (status <= 0) return status;
+    }
+
+    /* Save the start of the datagram body, which kma_retain() copies. */
+    h->body = p;
+
+    /* Set the pointers of the datagram array (channel) data into the correct places in the buffer. */
+    switch (h->d.header.dgmType) {
+
+        case KMA_DATAGRAM_IIP :
+
+            h->d.datagram.iip.data = (kma_datagram_iip_data *) p;
+            p += sizeof (kma_datagram_iip_data);
+            h->d.datagram.iip.install_text = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.iip.data->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected IIP datagram size (%u,%u)\n", h->d.datagram.iip.data->numBytesCmnPart, h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_IOP :
+
+            h->d.datagram.iop.data = (kma_datagram_iop_data *) p;
+            p += sizeof (kma_datagram_iop_data);
+            h->d.datagram.iop.runtime_text = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.iop.data->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected IOP datagram size (%u,%u)\n", h->d.datagram.iop.data->numBytesCmnPart, h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_IBE :
+
+            h->d.datagram.ibe.data = (kma_datagram_b_data *) p;
+            p += sizeof (kma_datagram_b_data);
+            h->d.datagram.ibe.bist_text = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.ibe.data->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected IBE datagram size (%u,%u)\n", h->d.datagram.ibe.data->numBytesCmnPart, h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_IBR :
+
+            h->d.datagram.ibr.data = (kma_datagram_b_data *) p;
+            p += sizeof (kma_datagram_b_data);
+            h->d.datagram.ibr.bist_text = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.ibr.data->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected IBR datagram size (%u,%u)\n", h->d.datagram.ibr.data->numBytesCmnPart, h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_IBS :
+
+            h->d.datagram.ibs.data = (kma_datagram_b_data *) p;
+            p += sizeof (kma_datagram_b_data);
+            h->d.datagram.ibs.bist_text = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.ibs.data->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected IBS datagram size (%u,%u)\n", h->d.datagram.ibs.data->numBytesCmnPart, h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_MRZ :
+
+            h->d.datagram.mrz.partition = (kma_datagram_m_partition *) p;
+            p += sizeof (kma_datagram_m_partition);
+
+            if ((h->d.datagram.mrz.partition->dgmNum != 1) || (h->d.datagram.mrz.partition->numOfDgms != 1)) {
+                cpl_debug (kma_debug, "Unexpected datagram partition (%u,%u)\n", h->d.datagram.mrz.partition->dgmNum, h->d.datagram.mrz.partition->numOfDgms);
+                return CS_EBADDATA;
+            }
+
+            /* TODO: Sanity check that all pointers are contained within the datagram buffer. */
+            h->d.datagram.mrz.common = (kma_datagram_m_common *) p;
+            p += h->d.datagram.mrz.common->numBytesCmnPart;
+            h->d.datagram.mrz.pingInfo = (kma_datagram_mrz_ping_info *) p;
+            p += h->d.datagram.mrz.pingInfo->numBytesInfoData;
+            if (h->d.header.dgmVersion == 0) {
+                h->d.datagram.mrz.txSectorInfo.v0 = (kma_datagram_mrz_tx_sector_info_v0 *) p;
+                h->d.datagram.mrz.txSectorInfo.v1 = NULL;
+            } else {
+                h->d.datagram.mrz.txSectorInfo.v0 = NULL;
+                h->d.datagram.mrz.txSectorInfo.v1 = (kma_datagram_mrz_tx_sector_info_v1 *) p;
+            }
+            p += h->d.datagram.mrz.pingInfo->numTxSectors * h->d.datagram.mrz.pingInfo->numBytesPerTxSector;
+            h->d.datagram.mrz.rxInfo = (kma_datagram_mrz_rx_info *) p;
+            p += h->d.datagram.mrz.rxInfo->numBytesRxInfo;
+            h->d.datagram.mrz.extraDetInfo = (kma_datagram_mrz_extra_det_info *) p;
+            p += h->d.datagram.mrz.rxInfo->numExtraDetectionClasses * h->d.datagram.mrz.rxInfo->numBytesPerClass;
+            h->d.datagram.mrz.sounding = (kma_datagram_mrz_sounding *) p;
+            p += (h->d.datagram.mrz.rxInfo->numSoundingsMaxMain + h->d.datagram.mrz.rxInfo->numExtraDetections) * h->d.datagram.mrz.rxInfo->numBytesPerSounding;
+            h->d.datagram.mrz.sample = (int16_t *) p;
+
+            if (h->d.datagram.mrz.pingInfo->numTxSectors == 0) {
+                h->d.datagram.mrz.txSectorInfo.v0 = NULL;
+                h->d.datagram.mrz.txSectorInfo.v1 = NULL;
+            }
+
+            if (h->d.datagram.mrz.rxInfo->numExtraDetectionClasses == 0) {
+                h->d.datagram.mrz.extraDetInfo = NULL;
+            }
+
+            if (h->d.datagram.mrz.rxInfo->numSoundingsMaxMain + h->d.datagram.mrz.rxInfo->numExtraDetections == 0) {
+                h->d.datagram.mrz.sounding = NULL;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_MWC :
+
+            h->d.datagram.mwc.partition = (kma_datagram_m_partition *) p;
+            p += sizeof (kma_datagram_m_partition);
+
+            if ((h->d.datagram.mwc.partition->dgmNum != 1) || (h->d.datagram.mwc.partition->numOfDgms != 1)) {
+                cpl_debug (kma_debug, "Unexpected datagram partition (%u,%u)\n", h->d.datagram.mwc.partition->dgmNum, h->d.datagram.mwc.partition->numOfDgms);
+                return CS_EBADDATA;
+            }
+
+            /* TODO: Sanity check that all pointers are contained within the datagram buffer. */
+            h->d.datagram.mwc.common = (kma_datagram_m_common *) p;
+            p += h->d.datagram.mwc.common->numBytesCmnPart;
+            h->d.datagram.mwc.txInfo = (kma_datagram_mwc_tx_info *) p;
+            p += h->d.datagram.mwc.txInfo->numBytesTxInfo;
+            h->d.datagram.mwc.txSectorInfo = (kma_datagram_mwc_tx_sector_info *) p;
+            p += h->d.datagram.mwc.txInfo->numTxSectors * h->d.datagram.mwc.txInfo->numBytesPerTxSector;
+            h->d.datagram.mwc.rxInfo = (kma_datagram_mwc_rx_info *) p;
+            p += h->d.datagram.mwc.rxInfo->numBytesRxInfo;
+            h->d.datagram.mwc.beamData = (uint8_t *) p;
+
+            if (h->d.datagram.mwc.rxInfo->numBeams == 0) {
+                h->d.datagram.mwc.beamData = NULL;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_SPO :
+
+            h->d.datagram.spo.common = (kma_datagram_s_common *) p;
+            p += h->d.datagram.spo.common->numBytesCmnPart;
+            h->d.datagram.spo.data = (kma_datagram_spo_data *) p;
+            p += sizeof (kma_datagram_spo_data);
+            h->d.datagram.spo.dataFromSensor = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.spo.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected SPO datagram size (%u,%u)\n", h->d.datagram.spo.common->numBytesCmnPart, h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_SKM :
+
+            h->d.datagram.skm.info = (kma_datagram_skm_info *) p;
+            p += h->d.datagram.skm.info->numBytesInfoPart;
+            h->d.datagram.skm.data = (kma_datagram_skm_sample *) p;
+
+            datagram_size = h->d.datagram.skm.info->numBytesInfoPart + ((uint32_t) h->d.datagram.skm.info->numBytesPerSample) * h->d.datagram.skm.info->numSamples +
+                sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected SKM datagram size (%u)\n", h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            if (h->d.datagram.skm.info->numSamples == 0) {
+                h->d.datagram.skm.data = NULL;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_SVP :
+
+            h->d.datagram.svp.info = (kma_datagram_svp_info *) p;
+            p += h->d.datagram.svp.info->numBytesInfoPart;
+            h->d.datagram.svp.data = (kma_datagram_svp_sample *) p;
+
+            datagram_size = h->d.datagram.svp.info->numBytesInfoPart + h->d.datagram.svp.info->numSamples * sizeof (kma_datagram_svp_sample) + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected SVP datagram size (%u,%u)\n", h->d.datagram.svp.info->numSamples, h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            if (h->d.datagram.svp.info->numSamples == 0) {
+                h->d.datagram.svp.data = NULL;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_SVT :
+
+            h->d.datagram.svt.info = (kma_datagram_svt_info *) p;
+            p += h->d.datagram.svt.info->numBytesInfoPart;
+            h->d.datagram.svt.data = (kma_datagram_svt_sample *) p;
+
+            datagram_size = h->d.datagram.svt.info->numBytesInfoPart + ((uint32_t) h->d.datagram.svt.info->numBytesPerSample) * h->d.datagram.svt.info->numSamples + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected SVT datagram size (%u,%u)\n", h->d.datagram.svt.info->numSamples, h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            if (h->d.datagram.svp.info->numSamples == 0) {
+                h->d.datagram.svp.data = NULL;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_SCL :
+
+            h->d.datagram.scl.common = (kma_datagram_s_common *) p;
+            p += h->d.datagram.scl.common->numBytesCmnPart;
+            h->d.datagram.scl.data = (kma_datagram_scl_data *) p;
+            p += sizeof (kma_datagram_scl_data);
+            h->d.datagram.scl.dataFromSensor = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.scl.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected SCL datagram size (%u)\n", h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_SDE :
+
+            h->d.datagram.sde.common = (kma_datagram_s_common *) p;
+            p += h->d.datagram.sde.common->numBytesCmnPart;
+            if (h->d.header.dgmVersion == 0) {
+                h->d.datagram.sde.data.v0 = (kma_datagram_sde_data_v0 *) p;
+                h->d.datagram.sde.data.v1 = NULL;
+                p += sizeof (kma_datagram_sde_data_v0);
+            } else if (h->d.header.dgmVersion >= 1) {
+                h->d.datagram.sde.data.v0 = NULL;
+                h->d.datagram.sde.data.v1 = (kma_datagram_sde_data_v1 *) p;
+                p += sizeof (kma_datagram_sde_data_v1);
+            }
+            h->d.datagram.sde.dataFromSensor = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.sde.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected SDE datagram size (%u)\n", h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_SHI :
+
+            h->d.datagram.shi.common = (kma_datagram_s_common *) p;
+            p += h->d.datagram.shi.common->numBytesCmnPart;
+            h->d.datagram.shi.data = (kma_datagram_shi_data *) p;
+            p += sizeof (kma_datagram_shi_data);
+            h->d.datagram.shi.dataFromSensor = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.shi.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected SHI datagram size (%u)\n", h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_CPO :
+
+            h->d.datagram.cpo.common = (kma_datagram_s_common *) p;
+            p += h->d.datagram.cpo.common->numBytesCmnPart;
+            h->d.datagram.cpo.data = (kma_datagram_cpo_data *) p;
+            p += sizeof (kma_datagram_cpo_data);
+            h->d.datagram.cpo.dataFromSensor = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.cpo.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected CPO datagram size (%u)\n", h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_CHE :
+
+            h->d.datagram.che.common = (kma_datagram_m_common *) p;
+            p += h->d.datagram.che.common->numBytesCmnPart;
+            h->d.datagram.che.data = (kma_datagram_che_data *) p;
+
+            datagram_size = h->d.datagram.che.common->numBytesCmnPart + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected CHE datagram size (%u)\n", h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        case KMA_DATAGRAM_FCF :
+
+            h->d.datagram.fcf.partition = (kma_datagram_m_partition *) p;
+            p += sizeof (kma_datagram_m_partition);
+            h->d.datagram.fcf.common = (kma_datagram_f_common *) p;
+            h->d.datagram.fcf.fileName = (char *) (p + sizeof (kma_datagram_f_common));
+            p += h->d.datagram.fcf.common->numBytesCmnPart;
+            h->d.datagram.fcf.bsCalibrationFile = (uint8_t *) p;
+
+            datagram_size = h->d.datagram.fcf.common->numBytesCmnPart + sizeof (kma_datagram_m_partition) + sizeof (kma_datagram_header) + sizeof (uint32_t);
+
+            if (datagram_size > h->d.header.numBytesDgm) {
+                cpl_debug (kma_debug, "Unexpected FCF datagram size (%u)\n", h->d.header.numBytesDgm);
+                return CS_EBADDATA;
+            }
+
+            break;
+
+        default :
+
+            cpl_debug (kma_debug, "Unknown message type (%u) of size %u bytes\n",
+                h->d.header.dgmType, h->d.header.numBytesDgm);
+
+            break;
+    }
+
+    /* Store the navigation samples if requested. */
+    if (h->nav && (h->d.header.dgmType == KMA_DATAGRAM_SKM)) {
+        status = kma_add_nav (h->nav, &(h->d));
+        if (status != CS_ENONE) return status;
+    }
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* kma_skip - Skip SIZE bytes forward from the current position of the file
+*   handle H without reading the data.
+*
+* Return: 0 if the data was skipped, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ESEEK
+*
+******************************************************************************/
+
+static int kma_skip (
+    kma_handle *h,
+    const size_t size) {
+
+    assert (h);
+
+    if (h->map) {
+        /* Clamp to the end of the map, which behaves the same as seeking past EOF. */
+        if (h->map_size - h->map_offset < size) {
+            h->map_offset = h->map_size;
+        } else {
+            h->map_offset += size;
+        }
+    } else if (cpl_bfile_skip (&(h->io), size) != 0) {
+        cpl_debug (kma_debug, "Seek failed\n");
+        h->kma_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_filter_type - Return true if datagrams of type DGM_TYPE are rejected by
+*   the datagram type filter of the file handle H.
+*
+******************************************************************************/
+
+static int kma_filter_type (
+    const kma_handle *h,
+    const uint32_t dgm_type) {
+
+    size_t i;
+
+
+    assert (h);
+
+    for (i=0; i<h->filter_size; i++) {
+        if (h->filter[i] == dgm_type) {
+            return h->filter_exclude;
+        }
+    }
+
+    return !h->filter_exclude;
+}
+
+
+/******************************************************************************
+*
+* kma_copy_type - Return true if datagrams of type DGM_TYPE are copied by
+*   kma_copy() from the file handle H, which are those read by kma_read().
+*
+******************************************************************************/
+
+static int kma_copy_type (
+    const kma_handle *h,
+    const uint32_t dgm_type) {
+
+    assert (h);
+
+    if (h->ignore_mwc && (dgm_type == KMA_DATAGRAM_MWC)) return 0;
+    if (h->ignore_mrz && (dgm_type == KMA_DATAGRAM_MRZ)) return 0;
+    if (h->filter && kma_filter_type (h, dgm_type)) return 0;
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* kma_copy_write - Write SIZE bytes at P to the file descriptor FD.
+*
+* Return: 0 if the data was written, or
+*         CS_EWRITE if an error occurred.
+*
+******************************************************************************/
+
+static int kma_copy_write (
+    const int fd,
+    const char *p,
+    const size_t size) {
+
+    assert (p);
+
+    if ((size > 0) && (cpl_write (fd, p, size) != (ssize_t) size)) {
+        cpl_debug (kma_debug, "Failed to write datagrams (%lu bytes)\n", (unsigned long) size);
+        return CS_EWRITE;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_join_partition - Join the datagram partition of size READ_SIZE given by
+*   *P (after the datagram header) to the partition buffer of the file handle H.
+*   A partition contains the partition info, part of the datagram data, and the
+*   datagram size at the end.  The data of all partitions are concatenated after
+*   the partition info of the first partition, which is changed to indicate a
+*   single datagram, and the datagram size in the header is updated.  Partitions
+*   that are out of order, or that belong to a different datagram, are discarded
+*   along with any partially joined datagram.
+*
+* Return: 1 if the datagram is complete and *P is set to the joined datagram,
+*         0 if more partitions must be read, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EBADDATA
+*
+******************************************************************************/
+
+static int kma_join_partition (
+    kma_handle *h,
+    char **p,
+    const size_t read_size) {
+
+    const kma_datagram_m_partition *partition;
+    kma_datagram_m_partition *joined;
+    uint32_t datagram_size;
+    size_t data_size;
+    size_t size;
+    size_t alloc;
+    char *buffer;
+
+
+    assert (h);
+    assert (p);
+
+    partition = (const kma_datagram_m_partition *) *p;
+
+    /* The datagram is not split, so there is nothing to do. */
+    if (partition->numOfDgms == 1) {
+        return 1;
+    }
+
+    if ((partition->numOfDgms == 0) || (partition->dgmNum == 0) || (partition->dgmNum > partition->numOfDgms) ||
+        (read_size < sizeof (kma_datagram_m_partition) + sizeof (uint32_t))) {
+        cpl_debug (kma_debug, "Unexpected datagram partition (%u,%u)\n", partition->dgmNum, partition->numOfDgms);
+        return CS_EBADDATA;
+    }
+
+    /* Size of the datagram data in this partition without the partition info and the datagram size at the end. */
+    data_size = read_size - sizeof (kma_datagram_m_partition) - sizeof (uint32_t);
+
+    if (partition->dgmNum == 1) {
+        if (h->part_num != 0) {
+            cpl_debug (kma_debug, "Incomplete datagram discarded (%u,%u)\n", h->part_num, h->part_count);
+        }
+
+        /* Start a new datagram. */
+        size = sizeof (kma_datagram_m_partition) + data_size;
+        alloc = h->buffer_size;
+        buffer = (char *) cpl_realloc2 (h->buffer, size + sizeof (uint32_t), sizeof (char), &alloc);
+        if (!buffer) {
+            h->part_num = 0;
+            return CS_ENOMEM;
+        }
+
+        h->buffer = buffer;
+        h->buffer_size = alloc;
+        memcpy (h->buffer, *p, size);
+
+        h->part_size = size;
+        h->part_type = h->d.header.dgmType;
+        h->part_time_sec = h->d.header.time_sec;
+        h->part_time_nsec = h->d.header.time_nanosec;
+        h->part_count = partition->numOfDgms;
+        h->part_num = 1;
+
+        return 0;
+    }
+
+    /* The partition must be the next one of the datagram being joined. */
+    if ((h->part_num == 0) || (partition->dgmNum != h->part_num + 1) || (partition->numOfDgms != h->part_count) ||
+        (h->d.header.dgmType != h->part_type) || (h->d.header.time_sec != h->part_time_sec) || (h->d.header.time_nanosec != h->part_time_nsec)) {
+        cpl_debug (kma_debug, "Unexpected datagram partition (%u,%u) discarded\n", partition->dgmNum, partition->numOfDgms);
+        h->part_num = 0;
+        return 0;
+    }
+
+    /* Append the data leaving room for the datagram size at the end. */
+    size = h->part_size + data_size;
+    alloc = h->buffer_size;
+    buffer = (char *) cpl_realloc2 (h->buffer, size + sizeof (uint32_t), sizeof (char), &alloc);
+    if (!buffer) {
+        h->part_num = 0;
+        return CS_ENOMEM;
+    }
+
+    h->buffer = buffer;
+    h->buffer_size = alloc;
+    memcpy (h->buffer + h->part_size, *p + sizeof (kma_datagram_m_partition), data_size);
+
+    h->part_size = size;
+    h->part_num = partition->dgmNum;
+
+    if (h->part_num < h->part_count) {
+        return 0;
+    }
+
+    /* All partitions were joined, so finish the datagram. */
+    h->part_num = 0;
+
+    if (h->part_size + sizeof (kma_datagram_header) + sizeof (uint32_t) > UINT32_MAX) {
+        cpl_debug (kma_debug, "Joined datagram is too large (%lu)\n", (unsigned long) h->part_size);
+        return CS_EBADDATA;
+    }
+
+    datagram_size = (uint32_t) (h->part_size + sizeof (kma_datagram_header) + sizeof (uint32_t));
+    memcpy (h->buffer + h->part_size, &datagram_size, sizeof (uint32_t));
+    h->d.header.numBytesDgm = datagram_size;
+
+    joined = (kma_datagram_m_partition *) h->buffer;
+    joined->numOfDgms = 1;
+    joined->dgmNum = 1;
+
+    *p = h->buffer;
+
+    return 1;
+}
+
+
+/******************************************************************************
+*
+* kma_resync - Search forward for the next valid datagram after the corrupt
+*   datagram at file offset OFFSET in the file handle H, and set the file
+*   position to its start.  A datagram is valid if the datagram type starts with
+*   the '#' magic byte, the header is valid, and the datagram size at the end of
+*   the datagram agrees with the header.  The data is searched in blocks using
+*   memchr, so the search costs about the same as reading the data.
+*
+* Return: 1 if a valid datagram was found,
+*         0 if EOF was reached, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EREAD
+*         CS_ESEEK
+*
+******************************************************************************/
+
+static int kma_resync (
+    kma_handle *h,
+    const uint64_t offset) {
+
+    kma_datagram_header header;
+    uint32_t datagram_size;
+    uint64_t position;
+    size_t window;
+    size_t i, n;
+    ssize_t result;
+    char *p, *q;
+
+
+    assert (h);
+
+    cpl_debug (kma_debug, "Searching for a valid datagram after offset %lu\n", (unsigned long) offset);
+
+    /* Search the whole memory-mapped file at once, otherwise a block at a time. */
+    window = h->map ? h->map_size : h->io.block_size;
+    if (window < 4096) window = 4096;
+
+    position = offset + 1;
+
+    for (;;) {
+        result = kma_peek (h, position, window, &p);
+        if (result < 0) return (int) result;
+
+        n = (size_t) result;
+        if (n < sizeof (kma_datagram_header)) break;
+
+        /* The '#' magic byte is the first byte of the datagram type at offset 4 of the header,
+           and only datagrams with the whole header in the block are tested. */
+        i = 4;
+        while (i <= n - sizeof (kma_datagram_header) + 4) {
+            q = (char *) memchr (p + i, '#', n - sizeof (kma_datagram_header) + 5 - i);
+            if (!q) break;
+
+            i = (size_t) (q - p);
+            memcpy (&header, q - 4, sizeof (kma_datagram_header));
+
+            if (kma_valid_header (&header)) {
+                /* Get the datagram size at the end of the datagram, which may be past the block. */
+                if (i - 4 + header.numBytesDgm <= n) {
+                    memcpy (&datagram_size, p + i - 4 + header.numBytesDgm - sizeof (uint32_t), sizeof (uint32_t));
+                } else {
+                    datagram_size = 0;
+
+                    result = kma_peek (h, position + i - 4 + header.numBytesDgm - sizeof (uint32_t), sizeof (uint32_t), &q);
+                    if (result < 0) return (int) result;
+                    if (result == sizeof (uint32_t)) memcpy (&datagram_size, q, sizeof (uint32_t));
+
+                    /* Get the search block again. */
+                    result = kma_peek (h, position, window, &p);
+                    if (result < 0) return (int) result;
+                    if ((size_t) result != n) return CS_EREAD;
+                }
+
+                if (datagram_size == header.numBytesDgm) {
+                    position += i - 4;
+                    cpl_debug (kma_debug, "Found valid datagram at offset %lu\n", (unsigned long) position);
+
+                    h->resync_bytes += position - offset;
+                    h->resync_count++;
+
+                    if (kma_seek (h, position) != 0) return CS_ESEEK;
+
+                    return 1;
+                }
+            }
+
+            i++;
+        }
+
+        /* Stop at EOF, otherwise search the next block starting with the datagram headers
+           that did not fit in this block. */
+        if (n < window) break;
+
+        position += n - sizeof (kma_datagram_header) + 1;
+    }
+
+    /* No valid datagram was found, so skip to EOF. */
+    position += n;
+    cpl_debug (kma_debug, "No valid datagram found before end of file\n");
+
+    h->resync_bytes += position - offset;
+    h->resync_count++;
+
+    if (kma_seek (h, position) != 0) return CS_ESEEK;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* kma_peek - Set the file position of the handle H to OFFSET and set P to the
+*   next SIZE bytes without moving the file position.  The data remains valid
+*   until the next read from H.
+*
+* Return: The number of bytes available at P, which is less than SIZE only at
+*           EOF, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EREAD
+*         CS_ESEEK
+*
+******************************************************************************/
+
+static ssize_t kma_peek (
+    kma_handle *h,
+    const uint64_t offset,
+    const size_t size,
+    char **p) {
+
+    ssize_t result;
+
+
+    assert (h);
+    assert (p);
+
+    if (h->map) {
+        if (offset >= h->map_size) return 0;
+        *p = (char *) (h->map + offset);
+        return (ssize_t) (h->map_size - offset < size ? h->map_size - offset : size);
+    }
+
+    if (cpl_bfile_seek (&(h->io), (off_t) offset) != 0) {
+        cpl_debug (kma_debug, "Seek failed\n");
+        return CS_ESEEK;
+    }
+
+    if (cpl_bfile_reserve (&(h->io), size) != 0) {
+        return CS_ENOMEM;
+    }
+
+    result = cpl_bfile_peek (&(h->io), p, size);
+    if (result < 0) {
+        cpl_debug (kma_debug, "Read error occurred\n");
+        return CS_EREAD;
+    }
+
+    return result;
+}
+
+
+/******************************************************************************
+*
+* kma_batch_task - Read the file number N of the batch read state ARG as a task
+*   of the thread pool used by kma_read_files().
+*
+******************************************************************************/
+
+static void kma_batch_task (
+    void *arg,
+    const size_t n) {
+
+    kma_batch *b = (kma_batch *) arg;
+
+
+    assert (b);
+    b->file_status[n] = kma_batch_file (b, n);
+}
+
+
+/******************************************************************************
+*
+* kma_batch_file - Read the file number N of the batch read state B and pass
+*   each datagram to the callback function.
+*
+* Return: 0 if the file was read successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EOPEN
+*         CS_ECLOSE
+*         Any error from kma_read() or kma_build_index()
+*
+******************************************************************************/
+
+static int kma_batch_file (
+    kma_batch *b,
+    const size_t n) {
+
+    const kma_data *d;
+    kma_handle *h;
+    size_t i;
+    int status;
+
+
+    assert (b);
+
+    if (b->options & KMA_BATCH_MMAP) {
+        h = kma_open_mmap (b->file_names[n]);
+    } else {
+        h = kma_open (b->file_names[n]);
+    }
+
+    if (!h) return CS_EOPEN;
+
+    /* The threads already read in parallel, so each frame of a compressed file is decoded when it is read. */
+    cpl_bfile_set_threads (&(h->io), 0);
+
+    /* Let the caller set up the handle before reading. */
+    if (b->fn (h, NULL, n, b->user_data) != 0) {
+        return kma_close (h);
+    }
+
+    if (b->options & KMA_BATCH_SORT) {
+        /* Use the datagrams indexed before any invalid data. */
+        status = kma_build_index (h);
+
+        if ((status == CS_ENONE) || (status == CS_EBADDATA)) {
+            h->read_one = 1;
+            h->kma_errno = CS_ENONE;
+
+            i = 0;
+            while ((d = kma_read_indexed (h, &i)) != NULL) {
+                if (b->fn (h, d, n, b->user_data) != 0) break;
+            }
+
+            if (h->kma_errno != CS_ENONE) status = h->kma_errno;
+        }
+    } else {
+        while ((d = kma_read (h)) != NULL) {
+            if (b->fn (h, d, n, b->user_data) != 0) break;
+        }
+
+        status = h->kma_errno;
+    }
+
+    if (kma_close (h) != 0) {
+        if (status == CS_ENONE) status = CS_ECLOSE;
+    }
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* kma_read_indexed - Read the next datagram in order of time of the file given
+*   by the handle H, which must have a datagram index and be set to read one
+*   datagram at a time.  The datagram is read starting at the entry NEXT of the
+*   index in order of time, and NEXT is set to the entry following the datagram.
+*   Entries of datagrams rejected by the type filter and of the first partitions
+*   of a split datagram are skipped.
+*
+* Return: A pointer to the kma_data struct, or
+*         NULL if the end of the index was reached or an error occurred.
+*
+******************************************************************************/
+
+static kma_data * kma_read_indexed (
+    kma_handle *h,
+    size_t *next) {
+
+    const kma_index_entry *entry;
+    kma_data *d;
+
+
+    assert (h);
+    assert (next);
+
+    while (*next < h->index_size) {
+        entry = &(h->index[h->index_by_time[*next]]);
+        (*next)++;
+
+        if ((kma_tell (h) != entry->offset) && (kma_seek (h, entry->offset) != 0)) {
+            h->kma_errno = CS_ESEEK;
+            return NULL;
+        }
+
+        d = kma_read (h);
+        if (d) return d;
+        if (h->kma_errno != CS_ENONE) return NULL;
+    }
+
+    return NULL;
+}
+
+
+/******************************************************************************
+*
+* kma_merge_start - Read the first datagram of each input of the merged stream
+*   given by the handle M and build the heap of inputs.  If reading in order of
+*   time, then the datagram index of each input is built unless already loaded,
+*   and the datagrams indexed before any invalid data are used.
+*
+* Return: 0 if the inputs were read successfully, or
+*         error condition if an error occurred.
+*
+* Errors: Any error from kma_read() or kma_build_index()
+*
+******************************************************************************/
+
+static int kma_merge_start (
+    kma_merge *m) {
+
+    kma_handle *h;
+    size_t i;
+    int status;
+
+
+    assert (m);
+
+    m->heap_size = 0;
+
+    for (i=0; i<m->num_inputs; i++) {
+        h = m->input[i].h;
+
+        if (m->options & KMA_BATCH_SORT) {
+            if (!h->index_by_time) {
+                status = kma_build_index (h);
+                if ((status != CS_ENONE) && (status != CS_EBADDATA)) return status;
+            }
+
+            h->read_one = 1;
+            h->kma_errno = CS_ENONE;
+            m->input[i].next = 0;
+        }
+
+        status = kma_merge_advance (m, i);
+        if (status != CS_ENONE) return status;
+
+        if (m->input[i].d) {
+            m->heap[m->heap_size] = i;
+            kma_merge_sift_up (m, m->heap_size++);
+        }
+    }
+
+    m->started = 1;
+    cpl_debug (kma_debug, "Merging %lu of %lu inputs\n", (unsigned long) m->heap_size, (unsigned long) m->num_inputs);
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_merge_advance - Read the next datagram of the input N of the merged
+*   stream given by the handle M.  If N is in the heap, then it must be at the
+*   top and the heap is updated for its new time or N is removed at the end of
+*   its file.
+*
+* Return: 0 if the datagram was read or the end of the file was reached, or
+*         error condition if an error occurred.
+*
+* Errors: Any error from kma_read()
+*
+******************************************************************************/
+
+static int kma_merge_advance (
+    kma_merge *m,
+    const size_t n) {
+
+    kma_merge_input *in;
+    int in_heap;
+
+
+    assert (m);
+    assert (n < m->num_inputs);
+
+    in = &(m->input[n]);
+    in_heap = m->started && (m->heap_size > 0) && (m->heap[0] == n);
+
+    if (m->options & KMA_BATCH_SORT) {
+        in->d = kma_read_indexed (in->h, &(in->next));
+    } else {
+        in->d = kma_read (in->h);
+    }
+
+    if (in->d) {
+        in->time = kma_index_time (in->d->header.time_sec, in->d->header.time_nanosec);
+    } else if (in->h->kma_errno != CS_ENONE) {
+        return in->h->kma_errno;
+    }
+
+    if (in_heap) {
+        if (!in->d) m->heap[0] = m->heap[--m->heap_size];
+        kma_merge_sift_down (m, 0);
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_merge_before - Check if the next datagram of the input A of the merged
+*   stream given by the handle M is before that of the input B, which orders
+*   datagrams by time and then by input number.
+*
+* Return: 1 if the datagram of input A is first, or
+*         0 otherwise.
+*
+******************************************************************************/
+
+static int kma_merge_before (
+    const kma_merge *m,
+    const size_t a,
+    const size_t b) {
+
+    assert (m);
+
+    if (m->input[a].time != m->input[b].time) return m->input[a].time < m->input[b].time;
+    return a < b;
+}
+
+
+/******************************************************************************
+*
+* kma_merge_sift_down - Move the input at position I of the heap of the merged
+*   stream given by the handle M down until neither child is before it.
+*
+******************************************************************************/
+
+static void kma_merge_sift_down (
+    kma_merge *m,
+    size_t i) {
+
+    size_t child, t, n;
+
+
+    assert (m);
+
+    n = m->heap_size;
+
+    while ((child = 2 * i + 1) < n) {
+        if ((child + 1 < n) && kma_merge_before (m, m->heap[child + 1], m->heap[child])) child++;
+        if (!kma_merge_before (m, m->heap[child], m->heap[i])) break;
+
+        t = m->heap[i];
+        m->heap[i] = m->heap[child];
+        m->heap[child] = t;
+        i = child;
+    }
+}
+
+
+/******************************************************************************
+*
+* kma_merge_sift_up - Move the input at position I of the heap of the merged
+*   stream given by the handle M up until its parent is before it.
+*
+******************************************************************************/
+
+static void kma_merge_sift_up (
+    kma_merge *m,
+    size_t i) {
+
+    size_t parent, t;
+
+
+    assert (m);
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!kma_merge_before (m, m->heap[i], m->heap[parent])) break;
+
+        t = m->heap[i];
+        m->heap[i] = m->heap[parent];
+        m->heap[parent] = t;
+        i = parent;
+    }
+}
+
+
+/******************************************************************************
+*
+* kma_split_chunks - Store the start offsets of NUM_CHUNKS ranges of about equal
+*   size of the file given by the handle H in OFFSETS, followed by the file size.
+*   Each offset is that of an indexed datagram, but never one between the
+*   partitions of a split MRZ or MWC datagram.  Chunks that would start past the
+*   last indexed datagram are empty, so any data after the index, e.g., after
+*   invalid data, is read by the last chunk that is not empty.
+*
+* Return: 0 if the offsets were stored, or
+*         error condition if an error occurred.
+*
+* Errors: Any error from kma_build_index()
+*
+******************************************************************************/
+
+static int kma_split_chunks (
+    kma_handle *h,
+    uint64_t *offsets,
+    const size_t num_chunks) {
+
+    const kma_datagram_m_partition *partition;
+    const kma_index_entry *entry;
+    uint64_t file_size;
+    uint64_t target;
+    size_t i = 0;
+    size_t j, n;
+    int status;
+    char *p;
+
+
+    assert (h);
+    assert (offsets);
+
+    /* Use the datagrams indexed before any invalid data. */
+    status = kma_build_index (h);
+    if ((status != CS_ENONE) && (status != CS_EBADDATA)) return status;
+
+    if (kma_file_size (h, &file_size) != 0) return CS_ESEEK;
+
+    offsets[0] = 0;
+    offsets[num_chunks] = file_size;
+
+    for (n=1; n<num_chunks; n++) {
+        target = file_size / num_chunks * n;
+
+        /* Find the first datagram at or after the target in file order. */
+        while ((i < h->index_size) && (h->index[i].offset < target)) i++;
+
+        /* Move past the remaining partitions of a split datagram and any datagrams between them, which
+           are read by the previous chunk.  These are found before the next MRZ or MWC datagram start. */
+        for (j=i; j<h->index_size; j++) {
+            entry = &(h->index[j]);
+            if ((entry->dgmType != KMA_DATAGRAM_MRZ) && (entry->dgmType != KMA_DATAGRAM_MWC)) continue;
+
+            if (kma_peek (h, entry->offset + sizeof (kma_datagram_header), sizeof (kma_datagram_m_partition), &p) !=
+                (ssize_t) sizeof (kma_datagram_m_partition)) break;
+
+            partition = (const kma_datagram_m_partition *) p;
+            if (partition->dgmNum <= 1) break;
+            i = j + 1;
+        }
+
+        offsets[n] = i < h->index_size ? h->index[i].offset : file_size;
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_chunk_task - Read the chunk number N of the chunked read state ARG as a
+*   task of the thread pool used by kma_read_chunks().
+*
+******************************************************************************/
+
+static void kma_chunk_task (
+    void *arg,
+    const size_t n) {
+
+    kma_chunks *c = (kma_chunks *) arg;
+
+
+    assert (c);
+    c->chunk_status[n] = kma_chunk_file (c, n);
+}
+
+
+/******************************************************************************
+*
+* kma_chunk_file - Read the chunk number N of the chunked read state C using a
+*   new file handle and pass each datagram to the callback function.
+*
+* Return: 0 if the chunk was read successfully, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EOPEN
+*         CS_ECLOSE
+*         CS_ESEEK
+*         Any error from kma_read()
+*
+******************************************************************************/
+
+static int kma_chunk_file (
+    kma_chunks *c,
+    const size_t n) {
+
+    const kma_data *d;
+    kma_handle *h;
+    uint64_t offset;
+    int status;
+
+
+    assert (c);
+
+    if (c->offsets[n] >= c->offsets[n+1]) return CS_ENONE;
+
+    if (c->options & KMA_BATCH_MMAP) {
+        h = kma_open_mmap (c->file_name);
+    } else {
+        h = kma_open (c->file_name);
+    }
+
+    if (!h) return CS_EOPEN;
+
+    /* The threads already read in parallel, so each frame of a compressed file is decoded when it is read. */
+    cpl_bfile_set_threads (&(h->io), 0);
+
+    /* Let the caller set up the handle before reading. */
+    if (c->fn (h, NULL, n, c->user_data) != 0) {
+        return kma_close (h);
+    }
+
+    if (kma_seek (h, c->offsets[n]) != 0) {
+        h->kma_errno = CS_ESEEK;
+    } else {
+        /* Read one datagram at a time, so no datagram starting in the next chunk is passed.  A datagram
+           rejected by the type filter or the first partitions of a split datagram return NULL. */
+        h->read_one = 1;
+
+        while ((offset = kma_tell (h)) < c->offsets[n+1]) {
+            d = kma_read (h);
+
+            if (!d) {
+                if ((h->kma_errno != CS_ENONE) || (kma_tell (h) == offset)) break;
+                continue;
+            }
+
+            if (c->fn (h, d, n, c->user_data) != 0) break;
+        }
+    }
+
+    status = h->kma_errno;
+
+    if ((kma_close (h) != 0) && (status == CS_ENONE)) {
+        status = CS_ECLOSE;
+    }
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* kma_tell - Return the file offset of the next datagram to be read from the
+*   file handle H.
+*
+******************************************************************************/
+
+static uint64_t kma_tell (
+    const kma_handle *h) {
+
+    assert (h);
+
+    if (h->map) return h->map_offset;
+
+    return (uint64_t) cpl_bfile_tell (&(h->io));
+}
+
+
+/******************************************************************************
+*
+* kma_seek - Set the file offset of the next datagram to be read from the file
+*   handle H to OFFSET.
+*
+* Return: 0 if the file position was set, or
+*        -1 if an error occurred.
+*
+******************************************************************************/
+
+static int kma_seek (
+    kma_handle *h,
+    const uint64_t offset) {
+
+    assert (h);
+
+    if (h->map) {
+        if (offset > h->map_size) return -1;
+        h->map_offset = (size_t) offset;
+        return 0;
+    }
+
+    return cpl_bfile_seek (&(h->io), (off_t) offset);
+}
+
+
+/******************************************************************************
+*
+* kma_file_size - Store the size in bytes of the file given by the handle H in
+*   SIZE.
+*
+* Return: 0 if the file size is known, or
+*        -1 if the file is not a regular file.
+*
+******************************************************************************/
+
+static int kma_file_size (
+    const kma_handle *h,
+    uint64_t *size) {
+
+    cpl_stat_t stbuf;
+
+
+    assert (h);
+    assert (size);
+
+    if (h->map) {
+        *size = h->map_size;
+        return 0;
+    }
+
+    if (h->io.zfile) {
+        *size = cpl_zfile_get_size (h->io.zfile);
+        return 0;
+    }
+
+    if ((cpl_fstat (h->fd, &stbuf) != 0) || (stbuf.s_isreg == 0)) return -1;
+
+    *size = (uint64_t) stbuf.file_size;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* kma_index_time - Return the time given by TIME_SEC and TIME_NANOSEC as a
+*   single value in nanoseconds that is used to sort and search the index.
+*
+******************************************************************************/
+
+static uint64_t kma_index_time (
+    const uint32_t time_sec,
+    const uint32_t time_nanosec) {
+
+    return (uint64_t) time_sec * 1000000000 + time_nanosec;
+}
+
+
+/******************************************************************************
+*
+* kma_mrz_num_soundings - Return the number of soundings of the MRZ datagram in
+*   D, which is limited to the soundings that fit in the datagram size, so
+*   that a corrupt numSoundingsMaxMain or numExtraDetections does not read
+*   past the datagram.
+*
+* Return: The number of soundings, or 0 if D is not an MRZ datagram.
+*
+******************************************************************************/
+
+static size_t kma_mrz_num_soundings (
+    const kma_data *d) {
+
+    const kma_datagram_mrz *mrz;
+    const char *end;
+    size_t num_soundings;
+    size_t stride;
+    size_t size;
+
+
+    assert (d);
+
+    mrz = &(d->datagram.mrz);
+
+    if ((d->header.dgmType != KMA_DATAGRAM_MRZ) || !mrz->partition || !mrz->rxInfo || !mrz->sounding) return 0;
+
+    /* The datagram body starts with the partition info and ends with the datagram size. */
+    if (d->header.numBytesDgm < sizeof (kma_datagram_header) + sizeof (uint32_t)) return 0;
+    end = (const char *) mrz->partition + d->header.numBytesDgm - sizeof (kma_datagram_header) - sizeof (uint32_t);
+    if ((const char *) mrz->sounding > end) return 0;
+
+    num_soundings = mrz->rxInfo->numSoundingsMaxMain + mrz->rxInfo->numExtraDetections;
+    stride = mrz->rxInfo->numBytesPerSounding;
+    size = (size_t) (end - (const char *) mrz->sounding);
+
+    if ((stride > 0) && (num_soundings > size / stride)) {
+        cpl_debug (kma_debug, "Invalid number of MRZ soundings (%lu)\n", (unsigned long) num_soundings);
+        num_soundings = size / stride;
+    }
+
+    return num_soundings;
+}
+
+
+/******************************************************************************
+*
+* kma_compare_type - Compare the index sort keys A and B by datagram type, time,
+*   and file order for qsort.
+*
+******************************************************************************/
+
+static int kma_compare_type (
+    const void *a,
+    const void *b) {
+
+    const kma_index_key *ka = (const kma_index_key *) a;
+    const kma_index_key *kb = (const kma_index_key *) b;
+
+
+    if (ka->type != kb->type) return ka->type < kb->type ? -1 : 1;
+
+    return kma_compare_time (a, b);
+}
+
+
+/******************************************************************************
+*
+* kma_compare_time - Compare the index sort keys A and B by time and file order
+*   for qsort.
+*
+******************************************************************************/
+
+static int kma_compare_time (
+    const void *a,
+    const void *b) {
+
+    const kma_index_key *ka = (const kma_index_key *) a;
+    const kma_index_key *kb = (const kma_index_key *) b;
+
+
+    if (ka->time != kb->time) return ka->time < kb->time ? -1 : 1;
+    if (ka->entry != kb->entry) return ka->entry < kb->entry ? -1 : 1;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* kma_sort_index - Create the sorted index entry arrays of the file handle H,
+*   which are used to search the index by datagram type and time.
+*
+* Return: 0 if the arrays were created, or
+*        -1 if memory allocation failed.
+*
+******************************************************************************/
+
+static int kma_sort_index (
+    kma_handle *h) {
+
+    kma_index_key *keys;
+    size_t i, n;
+
+
+    assert (h);
+
+    if (h->index_by_type) cpl_free (h->index_by_type);
+    if (h->index_by_time) cpl_free (h->index_by_time);
+
+    /* Allocate at least one element so an empty index is still valid. */
+    n = h->index_size > 0 ? h->index_size : 1;
+
+    h->index_by_type = (uint32_t *) cpl_malloc (n * sizeof (uint32_t));
+    h->index_by_time = (uint32_t *) cpl_malloc (n * sizeof (uint32_t));
+    keys = (kma_index_key *) cpl_malloc (n * sizeof (kma_index_key));
+
+    if (!h->index_by_type || !h->index_by_time || !keys) {
+        if (keys) cpl_free (keys);
+        if (h->index_by_type) cpl_free (h->index_by_type);
+        if (h->index_by_time) cpl_free (h->index_by_time);
+        h->index_by_type = NULL;
+        h->index_by_time = NULL;
+        return -1;
+    }
+
+    for (i=0; i<h->index_size; i++) {
+        keys[i].time = kma_index_time (h->index[i].time_sec, h->index[i].time_nanosec);
+        keys[i].type = h->index[i].dgmType;
+        keys[i].entry = (uint32_t) i;
+    }
+
+    qsort (keys, h->index_size, sizeof (kma_index_key), kma_compare_type);
+
+    for (i=0; i<h->index_size; i++) {
+        h->index_by_type[i] = keys[i].entry;
+    }
+
+    qsort (keys, h->index_size, sizeof (kma_index_key), kma_compare_time);
+
+    for (i=0; i<h->index_size; i++) {
+        h->index_by_time[i] = keys[i].entry;
+    }
+
+    cpl_free (keys);
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* kma_free_index - Free the datagram index of the file handle H.
+*
+******************************************************************************/
+
+static void kma_free_index (
+    kma_handle *h) {
+
+    assert (h);
+
+    if (h->index) cpl_free (h->index);
+    if (h->index_by_type) cpl_free (h->index_by_type);
+    if (h->index_by_time) cpl_free (h->index_by_time);
+
+    h->index = NULL;
+    h->index_size = 0;
+    h->index_alloc = 0;
+    h->index_by_type = NULL;
+    h->index_by_time = NULL;
+}
+
+
+/******************************************************************************
+*
+* kma_add_nav - Add the KM binary samples of the SKM datagram D to the
+*   navigation store NAV.  The heave is stored as NaN if it is invalid.
+*
+* Return: 0 if the samples were added, or
+*         CS_ENOMEM if memory could not be allocated.
+*
+******************************************************************************/
+
+static int kma_add_nav (
+    cpl_nav *nav,
+    const kma_data *d) {
+
+    const kma_datagram_skm_binary *b;
+    const uint8_t *p;
+    int64_t t;
+    double heave;
+    size_t i;
+    int status;
+
+
+    assert (nav);
+    assert (d);
+
+    if (!d->datagram.skm.info || !d->datagram.skm.data) return CS_ENONE;
+
+    /* The samples must at least hold the KMdefault struct. */
+    if (d->datagram.skm.info->numBytesPerSample < sizeof (kma_datagram_skm_binary)) return CS_ENONE;
+
+    p = (const uint8_t *) d->datagram.skm.data;
+
+    for (i=0; i<d->datagram.skm.info->numSamples; i++, p+=d->datagram.skm.info->numBytesPerSample) {
+
+        b = (const kma_datagram_skm_binary *) p;
+        t = (int64_t) b->time_sec * 1000000000 + b->time_nanosec;
+
+        /* Bits 0-3 of the status mark invalid position, roll and pitch, heading, and heave. */
+        if (!(b->status & 0x01)) {
+            status = cpl_nav_add_position (nav, t, b->latitude_deg, b->longitude_deg);
+            if (status != CS_ENONE) return status;
+        }
+
+        if (!(b->status & 0x02)) {
+            heave = (b->status & 0x08) ? NAN : b->heave_m;
+            status = cpl_nav_add_attitude (nav, t, b->roll_deg, b->pitch_deg, heave);
+            if (status != CS_ENONE) return status;
+        }
+
+        if (!(b->status & 0x04)) {
+            status = cpl_nav_add_heading (nav, t, b->heading_deg);
+            if (status != CS_ENONE) return status;
+        }
+    }
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_relocate - Change the pointers of the datagram D into the datagram body
+*   SRC of SIZE bytes to the same offsets into the copy of the body DST.  The
+*   members of the datagram union consist only of pointers, so each pointer in
+*   the union is relocated if it points into SRC.  Pointers of other datagram
+*   types that remain from earlier datagrams are left unchanged.
+*
+******************************************************************************/
+
+static void kma_relocate (
+    kma_datagram *d,
+    const char *src,
+    const size_t size,
+    char *dst) {
+
+    char *q = (char *) d;
+    const char *p;
+    void *ptr;
+    size_t i;
+
+
+    assert (d);
+    assert (src);
+    assert (dst);
+
+    for (i=0; i+sizeof (void *)<=sizeof (kma_datagram); i+=sizeof (void *)) {
+        memcpy (&ptr, q + i, sizeof (void *));
+        p = (const char *) ptr;
+
+        if (p && (p >= src) && (p <= src + size)) {
+            ptr = dst + (p - src);
+            memcpy (q + i, &ptr, sizeof (void *));
+        }
+    }
+}
+
+
+/******************************************************************************
+*
+* kma_parser_carry - Move the next SIZE bytes of the last feed of the push
+*   parser P to the end of its carry buffer.  The feed is unchanged if memory
+*   can not be allocated.
+*
+* Return: 0 if the data was moved, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*
+******************************************************************************/
+
+static int kma_parser_carry (
+    kma_parser *p,
+    const size_t size) {
+
+    size_t alloc;
+    char *buffer;
+
+
+    assert (p);
+    assert (size <= p->data_size);
+
+    /* Parsed data at the start of the buffer is no longer needed. */
+    if (p->carry_start > 0) {
+        memmove (p->carry, p->carry + p->carry_start, p->carry_end - p->carry_start);
+        p->carry_end -= p->carry_start;
+        p->carry_start = 0;
+    }
+
+    alloc = p->carry_size;
+    buffer = (char *) cpl_realloc2 (p->carry, p->carry_end + size, sizeof (char), &alloc);
+    if (!buffer) return CS_ENOMEM;
+
+    p->carry = buffer;
+    p->carry_size = alloc;
+    memcpy (p->carry + p->carry_end, p->data, size);
+    p->carry_end += size;
+    p->data += size;
+    p->data_size -= size;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_parser_fill - Copy data from the last feed of the push parser P to its
+*   carry buffer until it holds SIZE unparsed bytes or the feed is used up.
+*
+* Return: 0 if successful, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*
+******************************************************************************/
+
+static int kma_parser_fill (
+    kma_parser *p,
+    const size_t size) {
+
+    size_t n;
+
+
+    assert (p);
+
+    n = p->carry_end - p->carry_start;
+    if (n >= size) return CS_ENONE;
+
+    n = size - n;
+    if (n > p->data_size) n = p->data_size;
+    if (n == 0) return CS_ENONE;
+
+    return kma_parser_carry (p, n);
+}
+
+
+/******************************************************************************
+*
+* kma_parser_skip_byte - Skip the first byte of the corrupt datagram at the
+*   start of the unparsed data of the push parser P, and start searching for
+*   the next valid datagram.
+*
+******************************************************************************/
+
+static void kma_parser_skip_byte (
+    kma_parser *p,
+    const int in_carry) {
+
+    assert (p);
+
+    if (!p->searching) {
+        p->h->resync_count++;
+        p->searching = 1;
+    }
+
+    if (in_carry) {
+        p->carry_start++;
+    } else {
+        p->data++;
+        p->data_size--;
+    }
+
+    p->h->resync_bytes++;
+}
+
+
+/******************************************************************************
+*
+* kma_parser_search - Search the carry buffer of the push parser P for the next
+*   valid datagram after corrupt data.  A datagram is valid if the header is
+*   valid and the datagram size at the end agrees with the header.  A candidate
+*   that is not complete yet is kept, but a later valid datagram is preferred so
+*   that a corrupt size does not hold back the datagrams after it.
+*
+* Return: 1 if a valid datagram is at the start of the unparsed data, or
+*         0 if more data is needed.
+*
+******************************************************************************/
+
+static int kma_parser_search (
+    kma_parser *p) {
+
+    kma_datagram_header header;
+    uint32_t datagram_size;
+    size_t pos, pending, end;
+    const char *c;
+
+
+    assert (p);
+
+    end = p->carry_end;
+    pos = p->carry_start;
+    pending = end;
+
+    /* The '#' of the datagram type follows the 4-byte datagram size. */
+    while (pos + sizeof (kma_datagram_header) <= end) {
+        c = (const char *) memchr (p->carry + pos + 4, '#', end - pos - 4);
+        if (!c) {
+            pos = end - 4;
+            break;
+        }
+
+        pos = (size_t) (c - p->carry) - 4;
+        if (pos + sizeof (kma_datagram_header) > end) break;
+
+        memcpy (&header, p->carry + pos, sizeof (kma_datagram_header));
+
+        if (kma_valid_header (&header)) {
+            if (header.numBytesDgm <= end - pos) {
+                memcpy (&datagram_size, p->carry + pos + header.numBytesDgm - sizeof (uint32_t), sizeof (uint32_t));
+                if (datagram_size == header.numBytesDgm) {
+                    p->h->resync_bytes += pos - p->carry_start;
+                    p->carry_start = pos;
+                    p->searching = 0;
+                    return 1;
+                }
+            } else if (pending == end) {
+                pending = pos;
+            }
+        }
+
+        pos++;
+    }
+
+    /* Keep the first incomplete candidate and the data that could not be searched yet. */
+    if (pending < pos) pos = pending;
+    if (pos < p->carry_start) pos = p->carry_start;
+
+    p->h->resync_bytes += pos - p->carry_start;
+    p->carry_start = pos;
+
+    return 0;
+}
+
+
+/******************************************************************************
+*
+* kma_delta_mwc - Delta code the amplitude samples of each beam of the MWC
+*   beam data P, which ends at END, with the RX info RX.  If DECODE is true,
+*   the delta coding is undone instead.  Each sample is replaced by its
+*   difference to the previous sample of the beam, which is near zero for the
+*   slowly varying amplitudes, so the samples compress far better.  The beam
+*   entries are not changed, so beams past any corrupt entry are left as is in
+*   both directions.
+*
+******************************************************************************/
+
+static void kma_delta_mwc (
+    uint8_t *p,
+    const uint8_t *end,
+    const kma_datagram_mwc_rx_info *rx,
+    const int decode) {
+
+    uint16_t num_samples;
+    size_t sample_size;
+    size_t i, j;
+
+
+    assert (p);
+    assert (end);
+    assert (rx);
+
+    if (rx->numBytesPerBeamEntry < offsetof (kma_datagram_mwc_rx_beam_data, numSamples) + sizeof (uint16_t)) return;
+
+    sample_size = sizeof (int8_t);
+    if (rx->phaseFlag == KMA_MWC_RX_PHASE_LOW) {
+        sample_size += sizeof (int8_t);
+    } else if (rx->phaseFlag == KMA_MWC_RX_PHASE_HIGH) {
+        sample_size += sizeof (int16_t);
+    }
+
+    for (i=0; i<rx->numBeams; i++) {
+        if ((size_t) (end - p) < rx->numBytesPerBeamEntry) return;
+
+        memcpy (&num_samples, p + offsetof (kma_datagram_mwc_rx_beam_data, numSamples), sizeof (uint16_t));
+        p += rx->numBytesPerBeamEntry;
+
+        if ((size_t) (end - p) < num_samples * sample_size) return;
+
+        if (decode) {
+            for (j=1; j<num_samples; j++) {
+                p[j] = (uint8_t) (p[j] + p[j-1]);
+            }
+        } else {
+            for (j=num_samples; j>1; j--) {
+                p[j-1] = (uint8_t) (p[j-1] - p[j-2]);
+            }
+        }
+
+        p += num_samples * sample_size;
+    }
+}
+
+/******************************************************************************
+*
+* kma_count_datagram - Add the datagram returned by the file handle H to the
+*   read statistics, and call the trace function if set.  If timing is enabled,
+*   then START is the clock time when the read started and PARSE_TIME is the
+*   time spent parsing the datagram, and the rest of the time is counted as
+*   I/O.
+*
+******************************************************************************/
+
+static void kma_count_datagram (
+    kma_handle *h,
+    const uint64_t start,
+    const uint64_t parse_time) {
+
+    kma_stats *s;
+    uint64_t io_time = 0;
+    size_t i;
+
+
+    assert (h);
+
+    s = &(h->stats);
+    s->num_datagrams++;
+    s->num_bytes += h->d.header.numBytesDgm;
+
+    /* The few datagram types in a file are found after a short search. */
+    for (i=0; i<s->num_types; i++) {
+        if (s->type[i].dgmType == h->d.header.dgmType) break;
+    }
+
+    if ((i == s->num_types) && (i < KMA_SCAN_MAX_TYPES)) {
+        s->type[i].dgmType = h->d.header.dgmType;
+        s->type[i].count = 0;
+        s->type[i].bytes = 0;
+        s->num_types++;
+    }
+
+    if (i < s->num_types) {
+        s->type[i].count++;
+        s->type[i].bytes += h->d.header.numBytesDgm;
+    }
+
+    if (h->timing) {
+        io_time = cpl_clock_ns () - start - parse_time;
+        s->io_time += io_time;
+        s->parse_time += parse_time;
+    }
+
+    if (h->trace) h->trace (h, &(h->d), io_time, parse_time, h->trace_data);
+}
+
+
+/******************************************************************************
+*
+* kma_prefetch_read - Return the next datagram read ahead by the I/O thread of
+*   the file handle H, and start the I/O thread at the current file position if
+*   it is not running.  The buffer of the previous datagram is given back to the
+*   I/O thread, and the datagram is copied to the handle so that kma_retain()
+*   and the navigation store see it as if it were read directly.
+*
+* Return: A pointer to the data struct if the data was read successfully,
+*         NULL if no valid data was found or EOF was reached.
+*
+* Errors: Any error from kma_read()
+*
+******************************************************************************/
+
+static kma_data * kma_prefetch_read (
+    kma_handle *h) {
+
+    kma_prefetch *p;
+    kma_prefetch_slot *s;
+    int status;
+
+
+    assert (h);
+    assert (h->prefetch);
+
+    p = h->prefetch;
+    h->body = NULL;
+
+    if (!p->running) {
+        status = kma_prefetch_start (h);
+        if (status != CS_ENONE) {
+            h->kma_errno = status;
+            return NULL;
+        }
+    }
+
+    /* The end of the data stays in the ring until read-ahead is restarted. */
+    if (p->last) {
+        if (!p->last->body) return NULL;
+        cpl_ring_push (p->free, p->last);
+        p->last = NULL;
+    }
+
+    s = (kma_prefetch_slot *) cpl_ring_pop (p->ready);
+    if (!s) {
+        p->stalls++;
+        s = (kma_prefetch_slot *) cpl_ring_wait (p->ready);
+    }
+
+    assert (s);
+
+    p->last = s;
+    p->position = s->end;
+    h->resync_bytes = s->resync_bytes;
+    h->resync_count = s->resync_count;
+    h->io.bytes_read = s->bytes_read;
+    h->io.num_reads = s->num_reads;
+    h->io.num_seeks = s->num_seeks;
+
+    if (!s->body) {
+        if (s->status != CS_ENONE) h->kma_errno = s->status;
+        return NULL;
+    }
+
+    p->count++;
+    h->d = s->d;
+    h->body = s->body;
+
+    /* Store the navigation samples in the order the datagrams are returned. */
+    if (h->nav && (h->d.header.dgmType == KMA_DATAGRAM_SKM)) {
+        status = kma_add_nav (h->nav, &(h->d));
+        if (status != CS_ENONE) {
+            h->kma_errno = status;
+            return NULL;
+        }
+    }
+
+    return &(h->d);
+}
+
+
+/******************************************************************************
+*
+* kma_prefetch_start - Start the I/O thread of the file handle H reading ahead
+*   at the current file position.  The I/O thread uses a copy of the handle, so
+*   that the file state is owned by one thread at a time, and all buffers are
+*   given to it.
+*
+* Return: 0 if read-ahead was started, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*
+******************************************************************************/
+
+static int kma_prefetch_start (
+    kma_handle *h) {
+
+    kma_prefetch *p;
+    size_t i;
+
+
+    assert (h);
+    assert (h->prefetch);
+
+    p = h->prefetch;
+
+    assert (!p->running);
+
+    p->ready = cpl_ring_create (p->depth);
+    p->free = cpl_ring_create (p->depth);
+
+    if (!p->ready || !p->free) {
+        cpl_ring_destroy (p->ready);
+        cpl_ring_destroy (p->free);
+        p->ready = NULL;
+        p->free = NULL;
+        return CS_ENOMEM;
+    }
+
+    for (i=0; i<p->depth; i++) {
+        cpl_ring_push (p->free, &(p->slots[i]));
+    }
+
+    /* The copy reads the file without storing navigation or retaining data. */
+    p->h = *h;
+    p->h.kma_errno = CS_ENONE;
+    p->h.nav = NULL;
+    p->h.body = NULL;
+    p->h.retained = NULL;
+    p->h.released = NULL;
+    p->h.prefetch = NULL;
+    p->h.timing = 0;
+    p->h.trace = NULL;
+
+    p->last = NULL;
+    p->position = kma_tell (h);
+    p->running = 1;
+
+    cpl_worker_start (p->worker, kma_prefetch_task, p, 0);
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_prefetch_stop - Stop the I/O thread of the file handle H, if any, and move
+*   the file state back to the handle at the position after the last datagram
+*   returned by kma_read().  The datagrams read ahead are discarded, but the
+*   last datagram returned stays valid until the next read.
+*
+* Return: 0 if read-ahead was stopped or not running, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ESEEK
+*
+******************************************************************************/
+
+static int kma_prefetch_stop (
+    kma_handle *h) {
+
+    kma_prefetch *p;
+
+
+    assert (h);
+
+    p = h->prefetch;
+    if (!p || !p->running) return CS_ENONE;
+
+    /* The I/O thread finishes the datagram being read and then stops. */
+    cpl_ring_close (p->free);
+    cpl_worker_wait (p->worker);
+
+    cpl_ring_destroy (p->ready);
+    cpl_ring_destroy (p->free);
+    p->ready = NULL;
+    p->free = NULL;
+    p->running = 0;
+
+    /* The buffered file and the partition buffer may have moved or grown. */
+    h->io = p->h.io;
+    h->map_offset = p->h.map_offset;
+    h->buffer = p->h.buffer;
+    h->buffer_size = p->h.buffer_size;
+
+    if (kma_seek (h, p->position) != 0) {
+        h->kma_errno = CS_ESEEK;
+        return CS_ESEEK;
+    }
+
+    /* Discard any partially joined datagram. */
+    h->part_num = 0;
+
+    return CS_ENONE;
+}
+
+
+/******************************************************************************
+*
+* kma_prefetch_free - Stop the I/O thread of the file handle H, if any, and free
+*   the read-ahead buffers.
+*
+******************************************************************************/
+
+static void kma_prefetch_free (
+    kma_handle *h) {
+
+    kma_prefetch *p;
+    size_t i;
+
+
+    assert (h);
+
+    p = h->prefetch;
+    if (!p) return;
+
+    kma_prefetch_stop (h);
+
+    /* The last datagram points into a buffer that is freed. */
+    if (p->last) h->body = NULL;
+
+    for (i=0; i<p->depth; i++) {
+        if (p->slots[i].buffer) cpl_free (p->slots[i].buffer);
+    }
+
+    cpl_worker_destroy (p->worker);
+    cpl_free (p->slots);
+    cpl_free (p);
+
+    h->prefetch = NULL;
+}
+
+
+/******************************************************************************
+*
+* kma_prefetch_task - Run the I/O thread of the read-ahead state ARG, which
+*   reads the next datagram into each buffer given back by the consumer until
+*   the end of the data or the free ring is closed.  The datagram body is copied
+*   to the buffer unless it points into a memory-mapped file, and the buffer at
+*   the end of the data has no body and holds the error condition.
+*
+******************************************************************************/
+
+static void kma_prefetch_task (
+    void *arg,
+    const size_t task) {
+
+    kma_prefetch *p = (kma_prefetch *) arg;
+    kma_prefetch_slot *s;
+    kma_handle *h;
+    kma_data *d;
+    size_t size;
+    char *buffer;
+
+
+    assert (p);
+
+    (void) task;
+
+    h = &(p->h);
+
+    while ((s = (kma_prefetch_slot *) cpl_ring_wait (p->free)) != NULL) {
+        d = kma_read (h);
+
+        s->body = NULL;
+        s->status = h->kma_errno;
+        s->end = kma_tell (h);
+        s->resync_bytes = h->resync_bytes;
+        s->resync_count = h->resync_count;
+        s->bytes_read = h->io.bytes_read;
+        s->num_reads = h->io.num_reads;
+        s->num_seeks = h->io.num_seeks;
+
+        if (d) {
+            size = d->header.numBytesDgm - sizeof (kma_datagram_header);
+            s->d = *d;
+
+            if (h->map && (h->body >= h->map) && (h->body + size <= h->map + h->map_size)) {
+                s->body = h->body;
+            } else {
+                buffer = (char *) cpl_resize (s->buffer, size, sizeof (char), &(s->buffer_size));
+                if (buffer) {
+                    s->buffer = buffer;
+                    memcpy (s->buffer, h->body, size);
+                    kma_relocate (&(s->d.datagram), h->body, size, s->buffer);
+                    s->body = s->buffer;
+                } else {
+                    s->buffer = NULL;
+                    s->buffer_size = 0;
+                    s->status = CS_ENOMEM;
+                }
+            }
+        }
+
+        /* The ready ring holds every buffer, so it is never full. */
+        cpl_ring_push (p->ready, s);
+
+        if (!s->body) break;
+    }
 }
@@ -54,6 +54,11 @@
 
 #define CPL_NEED_FIXED_WIDTH_T  /* Tell cpl_spec.h we need fixed-width types. */
 #include "cpl_spec.h"
+#include "cpl_alloc.h"
+#include "cpl_nav.h"
+#include "cpl_table.h"
+#include "cpl_snippets.h"
+#include "cpl_wcfile.h"
 
 
 /******************************** DEFINITIONS ********************************/
@@ -1300,24 +1305,207 @@ typedef struct {
 } kma_data;
 
 
+/* KMA Datagram Index Entry (24 Bytes) */
+typedef struct CPL_ATTRIBUTE_PACKED CPL_ATTRIBUTE_GCC_STRUCT {
+    uint64_t offset;                            /* File offset of the datagram header.                                     */
+    uint32_t numBytesDgm;                       /* Datagram length in bytes.                                               */
+    uint32_t dgmType;                           /* Multibeam datagram type definition.                                     */
+    uint32_t time_sec;                          /* UTC time in seconds (Epoch 1970-01-01).                                 */
+    uint32_t time_nanosec;                      /* Nano seconds remainder.                                                 */
+} kma_index_entry;
+
+
+/* KMA Maximum Number of Datagram Types in a Scan Summary */
+#define KMA_SCAN_MAX_TYPES  64
+
+
+/* KMA Scan Datagram Type Statistics */
+typedef struct {
+    uint32_t dgmType;                           /* Multibeam datagram type definition.                                     */
+    uint64_t count;                             /* Number of datagrams of this type.                                       */
+    uint64_t bytes;                             /* Total size of the datagrams of this type in bytes.                      */
+} kma_scan_type;
+
+
+/* KMA Scan Summary */
+typedef struct {
+    uint64_t num_datagrams;                     /* Total number of datagrams.                                              */
+    uint64_t num_bytes;                         /* Total size of all datagrams in bytes.                                   */
+    uint32_t first_time_sec;                    /* Earliest datagram time in seconds (Epoch 1970-01-01).                   */
+    uint32_t first_time_nanosec;                /* Nano seconds remainder of the earliest datagram time.                   */
+    uint32_t last_time_sec;                     /* Latest datagram time in seconds (Epoch 1970-01-01).                     */
+    uint32_t last_time_nanosec;                 /* Nano seconds remainder of the latest datagram time.                     */
+    uint16_t echoSounderID;                     /* Echo sounder identity of the first datagram, e.g. 2040.                 */
+    uint8_t systemID;                           /* System ID of the first datagram.                                        */
+    size_t num_types;                           /* Number of datagram types found.                                         */
+    kma_scan_type type[KMA_SCAN_MAX_TYPES];     /* Statistics for each datagram type in the order first found.             */
+} kma_scan_summary;
+
+
+/* KMA Read Statistics */
+typedef struct {
+    uint64_t bytes_read;                        /* Number of bytes read from the file or memory map.                       */
+    uint64_t num_reads;                         /* Number of reads from the file.                                          */
+    uint64_t num_seeks;                         /* Number of seeks in the file.                                            */
+    uint64_t num_datagrams;                     /* Number of datagrams returned.                                           */
+    uint64_t num_bytes;                         /* Total size of the datagrams returned in bytes.                          */
+    uint64_t resync_bytes;                      /* Number of bytes skipped by resync.                                      */
+    uint64_t resync_count;                      /* Number of bad datagrams skipped by resync.                              */
+    uint64_t io_time;                           /* Time reading the datagrams in nanoseconds if timing is enabled.         */
+    uint64_t parse_time;                        /* Time parsing the datagrams in nanoseconds if timing is enabled.         */
+    size_t num_types;                           /* Number of datagram types returned.                                      */
+    kma_scan_type type[KMA_SCAN_MAX_TYPES];     /* Statistics for each datagram type in the order first returned.          */
+} kma_stats;
+
+
+/* KMA MRZ Sounding Columns */
+#define KMA_MRZ_COLUMN_X                    0x0001  /* x_reRefPoint_m in meters.                 */
+#define KMA_MRZ_COLUMN_Y                    0x0002  /* y_reRefPoint_m in meters.                 */
+#define KMA_MRZ_COLUMN_Z                    0x0004  /* z_reRefPoint_m in meters.                 */
+#define KMA_MRZ_COLUMN_DETECTION_TYPE       0x0008  /* detectionType.                            */
+#define KMA_MRZ_COLUMN_REFLECTIVITY1        0x0010  /* reflectivity1_dB in dB.                   */
+#define KMA_MRZ_COLUMN_BEAM_ANGLE           0x0020  /* beamAngleReRx_deg in degrees.             */
+#define KMA_MRZ_COLUMN_REFLECTIVITY2        0x0040  /* reflectivity2_dB in dB.                   */
+#define KMA_MRZ_COLUMN_TWO_WAY_TRAVEL_TIME  0x0080  /* twoWayTravelTime_sec in seconds.          */
+#define KMA_MRZ_COLUMN_QUALITY_FACTOR       0x0100  /* qualityFactor in percent.                 */
+#define KMA_MRZ_COLUMN_UNCERTAINTY_VER      0x0200  /* detectionUncertaintyVer_m in meters.      */
+#define KMA_MRZ_COLUMN_UNCERTAINTY_HOR      0x0400  /* detectionUncertaintyHor_m in meters.      */
+#define KMA_MRZ_COLUMN_DELTA_LATITUDE       0x0800  /* deltaLatitude_deg in degrees.             */
+#define KMA_MRZ_COLUMN_DELTA_LONGITUDE      0x1000  /* deltaLongitude_deg in degrees.            */
+#define KMA_MRZ_NUM_COLUMNS                 13
+
+
+/* KMA MRZ Sounding Column Arrays */
+typedef struct {
+    float *x_reRefPoint_m;                      /* Array of x_reRefPoint_m or NULL.                                        */
+    float *y_reRefPoint_m;                      /* Array of y_reRefPoint_m or NULL.                                        */
+    float *z_reRefPoint_m;                      /* Array of z_reRefPoint_m or NULL.                                        */
+    float *detectionType;                       /* Array of detectionType or NULL.                                         */
+    float *reflectivity1_dB;                    /* Array of reflectivity1_dB or NULL.                                      */
+    float *beamAngleReRx_deg;                   /* Array of beamAngleReRx_deg or NULL.                                     */
+    float *reflectivity2_dB;                    /* Array of reflectivity2_dB or NULL.                                      */
+    float *twoWayTravelTime_sec;                /* Array of twoWayTravelTime_sec or NULL.                                  */
+    float *qualityFactor;                       /* Array of qualityFactor or NULL.                                         */
+    float *detectionUncertaintyVer_m;           /* Array of detectionUncertaintyVer_m or NULL.                             */
+    float *detectionUncertaintyHor_m;           /* Array of detectionUncertaintyHor_m or NULL.                             */
+    float *deltaLatitude_deg;                   /* Array of deltaLatitude_deg or NULL.                                     */
+    float *deltaLongitude_deg;                  /* Array of deltaLongitude_deg or NULL.                                    */
+} kma_mrz_columns;
+
+
+/* KMA MWC Beam Table */
+typedef struct {
+    const uint8_t **beam;                       /* Array of num_beams pointers to the RX beam data streams.                */
+    size_t num_beams;                           /* Number of RX beams in the table.                                        */
+    size_t max_samples;                         /* Maximum numSamples of the RX beams.                                     */
+    size_t beam_alloc;                          /* Number of beam pointers allocated.                                      */
+    uint8_t phaseFlag;                          /* Phase flag of the water column datagram.                                */
+    uint8_t numBytesPerBeamEntry;               /* Bytes in MWC Rx Beam Data struct of the water column datagram.          */
+} kma_mwc_table;
+
+
 /* Opaque KMA File Handle Type */
 typedef struct kma_handle_struct kma_handle;
 
 
+/* Opaque KMA Merged Stream Handle Type */
+typedef struct kma_merge_struct kma_merge;
+
+
+/* Opaque KMA Push Parser Type */
+typedef struct kma_parser_struct kma_parser;
+
+
+/* Opaque KMA Compressed Water Column File Type */
+typedef struct kma_wc_file_struct kma_wc_file;
+
+
+/* KMA Batch Read Callback Function */
+typedef int (*kma_batch_fn) (kma_handle *, const kma_data *, const size_t, void *);
+
+
+/* KMA Trace Callback Function */
+typedef void (*kma_trace_fn) (const kma_handle *, const kma_data *, const uint64_t, const uint64_t, void *);
+
+
+/* KMA Batch Read Options */
+#define KMA_BATCH_MMAP  0x01  /* Open the files with kma_open_mmap().          */
+#define KMA_BATCH_SORT  0x02  /* Read the datagrams of each file in time order. */
+
+
 /******************************* API Functions *******************************/
 
 CPL_CLINKAGE_START
 
 kma_handle * kma_open (const char *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+kma_handle * kma_open_mmap (const char *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+kma_handle * kma_open_fd (const int, char *, const size_t, const size_t) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
 int kma_close (kma_handle *);
 kma_data * kma_read (kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+kma_data * kma_retain (kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+void kma_release (kma_handle *, kma_data *) CPL_ATTRIBUTE_NONNULL (1);
 void kma_print (FILE *, const kma_data *, const int) CPL_ATTRIBUTE_NONNULL (1);
 void kma_set_ignore_mwc (kma_handle *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
 void kma_set_ignore_mrz (kma_handle *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+void kma_set_resync (kma_handle *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+void kma_get_resync_info (const kma_handle *, uint64_t *, uint64_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+void kma_set_nav (kma_handle *, cpl_nav *) CPL_ATTRIBUTE_NONNULL (1);
+int kma_set_type_filter (kma_handle *, const uint32_t *, const size_t, const int) CPL_ATTRIBUTE_NONNULL (1);
+void kma_set_block_size (kma_handle *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_set_async_io (kma_handle *, const size_t, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_set_prefetch (kma_handle *, const size_t, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_set_decode_threads (kma_handle *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+void kma_get_prefetch_info (const kma_handle *, uint64_t *, uint64_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+void kma_set_timing (kma_handle *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+void kma_set_trace (kma_handle *, kma_trace_fn, void *) CPL_ATTRIBUTE_NONNULL (1);
+void kma_get_stats (const kma_handle *, kma_stats *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_build_index (kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_save_index (const kma_handle *, const char *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_load_index (kma_handle *, const char *) CPL_ATTRIBUTE_NONNULL_ALL;
+const kma_index_entry * kma_get_index (const kma_handle *, size_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_find_index (const kma_handle *, const uint32_t, const size_t, size_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_find_index_time (const kma_handle *, const uint32_t, const uint32_t, const uint32_t, size_t *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_seek_to_index (kma_handle *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_scan (kma_handle *, kma_scan_summary *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_copy (kma_handle *, const int, const uint64_t, const uint64_t, const uint64_t, uint64_t *) CPL_ATTRIBUTE_NONNULL (1);
+int kma_read_files (const char **, const size_t, const int, const int, kma_batch_fn, void *, int *) CPL_ATTRIBUTE_NONNULL (1) CPL_ATTRIBUTE_NONNULL (5);
+int kma_read_chunks (const char *, const size_t, const int, const int, kma_batch_fn, void *) CPL_ATTRIBUTE_NONNULL (1) CPL_ATTRIBUTE_NONNULL (5);
+kma_merge * kma_merge_open (const char **, const size_t, const int) CPL_ATTRIBUTE_NONNULL (1) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int kma_merge_close (kma_merge *);
+kma_data * kma_merge_read (kma_merge *, size_t *) CPL_ATTRIBUTE_NONNULL (1);
+kma_handle * kma_merge_get_handle (const kma_merge *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+int kma_merge_get_errno (const kma_merge *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+kma_parser * kma_parser_open (void) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int kma_parser_close (kma_parser *);
+int kma_parser_feed (kma_parser *, const void *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
+kma_data * kma_parser_read (kma_parser *) CPL_ATTRIBUTE_NONNULL_ALL;
+void kma_parser_reset (kma_parser *) CPL_ATTRIBUTE_NONNULL_ALL;
+kma_handle * kma_parser_get_handle (const kma_parser *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+int kma_parser_get_errno (const kma_parser *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+int kma_write_wc_file (kma_handle *, const char *) CPL_ATTRIBUTE_NONNULL_ALL;
+kma_wc_file * kma_wc_file_open (const char *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int kma_wc_file_close (kma_wc_file *);
+kma_data * kma_wc_file_read (kma_wc_file *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+size_t kma_wc_file_get_num_pings (const kma_wc_file *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+const cpl_wcfile_entry * kma_wc_file_get_entry (const kma_wc_file *, const size_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+size_t kma_wc_file_find_time (const kma_wc_file *, const uint32_t, const uint32_t) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+kma_handle * kma_wc_file_get_handle (const kma_wc_file *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+int kma_wc_file_get_errno (const kma_wc_file *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
 const char * kma_get_datagram_name (const uint32_t) CPL_ATTRIBUTE_RETURNS_NONNULL CPL_ATTRIBUTE_PURE;
+size_t kma_get_mrz_columns (const kma_data *, const unsigned int, const kma_mrz_columns *, const size_t, const size_t) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_alloc_mrz_columns (kma_mrz_columns *, const unsigned int, const size_t, cpl_arena *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_add_mrz_table_columns (cpl_table *, const unsigned int) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_write_mrz_table (cpl_table *, const kma_data *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_get_mrz_snippets (const kma_data *, cpl_snippets *) CPL_ATTRIBUTE_NONNULL_ALL;
 const uint8_t * kma_get_mwc_rx_beam_data (kma_datagram_mwc_rx_beam *, const uint8_t *, const uint8_t, const uint8_t) CPL_ATTRIBUTE_NONNULL_ALL;
+void kma_init_mwc_table (kma_mwc_table *) CPL_ATTRIBUTE_NONNULL_ALL;
+void kma_free_mwc_table (kma_mwc_table *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_build_mwc_table (kma_mwc_table *, const kma_datagram_mwc *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_get_mwc_table_beam (const kma_mwc_table *, const size_t, kma_datagram_mwc_rx_beam *) CPL_ATTRIBUTE_NONNULL_ALL;
+int kma_get_mwc_matrix (const kma_mwc_table *, float *, float *, const size_t) CPL_ATTRIBUTE_NONNULL (1);
 int kma_get_errno (const kma_handle *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
 int kma_identify (const char *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int kma_identify_data (const void *, const size_t) CPL_ATTRIBUTE_PURE;
 void kma_set_debug (const int);
 
 
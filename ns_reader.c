@@ -0,0 +1,373 @@
+/* ns_reader.c -- Open a Kongsberg file of either format.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   The file is opened and the start of it is read once to determine the format.
+   The file descriptor and the data already read are then given to the reader
+   of that format, so the file is not opened or read again.  The format of a
+   compressed file is determined from the start of its decoded data. */
+
+#include <stddef.h>
+#include <assert.h>
+#include "ns_reader.h"
+#include "cpl_alloc.h"
+#include "cpl_error.h"
+#include "cpl_debug.h"
+#include "cpl_file.h"
+#include "cpl_zfile.h"
+
+
+/* External Variable */
+extern int cpl_lib_debug;
+
+
+/* Private Function Prototypes */
+static ssize_t ns_read_prefix (char *, const int) CPL_ATTRIBUTE_NONNULL_ALL;
+static int ns_identify_prefix (const char *, const size_t, const int) CPL_ATTRIBUTE_NONNULL (1);
+
+
+/******************************************************************************
+*
+* ns_open - Open the file given by FILE_NAME, determine if it is an EMX or KMA
+*   file, and return a handle to the reader of that format.  The first
+*   NS_PREFIX_SIZE bytes of the file are read once and given to the reader,
+*   which returns them from its first reads.  A file written by
+*   cpl_zfile_compress() is identified from the start of its decoded data and
+*   is decoded as it is read, but a file compressed by gzip or zstd is not
+*   supported.  The caller must call ns_close() to close the file and free the
+*   memory after use.
+*
+* Return: A file handle pointer to the open file, or
+*         NULL if the file can not be opened for reading or is not a
+*           supported file format.
+*
+******************************************************************************/
+
+ns_handle * ns_open (
+    const char *file_name) {
+
+    ns_handle *h;
+    char *buffer;
+    ssize_t result;
+    int fd;
+
+
+    if (!file_name) return NULL;
+
+    cpl_debug (cpl_lib_debug, "Opening file '%s'\n", file_name);
+
+    /* Open the binary file for read-only access and save the file descriptor. */
+    fd = cpl_open (file_name, CPL_OPEN_RDONLY | CPL_OPEN_BINARY | CPL_OPEN_SEQUENTIAL);
+
+    if (fd < 0) {
+        cpl_debug (cpl_lib_debug, "Failed to open file '%s'\n", file_name);
+        return NULL;
+    }
+
+    h = (ns_handle *) cpl_malloc (sizeof (ns_handle));
+    if (!h) {
+        cpl_close (fd);
+        return NULL;
+    }
+
+    /* The prefix is read into a full file block, which becomes the block of the reader. */
+    buffer = (char *) cpl_malloc (CPL_BFILE_BLOCK_SIZE);
+    if (!buffer) goto L1;
+
+    result = ns_read_prefix (buffer, fd);
+    if (result < 0) {
+        cpl_debug (cpl_lib_debug, "Read error occurred for file '%s'\n", file_name);
+        goto L2;
+    }
+
+    /* Give the file descriptor and the prefix to the reader of the format. */
+    h->format = ns_identify_prefix (buffer, (size_t) result, fd);
+
+    if (h->format == NS_FORMAT_KMA) {
+        h->h.kma = kma_open_fd (fd, buffer, CPL_BFILE_BLOCK_SIZE, (size_t) result);
+        if (h->h.kma) return h;
+    } else if (h->format == NS_FORMAT_EMX) {
+        h->h.emx = emx_open_fd (fd, buffer, CPL_BFILE_BLOCK_SIZE, (size_t) result);
+        if (h->h.emx) return h;
+    } else {
+        cpl_debug (cpl_lib_debug, "Unknown file format for file '%s'\n", file_name);
+    }
+
+L2: cpl_free (buffer);
+L1: cpl_free (h);
+    cpl_close (fd);
+    return NULL;
+}
+
+
+/******************************************************************************
+*
+* ns_close - Close the file and free the memory of the handle H.
+*
+* Return: 0 if the file was closed, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ECLOSE
+*
+******************************************************************************/
+
+int ns_close (
+    ns_handle *h) {
+
+    int status = CS_ENONE;
+
+
+    if (!h) return CS_ENONE;
+
+    if (h->format == NS_FORMAT_KMA) {
+        status = kma_close (h->h.kma);
+    } else if (h->format == NS_FORMAT_EMX) {
+        status = emx_close (h->h.emx);
+    }
+
+    cpl_free (h);
+
+    return status;
+}
+
+
+/******************************************************************************
+*
+* ns_release - Free the memory of the handle H without closing the file.  The
+*   reader given by ns_get_emx_handle() or ns_get_kma_handle() stays open and
+*   the caller must close it with emx_close() or kma_close().
+*
+******************************************************************************/
+
+void ns_release (
+    ns_handle *h) {
+
+    cpl_free (h);
+}
+
+
+/******************************************************************************
+*
+* ns_identify - Determine the format of the file given by FILE_NAME from the
+*   first NS_PREFIX_SIZE bytes of the file, or of the decoded data if the file
+*   is compressed.
+*
+* Return: NS_FORMAT_EMX, NS_FORMAT_KMA or NS_FORMAT_UNKNOWN, or
+*         error condition if an error occurred.
+*
+* Errors: CS_EOPEN
+*         CS_ENOMEM
+*         CS_EREAD
+*
+******************************************************************************/
+
+int ns_identify (
+    const char *file_name) {
+
+    ssize_t result;
+    char *buffer;
+    int fd;
+
+
+    if (!file_name) return NS_FORMAT_UNKNOWN;
+
+    /* Open the binary file for read-only access or return on failure. */
+    fd = cpl_open (file_name, CPL_OPEN_RDONLY | CPL_OPEN_BINARY | CPL_OPEN_SEQUENTIAL);
+
+    if (fd < 0) {
+        cpl_debug (cpl_lib_debug, "Open failed for file '%s'\n", file_name);
+        return CS_EOPEN;
+    }
+
+    buffer = (char *) cpl_malloc (NS_PREFIX_SIZE);
+    if (!buffer) {
+        cpl_close (fd);
+        return CS_ENOMEM;
+    }
+
+    result = ns_read_prefix (buffer, fd);
+
+    if (result < 0) {
+        cpl_debug (cpl_lib_debug, "Read error occurred for file '%s'\n", file_name);
+        cpl_free (buffer);
+        cpl_close (fd);
+        return CS_EREAD;
+    }
+
+    result = ns_identify_prefix (buffer, (size_t) result, fd);
+
+    cpl_free (buffer);
+    cpl_close (fd);
+
+    return (int) result;
+}
+
+
+/******************************************************************************
+*
+* ns_identify_data - Determine the format of a file given the SIZE bytes DATA
+*   at the start of the file.  Both readers validate several consecutive
+*   datagram headers, and the KMA test is done first since it is the stricter.
+*
+* Return: NS_FORMAT_EMX, NS_FORMAT_KMA or NS_FORMAT_UNKNOWN.
+*
+******************************************************************************/
+
+int ns_identify_data (
+    const void *data,
+    const size_t size) {
+
+    if (kma_identify_data (data, size)) return NS_FORMAT_KMA;
+    if (emx_identify_data (data, size)) return NS_FORMAT_EMX;
+
+    return NS_FORMAT_UNKNOWN;
+}
+
+
+/******************************************************************************
+*
+* ns_get_format - Return the file format of the handle H.
+*
+******************************************************************************/
+
+int ns_get_format (
+    const ns_handle *h) {
+
+    assert (h);
+    return h->format;
+}
+
+
+/******************************************************************************
+*
+* ns_get_emx_handle - Return the EMX reader of the handle H, or NULL if the file
+*   is not an EMX file.
+*
+******************************************************************************/
+
+emx_handle * ns_get_emx_handle (
+    const ns_handle *h) {
+
+    assert (h);
+    return h->format == NS_FORMAT_EMX ? h->h.emx : NULL;
+}
+
+
+/******************************************************************************
+*
+* ns_get_kma_handle - Return the KMA reader of the handle H, or NULL if the file
+*   is not a KMA file.
+*
+******************************************************************************/
+
+kma_handle * ns_get_kma_handle (
+    const ns_handle *h) {
+
+    assert (h);
+    return h->format == NS_FORMAT_KMA ? h->h.kma : NULL;
+}
+
+
+/******************************************************************************
+*
+* ns_read_prefix - Read up to NS_PREFIX_SIZE bytes from the start of the open
+*   file descriptor FD to BUFFER.  Pipes and network files may return partial
+*   reads, so the read is repeated until the prefix is read or EOF is reached.
+*
+* Return: The number of bytes read, or
+*        -1 if a read error occurred.
+*
+******************************************************************************/
+
+static ssize_t ns_read_prefix (
+    char *buffer,
+    const int fd) {
+
+    ssize_t result;
+    size_t n = 0;
+
+
+    assert (buffer);
+
+    while (n < NS_PREFIX_SIZE) {
+        result = cpl_read (buffer + n, NS_PREFIX_SIZE - n, fd);
+        if (result < 0) return -1;
+        if (result == 0) break;
+        n += (size_t) result;
+    }
+
+    return (ssize_t) n;
+}
+
+
+/******************************************************************************
+*
+* ns_identify_prefix - Determine the format of the file of the open file
+*   descriptor FD given the N bytes BUFFER at the start of the file.  If the
+*   file is compressed, then up to NS_PREFIX_SIZE bytes of the decoded data are
+*   decoded by the calling thread and identified instead.
+*
+* Return: NS_FORMAT_EMX, NS_FORMAT_KMA or NS_FORMAT_UNKNOWN, or
+*         error condition if an error occurred.
+*
+* Errors: CS_ENOMEM
+*         CS_EREAD
+*
+******************************************************************************/
+
+static int ns_identify_prefix (
+    const char *buffer,
+    const size_t n,
+    const int fd) {
+
+    cpl_zfile *z;
+    ssize_t result;
+    char *data;
+    size_t size = 0;
+    int format;
+
+
+    assert (buffer);
+
+    if (!cpl_zfile_identify_data (buffer, n)) return ns_identify_data (buffer, n);
+
+    z = cpl_zfile_open_fd (fd, 0);
+    if (!z) return NS_FORMAT_UNKNOWN;
+
+    data = (char *) cpl_malloc (NS_PREFIX_SIZE);
+    if (!data) {
+        cpl_zfile_close (z);
+        return CS_ENOMEM;
+    }
+
+    while (size < NS_PREFIX_SIZE) {
+        result = cpl_zfile_read (z, data + size, NS_PREFIX_SIZE - size);
+        if (result < 0) {
+            cpl_debug (cpl_lib_debug, "Failed to decode compressed file\n");
+            cpl_free (data);
+            cpl_zfile_close (z);
+            return CS_EREAD;
+        }
+        if (result == 0) break;
+        size += (size_t) result;
+    }
+
+    format = ns_identify_data (data, size);
+
+    cpl_free (data);
+    cpl_zfile_close (z);
+
+    return format;
+}
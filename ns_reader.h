@@ -0,0 +1,66 @@
+/* ns_reader.h -- Header file for ns_reader.c
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. */
+
+#ifndef NS_READER_H
+#define NS_READER_H
+
+#if defined (__cplusplus)
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#include "cpl_spec.h"
+#include "emx_reader.h"
+#include "kma_reader.h"
+
+
+/* File Formats */
+#define NS_FORMAT_UNKNOWN  0  /* Not a supported file format.  */
+#define NS_FORMAT_EMX      1  /* Kongsberg .all file.          */
+#define NS_FORMAT_KMA      2  /* Kongsberg .kmall file.        */
+
+
+/* Size of the File Prefix Read to Determine the File Format */
+#define NS_PREFIX_SIZE  (1<<16)
+
+
+/* File Handle Tagged with the File Format */
+typedef struct {
+    int format;                       /* NS_FORMAT_EMX or NS_FORMAT_KMA.      */
+    union {
+        emx_handle *emx;              /* Handle if the format is NS_FORMAT_EMX. */
+        kma_handle *kma;              /* Handle if the format is NS_FORMAT_KMA. */
+    } h;
+} ns_handle;
+
+
+/******************************* API Functions *******************************/
+
+CPL_CLINKAGE_START
+
+ns_handle * ns_open (const char *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int ns_close (ns_handle *);
+void ns_release (ns_handle *);
+int ns_identify (const char *) CPL_ATTRIBUTE_WARN_UNUSED_RESULT;
+int ns_identify_data (const void *, const size_t) CPL_ATTRIBUTE_PURE;
+int ns_get_format (const ns_handle *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+emx_handle * ns_get_emx_handle (const ns_handle *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+kma_handle * ns_get_kma_handle (const ns_handle *) CPL_ATTRIBUTE_NONNULL_ALL CPL_ATTRIBUTE_PURE;
+
+CPL_CLINKAGE_END
+
+#endif /* NS_READER_H */
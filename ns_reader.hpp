@@ -0,0 +1,477 @@
+/* ns_reader.hpp -- C++17 interface to the EMX and KMA readers.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   This header has no source file.  The classes own the C handles, so a file
+   is closed when its object is destroyed, and the datagrams are read through
+   an input range or dispatched by type to a visitor:
+
+     ns::kma::file f ("0001.kmall");
+
+     for (const kma_data &d : f) { ... }
+
+     ns::kma::visit<KMA_DATAGRAM_MRZ, KMA_DATAGRAM_SPO> (f, ns::overloaded {
+         [] (ns::kma::mrz_view v) { ... v->rxInfo->numSoundingsMaxMain ... },
+         [] (ns::kma::spo_view v) { ... v->data->correctedLat_deg ... }
+     });
+
+   The types given to visit() are set as the type filter of the reader, so
+   datagrams of other types are skipped without being read or parsed, and the
+   dispatch on the type is a sequence of compares that is inlined.  As in the
+   C API, a datagram and its views are only valid until the next read. */
+
+#ifndef NS_READER_HPP
+#define NS_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "cpl_error.h"
+#include "emx_reader.h"
+#include "kma_reader.h"
+#include "ns_reader.h"
+
+namespace ns {
+
+
+/* Exception Thrown if a File Can Not Be Opened */
+class error : public std::runtime_error {
+public:
+    error (const std::string &what, const int code) : std::runtime_error (what), code_ (code) {}
+    int code () const noexcept { return code_; }
+private:
+    int code_;                        /* CS_E* error condition.                    */
+};
+
+
+/* Combine Lambdas into One Visitor */
+template <typename... Fs> struct overloaded : Fs... { using Fs::operator()...; };
+template <typename... Fs> overloaded (Fs...) -> overloaded<Fs...>;
+
+
+namespace detail {
+
+/* Input Iterator Over the Datagrams of a File */
+template <typename File, typename Data> class iterator {
+public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef Data value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Data *pointer;
+    typedef const Data &reference;
+
+    iterator () noexcept : file_ (nullptr), d_ (nullptr) {}
+    explicit iterator (File *file) : file_ (file), d_ (file->read ()) {}
+
+    reference operator* () const noexcept { return *d_; }
+    pointer operator-> () const noexcept { return d_; }
+    iterator & operator++ () { d_ = file_->read (); return *this; }
+    void operator++ (int) { ++*this; }
+
+    /* All iterators at EOF are equal, which is all that an input range needs. */
+    bool operator== (const iterator &other) const noexcept { return d_ == other.d_; }
+    bool operator!= (const iterator &other) const noexcept { return d_ != other.d_; }
+
+private:
+    File *file_;                      /* File read by the iterator.                */
+    const Data *d_;                   /* Current datagram, or NULL at EOF.         */
+};
+
+/* Datagram Types Known at Compile Time */
+template <typename T, T... Types> struct type_set {
+    static_assert (sizeof... (Types) > 0, "at least one datagram type must be handled");
+    static constexpr T value[] = {Types...};
+    static constexpr std::size_t size = sizeof... (Types);
+};
+
+} /* namespace detail */
+
+
+/******************************************************************************
+*
+* KMA Files
+*
+******************************************************************************/
+
+namespace kma {
+
+
+/* Owner of a KMA File Handle */
+class file {
+public:
+    typedef detail::iterator<file, kma_data> iterator;
+
+    /* Open the file, memory-mapped if MMAP is true. */
+    explicit file (const char *file_name, const bool mmap = false)
+        : h_ (mmap ? kma_open_mmap (file_name) : kma_open (file_name)) {
+        if (!h_) throw error (std::string ("Failed to open file '") + file_name + "'", CS_EOPEN);
+    }
+
+    /* Take ownership of a handle, such as one opened by kma_open_fd(). */
+    explicit file (kma_handle *h) noexcept : h_ (h) {}
+
+    /* Take ownership of a handle opened by ns_open() and keep its reader.  If
+       H is NULL or the file has another format, then H is closed and this throws. */
+    explicit file (ns_handle *h) : h_ (h ? ns_get_kma_handle (h) : nullptr) {
+        if (!h_) {
+            ns_close (h);
+            throw error ("File is not in the KMA format", CS_EINVAL);
+        }
+        ns_release (h);
+    }
+
+    file (file &&other) noexcept : h_ (std::exchange (other.h_, nullptr)) {}
+    file & operator= (file &&other) noexcept { std::swap (h_, other.h_); return *this; }
+    file (const file &) = delete;
+    file & operator= (const file &) = delete;
+    ~file () { if (h_) kma_close (h_); }
+
+    /* The C handle, for the functions that are not wrapped. */
+    kma_handle * get () const noexcept { return h_; }
+
+    /* Give up ownership of the handle. */
+    kma_handle * release () noexcept { return std::exchange (h_, nullptr); }
+
+    /* Read the next datagram, or return NULL at EOF or if an error occurred. */
+    const kma_data * read () { return kma_read (h_); }
+
+    /* Error condition of the last failed operation. */
+    int errno_value () const noexcept { return kma_get_errno (h_); }
+
+    iterator begin () { return iterator (this); }
+    iterator end () noexcept { return iterator (); }
+
+private:
+    kma_handle *h_;
+};
+
+
+/* Datagram Member of kma_datagram for Each Datagram Type */
+template <std::uint32_t Type> struct traits;
+
+#define NS_KMA_TRAITS(type, member)                                                        \
+    template <> struct traits<type> {                                                      \
+        typedef decltype (kma_datagram::member) datagram_type;                             \
+        static const datagram_type & get (const kma_data &d) noexcept { return d.datagram.member; } \
+    }
+
+NS_KMA_TRAITS (KMA_DATAGRAM_IIP, iip);
+NS_KMA_TRAITS (KMA_DATAGRAM_IOP, iop);
+NS_KMA_TRAITS (KMA_DATAGRAM_IBE, ibe);
+NS_KMA_TRAITS (KMA_DATAGRAM_IBR, ibr);
+NS_KMA_TRAITS (KMA_DATAGRAM_IBS, ibs);
+NS_KMA_TRAITS (KMA_DATAGRAM_MRZ, mrz);
+NS_KMA_TRAITS (KMA_DATAGRAM_MWC, mwc);
+NS_KMA_TRAITS (KMA_DATAGRAM_SPO, spo);
+NS_KMA_TRAITS (KMA_DATAGRAM_SKM, skm);
+NS_KMA_TRAITS (KMA_DATAGRAM_SVP, svp);
+NS_KMA_TRAITS (KMA_DATAGRAM_SVT, svt);
+NS_KMA_TRAITS (KMA_DATAGRAM_SCL, scl);
+NS_KMA_TRAITS (KMA_DATAGRAM_SDE, sde);
+NS_KMA_TRAITS (KMA_DATAGRAM_SHI, shi);
+NS_KMA_TRAITS (KMA_DATAGRAM_CPO, cpo);
+NS_KMA_TRAITS (KMA_DATAGRAM_CHE, che);
+NS_KMA_TRAITS (KMA_DATAGRAM_FCF, fcf);
+
+#undef NS_KMA_TRAITS
+
+
+/* Typed View of a Datagram of Type TYPE */
+template <std::uint32_t Type> class view {
+public:
+    typedef typename traits<Type>::datagram_type datagram_type;
+    static constexpr std::uint32_t type = Type;
+
+    explicit view (const kma_data &d) noexcept : d_ (&d) {}
+
+    const kma_datagram_header & header () const noexcept { return d_->header; }
+    const datagram_type & datagram () const noexcept { return traits<Type>::get (*d_); }
+    const datagram_type * operator-> () const noexcept { return &datagram (); }
+    const kma_data & data () const noexcept { return *d_; }
+
+private:
+    const kma_data *d_;
+};
+
+typedef view<KMA_DATAGRAM_IIP> iip_view;
+typedef view<KMA_DATAGRAM_IOP> iop_view;
+typedef view<KMA_DATAGRAM_IBE> ibe_view;
+typedef view<KMA_DATAGRAM_IBR> ibr_view;
+typedef view<KMA_DATAGRAM_IBS> ibs_view;
+typedef view<KMA_DATAGRAM_MRZ> mrz_view;
+typedef view<KMA_DATAGRAM_MWC> mwc_view;
+typedef view<KMA_DATAGRAM_SPO> spo_view;
+typedef view<KMA_DATAGRAM_SKM> skm_view;
+typedef view<KMA_DATAGRAM_SVP> svp_view;
+typedef view<KMA_DATAGRAM_SVT> svt_view;
+typedef view<KMA_DATAGRAM_SCL> scl_view;
+typedef view<KMA_DATAGRAM_SDE> sde_view;
+typedef view<KMA_DATAGRAM_SHI> shi_view;
+typedef view<KMA_DATAGRAM_CPO> cpo_view;
+typedef view<KMA_DATAGRAM_CHE> che_view;
+typedef view<KMA_DATAGRAM_FCF> fcf_view;
+
+
+/* Call FN with the view of D if D has one of the types TYPES. */
+template <std::uint32_t... Types, typename F> inline bool dispatch (const kma_data &d, F &&fn) {
+    return ((d.header.dgmType == Types ? (fn (view<Types> (d)), true) : false) || ...);
+}
+
+
+/******************************************************************************
+*
+* visit - Read the datagrams of the file F with one of the types TYPES and call
+*   FN with the view of each datagram.  The type filter of F is set to TYPES,
+*   so other datagrams are skipped by the reader.
+*
+* Return: The number of datagrams visited.
+*
+******************************************************************************/
+
+template <std::uint32_t... Types, typename F> std::size_t visit (file &f, F &&fn) {
+
+    typedef detail::type_set<std::uint32_t, Types...> types;
+    std::size_t n = 0;
+    const kma_data *d;
+
+    static_assert ((std::is_invocable_v<F &, view<Types>> && ...), "visitor must accept the view of every handled type");
+
+    if (kma_set_type_filter (f.get (), types::value, types::size, 0) != 0) {
+        throw error ("Failed to set the datagram type filter", f.errno_value ());
+    }
+
+    while ((d = f.read ()) != nullptr) {
+        if (dispatch<Types...> (*d, fn)) n++;
+    }
+
+    return n;
+}
+
+} /* namespace kma */
+
+
+/******************************************************************************
+*
+* EMX Files
+*
+******************************************************************************/
+
+namespace emx {
+
+
+/* Owner of an EMX File Handle */
+class file {
+public:
+    typedef detail::iterator<file, emx_data> iterator;
+
+    /* Open the file, memory-mapped if MMAP is true. */
+    explicit file (const char *file_name, const bool mmap = false)
+        : h_ (mmap ? emx_open_mmap (file_name) : emx_open (file_name)) {
+        if (!h_) throw error (std::string ("Failed to open file '") + file_name + "'", CS_EOPEN);
+    }
+
+    /* Take ownership of a handle, such as one opened by emx_open_fd(). */
+    explicit file (emx_handle *h) noexcept : h_ (h) {}
+
+    /* Take ownership of a handle opened by ns_open() and keep its reader.  If
+       H is NULL or the file has another format, then H is closed and this throws. */
+    explicit file (ns_handle *h) : h_ (h ? ns_get_emx_handle (h) : nullptr) {
+        if (!h_) {
+            ns_close (h);
+            throw error ("File is not in the EMX format", CS_EINVAL);
+        }
+        ns_release (h);
+    }
+
+    file (file &&other) noexcept : h_ (std::exchange (other.h_, nullptr)) {}
+    file & operator= (file &&other) noexcept { std::swap (h_, other.h_); return *this; }
+    file (const file &) = delete;
+    file & operator= (const file &) = delete;
+    ~file () { if (h_) emx_close (h_); }
+
+    /* The C handle, for the functions that are not wrapped. */
+    emx_handle * get () const noexcept { return h_; }
+
+    /* Give up ownership of the handle. */
+    emx_handle * release () noexcept { return std::exchange (h_, nullptr); }
+
+    /* Read the next datagram, or return NULL at EOF or if an error occurred. */
+    const emx_data * read () { return emx_read (h_); }
+
+    /* Error condition of the last failed operation. */
+    int errno_value () const noexcept { return emx_get_errno (h_); }
+
+    iterator begin () { return iterator (this); }
+    iterator end () noexcept { return iterator (); }
+
+private:
+    emx_handle *h_;
+};
+
+
+/* Datagram Member of emx_datagram for Each Datagram Type */
+template <std::uint8_t Type> struct traits;
+
+#define NS_EMX_TRAITS(type, member)                                                        \
+    template <> struct traits<type> {                                                      \
+        typedef decltype (emx_datagram::member) datagram_type;                             \
+        static const datagram_type & get (const emx_data &d) noexcept { return d.datagram.member; } \
+    }
+
+NS_EMX_TRAITS (EMX_DATAGRAM_DEPTH, depth);
+NS_EMX_TRAITS (EMX_DATAGRAM_XYZ, xyz);
+NS_EMX_TRAITS (EMX_DATAGRAM_DEPTH_NOMINAL, depth_nominal);
+NS_EMX_TRAITS (EMX_DATAGRAM_EXTRA_DETECTIONS, extra_detect);
+NS_EMX_TRAITS (EMX_DATAGRAM_CENTRAL_BEAMS, central_beams);
+NS_EMX_TRAITS (EMX_DATAGRAM_RRA_101, rra_101);
+NS_EMX_TRAITS (EMX_DATAGRAM_RRA_70, rra_70);
+NS_EMX_TRAITS (EMX_DATAGRAM_RRA_102, rra_102);
+NS_EMX_TRAITS (EMX_DATAGRAM_RRA_78, rra_78);
+NS_EMX_TRAITS (EMX_DATAGRAM_SEABED_IMAGE_83, seabed_83);
+NS_EMX_TRAITS (EMX_DATAGRAM_SEABED_IMAGE_89, seabed_89);
+NS_EMX_TRAITS (EMX_DATAGRAM_WATER_COLUMN, wc);
+NS_EMX_TRAITS (EMX_DATAGRAM_QUALITY_FACTOR, qf);
+NS_EMX_TRAITS (EMX_DATAGRAM_ATTITUDE, attitude);
+NS_EMX_TRAITS (EMX_DATAGRAM_ATTITUDE_NETWORK, attitude_network);
+NS_EMX_TRAITS (EMX_DATAGRAM_CLOCK, clock);
+NS_EMX_TRAITS (EMX_DATAGRAM_HEIGHT, height);
+NS_EMX_TRAITS (EMX_DATAGRAM_HEADING, heading);
+NS_EMX_TRAITS (EMX_DATAGRAM_POSITION, position);
+NS_EMX_TRAITS (EMX_DATAGRAM_SINGLE_BEAM_DEPTH, sb_depth);
+NS_EMX_TRAITS (EMX_DATAGRAM_TIDE, tide);
+NS_EMX_TRAITS (EMX_DATAGRAM_SSSV, sssv);
+NS_EMX_TRAITS (EMX_DATAGRAM_SVP, svp);
+NS_EMX_TRAITS (EMX_DATAGRAM_SVP_EM3000, svp_em3000);
+NS_EMX_TRAITS (EMX_DATAGRAM_KM_SSP_OUTPUT, ssp_output);
+NS_EMX_TRAITS (EMX_DATAGRAM_INSTALL_PARAMS, install_params);
+NS_EMX_TRAITS (EMX_DATAGRAM_INSTALL_PARAMS_STOP, install_params_stop);
+NS_EMX_TRAITS (EMX_DATAGRAM_INSTALL_PARAMS_REMOTE, install_params_remote);
+NS_EMX_TRAITS (EMX_DATAGRAM_RUNTIME_PARAMS, runtime_params);
+NS_EMX_TRAITS (EMX_DATAGRAM_EXTRA_PARAMS, extra_params);
+NS_EMX_TRAITS (EMX_DATAGRAM_PU_OUTPUT, pu_output);
+NS_EMX_TRAITS (EMX_DATAGRAM_PU_STATUS, pu_status);
+NS_EMX_TRAITS (EMX_DATAGRAM_PU_BIST_RESULT, pu_bist_result);
+NS_EMX_TRAITS (EMX_DATAGRAM_TRANSDUCER_TILT, tilt);
+NS_EMX_TRAITS (EMX_DATAGRAM_HISAS_STATUS, hisas_status);
+NS_EMX_TRAITS (EMX_DATAGRAM_SIDESCAN_STATUS, sidescan_status);
+NS_EMX_TRAITS (EMX_DATAGRAM_HISAS_1032_SIDESCAN, sidescan_data);
+NS_EMX_TRAITS (EMX_DATAGRAM_NAVIGATION_OUTPUT, navigation_output);
+
+#undef NS_EMX_TRAITS
+
+
+/* Typed View of a Datagram of Type TYPE */
+template <std::uint8_t Type> class view {
+public:
+    typedef typename traits<Type>::datagram_type datagram_type;
+    static constexpr std::uint8_t type = Type;
+
+    explicit view (const emx_data &d) noexcept : d_ (&d) {}
+
+    const emx_datagram_header & header () const noexcept { return d_->header; }
+    const datagram_type & datagram () const noexcept { return traits<Type>::get (*d_); }
+    const datagram_type * operator-> () const noexcept { return &datagram (); }
+    const emx_data & data () const noexcept { return *d_; }
+
+private:
+    const emx_data *d_;
+};
+
+typedef view<EMX_DATAGRAM_DEPTH> depth68_view;
+typedef view<EMX_DATAGRAM_XYZ> xyz88_view;
+typedef view<EMX_DATAGRAM_DEPTH_NOMINAL> depth_nominal_view;
+typedef view<EMX_DATAGRAM_EXTRA_DETECTIONS> extra_detect_view;
+typedef view<EMX_DATAGRAM_CENTRAL_BEAMS> central_beams_view;
+typedef view<EMX_DATAGRAM_RRA_101> rra101_view;
+typedef view<EMX_DATAGRAM_RRA_70> rra70_view;
+typedef view<EMX_DATAGRAM_RRA_102> rra102_view;
+typedef view<EMX_DATAGRAM_RRA_78> rra78_view;
+typedef view<EMX_DATAGRAM_SEABED_IMAGE_83> seabed83_view;
+typedef view<EMX_DATAGRAM_SEABED_IMAGE_89> seabed89_view;
+typedef view<EMX_DATAGRAM_WATER_COLUMN> wc_view;
+typedef view<EMX_DATAGRAM_QUALITY_FACTOR> qf_view;
+typedef view<EMX_DATAGRAM_ATTITUDE> attitude_view;
+typedef view<EMX_DATAGRAM_ATTITUDE_NETWORK> attitude_network_view;
+typedef view<EMX_DATAGRAM_CLOCK> clock_view;
+typedef view<EMX_DATAGRAM_HEIGHT> height_view;
+typedef view<EMX_DATAGRAM_HEADING> heading_view;
+typedef view<EMX_DATAGRAM_POSITION> position_view;
+typedef view<EMX_DATAGRAM_SINGLE_BEAM_DEPTH> sb_depth_view;
+typedef view<EMX_DATAGRAM_TIDE> tide_view;
+typedef view<EMX_DATAGRAM_SSSV> sssv_view;
+typedef view<EMX_DATAGRAM_SVP> svp_view;
+typedef view<EMX_DATAGRAM_SVP_EM3000> svp_em3000_view;
+typedef view<EMX_DATAGRAM_KM_SSP_OUTPUT> ssp_output_view;
+typedef view<EMX_DATAGRAM_INSTALL_PARAMS> install_params_view;
+typedef view<EMX_DATAGRAM_INSTALL_PARAMS_STOP> install_params_stop_view;
+typedef view<EMX_DATAGRAM_INSTALL_PARAMS_REMOTE> install_params_remote_view;
+typedef view<EMX_DATAGRAM_RUNTIME_PARAMS> runtime_params_view;
+typedef view<EMX_DATAGRAM_EXTRA_PARAMS> extra_params_view;
+typedef view<EMX_DATAGRAM_PU_OUTPUT> pu_output_view;
+typedef view<EMX_DATAGRAM_PU_STATUS> pu_status_view;
+typedef view<EMX_DATAGRAM_PU_BIST_RESULT> pu_bist_result_view;
+typedef view<EMX_DATAGRAM_TRANSDUCER_TILT> tilt_view;
+typedef view<EMX_DATAGRAM_HISAS_STATUS> hisas_status_view;
+typedef view<EMX_DATAGRAM_SIDESCAN_STATUS> sidescan_status_view;
+typedef view<EMX_DATAGRAM_HISAS_1032_SIDESCAN> sidescan_data_view;
+typedef view<EMX_DATAGRAM_NAVIGATION_OUTPUT> navigation_output_view;
+
+
+/* Call FN with the view of D if D has one of the types TYPES. */
+template <std::uint8_t... Types, typename F> inline bool dispatch (const emx_data &d, F &&fn) {
+    return ((d.header.datagram_type == Types ? (fn (view<Types> (d)), true) : false) || ...);
+}
+
+
+/******************************************************************************
+*
+* visit - Read the datagrams of the file F with one of the types TYPES and call
+*   FN with the view of each datagram.  The type filter of F is set to TYPES,
+*   so other datagrams are skipped by the reader without verifying their
+*   checksum.
+*
+* Return: The number of datagrams visited.
+*
+******************************************************************************/
+
+template <std::uint8_t... Types, typename F> std::size_t visit (file &f, F &&fn) {
+
+    typedef detail::type_set<std::uint8_t, Types...> types;
+    std::size_t n = 0;
+    const emx_data *d;
+
+    static_assert ((std::is_invocable_v<F &, view<Types>> && ...), "visitor must accept the view of every handled type");
+
+    if (emx_set_type_filter (f.get (), types::value, types::size, 0) != 0) {
+        throw error ("Failed to set the datagram type filter", f.errno_value ());
+    }
+
+    while ((d = f.read ()) != nullptr) {
+        if (dispatch<Types...> (*d, fn)) n++;
+    }
+
+    return n;
+}
+
+} /* namespace emx */
+
+} /* namespace ns */
+
+#endif /* NS_READER_HPP */